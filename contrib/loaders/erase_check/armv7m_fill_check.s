@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+	Count the words at the start of each block that hold the fill value,
+	e.g. to find the unused part of a stack.
+
+	parameters:
+	r0 - pointer to struct { uint32_t size_in_result_out, uint32_t addr }
+	r1 - fill value
+
+	size is in words, the result is the number of words left from the
+	first one that doesn't match to the end of the block, 0 if all match.
+*/
+
+	.text
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+	.thumb_func
+
+	.align	2
+
+BLOCK_SIZE_RESULT	= 0
+BLOCK_ADDRESS		= 4
+SIZEOF_STRUCT_BLOCK	= 8
+
+start:
+block_loop:
+	ldr	r2, [r0, #BLOCK_SIZE_RESULT]	/* get size */
+	tst	r2, r2
+	beq	done
+
+	ldr	r3, [r0, #BLOCK_ADDRESS]	/* get address */
+
+word_loop:
+	ldr	r4, [r3]	/* read word */
+	adds	r3, #4
+
+	cmp	r4, r1
+	bne	save_result
+
+	subs	r2, #1
+	bne	word_loop
+
+save_result:
+	str	r2, [r0, #BLOCK_SIZE_RESULT]
+	adds	r0, #SIZEOF_STRUCT_BLOCK
+	b	block_loop
+
+/* Avoid padding at .text segment end. Otherwise exit point check fails. */
+        .skip   ( . - start + 2) & 2, 0
+
+done:
+	bkpt	#0
+
+	.end
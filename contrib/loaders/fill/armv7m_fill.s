@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+	Fill memory with a value, so that only the value and the range have
+	to be sent to the target.
+
+	parameters:
+	r0 - address, aligned to the access size
+	r1 - end address, address + access size * count
+	r2 - fill value
+	r3 - access size in bytes: 1, 2 or 4
+*/
+
+	.text
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+	.thumb_func
+
+	.align	2
+
+start:
+	cmp	r3, #2
+	beq	fill16
+	bhi	fill32
+
+fill8:
+	strb	r2, [r0]
+	adds	r0, #1
+	cmp	r0, r1
+	bne	fill8
+	b	done
+
+fill16:
+	strh	r2, [r0]
+	adds	r0, #2
+	cmp	r0, r1
+	bne	fill16
+	b	done
+
+fill32:
+	str	r2, [r0]
+	adds	r0, #4
+	cmp	r0, r1
+	bne	fill32
+
+done:
+	bkpt	#0
+
+	.end
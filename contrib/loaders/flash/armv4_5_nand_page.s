@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+	.text
+	.arm
+
+/* Runs a page script, see armv7m_nand_page.s for the format.
+ *
+ * Inputs:
+ *  r0	NAND data address (byte wide)
+ *  r1	NAND command address
+ *  r2	NAND address address
+ *  r3	script address
+ *  r4	buffer address
+ * Outputs:
+ *  r5	last status byte read by a wait
+ */
+next:
+	ldr		r6, [r3], #4
+	mov		r7, r6, lsr #24
+	bic		r6, r6, #0xff000000
+	cmp		r7, #1
+	strbeq	r6, [r1]
+	beq		next
+	cmp		r7, #2
+	strbeq	r6, [r2]
+	beq		next
+	cmp		r7, #3
+	beq		write
+	cmp		r7, #4
+	beq		read
+	cmp		r7, #5
+	beq		wait
+	b		done
+
+write:
+	subs	r6, r6, #1
+	bmi		next
+	ldrb	r7, [r4], #1
+	strb	r7, [r0]
+	b		write
+
+read:
+	subs	r6, r6, #1
+	bmi		next
+	ldrb	r7, [r0]
+	strb	r7, [r4], #1
+	b		read
+
+wait:
+	mov		r7, #0x70
+	strb	r7, [r1]
+poll:
+	ldrb	r5, [r0]
+	tst		r5, #0x40
+	beq		poll
+	b		next
+
+	/* exit: ARMv4 needs hardware breakpoint */
+done:
+	bkpt	#0
+
+	.end
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+	.text
+	.syntax unified
+	.arch armv7-m
+	.thumb
+	.thumb_func
+
+	.align 4
+
+/* Runs a page script of 32-bit words, opcode << 24 | argument:
+ *  0	end of script
+ *  1	write argument to the command latch
+ *  2	write argument to the address latch
+ *  3	write argument bytes from the buffer to the data register
+ *  4	read argument bytes from the data register into the buffer
+ *  5	issue READ STATUS and poll until the chip is ready
+ *
+ * Inputs:
+ *  r0	NAND data address (byte wide)
+ *  r1	NAND command address
+ *  r2	NAND address address
+ *  r3	script address
+ *  r4	buffer address
+ * Outputs:
+ *  r5	last status byte read by a wait
+ */
+next:
+	ldr		r6, [r3], #4
+	lsrs	r7, r6, #24
+	bic		r6, r6, #0xff000000
+	cmp		r7, #1
+	beq		cmd
+	cmp		r7, #2
+	beq		addr
+	cmp		r7, #3
+	beq		write
+	cmp		r7, #4
+	beq		read
+	cmp		r7, #5
+	beq		wait
+	b		done
+
+cmd:
+	strb	r6, [r1]
+	b		next
+
+addr:
+	strb	r6, [r2]
+	b		next
+
+write:
+	subs	r6, r6, #1
+	bmi		next
+	ldrb	r7, [r4], #1
+	strb	r7, [r0]
+	b		write
+
+read:
+	subs	r6, r6, #1
+	bmi		next
+	ldrb	r7, [r0]
+	strb	r7, [r4], #1
+	b		read
+
+wait:
+	movs	r7, #0x70
+	strb	r7, [r1]
+poll:
+	ldrb	r5, [r0]
+	tst		r5, #0x40
+	beq		poll
+	b		next
+
+done:
+	bkpt	#0
+
+	.end
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * Parameter block of the CFI write buffer loaders, an array of 32 bit words
+ * in target byte order. Keep in sync with cfi_write_buffers_async().
+ */
+
+#define CFI_ASYNC_FIFO_END	0	/* end of the fifo in the work area */
+#define CFI_ASYNC_BUF_WORDS	4	/* bus words per write buffer */
+#define CFI_ASYNC_BUF_COUNT	8	/* word count command, BUF_WORDS - 1 */
+#define CFI_ASYNC_CMD_START	12	/* 0xe8 (intel) or 0x25 (amd) */
+#define CFI_ASYNC_CMD_COMMIT	16	/* 0xd0 (intel) or 0x29 (amd) */
+#define CFI_ASYNC_READY	20	/* intel SR.7, amd DQ7 */
+#define CFI_ASYNC_ERROR	24	/* intel SR error bits, amd DQ5 and DQ1 */
+#define CFI_ASYNC_UNLOCK1	28	/* amd unlock addresses */
+#define CFI_ASYNC_UNLOCK2	32
+
+#define CFI_ASYNC_PARAMS_SIZE	36
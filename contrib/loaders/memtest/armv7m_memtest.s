@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+	Memory test: write a pattern to every word of a region, then read
+	it back and log the words that don't match.
+
+	parameters:
+	r0 - address, word aligned
+	r1 - size in words, not 0
+	r2 - test: 0 walking ones, 1 address in address, 2 LFSR pattern
+	r3 - first pattern for the walking ones, state for the LFSR, not 0
+	r4 - pointer to the failure log, entries of
+	     struct { uint32_t address, uint32_t expected, uint32_t actual }
+	r5 - number of entries in the failure log
+
+	result:
+	r0 - number of failures, more than the log holds if it overflowed
+*/
+
+	.text
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+	.thumb_func
+
+	.align	2
+
+TEST_ADDRESS		= 1
+LFSR_POLY_HIGH		= 0x80		/* 0x80200003, taps 32, 22, 2, 1 */
+LFSR_POLY_MID		= 0x20
+LFSR_POLY_LOW		= 3
+SIZEOF_STRUCT_ENTRY	= 12
+
+start:
+	mov	r8, r0		/* address */
+	mov	r9, r1		/* size */
+	mov	r10, r2		/* test */
+	mov	lr, r3		/* first pattern */
+	movs	r3, #0
+	mov	r11, r3		/* failures */
+	mov	r12, r3		/* pass, 0 writes, 1 verifies */
+
+	movs	r6, #LFSR_POLY_HIGH
+	lsls	r6, r6, #24
+	movs	r3, #LFSR_POLY_MID
+	lsls	r3, r3, #16
+	orrs	r6, r3
+	adds	r6, #LFSR_POLY_LOW
+
+pass_loop:
+	mov	r0, r8
+	mov	r1, r9
+	mov	r7, lr		/* pattern state */
+
+word_loop:
+	mov	r3, r10
+	cmp	r3, #TEST_ADDRESS
+	beq	address
+	bhi	lfsr
+
+walking:
+	mov	r2, r7
+	movs	r3, #31
+	rors	r7, r3		/* rotate left by one */
+	b	have_pattern
+
+lfsr:
+	lsrs	r7, r7, #1
+	bcc	lfsr_done
+	eors	r7, r6
+lfsr_done:
+	mov	r2, r7
+	b	have_pattern
+
+address:
+	mov	r2, r0
+
+have_pattern:
+	mov	r3, r12
+	cmp	r3, #0
+	bne	verify
+	str	r2, [r0]
+	b	next_word
+
+verify:
+	ldr	r3, [r0]
+	cmp	r3, r2
+	beq	next_word
+
+	cmp	r5, #0		/* log full */
+	beq	count_failure
+	str	r0, [r4, #0]
+	str	r2, [r4, #4]
+	str	r3, [r4, #8]
+	adds	r4, #SIZEOF_STRUCT_ENTRY
+	subs	r5, #1
+count_failure:
+	mov	r3, r11
+	adds	r3, #1
+	mov	r11, r3
+
+next_word:
+	adds	r0, #4
+	subs	r1, #1
+	bne	word_loop
+
+	mov	r3, r12
+	adds	r3, #1
+	mov	r12, r3
+	cmp	r3, #2
+	bne	pass_loop
+
+	mov	r0, r11
+
+/* Avoid padding at .text segment end. Otherwise exit point check fails. */
+	.skip	( . - start + 2) & 2, 0
+
+done:
+	bkpt	#0
+
+	.end
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Decoder for the binary RISC-V DMI scan traces written by
+ * "riscv dmi_trace <file>", see src/target/riscv/batch.h for the format.
+ *
+ * Build with:  cc -o riscv_dmi_trace riscv_dmi_trace.c
+ *
+ * Without options every scan is printed, one per line, much like the
+ * debug log does. With -s only a summary is printed: the number of scans
+ * per op and status, the busy responses per DM register and the longest
+ * run of consecutive busy responses, which is what usually makes a slow
+ * target slow.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC		"OCDDMI"
+#define TRACE_VERSION		1
+#define TRACE_HEADER_SIZE	8
+#define TRACE_RECORD_SIZE	32
+#define TRACE_NOT_CAPTURED	0xff
+
+#define DMI_OP_BUSY		3
+#define NUM_ADDRESSES		0x80
+
+struct record {
+	uint64_t time_us;
+	uint32_t out_address;
+	uint32_t out_data;
+	uint32_t in_address;
+	uint32_t in_data;
+	uint16_t tap;
+	uint16_t idle;
+	uint8_t out_op;
+	uint8_t in_op;
+	uint8_t num_bits;
+};
+
+static const char * const op_string[] = {"-", "r", "w", "?"};
+static const char * const status_string[] = {"+", "?", "F", "b"};
+
+static const char *dm_register_name(uint32_t address)
+{
+	static char name[16];
+
+	switch (address) {
+	case 0x10: return "dmcontrol";
+	case 0x11: return "dmstatus";
+	case 0x12: return "hartinfo";
+	case 0x13: return "haltsum1";
+	case 0x14: return "hawindowsel";
+	case 0x15: return "hawindow";
+	case 0x16: return "abstractcs";
+	case 0x17: return "command";
+	case 0x18: return "abstractauto";
+	case 0x19: return "confstrptr0";
+	case 0x1d: return "nextdm";
+	case 0x30: return "authdata";
+	case 0x34: return "haltsum2";
+	case 0x35: return "haltsum3";
+	case 0x38: return "sbcs";
+	case 0x39: return "sbaddress0";
+	case 0x3a: return "sbaddress1";
+	case 0x3c: return "sbdata0";
+	case 0x3d: return "sbdata1";
+	case 0x40: return "haltsum0";
+	}
+	if (address >= 0x04 && address <= 0x0f)
+		snprintf(name, sizeof(name), "data%u", (unsigned int)address - 0x04);
+	else if (address >= 0x20 && address <= 0x2f)
+		snprintf(name, sizeof(name), "progbuf%u", (unsigned int)address - 0x20);
+	else
+		snprintf(name, sizeof(name), "@%02" PRIx32, address);
+	return name;
+}
+
+static uint16_t get_u16(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return get_u16(buf) | (uint32_t)get_u16(buf + 2) << 16;
+}
+
+static uint64_t get_u64(const uint8_t *buf)
+{
+	return get_u32(buf) | (uint64_t)get_u32(buf + 4) << 32;
+}
+
+static void decode_record(const uint8_t *buf, struct record *r)
+{
+	r->time_us = get_u64(buf);
+	r->out_address = get_u32(buf + 8);
+	r->out_data = get_u32(buf + 12);
+	r->in_address = get_u32(buf + 16);
+	r->in_data = get_u32(buf + 20);
+	r->tap = get_u16(buf + 24);
+	r->idle = get_u16(buf + 26);
+	r->out_op = buf[28] & 3;
+	r->in_op = buf[29];
+	r->num_bits = buf[30];
+}
+
+static void print_record(const struct record *r)
+{
+	printf("%10" PRIu64 " tap%u %ub %s %08" PRIx32 " %-12s -> ",
+			r->time_us, r->tap, r->num_bits, op_string[r->out_op],
+			r->out_data, dm_register_name(r->out_address));
+	if (r->in_op == TRACE_NOT_CAPTURED)
+		printf("?");
+	else
+		printf("%s %08" PRIx32 " %-12s", status_string[r->in_op & 3],
+				r->in_data, dm_register_name(r->in_address));
+	printf(" %ui\n", r->idle);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *f = stdin;
+	bool summary = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "f:s")) != EOF) {
+		switch (c) {
+		case 'f':
+			f = fopen(optarg, "rb");
+			if (!f) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			summary = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s] [-f trace_file]\n",
+				basename(argv[0]));
+			return 1;
+		}
+	}
+
+	uint8_t buf[TRACE_RECORD_SIZE];
+	if (fread(buf, TRACE_HEADER_SIZE, 1, f) != 1 ||
+			memcmp(buf, TRACE_MAGIC, strlen(TRACE_MAGIC)) ||
+			buf[TRACE_HEADER_SIZE - 1] != TRACE_VERSION) {
+		fprintf(stderr, "not a version %d DMI trace\n", TRACE_VERSION);
+		return 1;
+	}
+
+	uint64_t scans = 0, first_us = 0, last_us = 0;
+	uint64_t per_op[4][5] = { { 0 } };
+	uint64_t busy_per_address[NUM_ADDRESSES] = { 0 };
+	uint64_t busy_run = 0, longest_busy_run = 0, longest_busy_run_us = 0;
+	uint32_t last_address = 0;
+	struct record r;
+
+	while (fread(buf, sizeof(buf), 1, f) == 1) {
+		decode_record(buf, &r);
+
+		if (!summary) {
+			print_record(&r);
+			continue;
+		}
+
+		if (!scans)
+			first_us = r.time_us;
+		last_us = r.time_us;
+		scans++;
+		per_op[r.out_op][r.in_op == TRACE_NOT_CAPTURED ? 4 : r.in_op & 3]++;
+
+		/* A busy status is the answer to the previous scan. */
+		if (r.in_op == DMI_OP_BUSY) {
+			busy_per_address[last_address % NUM_ADDRESSES]++;
+			if (++busy_run > longest_busy_run) {
+				longest_busy_run = busy_run;
+				longest_busy_run_us = r.time_us;
+			}
+		} else {
+			busy_run = 0;
+		}
+		last_address = r.out_address;
+	}
+
+	if (ferror(f)) {
+		fprintf(stderr, "read error: %s\n", strerror(errno));
+		return 1;
+	}
+
+	if (!summary)
+		return 0;
+
+	printf("%" PRIu64 " scans in %" PRIu64 " us\n", scans, last_us - first_us);
+	printf("op   success  reserved    failed      busy  not captured\n");
+	for (unsigned int op = 0; op < 4; op++) {
+		printf("%-2s", op_string[op]);
+		for (unsigned int status = 0; status < 5; status++)
+			printf(" %9" PRIu64, per_op[op][status]);
+		printf("\n");
+	}
+
+	printf("busy responses per register:\n");
+	for (unsigned int address = 0; address < NUM_ADDRESSES; address++) {
+		if (busy_per_address[address])
+			printf("  %-12s %" PRIu64 "\n", dm_register_name(address),
+					busy_per_address[address]);
+	}
+	if (longest_busy_run)
+		printf("longest busy run: %" PRIu64 " scans, ending at %" PRIu64 " us\n",
+				longest_busy_run, longest_busy_run_us);
+
+	return 0;
+}
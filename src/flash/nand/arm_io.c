@@ -286,3 +286,296 @@ int arm_nandread(struct arm_nand_data *nand, uint8_t *data, uint32_t size)
 
 	return retval;
 }
+
+/* page script words are opcode << 24 | argument,
+ * see contrib/loaders/flash/armv7m_nand_page.s
+ */
+#define ARM_NAND_OP_END		0
+#define ARM_NAND_OP_CMD		1
+#define ARM_NAND_OP_ADDR	2
+#define ARM_NAND_OP_WRITE	3
+#define ARM_NAND_OP_READ	4
+#define ARM_NAND_OP_WAIT	5
+
+#define ARM_NAND_OP(op, arg)	((uint32_t)(op) << 24 | (arg))
+
+/* the longest script: three commands, a wait, the address cycles,
+ * one transfer and the end marker
+ */
+#define ARM_NAND_SCRIPT_WORDS	(6 + NAND_MAX_ADDRESS_CYCLES)
+
+/**
+ * Runs a page script on an ARM core, so that a whole page access
+ * (command and address cycles, data, OOB and waiting for the chip)
+ * costs one download, one algorithm run and, for reads, one upload.
+ *
+ * The page buffer holds @a data followed by @a oob, it is written to the
+ * target before the run unless @a read is set, else read back after it.
+ *
+ * @param io Pointer to the arm_nand_data struct that defines the I/O
+ * @param script Page script, ending with ARM_NAND_OP_END
+ * @param script_words Number of words in the script
+ * @param data Pointer to the page data, or NULL
+ * @param data_size Size of the page data
+ * @param oob Pointer to the OOB data, or NULL
+ * @param oob_size Size of the OOB data
+ * @param read True if the script fills the page buffer
+ * @param status Status byte of the last wait in the script
+ * @return Success or failure of the operation
+ */
+static int arm_nand_run_page(struct arm_nand_data *io,
+		const uint32_t *script, unsigned int script_words,
+		uint8_t *data, uint32_t data_size, uint8_t *oob, uint32_t oob_size,
+		bool read, uint8_t *status)
+{
+	struct target *target = io->target;
+	struct arm_algorithm armv4_5_algo;
+	struct armv7m_algorithm armv7m_algo;
+	void *arm_algo;
+	struct arm *arm = target->arch_info;
+	struct reg_param reg_params[6];
+	uint32_t script_size = ARM_NAND_SCRIPT_WORDS * 4;
+	uint32_t size = data_size + oob_size;
+	uint32_t script_addr, target_buf;
+	uint32_t exit_var = 0;
+	uint8_t *buffer;
+	int retval;
+
+	/* see contrib/loaders/flash/armv4_5_nand_page.s for src */
+	static const uint32_t code_armv4_5[] = {
+		0xe4936004, 0xe1a07c26, 0xe3c664ff, 0xe3570001,
+		0x05c16000, 0x0afffff9, 0xe3570002, 0x05c26000,
+		0x0afffff6, 0xe3570003, 0x0a000004, 0xe3570004,
+		0x0a000007, 0xe3570005, 0x0a00000a, 0xea00000f,
+		0xe2566001, 0x4affffed, 0xe4d47001, 0xe5c07000,
+		0xeafffffa, 0xe2566001, 0x4affffe8, 0xe5d07000,
+		0xe4c47001, 0xeafffffa, 0xe3a07070, 0xe5c17000,
+		0xe5d05000, 0xe3150040, 0x0afffffc, 0xeaffffdf,
+
+		/* exit: ARMv4 needs hardware breakpoint */
+		0xe1200070,
+	};
+
+	/* see contrib/loaders/flash/armv7m_nand_page.s for src */
+	static const uint32_t code_armv7m[] = {
+		0x6b04f853, 0xf0260e37, 0x2f01467f, 0x2f02d008,
+		0x2f03d008, 0x2f04d008, 0x2f05d00c, 0xe016d010,
+		0xe7ed700e, 0xe7eb7016, 0xd4e91e76, 0x7b01f814,
+		0xe7f97007, 0xd4e31e76, 0xf8047807, 0xe7f97b01,
+		0x700f2770, 0xf0157805, 0xd0fb0f40, 0xbe00e7d8,
+	};
+
+	int target_code_size = 0;
+	const uint32_t *target_code_src = NULL;
+
+	/* set up algorithm */
+	if (is_armv7m(target_to_armv7m(target))) {  /* armv7m target */
+		armv7m_algo.common_magic = ARMV7M_COMMON_MAGIC;
+		armv7m_algo.core_mode = ARM_MODE_THREAD;
+		arm_algo = &armv7m_algo;
+		target_code_size = sizeof(code_armv7m);
+		target_code_src = code_armv7m;
+	} else {
+		armv4_5_algo.common_magic = ARM_COMMON_MAGIC;
+		armv4_5_algo.core_mode = ARM_MODE_SVC;
+		armv4_5_algo.core_state = ARM_STATE_ARM;
+		arm_algo = &armv4_5_algo;
+		target_code_size = sizeof(code_armv4_5);
+		target_code_src = code_armv4_5;
+	}
+
+	/* a larger page than the area was sized for needs a new one */
+	if (io->page_area &&
+			io->page_area->size < target_code_size + script_size + size) {
+		target_free_working_area(target, io->page_area);
+		io->page_area = NULL;
+	}
+
+	/* the area is kept, so the code only needs to go there once */
+	if (!io->page_area) {
+		retval = arm_code_to_working_area(target, target_code_src, target_code_size,
+				script_size + size, &io->page_area);
+		if (retval != ERROR_OK) {
+			if (io->page_area) {
+				target_free_working_area(target, io->page_area);
+				io->page_area = NULL;
+			}
+			return retval;
+		}
+	}
+
+	script_addr = io->page_area->address + target_code_size;
+	target_buf = script_addr + script_size;
+
+	/* download the script and, when writing, the page in one go */
+	buffer = malloc(script_size + size);
+	if (!buffer) {
+		LOG_ERROR("no memory for NAND page buffer");
+		return ERROR_NAND_OPERATION_FAILED;
+	}
+
+	target_buffer_set_u32_array(target, buffer, script_words, script);
+	if (!read) {
+		if (data)
+			memcpy(buffer + script_size, data, data_size);
+		if (oob)
+			memcpy(buffer + script_size + data_size, oob, oob_size);
+	}
+
+	retval = target_write_buffer(target, script_addr,
+			read ? script_size : script_size + size, buffer);
+	if (retval != ERROR_OK)
+		goto done;
+
+	/* set up parameters */
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_IN);
+
+	buf_set_u32(reg_params[0].value, 0, 32, io->data);
+	buf_set_u32(reg_params[1].value, 0, 32, io->cmd);
+	buf_set_u32(reg_params[2].value, 0, 32, io->addr);
+	buf_set_u32(reg_params[3].value, 0, 32, script_addr);
+	buf_set_u32(reg_params[4].value, 0, 32, target_buf);
+
+	/* armv4 must exit using a hardware breakpoint */
+	if (arm->arch == ARM_ARCH_V4)
+		exit_var = io->page_area->address + target_code_size - 4;
+
+	/* use alg to run the whole page access */
+	retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
+			io->page_area->address, exit_var, 1000, arm_algo);
+	if (retval != ERROR_OK)
+		LOG_ERROR("error executing hosted NAND page access");
+	else
+		*status = buf_get_u32(reg_params[5].value, 0, 8);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	/* read from work area to the host's memory */
+	if (retval == ERROR_OK && read) {
+		retval = target_read_buffer(target, target_buf, size, buffer + script_size);
+		if (retval == ERROR_OK) {
+			if (data)
+				memcpy(data, buffer + script_size, data_size);
+			if (oob)
+				memcpy(oob, buffer + script_size + data_size, oob_size);
+		}
+	}
+
+done:
+	free(buffer);
+	return retval;
+}
+
+/**
+ * Programs a page of an 8-bit wide NAND with a single run of an on-chip
+ * algorithm, see arm_nand_run_page().  Needs memory mapped command and
+ * address latches.
+ *
+ * @param nand NAND device to write to
+ * @param io Pointer to the arm_nand_data struct that defines the I/O
+ * @param page Page to write
+ * @param data Pointer to the data to be written, or NULL
+ * @param data_size Size of the data
+ * @param oob Pointer to the OOB data to be written, or NULL
+ * @param oob_size Size of the OOB data
+ * @return Success or failure of the operation, ERROR_NAND_NO_BUFFER if
+ * the caller should fall back to nand_write_page_raw()
+ */
+int arm_nand_write_page(struct nand_device *nand, struct arm_nand_data *io,
+		uint32_t page, uint8_t *data, uint32_t data_size,
+		uint8_t *oob, uint32_t oob_size)
+{
+	uint32_t script[ARM_NAND_SCRIPT_WORDS];
+	uint8_t cycles[NAND_MAX_ADDRESS_CYCLES];
+	unsigned int n_cycles, n = 0;
+	uint8_t status;
+	int retval;
+
+	if (!io->cmd || !io->addr || (nand->device->options & NAND_BUSWIDTH_16))
+		return ERROR_NAND_NO_BUFFER;
+
+	if (!data)
+		data_size = 0;
+	if (!oob)
+		oob_size = 0;
+
+	n_cycles = nand_page_address(nand, page, !data, cycles);
+
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_CMD, NAND_CMD_SEQIN);
+	for (unsigned int i = 0; i < n_cycles; i++)
+		script[n++] = ARM_NAND_OP(ARM_NAND_OP_ADDR, cycles[i]);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_WRITE, data_size + oob_size);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_CMD, NAND_CMD_PAGEPROG);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_WAIT, 0);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_END, 0);
+
+	retval = arm_nand_run_page(io, script, n, data, data_size, oob, oob_size,
+			false, &status);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (status & NAND_STATUS_FAIL) {
+		LOG_ERROR("write operation didn't pass, status: 0x%2.2x", status);
+		return ERROR_NAND_OPERATION_FAILED;
+	}
+
+	return ERROR_OK;
+}
+
+/**
+ * Reads a page of an 8-bit wide, large page NAND with a single run of an
+ * on-chip algorithm, see arm_nand_run_page().  Needs memory mapped command
+ * and address latches.
+ *
+ * Small page chips are left to the host, leaving the READ STATUS mode the
+ * wait uses to look for the end of the page load is not reliable on them.
+ *
+ * @param nand NAND device to read from
+ * @param io Pointer to the arm_nand_data struct that defines the I/O
+ * @param page Page to read
+ * @param data Pointer to where data should be read to, or NULL
+ * @param data_size Size of the data
+ * @param oob Pointer to where OOB data should be read to, or NULL
+ * @param oob_size Size of the OOB data
+ * @return Success or failure of the operation, ERROR_NAND_NO_BUFFER if
+ * the caller should fall back to nand_read_page_raw()
+ */
+int arm_nand_read_page(struct nand_device *nand, struct arm_nand_data *io,
+		uint32_t page, uint8_t *data, uint32_t data_size,
+		uint8_t *oob, uint32_t oob_size)
+{
+	uint32_t script[ARM_NAND_SCRIPT_WORDS];
+	uint8_t cycles[NAND_MAX_ADDRESS_CYCLES];
+	unsigned int n_cycles, n = 0;
+	uint8_t status;
+
+	if (!io->cmd || !io->addr || (nand->device->options & NAND_BUSWIDTH_16) ||
+			nand->page_size <= 512)
+		return ERROR_NAND_NO_BUFFER;
+
+	if (!data)
+		data_size = 0;
+	if (!oob)
+		oob_size = 0;
+
+	n_cycles = nand_page_address(nand, page, !data, cycles);
+
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_CMD, NAND_CMD_READ0);
+	for (unsigned int i = 0; i < n_cycles; i++)
+		script[n++] = ARM_NAND_OP(ARM_NAND_OP_ADDR, cycles[i]);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_CMD, NAND_CMD_READSTART);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_WAIT, 0);
+	/* back from status to data output */
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_CMD, NAND_CMD_READ0);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_READ, data_size + oob_size);
+	script[n++] = ARM_NAND_OP(ARM_NAND_OP_END, 0);
+
+	return arm_nand_run_page(io, script, n, data, data_size, oob, oob_size,
+			true, &status);
+}
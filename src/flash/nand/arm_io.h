@@ -32,6 +32,15 @@ struct arm_nand_data {
 	/** Where data is read from or written to. */
 	uint32_t data;
 
+	/** Where commands are written to, 0 if not memory mapped. */
+	uint32_t cmd;
+
+	/** Where addresses are written to, 0 if not memory mapped. */
+	uint32_t addr;
+
+	/** The page area holds the page script loop, a script and a page. */
+	struct working_area *page_area;
+
 	/** Last operation executed using this struct. */
 	enum arm_nand_op op;
 
@@ -41,4 +50,11 @@ struct arm_nand_data {
 int arm_nandwrite(struct arm_nand_data *nand, uint8_t *data, int size);
 int arm_nandread(struct arm_nand_data *nand, uint8_t *data, uint32_t size);
 
+int arm_nand_write_page(struct nand_device *nand, struct arm_nand_data *io,
+		uint32_t page, uint8_t *data, uint32_t data_size,
+		uint8_t *oob, uint32_t oob_size);
+int arm_nand_read_page(struct nand_device *nand, struct arm_nand_data *io,
+		uint32_t page, uint8_t *data, uint32_t data_size,
+		uint8_t *oob, uint32_t oob_size);
+
 #endif /* OPENOCD_FLASH_NAND_ARM_IO_H */
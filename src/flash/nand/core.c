@@ -13,6 +13,7 @@
 #endif
 
 #include "imp.h"
+#include <helper/fileio.h>
 
 /* configured NAND devices and NAND Flash command handler */
 struct nand_device *nand_devices;
@@ -246,6 +247,127 @@ int nand_build_bbt(struct nand_device *nand, int first, int last)
 	return ERROR_OK;
 }
 
+/* first line of a saved bad block table */
+#define NAND_BBT_HEADER "# OpenOCD NAND bad block table\n"
+
+/**
+ * Formats the line a saved bad block table is keyed by: the chip IDs and
+ * geometry, plus a user supplied @a tag telling apart chips of the same
+ * type, e.g. a board serial number.
+ */
+static void nand_bbt_key(struct nand_device *nand, const char *tag,
+	char *key, size_t size)
+{
+	snprintf(key, size, "key 0x%2.2x 0x%2.2x %d %d %d %s\n",
+		nand->manufacturer->id, nand->device->id,
+		nand->num_blocks, nand->erase_size, nand->page_size,
+		tag ? tag : "-");
+}
+
+int nand_bbt_save(struct nand_device *nand, const char *filename, const char *tag)
+{
+	struct fileio *fileio;
+	char line[128];
+	size_t size_written;
+	int retval;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	/* only blocks we know about can be saved */
+	for (int i = 0; i < nand->num_blocks; i++) {
+		if (nand->blocks[i].is_bad == -1) {
+			int last = i;
+			while (last + 1 < nand->num_blocks && nand->blocks[last + 1].is_bad == -1)
+				last++;
+			retval = nand_build_bbt(nand, i, last);
+			if (retval != ERROR_OK)
+				return retval;
+			i = last;
+		}
+	}
+
+	retval = fileio_open(&fileio, filename, FILEIO_WRITE, FILEIO_TEXT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = fileio_write(fileio, strlen(NAND_BBT_HEADER), NAND_BBT_HEADER, &size_written);
+	if (retval == ERROR_OK) {
+		nand_bbt_key(nand, tag, line, sizeof(line));
+		retval = fileio_write(fileio, strlen(line), line, &size_written);
+	}
+
+	for (int i = 0; retval == ERROR_OK && i < nand->num_blocks; i++) {
+		if (nand->blocks[i].is_bad != 1)
+			continue;
+		snprintf(line, sizeof(line), "bad %d\n", i);
+		retval = fileio_write(fileio, strlen(line), line, &size_written);
+	}
+
+	fileio_close(fileio);
+	if (retval != ERROR_OK)
+		LOG_ERROR("couldn't write bad block table to %s", filename);
+
+	return retval;
+}
+
+int nand_bbt_load(struct nand_device *nand, const char *filename, const char *tag)
+{
+	struct fileio *fileio;
+	char key[128], line[128];
+	int *is_bad;
+	int retval, block;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	retval = fileio_open(&fileio, filename, FILEIO_READ, FILEIO_TEXT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	nand_bbt_key(nand, tag, key, sizeof(key));
+	if (fileio_fgets(fileio, sizeof(line), line) != ERROR_OK ||
+			strcmp(line, NAND_BBT_HEADER) ||
+			fileio_fgets(fileio, sizeof(line), line) != ERROR_OK) {
+		LOG_ERROR("%s is not a bad block table", filename);
+		fileio_close(fileio);
+		return ERROR_FAIL;
+	}
+	if (strcmp(line, key)) {
+		LOG_ERROR("bad block table %s belongs to another chip or tag", filename);
+		fileio_close(fileio);
+		return ERROR_FAIL;
+	}
+
+	/* don't touch the device's table unless the whole file is good */
+	is_bad = calloc(nand->num_blocks, sizeof(*is_bad));
+	if (!is_bad) {
+		LOG_ERROR("out of memory");
+		fileio_close(fileio);
+		return ERROR_FAIL;
+	}
+
+	while (fileio_fgets(fileio, sizeof(line), line) == ERROR_OK) {
+		if (sscanf(line, "bad %d", &block) != 1 ||
+				block < 0 || block >= nand->num_blocks) {
+			LOG_ERROR("invalid line in bad block table %s: %s", filename, line);
+			retval = ERROR_FAIL;
+			break;
+		}
+		is_bad[block] = 1;
+	}
+
+	fileio_close(fileio);
+
+	if (retval == ERROR_OK) {
+		for (int i = 0; i < nand->num_blocks; i++)
+			nand->blocks[i].is_bad = is_bad[i];
+	}
+
+	free(is_bad);
+	return retval;
+}
+
 int nand_read_status(struct nand_device *nand, uint8_t *status)
 {
 	if (!nand->device)
@@ -690,59 +812,71 @@ int nand_read_page(struct nand_device *nand, uint32_t page,
 		return nand->controller->read_page(nand, page, data, data_size, oob, oob_size);
 }
 
-int nand_page_command(struct nand_device *nand, uint32_t page,
-	uint8_t cmd, bool oob_only)
+unsigned int nand_page_address(struct nand_device *nand, uint32_t page,
+	bool oob_only, uint8_t *cycles)
 {
-	if (!nand->device)
-		return ERROR_NAND_DEVICE_NOT_PROBED;
-
-	if (oob_only && NAND_CMD_READ0 == cmd && nand->page_size <= 512)
-		cmd = NAND_CMD_READOOB;
-
-	nand->controller->command(nand, cmd);
+	unsigned int n = 0;
 
 	if (nand->page_size <= 512) {
 		/* small page device */
 
 		/* column (always 0, we start at the beginning of a page/OOB area) */
-		nand->controller->address(nand, 0x0);
+		cycles[n++] = 0x0;
 
 		/* row */
-		nand->controller->address(nand, page & 0xff);
-		nand->controller->address(nand, (page >> 8) & 0xff);
+		cycles[n++] = page & 0xff;
+		cycles[n++] = (page >> 8) & 0xff;
 
 		/* 4th cycle only on devices with more than 32 MiB */
 		if (nand->address_cycles >= 4)
-			nand->controller->address(nand, (page >> 16) & 0xff);
+			cycles[n++] = (page >> 16) & 0xff;
 
 		/* 5th cycle only on devices with more than 8 GiB */
 		if (nand->address_cycles >= 5)
-			nand->controller->address(nand, (page >> 24) & 0xff);
+			cycles[n++] = (page >> 24) & 0xff;
 	} else {
 		/* large page device */
 
 		/* column (0 when we start at the beginning of a page,
 		 * or 2048 for the beginning of OOB area)
 		 */
-		nand->controller->address(nand, 0x0);
-		if (oob_only)
-			nand->controller->address(nand, 0x8);
-		else
-			nand->controller->address(nand, 0x0);
+		cycles[n++] = 0x0;
+		cycles[n++] = oob_only ? 0x8 : 0x0;
 
 		/* row */
-		nand->controller->address(nand, page & 0xff);
-		nand->controller->address(nand, (page >> 8) & 0xff);
+		cycles[n++] = page & 0xff;
+		cycles[n++] = (page >> 8) & 0xff;
 
 		/* 5th cycle only on devices with more than 128 MiB */
 		if (nand->address_cycles >= 5)
-			nand->controller->address(nand, (page >> 16) & 0xff);
-
-		/* large page devices need a start command if reading */
-		if (cmd == NAND_CMD_READ0)
-			nand->controller->command(nand, NAND_CMD_READSTART);
+			cycles[n++] = (page >> 16) & 0xff;
 	}
 
+	return n;
+}
+
+int nand_page_command(struct nand_device *nand, uint32_t page,
+	uint8_t cmd, bool oob_only)
+{
+	uint8_t cycles[NAND_MAX_ADDRESS_CYCLES];
+	unsigned int n_cycles;
+
+	if (!nand->device)
+		return ERROR_NAND_DEVICE_NOT_PROBED;
+
+	if (oob_only && NAND_CMD_READ0 == cmd && nand->page_size <= 512)
+		cmd = NAND_CMD_READOOB;
+
+	nand->controller->command(nand, cmd);
+
+	n_cycles = nand_page_address(nand, page, oob_only, cycles);
+	for (unsigned int i = 0; i < n_cycles; i++)
+		nand->controller->address(nand, cycles[i]);
+
+	/* large page devices need a start command if reading */
+	if (nand->page_size > 512 && cmd == NAND_CMD_READ0)
+		nand->controller->command(nand, NAND_CMD_READSTART);
+
 	if (nand->controller->nand_ready) {
 		if (!nand->controller->nand_ready(nand, 100))
 			return ERROR_NAND_OPERATION_TIMEOUT;
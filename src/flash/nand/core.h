@@ -183,6 +183,16 @@ extern struct nand_device *nand_devices;
 
 struct nand_device *get_nand_device_by_num(int num);
 
+/** Address cycles needed to select a page, at most. */
+#define NAND_MAX_ADDRESS_CYCLES 5
+
+/**
+ * Computes the address cycles nand_page_command() sends to select @a page,
+ * or its OOB area if @a oob_only is set.
+ * @returns the number of cycles stored to @a cycles.
+ */
+unsigned int nand_page_address(struct nand_device *nand, uint32_t page,
+		bool oob_only, uint8_t *cycles);
 int nand_page_command(struct nand_device *nand, uint32_t page,
 		      uint8_t cmd, bool oob_only);
 
@@ -373,6 +373,22 @@ static int davinci_writepage_tail(struct nand_device *nand,
 	return ERROR_OK;
 }
 
+/*
+ * Without ECC on read, a whole page can be handled by a bit of native code.
+ */
+static int davinci_read_page_raw(struct nand_device *nand, uint32_t page,
+	uint8_t *data, uint32_t data_size, uint8_t *oob, uint32_t oob_size)
+{
+	struct davinci_nand *info = nand->controller_priv;
+	int status;
+
+	status = arm_nand_read_page(nand, &info->io, page, data, data_size, oob, oob_size);
+	if (status == ERROR_NAND_NO_BUFFER)
+		status = nand_read_page_raw(nand, page, data, data_size, oob, oob_size);
+
+	return status;
+}
+
 /*
  * All DaVinci family chips support 1-bit ECC on a per-chipselect basis.
  */
@@ -732,13 +748,15 @@ NAND_DEVICE_COMMAND_HANDLER(davinci_nand_device_command)
 
 	info->io.target = nand->target;
 	info->io.data = info->data;
+	info->io.cmd = info->cmd;
+	info->io.addr = info->addr;
 	info->io.op = ARM_NAND_NONE;
 
 	/* NOTE:  for now we don't do any error correction on read.
 	 * Nothing else in OpenOCD currently corrects read errors,
 	 * and in any case it's *writing* that we care most about.
 	 */
-	info->read_page = nand_read_page_raw;
+	info->read_page = davinci_read_page_raw;
 
 	switch (eccmode) {
 		case HWECC1:
@@ -24,4 +24,16 @@ int nand_probe(struct nand_device *nand);
 int nand_erase(struct nand_device *nand, int first_block, int last_block);
 int nand_build_bbt(struct nand_device *nand, int first, int last);
 
+/**
+ * Saves the bad block table of @a nand to @a filename, scanning the blocks
+ * whose condition isn't known yet first.
+ */
+int nand_bbt_save(struct nand_device *nand, const char *filename, const char *tag);
+
+/**
+ * Loads a bad block table saved by nand_bbt_save(), instead of scanning the
+ * chip. The table must have been saved for the same chip type and @a tag.
+ */
+int nand_bbt_load(struct nand_device *nand, const char *filename, const char *tag);
+
 #endif /* OPENOCD_FLASH_NAND_IMP_H */
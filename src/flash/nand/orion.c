@@ -94,6 +94,36 @@ static int orion_nand_fast_block_write(struct nand_device *nand, uint8_t *data,
 	return retval;
 }
 
+static int orion_nand_write_page(struct nand_device *nand, uint32_t page,
+	uint8_t *data, uint32_t data_size, uint8_t *oob, uint32_t oob_size)
+{
+	struct orion_nand_controller *hw = nand->controller_priv;
+	struct target *target = nand->target;
+	int retval;
+
+	CHECK_HALTED;
+	retval = arm_nand_write_page(nand, &hw->io, page, data, data_size, oob, oob_size);
+	if (retval == ERROR_NAND_NO_BUFFER)
+		retval = nand_write_page_raw(nand, page, data, data_size, oob, oob_size);
+
+	return retval;
+}
+
+static int orion_nand_read_page(struct nand_device *nand, uint32_t page,
+	uint8_t *data, uint32_t data_size, uint8_t *oob, uint32_t oob_size)
+{
+	struct orion_nand_controller *hw = nand->controller_priv;
+	struct target *target = nand->target;
+	int retval;
+
+	CHECK_HALTED;
+	retval = arm_nand_read_page(nand, &hw->io, page, data, data_size, oob, oob_size);
+	if (retval == ERROR_NAND_NO_BUFFER)
+		retval = nand_read_page_raw(nand, page, data, data_size, oob, oob_size);
+
+	return retval;
+}
+
 static int orion_nand_reset(struct nand_device *nand)
 {
 	return orion_nand_command(nand, NAND_CMD_RESET);
@@ -126,6 +156,8 @@ NAND_DEVICE_COMMAND_HANDLER(orion_nand_device_command)
 
 	hw->io.target = nand->target;
 	hw->io.data = hw->data;
+	hw->io.cmd = hw->cmd;
+	hw->io.addr = hw->addr;
 	hw->io.op = ARM_NAND_NONE;
 
 	return ERROR_OK;
@@ -144,6 +176,8 @@ struct nand_flash_controller orion_nand_controller = {
 	.read_data = orion_nand_read,
 	.write_data = orion_nand_write,
 	.write_block_data = orion_nand_fast_block_write,
+	.write_page = orion_nand_write_page,
+	.read_page = orion_nand_read_page,
 	.reset = orion_nand_reset,
 	.nand_device_command = orion_nand_device_command,
 	.init = orion_nand_init,
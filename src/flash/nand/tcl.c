@@ -226,6 +226,40 @@ COMMAND_HANDLER(handle_nand_check_bad_blocks_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_nand_bbt_save_command)
+{
+	if (CMD_ARGC < 2 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct nand_device *p;
+	int retval = CALL_COMMAND_HANDLER(nand_command_get_device, 0, &p);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = nand_bbt_save(p, CMD_ARGV[1], CMD_ARGC == 3 ? CMD_ARGV[2] : NULL);
+	if (retval == ERROR_OK)
+		command_print(CMD, "saved bad block table to %s", CMD_ARGV[1]);
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_nand_bbt_load_command)
+{
+	if (CMD_ARGC < 2 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct nand_device *p;
+	int retval = CALL_COMMAND_HANDLER(nand_command_get_device, 0, &p);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = nand_bbt_load(p, CMD_ARGV[1], CMD_ARGC == 3 ? CMD_ARGV[2] : NULL);
+	if (retval == ERROR_OK)
+		command_print(CMD, "loaded bad block table from %s", CMD_ARGV[1]);
+
+	return retval;
+}
+
 COMMAND_HANDLER(handle_nand_write_command)
 {
 	struct nand_device *nand = NULL;
@@ -420,6 +454,21 @@ static const struct command_registration nand_exec_command_handlers[] = {
 		.usage = "bank_id [offset length]",
 		.help = "check all or part of NAND flash device for bad blocks",
 	},
+	{
+		.name = "bbt_save",
+		.handler = handle_nand_bbt_save_command,
+		.mode = COMMAND_EXEC,
+		.usage = "bank_id filename [tag]",
+		.help = "save the bad block table of NAND flash device to a file",
+	},
+	{
+		.name = "bbt_load",
+		.handler = handle_nand_bbt_load_command,
+		.mode = COMMAND_EXEC,
+		.usage = "bank_id filename [tag]",
+		.help = "load the bad block table of NAND flash device from a file "
+			"instead of scanning the device",
+	},
 	{
 		.name = "erase",
 		.handler = handle_nand_erase_command,
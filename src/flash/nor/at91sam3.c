@@ -2877,11 +2877,28 @@ static int sam3_read_all_regs(struct sam3_chip *chip)
 {
 	int r;
 	const struct sam3_reg_list *reg;
+	/* the PMC registers are read as one block instead of one by one */
+	uint8_t pmc[SAM3_PMC_FSPR + 4 - SAM3_PMC_SCSR];
+
+	r = target_read_buffer(chip->target, SAM3_PMC_SCSR, sizeof(pmc), pmc);
+	if (r != ERROR_OK) {
+		LOG_ERROR("Cannot read SAM3 PMC registers @ 0x%08x, Error: %d",
+			(unsigned)SAM3_PMC_SCSR, r);
+		return r;
+	}
 
 	reg = &(sam3_all_regs[0]);
 	while (reg->name) {
-		r = sam3_read_this_reg(chip,
-				sam3_get_reg_ptr(&(chip->cfg), reg));
+		uint32_t *goes_here = sam3_get_reg_ptr(&(chip->cfg), reg);
+
+		if (reg->address >= SAM3_PMC_SCSR && reg->address <= SAM3_PMC_FSPR) {
+			*goes_here = target_buffer_get_u32(chip->target,
+					pmc + reg->address - SAM3_PMC_SCSR);
+			reg++;
+			continue;
+		}
+
+		r = sam3_read_this_reg(chip, goes_here);
 		if (r != ERROR_OK) {
 			LOG_ERROR("Cannot read SAM3 register: %s @ 0x%08x, Error: %d",
 				reg->name, ((unsigned)(reg->address)), r);
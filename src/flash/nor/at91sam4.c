@@ -1828,12 +1828,9 @@ static int flashd_get_lock_bits(struct sam4_bank_private *private, uint32_t *v)
 	int r;
 	LOG_DEBUG("Here");
 	r = efc_perform_command(private, AT91C_EFC_FCMD_GLB, 0, NULL);
-	if (r == ERROR_OK)	{
-		efc_get_result(private, v);
-		efc_get_result(private, v);
-		efc_get_result(private, v);
-		r = efc_get_result(private, v);
-	}
+	/* each read of FRR returns the next word of lock bits */
+	for (unsigned int i = 0; r == ERROR_OK && i < 4; i++)
+		r = efc_get_result(private, &v[i]);
 	LOG_DEBUG("End: %d", r);
 	return r;
 }
@@ -2384,11 +2381,28 @@ static int sam4_read_all_regs(struct sam4_chip *chip)
 {
 	int r;
 	const struct sam4_reg_list *reg;
+	/* the PMC registers are read as one block instead of one by one */
+	uint8_t pmc[SAM4_PMC_FSPR + 4 - SAM4_PMC_SCSR];
+
+	r = target_read_buffer(chip->target, SAM4_PMC_SCSR, sizeof(pmc), pmc);
+	if (r != ERROR_OK) {
+		LOG_ERROR("Cannot read SAM4 PMC registers @ 0x%08x, Error: %d",
+			(unsigned)SAM4_PMC_SCSR, r);
+		return r;
+	}
 
 	reg = &(sam4_all_regs[0]);
 	while (reg->name) {
-		r = sam4_read_this_reg(chip,
-				sam4_get_reg_ptr(&(chip->cfg), reg));
+		uint32_t *goes_here = sam4_get_reg_ptr(&(chip->cfg), reg);
+
+		if (reg->address >= SAM4_PMC_SCSR && reg->address <= SAM4_PMC_FSPR) {
+			*goes_here = target_buffer_get_u32(chip->target,
+					pmc + reg->address - SAM4_PMC_SCSR);
+			reg++;
+			continue;
+		}
+
+		r = sam4_read_this_reg(chip, goes_here);
 		if (r != ERROR_OK) {
 			LOG_ERROR("Cannot read SAM4 register: %s @ 0x%08x, Error: %d",
 				reg->name, ((unsigned)(reg->address)), r);
@@ -20,8 +20,11 @@
 #include <target/arm7_9_common.h>
 #include <target/armv7m.h>
 #include <target/mips32.h>
+#include <target/riscv/riscv.h>
+#include <helper/align.h>
 #include <helper/binarybuffer.h>
 #include <target/algorithm.h>
+#include "../../../contrib/loaders/flash/cfi/cfi_async.h"
 
 /* defines internal maximum size for code fragment in cfi_intel_write_block() */
 #define CFI_MAX_INTEL_CODESIZE 256
@@ -1251,8 +1254,8 @@ static int cfi_intel_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	}
 
 	/* write algorithm code to working area */
-	retval = target_write_buffer(target, write_algorithm->address,
-			target_code_size, target_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			target_code, target_code_size);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("Unable to write block write code to target");
 		goto cleanup;
@@ -1487,8 +1490,8 @@ static int cfi_spansion_write_block_mips(struct flash_bank *bank, const uint8_t
 	}
 
 	/* write algorithm code to working area */
-	retval = target_write_buffer(target, write_algorithm->address,
-			target_code_size, target_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			target_code, target_code_size);
 	if (retval != ERROR_OK) {
 		free(target_code);
 		return retval;
@@ -1866,8 +1869,8 @@ static int cfi_spansion_write_block(struct flash_bank *bank, const uint8_t *buff
 	}
 
 	/* write algorithm code to working area */
-	retval = target_write_buffer(target, write_algorithm->address,
-			target_code_size, target_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			target_code, target_code_size);
 	if (retval != ERROR_OK) {
 		free(target_code);
 		return retval;
@@ -1953,6 +1956,206 @@ static int cfi_spansion_write_block(struct flash_bank *bank, const uint8_t *buff
 	return retval;
 }
 
+static const uint8_t armv7m_cfi_intel_async_code[] = {
+#include "../../../contrib/loaders/flash/cfi/armv7m_cfi_intel_async.inc"
+};
+
+static const uint8_t armv7m_cfi_span_async_code[] = {
+#include "../../../contrib/loaders/flash/cfi/armv7m_cfi_span_async.inc"
+};
+
+static const uint8_t riscv32_cfi_intel_async_code[] = {
+#include "../../../contrib/loaders/flash/cfi/riscv32_cfi_intel_async.inc"
+};
+
+static const uint8_t riscv32_cfi_span_async_code[] = {
+#include "../../../contrib/loaders/flash/cfi/riscv32_cfi_span_async.inc"
+};
+
+static const uint8_t riscv64_cfi_intel_async_code[] = {
+#include "../../../contrib/loaders/flash/cfi/riscv64_cfi_intel_async.inc"
+};
+
+static const uint8_t riscv64_cfi_span_async_code[] = {
+#include "../../../contrib/loaders/flash/cfi/riscv64_cfi_span_async.inc"
+};
+
+/* size of one write buffer over all chips of the bus, 0 if not supported */
+static uint32_t cfi_write_buffer_size(struct flash_bank *bank)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+
+	if (cfi_info->buf_write_timeout_typ == 0)
+		return 0;
+
+	return (1UL << cfi_info->max_buf_write_size) * (bank->bus_width / bank->chip_width);
+}
+
+/* Program whole write buffers with a loader fed through the async algorithm
+ * fifo, so the next buffers are downloaded while the flash programs the
+ * current one. address and count must be multiples of the write buffer size.
+ */
+static int cfi_write_buffers_async(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t address, uint32_t count)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	struct target *target = bank->target;
+	uint32_t buffersize = cfi_write_buffer_size(bank);
+	struct armv7m_algorithm armv7m_algo;
+	void *arch_info = NULL;
+	char * const *reg_names;
+	unsigned int reg_bits = 32;
+	const uint8_t *code;
+	size_t code_size;
+	bool intel;
+	int retval;
+
+	static char * const armv7m_reg_names[] = { "r0", "r1", "r2", "r3", "r4" };
+	static char * const riscv_reg_names[] = { "a0", "a1", "a2", "a3", "a4" };
+
+	/* the loaders access the flash directly and queue whole words, the
+	 * word count command is a single byte */
+	if (cfi_info->write_mem || bank->bus_width > 4 || buffersize % 4 ||
+			buffersize / bank->bus_width > 256)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	switch (cfi_info->pri_id) {
+		case 1:
+		case 3:
+			intel = true;
+			break;
+		case 2:
+			intel = false;
+			break;
+		default:
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	if (strcmp(target_type_name(target), "riscv") == 0) {
+		reg_bits = riscv_xlen(target);
+		reg_names = riscv_reg_names;
+		if (reg_bits == 32) {
+			code = intel ? riscv32_cfi_intel_async_code : riscv32_cfi_span_async_code;
+			code_size = intel ? sizeof(riscv32_cfi_intel_async_code) :
+				sizeof(riscv32_cfi_span_async_code);
+		} else {
+			code = intel ? riscv64_cfi_intel_async_code : riscv64_cfi_span_async_code;
+			code_size = intel ? sizeof(riscv64_cfi_intel_async_code) :
+				sizeof(riscv64_cfi_span_async_code);
+		}
+	} else if (is_armv7m(target_to_armv7m(target)) &&
+			target_to_armv7m(target)->arm.arch != ARM_ARCH_V6M) {
+		/* the loaders use Thumb-2 instructions */
+		armv7m_algo.common_magic = ARMV7M_COMMON_MAGIC;
+		armv7m_algo.core_mode = ARM_MODE_THREAD;
+		arch_info = &armv7m_algo;
+		reg_names = armv7m_reg_names;
+		code = intel ? armv7m_cfi_intel_async_code : armv7m_cfi_span_async_code;
+		code_size = intel ? sizeof(armv7m_cfi_intel_async_code) :
+			sizeof(armv7m_cfi_span_async_code);
+	} else {
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	/* the parameter block follows the code */
+	uint32_t params_offset = ALIGN_UP(code_size, 4);
+	struct working_area *write_algorithm;
+	retval = target_alloc_working_area(target, params_offset + CFI_ASYNC_PARAMS_SIZE,
+			&write_algorithm);
+	if (retval != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* the fifo has to hold at least two write buffers to overlap anything */
+	struct working_area *fifo;
+	uint32_t fifo_size = MAX(32768, 2 * buffersize);
+	while (target_alloc_working_area_try(target, fifo_size + 8, &fifo) != ERROR_OK) {
+		fifo_size /= 2;
+		if (fifo_size < 2 * buffersize) {
+			target_free_working_area(target, write_algorithm);
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
+
+	uint8_t params[CFI_ASYNC_PARAMS_SIZE];
+	uint32_t fifo_end = fifo->address + fifo->size;
+	target_buffer_set_u32(target, params + CFI_ASYNC_FIFO_END, fifo_end);
+	target_buffer_set_u32(target, params + CFI_ASYNC_BUF_WORDS, buffersize / bank->bus_width);
+	target_buffer_set_u32(target, params + CFI_ASYNC_BUF_COUNT,
+		cfi_command_val(bank, buffersize / bank->bus_width - 1));
+	target_buffer_set_u32(target, params + CFI_ASYNC_CMD_START,
+		cfi_command_val(bank, intel ? 0xe8 : 0x25));
+	target_buffer_set_u32(target, params + CFI_ASYNC_CMD_COMMIT,
+		cfi_command_val(bank, intel ? 0xd0 : 0x29));
+	target_buffer_set_u32(target, params + CFI_ASYNC_READY, cfi_command_val(bank, 0x80));
+	if (intel) {
+		target_buffer_set_u32(target, params + CFI_ASYNC_ERROR, cfi_command_val(bank, 0x7e));
+		target_buffer_set_u32(target, params + CFI_ASYNC_UNLOCK1, 0);
+		target_buffer_set_u32(target, params + CFI_ASYNC_UNLOCK2, 0);
+	} else {
+		struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
+
+		/* DQ5 timeout and DQ1 write buffer abort, if the chip reports them */
+		target_buffer_set_u32(target, params + CFI_ASYNC_ERROR,
+			(cfi_info->status_poll_mask & (1 << 5)) ? cfi_command_val(bank, 0x22) : 0);
+		target_buffer_set_u32(target, params + CFI_ASYNC_UNLOCK1,
+			cfi_flash_address(bank, 0, pri_ext->_unlock1));
+		target_buffer_set_u32(target, params + CFI_ASYNC_UNLOCK2,
+			cfi_flash_address(bank, 0, pri_ext->_unlock2));
+	}
+
+	retval = target_write_working_area_code(target, write_algorithm, code, code_size);
+	if (retval == ERROR_OK)
+		retval = target_write_buffer(target, write_algorithm->address + params_offset,
+				sizeof(params), params);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, fifo);
+		target_free_working_area(target, write_algorithm);
+		return retval;
+	}
+
+	struct reg_param reg_params[5];
+	init_reg_param(&reg_params[0], reg_names[0], reg_bits, PARAM_IN_OUT);	/* fifo, status */
+	init_reg_param(&reg_params[1], reg_names[1], reg_bits, PARAM_OUT);	/* parameters */
+	init_reg_param(&reg_params[2], reg_names[2], reg_bits, PARAM_OUT);	/* flash address */
+	init_reg_param(&reg_params[3], reg_names[3], reg_bits, PARAM_OUT);	/* write buffers */
+	init_reg_param(&reg_params[4], reg_names[4], reg_bits, PARAM_OUT);	/* bus width */
+
+	buf_set_u64(reg_params[0].value, 0, reg_bits, fifo->address);
+	buf_set_u64(reg_params[1].value, 0, reg_bits, write_algorithm->address + params_offset);
+	buf_set_u64(reg_params[2].value, 0, reg_bits, address);
+	buf_set_u64(reg_params[3].value, 0, reg_bits, count / buffersize);
+	buf_set_u64(reg_params[4].value, 0, reg_bits, bank->bus_width);
+
+	if (intel)
+		cfi_intel_clear_status_register(bank);
+
+	LOG_DEBUG("Streaming %" PRIu32 " write buffers of %" PRIu32 " bytes through a "
+		"%" PRIu32 " bytes fifo", count / buffersize, buffersize, fifo_size);
+
+	retval = target_run_flash_async_algorithm(target, buffer, count / buffersize, buffersize,
+			0, NULL, ARRAY_SIZE(reg_params), reg_params,
+			fifo->address, fifo->size, write_algorithm->address, 0, arch_info);
+
+	if (retval == ERROR_FLASH_OPERATION_FAILED) {
+		LOG_ERROR("flash write buffer failed, status 0x%" PRIx32,
+			buf_get_u32(reg_params[0].value, 0, 32));
+		if (intel) {
+			cfi_intel_clear_status_register(bank);
+		} else if (cfi_spansion_unlock_seq(bank) == ERROR_OK) {
+			/* write to buffer abort reset */
+			cfi_send_command(bank, 0xf0, cfi_flash_address(bank, 0, 0x0));
+		}
+	}
+
+	target_free_working_area(target, fifo);
+	target_free_working_area(target, write_algorithm);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	return retval;
+}
+
 static int cfi_intel_write_word(struct flash_bank *bank, uint8_t *word, uint32_t address)
 {
 	int retval;
@@ -2278,6 +2481,117 @@ static int cfi_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, u
 	return ERROR_OK;
 }
 
+/* write count bytes, a multiple of the bus width, without the loaders
+ * that stream whole write buffers */
+static int cfi_write_aligned_sync(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t write_p, uint32_t count)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	uint8_t current_word[CFI_MAX_BUS_WIDTH * 4];	/* word (bus_width size) currently being
+							 *programmed */
+	int retval;
+
+	if (!count)
+		return ERROR_OK;
+
+	switch (cfi_info->pri_id) {
+		/* try block writes (fails without working area) */
+		case 1:
+		case 3:
+			retval = cfi_intel_write_block(bank, buffer, write_p, count);
+			break;
+		case 2:
+			retval = cfi_spansion_write_block(bank, buffer, write_p, count);
+			break;
+		default:
+			LOG_ERROR("cfi primary command set %i unsupported", cfi_info->pri_id);
+			retval = ERROR_FLASH_OPERATION_FAILED;
+			break;
+	}
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return retval;
+
+	/* Calculate buffer size and boundary mask
+	 * buffersize is (buffer size per chip) * (number of chips)
+	 * bufferwsize is buffersize in words */
+	uint32_t buffersize =
+		(1UL <<
+		 cfi_info->max_buf_write_size) *
+		(bank->bus_width / bank->chip_width);
+	uint32_t buffermask = buffersize-1;
+	uint32_t bufferwsize = buffersize / bank->bus_width;
+
+	/* fall back to memory writes */
+	while (count >= (uint32_t)bank->bus_width) {
+		bool fallback;
+		if ((write_p & 0xff) == 0) {
+			LOG_INFO("Programming at 0x%08" PRIx32 ", count 0x%08"
+				PRIx32 " bytes remaining", write_p, count);
+		}
+		fallback = true;
+		if ((bufferwsize > 0) && (count >= buffersize) &&
+				!(write_p & buffermask)) {
+			retval = cfi_write_words(bank, buffer, bufferwsize, write_p);
+			if (retval == ERROR_OK) {
+				buffer += buffersize;
+				write_p += buffersize;
+				count -= buffersize;
+				fallback = false;
+			} else if (retval != ERROR_FLASH_OPER_UNSUPPORTED)
+				return retval;
+		}
+		/* try the slow way? */
+		if (fallback) {
+			for (unsigned int i = 0; i < bank->bus_width; i++)
+				current_word[i] = *buffer++;
+
+			retval = cfi_write_word(bank, current_word, write_p);
+			if (retval != ERROR_OK)
+				return retval;
+
+			write_p += bank->bus_width;
+			count -= bank->bus_width;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* write count bytes, a multiple of the bus width */
+static int cfi_write_aligned(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t write_p, uint32_t count)
+{
+	uint32_t buffersize = cfi_write_buffer_size(bank);
+	int retval;
+
+	if (buffersize) {
+		/* stream the whole write buffers, the head and tail are done the
+		 * usual way */
+		uint32_t head = (buffersize - (write_p & (buffersize - 1))) & (buffersize - 1);
+		uint32_t middle = head < count ? ALIGN_DOWN(count - head, buffersize) : 0;
+
+		if (middle) {
+			retval = cfi_write_aligned_sync(bank, buffer, write_p, head);
+			if (retval != ERROR_OK)
+				return retval;
+
+			retval = cfi_write_buffers_async(bank, buffer + head, write_p + head, middle);
+			if (retval == ERROR_OK) {
+				return cfi_write_aligned_sync(bank, buffer + head + middle,
+						write_p + head + middle, count - head - middle);
+			}
+			if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				return retval;
+
+			LOG_DEBUG("no async loader for this target, using block writes");
+			return cfi_write_aligned_sync(bank, buffer + head, write_p + head,
+					count - head);
+		}
+	}
+
+	return cfi_write_aligned_sync(bank, buffer, write_p, count);
+}
+
 static int cfi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct cfi_flash_bank *cfi_info = bank->driver_priv;
@@ -2345,72 +2659,14 @@ static int cfi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t of
 
 	/* handle blocks of bus_size aligned bytes */
 	blk_count = count & ~(bank->bus_width - 1);	/* round down, leave tail bytes */
-	switch (cfi_info->pri_id) {
-		/* try block writes (fails without working area) */
-		case 1:
-		case 3:
-			retval = cfi_intel_write_block(bank, buffer, write_p, blk_count);
-			break;
-		case 2:
-			retval = cfi_spansion_write_block(bank, buffer, write_p, blk_count);
-			break;
-		default:
-			LOG_ERROR("cfi primary command set %i unsupported", cfi_info->pri_id);
-			retval = ERROR_FLASH_OPERATION_FAILED;
-			break;
-	}
-	if (retval == ERROR_OK) {
-		/* Increment pointers and decrease count on successful block write */
-		buffer += blk_count;
-		write_p += blk_count;
-		count -= blk_count;
-	} else {
-		if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
-			/* Calculate buffer size and boundary mask
-			 * buffersize is (buffer size per chip) * (number of chips)
-			 * bufferwsize is buffersize in words */
-			uint32_t buffersize =
-				(1UL <<
-				 cfi_info->max_buf_write_size) *
-				(bank->bus_width / bank->chip_width);
-			uint32_t buffermask = buffersize-1;
-			uint32_t bufferwsize = buffersize / bank->bus_width;
-
-			/* fall back to memory writes */
-			while (count >= (uint32_t)bank->bus_width) {
-				bool fallback;
-				if ((write_p & 0xff) == 0) {
-					LOG_INFO("Programming at 0x%08" PRIx32 ", count 0x%08"
-						PRIx32 " bytes remaining", write_p, count);
-				}
-				fallback = true;
-				if ((bufferwsize > 0) && (count >= buffersize) &&
-						!(write_p & buffermask)) {
-					retval = cfi_write_words(bank, buffer, bufferwsize, write_p);
-					if (retval == ERROR_OK) {
-						buffer += buffersize;
-						write_p += buffersize;
-						count -= buffersize;
-						fallback = false;
-					} else if (retval != ERROR_FLASH_OPER_UNSUPPORTED)
-						return retval;
-				}
-				/* try the slow way? */
-				if (fallback) {
-					for (unsigned int i = 0; i < bank->bus_width; i++)
-						current_word[i] = *buffer++;
-
-					retval = cfi_write_word(bank, current_word, write_p);
-					if (retval != ERROR_OK)
-						return retval;
-
-					write_p += bank->bus_width;
-					count -= bank->bus_width;
-				}
-			}
-		} else
-			return retval;
+	retval = cfi_write_aligned(bank, buffer, write_p, blk_count);
+	if (retval != ERROR_OK) {
+		free(swapped_buffer);
+		return retval;
 	}
+	buffer += blk_count;
+	write_p += blk_count;
+	count -= blk_count;
 
 	if (swapped_buffer) {
 		buffer = real_buffer + (buffer - swapped_buffer);
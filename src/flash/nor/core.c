@@ -16,6 +16,9 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <target/mem_track.h>
+#include <helper/coop.h>
+#include <helper/perf.h>
 
 /**
  * @file
@@ -30,11 +33,18 @@ int flash_driver_erase(struct flash_bank *bank, unsigned int first,
 		unsigned int last)
 {
 	int retval;
+	int64_t start = perf_begin();
 
+	/* drivers change the flash through registers and algorithms */
+	mem_track_invalidate(bank->target);
 	retval = bank->driver->erase(bank, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %u to %u", first, last);
 
+	if (start && last < bank->num_sectors)
+		perf_end(PERF_FLASH_ERASE, start, bank->sectors[last].offset +
+				bank->sectors[last].size - bank->sectors[first].offset);
+
 	return retval;
 }
 
@@ -87,8 +97,16 @@ int flash_driver_write(struct flash_bank *bank,
 {
 	int retval;
 
+	bank->write_crc_valid = false;
+	bank->write_crc_offset = offset;
+	bank->write_crc_count = count;
+
+	int64_t start = perf_begin();
+	mem_track_invalidate(bank->target);
 	retval = bank->driver->write(bank, buffer, offset, count);
+	perf_end(PERF_FLASH_WRITE, start, count);
 	if (retval != ERROR_OK) {
+		bank->write_crc_valid = false;
 		LOG_ERROR(
 			"error writing to flash at address " TARGET_ADDR_FMT
 			" at offset 0x%8.8" PRIx32,
@@ -106,7 +124,9 @@ int flash_driver_read(struct flash_bank *bank,
 
 	LOG_DEBUG("call flash_driver_read()");
 
+	int64_t start = perf_begin();
 	retval = bank->driver->read(bank, buffer, offset, count);
+	perf_end(PERF_FLASH_READ, start, count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
 			"error reading to flash at address " TARGET_ADDR_FMT
@@ -124,13 +144,49 @@ int default_flash_read(struct flash_bank *bank,
 	return target_read_buffer(bank->target, offset + bank->base, count, buffer);
 }
 
+void flash_driver_write_crc(struct flash_bank *bank, uint32_t crc)
+{
+	bank->write_crc = crc;
+	bank->write_crc_valid = true;
+}
+
+/* compare against the checksum the write loader read back, if it covers
+ * exactly this range, it is used only once */
+static int flash_verify_write_crc(struct flash_bank *bank,
+	const uint8_t *buffer, uint32_t offset, uint32_t count, bool *done)
+{
+	uint32_t image_crc;
+
+	*done = false;
+	if (!bank->write_crc_valid || bank->write_crc_offset != offset ||
+			bank->write_crc_count != count)
+		return ERROR_OK;
+	bank->write_crc_valid = false;
+
+	int retval = image_calculate_checksum(buffer, count, &image_crc);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_DEBUG("addr " TARGET_ADDR_FMT ", len 0x%08" PRIx32 ", crc 0x%08" PRIx32
+		" 0x%08" PRIx32 " read back while writing",
+		offset + bank->base, count, ~image_crc, ~bank->write_crc);
+	*done = true;
+	return bank->write_crc == image_crc ? ERROR_OK : ERROR_FAIL;
+}
+
 int flash_driver_verify(struct flash_bank *bank,
 	const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
+	bool done;
 	int retval;
+	int64_t start = perf_begin();
 
-	retval = bank->driver->verify ? bank->driver->verify(bank, buffer, offset, count) :
-		default_flash_verify(bank, buffer, offset, count);
+	retval = flash_verify_write_crc(bank, buffer, offset, count, &done);
+	if (!done && retval == ERROR_OK) {
+		retval = bank->driver->verify ? bank->driver->verify(bank, buffer, offset, count) :
+			default_flash_verify(bank, buffer, offset, count);
+	}
+	perf_end(PERF_FLASH_VERIFY, start, count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("verify failed in bank at " TARGET_ADDR_FMT " starting at 0x%8.8" PRIx32,
 			bank->base, offset);
@@ -727,44 +783,257 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
-int flash_write_unlock_verify(struct target *target, struct image *image,
-	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
+/* unlock, erase, write and verify one run of a flash bank */
+static int flash_write_run(struct target *target, struct flash_bank *c,
+	const uint8_t *buffer, target_addr_t run_address, uint32_t run_size,
+	bool erase, bool unlock, bool write, bool verify)
 {
 	int retval = ERROR_OK;
 
+	if (unlock)
+		retval = flash_unlock_address_range(target, run_address, run_size);
+	if (retval == ERROR_OK) {
+		if (erase) {
+			/* calculate and erase sectors */
+			retval = flash_erase_address_range(target,
+					true, run_address, run_size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (write) {
+			/* write flash sectors, a loader may checksum them on the way */
+			c->write_crc_wanted = verify;
+			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+			c->write_crc_wanted = false;
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (verify) {
+			/* verify flash sectors */
+			retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
+		}
+	}
+
+	return retval;
+}
+
+/* compare flash contents against buffer, without logging a mismatch */
+static bool flash_range_matches(struct flash_bank *c, const uint8_t *buffer,
+	uint32_t offset, uint32_t count)
+{
+	int retval = c->driver->verify ? c->driver->verify(c, buffer, offset, count) :
+		default_flash_verify(c, buffer, offset, count);
+	return retval == ERROR_OK;
+}
+
+/* Compare each block of a run against the buffer. Without a driver
+ * specific verify, all the blocks are checksummed at once. */
+static void flash_blocks_match(struct flash_bank *c, const uint8_t *buffer,
+	uint32_t run_start, struct target_memory_checksum_block *blocks,
+	unsigned int num_blocks, bool *matches)
+{
+	if (!c->driver->verify &&
+			target_checksum_memory_list(c->target, blocks, num_blocks) == ERROR_OK) {
+		for (unsigned int i = 0; i < num_blocks; i++) {
+			uint32_t image_crc;
+			const uint32_t offset = blocks[i].address - c->base;
+			matches[i] = image_calculate_checksum(buffer + offset - run_start,
+					blocks[i].size, &image_crc) == ERROR_OK &&
+				image_crc == blocks[i].checksum;
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < num_blocks; i++) {
+		const uint32_t offset = blocks[i].address - c->base;
+		matches[i] = flash_range_matches(c, buffer + offset - run_start,
+				offset, blocks[i].size);
+	}
+}
+
+/* Write only the sectors of a run whose contents differ from the buffer,
+ * consecutive differing sectors are programmed as one run. */
+static int flash_write_run_diff(struct target *target, struct flash_bank *c,
+	const uint8_t *buffer, target_addr_t run_address, uint32_t run_size,
+	bool unlock, bool verify, uint32_t *written)
+{
+	uint32_t run_start = run_address - c->base;
+	uint32_t run_end = run_start + run_size;
+	uint32_t diff_start = 0, diff_end = 0;
+	unsigned int total = 0, unchanged = 0;
+	int retval;
+
+	*written = 0;
+
+	/* the whole run is checked first, an unchanged image is common */
+	if (flash_range_matches(c, buffer, run_start, run_size)) {
+		LOG_INFO("flash bank %s unchanged at " TARGET_ADDR_FMT ", 0x%" PRIx32
+			" bytes skipped", c->name, run_address, run_size);
+		return ERROR_OK;
+	}
+
+	struct target_memory_checksum_block *blocks = calloc(c->num_sectors, sizeof(*blocks));
+	bool *matches = calloc(c->num_sectors, sizeof(*matches));
+	if (!blocks || !matches) {
+		LOG_ERROR("Out of memory");
+		free(blocks);
+		free(matches);
+		return ERROR_FAIL;
+	}
+
+	unsigned int num_blocks = 0;
+	for (unsigned int sector = 0; sector < c->num_sectors; sector++) {
+		uint32_t start = MAX(c->sectors[sector].offset, run_start);
+		uint32_t end = MIN(c->sectors[sector].offset + c->sectors[sector].size, run_end);
+
+		if (start >= end)
+			continue;
+		blocks[num_blocks].address = c->base + start;
+		blocks[num_blocks].size = end - start;
+		num_blocks++;
+	}
+	flash_blocks_match(c, buffer, run_start, blocks, num_blocks, matches);
+
+	retval = ERROR_OK;
+	for (unsigned int block = 0; block < num_blocks; block++) {
+		uint32_t start = blocks[block].address - c->base;
+		uint32_t end = start + blocks[block].size;
+
+		total++;
+		bool changed = !matches[block];
+		if (changed) {
+			if (diff_end != start)
+				diff_start = start;
+			diff_end = end;
+		} else {
+			unchanged++;
+		}
+
+		/* flush the pending differing sectors at the end of a span */
+		bool last = end == run_end;
+		if (diff_end > diff_start && (!changed || last)) {
+			retval = flash_write_run(target, c, buffer + diff_start - run_start,
+					c->base + diff_start, diff_end - diff_start,
+					true, unlock, true, verify);
+			if (retval != ERROR_OK)
+				break;
+			*written += diff_end - diff_start;
+			diff_start = diff_end;
+		}
+
+		if (last)
+			break;
+	}
+
+	free(blocks);
+	free(matches);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_INFO("flash bank %s: %u of %u sectors unchanged at " TARGET_ADDR_FMT,
+		c->name, unchanged, total, run_address);
+
+	return ERROR_OK;
+}
+
+/* Splits an image in runs of consecutive data of the same flash bank */
+struct flash_image_runs {
+	struct target *target;
+	struct image *image;
+	bool erase;
+	bool unlock;
+	/* banks of the other targets too, see get_any_flash_bank_by_addr() */
+	bool any_target;
+	/* the sections in ascending order of addresses */
+	struct imagesection **sections;
+	int *padding;
 	unsigned int section;
 	uint32_t section_offset;
-	struct flash_bank *c;
-	int *padding;
-
-	section = 0;
-	section_offset = 0;
+};
 
-	if (written)
-		*written = 0;
+/* The bank of any target at an address, those of target first */
+static int get_any_flash_bank_by_addr(struct target *target, target_addr_t addr,
+	struct flash_bank **result_bank)
+{
+	int retval = get_flash_bank_by_addr(target, addr, false, result_bank);
+	if (retval != ERROR_OK || *result_bank)
+		return retval;
 
-	if (erase) {
-		/* assume all sectors need erasing - stops any problems
-		 * when flash_write is called multiple times */
+	for (struct flash_bank *c = flash_banks; c; c = c->next) {
+		if (c->target == target)
+			continue;
 
-		flash_set_dirty();
+		retval = c->driver->auto_probe(c);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("auto_probe failed");
+			return retval;
+		}
+		if ((addr >= c->base) && (addr <= c->base + (c->size - 1))) {
+			*result_bank = c;
+			return ERROR_OK;
+		}
 	}
+	return ERROR_OK;
+}
+
+static int flash_image_runs_init(struct flash_image_runs *r, struct target *target,
+	struct image *image, bool erase, bool unlock, bool any_target)
+{
+	memset(r, 0, sizeof(*r));
+	r->target = target;
+	r->image = image;
+	r->erase = erase;
+	r->unlock = unlock;
+	r->any_target = any_target;
 
 	/* allocate padding array */
-	padding = calloc(image->num_sections, sizeof(*padding));
+	r->padding = calloc(image->num_sections, sizeof(*r->padding));
 
 	/* This fn requires all sections to be in ascending order of addresses,
 	 * whereas an image can have sections out of order. */
-	struct imagesection **sections = malloc(sizeof(struct imagesection *) *
-			image->num_sections);
+	r->sections = malloc(sizeof(struct imagesection *) * image->num_sections);
+
+	if (image->num_sections && (!r->padding || !r->sections)) {
+		free(r->padding);
+		free(r->sections);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 
 	for (unsigned int i = 0; i < image->num_sections; i++)
-		sections[i] = &image->sections[i];
+		r->sections[i] = &image->sections[i];
 
-	qsort(sections, image->num_sections, sizeof(struct imagesection *),
+	qsort(r->sections, image->num_sections, sizeof(struct imagesection *),
 		compare_section);
 
-	/* loop until we reach end of the image */
+	return ERROR_OK;
+}
+
+static void flash_image_runs_free(struct flash_image_runs *r)
+{
+	free(r->sections);
+	free(r->padding);
+}
+
+/*
+ * Read the next run of the image, padded as the bank requires, to a new
+ * buffer; *buffer is left NULL at the end of the image.
+ */
+static int flash_image_next_run(struct flash_image_runs *r, struct flash_bank **bank,
+	target_addr_t *address, uint32_t *size, uint8_t **buffer_out)
+{
+	struct image *image = r->image;
+	struct imagesection **sections = r->sections;
+	int *padding = r->padding;
+	unsigned int section = r->section;
+	uint32_t section_offset = r->section_offset;
+	struct flash_bank *c;
+	int retval;
+
+	*buffer_out = NULL;
+
 	while (section < image->num_sections) {
 		uint32_t buffer_idx;
 		uint8_t *buffer;
@@ -781,9 +1050,12 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 		}
 
 		/* find the corresponding flash bank */
-		retval = get_flash_bank_by_addr(target, run_address, false, &c);
+		if (r->any_target)
+			retval = get_any_flash_bank_by_addr(r->target, run_address, &c);
+		else
+			retval = get_flash_bank_by_addr(r->target, run_address, false, &c);
 		if (retval != ERROR_OK)
-			goto done;
+			return retval;
 		if (!c) {
 			LOG_WARNING("no flash bank found for address " TARGET_ADDR_FMT, run_address);
 			section++;	/* and skip it */
@@ -813,8 +1085,7 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 					" overlaps section ending at " TARGET_ADDR_FMT,
 					next_section_base, run_next_addr);
 				LOG_ERROR("Flash write aborted.");
-				retval = ERROR_FAIL;
-				goto done;
+				return ERROR_FAIL;
 			}
 
 			pad_bytes = next_section_base - run_next_addr;
@@ -874,7 +1145,7 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 				run_size += pad_bytes;
 			}
 
-		} else if (unlock || erase) {
+		} else if (r->unlock || r->erase) {
 			/* If we're applying any sector automagic, then pad this
 			 * (maybe-combined) segment to the end of its last sector.
 			 */
@@ -898,8 +1169,7 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 		buffer = malloc(run_size);
 		if (!buffer) {
 			LOG_ERROR("Out of memory for flash bank buffer");
-			retval = ERROR_FAIL;
-			goto done;
+			return ERROR_FAIL;
 		}
 
 		if (padding_at_start)
@@ -931,7 +1201,7 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 					size_read, buffer + buffer_idx, &size_read);
 			if (retval != ERROR_OK || size_read == 0) {
 				free(buffer);
-				goto done;
+				return retval;
 			}
 
 			buffer_idx += size_read;
@@ -949,46 +1219,215 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			}
 		}
 
-		retval = ERROR_OK;
+		r->section = section;
+		r->section_offset = section_offset;
+		*bank = c;
+		*address = run_address;
+		*size = run_size;
+		*buffer_out = buffer;
+		return ERROR_OK;
+	}
 
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
-			}
-		}
+	return ERROR_OK;
+}
 
-		if (retval == ERROR_OK) {
-			if (write) {
-				/* write flash sectors */
-				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
-			}
+/* Programs a run of the image in its bank, through the bank's target */
+static int flash_write_image_run(struct flash_bank *c, const uint8_t *buffer,
+	target_addr_t run_address, uint32_t run_size, bool erase, bool unlock,
+	bool write, bool verify, bool diff_only, uint32_t *written)
+{
+	*written = run_size;
+	if (diff_only && write)
+		return flash_write_run_diff(c->target, c, buffer, run_address,
+				run_size, unlock, verify, written);
+
+	return flash_write_run(c->target, c, buffer, run_address, run_size,
+			erase, unlock, write, verify);
+}
+
+struct flash_write_job {
+	struct flash_bank *bank;
+	target_addr_t address;
+	uint32_t size;
+	uint8_t *buffer;
+};
+
+/* The runs of the banks of one target, or SMP group */
+struct flash_write_worker {
+	struct target *target;
+	struct flash_write_job *jobs;
+	unsigned int num_jobs;
+	bool erase, unlock, write, verify, diff_only;
+	uint32_t written;
+};
+
+/* Targets of an SMP group share their memory and maybe their working area */
+static struct target *flash_write_worker_target(struct target *target)
+{
+	if (target->smp)
+		return list_first_entry(target->smp_targets, struct target_list, lh)->target;
+	return target;
+}
+
+static int flash_write_worker_run(void *arg)
+{
+	struct flash_write_worker *w = arg;
+
+	for (unsigned int i = 0; i < w->num_jobs; i++) {
+		struct flash_write_job *job = &w->jobs[i];
+		if (flash_write_worker_target(job->bank->target) != w->target)
+			continue;
+
+		uint32_t run_written;
+		int retval = flash_write_image_run(job->bank, job->buffer, job->address,
+				job->size, w->erase, w->unlock, w->write, w->verify, w->diff_only,
+				&run_written);
+		if (retval != ERROR_OK)
+			return retval;
+		w->written += run_written;
+	}
+	return ERROR_OK;
+}
+
+/*
+ * Reads all the runs first, then programs the banks of each target in a
+ * worker of its own. While one target waits for its flash, another one
+ * gets its data, see coop.h.
+ */
+static int flash_write_parallel(struct flash_image_runs *r, uint32_t *written,
+	bool erase, bool unlock, bool write, bool verify, bool diff_only)
+{
+	struct flash_write_job *jobs = NULL;
+	unsigned int num_jobs = 0;
+	struct flash_write_worker *workers = NULL;
+	void **args = NULL;
+	unsigned int num_workers = 0;
+	int retval;
+
+	while (true) {
+		struct flash_write_job job;
+		retval = flash_image_next_run(r, &job.bank, &job.address, &job.size,
+				&job.buffer);
+		if (retval != ERROR_OK || !job.buffer)
+			break;
+
+		struct flash_write_job *new_jobs = realloc(jobs, (num_jobs + 1) * sizeof(*jobs));
+		if (!new_jobs) {
+			free(job.buffer);
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+			break;
 		}
+		jobs = new_jobs;
+		jobs[num_jobs++] = job;
+	}
+	if (retval != ERROR_OK)
+		goto done;
+
+	workers = calloc(num_jobs, sizeof(*workers));
+	args = calloc(num_jobs, sizeof(*args));
+	if (num_jobs && (!workers || !args)) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto done;
+	}
 
-		if (retval == ERROR_OK) {
-			if (verify) {
-				/* verify flash sectors */
-				retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
-			}
+	for (unsigned int i = 0; i < num_jobs; i++) {
+		struct target *target = flash_write_worker_target(jobs[i].bank->target);
+		unsigned int w;
+		for (w = 0; w < num_workers; w++) {
+			if (workers[w].target == target)
+				break;
 		}
+		if (w < num_workers)
+			continue;
+
+		workers[w] = (struct flash_write_worker) {
+			.target = target,
+			.jobs = jobs,
+			.num_jobs = num_jobs,
+			.erase = erase,
+			.unlock = unlock,
+			.write = write,
+			.verify = verify,
+			.diff_only = diff_only,
+		};
+		args[w] = &workers[w];
+		num_workers++;
+	}
+
+	LOG_DEBUG("%u runs of flash on %u targets", num_jobs, num_workers);
+	retval = coop_run(flash_write_worker_run, args, num_workers);
+
+	if (written) {
+		for (unsigned int w = 0; w < num_workers; w++)
+			*written += workers[w].written;
+	}
+
+done:
+	for (unsigned int i = 0; i < num_jobs; i++)
+		free(jobs[i].buffer);
+	free(jobs);
+	free(workers);
+	free(args);
+	return retval;
+}
+
+int flash_write_unlock_verify(struct target *target, struct image *image,
+	uint32_t *written, bool erase, bool unlock, bool write, bool verify,
+	bool diff_only, bool parallel)
+{
+	struct flash_image_runs runs;
+	int retval;
+
+	if (written)
+		*written = 0;
+
+	if (erase) {
+		/* assume all sectors need erasing - stops any problems
+		 * when flash_write is called multiple times */
+
+		flash_set_dirty();
+	}
+
+	retval = flash_image_runs_init(&runs, target, image, erase, unlock, parallel);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (parallel) {
+		retval = flash_write_parallel(&runs, written, erase, unlock, write,
+				verify, diff_only);
+		flash_image_runs_free(&runs);
+		return retval;
+	}
+
+	/* loop until we reach end of the image */
+	while (true) {
+		struct flash_bank *c;
+		target_addr_t run_address;
+		uint32_t run_size;
+		uint8_t *buffer;
+
+		retval = flash_image_next_run(&runs, &c, &run_address, &run_size, &buffer);
+		if (retval != ERROR_OK || !buffer)
+			break;
+
+		uint32_t run_written;
+		retval = flash_write_image_run(c, buffer, run_address, run_size,
+				erase, unlock, write, verify, diff_only, &run_written);
 
 		free(buffer);
 
 		if (retval != ERROR_OK) {
 			/* abort operation */
-			goto done;
+			break;
 		}
 
 		if (written)
-			*written += run_size;	/* add run size to total written counter */
+			*written += run_written;	/* add run size to total written counter */
 	}
 
-done:
-	free(sections);
-	free(padding);
+	flash_image_runs_free(&runs);
 
 	return retval;
 }
@@ -996,7 +1435,8 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, bool erase)
 {
-	return flash_write_unlock_verify(target, image, written, erase, false, true, false);
+	return flash_write_unlock_verify(target, image, written, erase, false, true, false,
+		false, false);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size,
@@ -125,6 +125,18 @@ struct flash_bank {
 	/** Array of protection blocks, allocated and initialized by the flash driver */
 	struct flash_sector *prot_blocks;
 
+	/**
+	 * Set by the flash core while it writes a range it is going to verify
+	 * right away. A driver whose loader reads back what it programmed can
+	 * then accumulate a checksum, see flash_driver_write_crc().
+	 */
+	bool write_crc_wanted;
+	/** Checksum of the data read back during the last write, if valid. */
+	bool write_crc_valid;
+	uint32_t write_crc;
+	uint32_t write_crc_offset;
+	uint32_t write_crc_count;
+
 	struct flash_bank *next; /**< The next flash bank on this chip */
 };
 
@@ -210,6 +222,20 @@ int default_flash_read(struct flash_bank *bank,
 int default_flash_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
+/* seed of the CRC32_POLY_BE checksum used by verify */
+#define FLASH_WRITE_CRC_INIT	0xffffffff
+
+/**
+ * Called by a driver's write() when bank->write_crc_wanted is set and its
+ * loader checksummed the data it read back after programming. The checksum
+ * must cover the whole range passed to write(), starting from
+ * FLASH_WRITE_CRC_INIT. A following verify of the same range then compares
+ * it with the image instead of reading back the flash.
+ * @param bank The bank written.
+ * @param crc The checksum of the data read back.
+ */
+void flash_driver_write_crc(struct flash_bank *bank, uint32_t crc);
+
 /**
  * Provides default erased-bank check handling. Checks to see if
  * the flash driver knows they are erased; if things look uncertain,
@@ -817,8 +817,8 @@ static int efm32x_write_block(struct flash_bank *bank, const uint8_t *buf,
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	ret = target_write_buffer(target, write_algorithm->address,
-			sizeof(efm32x_flash_write_code), efm32x_flash_write_code);
+	ret = target_write_working_area_code(target, write_algorithm,
+			efm32x_flash_write_code, sizeof(efm32x_flash_write_code));
 	if (ret != ERROR_OK)
 		return ret;
 
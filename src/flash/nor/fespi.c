@@ -114,6 +114,8 @@ struct fespi_flash_bank {
 	bool probed;
 	target_addr_t ctrl_base;
 	const struct flash_device *dev;
+	/* memory can't be written while the loader runs, don't try again */
+	bool no_async_write;
 };
 
 struct fespi_target {
@@ -353,6 +355,28 @@ static int fespi_erase_sector(struct flash_bank *bank, int sector)
 	return ERROR_OK;
 }
 
+static int fespi_bulk_erase(struct flash_bank *bank)
+{
+	struct fespi_flash_bank *fespi_info = bank->driver_priv;
+	int retval;
+
+	retval = fespi_tx(bank, SPIFLASH_WRITE_ENABLE);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = fespi_txwm_wait(bank);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = fespi_tx(bank, fespi_info->dev->chip_erase_cmd);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = fespi_txwm_wait(bank);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return fespi_wip(bank, bank->num_sectors * FESPI_MAX_TIMEOUT);
+}
+
 static int fespi_erase(struct flash_bank *bank, unsigned int first,
 		unsigned int last)
 {
@@ -404,6 +428,17 @@ static int fespi_erase(struct flash_bank *bank, unsigned int first,
 	if (retval != ERROR_OK)
 		goto done;
 
+	/* a single chip erase is much faster than erasing every sector */
+	if (first == 0 && last == (bank->num_sectors - 1) &&
+			fespi_info->dev->chip_erase_cmd != 0x00 &&
+			fespi_info->dev->chip_erase_cmd != fespi_info->dev->erase_cmd) {
+		LOG_DEBUG("Trying bulk erase.");
+		retval = fespi_bulk_erase(bank);
+		if (retval == ERROR_OK)
+			goto done;
+		LOG_WARNING("Bulk flash erase failed. Falling back to sector erase.");
+	}
+
 	for (unsigned int sector = first; sector <= last; sector++) {
 		retval = fespi_erase_sector(bank, sector);
 		if (retval != ERROR_OK)
@@ -520,7 +555,9 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 
 	unsigned int xlen = riscv_xlen(target);
 	struct working_area *algorithm_wa = NULL;
-	struct working_area *data_wa = NULL;
+	/* With two data buffers the next chunk is downloaded while the loader
+	 * programs the previous one. */
+	struct working_area *data_wa[2] = { NULL, NULL };
 	const uint8_t *bin;
 	size_t bin_size;
 	if (xlen == 32) {
@@ -542,14 +579,20 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 			algorithm_wa = NULL;
 
 		} else {
-			data_wa_size = MIN(target_get_working_area_avail(target), count);
+			unsigned int avail = target_get_working_area_avail(target);
+			data_wa_size = MIN(avail, count);
+			if (count > avail && !fespi_info->no_async_write && avail / 2 >= 128)
+				data_wa_size = (avail / 2) & ~3u;
 			if (data_wa_size < 128) {
 				LOG_WARNING("Couldn't allocate data working area.");
 				target_free_working_area(target, algorithm_wa);
 				algorithm_wa = NULL;
-			} else if (target_alloc_working_area(target, data_wa_size, &data_wa) != ERROR_OK) {
+			} else if (target_alloc_working_area(target, data_wa_size, &data_wa[0]) != ERROR_OK) {
 				target_free_working_area(target, algorithm_wa);
 				algorithm_wa = NULL;
+			} else if (data_wa_size < count &&
+					target_alloc_working_area_try(target, data_wa_size, &data_wa[1]) != ERROR_OK) {
+				data_wa[1] = NULL;
 			}
 		}
 	} else {
@@ -570,32 +613,62 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 		init_reg_param(&reg_params[4], "a4", xlen, PARAM_OUT);
 		init_reg_param(&reg_params[5], "a5", xlen, PARAM_OUT);
 
+		unsigned int cur = 0;
+		cur_count = MIN(count, data_wa_size);
+		retval = target_write_buffer(target, data_wa[cur]->address, cur_count,
+				buffer);
+		if (retval != ERROR_OK) {
+			LOG_DEBUG("Failed to write %d bytes to " TARGET_ADDR_FMT ": %d",
+					cur_count, data_wa[cur]->address, retval);
+			goto err;
+		}
+
 		while (count > 0) {
-			cur_count = MIN(count, data_wa_size);
 			buf_set_u64(reg_params[0].value, 0, xlen, fespi_info->ctrl_base);
 			buf_set_u64(reg_params[1].value, 0, xlen, page_size);
-			buf_set_u64(reg_params[2].value, 0, xlen, data_wa->address);
+			buf_set_u64(reg_params[2].value, 0, xlen, data_wa[cur]->address);
 			buf_set_u64(reg_params[3].value, 0, xlen, offset);
 			buf_set_u64(reg_params[4].value, 0, xlen, cur_count);
 			buf_set_u64(reg_params[5].value, 0, xlen,
 					fespi_info->dev->pprog_cmd | (bank->size > 0x1000000 ? 0x100 : 0));
 
-			retval = target_write_buffer(target, data_wa->address, cur_count,
-					buffer);
-			if (retval != ERROR_OK) {
-				LOG_DEBUG("Failed to write %d bytes to " TARGET_ADDR_FMT ": %d",
-						cur_count, data_wa->address, retval);
-				goto err;
-			}
-
 			LOG_DEBUG("write(ctrl_base=0x%" TARGET_PRIxADDR ", page_size=0x%x, "
 					"address=0x%" TARGET_PRIxADDR ", offset=0x%" PRIx32
 					", count=0x%" PRIx32 "), buffer=%02x %02x %02x %02x %02x %02x ..." PRIx32,
-					fespi_info->ctrl_base, page_size, data_wa->address, offset, cur_count,
+					fespi_info->ctrl_base, page_size, data_wa[cur]->address, offset, cur_count,
 					buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5]);
-			retval = target_run_algorithm(target, 0, NULL,
+			retval = target_start_algorithm(target, 0, NULL,
 					ARRAY_SIZE(reg_params), reg_params,
-					algorithm_wa->address, 0, cur_count * 2, NULL);
+					algorithm_wa->address, 0, NULL);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("Failed to execute algorithm at " TARGET_ADDR_FMT ": %d",
+						algorithm_wa->address, retval);
+				goto err;
+			}
+
+			uint32_t run_count = cur_count;
+			buffer += cur_count;
+			offset += cur_count;
+			count -= cur_count;
+
+			/* Download the next chunk while this one is programmed. This
+			 * needs memory accesses that work on a running hart. */
+			cur_count = MIN(count, data_wa_size);
+			bool next_loaded = false;
+			if (cur_count && data_wa[1] && !fespi_info->no_async_write) {
+				if (target_write_buffer(target, data_wa[!cur]->address,
+							cur_count, buffer) == ERROR_OK) {
+					next_loaded = true;
+				} else {
+					LOG_INFO("Can't write memory while the flash loader runs, "
+							"using a single buffer.");
+					fespi_info->no_async_write = true;
+				}
+			}
+
+			retval = target_wait_algorithm(target, 0, NULL,
+					ARRAY_SIZE(reg_params), reg_params,
+					0, run_count * 2, NULL);
 			if (retval != ERROR_OK) {
 				LOG_ERROR("Failed to execute algorithm at " TARGET_ADDR_FMT ": %d",
 						algorithm_wa->address, retval);
@@ -609,12 +682,24 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 				goto err;
 			}
 
-			buffer += cur_count;
-			offset += cur_count;
-			count -= cur_count;
+			if (!cur_count)
+				break;
+
+			if (next_loaded) {
+				cur = !cur;
+			} else {
+				retval = target_write_buffer(target, data_wa[cur]->address,
+						cur_count, buffer);
+				if (retval != ERROR_OK) {
+					LOG_DEBUG("Failed to write %d bytes to " TARGET_ADDR_FMT ": %d",
+							cur_count, data_wa[cur]->address, retval);
+					goto err;
+				}
+			}
 		}
 
-		target_free_working_area(target, data_wa);
+		target_free_working_area(target, data_wa[1]);
+		target_free_working_area(target, data_wa[0]);
 		target_free_working_area(target, algorithm_wa);
 
 	} else {
@@ -656,7 +741,8 @@ static int fespi_write(struct flash_bank *bank, const uint8_t *buffer,
 	return ERROR_OK;
 
 err:
-	target_free_working_area(target, data_wa);
+	target_free_working_area(target, data_wa[1]);
+	target_free_working_area(target, data_wa[0]);
 	target_free_working_area(target, algorithm_wa);
 
 	/* Switch to HW mode before return to prompt */
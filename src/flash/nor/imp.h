@@ -37,8 +37,12 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/* write (optional verify) an image to flash memory of the given target,
+ * with diff_only set only the sectors whose contents differ are erased and written,
+ * with parallel set the banks of the other targets are written too, one
+ * target's waits overlapping with the transfers to another one */
 int flash_write_unlock_verify(struct target *target, struct image *image,
-		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
+		uint32_t *written, bool erase, bool unlock, bool write, bool verify,
+		bool diff_only, bool parallel);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
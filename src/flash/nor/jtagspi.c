@@ -12,9 +12,15 @@
 #include <jtag/jtag.h>
 #include <flash/nor/spi.h>
 #include <helper/time_support.h>
+#include <jtag/adapter.h>
 #include <pld/pld.h>
 
 #define JTAGSPI_MAX_TIMEOUT 3000
+/* pages programmed per queue flush through a proxy bitstream */
+#define JTAGSPI_PAGES_PER_FLUSH		16
+/* initial wait after a page program, adjusted to the flash afterwards */
+#define JTAGSPI_PAGE_PROGRAM_US		1000
+#define JTAGSPI_PAGE_PROGRAM_MIN_US	50
 
 
 struct jtagspi_flash_bank {
@@ -27,6 +33,7 @@ struct jtagspi_flash_bank {
 	struct pld_device *pld_device; /* if not NULL, the PLD has special instructions for JTAGSPI */
 	uint32_t ir;                   /* when !pld_device, this instruction code is used in
 									  jtagspi_set_user_ir to connect through a proxy bitstream */
+	unsigned int page_program_us;  /* how long a page program is expected to take */
 };
 
 FLASH_BANK_COMMAND_HANDLER(jtagspi_flash_bank_command)
@@ -76,6 +83,7 @@ FLASH_BANK_COMMAND_HANDLER(jtagspi_flash_bank_command)
 
 	info->ir = ir;
 	info->pld_device = device;
+	info->page_program_us = JTAGSPI_PAGE_PROGRAM_US;
 
 	return ERROR_OK;
 }
@@ -99,7 +107,11 @@ static void flip_u8(const uint8_t *in, uint8_t *out, unsigned int len)
 		out[i] = flip_u32(in[i], 8);
 }
 
-static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
+/*
+ * Queue a SPI command. The write and data buffers are bit reversed in
+ * place, and so is read data once the queue has been executed.
+ */
+static int jtagspi_queue_cmd(struct flash_bank *bank, uint8_t cmd,
 		uint8_t *write_buffer, unsigned int write_len, uint8_t *data_buffer, int data_len)
 {
 	assert(write_buffer || write_len == 0);
@@ -194,12 +206,23 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 
 	/* passing from an IR scan to SHIFT-DR clears BYPASS registers */
 	jtag_add_dr_scan(info->tap, n, fields, TAP_IDLE);
-	int retval = jtag_execute_queue();
+	return ERROR_OK;
+}
+
+static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
+		uint8_t *write_buffer, unsigned int write_len, uint8_t *data_buffer, int data_len)
+{
+	struct jtagspi_flash_bank *info = bank->driver_priv;
+
+	int retval = jtagspi_queue_cmd(bank, cmd, write_buffer, write_len, data_buffer, data_len);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = jtag_execute_queue();
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (is_read)
-		flip_u8(data_buffer, data_buffer, data_len);
+	if (data_len < 0)
+		flip_u8(data_buffer, data_buffer, -data_len);
 
 	if (info->pld_device)
 		return pld_disconnect_spi_from_jtag(info->pld_device);
@@ -740,6 +763,110 @@ static int jtagspi_page_write(struct flash_bank *bank, const uint8_t *buffer, ui
 	return jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
 }
 
+/* Queue a wait for about the typical page program time, clocking TCK if possible. */
+static void jtagspi_queue_page_program_wait(struct jtagspi_flash_bank *info)
+{
+	unsigned int khz = adapter_get_speed_khz();
+
+	if (khz)
+		jtag_add_runtest(MIN((uint64_t)info->page_program_us * khz / 1000, INT_MAX), TAP_IDLE);
+	else
+		jtag_add_sleep(info->page_program_us);
+}
+
+/*
+ * Program pages through a proxy bitstream, JTAGSPI_PAGES_PER_FLUSH at a
+ * time. Each page program is followed by a wait for the typical program
+ * time instead of status polls, then the next page is written enabled
+ * and the status is read before its page program is shifted. The flash
+ * ignores commands while it's busy, so a page whose status shows the
+ * flash busy, or not write enabled, and all the pages after it are
+ * programmed again in the next flush, after a longer wait.
+ */
+static int jtagspi_write_pipelined(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, uint32_t pagesize)
+{
+	struct jtagspi_flash_bank *info = bank->driver_priv;
+	uint8_t addr[sizeof(uint32_t)];
+	uint8_t status[JTAGSPI_PAGES_PER_FLUSH + 1];
+	uint32_t sizes[JTAGSPI_PAGES_PER_FLUSH];
+	int retval;
+
+	uint8_t *page = malloc(pagesize);
+	if (!page) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* ATXP032/064/128 use always 4-byte addresses except for 0x03 read */
+	unsigned int addr_len = ((info->dev.read_cmd != 0x03) && info->always_4byte) ? 4 : info->addr_len;
+
+	while (count > 0) {
+		keep_alive();
+
+		unsigned int n = 0;
+		uint32_t o = offset;
+		const uint8_t *b = buffer;
+		uint32_t c = count;
+		retval = ERROR_OK;
+		for (; n < JTAGSPI_PAGES_PER_FLUSH && c > 0 && retval == ERROR_OK; n++) {
+			/* length up to end of current page, but no more than remaining size */
+			sizes[n] = MIN(((o + pagesize) & ~(pagesize - 1)) - o, c);
+
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, 0, NULL, 0);
+			if (retval == ERROR_OK)
+				retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, 0, &status[n], -1);
+			memcpy(page, b, sizes[n]);
+			if (retval == ERROR_OK)
+				retval = jtagspi_queue_cmd(bank, info->dev.pprog_cmd,
+					fill_addr(o, addr_len, addr), addr_len, page, sizes[n]);
+			jtagspi_queue_page_program_wait(info);
+
+			o += sizes[n];
+			b += sizes[n];
+			c -= sizes[n];
+		}
+		if (retval == ERROR_OK)
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, 0, &status[n], -1);
+		if (retval == ERROR_OK)
+			retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			break;
+		flip_u8(status, status, n + 1);
+
+		unsigned int done = 0;
+		while (done < n && (status[done] & (SPIFLASH_WE_BIT | SPIFLASH_BSY_BIT)) == SPIFLASH_WE_BIT) {
+			offset += sizes[done];
+			buffer += sizes[done];
+			count -= sizes[done];
+			done++;
+		}
+		LOG_DEBUG("wrote %u of %u pages up to 0x%08" PRIx32 ", waiting %u us per page",
+			done, n, offset, info->page_program_us);
+
+		if (!done) {
+			LOG_ERROR("Cannot enable write to flash. Status=0x%02" PRIx8, status[0]);
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		if (done < n) {
+			info->page_program_us = MIN(2 * info->page_program_us, JTAGSPI_MAX_TIMEOUT * 1000);
+		} else if (!(status[n] & SPIFLASH_BSY_BIT)) {
+			info->page_program_us = MAX(info->page_program_us - info->page_program_us / 8,
+				JTAGSPI_PAGE_PROGRAM_MIN_US);
+			continue;
+		}
+
+		retval = jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	free(page);
+	return retval;
+}
+
 static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
@@ -754,6 +881,10 @@ static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_
 	/* if no write pagesize, use reasonable default */
 	pagesize = info->dev.pagesize ? info->dev.pagesize : SPIFLASH_DEF_PAGESIZE;
 
+	/* the PLD may have to connect the flash for each command */
+	if (!info->pld_device)
+		return jtagspi_write_pipelined(bank, buffer, offset, count, pagesize);
+
 	while (count > 0) {
 		/* length up to end of current page */
 		currsize = ((offset + pagesize) & ~(pagesize - 1)) - offset;
@@ -18,6 +18,7 @@
 #include <helper/types.h>
 #include <helper/time_support.h>
 #include <helper/bits.h>
+#include <helper/crc32.h>
 
 /* The refresh code is constant across the current spectrum of nRF5 devices */
 #define WATCHDOG_REFRESH_VALUE          0x6e524635
@@ -1109,13 +1110,15 @@ static int nrf5_erase_page(struct flash_bank *bank,
 }
 
 /* Start a low level flash write for the specified region */
-static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const uint8_t *buffer, uint32_t bytes)
+/* If bank->write_crc_wanted, the loader checksums the words it read back */
+static int nrf5_ll_flash_write(struct nrf5_info *chip, struct flash_bank *bank,
+		uint32_t address, const uint8_t *buffer, uint32_t bytes)
 {
 	struct target *target = chip->target;
 	uint32_t buffer_size = 8192;
 	struct working_area *write_algorithm;
 	struct working_area *source;
-	struct reg_param reg_params[6];
+	struct reg_param reg_params[8];
 	struct armv7m_algorithm armv7m_info;
 	int retval = ERROR_OK;
 
@@ -1147,9 +1150,8 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 		return ERROR_OK;
 	}
 
-	retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(nrf5_flash_write_code),
-				nrf5_flash_write_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+				nrf5_flash_write_code, sizeof(nrf5_flash_write_code));
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1175,6 +1177,8 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 	init_reg_param(&reg_params[3], "r3", 32, PARAM_IN_OUT);	/* target address */
 	init_reg_param(&reg_params[4], "r6", 32, PARAM_OUT);	/* watchdog refresh value */
 	init_reg_param(&reg_params[5], "r7", 32, PARAM_OUT);	/* watchdog refresh register address */
+	init_reg_param(&reg_params[6], "r8", 32, PARAM_IN_OUT);	/* CRC */
+	init_reg_param(&reg_params[7], "r9", 32, PARAM_OUT);	/* CRC polynomial */
 
 	buf_set_u32(reg_params[0].value, 0, 32, bytes);
 	buf_set_u32(reg_params[1].value, 0, 32, source->address);
@@ -1182,6 +1186,8 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 	buf_set_u32(reg_params[3].value, 0, 32, address);
 	buf_set_u32(reg_params[4].value, 0, 32, WATCHDOG_REFRESH_VALUE);
 	buf_set_u32(reg_params[5].value, 0, 32, chip->map->watchdog_refresh_addr);
+	buf_set_u32(reg_params[6].value, 0, 32, FLASH_WRITE_CRC_INIT);
+	buf_set_u32(reg_params[7].value, 0, 32, bank->write_crc_wanted ? CRC32_POLY_BE : 0);
 
 	retval = target_run_flash_async_algorithm(target, buffer, bytes/4, 4,
 			0, NULL,
@@ -1190,15 +1196,14 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 			write_algorithm->address, write_algorithm->address + sizeof(nrf5_flash_write_code) - 2,
 			&armv7m_info);
 
+	if (retval == ERROR_OK && bank->write_crc_wanted)
+		flash_driver_write_crc(bank, buf_get_u32(reg_params[6].value, 0, 32));
+
 	target_free_working_area(target, source);
 	target_free_working_area(target, write_algorithm);
 
-	destroy_reg_param(&reg_params[0]);
-	destroy_reg_param(&reg_params[1]);
-	destroy_reg_param(&reg_params[2]);
-	destroy_reg_param(&reg_params[3]);
-	destroy_reg_param(&reg_params[4]);
-	destroy_reg_param(&reg_params[5]);
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
 
 	return retval;
 }
@@ -1253,7 +1258,7 @@ static int nrf5_write(struct flash_bank *bank, const uint8_t *buffer,
 	if (res != ERROR_OK)
 		goto error;
 
-	res = nrf5_ll_flash_write(chip, bank->base + offset, buffer, count);
+	res = nrf5_ll_flash_write(chip, bank, bank->base + offset, buffer, count);
 	if (res != ERROR_OK)
 		goto error;
 
@@ -5,6 +5,7 @@
 #endif
 
 #include "imp.h"
+#include <helper/align.h>
 #include <helper/binarybuffer.h>
 #include <target/algorithm.h>
 #include <target/armv7m.h>
@@ -211,6 +212,91 @@ static int rp2040_stack_grab_and_prep(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
+/* Stream whole pages through a fifo to a loader calling flash_range_program()
+ * per page, with the flash kept out of XIP mode for the entire write.
+ * Must be called between rp2040_stack_grab_and_prep() and
+ * rp2040_finalize_stack_free().
+ */
+static int rp2040_write_block(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	struct rp2040_flash_bank *priv = bank->driver_priv;
+	struct target *target = bank->target;
+	uint32_t page_size = priv->dev->pagesize;
+	struct working_area *write_algorithm;
+	struct working_area *source;
+	struct reg_param reg_params[7];
+	struct armv7m_algorithm armv7m_info;
+
+	static const uint8_t rp2040_flash_write_code[] = {
+#include "../../../contrib/loaders/flash/rp2040/rp2040.inc"
+	};
+
+	if (!IS_PWR_OF_2(page_size) || count % page_size)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (target_alloc_working_area(target, sizeof(rp2040_flash_write_code),
+			&write_algorithm) != ERROR_OK) {
+		LOG_WARNING("no working area available, can't do block memory writes");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	int retval = target_write_working_area_code(target, write_algorithm,
+			rp2040_flash_write_code, sizeof(rp2040_flash_write_code));
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, write_algorithm);
+		return retval;
+	}
+
+	/* fifo of at most 16 pages, at least 2 to overlap transfer and programming */
+	uint32_t fifo_pages = MIN(16, count / page_size);
+	while (target_alloc_working_area_try(target, 8 + fifo_pages * page_size,
+			&source) != ERROR_OK) {
+		fifo_pages /= 2;
+		if (fifo_pages < 2) {
+			target_free_working_area(target, write_algorithm);
+			LOG_WARNING("no large enough working area available, can't do block memory writes");
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);	/* fifo start */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* fifo end */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* flash offset */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* page count */
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);	/* page size */
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);	/* flash_range_program() */
+	init_reg_param(&reg_params[6], "sp", 32, PARAM_OUT);	/* ROM function stack */
+
+	buf_set_u32(reg_params[0].value, 0, 32, source->address);
+	buf_set_u32(reg_params[1].value, 0, 32, source->address + source->size);
+	buf_set_u32(reg_params[2].value, 0, 32, offset);
+	buf_set_u32(reg_params[3].value, 0, 32, count / page_size);
+	buf_set_u32(reg_params[4].value, 0, 32, page_size);
+	buf_set_u32(reg_params[5].value, 0, 32, priv->jump_flash_range_program | 1);
+	buf_set_u32(reg_params[6].value, 0, 32, priv->stack->address + priv->stack->size);
+
+	retval = target_run_flash_async_algorithm(target, buffer, count / page_size, page_size,
+			0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			source->address, source->size,
+			write_algorithm->address, 0,
+			&armv7m_info);
+	if (retval != ERROR_OK)
+		LOG_ERROR("error executing rp2040 flash write algorithm");
+
+	target_free_working_area(target, source);
+	target_free_working_area(target, write_algorithm);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	return retval;
+}
+
 static int rp2040_flash_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	LOG_DEBUG("Writing %d bytes starting at 0x%" PRIx32, count, offset);
@@ -229,6 +315,12 @@ static int rp2040_flash_write(struct flash_bank *bank, const uint8_t *buffer, ui
 	if (err != ERROR_OK)
 		goto cleanup;
 
+	err = rp2040_write_block(bank, buffer, offset, count);
+	if (err != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		goto cleanup;
+
+	LOG_DEBUG("falling back to programming through a bounce buffer");
+
 	unsigned int avail_pages = target_get_working_area_avail(target) / priv->dev->pagesize;
 	/* We try to allocate working area rounded down to device page size,
 	 * al least 1 page, at most the write data size
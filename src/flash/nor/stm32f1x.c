@@ -19,6 +19,7 @@
 
 #include "imp.h"
 #include <helper/binarybuffer.h>
+#include <helper/crc32.h>
 #include <target/algorithm.h>
 #include <target/cortex_m.h>
 
@@ -464,8 +465,8 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code), stm32x_flash_write_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			stm32x_flash_write_code, sizeof(stm32x_flash_write_code));
 	if (retval != ERROR_OK) {
 		target_free_working_area(target, write_algorithm);
 		return retval;
@@ -492,19 +493,24 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	struct reg_param reg_params[5];
+	struct reg_param reg_params[7];
 
 	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* flash base (in), status (out) */
 	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* count (halfword-16bit) */
 	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* buffer start */
 	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* buffer end */
 	init_reg_param(&reg_params[4], "r4", 32, PARAM_IN_OUT);	/* target address */
+	init_reg_param(&reg_params[5], "r8", 32, PARAM_IN_OUT);	/* CRC */
+	init_reg_param(&reg_params[6], "r9", 32, PARAM_OUT);	/* CRC polynomial */
 
 	buf_set_u32(reg_params[0].value, 0, 32, stm32x_info->register_base);
 	buf_set_u32(reg_params[1].value, 0, 32, hwords_count);
 	buf_set_u32(reg_params[2].value, 0, 32, source->address);
 	buf_set_u32(reg_params[3].value, 0, 32, source->address + source->size);
 	buf_set_u32(reg_params[4].value, 0, 32, address);
+	buf_set_u32(reg_params[5].value, 0, 32, FLASH_WRITE_CRC_INIT);
+	/* checksum what was programmed if it is verified right after */
+	buf_set_u32(reg_params[6].value, 0, 32, bank->write_crc_wanted ? CRC32_POLY_BE : 0);
 
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
@@ -529,6 +535,8 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 
 		LOG_ERROR("flash write failed just before address 0x%"PRIx32,
 				buf_get_u32(reg_params[4].value, 0, 32));
+	} else if (retval == ERROR_OK && bank->write_crc_wanted) {
+		flash_driver_write_crc(bank, buf_get_u32(reg_params[5].value, 0, 32));
 	}
 
 	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
@@ -558,8 +566,8 @@ static int stm32x_write_block_riscv(struct flash_bank *bank, const uint8_t *buff
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	int retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(gd32vf103_flash_write_code), gd32vf103_flash_write_code);
+	int retval = target_write_working_area_code(target, write_algorithm,
+			gd32vf103_flash_write_code, sizeof(gd32vf103_flash_write_code));
 	if (retval != ERROR_OK) {
 		target_free_working_area(target, write_algorithm);
 		return retval;
@@ -715,9 +715,8 @@ static int stm32x_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code),
-			stm32x_flash_write_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			stm32x_flash_write_code, sizeof(stm32x_flash_write_code));
 	if (retval != ERROR_OK) {
 		target_free_working_area(target, write_algorithm);
 		return retval;
@@ -551,6 +551,12 @@ static int stm32x_protect(struct flash_bank *bank, int set, unsigned int first,
 	return stm32x_write_option(bank, FLASH_WPSN_PRG, protection);
 }
 
+/*
+ * Both banks have their own controller and could be programmed at the same
+ * time, but the flash core hands us one bank at a time. The loader already
+ * programs faster than a debug adapter can fill the fifo, so running one
+ * loader per bank would not shorten the write anyway.
+ */
 static int stm32x_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		uint32_t offset, uint32_t count)
 {
@@ -579,9 +585,8 @@ static int stm32x_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code),
-			stm32x_flash_write_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			stm32x_flash_write_code, sizeof(stm32x_flash_write_code));
 	if (retval != ERROR_OK) {
 		target_free_working_area(target, write_algorithm);
 		return retval;
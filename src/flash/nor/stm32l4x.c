@@ -1394,7 +1394,9 @@ static int stm32l4_protect(struct flash_bank *bank, int set, unsigned int first,
 	}
 }
 
-/* count is the size divided by stm32l4_info->data_width */
+/* count is the size divided by stm32l4_info->data_width
+ * In dual bank mode both banks still share a single controller (one BSY flag
+ * and one CR), so the banks cannot be programmed concurrently. */
 static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	uint32_t offset, uint32_t count)
 {
@@ -1417,9 +1419,8 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32l4_flash_write_code),
-			stm32l4_flash_write_code);
+	retval = target_write_working_area_code(target, write_algorithm,
+			stm32l4_flash_write_code, sizeof(stm32l4_flash_write_code));
 	if (retval != ERROR_OK) {
 		target_free_working_area(target, write_algorithm);
 		return retval;
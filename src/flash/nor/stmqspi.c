@@ -171,6 +171,9 @@ struct stmqspi_flash_bank {
 	uint32_t saved_ir;	/* only for OCTOSPI */
 	unsigned int sfdp_dummy1;	/* number of dummy bytes for SFDP read for flash1 and octo */
 	unsigned int sfdp_dummy2;	/* number of dummy bytes for SFDP read for flash2 */
+	/* SFDP results for flash1 and flash2, reused while the id doesn't change */
+	struct flash_device sfdp_dev[2];
+	uint32_t sfdp_id[2];
 };
 
 static inline int octospi_cmd(struct flash_bank *bank, uint32_t mode,
@@ -223,6 +226,8 @@ FLASH_BANK_COMMAND_HANDLER(stmqspi_flash_bank_command)
 	bank->driver_priv = stmqspi_info;
 	stmqspi_info->sfdp_dummy1 = 0;
 	stmqspi_info->sfdp_dummy2 = 0;
+	stmqspi_info->sfdp_id[0] = 0;
+	stmqspi_info->sfdp_id[1] = 0;
 	stmqspi_info->probed = false;
 	stmqspi_info->io_base = io_base;
 
@@ -408,7 +413,7 @@ static int wait_till_ready(struct flash_bank *bank, int timeout)
 
 		if ((status & ((SPIFLASH_BSY_BIT << 8) | SPIFLASH_BSY_BIT)) == 0)
 			return retval;
-		alive_sleep(25);
+		alive_sleep(1);
 	} while (timeval_ms() < endtime);
 
 	LOG_ERROR("timeout");
@@ -482,14 +487,67 @@ err:
 	return retval;
 }
 
+/* Erase the whole flash chip(s), the caller switches back to memory mapped mode */
+static int qspi_mass_erase(struct flash_bank *bank)
+{
+	struct target *target = bank->target;
+	struct stmqspi_flash_bank *stmqspi_info = bank->driver_priv;
+	uint32_t io_base = stmqspi_info->io_base;
+	uint16_t status;
+	int retval;
+
+	retval = qspi_write_enable(bank);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* Send Mass Erase command */
+	if (IS_OCTOSPI)
+		retval = octospi_cmd(bank, OCTOSPI_WRITE_MODE, OCTOSPI_CCR_MASS_ERASE,
+			stmqspi_info->dev.chip_erase_cmd);
+	else
+		retval = target_write_u32(target, io_base + QSPI_CCR, QSPI_CCR_MASS_ERASE);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* Wait for transmit of command completed */
+	retval = poll_busy(bank, SPI_CMD_TIMEOUT);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* Read flash status register(s) */
+	retval = read_status_reg(bank, &status);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* Check for command in progress for flash 1 */
+	if (((stmqspi_info->saved_cr & (BIT(SPI_DUAL_FLASH) | BIT(SPI_FSEL_FLASH)))
+		!= BIT(SPI_FSEL_FLASH)) && ((status & SPIFLASH_BSY_BIT) == 0) &&
+		((status & SPIFLASH_WE_BIT) != 0)) {
+		LOG_ERROR("Mass erase command not accepted by flash1. Status=0x%02x",
+			status & 0xFFU);
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	/* Check for command in progress for flash 2 */
+	status >>= 8;
+	if (((stmqspi_info->saved_cr & (BIT(SPI_DUAL_FLASH) | BIT(SPI_FSEL_FLASH))) != 0) &&
+		((status & SPIFLASH_BSY_BIT) == 0) &&
+		((status & SPIFLASH_WE_BIT) != 0)) {
+		LOG_ERROR("Mass erase command not accepted by flash2. Status=0x%02x",
+			status & 0xFFU);
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	/* Poll WIP for end of self timed Sector Erase cycle */
+	return wait_till_ready(bank, SPI_MASS_ERASE_TIMEOUT);
+}
+
 COMMAND_HANDLER(stmqspi_handle_mass_erase_command)
 {
 	struct target *target = NULL;
 	struct flash_bank *bank;
 	struct stmqspi_flash_bank *stmqspi_info;
 	struct duration bench;
-	uint32_t io_base;
-	uint16_t status;
 	unsigned int sector;
 	int retval;
 
@@ -527,55 +585,9 @@ COMMAND_HANDLER(stmqspi_handle_mass_erase_command)
 		}
 	}
 
-	io_base = stmqspi_info->io_base;
 	duration_start(&bench);
 
-	retval = qspi_write_enable(bank);
-	if (retval != ERROR_OK)
-		goto err;
-
-	/* Send Mass Erase command */
-	if (IS_OCTOSPI)
-		retval = octospi_cmd(bank, OCTOSPI_WRITE_MODE, OCTOSPI_CCR_MASS_ERASE,
-			stmqspi_info->dev.chip_erase_cmd);
-	else
-		retval = target_write_u32(target, io_base + QSPI_CCR, QSPI_CCR_MASS_ERASE);
-	if (retval != ERROR_OK)
-		goto err;
-
-	/* Wait for transmit of command completed */
-	poll_busy(bank, SPI_CMD_TIMEOUT);
-	if (retval != ERROR_OK)
-		goto err;
-
-	/* Read flash status register(s) */
-	retval = read_status_reg(bank, &status);
-	if (retval != ERROR_OK)
-		goto err;
-
-	/* Check for command in progress for flash 1 */
-	if (((stmqspi_info->saved_cr & (BIT(SPI_DUAL_FLASH) | BIT(SPI_FSEL_FLASH)))
-		!= BIT(SPI_FSEL_FLASH)) && ((status & SPIFLASH_BSY_BIT) == 0) &&
-		((status & SPIFLASH_WE_BIT) != 0)) {
-		LOG_ERROR("Mass erase command not accepted by flash1. Status=0x%02x",
-			status & 0xFFU);
-		retval = ERROR_FLASH_OPERATION_FAILED;
-		goto err;
-	}
-
-	/* Check for command in progress for flash 2 */
-	status >>= 8;
-	if (((stmqspi_info->saved_cr & (BIT(SPI_DUAL_FLASH) | BIT(SPI_FSEL_FLASH))) != 0) &&
-		((status & SPIFLASH_BSY_BIT) == 0) &&
-		((status & SPIFLASH_WE_BIT) != 0)) {
-		LOG_ERROR("Mass erase command not accepted by flash2. Status=0x%02x",
-			status & 0xFFU);
-		retval = ERROR_FLASH_OPERATION_FAILED;
-		goto err;
-	}
-
-	/* Poll WIP for end of self timed Sector Erase cycle */
-	retval = wait_till_ready(bank, SPI_MASS_ERASE_TIMEOUT);
+	retval = qspi_mass_erase(bank);
 
 	duration_measure(&bench);
 	if (retval == ERROR_OK)
@@ -586,7 +598,6 @@ COMMAND_HANDLER(stmqspi_handle_mass_erase_command)
 		command_print(CMD, "stmqspi mass erase not completed even after %fs",
 			duration_elapsed(&bench));
 
-err:
 	/* Switch to memory mapped mode before return to prompt */
 	set_mm_mode(bank);
 
@@ -1028,11 +1039,24 @@ static int stmqspi_erase(struct flash_bank *bank, unsigned int first, unsigned i
 		}
 	}
 
+	/* a single chip erase is much faster than erasing every sector */
+	if (first == 0 && last == (bank->num_sectors - 1) &&
+		stmqspi_info->dev.chip_erase_cmd != 0x00 &&
+		stmqspi_info->dev.chip_erase_cmd != stmqspi_info->dev.erase_cmd) {
+		LOG_DEBUG("Trying mass erase.");
+		retval = qspi_mass_erase(bank);
+		if (retval == ERROR_OK) {
+			set_mm_mode(bank);
+			return retval;
+		}
+		LOG_WARNING("Mass erase failed. Falling back to sector erase.");
+	}
+
+	/* qspi_erase_sector() waits for the end of the erase cycle */
 	for (sector = first; sector <= last; sector++) {
 		retval = qspi_erase_sector(bank, sector);
 		if (retval != ERROR_OK)
 			break;
-		alive_sleep(10);
 		keep_alive();
 	}
 
@@ -2064,6 +2088,45 @@ err:
 	return retval;
 }
 
+/* Read SFDP of flash1 (flash = 0) or flash2 (flash = 1), or return the
+ * parameters read at a previous probe if the id is still the same. The
+ * reset-init scripts of several boards probe after every reset to pick up
+ * the controller configuration, and reading SFDP is the slow part.
+ */
+static int stmqspi_sfdp(struct flash_bank *bank, unsigned int flash,
+		uint32_t id, struct flash_device *dev)
+{
+	struct stmqspi_flash_bank *stmqspi_info = bank->driver_priv;
+	uint32_t saved_cr = stmqspi_info->saved_cr;
+	int retval;
+
+	if (stmqspi_info->sfdp_id[flash] == id) {
+		LOG_DEBUG("flash%u id = 0x%06" PRIx32 " unchanged, reusing SFDP parameters",
+			flash + 1, id);
+		memcpy(dev, &stmqspi_info->sfdp_dev[flash], sizeof(*dev));
+		return ERROR_OK;
+	}
+
+	/* select flash1 or flash2 */
+	if (flash)
+		stmqspi_info->saved_cr = stmqspi_info->saved_cr | BIT(SPI_FSEL_FLASH);
+	else
+		stmqspi_info->saved_cr = stmqspi_info->saved_cr & ~BIT(SPI_FSEL_FLASH);
+	retval = spi_sfdp(bank, dev, &read_sfdp_block);
+
+	/* restore saved_cr */
+	stmqspi_info->saved_cr = saved_cr;
+
+	if (retval == ERROR_OK) {
+		memcpy(&stmqspi_info->sfdp_dev[flash], dev, sizeof(*dev));
+		stmqspi_info->sfdp_id[flash] = id;
+	} else {
+		stmqspi_info->sfdp_id[flash] = 0;
+	}
+
+	return retval;
+}
+
 static int stmqspi_probe(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
@@ -2214,14 +2277,8 @@ static int stmqspi_probe(struct flash_bank *bank)
 	if (id1 && !p->name) {
 		/* chip not been identified by id, then try SFDP */
 		struct flash_device temp;
-		uint32_t saved_cr = stmqspi_info->saved_cr;
 
-		/* select flash1 */
-		stmqspi_info->saved_cr = stmqspi_info->saved_cr & ~BIT(SPI_FSEL_FLASH);
-		retval = spi_sfdp(bank, &temp, &read_sfdp_block);
-
-		/* restore saved_cr */
-		stmqspi_info->saved_cr = saved_cr;
+		retval = stmqspi_sfdp(bank, 0, id1, &temp);
 
 		if (retval == ERROR_OK) {
 			LOG_INFO("flash1 \'%s\' id = 0x%06" PRIx32 " size = %" PRIu32
@@ -2272,14 +2329,8 @@ static int stmqspi_probe(struct flash_bank *bank)
 	if (id2 && !p->name) {
 		/* chip not been identified by id, then try SFDP */
 		struct flash_device temp;
-		uint32_t saved_cr = stmqspi_info->saved_cr;
-
-		/* select flash2 */
-		stmqspi_info->saved_cr = stmqspi_info->saved_cr | BIT(SPI_FSEL_FLASH);
-		retval = spi_sfdp(bank, &temp, &read_sfdp_block);
 
-		/* restore saved_cr */
-		stmqspi_info->saved_cr = saved_cr;
+		retval = stmqspi_sfdp(bank, 1, id2, &temp);
 
 		if (retval == ERROR_OK)
 			LOG_INFO("flash2 \'%s\' id = 0x%06" PRIx32 " size = %" PRIu32
@@ -1058,6 +1058,7 @@ COMMAND_HANDLER(str9xpec_handle_flash_enable_turbo_command)
 
 	/* modify scan chain - str9 core has been removed */
 	tap1->enabled = 0;
+	jtag_tap_chain_changed();
 
 	return ERROR_OK;
 }
@@ -1089,6 +1090,7 @@ COMMAND_HANDLER(str9xpec_handle_flash_disable_turbo_command)
 	/* restore previous scan chain */
 	if (tap->next_tap)
 		tap->next_tap->enabled = 1;
+	jtag_tap_chain_changed();
 
 	return ERROR_OK;
 }
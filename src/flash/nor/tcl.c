@@ -401,6 +401,9 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool diff = false;
+	bool verify = false;
+	bool parallel = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -408,11 +411,28 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto erase enabled");
+		} else if (strcmp(CMD_ARGV[0], "diff") == 0) {
+			/* changed sectors are erased before they are written */
+			auto_erase = 1;
+			diff = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "differential write enabled");
 		} else if (strcmp(CMD_ARGV[0], "unlock") == 0) {
 			auto_unlock = true;
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "verify") == 0) {
+			verify = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "verify enabled");
+		} else if (strcmp(CMD_ARGV[0], "parallel") == 0) {
+			parallel = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "parallel write enabled");
 		} else
 			break;
 	}
@@ -443,7 +463,7 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		return retval;
 
 	retval = flash_write_unlock_verify(target, &image, &written, auto_erase,
-		auto_unlock, true, false);
+		auto_unlock, true, verify, diff, parallel);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -495,7 +515,7 @@ COMMAND_HANDLER(handle_flash_verify_image_command)
 		return retval;
 
 	retval = flash_write_unlock_verify(target, &image, &verified, false,
-		false, false, true);
+		false, false, true, false, false);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -1183,10 +1203,12 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [diff] [unlock] [verify] [parallel] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
-			"and/or erase the region to be used. Allow optional "
-			"offset from beginning of bank (defaults to zero)",
+			"and/or erase the region to be used, or erase and write only "
+			"the sectors that differ, and verify what was written. With "
+			"parallel, the banks of all the targets are written at once. "
+			"Allow optional offset from beginning of bank (defaults to zero)",
 	},
 	{
 		.name = "verify_image",
@@ -31,6 +31,8 @@ proc program {filename args} {
 			set reset 1
 		} elseif {[string equal $arg "exit"]} {
 			set exit 1
+		} elseif {[string equal $arg "parallel"]} {
+			set parallel 1
 		} else {
 			set address $arg
 		}
@@ -68,17 +70,21 @@ proc program {filename args} {
 	if {$needsflash == 1} {
 		echo "** Programming Started **"
 
-		if {[catch {eval flash write_image erase $flash_args}] == 0} {
-			echo "** Programming Finished **"
-			if {[info exists verify]} {
-				# verify phase
-				echo "** Verify Started **"
-				if {[catch {eval verify_image $flash_args}] == 0} {
-					echo "** Verified OK **"
-				} else {
-					program_error "** Verify Failed **" $exit
-				}
+		# the flash of all the targets, at once
+		if {[info exists parallel]} {
+			set flash_args "parallel $flash_args"
+		}
+
+		if {[info exists verify]} {
+			# each range is verified right after it is written
+			if {[catch {eval flash write_image erase verify $flash_args}] == 0} {
+				echo "** Programming Finished **"
+				echo "** Verified OK **"
+			} else {
+				program_error "** Programming or Verify Failed **" $exit
 			}
+		} elseif {[catch {eval flash write_image erase $flash_args}] == 0} {
+			echo "** Programming Finished **"
 		} else {
 			program_error "** Programming Failed **" $exit
 		}
@@ -101,8 +107,8 @@ proc program {filename args} {
 	return
 }
 
-add_help_text program "write an image to flash, address is only required for binary images. verify, reset, exit are optional"
-add_usage_text program "<filename> \[address\] \[pre-verify\] \[verify\] \[reset\] \[exit\]"
+add_help_text program "write an image to flash, address is only required for binary images. verify, parallel, reset, exit are optional"
+add_usage_text program "<filename> \[address\] \[pre-verify\] \[verify\] \[parallel\] \[reset\] \[exit\]"
 
 # stm32[f0x|f3x] uses the same flash driver as the stm32f1x
 proc stm32f0x args { eval stm32f1x $args }
@@ -40,6 +40,14 @@ static const char hex_digits[] = {
 	'a', 'b', 'c', 'd', 'e', 'f'
 };
 
+/* Value + 1 of the hex digits, 0 for all the other characters */
+static const uint8_t hex_values[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
 void *buf_cpy(const void *from, void *_to, unsigned size)
 {
 	if (!from || !_to)
@@ -92,7 +100,18 @@ bool buf_cmp_mask(const void *_buf1, const void *_buf2,
 
 	const uint8_t *buf1 = _buf1, *buf2 = _buf2, *mask = _mask;
 	unsigned last = size / 8;
-	for (unsigned i = 0; i < last; i++) {
+	unsigned i = 0;
+	/* a word at a time, long scans (e.g. bypassed chains) are compared
+	 * on every jtag_check_value_mask() */
+	for (; i + sizeof(uint64_t) <= last; i += sizeof(uint64_t)) {
+		uint64_t a, b, m;
+		memcpy(&a, buf1 + i, sizeof(a));
+		memcpy(&b, buf2 + i, sizeof(b));
+		memcpy(&m, mask + i, sizeof(m));
+		if ((a ^ b) & m)
+			return true;
+	}
+	for (; i < last; i++) {
 		if (buf_cmp_masked(buf1[i], buf2[i], mask[i]))
 			return true;
 	}
@@ -139,25 +158,16 @@ void *buf_set_buf(const void *_src, unsigned src_start,
 	 * len is a multiple of 8bit so we can simple copy
 	 * the buffer */
 	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
+		memcpy(dst, src, lb);
 		return _dst;
 	}
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
-		}
+	/* Otherwise move up to 64 bits at a time. The source bits are
+	 * gathered and the destination bits merged a byte at a time, see
+	 * buf_get_u64() and buf_set_u64(). */
+	for (i = 0; i < len; i += 64) {
+		unsigned int n = MIN(len - i, 64u);
+		buf_set_u64(dst, dq + i, n, buf_get_u64(src, sq + i, n));
 	}
 
 	return _dst;
@@ -176,6 +186,25 @@ uint32_t flip_u32(uint32_t value, unsigned int num)
 	return c;
 }
 
+void buf_flip_bytes(uint8_t *buf, size_t size)
+{
+	size_t i = 0;
+
+	/* Swap neighbouring bits, bit pairs and nibbles of 8 bytes at once,
+	 * a plain loop like this one is vectorized by the compiler */
+	for (; i + 8 <= size; i += 8) {
+		uint64_t x;
+		memcpy(&x, buf + i, sizeof(x));
+		x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+		x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+		x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+		memcpy(buf + i, &x, sizeof(x));
+	}
+
+	for (; i < size; i++)
+		buf[i] = bit_reverse_table256[buf[i]];
+}
+
 static int ceil_f_to_u32(float x)
 {
 	if (x < 0)	/* return zero for negative numbers */
@@ -354,27 +383,60 @@ void bit_copy_discard(struct bit_copy_queue *q)
 size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 {
 	size_t i;
-	char tmp;
 
 	if (!bin || !hex)
 		return 0;
 
-	memset(bin, 0, count);
+	/* a pair at a time, stopping at the first character that isn't a hex
+	 * digit; a lone high nibble is still stored */
+	for (i = 0; i < count; i++) {
+		const uint8_t hi = hex_values[(uint8_t)hex[2 * i]];
+		if (!hi)
+			break;
+		const uint8_t lo = hex_values[(uint8_t)hex[2 * i + 1]];
+		if (!lo) {
+			bin[i++] = (hi - 1) << 4;
+			memset(bin + i, 0, count - i);
+			return i - 1;
+		}
+		bin[i] = (hi - 1) << 4 | (lo - 1);
+	}
 
-	for (i = 0; i < 2 * count; i++) {
-		if (hex[i] >= 'a' && hex[i] <= 'f')
-			tmp = hex[i] - 'a' + 10;
-		else if (hex[i] >= 'A' && hex[i] <= 'F')
-			tmp = hex[i] - 'A' + 10;
-		else if (hex[i] >= '0' && hex[i] <= '9')
-			tmp = hex[i] - '0';
-		else
-			return i / 2;
+	memset(bin + i, 0, count - i);
+	return i;
+}
 
-		bin[i / 2] |= tmp << (4 * ((i + 1) % 2));
+/**
+ * Convert a string of '0' and '1' characters, most significant bit first,
+ * into its binary representation.
+ *
+ * @param[out] bin Buffer to store binary representation. The buffer size must
+ *                 be at least @p count.
+ * @param[in] str String with groups of 8 binary digits to convert, it must
+ *                be at least 8 * @p count characters long.
+ * @param[in] count Number of groups to convert.
+ *
+ * @return The number of converted groups, conversion stops at the first
+ * group with a character that isn't a binary digit.
+ */
+size_t unbinarize(uint8_t *bin, const char *str, size_t count)
+{
+	size_t i;
+
+	if (!bin || !str)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		/* The first character ends up in the lowest byte */
+		uint64_t x = le_to_h_u64((const uint8_t *)str + 8 * i);
+		if ((x & ~0x0101010101010101ULL) != 0x3030303030303030ULL)
+			break;
+		/* Gather bit 0 of every byte into the top byte, the first one
+		 * most significant */
+		bin[i] = ((x & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
 	}
 
-	return i / 2;
+	return i;
 }
 
 /**
@@ -391,16 +453,21 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
  */
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
-	size_t i;
-	uint8_t tmp;
-
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
+	const size_t n = MIN(count, (length - 1) / 2);
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		hex[2 * i] = hex_digits[bin[i] >> 4];
+		hex[2 * i + 1] = hex_digits[bin[i] & 0x0f];
 	}
+	i *= 2;
+
+	/* an odd length only has room for the high nibble of the next byte */
+	if (n < count && i < length - 1)
+		hex[i++] = hex_digits[bin[n] >> 4];
 
 	hex[i] = 0;
 
@@ -18,6 +18,53 @@
  * Support functions to access arbitrary bits in a byte array
  */
 
+/**
+ * Slow path of buf_set_u32() and buf_set_u64(), for fields that don't
+ * start on a byte boundary or that are not 32 or 64 bits wide. Updates
+ * the bytes covering the field a whole byte at a time, rather than bit by
+ * bit, and doesn't touch the bits outside of the field.
+ */
+static inline void buf_set_bits_u64(uint8_t *buffer,
+	unsigned int first, unsigned int num, uint64_t value)
+{
+	uint8_t *p = buffer + first / 8;
+	unsigned int shift = first % 8;
+
+	while (num) {
+		unsigned int n = 8 - shift;
+		if (n > num)
+			n = num;
+		const uint8_t mask = ((1U << n) - 1) << shift;
+		*p = (*p & ~mask) | ((uint8_t)(value << shift) & mask);
+		value >>= n;
+		num -= n;
+		shift = 0;
+		p++;
+	}
+}
+
+/**
+ * Slow path of buf_get_u32() and buf_get_u64(): gathers the (at most 9)
+ * bytes covering the field, without reading past its last byte.
+ */
+static inline uint64_t buf_get_bits_u64(const uint8_t *buffer,
+	unsigned int first, unsigned int num)
+{
+	if (!num)
+		return 0;
+
+	const uint8_t *p = buffer + first / 8;
+	const unsigned int shift = first % 8;
+	const unsigned int num_bytes = (shift + num + 7) / 8;
+	uint64_t result = p[0] >> shift;
+
+	for (unsigned int i = 1; i < num_bytes; i++)
+		result |= (uint64_t)p[i] << (8 * i - shift);
+	if (num < 64)
+		result &= ((uint64_t)1 << num) - 1;
+	return result;
+}
+
 /**
  * Sets @c num bits in @c _buffer, starting at the @c first bit,
  * using the bits in @c value.  This routine fast-paths writes
@@ -39,12 +86,7 @@ static inline void buf_set_u32(uint8_t *_buffer,
 		buffer[1] = (value >> 8) & 0xff;
 		buffer[0] = (value >> 0) & 0xff;
 	} else {
-		for (unsigned i = first; i < first + num; i++) {
-			if (((value >> (i - first)) & 1) == 1)
-				buffer[i / 8] |= 1 << (i % 8);
-			else
-				buffer[i / 8] &= ~(1 << (i % 8));
-		}
+		buf_set_bits_u64(buffer, first, num, value);
 	}
 }
 
@@ -78,12 +120,7 @@ static inline void buf_set_u64(uint8_t *_buffer,
 		buffer[1] = (value >> 8) & 0xff;
 		buffer[0] = (value >> 0) & 0xff;
 	} else {
-		for (unsigned i = first; i < first + num; i++) {
-			if (((value >> (i - first)) & 1) == 1)
-				buffer[i / 8] |= 1 << (i % 8);
-			else
-				buffer[i / 8] &= ~(1 << (i % 8));
-		}
+		buf_set_bits_u64(buffer, first, num, value);
 	}
 }
 
@@ -107,12 +144,7 @@ static inline uint32_t buf_get_u32(const uint8_t *_buffer,
 				(((uint32_t)buffer[1]) << 8) |
 				(((uint32_t)buffer[0]) << 0);
 	} else {
-		uint32_t result = 0;
-		for (unsigned i = first; i < first + num; i++) {
-			if (((buffer[i / 8] >> (i % 8)) & 1) == 1)
-				result |= 1U << (i - first);
-		}
-		return result;
+		return buf_get_bits_u64(buffer, first, num);
 	}
 }
 
@@ -145,12 +177,7 @@ static inline uint64_t buf_get_u64(const uint8_t *_buffer,
 				(((uint64_t)buffer[1]) << 8)  |
 				(((uint64_t)buffer[0]) << 0));
 	} else {
-		uint64_t result = 0;
-		for (unsigned i = first; i < first + num; i++) {
-			if (((buffer[i / 8] >> (i % 8)) & 1) == 1)
-				result = result | ((uint64_t)1 << (uint64_t)(i - first));
-		}
-		return result;
+		return buf_get_bits_u64(buffer, first, num);
 	}
 }
 
@@ -165,6 +192,13 @@ static inline uint64_t buf_get_u64(const uint8_t *_buffer,
  */
 uint32_t flip_u32(uint32_t value, unsigned width);
 
+/**
+ * Inverts the ordering of the bits inside each byte of a buffer, in place.
+ * @param buf The buffer to flip.
+ * @param size The size of the buffer in bytes.
+ */
+void buf_flip_bytes(uint8_t *buf, size_t size);
+
 bool buf_cmp(const void *buf1, const void *buf2, unsigned size);
 bool buf_cmp_mask(const void *buf1, const void *buf2,
 		const void *mask, unsigned size);
@@ -228,6 +262,9 @@ void bit_copy_discard(struct bit_copy_queue *q);
  * used in ti-icdi driver and gdb server */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count);
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t out_maxlen);
+
+/* convert groups of 8 binary digit characters, used by the PLD drivers */
+size_t unbinarize(uint8_t *bin, const char *str, size_t count);
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count);
 
 #endif /* OPENOCD_HELPER_BINARYBUFFER_H */
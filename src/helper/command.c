@@ -62,32 +62,23 @@ static void tcl_output(void *privData, const char *file, unsigned line,
 	const char *function, const char *string)
 {
 	struct log_capture_state *state = privData;
+	if (!state->output) {
+		/* A garbage collect can happen, so we need a reference count to
+		 * this object */
+		state->output = Jim_NewStringObj(state->interp, "", 0);
+		Jim_IncrRefCount(state->output);
+	}
 	Jim_AppendString(state->interp, state->output, string, strlen(string));
 }
 
-static struct log_capture_state *command_log_capture_start(Jim_Interp *interp)
+/* capture log output and return it. The output object is only created
+ * once something is logged, most commands don't log anything. */
+static void command_log_capture_start(Jim_Interp *interp, struct log_capture_state *state)
 {
-	/* capture log output and return it. A garbage collect can
-	 * happen, so we need a reference count to this object */
-	Jim_Obj *jim_output = Jim_NewStringObj(interp, "", 0);
-	if (!jim_output)
-		return NULL;
-
-	Jim_IncrRefCount(jim_output);
-
-	struct log_capture_state *state = malloc(sizeof(*state));
-	if (!state) {
-		LOG_ERROR("Out of memory");
-		Jim_DecrRefCount(interp, jim_output);
-		return NULL;
-	}
-
 	state->interp = interp;
-	state->output = jim_output;
+	state->output = NULL;
 
 	log_add_callback(tcl_output, state);
-
-	return state;
 }
 
 /* Classic openocd commands provide progress output which we
@@ -103,11 +94,12 @@ static struct log_capture_state *command_log_capture_start(Jim_Interp *interp)
  */
 static void command_log_capture_finish(struct log_capture_state *state)
 {
-	if (!state)
-		return;
-
 	log_remove_callback(tcl_output, state);
 
+	/* nothing logged, the result is the command's one */
+	if (!state->output)
+		return;
+
 	int loglen;
 	const char *log_result = Jim_GetString(state->output, &loglen);
 	int reslen;
@@ -121,8 +113,6 @@ static void command_log_capture_finish(struct log_capture_state *state)
 
 	Jim_SetResult(state->interp, state->output);
 	Jim_DecrRefCount(state->interp, state->output);
-
-	free(state);
 }
 
 static int command_retval_set(Jim_Interp *interp, int retval)
@@ -140,7 +130,7 @@ extern struct command_context *global_cmd_ctx;
  * Do nothing in case we are not at debug level 3 */
 static void script_debug(Jim_Interp *interp, unsigned int argc, Jim_Obj * const *argv)
 {
-	if (debug_level < LOG_LVL_DEBUG)
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
 		return;
 
 	char *dbg = alloc_printf("command -");
@@ -289,6 +279,14 @@ int __register_commands(struct command_context *cmd_ctx, const char *cmd_prefix,
 {
 	int retval = ERROR_OK;
 	unsigned i;
+
+	/* let jim_command_dispatch() look for the subcommands of the parent */
+	if (cmd_prefix) {
+		struct command *parent = command_find_from_name(cmd_ctx->interp, cmd_prefix);
+		if (parent)
+			parent->has_subcommands = true;
+	}
+
 	for (i = 0; cmds[i].name || cmds[i].chain; i++) {
 		const struct command_registration *cr = cmds + i;
 
@@ -532,8 +530,8 @@ static int exec_command(Jim_Interp *interp, struct command_context *context,
 		 * Drop last '\n' to allow command output concatenation
 		 * while keep using command_print() everywhere.
 		 */
-		const char *output_txt = Jim_String(cmd.output);
-		int len = strlen(output_txt);
+		int len;
+		const char *output_txt = Jim_GetString(cmd.output, &len);
 		if (len && output_txt[len - 1] == '\n')
 			--len;
 		Jim_SetResultString(context->interp, output_txt, len);
@@ -687,7 +685,8 @@ static int jim_capture(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 	if (argc != 2)
 		return JIM_ERR;
 
-	struct log_capture_state *state = command_log_capture_start(interp);
+	struct log_capture_state state;
+	command_log_capture_start(interp, &state);
 
 	/* disable polling during capture. This avoids capturing output
 	 * from polling.
@@ -702,7 +701,7 @@ static int jim_capture(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 
 	jtag_poll_unmask(save_poll_mask);
 
-	command_log_capture_finish(state);
+	command_log_capture_finish(&state);
 
 	return retcode;
 }
@@ -884,8 +883,10 @@ static char *alloc_concatenate_strings(int argc, Jim_Obj * const *argv)
 
 static int jim_command_dispatch(Jim_Interp *interp, int argc, Jim_Obj * const *argv)
 {
-	/* check subcommands */
-	if (argc > 1) {
+	struct command *c = jim_to_command(interp);
+
+	/* check subcommands, only commands registered with some have them */
+	if (argc > 1 && c->has_subcommands) {
 		char *s = alloc_printf("%s %s", Jim_GetString(argv[0], NULL), Jim_GetString(argv[1], NULL));
 		Jim_Obj *js = Jim_NewStringObj(interp, s, -1);
 		Jim_IncrRefCount(js);
@@ -901,7 +902,6 @@ static int jim_command_dispatch(Jim_Interp *interp, int argc, Jim_Obj * const *a
 
 	script_debug(interp, argc, argv);
 
-	struct command *c = jim_to_command(interp);
 	if (!c->jim_handler && !c->handler) {
 		Jim_EvalObjPrefix(interp, Jim_NewStringObj(interp, "usage", -1), 1, argv);
 		return JIM_ERR;
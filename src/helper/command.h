@@ -203,6 +203,9 @@ struct command {
 	struct target *jim_override_target;
 		/* Used only for target of target-prefixed cmd */
 	enum command_mode mode;
+	bool has_subcommands;
+		/* Commands were registered below this one. Tcl procs are only
+		 * found as subcommands of such a command */
 };
 
 /*
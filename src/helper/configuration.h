@@ -16,6 +16,9 @@
 int parse_cmdline_args(struct command_context *cmd_ctx,
 		int argc, char *argv[]);
 
+/* Set by --startup-profile */
+extern int startup_profile_flag;
+
 int parse_config_file(struct command_context *cmd_ctx);
 void add_config_command(const char *cfg);
 
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Cooperative workers, see coop.h.
+ *
+ * The worker allowed to run is coop_current, the others wait for it to
+ * change. When the running worker yields, sleeps or returns it hands over
+ * to the next one, round robin, that isn't sleeping anymore. If they all
+ * sleep, the one handing over sleeps until the first of them wakes up,
+ * keeping the clients alive.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "coop.h"
+#include "log.h"
+#include "replacements.h"
+#include "time_support.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Longest nap while all the workers sleep, between two keep_alive() */
+#define COOP_NAP_MS 10
+
+enum coop_state {
+	COOP_RUNNABLE,
+	COOP_SLEEPING,
+	COOP_DONE,
+};
+
+struct coop_worker {
+	pthread_t thread;
+	int (*fn)(void *arg);
+	void *arg;
+	int retval;
+	enum coop_state state;
+	/* end of the sleep, in timeval_ms() */
+	int64_t wake;
+};
+
+static pthread_mutex_t coop_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* signals a change of coop_current */
+static pthread_cond_t coop_cond = PTHREAD_COND_INITIALIZER;
+static struct coop_worker *coop_workers;
+static unsigned int coop_count;
+/* NULL once all the workers are done */
+static struct coop_worker *coop_current;
+
+/* Next worker able to run after self, self last; NULL if none right now */
+static struct coop_worker *coop_pick(struct coop_worker *self, int64_t now)
+{
+	const unsigned int index = self - coop_workers;
+
+	for (unsigned int i = 1; i <= coop_count; i++) {
+		struct coop_worker *w = &coop_workers[(index + i) % coop_count];
+		if (w->state == COOP_SLEEPING && w->wake <= now)
+			w->state = COOP_RUNNABLE;
+		if (w->state == COOP_RUNNABLE)
+			return w;
+	}
+	return NULL;
+}
+
+/* Hand over to the next worker and wait for our turn, under coop_mutex */
+static void coop_switch(struct coop_worker *self)
+{
+	struct coop_worker *next;
+
+	while (true) {
+		int64_t now = timeval_ms();
+		next = coop_pick(self, now);
+		if (next)
+			break;
+
+		int64_t wake = INT64_MAX;
+		for (unsigned int i = 0; i < coop_count; i++) {
+			if (coop_workers[i].state == COOP_SLEEPING)
+				wake = MIN(wake, coop_workers[i].wake);
+		}
+		/* all done */
+		if (wake == INT64_MAX)
+			break;
+
+		/* nobody else can run meanwhile, the mutex isn't needed */
+		pthread_mutex_unlock(&coop_mutex);
+		usleep(MIN(wake - now, COOP_NAP_MS) * 1000);
+		keep_alive();
+		pthread_mutex_lock(&coop_mutex);
+	}
+
+	coop_current = next;
+	pthread_cond_broadcast(&coop_cond);
+
+	if (self->state == COOP_DONE)
+		return;
+	while (coop_current != self)
+		pthread_cond_wait(&coop_cond, &coop_mutex);
+}
+
+static void *coop_worker_main(void *arg)
+{
+	struct coop_worker *w = arg;
+
+	pthread_mutex_lock(&coop_mutex);
+	while (coop_current != w)
+		pthread_cond_wait(&coop_cond, &coop_mutex);
+	pthread_mutex_unlock(&coop_mutex);
+
+	int retval = w->fn(w->arg);
+
+	pthread_mutex_lock(&coop_mutex);
+	w->retval = retval;
+	w->state = COOP_DONE;
+	coop_switch(w);
+	pthread_mutex_unlock(&coop_mutex);
+	return NULL;
+}
+
+/* The running worker, if called by it */
+static struct coop_worker *coop_self(void)
+{
+	struct coop_worker *self = NULL;
+
+	pthread_mutex_lock(&coop_mutex);
+	if (coop_current && pthread_equal(pthread_self(), coop_current->thread))
+		self = coop_current;
+	pthread_mutex_unlock(&coop_mutex);
+	return self;
+}
+
+int coop_run(int (*fn)(void *arg), void **args, unsigned int count)
+{
+	int retval = ERROR_OK;
+
+	/* not worth it, or nested */
+	if (count < 2 || coop_workers) {
+		for (unsigned int i = 0; i < count; i++) {
+			int r = fn(args[i]);
+			if (retval == ERROR_OK)
+				retval = r;
+		}
+		return retval;
+	}
+
+	struct coop_worker *workers = calloc(count, sizeof(*workers));
+	if (!workers) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* the workers log, possibly along with the adapter thread */
+	log_enable_threads();
+
+	pthread_mutex_lock(&coop_mutex);
+	coop_workers = workers;
+	coop_current = NULL;
+
+	unsigned int started;
+	for (started = 0; started < count; started++) {
+		struct coop_worker *w = &workers[started];
+		w->fn = fn;
+		w->arg = args[started];
+		w->retval = ERROR_FAIL;
+		w->state = COOP_RUNNABLE;
+		int err = pthread_create(&w->thread, NULL, coop_worker_main, w);
+		if (err) {
+			LOG_WARNING("can't create a worker thread: %s", strerror(err));
+			break;
+		}
+	}
+	coop_count = started;
+
+	/* they only start running once they all exist */
+	if (started) {
+		coop_current = &workers[0];
+		pthread_cond_broadcast(&coop_cond);
+		while (coop_current)
+			pthread_cond_wait(&coop_cond, &coop_mutex);
+	}
+
+	coop_workers = NULL;
+	coop_count = 0;
+	pthread_mutex_unlock(&coop_mutex);
+
+	for (unsigned int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (retval == ERROR_OK)
+			retval = workers[i].retval;
+	}
+
+	/* what didn't get a thread */
+	for (unsigned int i = started; i < count; i++) {
+		int r = fn(args[i]);
+		if (retval == ERROR_OK)
+			retval = r;
+	}
+
+	free(workers);
+	return retval;
+}
+
+void coop_yield(void)
+{
+	struct coop_worker *self = coop_self();
+	if (!self)
+		return;
+
+	pthread_mutex_lock(&coop_mutex);
+	coop_switch(self);
+	pthread_mutex_unlock(&coop_mutex);
+}
+
+bool coop_sleep(uint64_t ms)
+{
+	struct coop_worker *self = coop_self();
+	if (!self)
+		return false;
+
+	pthread_mutex_lock(&coop_mutex);
+	self->state = COOP_SLEEPING;
+	self->wake = timeval_ms() + ms;
+	coop_switch(self);
+	pthread_mutex_unlock(&coop_mutex);
+	return true;
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+int coop_run(int (*fn)(void *arg), void **args, unsigned int count)
+{
+	int retval = ERROR_OK;
+
+	for (unsigned int i = 0; i < count; i++) {
+		int r = fn(args[i]);
+		if (retval == ERROR_OK)
+			retval = r;
+	}
+	return retval;
+}
+
+void coop_yield(void)
+{
+}
+
+bool coop_sleep(uint64_t ms)
+{
+	return false;
+}
+
+#endif /* HAVE_PTHREAD_H */
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_HELPER_COOP_H
+#define OPENOCD_HELPER_COOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Cooperative workers, to overlap the waits of independent jobs, e.g. the
+ * programming of the flash of several targets.
+ *
+ * Each worker has a thread, but only one of them runs at a time: a worker
+ * only lets the others run while it sleeps in alive_sleep() or waits for
+ * its target in target_wait_state(). The rest of OpenOCD, which isn't
+ * thread safe, thus never sees two workers at once; the thread that
+ * called coop_run() waits for all of them meanwhile.
+ */
+
+/**
+ * Call @a fn with each of the @a count @a args, in cooperative workers.
+ * Without thread support, or from a worker, the calls are made one after
+ * the other.
+ * @returns the first error of the calls, in the order of @a args.
+ */
+int coop_run(int (*fn)(void *arg), void **args, unsigned int count);
+
+/**
+ * Called by a worker that can wait, to let another worker run meanwhile.
+ * Does nothing outside of a worker.
+ */
+void coop_yield(void);
+
+/**
+ * Sleep for @a ms milliseconds if called by a worker, letting the others
+ * run meanwhile.
+ * @returns false outside of a worker, nothing was done then.
+ */
+bool coop_sleep(uint64_t ms);
+
+#endif /* OPENOCD_HELPER_COOP_H */
@@ -13,6 +13,7 @@
 #endif
 
 #include "crc32.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -48,3 +49,55 @@ uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 
 	return seed;
 }
+
+/* slice-by-8 tables: crc32_be_table[k][i] is the CRC of byte i followed by
+ * k zero bytes */
+static uint32_t crc32_be_table[8][256];
+
+static void crc32_be_init(void)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CRC32_POLY_BE : (c << 1);
+		crc32_be_table[0][i] = c;
+	}
+
+	for (unsigned int k = 1; k < 8; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_be_table[k - 1][i];
+			crc32_be_table[k][i] = (c << 8) ^ crc32_be_table[0][c >> 24];
+		}
+}
+
+uint32_t crc32_be(uint32_t seed, const void *_data, size_t data_len)
+{
+	static bool initialized;
+	const uint8_t *data = _data;
+	uint32_t crc = seed;
+
+	if (!initialized) {
+		crc32_be_init();
+		initialized = true;
+	}
+
+	while (data_len >= 8) {
+		crc ^= (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+			(uint32_t)data[2] << 8 | data[3];
+		crc = crc32_be_table[7][crc >> 24] ^
+			crc32_be_table[6][(crc >> 16) & 0xff] ^
+			crc32_be_table[5][(crc >> 8) & 0xff] ^
+			crc32_be_table[4][crc & 0xff] ^
+			crc32_be_table[3][data[4]] ^
+			crc32_be_table[2][data[5]] ^
+			crc32_be_table[1][data[6]] ^
+			crc32_be_table[0][data[7]];
+		data += 8;
+		data_len -= 8;
+	}
+
+	while (data_len--)
+		crc = (crc << 8) ^ crc32_be_table[0][(crc >> 24) ^ *data++];
+
+	return crc;
+}
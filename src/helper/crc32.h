@@ -34,4 +34,22 @@
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *data,
 		size_t data_len);
 
+/**
+ * CRC32 polynomial of the MSB first CRC32 used by gdb and the target
+ * checksum algorithms
+ */
+#define CRC32_POLY_BE	0x04c11db7
+
+/**
+ * Calculate the MSB first CRC32 with polynomial #CRC32_POLY_BE of the given
+ * data, table driven and eight bytes at a time
+ * @param	seed		The seed to use (mostly `0xffffffff`)
+ * @param	data		The data to calculate the CRC32 of
+ * @param	data_len	The length of the data in @p data in bytes
+ * @return	The CRC value of the first @p data_len bytes at @p data
+ * @note	As with crc32_le() the CRC of the previous chunk can be used as
+ *			@p seed for the next chunk.
+ */
+uint32_t crc32_be(uint32_t seed, const void *data, size_t data_len);
+
 #endif /* OPENOCD_HELPER_CRC32_H */
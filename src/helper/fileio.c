@@ -20,16 +20,44 @@
 #include "fileio.h"
 #include "replacements.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	/* read-only mapping of the whole file, NULL if not mapped */
+	const uint8_t *map;
 };
 
+static void fileio_map_local(struct fileio *fileio)
+{
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->access != FILEIO_READ || fileio->type != FILEIO_BINARY || !fileio->size)
+		return;
+
+	/* not fatal, e.g. pipes and some file systems can't be mapped */
+	void *map = mmap(NULL, fileio->size, PROT_READ, MAP_PRIVATE, fileno(fileio->file), 0);
+	if (map == MAP_FAILED) {
+		LOG_DEBUG("couldn't map %s, using plain reads: %s", fileio->url, strerror(errno));
+		return;
+	}
+
+	fileio->map = map;
+#endif
+}
+
 static inline int fileio_close_local(struct fileio *fileio)
 {
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map)
+		munmap((void *)fileio->map, fileio->size);
+#endif
+
 	int retval = fclose(fileio->file);
 	if (retval != 0) {
 		if (retval == EBADF)
@@ -103,6 +131,8 @@ static inline int fileio_open_local(struct fileio *fileio)
 
 	fileio->size = file_size;
 
+	fileio_map_local(fileio);
+
 	return ERROR_OK;
 }
 
@@ -117,6 +147,7 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->map = NULL;
 
 	retval = fileio_open_local(tmp);
 
@@ -179,6 +210,20 @@ int fileio_read(struct fileio *fileio, size_t size, void *buffer,
 	return fileio_local_read(fileio, size, buffer, size_read);
 }
 
+int fileio_map(struct fileio *fileio, size_t position, size_t size,
+		const uint8_t **data)
+{
+	if (!fileio->map)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	if (position > fileio->size || size > fileio->size - position)
+		return ERROR_FILEIO_OPERATION_FAILED;
+
+	*data = fileio->map + position;
+
+	return ERROR_OK;
+}
+
 int fileio_read_u32(struct fileio *fileio, uint32_t *data)
 {
 	int retval;
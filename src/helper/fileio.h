@@ -47,6 +47,15 @@ int fileio_read(struct fileio *fileio,
 int fileio_write(struct fileio *fileio,
 		size_t size, const void *buffer, size_t *size_written);
 
+/**
+ * Get a pointer to @a size bytes of the file at @a position, without
+ * copying them. The data stays valid until the file is closed. Only binary
+ * files opened for reading can be mapped, and only on hosts with mmap();
+ * on ERROR_FILEIO_OPERATION_NOT_SUPPORTED use fileio_read() instead.
+ */
+int fileio_map(struct fileio *fileio, size_t position, size_t size,
+		const uint8_t **data);
+
 int fileio_read_u32(struct fileio *fileio, uint32_t *data);
 int fileio_write_u32(struct fileio *fileio, uint32_t data);
 int fileio_size(struct fileio *fileio, size_t *size);
@@ -17,6 +17,8 @@
 
 #include "log.h"
 #include "command.h"
+#include "coop.h"
+#include "list.h"
 #include "replacements.h"
 #include "time_support.h"
 #include <server/gdb_server.h>
@@ -24,6 +26,10 @@
 
 #include <stdarg.h>
 
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #ifdef _DEBUG_FREE_SPACE_
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
@@ -52,6 +58,185 @@ static const char * const log_strings[6] = {
 
 static int count;
 
+#if HAVE_PTHREAD_H
+/* Held while logging once the adapter thread logs too, recursive as the
+ * log callbacks and keep_alive() may log again */
+static pthread_mutex_t log_mutex;
+static bool log_threads;
+#endif
+
+static void log_lock(void)
+{
+#if HAVE_PTHREAD_H
+	if (log_threads)
+		pthread_mutex_lock(&log_mutex);
+#endif
+}
+
+static void log_unlock(void)
+{
+#if HAVE_PTHREAD_H
+	if (log_threads)
+		pthread_mutex_unlock(&log_mutex);
+#endif
+}
+
+void log_enable_threads(void)
+{
+#if HAVE_PTHREAD_H
+	if (log_threads)
+		return;
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&log_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	log_threads = true;
+#endif
+}
+
+/* "log_level" rule: debug level of the source files in a directory or with
+ * a given name */
+struct log_filter {
+	struct list_head list;
+	char *name;
+	int level;
+};
+
+static LIST_HEAD(log_filters);
+unsigned int log_filter_count;
+unsigned int log_filter_generation = 1;
+/* Highest level of the rules and debug_level */
+static int log_filter_max_level;
+
+static const char * const log_filter_level_names[] = {
+	[LOG_LVL_INFO] = "info",
+	[LOG_LVL_DEBUG] = "debug",
+	[LOG_LVL_DEBUG_IO] = "debug_io",
+};
+
+/* Rank of the most specific path component of @a file matching @a name:
+ * the file name itself, with or without extension, beats the directories,
+ * deeper directories beat the outer ones. 0 if nothing matches. */
+static unsigned int log_filter_match(const char *name, const char *file)
+{
+	const size_t name_len = strlen(name);
+	unsigned int rank = 0;
+	unsigned int depth = 0;
+
+	for (const char *p = file; *p; ) {
+		const size_t len = strcspn(p, "/\\");
+		depth++;
+		if (!p[len]) {
+			/* file name */
+			const char *dot = strrchr(p, '.');
+			if ((len == name_len && !strncmp(p, name, len)) ||
+					(dot && (size_t)(dot - p) == name_len && !strncmp(p, name, name_len)))
+				rank = UINT_MAX;
+			break;
+		}
+		if (len == name_len && !strncmp(p, name, len))
+			rank = depth;
+		p += len + 1;
+	}
+
+	return rank;
+}
+
+int log_file_level_update(struct log_file_level *cache, const char *file)
+{
+	struct log_filter *filter;
+	unsigned int best = 0;
+	int level = debug_level;
+
+	list_for_each_entry(filter, &log_filters, list) {
+		const unsigned int rank = log_filter_match(filter->name, file);
+		/* the last rule wins among equally specific ones */
+		if (rank && rank >= best) {
+			best = rank;
+			level = filter->level;
+		}
+	}
+
+	cache->level = level;
+	cache->generation = log_filter_generation;
+	return level;
+}
+
+static void log_filters_changed(void)
+{
+	struct log_filter *filter;
+
+	log_filter_max_level = debug_level;
+	list_for_each_entry(filter, &log_filters, list)
+		log_filter_max_level = MAX(log_filter_max_level, filter->level);
+	log_filter_generation++;
+}
+
+/* The rules only apply to debug messages, the sites have checked them
+ * already with LOG_LEVEL_IS() */
+static bool log_level_enabled(enum log_levels level)
+{
+	if (level >= LOG_LVL_DEBUG && log_filter_count)
+		return level <= log_filter_max_level;
+	return level <= debug_level;
+}
+
+/* Debug messages collected by "log_buffer_size", written out in one go */
+static char *log_buffer;
+static size_t log_buffer_size;
+static size_t log_buffer_used;
+
+void log_flush(void)
+{
+	log_lock();
+	if (log_buffer_used) {
+		fwrite(log_buffer, 1, log_buffer_used, log_output ? log_output : stderr);
+		fflush(log_output ? log_output : stderr);
+		log_buffer_used = 0;
+	}
+	log_unlock();
+}
+
+/* Format a debug message straight into the buffer, with the same header as
+ * log_puts(). Returns false if the message doesn't fit even in an empty
+ * buffer and must be logged the usual way. */
+static bool log_buffer_vprintf(enum log_levels level, const char *file,
+		unsigned int line, const char *function, const char *format, va_list args)
+{
+	const char *f = strrchr(file, '/');
+	if (f)
+		file = f + 1;
+	const int64_t t = timeval_ms() - start;
+
+	for (int retry = 0; retry < 2; retry++) {
+		char *buf = log_buffer + log_buffer_used;
+		size_t space = log_buffer_size - log_buffer_used;
+		va_list ap;
+
+		int len = snprintf(buf, space, "%s%d %" PRId64 " %s:%u %s(): ",
+				log_strings[level + 1], count, t, file, line, function);
+		if (len >= 0 && (size_t)len < space) {
+			va_copy(ap, args);
+			int n = vsnprintf(buf + len, space - len, format, ap);
+			va_end(ap);
+			/* one more byte for the newline, vsnprintf() wants room for the NUL */
+			if (n >= 0 && (size_t)(len + n + 1) < space) {
+				buf[len + n] = '\n';
+				log_buffer_used += len + n + 1;
+				return true;
+			}
+		}
+
+		if (!log_buffer_used)
+			break;
+		log_flush();
+	}
+
+	return false;
+}
+
 /* forward the log to the listeners */
 static void log_forward(const char *file, unsigned line, const char *function, const char *string)
 {
@@ -83,6 +268,9 @@ static void log_puts(enum log_levels level,
 {
 	char *f;
 
+	/* keep the buffered debug messages in order with this one */
+	log_flush();
+
 	if (!log_output) {
 		/* log_init() not called yet; print on stderr */
 		fputs(string, stderr);
@@ -101,7 +289,7 @@ static void log_puts(enum log_levels level,
 	if (f)
 		file = f + 1;
 
-	if (debug_level >= LOG_LVL_DEBUG) {
+	if (debug_level >= LOG_LVL_DEBUG || level >= LOG_LVL_DEBUG) {
 		/* print with count and time information */
 		int64_t t = timeval_ms() - start;
 #ifdef _DEBUG_FREE_SPACE_
@@ -141,9 +329,12 @@ void log_printf(enum log_levels level,
 	char *string;
 	va_list ap;
 
+	log_lock();
 	count++;
-	if (level > debug_level)
+	if (!log_level_enabled(level)) {
+		log_unlock();
 		return;
+	}
 
 	va_start(ap, format);
 
@@ -154,16 +345,23 @@ void log_printf(enum log_levels level,
 	}
 
 	va_end(ap);
+	log_unlock();
 }
 
-void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
+static void log_vprintf_lf_locked(enum log_levels level, const char *file, unsigned line,
 		const char *function, const char *format, va_list args)
 {
 	char *tmp;
 
 	count++;
 
-	if (level > debug_level)
+	if (!log_level_enabled(level))
+		return;
+
+	/* Debug messages aren't forwarded to the log callbacks, buffering them
+	 * only defers the write to the log output */
+	if (log_buffer && log_output && level >= LOG_LVL_DEBUG &&
+			log_buffer_vprintf(level, file, line, function, format, args))
 		return;
 
 	tmp = alloc_vprintf(format, args);
@@ -180,6 +378,14 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
 	free(tmp);
 }
 
+void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, va_list args)
+{
+	log_lock();
+	log_vprintf_lf_locked(level, file, line, function, format, args);
+	log_unlock();
+}
+
 void log_printf_lf(enum log_levels level,
 	const char *file,
 	unsigned line,
@@ -204,6 +410,7 @@ COMMAND_HANDLER(handle_debug_level_command)
 			return ERROR_COMMAND_SYNTAX_ERROR;
 		}
 		debug_level = new_level;
+		log_filters_changed();
 	} else if (CMD_ARGC > 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
@@ -212,6 +419,72 @@ COMMAND_HANDLER(handle_debug_level_command)
 	return ERROR_OK;
 }
 
+static void log_filter_free(struct log_filter *filter)
+{
+	list_del(&filter->list);
+	free(filter->name);
+	free(filter);
+	log_filter_count--;
+}
+
+COMMAND_HANDLER(handle_log_level_command)
+{
+	struct log_filter *filter, *tmp;
+
+	if (CMD_ARGC == 0) {
+		list_for_each_entry(filter, &log_filters, list)
+			command_print(CMD, "%s %s", filter->name,
+					log_filter_level_names[filter->level]);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "clear")) {
+		list_for_each_entry_safe(filter, tmp, &log_filters, list)
+			log_filter_free(filter);
+		log_filters_changed();
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	int level = -1;
+	if (strcmp(CMD_ARGV[1], "default")) {
+		for (unsigned int i = LOG_LVL_INFO; i < ARRAY_SIZE(log_filter_level_names); i++) {
+			if (!strcmp(CMD_ARGV[1], log_filter_level_names[i]))
+				level = i;
+		}
+		if (level < 0) {
+			command_print(CMD, "unknown level \"%s\"", CMD_ARGV[1]);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	/* a new rule for the same name replaces the old one */
+	list_for_each_entry_safe(filter, tmp, &log_filters, list) {
+		if (!strcmp(filter->name, CMD_ARGV[0]))
+			log_filter_free(filter);
+	}
+
+	if (level >= 0) {
+		filter = malloc(sizeof(*filter));
+		if (filter)
+			filter->name = strdup(CMD_ARGV[0]);
+		if (!filter || !filter->name) {
+			free(filter);
+			log_filters_changed();
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		filter->level = level;
+		list_add_tail(&filter->list, &log_filters);
+		log_filter_count++;
+	}
+
+	log_filters_changed();
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_log_output_command)
 {
 	if (CMD_ARGC > 1)
@@ -230,6 +503,7 @@ COMMAND_HANDLER(handle_log_output_command)
 		command_print(CMD, "set log_output to default");
 	}
 
+	log_flush();
 	if (log_output != stderr && log_output) {
 		/* Close previous log file, if it was open and wasn't stderr. */
 		fclose(log_output);
@@ -238,6 +512,35 @@ COMMAND_HANDLER(handle_log_output_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_log_buffer_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+
+		char *buffer = NULL;
+		if (size) {
+			buffer = malloc(size);
+			if (!buffer) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+		}
+
+		log_flush();
+		free(log_buffer);
+		log_buffer = buffer;
+		log_buffer_size = size;
+	}
+
+	command_print(CMD, "log_buffer_size: %zu", log_buffer_size);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -246,6 +549,24 @@ static const struct command_registration log_command_handlers[] = {
 		.help = "redirect logging to a file (default: stderr)",
 		.usage = "[file_name | 'default']",
 	},
+	{
+		.name = "log_level",
+		.handler = handle_log_level_command,
+		.mode = COMMAND_ANY,
+		.help = "List, set or clear the debug level of the source files "
+			"in a directory or with a given name, overriding debug_level "
+			"for their debug messages",
+		.usage = "[name ('info'|'debug'|'debug_io'|'default') | 'clear']",
+	},
+	{
+		.name = "log_buffer_size",
+		.handler = handle_log_buffer_size_command,
+		.mode = COMMAND_ANY,
+		.help = "Collect debug messages in a buffer of this many bytes "
+			"and write them out when it's full or OpenOCD is idle "
+			"(default: 0, disabled)",
+		.usage = "[size]",
+	},
 	{
 		.name = "debug_level",
 		.handler = handle_debug_level_command,
@@ -277,6 +598,7 @@ void log_init(void)
 				debug_level <= LOG_LVL_DEBUG_IO)
 				debug_level = value;
 	}
+	log_filters_changed();
 
 	if (!log_output)
 		log_output = stderr;
@@ -286,6 +608,16 @@ void log_init(void)
 
 void log_exit(void)
 {
+	struct log_filter *filter, *tmp;
+	list_for_each_entry_safe(filter, tmp, &log_filters, list)
+		log_filter_free(filter);
+	log_filters_changed();
+
+	log_flush();
+	free(log_buffer);
+	log_buffer = NULL;
+	log_buffer_size = 0;
+
 	if (log_output && log_output != stderr) {
 		/* Close log file, if it was open and wasn't stderr. */
 		fclose(log_output);
@@ -412,7 +744,7 @@ static void gdb_timeout_warning(int64_t delta_time)
 			delta_time);
 }
 
-void keep_alive(void)
+static void keep_alive_locked(void)
 {
 	int64_t current_time = timeval_ms();
 	int64_t delta_time = current_time - last_time;
@@ -439,9 +771,17 @@ void keep_alive(void)
 	}
 }
 
+void keep_alive(void)
+{
+	log_lock();
+	keep_alive_locked();
+	log_unlock();
+}
+
 /* reset keep alive timer without sending message */
 void kept_alive(void)
 {
+	log_lock();
 	int64_t current_time = timeval_ms();
 
 	int64_t delta_time = current_time - last_time;
@@ -450,11 +790,18 @@ void kept_alive(void)
 
 	if (delta_time > KEEP_ALIVE_TIMEOUT_MS)
 		gdb_timeout_warning(delta_time);
+	log_unlock();
 }
 
 /* if we sleep for extended periods of time, we must invoke keep_alive() intermittently */
 void alive_sleep(uint64_t ms)
 {
+	/* a worker lets the others run meanwhile */
+	if (coop_sleep(ms)) {
+		keep_alive();
+		return;
+	}
+
 	uint64_t nap_time = 10;
 	for (uint64_t i = 0; i < ms; i += nap_time) {
 		uint64_t sleep_a_bit = ms - i;
@@ -62,9 +62,13 @@ __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 5, 6)));
  */
 void log_init(void);
 void log_exit(void);
+/** Write out the debug messages collected by "log_buffer_size". */
+void log_flush(void);
 
 int log_register_commands(struct command_context *cmd_ctx);
 
+/** Make the log safe to use from more than one thread, for good. */
+void log_enable_threads(void);
 void keep_alive(void);
 void kept_alive(void);
 
@@ -93,14 +97,35 @@ char *find_nonprint_char(char *buf, unsigned buf_len);
 
 extern int debug_level;
 
+/* Debug level of the source files matching a "log_level" rule, set by
+ * log_file_level_update() and cached once per translation unit. */
+struct log_file_level {
+	/* The level is only valid if equal to log_filter_generation. */
+	unsigned int generation;
+	int level;
+};
+
+/* Number of "log_level" rules, bumped generation whenever they or
+ * debug_level change. */
+extern unsigned int log_filter_count;
+extern unsigned int log_filter_generation;
+
+static struct log_file_level log_file_level __attribute__((unused));
+
+int log_file_level_update(struct log_file_level *cache, const char *file);
+
 /* Avoid fn call and building parameter list if we're not outputting the information.
- * Matters on feeble CPUs for DEBUG/INFO statements that are involved frequently */
+ * Matters on feeble CPUs for DEBUG/INFO statements that are involved frequently.
+ * Without "log_level" rules this is a single test of debug_level. */
 
-#define LOG_LEVEL_IS(FOO)  ((debug_level) >= (FOO))
+#define LOG_LEVEL_IS(FOO) \
+	(!log_filter_count ? (debug_level) >= (FOO) : \
+		(log_file_level.generation == log_filter_generation ? log_file_level.level : \
+			log_file_level_update(&log_file_level, __BASE_FILE__)) >= (FOO))
 
 #define LOG_DEBUG_IO(expr ...) \
 	do { \
-		if (debug_level >= LOG_LVL_DEBUG_IO) \
+		if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) \
 			log_printf_lf(LOG_LVL_DEBUG, \
 				__FILE__, __LINE__, __func__, \
 				expr); \
@@ -108,7 +133,7 @@ extern int debug_level;
 
 #define LOG_DEBUG(expr ...) \
 	do { \
-		if (debug_level >= LOG_LVL_DEBUG) \
+		if (LOG_LEVEL_IS(LOG_LVL_DEBUG)) \
 			log_printf_lf(LOG_LVL_DEBUG, \
 				__FILE__, __LINE__, __func__, \
 				expr); \
@@ -117,7 +142,7 @@ extern int debug_level;
 #define LOG_CUSTOM_LEVEL(level, expr ...) \
 	do { \
 		enum log_levels _level = level; \
-		if (debug_level >= _level) \
+		if (LOG_LEVEL_IS(_level)) \
 			log_printf_lf(_level, \
 				__FILE__, __LINE__, __func__, \
 				expr); \
@@ -35,6 +35,7 @@
 #endif
 
 static int help_flag, version_flag;
+int startup_profile_flag;
 
 static const struct option long_options[] = {
 	{"help",		no_argument,			&help_flag,		1},
@@ -44,6 +45,7 @@ static const struct option long_options[] = {
 	{"search",		required_argument,		NULL,			's'},
 	{"log_output",	required_argument,		NULL,			'l'},
 	{"command",		required_argument,		NULL,			'c'},
+	{"startup-profile",	no_argument,		&startup_profile_flag,	1},
 	{NULL, 0, NULL, 0}
 };
 
@@ -332,6 +334,7 @@ int parse_cmdline_args(struct command_context *cmd_ctx, int argc, char *argv[])
 		LOG_OUTPUT("             | -d<n>\tset debug level to <level>\n");
 		LOG_OUTPUT("--log_output | -l\tredirect log output to file <name>\n");
 		LOG_OUTPUT("--command    | -c\trun <command>\n");
+		LOG_OUTPUT("--startup-profile\treport the time spent in each startup phase\n");
 		exit(-1);
 	}
 
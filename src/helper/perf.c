@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Latency histograms of target, flash and JTAG operations, see perf.h.
+ *
+ * Latencies are recorded in us into log-linear buckets like HDR histograms
+ * do: every power of two is split into PERF_SUB_BUCKETS linear buckets, so
+ * the relative error of a bucket is at most 25% at any magnitude and the
+ * histogram still has a fixed, small size.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "perf.h"
+#include "command.h"
+#include "log.h"
+#include "replacements.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define PERF_SUB_BUCKET_BITS	2
+#define PERF_SUB_BUCKETS	(1 << PERF_SUB_BUCKET_BITS)
+/* Up to 2^40 us, the last bucket takes everything above. */
+#define PERF_BUCKETS		(40 * PERF_SUB_BUCKETS)
+
+struct perf_op_stats {
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t total_us;
+	uint64_t min_us;
+	uint64_t max_us;
+	uint64_t buckets[PERF_BUCKETS];
+};
+
+static const char * const perf_op_names[PERF_NUM_OPS] = {
+	[PERF_READ_MEMORY] = "read_memory",
+	[PERF_WRITE_MEMORY] = "write_memory",
+	[PERF_GET_REGISTER] = "get_register",
+	[PERF_SET_REGISTER] = "set_register",
+	[PERF_HALT] = "halt",
+	[PERF_RESUME] = "resume",
+	[PERF_STEP] = "step",
+	[PERF_FLASH_ERASE] = "flash_erase",
+	[PERF_FLASH_WRITE] = "flash_write",
+	[PERF_FLASH_READ] = "flash_read",
+	[PERF_FLASH_VERIFY] = "flash_verify",
+	[PERF_JTAG_EXECUTE_QUEUE] = "jtag_execute_queue",
+};
+
+bool perf_enabled;
+static struct perf_op_stats perf_stats[PERF_NUM_OPS];
+static int64_t perf_start_us;
+
+static unsigned int perf_bucket(uint64_t us)
+{
+	if (us < PERF_SUB_BUCKETS)
+		return us;
+
+	unsigned int msb = 63 - __builtin_clzll(us);
+	unsigned int sub = (us >> (msb - PERF_SUB_BUCKET_BITS)) & (PERF_SUB_BUCKETS - 1);
+	unsigned int bucket = (msb - PERF_SUB_BUCKET_BITS + 1) * PERF_SUB_BUCKETS + sub;
+	return MIN(bucket, PERF_BUCKETS - 1);
+}
+
+/* Smallest latency that falls into "bucket". */
+static uint64_t perf_bucket_low(unsigned int bucket)
+{
+	if (bucket < PERF_SUB_BUCKETS)
+		return bucket;
+
+	unsigned int shift = bucket / PERF_SUB_BUCKETS - 1;
+	return (uint64_t)(PERF_SUB_BUCKETS + bucket % PERF_SUB_BUCKETS) << shift;
+}
+
+void perf_record(enum perf_op op, int64_t start_us, uint64_t bytes)
+{
+	struct perf_op_stats *s = &perf_stats[op];
+	int64_t elapsed = timeval_us() - start_us;
+	uint64_t us = elapsed > 0 ? elapsed : 0;
+
+	if (!s->count || us < s->min_us)
+		s->min_us = us;
+	s->max_us = MAX(s->max_us, us);
+	s->count++;
+	s->bytes += bytes;
+	s->total_us += us;
+	s->buckets[perf_bucket(us)]++;
+}
+
+/* Upper bound of the latency of the "permille" fraction of the operations. */
+static uint64_t perf_percentile(const struct perf_op_stats *s, unsigned int permille)
+{
+	uint64_t rank = (s->count * permille + 999) / 1000;
+	uint64_t seen = 0;
+
+	for (unsigned int i = 0; i < PERF_BUCKETS - 1; i++) {
+		seen += s->buckets[i];
+		if (seen >= rank)
+			return MIN(perf_bucket_low(i + 1) - 1, s->max_us);
+	}
+	return s->max_us;
+}
+
+static void perf_reset(void)
+{
+	memset(perf_stats, 0, sizeof(perf_stats));
+	perf_start_us = timeval_us();
+}
+
+COMMAND_HANDLER(handle_perf_collect_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+		if (enable && !perf_enabled && !perf_start_us)
+			perf_start_us = timeval_us();
+		perf_enabled = enable;
+	}
+
+	command_print(CMD, "perf collect %s", perf_enabled ? "on" : "off");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_perf_reset_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	perf_reset();
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_perf_stats_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	command_print(CMD, "%-18s %9s %12s %12s %9s %9s %9s %9s %9s",
+			"operation", "count", "bytes", "total us", "min us",
+			"p50 us", "p90 us", "p99 us", "max us");
+	for (unsigned int op = 0; op < PERF_NUM_OPS; op++) {
+		const struct perf_op_stats *s = &perf_stats[op];
+		if (!s->count)
+			continue;
+		command_print(CMD, "%-18s %9" PRIu64 " %12" PRIu64 " %12" PRIu64
+				" %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64,
+				perf_op_names[op], s->count, s->bytes, s->total_us, s->min_us,
+				perf_percentile(s, 500), perf_percentile(s, 900),
+				perf_percentile(s, 990), s->max_us);
+	}
+	return ERROR_OK;
+}
+
+/* Append to a string allocated on the heap, frees it on failure. */
+static char *perf_append(char *s, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	char *tail = alloc_vprintf(fmt, ap);
+	va_end(ap);
+
+	char *joined = tail ? realloc(s, strlen(s) + strlen(tail) + 1) : NULL;
+	if (!joined) {
+		free(s);
+		free(tail);
+		return NULL;
+	}
+	strcat(joined, tail);
+	free(tail);
+	return joined;
+}
+
+/* Buckets are listed as [lowest latency in us, count], empty ones are left out. */
+static char *perf_json(void)
+{
+	char *json = alloc_printf("{\"collect\": %s, \"elapsed_us\": %" PRId64 ", \"operations\": {",
+			perf_enabled ? "true" : "false",
+			perf_start_us ? timeval_us() - perf_start_us : 0);
+	const char *separator = "";
+
+	for (unsigned int op = 0; json && op < PERF_NUM_OPS; op++) {
+		const struct perf_op_stats *s = &perf_stats[op];
+		if (!s->count)
+			continue;
+
+		json = perf_append(json, "%s\"%s\": {\"count\": %" PRIu64
+				", \"bytes\": %" PRIu64 ", \"total_us\": %" PRIu64
+				", \"min_us\": %" PRIu64 ", \"p50_us\": %" PRIu64
+				", \"p90_us\": %" PRIu64 ", \"p99_us\": %" PRIu64
+				", \"max_us\": %" PRIu64 ", \"buckets\": [",
+				separator, perf_op_names[op], s->count, s->bytes, s->total_us,
+				s->min_us, perf_percentile(s, 500), perf_percentile(s, 900),
+				perf_percentile(s, 990), s->max_us);
+		const char *bucket_separator = "";
+		for (unsigned int i = 0; json && i < PERF_BUCKETS; i++) {
+			if (!s->buckets[i])
+				continue;
+			json = perf_append(json, "%s[%" PRIu64 ", %" PRIu64 "]",
+					bucket_separator, perf_bucket_low(i), s->buckets[i]);
+			bucket_separator = ", ";
+		}
+		if (json)
+			json = perf_append(json, "]}");
+		separator = ", ";
+	}
+
+	if (json)
+		json = perf_append(json, "}}");
+	return json;
+}
+
+COMMAND_HANDLER(handle_perf_json_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	char *json = perf_json();
+	if (!json) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%s", json);
+	} else {
+		FILE *f = fopen(CMD_ARGV[0], "w");
+		if (!f) {
+			command_print(CMD, "can't open '%s': %s", CMD_ARGV[0], strerror(errno));
+			retval = ERROR_FAIL;
+		} else {
+			if (fprintf(f, "%s\n", json) < 0)
+				retval = ERROR_FAIL;
+			if (fclose(f) != 0)
+				retval = ERROR_FAIL;
+			if (retval != ERROR_OK)
+				command_print(CMD, "can't write '%s'", CMD_ARGV[0]);
+		}
+	}
+
+	free(json);
+	return retval;
+}
+
+static const struct command_registration perf_subcommand_handlers[] = {
+	{
+		.name = "collect",
+		.handler = handle_perf_collect_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set whether operation latencies are collected",
+		.usage = "['on'|'off']",
+	},
+	{
+		.name = "reset",
+		.handler = handle_perf_reset_command,
+		.mode = COMMAND_ANY,
+		.help = "Clear the collected statistics",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_perf_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "Display count, bytes and latency percentiles per operation",
+		.usage = "",
+	},
+	{
+		.name = "json",
+		.handler = handle_perf_json_command,
+		.mode = COMMAND_ANY,
+		.help = "Display the statistics and latency histograms as JSON, "
+			"or write them to a file",
+		.usage = "[file]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration perf_command_handlers[] = {
+	{
+		.name = "perf",
+		.mode = COMMAND_ANY,
+		.help = "Latency statistics of target, flash and JTAG operations",
+		.usage = "",
+		.chain = perf_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int perf_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, perf_command_handlers);
+}
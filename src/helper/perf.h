@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_HELPER_PERF_H
+#define OPENOCD_HELPER_PERF_H
+
+#include "time_support.h"
+#include "types.h"
+
+struct command_context;
+
+/*
+ * Count, bytes and latency histogram of the operations a debug session
+ * spends its time in, see the "perf" commands. Collection is off by
+ * default and then only costs a test of perf_enabled per operation:
+ *
+ *	int64_t start = perf_begin();
+ *	retval = do_the_operation();
+ *	perf_end(PERF_READ_MEMORY, start, size);
+ */
+enum perf_op {
+	PERF_READ_MEMORY,
+	PERF_WRITE_MEMORY,
+	PERF_GET_REGISTER,
+	PERF_SET_REGISTER,
+	PERF_HALT,
+	PERF_RESUME,
+	PERF_STEP,
+	PERF_FLASH_ERASE,
+	PERF_FLASH_WRITE,
+	PERF_FLASH_READ,
+	PERF_FLASH_VERIFY,
+	PERF_JTAG_EXECUTE_QUEUE,
+	PERF_NUM_OPS
+};
+
+extern bool perf_enabled;
+
+void perf_record(enum perf_op op, int64_t start_us, uint64_t bytes);
+
+/** @returns the start time to pass to perf_end(), 0 if not collecting. */
+static inline int64_t perf_begin(void)
+{
+	return perf_enabled ? timeval_us() : 0;
+}
+
+static inline void perf_end(enum perf_op op, int64_t start_us, uint64_t bytes)
+{
+	if (start_us)
+		perf_record(op, start_us, bytes);
+}
+
+int perf_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_PERF_H */
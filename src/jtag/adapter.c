@@ -16,6 +16,8 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "swd.h"
+#include <helper/time_support.h>
 #include <transport/transport.h>
 
 /**
@@ -184,6 +186,8 @@ int adapter_init(struct command_context *cmd_ctx)
 
 int adapter_quit(void)
 {
+	adapter_thread_stop();
+
 	if (is_adapter_initialized() && adapter_driver->quit) {
 		/* close the JTAG interface */
 		int result = adapter_driver->quit();
@@ -194,6 +198,8 @@ int adapter_quit(void)
 	free(adapter_config.serial);
 	free(adapter_config.usb_location);
 
+	cmd_queue_release_free_pages();
+
 	struct jtag_tap *t = jtag_all_taps();
 	while (t) {
 		struct jtag_tap *n = t->next_tap;
@@ -1056,6 +1062,180 @@ COMMAND_HANDLER(handle_usb_location_command)
 }
 #endif /* HAVE_LIBUSB_GET_PORT_NUMBERS */
 
+#define BENCHMARK_DEFAULT_MS	1000
+#define BENCHMARK_LONG_BITS		32768
+
+static uint8_t benchmark_out[BENCHMARK_LONG_BITS / 8];
+static uint8_t benchmark_in[BENCHMARK_LONG_BITS / 8];
+static uint8_t *benchmark_bypass;
+static struct jtag_tap *benchmark_tap;
+
+struct adapter_benchmark {
+	const char *name;
+	/* operations queued before each flush */
+	unsigned int ops;
+	/* clock cycles per operation, 0 to skip the Mbit/s figure */
+	unsigned int bits;
+	void (*queue)(unsigned int ops);
+};
+
+static void benchmark_jtag_long_dr(unsigned int ops)
+{
+	for (unsigned int i = 0; i < ops; i++)
+		jtag_add_plain_dr_scan(BENCHMARK_LONG_BITS, benchmark_out, benchmark_in, TAP_IDLE);
+}
+
+static void benchmark_jtag_short_dr(unsigned int ops)
+{
+	for (unsigned int i = 0; i < ops; i++)
+		jtag_add_plain_dr_scan(32, benchmark_out, benchmark_in, TAP_IDLE);
+}
+
+static void benchmark_jtag_ir_dr(unsigned int ops)
+{
+	struct scan_field field = {
+		.num_bits = benchmark_tap->ir_length,
+		.out_value = benchmark_bypass,
+	};
+
+	for (unsigned int i = 0; i < ops; i++) {
+		jtag_add_ir_scan(benchmark_tap, &field, TAP_IDLE);
+		jtag_add_plain_dr_scan(32, benchmark_out, benchmark_in, TAP_IDLE);
+	}
+}
+
+static void benchmark_jtag_runtest(unsigned int ops)
+{
+	for (unsigned int i = 0; i < ops; i++)
+		jtag_add_runtest(1024, TAP_IDLE);
+}
+
+static uint32_t benchmark_swd_data;
+
+static void benchmark_swd_read(unsigned int ops)
+{
+	const struct swd_driver *swd = adapter_driver->swd_ops;
+
+	for (unsigned int i = 0; i < ops; i++)
+		swd->read_reg(swd_cmd(true, false, DP_DPIDR), &benchmark_swd_data, 0);
+}
+
+static void benchmark_swd_write(unsigned int ops)
+{
+	const struct swd_driver *swd = adapter_driver->swd_ops;
+
+	/* writing zero to ABORT has no effect */
+	for (unsigned int i = 0; i < ops; i++)
+		swd->write_reg(swd_cmd(false, false, DP_ABORT), 0, 0);
+}
+
+static int benchmark_swd_run(void)
+{
+	return adapter_driver->swd_ops->run();
+}
+
+static const struct adapter_benchmark benchmarks_jtag[] = {
+	{ "long DR scan", 4, BENCHMARK_LONG_BITS, benchmark_jtag_long_dr },
+	{ "short DR scan", 128, 32, benchmark_jtag_short_dr },
+	{ "IR+DR scan", 64, 0, benchmark_jtag_ir_dr },
+	{ "runtest", 16, 1024, benchmark_jtag_runtest },
+	{ "flush latency", 1, 32, benchmark_jtag_short_dr },
+	{ NULL, 0, 0, NULL }
+};
+
+/* bit counts are those of the request, ack, data and parity phases */
+static const struct adapter_benchmark benchmarks_swd[] = {
+	{ "DP read", 128, 46, benchmark_swd_read },
+	{ "DP write", 128, 46, benchmark_swd_write },
+	{ "flush latency", 1, 46, benchmark_swd_read },
+	{ NULL, 0, 0, NULL }
+};
+
+static int adapter_benchmark_run(struct command_invocation *cmd,
+		const struct adapter_benchmark *b, int (*flush)(void), unsigned int ms)
+{
+	struct duration bench;
+	unsigned int flushes = 0;
+	int retval;
+
+	duration_start(&bench);
+	do {
+		b->queue(b->ops);
+		retval = flush();
+		if (retval != ERROR_OK) {
+			command_print(CMD, "%s: failed", b->name);
+			return retval;
+		}
+		flushes++;
+		duration_measure(&bench);
+	} while (duration_elapsed(&bench) * 1000 < ms);
+
+	float elapsed = duration_elapsed(&bench);
+	float ops = (float)flushes * b->ops;
+	char mbps[32] = "";
+	if (b->bits)
+		snprintf(mbps, sizeof(mbps), "%9.3f Mbit/s", ops * b->bits / elapsed / 1e6);
+	command_print(CMD, "%-14s %12.0f op/s %s %9.1f us/flush", b->name,
+		ops / elapsed, mbps, elapsed * 1e6 / flushes);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_adapter_benchmark_command)
+{
+	const struct adapter_benchmark *b;
+	int (*flush)(void);
+	unsigned int ms = BENCHMARK_DEFAULT_MS;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], ms);
+
+	if (transport_is_jtag()) {
+		benchmark_tap = jtag_tap_next_enabled(NULL);
+		if (!benchmark_tap) {
+			command_print(CMD, "no enabled TAP to run the benchmark on");
+			return ERROR_FAIL;
+		}
+
+		/* the DR scans then go through the BYPASS registers of the chain */
+		benchmark_bypass = malloc(DIV_ROUND_UP(benchmark_tap->ir_length, 8));
+		if (!benchmark_bypass) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		memset(benchmark_bypass, 0xff, DIV_ROUND_UP(benchmark_tap->ir_length, 8));
+		struct scan_field field = {
+			.num_bits = benchmark_tap->ir_length,
+			.out_value = benchmark_bypass,
+		};
+		jtag_add_ir_scan(benchmark_tap, &field, TAP_IDLE);
+
+		b = benchmarks_jtag;
+		flush = jtag_execute_queue;
+	} else if (transport_is_swd() && adapter_driver->swd_ops) {
+		b = benchmarks_swd;
+		flush = benchmark_swd_run;
+	} else {
+		command_print(CMD, "transport %s is not supported by the benchmark",
+			get_current_transport() ? get_current_transport()->name : "none");
+		return ERROR_FAIL;
+	}
+
+	command_print(CMD, "%s at %u kHz, %u ms per test", adapter_driver->name,
+		adapter_get_speed_khz(), ms);
+
+	int retval = ERROR_OK;
+	for (; b->name && retval == ERROR_OK; b++)
+		retval = adapter_benchmark_run(CMD, b, flush, ms);
+
+	free(benchmark_bypass);
+	benchmark_bypass = NULL;
+
+	return retval;
+}
+
 static const struct command_registration adapter_usb_command_handlers[] = {
 #ifdef HAVE_LIBUSB_GET_PORT_NUMBERS
 	{
@@ -1087,6 +1267,28 @@ static const struct command_registration adapter_srst_command_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
+COMMAND_HANDLER(handle_adapter_thread_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		if (enable) {
+			int retval = adapter_thread_start();
+			if (retval != ERROR_OK)
+				return retval;
+		} else {
+			adapter_thread_stop();
+		}
+	}
+
+	command_print(CMD, "adapter thread %s",
+			adapter_thread_enabled() ? "enabled" : "disabled");
+	return ERROR_OK;
+}
+
 static const struct command_registration adapter_command_handlers[] = {
 	{
 		.name = "driver",
@@ -1112,6 +1314,14 @@ static const struct command_registration adapter_command_handlers[] = {
 		.help = "Set the serial number of the adapter",
 		.usage = "serial_string",
 	},
+	{
+		.name = "thread",
+		.handler = handle_adapter_thread_command,
+		.mode = COMMAND_ANY,
+		.help = "Display, enable or disable running the adapter I/O "
+			"on its own thread",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.name = "list",
 		.handler = handle_adapter_list_command,
@@ -1162,6 +1372,14 @@ static const struct command_registration adapter_command_handlers[] = {
 		.help = "Controls SRST and TRST lines.",
 		.usage = "|assert [srst|trst [deassert|assert srst|trst]]",
 	},
+	{
+		.name = "benchmark",
+		.handler = handle_adapter_benchmark_command,
+		.mode = COMMAND_EXEC,
+		.help = "Measure the throughput of the adapter through the "
+			"regular JTAG or SWD queue",
+		.usage = "[ms_per_test]",
+	},
 	{
 		.name = "gpio",
 		.handler = adapter_gpio_config_handler,
@@ -124,4 +124,21 @@ const struct adapter_gpio_config *adapter_gpio_get_config(void);
 
 #define ADAPTER_GPIO_NOT_SET UINT_MAX
 
+/**
+ * Run @a fn on the adapter thread, if it's enabled with "adapter thread",
+ * else right away. The calling thread keeps the clients of the servers
+ * alive until @a fn is done.
+ * @returns the result of @a fn.
+ */
+int adapter_thread_run(int (*fn)(void *arg), void *arg);
+
+/** Start the adapter thread, if threads are supported. */
+int adapter_thread_start(void);
+
+/** Stop the adapter thread, once it's done with what it runs. */
+void adapter_thread_stop(void);
+
+/** @returns true if the adapter thread runs. */
+bool adapter_thread_enabled(void);
+
 #endif /* OPENOCD_JTAG_ADAPTER_H */
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Optional thread for the adapter I/O, see adapter_thread_run().
+ *
+ * The rest of OpenOCD expects queued transactions to be complete when the
+ * call returns, so the main thread hands one job at a time to the adapter
+ * thread and waits for its completion. Meanwhile it keeps the gdb and
+ * telnet clients alive instead of being stuck in a USB transfer. The log is
+ * shared by both threads, see log_enable_threads().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "adapter.h"
+#include <helper/log.h>
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* The main thread keeps the clients alive this often while it waits */
+#define ADAPTER_THREAD_KEEP_ALIVE_MS 100
+
+struct adapter_thread_job {
+	int (*fn)(void *arg);
+	void *arg;
+	int retval;
+	/* set by the adapter thread, under adapter_thread_mutex */
+	bool done;
+};
+
+static pthread_t adapter_thread;
+static bool adapter_thread_running;
+static pthread_mutex_t adapter_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* signals a new job, or that the thread has to stop */
+static pthread_cond_t adapter_thread_submit = PTHREAD_COND_INITIALIZER;
+/* signals the completion of the job */
+static pthread_cond_t adapter_thread_complete = PTHREAD_COND_INITIALIZER;
+static struct adapter_thread_job *adapter_thread_job;
+static bool adapter_thread_quit;
+
+static void *adapter_thread_main(void *arg)
+{
+	pthread_mutex_lock(&adapter_thread_mutex);
+	while (!adapter_thread_quit) {
+		struct adapter_thread_job *job = adapter_thread_job;
+		if (!job) {
+			pthread_cond_wait(&adapter_thread_submit, &adapter_thread_mutex);
+			continue;
+		}
+		adapter_thread_job = NULL;
+
+		pthread_mutex_unlock(&adapter_thread_mutex);
+		int retval = job->fn(job->arg);
+		pthread_mutex_lock(&adapter_thread_mutex);
+
+		job->retval = retval;
+		job->done = true;
+		pthread_cond_signal(&adapter_thread_complete);
+	}
+	pthread_mutex_unlock(&adapter_thread_mutex);
+	return NULL;
+}
+
+int adapter_thread_run(int (*fn)(void *arg), void *arg)
+{
+	/* the adapter thread itself may end up here, e.g. through a driver */
+	if (!adapter_thread_running || pthread_equal(pthread_self(), adapter_thread))
+		return fn(arg);
+
+	struct adapter_thread_job job = {
+		.fn = fn,
+		.arg = arg,
+		.retval = ERROR_FAIL,
+		.done = false,
+	};
+
+	pthread_mutex_lock(&adapter_thread_mutex);
+	adapter_thread_job = &job;
+	pthread_cond_signal(&adapter_thread_submit);
+	while (!job.done) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += ADAPTER_THREAD_KEEP_ALIVE_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&adapter_thread_complete, &adapter_thread_mutex, &deadline);
+		if (job.done)
+			break;
+
+		/* a long transfer, don't let gdb time out */
+		pthread_mutex_unlock(&adapter_thread_mutex);
+		keep_alive();
+		pthread_mutex_lock(&adapter_thread_mutex);
+	}
+	pthread_mutex_unlock(&adapter_thread_mutex);
+
+	return job.retval;
+}
+
+int adapter_thread_start(void)
+{
+	if (adapter_thread_running)
+		return ERROR_OK;
+
+	log_enable_threads();
+	adapter_thread_quit = false;
+	int err = pthread_create(&adapter_thread, NULL, adapter_thread_main, NULL);
+	if (err) {
+		LOG_ERROR("can't create the adapter thread: %s", strerror(err));
+		return ERROR_FAIL;
+	}
+	adapter_thread_running = true;
+	return ERROR_OK;
+}
+
+void adapter_thread_stop(void)
+{
+	if (!adapter_thread_running)
+		return;
+
+	pthread_mutex_lock(&adapter_thread_mutex);
+	adapter_thread_quit = true;
+	pthread_cond_signal(&adapter_thread_submit);
+	pthread_mutex_unlock(&adapter_thread_mutex);
+
+	pthread_join(adapter_thread, NULL);
+	adapter_thread_running = false;
+}
+
+bool adapter_thread_enabled(void)
+{
+	return adapter_thread_running;
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+int adapter_thread_run(int (*fn)(void *arg), void *arg)
+{
+	return fn(arg);
+}
+
+int adapter_thread_start(void)
+{
+	LOG_ERROR("OpenOCD was built without thread support");
+	return ERROR_NOT_IMPLEMENTED;
+}
+
+void adapter_thread_stop(void)
+{
+}
+
+bool adapter_thread_enabled(void)
+{
+	return false;
+}
+
+#endif /* HAVE_PTHREAD_H */
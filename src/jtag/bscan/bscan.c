@@ -0,0 +1,684 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Boundary scan tests driven by vectors from a file. The length of the
+ * boundary register and the instruction opcodes of a TAP are taken from
+ * its BSDL file. The vectors are queued in batches and the captured data
+ * is compared in bulk, while the adapter shifts the next batch.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bscan.h"
+#include <helper/binarybuffer.h>
+#include <helper/list.h>
+#include <helper/log.h>
+#include <jtag/jtag.h>
+
+/* vectors queued per flush, two batches are in use at a time */
+#define BSCAN_VECTORS_PER_BATCH		256
+#define BSCAN_MISMATCHES_REPORTED	10
+
+struct bscan_instruction {
+	char *name;
+	uint64_t opcode;
+};
+
+/* What the BSDL file of a TAP says. */
+struct bscan_device {
+	struct list_head list;
+	struct jtag_tap *tap;
+	unsigned int boundary_length;
+	unsigned int num_instructions;
+	struct bscan_instruction *instructions;
+};
+
+static LIST_HEAD(bscan_devices);
+
+static void bscan_device_free(struct bscan_device *device)
+{
+	for (unsigned int i = 0; i < device->num_instructions; i++)
+		free(device->instructions[i].name);
+	free(device->instructions);
+	free(device);
+}
+
+void bscan_cleanup_all(void)
+{
+	struct bscan_device *device, *tmp;
+	list_for_each_entry_safe(device, tmp, &bscan_devices, list) {
+		list_del(&device->list);
+		bscan_device_free(device);
+	}
+}
+
+static struct bscan_device *bscan_device_by_tap(struct jtag_tap *tap)
+{
+	struct bscan_device *device;
+	list_for_each_entry(device, &bscan_devices, list) {
+		if (device->tap == tap)
+			return device;
+	}
+	return NULL;
+}
+
+/* Read the whole BSDL file, with the "--" comments blanked out. */
+static char *bsdl_read_file(const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
+		return NULL;
+	}
+
+	size_t size = 0, capacity = 0;
+	char *text = NULL;
+	do {
+		if (capacity - size < 2) {
+			capacity = MAX(2 * capacity, 64 * 1024);
+			char *p = realloc(text, capacity);
+			if (!p) {
+				LOG_ERROR("Out of memory");
+				free(text);
+				fclose(file);
+				return NULL;
+			}
+			text = p;
+		}
+		size += fread(text + size, 1, capacity - size - 1, file);
+	} while (!feof(file) && !ferror(file));
+
+	if (ferror(file)) {
+		LOG_ERROR("couldn't read %s: %s", filename, strerror(errno));
+		free(text);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+	text[size] = '\0';
+
+	for (char *p = strstr(text, "--"); p; p = strstr(p, "--")) {
+		while (*p && *p != '\n')
+			*p++ = ' ';
+	}
+
+	return text;
+}
+
+static bool bsdl_is_identifier(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+static const char *bsdl_skip_space(const char *p)
+{
+	while (isspace((unsigned char)*p))
+		p++;
+	return p;
+}
+
+/*
+ * @returns a copy of the value of "attribute <name> of <entity> : entity
+ * is <value>;", or NULL if the attribute isn't there.
+ */
+static char *bsdl_attribute(const char *text, const char *name)
+{
+	const size_t name_len = strlen(name);
+
+	for (const char *p = text; *p; p++) {
+		if (strncasecmp(p, "attribute", 9) || (p > text && bsdl_is_identifier(p[-1])) ||
+				bsdl_is_identifier(p[9]))
+			continue;
+
+		const char *q = bsdl_skip_space(p + 9);
+		if (strncasecmp(q, name, name_len) || bsdl_is_identifier(q[name_len]))
+			continue;
+
+		const char *colon = strchr(q, ':');
+		const char *end = strchr(q, ';');
+		if (!colon || !end || colon > end)
+			return NULL;
+
+		q = bsdl_skip_space(colon + 1);
+		if (strncasecmp(q, "entity", 6))
+			return NULL;
+		q = bsdl_skip_space(q + 6);
+		if (strncasecmp(q, "is", 2) || bsdl_is_identifier(q[2]))
+			return NULL;
+
+		return strndup(q + 2, end - q - 2);
+	}
+
+	return NULL;
+}
+
+static int bsdl_number_attribute(const char *text, const char *name, unsigned int *value)
+{
+	char *string = bsdl_attribute(text, name);
+	if (!string) {
+		LOG_ERROR("BSDL file has no %s attribute", name);
+		return ERROR_FAIL;
+	}
+
+	char *end;
+	unsigned long n = strtoul(string, &end, 10);
+	bool valid = end != string && *bsdl_skip_space(end) == '\0' && n > 0 && n <= UINT_MAX;
+	free(string);
+	if (!valid) {
+		LOG_ERROR("BSDL file has an invalid %s attribute", name);
+		return ERROR_FAIL;
+	}
+
+	*value = n;
+	return ERROR_OK;
+}
+
+/*
+ * Parse the INSTRUCTION_OPCODE attribute, a concatenation of strings such
+ * as "EXTEST (0000)," & "SAMPLE (0001, 0011)". Only the first opcode of an
+ * instruction is kept, and opcodes with don't care bits are ignored.
+ */
+static int bsdl_parse_opcodes(struct bscan_device *device, const char *text,
+		unsigned int ir_length)
+{
+	char *value = bsdl_attribute(text, "INSTRUCTION_OPCODE");
+	if (!value) {
+		LOG_ERROR("BSDL file has no INSTRUCTION_OPCODE attribute");
+		return ERROR_FAIL;
+	}
+
+	/* join the contents of the quoted strings */
+	char *list = malloc(strlen(value) + 1);
+	if (!list) {
+		LOG_ERROR("Out of memory");
+		free(value);
+		return ERROR_FAIL;
+	}
+	char *dst = list;
+	bool quoted = false;
+	for (const char *src = value; *src; src++) {
+		if (*src == '"')
+			quoted = !quoted;
+		else if (quoted)
+			*dst++ = *src;
+	}
+	*dst = '\0';
+	free(value);
+
+	int retval = ERROR_OK;
+	const char *p = list;
+	while (retval == ERROR_OK) {
+		while (isspace((unsigned char)*p) || *p == ',')
+			p++;
+		if (!*p)
+			break;
+
+		const char *name = p;
+		while (bsdl_is_identifier(*p))
+			p++;
+		const size_t name_len = p - name;
+		p = bsdl_skip_space(p);
+		const char *close = strchr(p, ')');
+		if (!name_len || *p != '(' || !close) {
+			LOG_ERROR("BSDL file has an invalid INSTRUCTION_OPCODE attribute");
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		const char *bits = bsdl_skip_space(p + 1);
+		uint64_t opcode = 0;
+		unsigned int num_bits = 0;
+		for (; *bits == '0' || *bits == '1'; bits++, num_bits++)
+			opcode = (opcode << 1) | (*bits - '0');
+		p = close + 1;
+
+		bits = bsdl_skip_space(bits);
+		if (num_bits != ir_length || (*bits != ',' && *bits != ')')) {
+			LOG_DEBUG("skipping BSDL instruction %.*s", (int)name_len, name);
+			continue;
+		}
+
+		bool known = false;
+		for (unsigned int i = 0; i < device->num_instructions && !known; i++)
+			known = strlen(device->instructions[i].name) == name_len &&
+				!strncasecmp(device->instructions[i].name, name, name_len);
+		if (known)
+			continue;
+
+		struct bscan_instruction *instructions = realloc(device->instructions,
+			(device->num_instructions + 1) * sizeof(*instructions));
+		char *copy = strndup(name, name_len);
+		if (instructions)
+			device->instructions = instructions;
+		if (!instructions || !copy) {
+			LOG_ERROR("Out of memory");
+			free(copy);
+			retval = ERROR_FAIL;
+			break;
+		}
+		device->instructions[device->num_instructions].name = copy;
+		device->instructions[device->num_instructions].opcode = opcode;
+		device->num_instructions++;
+	}
+
+	free(list);
+	return retval;
+}
+
+COMMAND_HANDLER(handle_bscan_bsdl_command)
+{
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct jtag_tap *tap = jtag_tap_by_string(CMD_ARGV[0]);
+	if (!tap) {
+		command_print(CMD, "Tap '%s' could not be found", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	char *text = bsdl_read_file(CMD_ARGV[1]);
+	if (!text)
+		return ERROR_FAIL;
+
+	struct bscan_device *device = calloc(1, sizeof(*device));
+	if (!device) {
+		LOG_ERROR("Out of memory");
+		free(text);
+		return ERROR_FAIL;
+	}
+	device->tap = tap;
+
+	unsigned int ir_length;
+	int retval = bsdl_number_attribute(text, "INSTRUCTION_LENGTH", &ir_length);
+	if (retval == ERROR_OK && (int)ir_length != tap->ir_length) {
+		command_print(CMD, "BSDL file has an IR length of %u, TAP %s of %d",
+			ir_length, tap->dotted_name, tap->ir_length);
+		retval = ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (retval == ERROR_OK && ir_length > 64) {
+		command_print(CMD, "IR length of %u not supported", ir_length);
+		retval = ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (retval == ERROR_OK)
+		retval = bsdl_number_attribute(text, "BOUNDARY_LENGTH", &device->boundary_length);
+	if (retval == ERROR_OK)
+		retval = bsdl_parse_opcodes(device, text, ir_length);
+	free(text);
+	if (retval != ERROR_OK) {
+		bscan_device_free(device);
+		return retval;
+	}
+
+	struct bscan_device *old = bscan_device_by_tap(tap);
+	if (old) {
+		list_del(&old->list);
+		bscan_device_free(old);
+	}
+	list_add_tail(&device->list, &bscan_devices);
+
+	LOG_DEBUG("%s: boundary register of %u bits, %u instructions", tap->dotted_name,
+		device->boundary_length, device->num_instructions);
+
+	return ERROR_OK;
+}
+
+static struct bscan_device *bscan_device_from_arg(struct command_invocation *cmd,
+		const char *arg)
+{
+	struct jtag_tap *tap = jtag_tap_by_string(arg);
+	if (!tap) {
+		command_print(cmd, "Tap '%s' could not be found", arg);
+		return NULL;
+	}
+
+	struct bscan_device *device = bscan_device_by_tap(tap);
+	if (!device)
+		command_print(cmd, "No BSDL file loaded for TAP %s, see 'bscan bsdl'",
+			tap->dotted_name);
+	return device;
+}
+
+COMMAND_HANDLER(handle_bscan_info_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct bscan_device *device = bscan_device_from_arg(CMD, CMD_ARGV[0]);
+	if (!device)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	command_print(CMD, "boundary register: %u bits", device->boundary_length);
+	for (unsigned int i = 0; i < device->num_instructions; i++)
+		command_print(CMD, "%-16s 0x%0*" PRIx64, device->instructions[i].name,
+			DIV_ROUND_UP(device->tap->ir_length, 4), device->instructions[i].opcode);
+
+	return ERROR_OK;
+}
+
+/* A batch of vectors, the buffers hold BSCAN_VECTORS_PER_BATCH each. */
+struct bscan_batch {
+	unsigned int count;
+	unsigned int *lines;
+	uint8_t *out;
+	uint8_t *in;
+	uint8_t *expected;
+	uint8_t *mask;
+};
+
+static void bscan_batch_free(struct bscan_batch *batch)
+{
+	free(batch->lines);
+	free(batch->out);
+	free(batch->in);
+	free(batch->expected);
+	free(batch->mask);
+}
+
+static int bscan_batch_alloc(struct bscan_batch *batch, unsigned int num_bytes)
+{
+	const size_t size = (size_t)BSCAN_VECTORS_PER_BATCH * num_bytes;
+
+	batch->count = 0;
+	batch->lines = calloc(BSCAN_VECTORS_PER_BATCH, sizeof(*batch->lines));
+	batch->out = malloc(size);
+	batch->in = malloc(size);
+	batch->expected = malloc(size);
+	batch->mask = malloc(size);
+	if (!batch->lines || !batch->out || !batch->in || !batch->expected || !batch->mask) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+/* Parse a hex number of up to @a num_bits bits, MSB first as for drscan. */
+static int bscan_parse_hex(const char *str, size_t len, uint8_t *buf, unsigned int num_bits)
+{
+	if (len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		str += 2;
+		len -= 2;
+	}
+
+	memset(buf, 0, DIV_ROUND_UP(num_bits, 8));
+	unsigned int bit = 0;
+	for (size_t i = len; i-- > 0; bit += 4) {
+		unsigned int digit;
+		if (str[i] >= '0' && str[i] <= '9')
+			digit = str[i] - '0';
+		else if (tolower((unsigned char)str[i]) >= 'a' && tolower((unsigned char)str[i]) <= 'f')
+			digit = tolower((unsigned char)str[i]) - 'a' + 10;
+		else
+			return ERROR_FAIL;
+
+		if (bit >= num_bits) {
+			if (digit)
+				return ERROR_FAIL;
+			continue;
+		}
+		const unsigned int n = MIN(4, num_bits - bit);
+		if (digit >> n)
+			return ERROR_FAIL;
+		buf_set_u32(buf, bit, n, digit);
+	}
+
+	return len ? ERROR_OK : ERROR_FAIL;
+}
+
+/*
+ * Read the next vectors of the file into @a batch. Each line holds the
+ * bits to shift in, optionally followed by the bits expected to be shifted
+ * out and a mask of the bits to compare, all in hex. '#' starts a comment.
+ */
+static int bscan_read_batch(FILE *file, char *line, size_t line_size,
+		unsigned int *line_number, struct bscan_batch *batch, unsigned int num_bits)
+{
+	const unsigned int num_bytes = DIV_ROUND_UP(num_bits, 8);
+
+	batch->count = 0;
+	while (batch->count < BSCAN_VECTORS_PER_BATCH && fgets(line, line_size, file)) {
+		(*line_number)++;
+		size_t len = strlen(line);
+		if (len == line_size - 1 && line[len - 1] != '\n' && !feof(file)) {
+			LOG_ERROR("line %u: too long", *line_number);
+			return ERROR_FAIL;
+		}
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		const unsigned int i = batch->count;
+		uint8_t *values[3] = {
+			batch->out + i * num_bytes,
+			batch->expected + i * num_bytes,
+			batch->mask + i * num_bytes,
+		};
+		unsigned int num_values = 0;
+		const char *p = bsdl_skip_space(line);
+		while (*p) {
+			const char *end = p;
+			while (*end && !isspace((unsigned char)*end))
+				end++;
+			if (num_values == ARRAY_SIZE(values) ||
+					bscan_parse_hex(p, end - p, values[num_values], num_bits) != ERROR_OK) {
+				LOG_ERROR("line %u: expected up to three hex values of %u bits",
+					*line_number, num_bits);
+				return ERROR_FAIL;
+			}
+			num_values++;
+			p = bsdl_skip_space(end);
+		}
+
+		if (!num_values)
+			continue;
+		if (num_values < 2)
+			memset(values[2], 0, num_bytes);
+		else if (num_values < 3)
+			buf_set_ones(values[2], num_bits);
+		batch->lines[i] = *line_number;
+		batch->count++;
+	}
+
+	if (ferror(file)) {
+		LOG_ERROR("couldn't read vectors: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+/* Compare what a batch captured, @returns the number of mismatches. */
+static unsigned int bscan_check_batch(const struct bscan_batch *batch, unsigned int num_bits,
+		unsigned int reported)
+{
+	const unsigned int num_bytes = DIV_ROUND_UP(num_bits, 8);
+	unsigned int mismatches = 0;
+
+	for (unsigned int i = 0; i < batch->count; i++) {
+		const uint8_t *in = batch->in + i * num_bytes;
+		const uint8_t *expected = batch->expected + i * num_bytes;
+		const uint8_t *mask = batch->mask + i * num_bytes;
+		if (!buf_cmp_mask(in, expected, mask, num_bits))
+			continue;
+
+		if (reported + mismatches < BSCAN_MISMATCHES_REPORTED) {
+			char *in_str = buf_to_hex_str(in, num_bits);
+			char *expected_str = buf_to_hex_str(expected, num_bits);
+			char *mask_str = buf_to_hex_str(mask, num_bits);
+			LOG_ERROR("line %u: captured 0x%s, expected 0x%s, mask 0x%s", batch->lines[i],
+				in_str ? in_str : "?", expected_str ? expected_str : "?",
+				mask_str ? mask_str : "?");
+			free(in_str);
+			free(expected_str);
+			free(mask_str);
+		}
+		mismatches++;
+	}
+
+	return mismatches;
+}
+
+static const struct bscan_instruction *bscan_instruction_by_name(
+		const struct bscan_device *device, const char *name)
+{
+	for (unsigned int i = 0; i < device->num_instructions; i++) {
+		if (!strcasecmp(device->instructions[i].name, name))
+			return &device->instructions[i];
+	}
+	return NULL;
+}
+
+COMMAND_HANDLER(handle_bscan_vectors_command)
+{
+	if (CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct bscan_device *device = bscan_device_from_arg(CMD, CMD_ARGV[0]);
+	if (!device)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	struct jtag_tap *tap = device->tap;
+	if (!tap->enabled) {
+		command_print(CMD, "TAP %s is disabled", tap->dotted_name);
+		return ERROR_FAIL;
+	}
+
+	uint64_t opcode;
+	const struct bscan_instruction *instruction = bscan_instruction_by_name(device, CMD_ARGV[1]);
+	if (instruction)
+		opcode = instruction->opcode;
+	else
+		COMMAND_PARSE_NUMBER(u64, CMD_ARGV[1], opcode);
+
+	FILE *file = fopen(CMD_ARGV[2], "r");
+	if (!file) {
+		command_print(CMD, "couldn't open %s: %s", CMD_ARGV[2], strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	const unsigned int num_bits = device->boundary_length;
+	const unsigned int num_bytes = DIV_ROUND_UP(num_bits, 8);
+	/* three values and some room for spaces, prefixes and a comment */
+	const size_t line_size = 3 * (DIV_ROUND_UP(num_bits, 4) + 3) + 256;
+	char *line = malloc(line_size);
+	struct bscan_batch batches[2] = { 0 };
+	int retval = ERROR_FAIL;
+	if (!line) {
+		LOG_ERROR("Out of memory");
+		goto out;
+	}
+	for (unsigned int i = 0; i < ARRAY_SIZE(batches); i++) {
+		if (bscan_batch_alloc(&batches[i], num_bytes) != ERROR_OK)
+			goto out;
+	}
+
+	uint8_t ir[8];
+	buf_set_u64(ir, 0, tap->ir_length, opcode);
+	struct scan_field field = {
+		.num_bits = tap->ir_length,
+		.out_value = ir,
+	};
+	jtag_add_ir_scan(tap, &field, TAP_IDLE);
+
+	/* Fill and queue one batch while the other one is shifted. */
+	struct jtag_async *async = NULL;
+	unsigned int line_number = 0, num_vectors = 0, mismatches = 0;
+	unsigned int cur = 0;
+	while (true) {
+		struct bscan_batch *batch = &batches[cur];
+		retval = bscan_read_batch(file, line, line_size, &line_number, batch, num_bits);
+		if (retval == ERROR_OK) {
+			for (unsigned int i = 0; i < batch->count; i++) {
+				field.num_bits = num_bits;
+				field.out_value = batch->out + i * num_bytes;
+				field.in_value = batch->in + i * num_bytes;
+				jtag_add_dr_scan_nocopy(tap, 1, &field, TAP_IDLE);
+			}
+		}
+
+		if (async) {
+			int wait_retval = jtag_async_wait(async);
+			async = NULL;
+			if (wait_retval != ERROR_OK) {
+				retval = wait_retval;
+				break;
+			}
+			mismatches += bscan_check_batch(&batches[!cur], num_bits, mismatches);
+		}
+
+		if (retval != ERROR_OK || !batch->count)
+			break;
+		num_vectors += batch->count;
+
+		retval = jtag_execute_queue_async(&async);
+		if (retval != ERROR_OK)
+			break;
+		cur = !cur;
+		keep_alive();
+	}
+
+	if (async) {
+		int wait_retval = jtag_async_wait(async);
+		if (retval == ERROR_OK)
+			retval = wait_retval;
+	}
+	/* e.g. the IR scan when the file has no vectors */
+	int flush_retval = jtag_execute_queue();
+	if (retval == ERROR_OK)
+		retval = flush_retval;
+
+	if (retval == ERROR_OK) {
+		command_print(CMD, "%u vectors, %u mismatches", num_vectors, mismatches);
+		if (mismatches)
+			retval = ERROR_FAIL;
+	}
+
+out:
+	for (unsigned int i = 0; i < ARRAY_SIZE(batches); i++)
+		bscan_batch_free(&batches[i]);
+	free(line);
+	fclose(file);
+	return retval;
+}
+
+static const struct command_registration bscan_subcommand_handlers[] = {
+	{
+		.name = "bsdl",
+		.handler = handle_bscan_bsdl_command,
+		.mode = COMMAND_ANY,
+		.help = "Load the boundary register length and the instruction "
+			"opcodes of a TAP from its BSDL file",
+		.usage = "tap_name filename",
+	},
+	{
+		.name = "info",
+		.handler = handle_bscan_info_command,
+		.mode = COMMAND_ANY,
+		.help = "Display what the BSDL file of a TAP says",
+		.usage = "tap_name",
+	},
+	{
+		.name = "vectors",
+		.handler = handle_bscan_vectors_command,
+		.mode = COMMAND_EXEC,
+		.help = "Load an instruction, e.g. SAMPLE or EXTEST, then scan the "
+			"boundary register vectors of a file and compare what is captured",
+		.usage = "tap_name (instruction_name|opcode) filename",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration bscan_command_handlers[] = {
+	{
+		.name = "bscan",
+		.mode = COMMAND_ANY,
+		.help = "Boundary scan commands",
+		.usage = "",
+		.chain = bscan_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int bscan_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, bscan_command_handlers);
+}
@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_BSCAN_BSCAN_H
+#define OPENOCD_JTAG_BSCAN_BSCAN_H
+
+#include <helper/command.h>
+
+int bscan_register_commands(struct command_context *cmd_ctx);
+
+/** Free the BSDL data of all the TAPs. */
+void bscan_cleanup_all(void);
+
+#endif /* OPENOCD_JTAG_BSCAN_BSCAN_H */
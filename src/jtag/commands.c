@@ -30,8 +30,17 @@ struct cmd_queue_page {
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
+/* upper bound of the pages kept for reuse once a queue is reset */
+#define CMD_QUEUE_FREE_PAGES_MAX 16
 static struct cmd_queue_page *cmd_queue_pages;
 static struct cmd_queue_page *cmd_queue_pages_tail;
+/* pages recycled by jtag_command_queue_reset(), all of CMD_QUEUE_PAGE_SIZE */
+static struct cmd_queue_page *cmd_queue_free_pages;
+
+static struct cmd_queue_stats cmd_queue_stats;
+
+/* run jtag_command_queue_optimize() before the queue goes to the driver */
+static bool cmd_queue_optimize_enabled;
 
 static struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
@@ -108,15 +117,30 @@ void *cmd_queue_alloc(size_t size)
 	}
 
 	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
+		if (size <= CMD_QUEUE_PAGE_SIZE && cmd_queue_free_pages) {
+			*p_page = cmd_queue_free_pages;
+			cmd_queue_free_pages = cmd_queue_free_pages->next;
+			cmd_queue_stats.free_pages--;
+		} else {
+			*p_page = malloc(sizeof(struct cmd_queue_page));
+			size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
+						CMD_QUEUE_PAGE_SIZE : size;
+			(*p_page)->address = malloc(alloc_size);
+			cmd_queue_stats.page_allocs++;
+		}
 		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
-					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
 		(*p_page)->next = NULL;
 		cmd_queue_pages_tail = *p_page;
+
+		cmd_queue_stats.pages++;
+		cmd_queue_stats.pages_high_water = MAX(cmd_queue_stats.pages_high_water,
+				cmd_queue_stats.pages);
 	}
 
+	cmd_queue_stats.bytes += size;
+	cmd_queue_stats.bytes_high_water = MAX(cmd_queue_stats.bytes_high_water,
+			cmd_queue_stats.bytes);
+
 	offset = (*p_page)->used;
 	(*p_page)->used += size;
 
@@ -124,19 +148,64 @@ void *cmd_queue_alloc(size_t size)
 	return t + offset;
 }
 
-static void cmd_queue_free(void)
+static void cmd_queue_page_free(struct cmd_queue_page *page)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	free(page->address);
+	free(page);
+}
+
+/* Move pages to the free list, so that the next queues up to the
+ * high-water mark get their memory without calling malloc(). */
+static void cmd_queue_recycle(struct cmd_queue_page *page)
+{
+	unsigned int keep = MIN(cmd_queue_stats.pages_high_water, CMD_QUEUE_FREE_PAGES_MAX);
 
 	while (page) {
-		struct cmd_queue_page *last = page;
-		free(page->address);
-		page = page->next;
-		free(last);
+		struct cmd_queue_page *next = page->next;
+
+		/* pages of an oversized single allocation are not reused */
+		if (page->used <= CMD_QUEUE_PAGE_SIZE && cmd_queue_stats.free_pages < keep) {
+			page->next = cmd_queue_free_pages;
+			cmd_queue_free_pages = page;
+			cmd_queue_stats.free_pages++;
+		} else {
+			cmd_queue_page_free(page);
+		}
+		page = next;
 	}
+}
+
+static struct cmd_queue_page *cmd_queue_take_pages(void)
+{
+	struct cmd_queue_page *pages = cmd_queue_pages;
 
 	cmd_queue_pages = NULL;
 	cmd_queue_pages_tail = NULL;
+	cmd_queue_stats.pages = 0;
+	cmd_queue_stats.bytes = 0;
+	cmd_queue_stats.resets++;
+
+	return pages;
+}
+
+static void cmd_queue_free(void)
+{
+	cmd_queue_recycle(cmd_queue_take_pages());
+}
+
+void cmd_queue_release_free_pages(void)
+{
+	while (cmd_queue_free_pages) {
+		struct cmd_queue_page *next = cmd_queue_free_pages->next;
+		cmd_queue_page_free(cmd_queue_free_pages);
+		cmd_queue_free_pages = next;
+	}
+	cmd_queue_stats.free_pages = 0;
+}
+
+const struct cmd_queue_stats *cmd_queue_get_stats(void)
+{
+	return &cmd_queue_stats;
 }
 
 void jtag_command_queue_reset(void)
@@ -152,6 +221,150 @@ struct jtag_command *jtag_command_queue_get(void)
 	return jtag_command_queue;
 }
 
+struct cmd_queue_page *jtag_command_queue_detach(void)
+{
+	struct cmd_queue_page *pages = cmd_queue_take_pages();
+
+	jtag_command_queue = NULL;
+	next_command_pointer = &jtag_command_queue;
+
+	return pages;
+}
+
+void jtag_command_queue_release(struct cmd_queue_page *pages)
+{
+	cmd_queue_recycle(pages);
+}
+
+void jtag_command_queue_set_optimize(bool enable)
+{
+	cmd_queue_optimize_enabled = enable;
+}
+
+bool jtag_command_queue_get_optimize(void)
+{
+	return cmd_queue_optimize_enabled;
+}
+
+static bool scan_field_bits_equal(const struct scan_field *a, const struct scan_field *b)
+{
+	if (a->num_bits != b->num_bits || !a->out_value || !b->out_value)
+		return false;
+
+	unsigned int bytes = a->num_bits / 8;
+	unsigned int trailing = a->num_bits % 8;
+
+	if (memcmp(a->out_value, b->out_value, bytes) != 0)
+		return false;
+
+	if (!trailing)
+		return true;
+
+	uint8_t mask = (1 << trailing) - 1;
+	return ((a->out_value[bytes] ^ b->out_value[bytes]) & mask) == 0;
+}
+
+/* An IR scan can be dropped if it shifts the same bits as the last one,
+ * nobody looks at the captured bits, and it goes from Run-Test/Idle back
+ * to Run-Test/Idle: the only effect would be to latch the same instruction
+ * again. Leaving e.g. Pause-DR would also pass Update-DR. */
+static bool ir_scan_is_redundant(const struct scan_command *scan,
+		const struct scan_command *last_ir, tap_state_t state)
+{
+	if (!last_ir || state != TAP_IDLE || scan->end_state != TAP_IDLE ||
+			scan->num_fields != last_ir->num_fields)
+		return false;
+
+	for (int i = 0; i < scan->num_fields; i++) {
+		if (scan->fields[i].in_value)
+			return false;
+		if (!scan_field_bits_equal(&scan->fields[i], &last_ir->fields[i]))
+			return false;
+	}
+
+	return true;
+}
+
+void jtag_command_queue_optimize(void)
+{
+	if (!cmd_queue_optimize_enabled)
+		return;
+
+	/* TAP state and instruction left by the commands seen so far; both
+	 * are unknown at the start of the queue */
+	tap_state_t state = TAP_INVALID;
+	const struct scan_command *last_ir = NULL;
+	struct jtag_command *prev = NULL;
+	struct jtag_command **p = &jtag_command_queue;
+
+	while (*p) {
+		struct jtag_command *cmd = *p;
+		bool drop = false;
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			if (cmd->cmd.scan->ir_scan) {
+				if (ir_scan_is_redundant(cmd->cmd.scan, last_ir, state)) {
+					cmd_queue_stats.ir_scans_dropped++;
+					drop = true;
+					break;
+				}
+				last_ir = cmd->cmd.scan;
+			}
+			state = cmd->cmd.scan->end_state;
+			break;
+		case JTAG_TLR_RESET:
+			/* a second reset in a row does nothing */
+			if (state == TAP_RESET && cmd->cmd.statemove->end_state == TAP_RESET) {
+				cmd_queue_stats.statemoves_dropped++;
+				drop = true;
+				break;
+			}
+			last_ir = NULL;
+			state = cmd->cmd.statemove->end_state;
+			break;
+		case JTAG_RUNTEST:
+			/* cycles in Run-Test/Idle add up when the first one stays there */
+			if (prev && prev->type == JTAG_RUNTEST &&
+					prev->cmd.runtest->end_state == TAP_IDLE &&
+					prev->cmd.runtest->num_cycles <= INT_MAX - cmd->cmd.runtest->num_cycles) {
+				prev->cmd.runtest->num_cycles += cmd->cmd.runtest->num_cycles;
+				prev->cmd.runtest->end_state = cmd->cmd.runtest->end_state;
+				cmd_queue_stats.runtests_merged++;
+				drop = true;
+			}
+			state = cmd->cmd.runtest->end_state;
+			break;
+		case JTAG_PATHMOVE:
+			if (cmd->cmd.pathmove->num_states > 0)
+				state = cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1];
+			break;
+		case JTAG_SLEEP:
+			break;
+		case JTAG_STABLECLOCKS:
+			/* clocking in Shift-IR would change the instruction */
+			if (state == TAP_INVALID || state == TAP_IRSHIFT)
+				last_ir = NULL;
+			break;
+		default:
+			/* resets and raw TMS sequences: forget everything */
+			last_ir = NULL;
+			state = TAP_INVALID;
+			break;
+		}
+
+		if (drop) {
+			*p = cmd->next;
+			continue;
+		}
+
+		prev = cmd;
+		p = &cmd->next;
+	}
+
+	next_command_pointer = p;
+}
+
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
@@ -151,10 +151,58 @@ struct jtag_command {
 
 void *cmd_queue_alloc(size_t size);
 
+/** Memory usage of the JTAG command queue, see 'jtag queue_stats'. */
+struct cmd_queue_stats {
+	/** pages used by the current queue */
+	unsigned int pages;
+	/** pages kept for reuse */
+	unsigned int free_pages;
+	/** most pages used by a single queue */
+	unsigned int pages_high_water;
+	/** bytes allocated from the current queue */
+	size_t bytes;
+	/** most bytes allocated from a single queue */
+	size_t bytes_high_water;
+	/** number of queue resets, i.e. of flushed queues */
+	uint64_t resets;
+	/** number of pages obtained from malloc() */
+	uint64_t page_allocs;
+	/** IR scans dropped by jtag_command_queue_optimize() */
+	uint64_t ir_scans_dropped;
+	/** runtests merged into the previous one by jtag_command_queue_optimize() */
+	uint64_t runtests_merged;
+	/** state moves dropped by jtag_command_queue_optimize() */
+	uint64_t statemoves_dropped;
+};
+
+const struct cmd_queue_stats *cmd_queue_get_stats(void);
+/** Free the pages kept for reuse by the command queue. */
+void cmd_queue_release_free_pages(void);
+
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
 struct jtag_command *jtag_command_queue_get(void);
 
+struct cmd_queue_page;
+/**
+ * Start a new, empty queue but keep the memory of the current one, which
+ * still holds e.g. the callbacks of a queue being executed asynchronously.
+ * The memory is given back with jtag_command_queue_release().
+ */
+struct cmd_queue_page *jtag_command_queue_detach(void);
+void jtag_command_queue_release(struct cmd_queue_page *pages);
+
+/**
+ * Drop the IR scans that reload the instruction already selected, merge
+ * adjacent runtests and drop repeated TAP resets. Only the commands queued
+ * since the last reset are considered, and only commands whose result
+ * nobody reads are dropped. Does nothing unless enabled with
+ * jtag_command_queue_set_optimize().
+ */
+void jtag_command_queue_optimize(void);
+void jtag_command_queue_set_optimize(bool enable);
+bool jtag_command_queue_get_optimize(void);
+
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
 int jtag_scan_size(const struct scan_command *cmd);
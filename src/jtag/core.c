@@ -26,6 +26,8 @@
 #include <transport/transport.h>
 #include <helper/jep106.h>
 #include "helper/system.h"
+#include <helper/perf.h>
+#include <helper/time_support.h>
 
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
@@ -34,6 +36,7 @@
 /* SVF and XSVF are higher level JTAG command sets (for boundary scan) */
 #include "svf/svf.h"
 #include "xsvf/xsvf.h"
+#include "bscan/bscan.h"
 
 /* ipdbg are utilities to debug IP-cores. It uses JTAG for transport. */
 #include "server/ipdbg.h"
@@ -44,6 +47,10 @@ static int jtag_flush_queue_count;
 /* Sleep this # of ms after flushing the queue */
 static int jtag_flush_queue_sleep;
 
+static struct jtag_stats jtag_stats;
+static unsigned int jtag_stats_log_interval_ms;
+static int64_t jtag_stats_last_log_us;
+
 static void jtag_add_scan_check(struct jtag_tap *active,
 		void (*jtag_add_scan)(struct jtag_tap *active,
 		int in_num_fields,
@@ -88,6 +95,13 @@ static enum reset_types jtag_reset_config = RESET_NONE;
 tap_state_t cmd_queue_cur_state = TAP_RESET;
 
 static bool jtag_verify_capture_ir = true;
+
+static bool jtag_ir_cache_enabled;
+/* Since the last IR scan, the instruction of every enabled TAP is known:
+ * cur_instr for the addressed one, bypass for the others. Any TAP reset,
+ * enable or disable bumps the chain generation, which drops the cache. */
+static bool jtag_ir_cache_valid;
+static unsigned int jtag_ir_cache_gen;
 static int jtag_verify = 1;
 
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
@@ -122,6 +136,10 @@ void jtag_set_flush_queue_sleep(int ms)
 
 void jtag_set_error(int error)
 {
+	/* whatever failed, what the TAPs hold is unknown now */
+	if (error != ERROR_OK)
+		jtag_ir_cache_valid = false;
+
 	if ((error == ERROR_OK) || (jtag_error != ERROR_OK))
 		return;
 	jtag_error = error;
@@ -209,6 +227,19 @@ unsigned jtag_tap_count_enabled(void)
 	return n;
 }
 
+/* bumped whenever TAPs are added, enabled, disabled or reset */
+static unsigned int jtag_tap_chain_gen;
+
+void jtag_tap_chain_changed(void)
+{
+	jtag_tap_chain_gen++;
+}
+
+unsigned int jtag_tap_chain_generation(void)
+{
+	return jtag_tap_chain_gen;
+}
+
 /** Append a new TAP to the chain of all taps. */
 static void jtag_tap_add(struct jtag_tap *t)
 {
@@ -221,6 +252,7 @@ static void jtag_tap_add(struct jtag_tap *t)
 	}
 	*tap = t;
 	t->abs_chain_position = jtag_num_taps;
+	jtag_tap_chain_changed();
 }
 
 /* returns a pointer to the n-th device in the scan chain */
@@ -358,8 +390,30 @@ void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field
 {
 	jtag_prelude(state);
 
+	active->stats.ir_scans++;
+	active->stats.ir_bits += active->ir_length;
+
 	int retval = interface_jtag_add_ir_scan(active, in_fields, state);
 	jtag_set_error(retval);
+	jtag_ir_cache_valid = retval == ERROR_OK;
+	jtag_ir_cache_gen = jtag_tap_chain_gen;
+}
+
+/* Same rule as the queue optimizer: an IR scan from Run-Test/Idle back to
+ * Run-Test/Idle without capture only latches the instruction again. */
+static bool jtag_ir_scan_is_cached(const struct jtag_tap *active,
+		const struct scan_field *field, tap_state_t state)
+{
+	if (!jtag_ir_cache_enabled || !jtag_ir_cache_valid ||
+			jtag_ir_cache_gen != jtag_tap_chain_gen)
+		return false;
+
+	if (cmd_queue_cur_state != TAP_IDLE || state != TAP_IDLE ||
+			field->in_value || !field->out_value)
+		return false;
+
+	return !active->bypass && field->num_bits == active->ir_length &&
+		!buf_cmp(field->out_value, active->cur_instr, active->ir_length);
 }
 
 static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
@@ -375,6 +429,11 @@ void jtag_add_ir_scan(struct jtag_tap *active, struct scan_field *in_fields, tap
 {
 	assert(state != TAP_RESET);
 
+	if (jtag_ir_scan_is_cached(active, in_fields, state)) {
+		active->stats.ir_scans_cached++;
+		return;
+	}
+
 	if (jtag_verify && jtag_verify_capture_ir) {
 		/* 8 x 32 bit id's is enough for all invocations */
 
@@ -397,6 +456,9 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 
 	jtag_prelude(state);
 
+	/* the bits don't tell which TAP got which instruction */
+	jtag_ir_cache_valid = false;
+
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
 	jtag_set_error(retval);
@@ -448,7 +510,7 @@ void jtag_add_dr_scan_check(struct jtag_tap *active,
 }
 
 
-void jtag_add_dr_scan(struct jtag_tap *active,
+static void jtag_add_dr_scan_prelude(struct jtag_tap *active,
 	int in_num_fields,
 	const struct scan_field *in_fields,
 	tap_state_t state)
@@ -457,11 +519,35 @@ void jtag_add_dr_scan(struct jtag_tap *active,
 
 	jtag_prelude(state);
 
+	active->stats.dr_scans++;
+	for (int i = 0; i < in_num_fields; i++)
+		active->stats.dr_bits += in_fields[i].num_bits;
+}
+
+void jtag_add_dr_scan(struct jtag_tap *active,
+	int in_num_fields,
+	const struct scan_field *in_fields,
+	tap_state_t state)
+{
+	jtag_add_dr_scan_prelude(active, in_num_fields, in_fields, state);
+
 	int retval;
 	retval = interface_jtag_add_dr_scan(active, in_num_fields, in_fields, state);
 	jtag_set_error(retval);
 }
 
+void jtag_add_dr_scan_nocopy(struct jtag_tap *active,
+	int in_num_fields,
+	const struct scan_field *in_fields,
+	tap_state_t state)
+{
+	jtag_add_dr_scan_prelude(active, in_num_fields, in_fields, state);
+
+	int retval;
+	retval = interface_jtag_add_dr_scan_nocopy(active, in_num_fields, in_fields, state);
+	jtag_set_error(retval);
+}
+
 void jtag_add_plain_dr_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_bits,
 	tap_state_t state)
 {
@@ -508,6 +594,7 @@ int jtag_add_tms_seq(unsigned nbits, const uint8_t *seq, enum tap_state state)
 
 	jtag_checks();
 	cmd_queue_cur_state = state;
+	jtag_ir_cache_valid = false;
 
 	retval = interface_add_tms_seq(nbits, seq, state);
 	jtag_set_error(retval);
@@ -539,6 +626,9 @@ void jtag_add_pathmove(int num_states, const tap_state_t *path)
 			jtag_set_error(ERROR_JTAG_TRANSITION_INVALID);
 			return;
 		}
+		/* Capture-IR overwrites the instruction shifted last */
+		if (path[i] == TAP_IRCAPTURE)
+			jtag_ir_cache_valid = false;
 		cur_state = path[i];
 	}
 
@@ -929,6 +1019,108 @@ void jtag_check_value_mask(struct scan_field *field, uint8_t *value, uint8_t *ma
 	jtag_set_error(retval);
 }
 
+/* Account the commands about to be sent to the adapter. */
+static void jtag_stats_account_queue(const struct jtag_command *cmd)
+{
+	uint64_t bits = 0;
+
+	for (; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+		case JTAG_SCAN: {
+			unsigned int scan_bits = jtag_scan_size(cmd->cmd.scan);
+			if (cmd->cmd.scan->ir_scan) {
+				jtag_stats.ir_scans++;
+				jtag_stats.ir_bits += scan_bits;
+			} else {
+				jtag_stats.dr_scans++;
+				jtag_stats.dr_bits += scan_bits;
+			}
+			bits += scan_bits;
+			break;
+		}
+		case JTAG_RUNTEST:
+			jtag_stats.idle_cycles += cmd->cmd.runtest->num_cycles;
+			break;
+		case JTAG_STABLECLOCKS:
+			jtag_stats.idle_cycles += cmd->cmd.stableclocks->num_cycles;
+			break;
+		default:
+			break;
+		}
+	}
+
+	jtag_stats.max_flush_bits = MAX(jtag_stats.max_flush_bits, bits);
+}
+
+static void jtag_stats_log(int64_t now)
+{
+	const struct jtag_stats *s = &jtag_stats;
+	int64_t elapsed = now - s->start_us;
+
+	LOG_INFO("jtag stats: %" PRIu64 " flushes, %" PRIu64 " IR / %" PRIu64
+			" DR scans, %" PRIu64 " bits, %" PRIu64 " idle cycles, "
+			"flush %" PRId64 " ms / driver %" PRId64 " ms of %" PRId64 " ms",
+			s->flushes, s->ir_scans, s->dr_scans, s->ir_bits + s->dr_bits,
+			s->idle_cycles, s->flush_us / 1000, s->driver_us / 1000, elapsed / 1000);
+}
+
+const struct jtag_stats *jtag_get_stats(void)
+{
+	return &jtag_stats;
+}
+
+void jtag_reset_stats(void)
+{
+	jtag_stats = (struct jtag_stats){
+		.start_us = timeval_us(),
+	};
+	jtag_stats_last_log_us = jtag_stats.start_us;
+
+	for (struct jtag_tap *tap = jtag_all_taps(); tap; tap = tap->next_tap)
+		tap->stats = (struct jtag_tap_stats){ 0 };
+}
+
+void jtag_set_stats_log_interval(unsigned int interval_ms)
+{
+	jtag_stats_log_interval_ms = interval_ms;
+	jtag_stats_last_log_us = timeval_us();
+}
+
+unsigned int jtag_get_stats_log_interval(void)
+{
+	return jtag_stats_log_interval_ms;
+}
+
+int default_interface_jtag_submit_queue(void)
+{
+	/* the synchronous path reports the configuration errors */
+	if (!is_adapter_initialized() || !transport_is_jtag() ||
+			!adapter_driver->jtag_ops->execute_queue_submit ||
+			!adapter_driver->jtag_ops->execute_queue_complete)
+		return ERROR_NOT_IMPLEMENTED;
+
+	jtag_command_queue_optimize();
+	jtag_stats_account_queue(jtag_command_queue_get());
+
+	int64_t start = timeval_us();
+	int retval = adapter_driver->jtag_ops->execute_queue_submit(jtag_command_queue_get());
+	jtag_stats.driver_us += timeval_us() - start;
+	return retval;
+}
+
+int default_interface_jtag_complete_queue(void)
+{
+	int64_t start = timeval_us();
+	int retval = adapter_driver->jtag_ops->execute_queue_complete();
+	jtag_stats.driver_us += timeval_us() - start;
+	return retval;
+}
+
+static int jtag_driver_execute_queue(void *cmd)
+{
+	return adapter_driver->jtag_ops->execute_queue(cmd);
+}
+
 int default_interface_jtag_execute_queue(void)
 {
 	if (!is_adapter_initialized()) {
@@ -951,10 +1143,16 @@ int default_interface_jtag_execute_queue(void)
 			return ERROR_OK;
 	}
 
+	jtag_command_queue_optimize();
+
 	struct jtag_command *cmd = jtag_command_queue_get();
-	int result = adapter_driver->jtag_ops->execute_queue(cmd);
+	jtag_stats_account_queue(cmd);
+
+	int64_t start = timeval_us();
+	int result = adapter_thread_run(jtag_driver_execute_queue, cmd);
+	jtag_stats.driver_us += timeval_us() - start;
 
-	while (debug_level >= LOG_LVL_DEBUG_IO && cmd) {
+	while (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO) && cmd) {
 		switch (cmd->type) {
 			case JTAG_SCAN:
 				LOG_DEBUG_IO("JTAG %s SCAN to %s",
@@ -1018,7 +1216,23 @@ int default_interface_jtag_execute_queue(void)
 void jtag_execute_queue_noclear(void)
 {
 	jtag_flush_queue_count++;
+	jtag_stats.flushes++;
+
+	int64_t start = timeval_us();
+	if (!jtag_stats.start_us)
+		jtag_stats.start_us = start;
 	jtag_set_error(interface_jtag_execute_queue());
+	int64_t now = timeval_us();
+	if (perf_enabled)
+		perf_record(PERF_JTAG_EXECUTE_QUEUE, start, 0);
+	jtag_stats.flush_us += now - start;
+	jtag_stats.max_flush_us = MAX(jtag_stats.max_flush_us, now - start);
+
+	if (jtag_stats_log_interval_ms &&
+			now - jtag_stats_last_log_us >= jtag_stats_log_interval_ms * INT64_C(1000)) {
+		jtag_stats_log(now);
+		jtag_stats_last_log_us = now;
+	}
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -1040,6 +1254,19 @@ int jtag_execute_queue(void)
 	return jtag_error_clear();
 }
 
+int jtag_execute_queue_async(struct jtag_async **async)
+{
+	jtag_flush_queue_count++;
+	jtag_stats.flushes++;
+	return interface_jtag_execute_queue_async(async);
+}
+
+int jtag_async_wait(struct jtag_async *async)
+{
+	jtag_set_error(interface_jtag_async_wait(async));
+	return jtag_error_clear();
+}
+
 static int jtag_reset_callback(enum jtag_event event, void *priv)
 {
 	struct jtag_tap *tap = priv;
@@ -1050,6 +1277,7 @@ static int jtag_reset_callback(enum jtag_event event, void *priv)
 		/* current instruction is either BYPASS or IDCODE */
 		buf_set_ones(tap->cur_instr, tap->ir_length);
 		tap->bypass = true;
+		jtag_tap_chain_changed();
 	}
 
 	return ERROR_OK;
@@ -1081,24 +1309,74 @@ void jtag_sleep(uint32_t us)
 /* a larger IR length than we ever expect to autoprobe */
 #define JTAG_IRLEN_MAX          60
 
-static int jtag_examine_chain_execute(uint8_t *idcode_buffer, unsigned num_idcode)
+/* What the chain autoprobe captured */
+struct jtag_autoprobe {
+	/* DR scan of the IDCODE or BYPASS registers after a TAP reset */
+	uint8_t *idcodes;
+	unsigned int num_idcodes;
+	/* IR scan of the values loaded on Capture-IR */
+	uint8_t *ir_capture;
+	unsigned int ir_capture_bits;
+};
+
+static void jtag_autoprobe_free(struct jtag_autoprobe *probe)
 {
-	struct scan_field field = {
-		.num_bits = num_idcode * 32,
-		.out_value = idcode_buffer,
-		.in_value = idcode_buffer,
-	};
+	free(probe->idcodes);
+	free(probe->ir_capture);
+}
+
+/*
+ * Capture the IDCODEs and the IR capture values of the whole chain with a
+ * single flush. The TAPs autoprobed from the IDCODEs aren't known yet when
+ * the IR scan is queued, so it has room for as many of them as the IDCODE
+ * scan can find, each with an IR of up to JTAG_IRLEN_MAX bits.
+ */
+static int jtag_autoprobe_execute(struct jtag_autoprobe *probe)
+{
+	unsigned int max_taps = jtag_tap_count();
+
+	/* Autoprobe up to this many. */
+	if (max_taps < JTAG_MAX_AUTO_TAPS)
+		max_taps = JTAG_MAX_AUTO_TAPS;
+
+	/* Add room for end-of-chain marker. */
+	probe->num_idcodes = max_taps + 1;
+
+	/* increase length to add 2 bit sentinel after scan */
+	unsigned int num_taps = 0;
+	probe->ir_capture_bits = 2;
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
+		probe->ir_capture_bits += tap->ir_length ? tap->ir_length : JTAG_IRLEN_MAX;
+		num_taps++;
+	}
+	if (num_taps < probe->num_idcodes)
+		probe->ir_capture_bits += (probe->num_idcodes - num_taps) * JTAG_IRLEN_MAX;
+
+	probe->idcodes = calloc(4, probe->num_idcodes);
+	probe->ir_capture = malloc(DIV_ROUND_UP(probe->ir_capture_bits, 8));
+	if (!probe->idcodes || !probe->ir_capture) {
+		LOG_ERROR("Out of memory");
+		return ERROR_JTAG_INIT_FAILED;
+	}
 
 	/* initialize to the end of chain ID value */
-	for (unsigned i = 0; i < num_idcode; i++)
-		buf_set_u32(idcode_buffer, i * 32, 32, END_OF_CHAIN_FLAG);
+	for (unsigned int i = 0; i < probe->num_idcodes; i++)
+		buf_set_u32(probe->idcodes, i * 32, 32, END_OF_CHAIN_FLAG);
 
-	jtag_add_plain_dr_scan(field.num_bits, field.out_value, field.in_value, TAP_DRPAUSE);
+	jtag_add_plain_dr_scan(probe->num_idcodes * 32, probe->idcodes, probe->idcodes,
+		TAP_DRPAUSE);
 	jtag_add_tlr();
+
+	/* after this scan, all TAPs will capture BYPASS instructions */
+	buf_set_ones(probe->ir_capture, probe->ir_capture_bits);
+	jtag_add_plain_ir_scan(probe->ir_capture_bits, probe->ir_capture, probe->ir_capture,
+		TAP_IDLE);
+
+	LOG_DEBUG("DR scan interrogation for IDCODE/BYPASS and IR capture validation scan");
 	return jtag_execute_queue();
 }
 
-static bool jtag_examine_chain_check(uint8_t *idcodes, unsigned count)
+static bool jtag_examine_chain_check(const uint8_t *idcodes, unsigned count)
 {
 	uint8_t zero_check = 0x0;
 	uint8_t one_check = 0xff;
@@ -1158,7 +1436,7 @@ static bool jtag_idcode_is_final(uint32_t idcode)
  * with the JTAG chain earlier, gives more helpful/explicit error messages.
  * Returns TRUE iff garbage was found.
  */
-static bool jtag_examine_chain_end(uint8_t *idcodes, unsigned count, unsigned max)
+static bool jtag_examine_chain_end(const uint8_t *idcodes, unsigned count, unsigned max)
 {
 	bool triggered = false;
 	for (; count < max - 31; count += 32) {
@@ -1212,33 +1490,17 @@ static bool jtag_examine_chain_match_tap(const struct jtag_tap *tap)
 /* Try to examine chain layout according to IEEE 1149.1 §12
  * This is called a "blind interrogation" of the scan chain.
  */
-static int jtag_examine_chain(void)
+static int jtag_examine_chain(const struct jtag_autoprobe *probe)
 {
-	int retval;
-	unsigned max_taps = jtag_tap_count();
-
-	/* Autoprobe up to this many. */
-	if (max_taps < JTAG_MAX_AUTO_TAPS)
-		max_taps = JTAG_MAX_AUTO_TAPS;
-
-	/* Add room for end-of-chain marker. */
-	max_taps++;
-
-	uint8_t *idcode_buffer = calloc(4, max_taps);
-	if (!idcode_buffer)
-		return ERROR_JTAG_INIT_FAILED;
+	int retval = ERROR_OK;
+	const unsigned int max_taps = probe->num_idcodes;
+	const uint8_t *idcode_buffer = probe->idcodes;
 
-	/* DR scan to collect BYPASS or IDCODE register contents.
-	 * Then make sure the scan data has both ones and zeroes.
+	/* The DR scan collected BYPASS or IDCODE register contents.
+	 * Make sure the scan data has both ones and zeroes.
 	 */
-	LOG_DEBUG("DR scan interrogation for IDCODE/BYPASS");
-	retval = jtag_examine_chain_execute(idcode_buffer, max_taps);
-	if (retval != ERROR_OK)
-		goto out;
-	if (!jtag_examine_chain_check(idcode_buffer, max_taps)) {
-		retval = ERROR_JTAG_INIT_FAILED;
-		goto out;
-	}
+	if (!jtag_examine_chain_check(idcode_buffer, max_taps))
+		return ERROR_JTAG_INIT_FAILED;
 
 	/* Point at the 1st predefined tap, if any */
 	struct jtag_tap *tap = jtag_tap_next_enabled(NULL);
@@ -1261,10 +1523,8 @@ static int jtag_examine_chain(void)
 			 * share it with jim_newtap_cmd().
 			 */
 			tap = calloc(1, sizeof(*tap));
-			if (!tap) {
-				retval = ERROR_FAIL;
-				goto out;
-			}
+			if (!tap)
+				return ERROR_FAIL;
 
 			tap->chip = alloc_printf("auto%u", autocount++);
 			tap->tapname = strdup("tap");
@@ -1308,15 +1568,12 @@ static int jtag_examine_chain(void)
 	 */
 	if (jtag_examine_chain_end(idcode_buffer, bit_count, max_taps * 32)) {
 		LOG_ERROR("double-check your JTAG setup (interface, speed, ...)");
-		retval = ERROR_JTAG_INIT_FAILED;
-		goto out;
+		return ERROR_JTAG_INIT_FAILED;
 	}
 
 	/* Return success or, for backwards compatibility if only
 	 * some IDCODE values mismatched, a soft/continuable fault.
 	 */
-out:
-	free(idcode_buffer);
 	return retval;
 }
 
@@ -1328,46 +1585,13 @@ out:
  * Entry state can be anything.  On non-error exit, all TAPs are in
  * bypass mode.  On error exits, the scan chain is reset.
  */
-static int jtag_validate_ircapture(void)
+static int jtag_validate_ircapture(const struct jtag_autoprobe *probe)
 {
-	struct jtag_tap *tap;
-	uint8_t *ir_test = NULL;
-	struct scan_field field;
+	struct jtag_tap *tap = NULL;
+	const uint8_t *ir_test = probe->ir_capture;
+	const int total_ir_length = probe->ir_capture_bits;
 	int chain_pos = 0;
-	int retval;
-
-	/* when autoprobing, accommodate huge IR lengths */
-	int total_ir_length = 0;
-	for (tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
-		if (tap->ir_length == 0)
-			total_ir_length += JTAG_IRLEN_MAX;
-		else
-			total_ir_length += tap->ir_length;
-	}
-
-	/* increase length to add 2 bit sentinel after scan */
-	total_ir_length += 2;
-
-	ir_test = malloc(DIV_ROUND_UP(total_ir_length, 8));
-	if (!ir_test)
-		return ERROR_FAIL;
-
-	/* after this scan, all TAPs will capture BYPASS instructions */
-	buf_set_ones(ir_test, total_ir_length);
-
-	field.num_bits = total_ir_length;
-	field.out_value = ir_test;
-	field.in_value = ir_test;
-
-	jtag_add_plain_ir_scan(field.num_bits, field.out_value, field.in_value, TAP_IDLE);
-
-	LOG_DEBUG("IR capture validation scan");
-	retval = jtag_execute_queue();
-	if (retval != ERROR_OK)
-		goto done;
-
-	tap = NULL;
-	chain_pos = 0;
+	int retval = ERROR_OK;
 
 	for (;; ) {
 		tap = jtag_tap_next_enabled(tap);
@@ -1435,7 +1659,6 @@ static int jtag_validate_ircapture(void)
 	}
 
 done:
-	free(ir_test);
 	if (retval != ERROR_OK) {
 		jtag_add_tlr();
 		jtag_execute_queue();
@@ -1455,6 +1678,8 @@ void jtag_tap_init(struct jtag_tap *tap)
 	tap->expected = calloc(1, ir_len_bytes);
 	tap->expected_mask = calloc(1, ir_len_bytes);
 	tap->cur_instr = malloc(ir_len_bytes);
+	tap->bypass_instr = malloc(ir_len_bytes);
+	tap->bypass_instr_len = -1;
 
 	/** @todo cope better with ir_length bigger than 32 bits */
 	if (ir_len_bits > 32)
@@ -1481,6 +1706,7 @@ void jtag_tap_init(struct jtag_tap *tap)
 void jtag_tap_free(struct jtag_tap *tap)
 {
 	jtag_unregister_event_callback(&jtag_reset_callback, tap);
+	jtag_tap_chain_changed();
 
 	struct jtag_tap_event_action *jteap = tap->event_action;
 	while (jteap) {
@@ -1494,6 +1720,7 @@ void jtag_tap_free(struct jtag_tap *tap)
 	free(tap->expected_mask);
 	free(tap->expected_ids);
 	free(tap->cur_instr);
+	free(tap->bypass_instr);
 	free(tap->chip);
 	free(tap->tapname);
 	free(tap->dotted_name);
@@ -1527,16 +1754,20 @@ int jtag_init_inner(struct command_context *cmd_ctx)
 		/* REVISIT default clock will often be too fast ... */
 	}
 
+	/* Capture the DR and IR values of the chain in one go. */
+	struct jtag_autoprobe probe = { 0 };
 	jtag_add_tlr();
-	retval = jtag_execute_queue();
-	if (retval != ERROR_OK)
+	retval = jtag_autoprobe_execute(&probe);
+	if (retval != ERROR_OK) {
+		jtag_autoprobe_free(&probe);
 		return retval;
+	}
 
 	/* Examine DR values first.  This discovers problems which will
 	 * prevent communication ... hardware issues like TDO stuck, or
 	 * configuring the wrong number of (enabled) TAPs.
 	 */
-	retval = jtag_examine_chain();
+	retval = jtag_examine_chain(&probe);
 	switch (retval) {
 		case ERROR_OK:
 			/* complete success */
@@ -1562,7 +1793,8 @@ int jtag_init_inner(struct command_context *cmd_ctx)
 	 * latter is uncommon, but easily worked around:  provide
 	 * ircapture/irmask values during TAP setup.)
 	 */
-	retval = jtag_validate_ircapture();
+	retval = jtag_validate_ircapture(&probe);
+	jtag_autoprobe_free(&probe);
 	if (retval != ERROR_OK) {
 		/* The target might be powered down. The user
 		 * can power it up and reset it after firing
@@ -1707,6 +1939,17 @@ bool jtag_will_verify_capture_ir(void)
 	return jtag_verify_capture_ir;
 }
 
+void jtag_set_ir_cache(bool enable)
+{
+	jtag_ir_cache_enabled = enable;
+	jtag_ir_cache_valid = false;
+}
+
+bool jtag_get_ir_cache(void)
+{
+	return jtag_ir_cache_enabled;
+}
+
 int jtag_power_dropout(int *dropout)
 {
 	if (!is_adapter_initialized()) {
@@ -1804,6 +2047,11 @@ static int jtag_select(struct command_context *ctx)
 
 	retval = xsvf_register_commands(ctx);
 
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = bscan_register_commands(ctx);
+
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -223,6 +223,33 @@ static int am335xgpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+static int am335xgpio_shift(const struct bitbang_shift *shift)
+{
+	const struct adapter_gpio_config *tdi_gpio = &adapter_gpio_config[ADAPTER_GPIO_IDX_TDI];
+	const struct adapter_gpio_config *tms_gpio = &adapter_gpio_config[ADAPTER_GPIO_IDX_TMS];
+	const struct adapter_gpio_config *tck_gpio = &adapter_gpio_config[ADAPTER_GPIO_IDX_TCK];
+	const struct adapter_gpio_config *tdo_gpio = &adapter_gpio_config[ADAPTER_GPIO_IDX_TDO];
+
+	for (unsigned int i = 0; i < shift->num_bits; i++) {
+		/* same as am335xgpio_write(0, tms, tdi) */
+		set_gpio_value(tdi_gpio, bitbang_shift_tdi(shift, i));
+		set_gpio_value(tms_gpio, bitbang_shift_tms(shift, i));
+		set_gpio_value(tck_gpio, 0);
+		for (unsigned int j = 0; j < jtag_delay; ++j)
+			asm volatile ("");
+
+		if (shift->tdo)
+			bitbang_shift_set_tdo(shift, i, get_gpio_value(tdo_gpio));
+
+		/* TDI and TMS keep their levels for am335xgpio_write(1, tms, tdi) */
+		set_gpio_value(tck_gpio, 1);
+		for (unsigned int j = 0; j < jtag_delay; ++j)
+			asm volatile ("");
+	}
+
+	return ERROR_OK;
+}
+
 static int am335xgpio_swd_write(int swclk, int swdio)
 {
 	set_gpio_value(&adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO], swdio);
@@ -286,6 +313,7 @@ static int am335xgpio_blink(int on)
 static struct bitbang_interface am335xgpio_bitbang = {
 	.read = am335xgpio_read,
 	.write = am335xgpio_write,
+	.shift = am335xgpio_shift,
 	.swdio_read = am335xgpio_swdio_read,
 	.swdio_drive = am335xgpio_swdio_drive,
 	.swd_write = am335xgpio_swd_write,
@@ -196,6 +196,36 @@ static int bcm2835gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+static int bcm2835gpio_shift(const struct bitbang_shift *shift)
+{
+	uint32_t tck_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_TCK].gpio_num;
+	uint32_t tms_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_TMS].gpio_num;
+	uint32_t tdi_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_TDI].gpio_num;
+	unsigned int tdo_shift = adapter_gpio_config[ADAPTER_GPIO_IDX_TDO].gpio_num;
+	uint32_t tdo_xor = adapter_gpio_config[ADAPTER_GPIO_IDX_TDO].active_low ? 1 : 0;
+
+	for (unsigned int i = 0; i < shift->num_bits; i++) {
+		uint32_t set = (bitbang_shift_tms(shift, i) ? tms_mask : 0) |
+				(bitbang_shift_tdi(shift, i) ? tdi_mask : 0);
+
+		/* same as bcm2835gpio_write(0, tms, tdi) */
+		GPIO_SET = set;
+		GPIO_CLR = tck_mask | (~set & (tms_mask | tdi_mask));
+		bcm2835_gpio_synchronize();
+		bcm2835_delay();
+
+		if (shift->tdo)
+			bitbang_shift_set_tdo(shift, i, ((GPIO_LEV >> tdo_shift) & 1) ^ tdo_xor);
+
+		/* only TCK changes for bcm2835gpio_write(1, tms, tdi) */
+		GPIO_SET = tck_mask;
+		bcm2835_gpio_synchronize();
+		bcm2835_delay();
+	}
+
+	return ERROR_OK;
+}
+
 /* Requires push-pull drive mode for swclk and swdio */
 static int bcm2835gpio_swd_write_fast(int swclk, int swdio)
 {
@@ -419,6 +449,7 @@ static int bcm2835gpio_blink(int on)
 static struct bitbang_interface bcm2835gpio_bitbang = {
 	.read = bcm2835gpio_read,
 	.write = bcm2835gpio_write,
+	.shift = bcm2835gpio_shift,
 	.swdio_read = bcm2835_swdio_read,
 	.swdio_drive = bcm2835_swdio_drive,
 	.swd_write = bcm2835gpio_swd_write_generic,
@@ -39,6 +39,74 @@ static void bitbang_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay
 
 struct bitbang_interface *bitbang_interface;
 
+/* A scan whose TDO samples are still buffered by the interface. With a
+ * buffering interface the samples are only read back when the buffer is
+ * full or the queue ends, so that several scans share one round trip. */
+struct bitbang_pending_scan {
+	struct jtag_command *cmd;
+	uint8_t *buffer;
+	unsigned int scan_size;
+	/* samples read back so far */
+	unsigned int read_bits;
+	struct bitbang_pending_scan *next;
+};
+
+static struct bitbang_pending_scan *bitbang_pending_head;
+static struct bitbang_pending_scan *bitbang_pending_tail;
+/* samples requested with sample() and not yet read back */
+static size_t bitbang_pending_samples;
+/* error from jtag_read_buffer() for a scan completed while draining */
+static int bitbang_pending_retval;
+
+static void bitbang_pending_pop(void)
+{
+	struct bitbang_pending_scan *scan = bitbang_pending_head;
+
+	bitbang_pending_head = scan->next;
+	if (!bitbang_pending_head)
+		bitbang_pending_tail = NULL;
+	free(scan->buffer);
+	free(scan);
+}
+
+static void bitbang_pending_discard(void)
+{
+	while (bitbang_pending_head)
+		bitbang_pending_pop();
+	bitbang_pending_samples = 0;
+}
+
+/* Read back all buffered samples. Scans whose samples are all in are
+ * handed to jtag_read_buffer(). */
+static int bitbang_pending_drain(void)
+{
+	while (bitbang_pending_samples) {
+		struct bitbang_pending_scan *scan = bitbang_pending_head;
+		assert(scan && scan->read_bits < scan->scan_size);
+
+		unsigned int i = scan->read_bits;
+		switch (bitbang_interface->read_sample()) {
+			case BB_LOW:
+				scan->buffer[i / 8] &= ~(1 << (i % 8));
+				break;
+			case BB_HIGH:
+				scan->buffer[i / 8] |= 1 << (i % 8);
+				break;
+			default:
+				return ERROR_FAIL;
+		}
+		bitbang_pending_samples--;
+
+		if (++scan->read_bits == scan->scan_size) {
+			if (jtag_read_buffer(scan->buffer, scan->cmd->cmd.scan) != ERROR_OK)
+				bitbang_pending_retval = ERROR_JTAG_QUEUE_FAILED;
+			bitbang_pending_pop();
+		}
+	}
+
+	return ERROR_OK;
+}
+
 /* DANGER!!!! clock absolutely *MUST* be 0 in idle or reset won't work!
  *
  * Set this to 1 and str912 reset halt will fail.
@@ -59,6 +127,21 @@ struct bitbang_interface *bitbang_interface;
  */
 #define CLOCK_IDLE() 0
 
+/* Try the shift() fast path of the interface. Returns ERROR_NOT_IMPLEMENTED
+ * if the caller has to clock the bits with write() itself. */
+static int bitbang_fast_shift(const struct bitbang_shift *shift)
+{
+	if (!bitbang_interface->shift || !shift->num_bits)
+		return ERROR_NOT_IMPLEMENTED;
+	if (shift->tdo && bitbang_interface->buf_size)
+		return ERROR_NOT_IMPLEMENTED;
+
+	int retval = bitbang_interface->shift(shift);
+	if (retval != ERROR_OK && retval != ERROR_NOT_IMPLEMENTED)
+		return ERROR_FAIL;
+	return retval;
+}
+
 /* The bitbang driver leaves the TCK 0 when in idle */
 static void bitbang_end_state(tap_state_t state)
 {
@@ -161,7 +244,11 @@ static int bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
+	const struct bitbang_shift shift = { .num_bits = num_cycles };
+	int retval = bitbang_fast_shift(&shift);
+	if (retval == ERROR_FAIL)
+		return ERROR_FAIL;
+	for (i = 0; retval != ERROR_OK && i < num_cycles; i++) {
 		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
 			return ERROR_FAIL;
 		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
@@ -214,8 +301,18 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		bitbang_end_state(saved_end_state);
 	}
 
-	size_t buffered = 0;
-	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
+	const struct bitbang_shift shift = {
+		.num_bits = scan_size,
+		.tdi = type != SCAN_IN ? buffer : NULL,
+		.tdo = type != SCAN_OUT ? buffer : NULL,
+		.tms = false,
+		.tms_last = true,
+	};
+	int retval = bitbang_fast_shift(&shift);
+	if (retval == ERROR_FAIL)
+		return ERROR_FAIL;
+
+	for (bit_cnt = 0; retval != ERROR_OK && bit_cnt < scan_size; bit_cnt++) {
 		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
 		int tdi;
 		int bytec = bit_cnt/8;
@@ -236,7 +333,7 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 			if (bitbang_interface->buf_size) {
 				if (bitbang_interface->sample() != ERROR_OK)
 					return ERROR_FAIL;
-				buffered++;
+				bitbang_pending_samples++;
 			} else {
 				switch (bitbang_interface->read()) {
 					case BB_LOW:
@@ -254,22 +351,10 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
 			return ERROR_FAIL;
 
-		if (type != SCAN_OUT && bitbang_interface->buf_size &&
-				(buffered == bitbang_interface->buf_size ||
-				 bit_cnt == scan_size - 1)) {
-			for (unsigned i = bit_cnt + 1 - buffered; i <= bit_cnt; i++) {
-				switch (bitbang_interface->read_sample()) {
-					case BB_LOW:
-						buffer[i/8] &= ~(1 << (i % 8));
-						break;
-					case BB_HIGH:
-						buffer[i/8] |= 1 << (i % 8);
-						break;
-					default:
-						return ERROR_FAIL;
-				}
-			}
-			buffered = 0;
+		if (bitbang_pending_samples == bitbang_interface->buf_size &&
+				bitbang_pending_samples) {
+			if (bitbang_pending_drain() != ERROR_OK)
+				return ERROR_FAIL;
 		}
 	}
 
@@ -311,6 +396,10 @@ int bitbang_execute_queue(struct jtag_command *cmd_queue)
 	 */
 	retval = ERROR_OK;
 
+	/* left over if the previous queue failed half way */
+	bitbang_pending_discard();
+	bitbang_pending_retval = ERROR_OK;
+
 	if (bitbang_interface->blink) {
 		if (bitbang_interface->blink(1) != ERROR_OK)
 			return ERROR_FAIL;
@@ -357,6 +446,29 @@ int bitbang_execute_queue(struct jtag_command *cmd_queue)
 						scan_size,
 					tap_state_name(cmd->cmd.scan->end_state));
 				type = jtag_scan_type(cmd->cmd.scan);
+				if (type != SCAN_OUT && bitbang_interface->buf_size && scan_size > 0) {
+					/* completed by bitbang_pending_drain() */
+					struct bitbang_pending_scan *pending = malloc(sizeof(*pending));
+					if (!pending) {
+						free(buffer);
+						return ERROR_FAIL;
+					}
+					*pending = (struct bitbang_pending_scan){
+						.cmd = cmd,
+						.buffer = buffer,
+						.scan_size = scan_size,
+					};
+					if (bitbang_pending_tail)
+						bitbang_pending_tail->next = pending;
+					else
+						bitbang_pending_head = pending;
+					bitbang_pending_tail = pending;
+
+					if (bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer,
+								scan_size) != ERROR_OK)
+						return ERROR_FAIL;
+					break;
+				}
 				if (bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer,
 							scan_size) != ERROR_OK)
 					return ERROR_FAIL;
@@ -379,6 +491,15 @@ int bitbang_execute_queue(struct jtag_command *cmd_queue)
 		}
 		cmd = cmd->next;
 	}
+
+	if (bitbang_pending_drain() != ERROR_OK) {
+		bitbang_pending_discard();
+		return ERROR_FAIL;
+	}
+	if (bitbang_pending_retval != ERROR_OK)
+		retval = bitbang_pending_retval;
+	bitbang_pending_retval = ERROR_OK;
+
 	if (bitbang_interface->blink) {
 		if (bitbang_interface->blink(0) != ERROR_OK)
 			return ERROR_FAIL;
@@ -20,6 +20,44 @@ typedef enum {
 	BB_ERROR
 } bb_value_t;
 
+/** A run of TCK cycles for bitbang_interface.shift().
+ *
+ * Every cycle presents TMS and TDI with TCK low, samples TDO and raises TCK,
+ * like the write(0, ...), read(), write(1, ...) sequence of the generic
+ * code. TMS is run-length encoded: it is @a tms for all cycles but the last
+ * one, which gets @a tms_last. That covers scans (0...01) and clocking in a
+ * stable state (constant). */
+struct bitbang_shift {
+	unsigned int num_bits;
+	/** TDI bits, LSB first, or NULL to keep TDI low. */
+	const uint8_t *tdi;
+	/** Where to store the TDO bits, or NULL to not sample TDO. May be the
+	 * same buffer as @a tdi, bit i of TDI is consumed before bit i of TDO is
+	 * stored. */
+	uint8_t *tdo;
+	bool tms;
+	bool tms_last;
+};
+
+static inline bool bitbang_shift_tms(const struct bitbang_shift *shift, unsigned int i)
+{
+	return i == shift->num_bits - 1 ? shift->tms_last : shift->tms;
+}
+
+static inline bool bitbang_shift_tdi(const struct bitbang_shift *shift, unsigned int i)
+{
+	return shift->tdi && (shift->tdi[i / 8] & (1 << (i % 8)));
+}
+
+static inline void bitbang_shift_set_tdo(const struct bitbang_shift *shift, unsigned int i,
+		bool value)
+{
+	if (value)
+		shift->tdo[i / 8] |= 1 << (i % 8);
+	else
+		shift->tdo[i / 8] &= ~(1 << (i % 8));
+}
+
 /** Low level callbacks (for bitbang).
  *
  * Either read(), or sample() and read_sample() must be implemented.
@@ -32,7 +70,9 @@ struct bitbang_interface {
 	bb_value_t (*read)(void);
 
 	/** The number of TDO samples that can be buffered up before the caller has
-	 * to call read_sample. */
+	 * to call read_sample. Samples are collected across scans and only read
+	 * back once this many are pending or the queue ends. The value is read
+	 * for every sample, so the interface may change it between queues. */
 	size_t buf_size;
 
 	/** Sample TDO and put the result in a buffer. */
@@ -44,6 +84,12 @@ struct bitbang_interface {
 	/** Set TCK, TMS, and TDI to the given values. */
 	int (*write)(int tck, int tms, int tdi);
 
+	/** Clock a whole run of bits in one call (optional). TCK is left high,
+	 * as after the last write(1, ...). Interfaces with buf_size are only
+	 * asked for runs without TDO, their samples go through sample(). May
+	 * return ERROR_NOT_IMPLEMENTED to fall back to write() and read(). */
+	int (*shift)(const struct bitbang_shift *shift);
+
 	/** Blink led (optional). */
 	int (*blink)(int on);
 
@@ -76,6 +76,23 @@ static void bitq_io(int tms, int tdi, int tdo_req)
 		bitq_in_proc();
 }
 
+/* clock num_bits bits with TMS low */
+static void bitq_io_bits(const uint8_t *tdi, int num_bits, int tdo_req)
+{
+	if (num_bits <= 0)
+		return;
+
+	if (bitq_interface->out_bits) {
+		bitq_interface->out_bits(tdi, num_bits, tdo_req);
+		if (bitq_interface->in_rdy())
+			bitq_in_proc();
+		return;
+	}
+
+	for (int i = 0; i < num_bits; i++)
+		bitq_io(0, tdi ? (tdi[i / 8] >> (i % 8)) & 1 : 0, tdo_req);
+}
+
 static void bitq_end_state(tap_state_t state)
 {
 	if (!tap_is_state_stable(state)) {
@@ -129,15 +146,12 @@ static void bitq_path_move(struct pathmove_command *cmd)
 
 static void bitq_runtest(int num_cycles)
 {
-	int i;
-
 	/* only do a state_move when we're not already in IDLE */
 	if (tap_get_state() != TAP_IDLE)
 		bitq_state_move(TAP_IDLE);
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++)
-		bitq_io(0, 0, 0);
+	bitq_io_bits(NULL, num_cycles, 0);
 
 	/* finish in end_state */
 	if (tap_get_state() != tap_get_end_state())
@@ -146,38 +160,21 @@ static void bitq_runtest(int num_cycles)
 
 static void bitq_scan_field(struct scan_field *field, int do_pause)
 {
-	int bit_cnt;
 	int tdo_req;
-
-	const uint8_t *out_ptr;
-	uint8_t  out_mask;
+	int last = field->num_bits > 0 ? field->num_bits - 1 : 0;
 
 	if (field->in_value)
 		tdo_req = 1;
 	else
 		tdo_req = 0;
 
-	if (!field->out_value) {
-		/* just send zeros and request data from TDO */
-		for (bit_cnt = field->num_bits; bit_cnt > 1; bit_cnt--)
-			bitq_io(0, 0, tdo_req);
+	/* all bits but the last one with TMS low, zeros if there is no out_value */
+	bitq_io_bits(field->out_value, last, tdo_req);
 
+	if (!field->out_value)
 		bitq_io(do_pause, 0, tdo_req);
-	} else {
-		/* send data, and optionally request TDO */
-		out_mask = 0x01;
-		out_ptr  = field->out_value;
-		for (bit_cnt = field->num_bits; bit_cnt > 1; bit_cnt--) {
-			bitq_io(0, ((*out_ptr) & out_mask) != 0, tdo_req);
-			if (out_mask == 0x80) {
-				out_mask = 0x01;
-				out_ptr++;
-			} else
-				out_mask <<= 1;
-		}
-
-		bitq_io(do_pause, ((*out_ptr) & out_mask) != 0, tdo_req);
-	}
+	else
+		bitq_io(do_pause, (field->out_value[last / 8] >> (last % 8)) & 1, tdo_req);
 
 	if (do_pause) {
 		bitq_io(0, 0, 0);
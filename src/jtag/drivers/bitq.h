@@ -13,6 +13,10 @@
 struct bitq_interface {
 	/* function to enqueueing low level IO requests */
 	int (*out)(int tms, int tdi, int tdo_req);
+	/* optional, clock num_bits with TMS low and TDI from tdi (zeros if NULL),
+	 * same as calling out() for each bit
+	 */
+	int (*out_bits)(const uint8_t *tdi, unsigned int num_bits, int tdo_req);
 	int (*flush)(void);
 
 	int (*sleep)(unsigned long us);
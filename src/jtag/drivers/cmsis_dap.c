@@ -68,6 +68,8 @@ static uint16_t cmsis_dap_vid[MAX_USB_IDS + 1] = { 0 };
 static uint16_t cmsis_dap_pid[MAX_USB_IDS + 1] = { 0 };
 static int cmsis_dap_backend = -1;
 static bool swd_mode;
+/* limit of requests in flight, 0 for the adapter's packet count */
+static unsigned int cmsis_dap_queue_depth;
 
 /* CMSIS-DAP General Commands */
 #define CMD_DAP_INFO              0x00
@@ -165,6 +167,12 @@ static bool swd_mode;
  * Prevent using it until we have at least r/w operations. */
 #define CMD_DAP_TFER_BLOCK_MIN_OPS 4
 
+/* A run of at least this many equal r/w operations, e.g. the DRW accesses
+ * of a MEM-AP block transfer, is sent as a DAP_TransferBlock packet of its
+ * own rather than in a DAP_Transfer mixed with other operations, if the
+ * pipeline has room for the extra packet. */
+#define CMD_DAP_TFER_BLOCK_SPLIT_OPS 8
+
 /* DAP Status Code */
 #define DAP_OK                    0
 #define DAP_ERROR                 0xFF
@@ -990,6 +998,88 @@ skip:
 	dap->pending_fifo_block_count--;
 }
 
+/* Another packet can be sent before the one being filled */
+static bool cmsis_dap_swd_can_split(struct cmsis_dap *dap)
+{
+	return !dap->quirk_mode && dap->packet_count > 1
+		&& dap->pending_fifo_block_count + 1 < dap->packet_count;
+}
+
+/* Recompute the packet size counters and the common operation of a block */
+static void cmsis_dap_swd_recount(struct cmsis_dap *dap, const struct pending_request_block *block)
+{
+	dap->write_count = 0;
+	dap->read_count = 0;
+	dap->swd_cmds_differ = false;
+	dap->common_swd_cmd = block->transfers[0].cmd;
+
+	for (unsigned int i = 0; i < block->transfer_count; i++) {
+		uint8_t cmd = block->transfers[i].cmd;
+
+		if (cmd & SWD_CMD_RNW)
+			dap->read_count++;
+		else
+			dap->write_count++;
+		if (cmd != dap->common_swd_cmd)
+			dap->swd_cmds_differ = true;
+	}
+}
+
+/* Send the block being filled. If it ends in a long run of equal operations,
+ * send only what's before the run and keep the run as the start of the next
+ * block, which can then become a DAP_TransferBlock. */
+static void cmsis_dap_swd_write_from_queue_split(struct cmsis_dap *dap)
+{
+	struct pending_request_block *block = &dap->pending_fifo[dap->pending_fifo_put_idx];
+
+	if (!dap->swd_cmds_differ || !cmsis_dap_swd_can_split(dap)) {
+		cmsis_dap_swd_write_from_queue(dap);
+		return;
+	}
+
+	uint8_t cmd = block->transfers[block->transfer_count - 1].cmd;
+	unsigned int run = 1;
+	while (run < block->transfer_count
+			&& block->transfers[block->transfer_count - 1 - run].cmd == cmd)
+		run++;
+
+	if (run < CMD_DAP_TFER_BLOCK_SPLIT_OPS) {
+		cmsis_dap_swd_write_from_queue(dap);
+		return;
+	}
+
+	struct pending_request_block *next =
+		&dap->pending_fifo[(dap->pending_fifo_put_idx + 1) % dap->packet_count];
+	memcpy(next->transfers, &block->transfers[block->transfer_count - run],
+		run * sizeof(*next->transfers));
+	block->transfer_count -= run;
+	cmsis_dap_swd_recount(dap, block);
+
+	cmsis_dap_swd_write_from_queue(dap);
+	if (queued_retval != ERROR_OK)
+		return;
+
+	/* the put index moved on to 'next' */
+	next->transfer_count = run;
+	cmsis_dap_swd_recount(dap, next);
+}
+
+/* Send the block being filled and make room for the next one */
+static void cmsis_dap_swd_flush_block(struct cmsis_dap *dap, bool split)
+{
+	if (dap->pending_fifo_block_count)
+		cmsis_dap_swd_read_process(dap, CMSIS_DAP_NON_BLOCKING);
+
+	if (split)
+		cmsis_dap_swd_write_from_queue_split(dap);
+	else
+		cmsis_dap_swd_write_from_queue(dap);
+
+	unsigned int packet_count = dap->quirk_mode ? 1 : dap->packet_count;
+	if (dap->pending_fifo_block_count >= packet_count)
+		cmsis_dap_swd_read_process(dap, CMSIS_DAP_BLOCKING);
+}
+
 static int cmsis_dap_swd_run_queue(void)
 {
 	if (cmsis_dap_handle->write_count + cmsis_dap_handle->read_count) {
@@ -1039,18 +1129,10 @@ static unsigned int cmsis_dap_tfer_resp_size(unsigned int write_count,
 	return size;
 }
 
-static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
+/* Do the DAP Transfer command and also its expected response for all queued
+ * and this operation fit into one packet? */
+static bool cmsis_dap_swd_cmd_fits(uint8_t cmd)
 {
-	/* TARGETSEL register write cannot be queued */
-	if (swd_cmd(false, false, DP_TARGETSEL) == cmd) {
-		queued_retval = cmsis_dap_swd_run_queue();
-
-		cmsis_dap_metacmd_targetsel(data);
-		return;
-	}
-
-	/* Compute sizes of the DAP Transfer command and the expected response
-	 * for all queued and this operation */
 	unsigned int write_count = cmsis_dap_handle->write_count;
 	unsigned int read_count = cmsis_dap_handle->read_count;
 	bool block_cmd;
@@ -1071,19 +1153,34 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 													block_cmd);
 	unsigned int max_transfer_count = block_cmd ? 65535 : 255;
 
-	/* Does the DAP Transfer command and also its expected response fit into one packet? */
-	if (cmd_size > tfer_max_command_size
-			|| resp_size > tfer_max_response_size
-			|| write_count + read_count > max_transfer_count) {
-		if (cmsis_dap_handle->pending_fifo_block_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_NON_BLOCKING);
+	return cmd_size <= tfer_max_command_size
+		&& resp_size <= tfer_max_response_size
+		&& write_count + read_count <= max_transfer_count;
+}
+
+static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
+{
+	/* TARGETSEL register write cannot be queued */
+	if (swd_cmd(false, false, DP_TARGETSEL) == cmd) {
+		queued_retval = cmsis_dap_swd_run_queue();
+
+		cmsis_dap_metacmd_targetsel(data);
+		return;
+	}
 
+	if (!cmsis_dap_swd_cmd_fits(cmd)) {
 		/* Not enough room in the queue. Run the queue. */
-		cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
+		cmsis_dap_swd_flush_block(cmsis_dap_handle, true);
 
-		unsigned int packet_count = cmsis_dap_handle->quirk_mode ? 1 : cmsis_dap_handle->packet_count;
-		if (cmsis_dap_handle->pending_fifo_block_count >= packet_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_BLOCKING);
+		/* a run kept for the next block may still leave no room */
+		if (queued_retval == ERROR_OK && !cmsis_dap_swd_cmd_fits(cmd))
+			cmsis_dap_swd_flush_block(cmsis_dap_handle, false);
+	} else if (cmsis_dap_handle->write_count + cmsis_dap_handle->read_count >= CMD_DAP_TFER_BLOCK_SPLIT_OPS
+			&& !cmsis_dap_handle->swd_cmds_differ
+			&& cmd != cmsis_dap_handle->common_swd_cmd
+			&& cmsis_dap_swd_can_split(cmsis_dap_handle)) {
+		/* Keep a long run of equal operations a DAP_TransferBlock */
+		cmsis_dap_swd_flush_block(cmsis_dap_handle, false);
 	}
 
 	assert(cmsis_dap_handle->pending_fifo[cmsis_dap_handle->pending_fifo_put_idx].transfer_count < pending_queue_len);
@@ -1393,6 +1490,9 @@ static int cmsis_dap_init(void)
 		LOG_DEBUG("CMSIS-DAP: Packet Count = %u", pkt_cnt);
 	}
 
+	if (cmsis_dap_queue_depth && cmsis_dap_queue_depth < cmsis_dap_handle->packet_count)
+		cmsis_dap_handle->packet_count = cmsis_dap_queue_depth;
+
 	LOG_DEBUG("Allocating FIFO for %u pending packets", cmsis_dap_handle->packet_count);
 	for (unsigned int i = 0; i < cmsis_dap_handle->packet_count; i++) {
 		cmsis_dap_handle->pending_fifo[i].transfers = malloc(pending_queue_len
@@ -2223,6 +2323,28 @@ COMMAND_HANDLER(cmsis_dap_handle_backend_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_queue_depth_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int depth;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], depth);
+		if (depth > MAX_PENDING_REQUESTS) {
+			command_print(CMD, "queue depth is limited to %d", MAX_PENDING_REQUESTS);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		cmsis_dap_queue_depth = depth;
+	}
+
+	if (cmsis_dap_queue_depth)
+		command_print(CMD, "CMSIS-DAP queue depth %u", cmsis_dap_queue_depth);
+	else
+		command_print(CMD, "CMSIS-DAP queue depth from adapter packet count");
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(cmsis_dap_handle_quirk_command)
 {
 	if (CMD_ARGC > 1)
@@ -2265,6 +2387,13 @@ static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 		.help = "set the communication backend to use (USB bulk or HID).",
 		.usage = "(auto | usb_bulk | hid)",
 	},
+	{
+		.name = "queue_depth",
+		.handler = &cmsis_dap_handle_queue_depth_command,
+		.mode = COMMAND_CONFIG,
+		.help = "limit the number of requests in flight, 0 uses the adapter packet count.",
+		.usage = "[depth]",
+	},
 	{
 		.name = "quirk",
 		.handler = &cmsis_dap_handle_quirk_command,
@@ -15,8 +15,9 @@ struct pending_transfer_result {
 };
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
- * until the first response arrives */
-#define MAX_PENDING_REQUESTS 4
+ * until the first response arrives, packet_count may be further limited
+ * by "cmsis-dap queue_depth" */
+#define MAX_PENDING_REQUESTS 32
 
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
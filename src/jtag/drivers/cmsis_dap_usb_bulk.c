@@ -574,6 +574,24 @@ static int cmsis_dap_usb_write(struct cmsis_dap *dap, int txlen, int timeout_ms)
 		return ERROR_FAIL;
 	}
 
+	/* Queue the read of the response right away. Each response is a
+	 * single packet, so the reads complete in the order of the commands
+	 * and the adapter never waits for the host before it can answer. */
+	struct cmsis_dap_bulk_transfer *tr_rsp;
+	tr_rsp = &dap->bdata->response_transfers[dap->pending_fifo_put_idx];
+	if (tr_rsp->status == CMSIS_DAP_TRANSFER_IDLE) {
+		libusb_fill_bulk_transfer(tr_rsp->transfer,
+								  dap->bdata->dev_handle, dap->bdata->ep_in,
+								  tr_rsp->buffer, dap->packet_size,
+								  &cmsis_dap_usb_callback, tr_rsp,
+								  timeout_ms);
+		LOG_DEBUG_IO("submit read @ %u", dap->pending_fifo_put_idx);
+		tr_rsp->status = CMSIS_DAP_TRANSFER_PENDING;
+		/* on failure cmsis_dap_usb_read() submits it again */
+		if (libusb_submit_transfer(tr_rsp->transfer))
+			tr_rsp->status = CMSIS_DAP_TRANSFER_IDLE;
+	}
+
 	return ERROR_OK;
 }
 
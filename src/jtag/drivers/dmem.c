@@ -218,6 +218,63 @@ static int dmem_emu_ap_q_write(unsigned int ap_idx, unsigned int reg, uint32_t d
 	return ret;
 }
 
+/*
+ * The memory behind emulated APs is mapped, so bursts are copied directly
+ * instead of emulating every DRW access. The emulated TAR and CSW are left
+ * alone, they match what arm_adi_v5 has cached.
+ */
+static volatile uint32_t *dmem_emu_mem_ap_buf(struct adiv5_ap *ap, uint32_t size,
+		uint32_t count, target_addr_t address)
+{
+	unsigned int idx;
+
+	/* Emulated APs only support 32-bit accesses */
+	if (size != 4 || address % 4 || !dmem_is_emulated_ap(ap, &idx))
+		return NULL;
+
+	address &= ~ARM_APB_PADDR31;
+	if (address + (uint64_t)count * 4 > dmem_emu_size)
+		return NULL;
+
+	return (volatile uint32_t *)((uintptr_t)dmem_emu_virt_base_addr + address);
+}
+
+static int dmem_dp_run(struct adiv5_dap *dap);
+
+static int dmem_emu_mem_ap_read_buf(struct adiv5_ap *ap, uint8_t *buffer,
+		uint32_t size, uint32_t count, target_addr_t address)
+{
+	volatile uint32_t *src = dmem_emu_mem_ap_buf(ap, size, count, address);
+	if (!src)
+		return ERROR_NOT_IMPLEMENTED;
+
+	int retval = dmem_dp_run(ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (uint32_t i = 0; i < count; i++)
+		h_u32_to_le(buffer + 4 * i, src[i]);
+
+	return ERROR_OK;
+}
+
+static int dmem_emu_mem_ap_write_buf(struct adiv5_ap *ap, const uint8_t *buffer,
+		uint32_t size, uint32_t count, target_addr_t address)
+{
+	volatile uint32_t *dst = dmem_emu_mem_ap_buf(ap, size, count, address);
+	if (!dst)
+		return ERROR_NOT_IMPLEMENTED;
+
+	int retval = dmem_dp_run(ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (uint32_t i = 0; i < count; i++)
+		dst[i] = le_to_h_u32(buffer + 4 * i);
+
+	return ERROR_OK;
+}
+
 /* AP MODE */
 static uint32_t dmem_get_ap_reg_offset(struct adiv5_ap *ap, unsigned int reg)
 {
@@ -601,6 +658,8 @@ static const struct dap_ops dmem_dap_ops = {
 	.queue_ap_read = dmem_ap_q_read,
 	.queue_ap_write = dmem_ap_q_write,
 	.queue_ap_abort = dmem_ap_q_abort,
+	.mem_ap_read_buf = dmem_emu_mem_ap_read_buf,
+	.mem_ap_write_buf = dmem_emu_mem_ap_write_buf,
 	.run = dmem_dp_run,
 };
 
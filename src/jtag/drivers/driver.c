@@ -35,6 +35,18 @@ struct jtag_callback_entry {
 	jtag_callback_data_t data3;
 };
 
+/* a queue handed to the interface by interface_jtag_execute_queue_async() */
+struct jtag_async {
+	/* callbacks to run on completion, in the memory of 'pages' */
+	struct jtag_callback_entry *callbacks;
+	struct cmd_queue_page *pages;
+	bool done;
+	int retval;
+};
+
+/* the queue submitted to the interface and not completed yet */
+static struct jtag_async *jtag_async_in_flight;
+
 static struct jtag_callback_entry *jtag_callback_queue_head;
 static struct jtag_callback_entry *jtag_callback_queue_tail;
 
@@ -44,6 +56,33 @@ static void jtag_callback_queue_reset(void)
 	jtag_callback_queue_tail = NULL;
 }
 
+/*
+ * Layout of a DR scan after the last IR scan: the TAP addressed and the
+ * number of bypassed TAPs before and after it. Valid as long as 'generation'
+ * matches jtag_tap_chain_generation(), as TAPs only enter or leave bypass
+ * on an IR scan.
+ */
+static struct {
+	struct jtag_tap *active;
+	size_t bypass_before;
+	size_t bypass_after;
+	unsigned int generation;
+} dr_layout;
+
+/* the BYPASS instruction of a TAP, built once per IR length */
+static const uint8_t *jtag_tap_bypass_instr(struct jtag_tap *tap)
+{
+	if (tap->bypass_instr_len != tap->ir_length) {
+		if (tap->ir_bypass_value)
+			buf_set_u64(tap->bypass_instr, 0, tap->ir_length, tap->ir_bypass_value);
+		else
+			buf_set_ones(tap->bypass_instr, tap->ir_length);
+		tap->bypass_instr_len = tap->ir_length;
+	}
+
+	return tap->bypass_instr;
+}
+
 /**
  * see jtag_add_ir_scan()
  *
@@ -68,6 +107,7 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 	scan->end_state = state;
 
 	struct scan_field *field = out_fields;	/* keep track where we insert data */
+	struct scan_field *active_field = NULL;
 
 	/* loop over all enabled TAPs */
 
@@ -79,19 +119,15 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 			tap->bypass = false;
 
 			jtag_scan_field_clone(field, in_fields);
+			active_field = field;
 		} else {
 			/* if a TAP isn't listed in input fields, set it to BYPASS */
 
 			tap->bypass = true;
 
+			/* the prebuilt pattern is never written, no need for a copy */
 			field->num_bits = tap->ir_length;
-			if (tap->ir_bypass_value) {
-				uint8_t *v = cmd_queue_alloc(DIV_ROUND_UP(tap->ir_length, 8));
-				buf_set_u64(v, 0, tap->ir_length, tap->ir_bypass_value);
-				field->out_value = v;
-			} else {
-				field->out_value = buf_set_ones(cmd_queue_alloc(DIV_ROUND_UP(tap->ir_length, 8)), tap->ir_length);
-			}
+			field->out_value = jtag_tap_bypass_instr(tap);
 			field->in_value = NULL; /* do not collect input for tap's in bypass */
 		}
 
@@ -103,37 +139,79 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 	/* paranoia: jtag_tap_count_enabled() and jtag_tap_next_enabled() not in sync */
 	assert(field == out_fields + num_taps);
 
+	/* the DR layout follows from this scan */
+	if (active_field) {
+		dr_layout.active = active;
+		dr_layout.bypass_before = active_field - out_fields;
+		dr_layout.bypass_after = num_taps - dr_layout.bypass_before - 1;
+	} else {
+		dr_layout.active = NULL;
+	}
+	dr_layout.generation = jtag_tap_chain_generation();
+
 	return ERROR_OK;
 }
 
-/**
- * see jtag_add_dr_scan()
- *
- */
-int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
-		const struct scan_field *in_fields, tap_state_t state)
+/* fill in the dummy DR bits of TAPs in bypass */
+static struct scan_field *jtag_add_bypass_fields(struct scan_field *field, size_t count)
 {
-	/* count devices in bypass */
+	while (count--) {
+		field->num_bits = 1;
+		field->out_value = NULL;
+		field->in_value = NULL;
+		field++;
+	}
+
+	return field;
+}
 
-	size_t bypass_devices = 0;
-	size_t all_devices = 0;
+/* count the TAPs in bypass around the one addressed, if there is one */
+static void jtag_update_dr_layout(void)
+{
+	size_t before = 0;
+	size_t after = 0;
+	struct jtag_tap *active = NULL;
 
 	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
-		all_devices++;
-
-		if (tap->bypass)
-			bypass_devices++;
+		if (!tap->bypass) {
+			/* at most one TAP can be out of bypass, see jtag_add_ir_scan() */
+			assert(!active);
+			active = tap;
+		} else if (active) {
+			after++;
+		} else {
+			before++;
+		}
 	}
 
-	if (all_devices == bypass_devices) {
+	dr_layout.active = active;
+	dr_layout.bypass_before = before;
+	dr_layout.bypass_after = after;
+	dr_layout.generation = jtag_tap_chain_generation();
+}
+
+static int jtag_add_dr_scan_fields(struct jtag_tap *active, int in_num_fields,
+		const struct scan_field *in_fields, tap_state_t state, bool copy)
+{
+	/* the chain may have changed since the last IR scan */
+	if (dr_layout.generation != jtag_tap_chain_generation())
+		jtag_update_dr_layout();
+
+	if (!dr_layout.active) {
 		LOG_ERROR("At least one TAP shouldn't be in BYPASS mode");
 
 		return ERROR_FAIL;
 	}
 
+	/* must have at least one input field for the not bypassed TAP */
+	assert(active == dr_layout.active);
+	assert(in_num_fields > 0);
+
+	size_t num_fields = in_num_fields + dr_layout.bypass_before + dr_layout.bypass_after;
+
 	struct jtag_command *cmd = cmd_queue_alloc(sizeof(struct jtag_command));
 	struct scan_command *scan = cmd_queue_alloc(sizeof(struct scan_command));
-	struct scan_field *out_fields = cmd_queue_alloc((in_num_fields + bypass_devices) * sizeof(struct scan_field));
+	struct scan_field *out_fields = cmd_queue_alloc(num_fields * sizeof(struct scan_field));
 
 	jtag_queue_command(cmd);
 
@@ -141,48 +219,52 @@ int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
 	cmd->cmd.scan = scan;
 
 	scan->ir_scan = false;
-	scan->num_fields = in_num_fields + bypass_devices;
+	scan->num_fields = num_fields;
 	scan->fields = out_fields;
 	scan->end_state = state;
 
-	struct scan_field *field = out_fields;	/* keep track where we insert data */
-
-	/* loop over all enabled TAPs */
-
-	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
-		/* if TAP is not bypassed insert matching input fields */
-
-		if (!tap->bypass) {
-			assert(active == tap);
-#ifndef NDEBUG
-			/* remember initial position for assert() */
-			struct scan_field *start_field = field;
-#endif /* NDEBUG */
-
-			for (int j = 0; j < in_num_fields; j++) {
-				jtag_scan_field_clone(field, in_fields + j);
-
-				field++;
-			}
+	/* if a TAP is bypassed, generate a dummy bit */
+	struct scan_field *field = jtag_add_bypass_fields(out_fields, dr_layout.bypass_before);
 
-			assert(field > start_field);	/* must have at least one input field per not bypassed TAP */
-		}
-
-		/* if a TAP is bypassed, generated a dummy bit*/
-		else {
-			field->num_bits = 1;
-			field->out_value = NULL;
-			field->in_value = NULL;
+	if (copy) {
+		for (int j = 0; j < in_num_fields; j++) {
+			jtag_scan_field_clone(field, in_fields + j);
 
 			field++;
 		}
+	} else {
+		/* the caller keeps out_value alive until the queue has run */
+		memcpy(field, in_fields, in_num_fields * sizeof(*field));
+		field += in_num_fields;
 	}
 
+	field = jtag_add_bypass_fields(field, dr_layout.bypass_after);
+
 	assert(field == out_fields + scan->num_fields); /* no superfluous input fields permitted */
 
 	return ERROR_OK;
 }
 
+/**
+ * see jtag_add_dr_scan()
+ *
+ */
+int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
+		const struct scan_field *in_fields, tap_state_t state)
+{
+	return jtag_add_dr_scan_fields(active, in_num_fields, in_fields, state, true);
+}
+
+/**
+ * see jtag_add_dr_scan_nocopy()
+ *
+ */
+int interface_jtag_add_dr_scan_nocopy(struct jtag_tap *active, int in_num_fields,
+		const struct scan_field *in_fields, tap_state_t state)
+{
+	return jtag_add_dr_scan_fields(active, in_num_fields, in_fields, state, false);
+}
+
 static int jtag_add_plain_scan(int num_bits, const uint8_t *out_bits,
 		uint8_t *in_bits, tap_state_t state, bool ir_scan)
 {
@@ -363,6 +445,36 @@ void interface_jtag_add_callback4(jtag_callback_t callback,
 	}
 }
 
+static int jtag_run_callbacks(struct jtag_callback_entry *entry)
+{
+	for (; entry; entry = entry->next) {
+		int retval = entry->callback(entry->data0, entry->data1, entry->data2, entry->data3);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+static void jtag_async_complete(void)
+{
+	struct jtag_async *async = jtag_async_in_flight;
+
+	if (!async)
+		return;
+
+	jtag_async_in_flight = NULL;
+
+	async->retval = default_interface_jtag_complete_queue();
+	if (async->retval == ERROR_OK)
+		async->retval = jtag_run_callbacks(async->callbacks);
+
+	jtag_command_queue_release(async->pages);
+	async->pages = NULL;
+	async->callbacks = NULL;
+	async->done = true;
+}
+
 int interface_jtag_execute_queue(void)
 {
 	static int reentry;
@@ -370,15 +482,12 @@ int interface_jtag_execute_queue(void)
 	assert(reentry == 0);
 	reentry++;
 
+	/* keep the order of the queues */
+	jtag_async_complete();
+
 	int retval = default_interface_jtag_execute_queue();
-	if (retval == ERROR_OK) {
-		struct jtag_callback_entry *entry;
-		for (entry = jtag_callback_queue_head; entry; entry = entry->next) {
-			retval = entry->callback(entry->data0, entry->data1, entry->data2, entry->data3);
-			if (retval != ERROR_OK)
-				break;
-		}
-	}
+	if (retval == ERROR_OK)
+		retval = jtag_run_callbacks(jtag_callback_queue_head);
 
 	jtag_command_queue_reset();
 	jtag_callback_queue_reset();
@@ -388,6 +497,52 @@ int interface_jtag_execute_queue(void)
 	return retval;
 }
 
+int interface_jtag_execute_queue_async(struct jtag_async **async_out)
+{
+	jtag_async_complete();
+
+	struct jtag_async *async = calloc(1, sizeof(*async));
+	*async_out = async;
+	if (!async) {
+		LOG_ERROR("Out of memory");
+		return interface_jtag_execute_queue();
+	}
+
+	int retval = default_interface_jtag_submit_queue();
+	if (retval == ERROR_NOT_IMPLEMENTED) {
+		async->retval = interface_jtag_execute_queue();
+		async->done = true;
+	} else if (retval != ERROR_OK) {
+		async->retval = retval;
+		async->done = true;
+		jtag_command_queue_reset();
+		jtag_callback_queue_reset();
+	} else {
+		async->callbacks = jtag_callback_queue_head;
+		async->pages = jtag_command_queue_detach();
+		jtag_callback_queue_reset();
+		jtag_async_in_flight = async;
+	}
+
+	return ERROR_OK;
+}
+
+int interface_jtag_async_wait(struct jtag_async *async)
+{
+	if (!async)
+		return ERROR_OK;
+
+	if (!async->done) {
+		assert(async == jtag_async_in_flight);
+		jtag_async_complete();
+	}
+
+	int retval = async->retval;
+	free(async);
+
+	return retval;
+}
+
 static int jtag_convert_to_callback4(jtag_callback_data_t data0,
 		jtag_callback_data_t data1, jtag_callback_data_t data2, jtag_callback_data_t data3)
 {
@@ -385,6 +385,62 @@ static int esp_usb_jtag_out(int tms, int tdi, int tdo_req)
 	return ERROR_OK;
 }
 
+/* Adds `ct` copies of a command, merging them into the pending RLE run where possible. The same
+ * as calling esp_usb_jtag_command_add() `ct` times. */
+static int esp_usb_jtag_command_add_run(unsigned int cmd, unsigned int ct)
+{
+	if (cmd == priv->prev_cmd && priv->prev_cmd_repct) {
+		unsigned int n = MIN(ct, (unsigned int)(CMD_REP_MAX_REPS - priv->prev_cmd_repct));
+		priv->prev_cmd_repct += n;
+		ct -= n;
+	}
+	while (ct) {
+		if (priv->prev_cmd_repct) {
+			int ret = esp_usb_jtag_write_rlestream(priv->prev_cmd, priv->prev_cmd_repct);
+			if (ret != ERROR_OK)
+				return ret;
+		}
+		unsigned int n = MIN(ct, (unsigned int)CMD_REP_MAX_REPS);
+		priv->prev_cmd = cmd;
+		priv->prev_cmd_repct = n;
+		ct -= n;
+	}
+	return ERROR_OK;
+}
+
+/* Called by bitq interface to clock out a whole field with TMS low. Runs of equal TDI bits are
+ * found a byte at a time and go into the RLE encoder as one run. */
+static int esp_usb_jtag_out_bits(const uint8_t *tdi, unsigned int num_bits, int tdo_req)
+{
+	unsigned int i = 0;
+
+	while (i < num_bits) {
+		int bit = tdi ? (tdi[i / 8] >> (i % 8)) & 1 : 0;
+		unsigned int end = i + 1;
+
+		if (!tdi) {
+			end = num_bits;
+		} else {
+			uint8_t fill = bit ? 0xff : 0x00;
+			while (end < num_bits && (end % 8) && ((tdi[end / 8] >> (end % 8)) & 1) == bit)
+				end++;
+			while (end + 8 <= num_bits && !(end % 8) && tdi[end / 8] == fill)
+				end += 8;
+			while (end < num_bits && ((tdi[end / 8] >> (end % 8)) & 1) == bit)
+				end++;
+		}
+
+		/* count the TDO bits first, like esp_usb_jtag_out() does for its single bit */
+		if (tdo_req)
+			priv->pending_in_bits += end - i;
+		int ret = esp_usb_jtag_command_add_run(CMD_CLK(tdo_req, bit, 0), end - i);
+		if (ret != ERROR_OK)
+			return ret;
+		i = end;
+	}
+	return ERROR_OK;
+}
+
 /* Called by bitq interface to flush all output commands and get returned data ready to read */
 static int esp_usb_jtag_flush(void)
 {
@@ -481,6 +537,7 @@ static int esp_usb_jtag_init(void)
 
 	bitq_interface = &priv->bitq_interface;
 	bitq_interface->out = esp_usb_jtag_out;
+	bitq_interface->out_bits = esp_usb_jtag_out_bits;
 	bitq_interface->flush = esp_usb_jtag_flush;
 	bitq_interface->sleep = esp_usb_jtag_sleep;
 	bitq_interface->reset = esp_usb_jtag_reset;
@@ -302,6 +302,42 @@ static void clock_tms_cs_out(struct mpsse_ctx *ctx, const uint8_t *out, unsigned
 }
 #endif
 
+/* TMS bits of state moves and idle clocks, collected across commands and
+ * sent in as few TMS opcodes as possible before the next data shift. TDI is
+ * held low, as the original sequences do. */
+static uint8_t ftdi_tms_pending;
+static unsigned int ftdi_tms_pending_len;
+
+/* buffer to shift adjacent fields not captured with one opcode */
+static uint8_t *ftdi_scan_buf;
+static size_t ftdi_scan_buf_size;
+
+static void ftdi_flush_tms(void)
+{
+	if (!ftdi_tms_pending_len)
+		return;
+
+	DO_CLOCK_TMS_CS_OUT(mpsse_ctx, &ftdi_tms_pending, 0, ftdi_tms_pending_len, false, ftdi_jtag_mode);
+	ftdi_tms_pending = 0;
+	ftdi_tms_pending_len = 0;
+}
+
+static void ftdi_queue_tms_bit(bool tms)
+{
+	if (tms)
+		ftdi_tms_pending |= 1 << ftdi_tms_pending_len;
+
+	/* the MPSSE TMS commands take up to 7 bits */
+	if (++ftdi_tms_pending_len == 7)
+		ftdi_flush_tms();
+}
+
+static void ftdi_queue_tms(const uint8_t *bits, unsigned int offset, unsigned int count)
+{
+	for (unsigned int i = offset; i < offset + count; i++)
+		ftdi_queue_tms_bit((bits[i / 8] >> (i % 8)) & 1);
+}
+
 /**
  * Function move_to_state
  * moves the TAP controller from the current state to a
@@ -330,12 +366,7 @@ static void move_to_state(tap_state_t goal_state)
 	for (int i = 0; i < tms_count; i++)
 		tap_set_state(tap_state_transition(tap_get_state(), (tms_bits >> i) & 1));
 
-	DO_CLOCK_TMS_CS_OUT(mpsse_ctx,
-		&tms_bits,
-		0,
-		tms_count,
-		false,
-		ftdi_jtag_mode);
+	ftdi_queue_tms(&tms_bits, 0, tms_count);
 }
 
 static int ftdi_speed(int speed)
@@ -384,7 +415,6 @@ static void ftdi_end_state(tap_state_t state)
 static void ftdi_execute_runtest(struct jtag_command *cmd)
 {
 	int i;
-	static const uint8_t zero;
 
 	LOG_DEBUG_IO("runtest %i cycles, end in %s",
 		cmd->cmd.runtest->num_cycles,
@@ -393,14 +423,9 @@ static void ftdi_execute_runtest(struct jtag_command *cmd)
 	if (tap_get_state() != TAP_IDLE)
 		move_to_state(TAP_IDLE);
 
-	/* TODO: Reuse ftdi_execute_stableclocks */
-	i = cmd->cmd.runtest->num_cycles;
-	while (i > 0) {
-		/* there are no state transitions in this code, so omit state tracking */
-		unsigned this_len = i > 7 ? 7 : i;
-		DO_CLOCK_TMS_CS_OUT(mpsse_ctx, &zero, 0, this_len, false, ftdi_jtag_mode);
-		i -= this_len;
-	}
+	/* there are no state transitions in this code, so omit state tracking */
+	for (i = 0; i < cmd->cmd.runtest->num_cycles; i++)
+		ftdi_queue_tms_bit(false);
 
 	ftdi_end_state(cmd->cmd.runtest->end_state);
 
@@ -433,12 +458,7 @@ static void ftdi_execute_tms(struct jtag_command *cmd)
 	LOG_DEBUG_IO("TMS: %d bits", cmd->cmd.tms->num_bits);
 
 	/* TODO: Missing tap state tracking, also missing from ft2232.c! */
-	DO_CLOCK_TMS_CS_OUT(mpsse_ctx,
-		cmd->cmd.tms->bits,
-		0,
-		cmd->cmd.tms->num_bits,
-		false,
-		ftdi_jtag_mode);
+	ftdi_queue_tms(cmd->cmd.tms->bits, 0, cmd->cmd.tms->num_bits);
 }
 
 static void ftdi_execute_pathmove(struct jtag_command *cmd)
@@ -451,8 +471,6 @@ static void ftdi_execute_pathmove(struct jtag_command *cmd)
 		tap_state_name(path[num_states-1]));
 
 	int state_count = 0;
-	unsigned bit_count = 0;
-	uint8_t tms_byte = 0;
 
 	LOG_DEBUG_IO("-");
 
@@ -462,10 +480,10 @@ static void ftdi_execute_pathmove(struct jtag_command *cmd)
 		/* either TMS=0 or TMS=1 must work ... */
 		if (tap_state_transition(tap_get_state(), false)
 		    == path[state_count])
-			buf_set_u32(&tms_byte, bit_count++, 1, 0x0);
+			ftdi_queue_tms_bit(false);
 		else if (tap_state_transition(tap_get_state(), true)
 			 == path[state_count]) {
-			buf_set_u32(&tms_byte, bit_count++, 1, 0x1);
+			ftdi_queue_tms_bit(true);
 
 			/* ... or else the caller goofed BADLY */
 		} else {
@@ -478,18 +496,40 @@ static void ftdi_execute_pathmove(struct jtag_command *cmd)
 
 		tap_set_state(path[state_count]);
 		state_count++;
+	}
+	tap_set_end_state(tap_get_state());
+}
 
-		if (bit_count == 7 || num_states == 0) {
-			DO_CLOCK_TMS_CS_OUT(mpsse_ctx,
-					&tms_byte,
-					0,
-					bit_count,
-					false,
-					ftdi_jtag_mode);
-			bit_count = 0;
+/* Copy the out bits of @a count fields into one buffer, NULL if none has any */
+static const uint8_t *ftdi_gather_out(const struct scan_field *fields, int count, unsigned bits)
+{
+	bool any_out = false;
+	for (int i = 0; i < count; i++)
+		any_out |= fields[i].out_value != NULL;
+	if (!any_out)
+		return NULL;
+
+	size_t size = DIV_ROUND_UP(bits, 8);
+	if (size > ftdi_scan_buf_size) {
+		uint8_t *buf = realloc(ftdi_scan_buf, size);
+		if (!buf) {
+			LOG_ERROR("Out of memory");
+			return NULL;
 		}
+		ftdi_scan_buf = buf;
+		ftdi_scan_buf_size = size;
 	}
-	tap_set_end_state(tap_get_state());
+
+	/* fields without out_value shift zeros, as alone */
+	memset(ftdi_scan_buf, 0, size);
+	unsigned offset = 0;
+	for (int i = 0; i < count; i++) {
+		if (fields[i].out_value)
+			bit_copy(ftdi_scan_buf, offset, fields[i].out_value, 0, fields[i].num_bits);
+		offset += fields[i].num_bits;
+	}
+
+	return ftdi_scan_buf;
 }
 
 static void ftdi_execute_scan(struct jtag_command *cmd)
@@ -518,67 +558,73 @@ static void ftdi_execute_scan(struct jtag_command *cmd)
 	}
 
 	ftdi_end_state(cmd->cmd.scan->end_state);
+	ftdi_flush_tms();
 
-	struct scan_field *field = cmd->cmd.scan->fields;
+	struct scan_field *fields = cmd->cmd.scan->fields;
+	int num_fields = cmd->cmd.scan->num_fields;
 	unsigned scan_size = 0;
 
-	for (int i = 0; i < cmd->cmd.scan->num_fields; i++, field++) {
-		scan_size += field->num_bits;
-		LOG_DEBUG_IO("%s%s field %d/%d %d bits",
-			field->in_value ? "in" : "",
-			field->out_value ? "out" : "",
-			i,
-			cmd->cmd.scan->num_fields,
-			field->num_bits);
-
-		if (i == cmd->cmd.scan->num_fields - 1 && tap_get_state() != tap_get_end_state()) {
+	for (int i = 0; i < num_fields; ) {
+		/* fields not captured are shifted together with their successors
+		 * that aren't captured either */
+		int n = 1;
+		unsigned bits = fields[i].num_bits;
+		if (!fields[i].in_value)
+			while (i + n < num_fields && !fields[i + n].in_value)
+				bits += fields[i + n++].num_bits;
+
+		const uint8_t *out = n == 1 ? fields[i].out_value : ftdi_gather_out(fields + i, n, bits);
+		uint8_t *in = fields[i].in_value;
+
+		LOG_DEBUG_IO("%s%s fields %d-%d/%d %d bits",
+			in ? "in" : "",
+			out ? "out" : "",
+			i, i + n - 1,
+			num_fields,
+			bits);
+
+		scan_size += bits;
+		i += n;
+
+		if (i == num_fields && tap_get_state() != tap_get_end_state()) {
 			/* Last field, and we're leaving IRSHIFT/DRSHIFT. Clock last bit during tap
 			 * movement. This last field can't have length zero, it was checked above. */
 			DO_CLOCK_DATA(mpsse_ctx,
-				field->out_value,
+				out,
 				0,
-				field->in_value,
+				in,
 				0,
-				field->num_bits - 1,
+				bits - 1,
 				ftdi_jtag_mode);
 			uint8_t last_bit = 0;
-			if (field->out_value)
-				bit_copy(&last_bit, 0, field->out_value, field->num_bits - 1, 1);
+			if (out)
+				bit_copy(&last_bit, 0, out, bits - 1, 1);
 			uint8_t tms_bits = 0x03;
 			DO_CLOCK_TMS_CS(mpsse_ctx,
 					&tms_bits,
 					0,
-					field->in_value,
-					field->num_bits - 1,
+					in,
+					bits - 1,
 					1,
 					last_bit,
 					ftdi_jtag_mode);
 			tap_set_state(tap_state_transition(tap_get_state(), 1));
+			/* TDI isn't sampled from here on, the rest joins the next moves */
 			if (tap_get_end_state() == TAP_IDLE) {
-				DO_CLOCK_TMS_CS_OUT(mpsse_ctx,
-						&tms_bits,
-						1,
-						2,
-						last_bit,
-						ftdi_jtag_mode);
+				ftdi_queue_tms(&tms_bits, 1, 2);
 				tap_set_state(tap_state_transition(tap_get_state(), 1));
 				tap_set_state(tap_state_transition(tap_get_state(), 0));
 			} else {
-				DO_CLOCK_TMS_CS_OUT(mpsse_ctx,
-						&tms_bits,
-						2,
-						1,
-						last_bit,
-						ftdi_jtag_mode);
+				ftdi_queue_tms(&tms_bits, 2, 1);
 				tap_set_state(tap_state_transition(tap_get_state(), 0));
 			}
 		} else
 			DO_CLOCK_DATA(mpsse_ctx,
-				field->out_value,
+				out,
 				0,
-				field->in_value,
+				in,
 				0,
-				field->num_bits,
+				bits,
 				ftdi_jtag_mode);
 	}
 
@@ -632,6 +678,7 @@ static void ftdi_execute_sleep(struct jtag_command *cmd)
 {
 	LOG_DEBUG_IO("sleep %" PRIu32, cmd->cmd.sleep->us);
 
+	ftdi_flush_tms();
 	mpsse_flush(mpsse_ctx);
 	jtag_sleep(cmd->cmd.sleep->us);
 	LOG_DEBUG_IO("sleep %" PRIu32 " usec while in %s",
@@ -646,17 +693,14 @@ static void ftdi_execute_stableclocks(struct jtag_command *cmd)
 	 */
 	int num_cycles = cmd->cmd.stableclocks->num_cycles;
 
-	/* 7 bits of either ones or zeros. */
-	uint8_t tms = tap_get_state() == TAP_RESET ? 0x7f : 0x00;
+	/* either ones or zeros */
+	bool tms = tap_get_state() == TAP_RESET;
 
 	/* TODO: Use mpsse_clock_data with in=out=0 for this, if TMS can be set to
 	 * the correct level and remain there during the scan */
-	while (num_cycles > 0) {
-		/* there are no state transitions in this code, so omit state tracking */
-		unsigned this_len = num_cycles > 7 ? 7 : num_cycles;
-		DO_CLOCK_TMS_CS_OUT(mpsse_ctx, &tms, 0, this_len, false, ftdi_jtag_mode);
-		num_cycles -= this_len;
-	}
+	/* there are no state transitions in this code, so omit state tracking */
+	for (int i = 0; i < num_cycles; i++)
+		ftdi_queue_tms_bit(tms);
 
 	LOG_DEBUG_IO("clocks %i while in %s",
 		cmd->cmd.stableclocks->num_cycles,
@@ -668,8 +712,10 @@ static void ftdi_execute_command(struct jtag_command *cmd)
 	switch (cmd->type) {
 #if BUILD_FTDI_CJTAG == 1
 		case JTAG_RESET:
-			if (cmd->cmd.reset->trst)
+			if (cmd->cmd.reset->trst) {
+				ftdi_flush_tms();
 				cjtag_reset_online_activate(); /* put the target (back) into selected cJTAG mode */
+			}
 			break;
 #endif
 		case JTAG_RUNTEST:
@@ -677,6 +723,7 @@ static void ftdi_execute_command(struct jtag_command *cmd)
 			break;
 		case JTAG_TLR_RESET:
 #if BUILD_FTDI_CJTAG == 1
+			ftdi_flush_tms();
 			cjtag_reset_online_activate(); /* put the target (back) into selected cJTAG mode */
 #endif
 			ftdi_execute_statemove(cmd);
@@ -702,7 +749,7 @@ static void ftdi_execute_command(struct jtag_command *cmd)
 	}
 }
 
-static int ftdi_execute_queue(struct jtag_command *cmd_queue)
+static int ftdi_execute_queue_submit(struct jtag_command *cmd_queue)
 {
 	/* blink, if the current layout has that feature */
 	struct signal *led = find_signal_by_name("LED");
@@ -713,17 +760,36 @@ static int ftdi_execute_queue(struct jtag_command *cmd_queue)
 		/* fill the write buffer with the desired command */
 		ftdi_execute_command(cmd);
 	}
+	ftdi_flush_tms();
 
 	if (led)
 		ftdi_set_signal(led, '0');
 
-	int retval = mpsse_flush(mpsse_ctx);
+	int retval = mpsse_flush_submit(mpsse_ctx);
 	if (retval != ERROR_OK)
 		LOG_ERROR("error while flushing MPSSE queue: %d", retval);
 
 	return retval;
 }
 
+static int ftdi_execute_queue_complete(void)
+{
+	int retval = mpsse_flush_complete(mpsse_ctx);
+	if (retval != ERROR_OK)
+		LOG_ERROR("error while flushing MPSSE queue: %d", retval);
+
+	return retval;
+}
+
+static int ftdi_execute_queue(struct jtag_command *cmd_queue)
+{
+	int retval = ftdi_execute_queue_submit(cmd_queue);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return ftdi_execute_queue_complete();
+}
+
 static int ftdi_initialize(void)
 {
 	if (tap_get_tms_path_len(TAP_IRPAUSE, TAP_IRPAUSE) == 7)
@@ -796,6 +862,10 @@ static int ftdi_quit(void)
 
 	free(swd_cmd_queue);
 
+	free(ftdi_scan_buf);
+	ftdi_scan_buf = NULL;
+	ftdi_scan_buf_size = 0;
+
 	return ERROR_OK;
 }
 
@@ -1671,6 +1741,8 @@ static const char * const ftdi_transports[] = { "jtag", "swd", NULL };
 static struct jtag_interface ftdi_interface = {
 	.supported = DEBUG_CAP_TMS_SEQ,
 	.execute_queue = ftdi_execute_queue,
+	.execute_queue_submit = ftdi_execute_queue_submit,
+	.execute_queue_complete = ftdi_execute_queue_complete,
 };
 
 struct adapter_driver ftdi_adapter_driver = {
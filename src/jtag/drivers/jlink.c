@@ -50,6 +50,12 @@ static bool trace_enabled;
 
 #define JLINK_MAX_SPEED			12000
 #define JLINK_TAP_BUFFER_SIZE	2048
+/*
+ * Upper bound for the SWD transaction buffer. The bit count of a SWD I/O
+ * request is 16 bits wide, probes with enough free memory can take a whole
+ * burst of memory accesses in a single request.
+ */
+#define JLINK_SWD_BUFFER_SIZE	(0xffff / 8)
 
 static unsigned int swd_buffer_size = JLINK_TAP_BUFFER_SIZE;
 
@@ -472,7 +478,7 @@ static bool adjust_swd_buffer_size(void)
 		return false;
 	}
 
-	tmp = MIN(JLINK_TAP_BUFFER_SIZE, (tmp - 16) / 2);
+	tmp = MIN(JLINK_SWD_BUFFER_SIZE, (tmp - 16) / 2);
 
 	if (tmp != swd_buffer_size) {
 		swd_buffer_size = tmp;
@@ -1960,9 +1966,9 @@ static void jlink_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_c
 
 static unsigned tap_length;
 /* In SWD mode use tms buffer for direction control */
-static uint8_t tms_buffer[JLINK_TAP_BUFFER_SIZE];
-static uint8_t tdi_buffer[JLINK_TAP_BUFFER_SIZE];
-static uint8_t tdo_buffer[JLINK_TAP_BUFFER_SIZE];
+static uint8_t tms_buffer[JLINK_SWD_BUFFER_SIZE];
+static uint8_t tdi_buffer[JLINK_SWD_BUFFER_SIZE];
+static uint8_t tdo_buffer[JLINK_SWD_BUFFER_SIZE];
 
 struct pending_scan_result {
 	/** First bit position in tdo_buffer to read. */
@@ -1977,17 +1983,19 @@ struct pending_scan_result {
 	uint8_t swd_cmd;
 };
 
-#define MAX_PENDING_SCAN_RESULTS 256
+/* enough for a full SWD buffer of read transactions */
+#define MAX_PENDING_SCAN_RESULTS (JLINK_SWD_BUFFER_SIZE * 8 / 46)
 
 static int pending_scan_results_length;
 static struct pending_scan_result pending_scan_results_buffer[MAX_PENDING_SCAN_RESULTS];
 
 static void jlink_tap_init(void)
 {
+	/* only the bits used by the previous queue can be set */
+	memset(tms_buffer, 0, DIV_ROUND_UP(tap_length, 8));
+	memset(tdi_buffer, 0, DIV_ROUND_UP(tap_length, 8));
 	tap_length = 0;
 	pending_scan_results_length = 0;
-	memset(tms_buffer, 0, sizeof(tms_buffer));
-	memset(tdi_buffer, 0, sizeof(tdi_buffer));
 }
 
 static void jlink_clock_data(const uint8_t *out, unsigned out_offset,
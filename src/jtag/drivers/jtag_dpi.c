@@ -24,6 +24,8 @@
 #include <netinet/tcp.h>
 #endif
 
+#include "sim_shm.h"
+
 #define SERVER_ADDRESS	"127.0.0.1"
 #define SERVER_PORT	5555
 
@@ -33,6 +35,10 @@ static char *server_address;
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
+/* used instead of sockfd if "jtag_dpi set_shm" is set */
+static char *shm_path;
+static struct sim_shm *shm;
+
 static uint8_t *last_ir_buf;
 static int last_ir_num_bits;
 
@@ -43,6 +49,8 @@ static int write_sock(char *buf, size_t len)
 			__func__, __FILE__, __LINE__);
 		return ERROR_FAIL;
 	}
+	if (shm)
+		return sim_shm_write(shm, buf, len);
 	if (write(sockfd, buf, len) != (ssize_t)len) {
 		LOG_ERROR("%s: %s, file %s, line %d", __func__,
 			strerror(errno), __FILE__, __LINE__);
@@ -58,6 +66,8 @@ static int read_sock(char *buf, size_t len)
 			__func__, __FILE__, __LINE__);
 		return ERROR_FAIL;
 	}
+	if (shm)
+		return sim_shm_read_all(shm, buf, len);
 	if (read(sockfd, buf, len) != (ssize_t)len) {
 		LOG_ERROR("%s: %s, file %s, line %d", __func__,
 			strerror(errno), __FILE__, __LINE__);
@@ -266,6 +276,11 @@ static int jtag_dpi_execute_queue(struct jtag_command *cmd_queue)
 
 static int jtag_dpi_init(void)
 {
+	if (shm_path) {
+		shm = sim_shm_open(shm_path);
+		return shm ? ERROR_OK : ERROR_FAIL;
+	}
+
 	sockfd = socket(AF_INET, SOCK_STREAM, 0);
 	if (sockfd < 0) {
 		LOG_ERROR("socket: %s, function %s, file %s, line %d",
@@ -317,6 +332,14 @@ static int jtag_dpi_quit(void)
 	free(server_address);
 	server_address = NULL;
 
+	if (shm) {
+		sim_shm_close(shm);
+		shm = NULL;
+		free(shm_path);
+		shm_path = NULL;
+		return ERROR_OK;
+	}
+
 	return close(sockfd);
 }
 
@@ -362,6 +385,23 @@ COMMAND_HANDLER(jtag_dpi_set_address)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_dpi_set_shm)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(shm_path);
+	shm_path = strdup(CMD_ARGV[0]);
+	if (!shm_path) {
+		LOG_ERROR("%s: strdup fail, file %s, line %d",
+			__func__, __FILE__, __LINE__);
+		return ERROR_FAIL;
+	}
+	LOG_INFO("Set shared memory file to %s", shm_path);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_dpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -377,6 +417,13 @@ static const struct command_registration jtag_dpi_subcommand_handlers[] = {
 		.help = "set the address of the DPI server",
 		.usage = "[address]",
 	},
+	{
+		.name = "set_shm",
+		.handler = &jtag_dpi_set_shm,
+		.mode = COMMAND_CONFIG,
+		.help = "talk to the DPI server through a shared memory file",
+		.usage = "path",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
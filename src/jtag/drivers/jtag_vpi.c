@@ -37,6 +37,35 @@
 #define CMD_SCAN_CHAIN		2
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
+#define CMD_NEGOTIATE		5
+#define CMD_BATCH		6
+
+/* Protocol version 2 adds CMD_BATCH: a variable-length message carrying a
+ * whole sequence of operations, answered by a single reply with the TDO
+ * bits of all scans in it. Legacy commands keep their fixed framing and can
+ * still be mixed in; both start with the little endian command word.
+ *
+ * request: cmd(4) nb_ops(4) length(4), then nb_ops times
+ *          op(1) nb_bits(4) [DIV_ROUND_UP(nb_bits, 8) bytes of TMS/TDI]
+ * reply:   cmd(4) length(4), then for every BATCH_OP_SCAN* op in order
+ *          DIV_ROUND_UP(nb_bits, 8) bytes of TDO
+ */
+#define PROTOCOL_VERSION_LEGACY	1
+#define PROTOCOL_VERSION_BATCH	2
+
+#define BATCH_OP_TMS_SEQ	0
+#define BATCH_OP_SCAN		1
+#define BATCH_OP_SCAN_FLIP_TMS	2
+/* nb_bits clocks with TMS=0 and TDI=1, no payload */
+#define BATCH_OP_CLOCKS		3
+
+#define BATCH_HEADER_SIZE	12
+#define BATCH_OP_HEADER_SIZE	5
+/* flush a batch once it gets this large */
+#define BATCH_MAX_SIZE		(1024 * 1024)
+
+/* how long to wait for the server to answer CMD_NEGOTIATE */
+#define NEGOTIATE_TIMEOUT_MS	500
 
 /* jtag_vpi server port and address to connect to */
 static int server_port = DEFAULT_SERVER_PORT;
@@ -45,6 +74,29 @@ static char *server_address;
 /* Send CMD_STOP_SIMU to server when OpenOCD exits? */
 static bool stop_sim_on_exit;
 
+/* Try to negotiate PROTOCOL_VERSION_BATCH at connect? */
+static bool batch_requested;
+static int protocol_version = PROTOCOL_VERSION_LEGACY;
+
+/* A scan queued in the current batch, completed when the reply arrives. */
+struct vpi_batch_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+	/* position of the TDO bits in the reply payload */
+	unsigned int reply_offset;
+};
+
+static uint8_t *batch_buf;
+static unsigned int batch_size;
+static unsigned int batch_used;
+static unsigned int batch_nb_ops;
+static unsigned int batch_reply_length;
+static struct vpi_batch_scan *batch_scans;
+static unsigned int batch_nb_scans;
+static unsigned int batch_scans_size;
+/* first jtag_read_buffer() error since the queue started */
+static int batch_retval = ERROR_OK;
+
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
@@ -79,54 +131,19 @@ static char *jtag_vpi_cmd_to_str(int cmd_num)
 		return "CMD_SCAN_CHAIN_FLIP_TMS";
 	case CMD_STOP_SIMU:
 		return "CMD_STOP_SIMU";
+	case CMD_NEGOTIATE:
+		return "CMD_NEGOTIATE";
 	default:
 		return "<unknown>";
 	}
 }
 
-static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_send_all(const void *data, size_t len)
 {
 	int retval;
 
-	/* Optional low-level JTAG debug */
-	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
-		if (vpi->nb_bits > 0) {
-			/* command with a non-empty data payload */
-			char *char_buf = buf_to_hex_str(vpi->buffer_out,
-					(vpi->nb_bits > DEBUG_JTAG_IOZ)
-						? DEBUG_JTAG_IOZ
-						: vpi->nb_bits);
-			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
-					"length=%" PRIu32 ", "
-					"nb_bits=%" PRIu32 ", "
-					"buf_out=0x%s%s",
-					jtag_vpi_cmd_to_str(vpi->cmd),
-					vpi->length,
-					vpi->nb_bits,
-					char_buf,
-					(vpi->nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
-			free(char_buf);
-		} else {
-			/* command without data payload */
-			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
-					"length=%" PRIu32 ", "
-					"nb_bits=%" PRIu32,
-					jtag_vpi_cmd_to_str(vpi->cmd),
-					vpi->length,
-					vpi->nb_bits);
-		}
-	}
-
-	/* Use little endian when transmitting/receiving jtag_vpi cmds.
-	   The choice of little endian goes against usual networking conventions
-	   but is intentional to remain compatible with most older OpenOCD builds
-	   (i.e. builds on little-endian platforms). */
-	h_u32_to_le(vpi->cmd_buf, vpi->cmd);
-	h_u32_to_le(vpi->length_buf, vpi->length);
-	h_u32_to_le(vpi->nb_bits_buf, vpi->nb_bits);
-
 retry_write:
-	retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
+	retval = write_socket(sockfd, data, len);
 
 	if (retval < 0) {
 		/* Account for the case when socket write is interrupted. */
@@ -144,7 +161,7 @@ retry_write:
 		/* TODO: Clean way how adapter drivers can report fatal errors
 		   to upper layers of OpenOCD and let it perform an orderly shutdown? */
 		exit(-1);
-	} else if (retval < (int)sizeof(struct vpi_cmd)) {
+	} else if ((size_t)retval < len) {
 		/* This means we could not send all data, which is most likely fatal
 		   for the jtag_vpi connection (the underlying TCP connection likely not
 		   usable anymore) */
@@ -156,12 +173,11 @@ retry_write:
 	return ERROR_OK;
 }
 
-static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
+static void jtag_vpi_receive_all(void *data, size_t len)
 {
-	unsigned bytes_buffered = 0;
-	while (bytes_buffered < sizeof(struct vpi_cmd)) {
-		int bytes_to_receive = sizeof(struct vpi_cmd) - bytes_buffered;
-		int retval = read_socket(sockfd, ((char *)vpi) + bytes_buffered, bytes_to_receive);
+	size_t bytes_buffered = 0;
+	while (bytes_buffered < len) {
+		int retval = read_socket(sockfd, (char *)data + bytes_buffered, len - bytes_buffered);
 		if (retval < 0) {
 #ifdef _WIN32
 			int wsa_err = WSAGetLastError();
@@ -186,6 +202,53 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 		/* Otherwise, we have successfully received some data */
 		bytes_buffered += retval;
 	}
+}
+
+static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
+{
+	/* Optional low-level JTAG debug */
+	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
+		if (vpi->nb_bits > 0) {
+			/* command with a non-empty data payload */
+			char *char_buf = buf_to_hex_str(vpi->buffer_out,
+					(vpi->nb_bits > DEBUG_JTAG_IOZ)
+						? DEBUG_JTAG_IOZ
+						: vpi->nb_bits);
+			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
+					"length=%" PRIu32 ", "
+					"nb_bits=%" PRIu32 ", "
+					"buf_out=0x%s%s",
+					jtag_vpi_cmd_to_str(vpi->cmd),
+					vpi->length,
+					vpi->nb_bits,
+					char_buf,
+					(vpi->nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
+			free(char_buf);
+		} else {
+			/* command without data payload */
+			LOG_DEBUG_IO("sending JTAG VPI cmd: cmd=%s, "
+					"length=%" PRIu32 ", "
+					"nb_bits=%" PRIu32,
+					jtag_vpi_cmd_to_str(vpi->cmd),
+					vpi->length,
+					vpi->nb_bits);
+		}
+	}
+
+	/* Use little endian when transmitting/receiving jtag_vpi cmds.
+	   The choice of little endian goes against usual networking conventions
+	   but is intentional to remain compatible with most older OpenOCD builds
+	   (i.e. builds on little-endian platforms). */
+	h_u32_to_le(vpi->cmd_buf, vpi->cmd);
+	h_u32_to_le(vpi->length_buf, vpi->length);
+	h_u32_to_le(vpi->nb_bits_buf, vpi->nb_bits);
+
+	return jtag_vpi_send_all(vpi, sizeof(struct vpi_cmd));
+}
+
+static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
+{
+	jtag_vpi_receive_all(vpi, sizeof(struct vpi_cmd));
 
 	/* Use little endian when transmitting/receiving jtag_vpi cmds. */
 	vpi->cmd = le_to_h_u32(vpi->cmd_buf);
@@ -195,6 +258,156 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+static void jtag_vpi_batch_flush(void);
+
+static bool jtag_vpi_batch_enabled(void)
+{
+	return protocol_version >= PROTOCOL_VERSION_BATCH;
+}
+
+/**
+ * jtag_vpi_batch_add - append one operation to the current batch
+ * @param op one of BATCH_OP_*
+ * @param bits TMS/TDI bits, NULL for BATCH_OP_CLOCKS
+ * @param nb_bits number of bits
+ */
+static int jtag_vpi_batch_add(uint8_t op, const uint8_t *bits, unsigned int nb_bits)
+{
+	unsigned int nb_bytes = bits ? DIV_ROUND_UP(nb_bits, 8) : 0;
+	unsigned int needed = BATCH_OP_HEADER_SIZE + nb_bytes;
+
+	if (batch_nb_ops && batch_used + needed > BATCH_MAX_SIZE)
+		jtag_vpi_batch_flush();
+
+	if (batch_used + needed > batch_size) {
+		unsigned int size = MAX(batch_used + needed, 2 * batch_size);
+		uint8_t *buf = realloc(batch_buf, size);
+		if (!buf) {
+			LOG_ERROR("jtag_vpi: out of memory");
+			return ERROR_FAIL;
+		}
+		batch_buf = buf;
+		batch_size = size;
+	}
+
+	batch_buf[batch_used] = op;
+	h_u32_to_le(batch_buf + batch_used + 1, nb_bits);
+	if (bits)
+		memcpy(batch_buf + batch_used + BATCH_OP_HEADER_SIZE, bits, nb_bytes);
+	batch_used += needed;
+	batch_nb_ops++;
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_batch_add_scan - append a scan whose TDO bits are wanted
+ * @param cmd the scan command, completed when the batch is flushed
+ * @param buf scan buffer from jtag_build_buffer(), freed after completion
+ * @param nb_bits number of bits in @a buf
+ * @param tap_shift set TMS on the last bit
+ */
+static int jtag_vpi_batch_add_scan(struct scan_command *cmd, uint8_t *buf,
+		unsigned int nb_bits, int tap_shift)
+{
+	if (batch_nb_scans == batch_scans_size) {
+		unsigned int size = batch_scans_size ? 2 * batch_scans_size : 16;
+		struct vpi_batch_scan *scans = realloc(batch_scans, size * sizeof(*scans));
+		if (!scans) {
+			LOG_ERROR("jtag_vpi: out of memory");
+			return ERROR_FAIL;
+		}
+		batch_scans = scans;
+		batch_scans_size = size;
+	}
+
+	int retval = jtag_vpi_batch_add(tap_shift ? BATCH_OP_SCAN_FLIP_TMS : BATCH_OP_SCAN,
+			buf, nb_bits);
+	if (retval != ERROR_OK)
+		return retval;
+
+	batch_scans[batch_nb_scans++] = (struct vpi_batch_scan){
+		.cmd = cmd,
+		.buf = buf,
+		.reply_offset = batch_reply_length,
+	};
+	batch_reply_length += DIV_ROUND_UP(nb_bits, 8);
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_batch_flush - send the current batch and complete its scans
+ *
+ * Errors from jtag_read_buffer() are kept in batch_retval until the end of
+ * the queue, see jtag_vpi_batch_complete().
+ */
+static void jtag_vpi_batch_flush(void)
+{
+	if (!batch_nb_ops)
+		return;
+
+	LOG_DEBUG_IO("sending JTAG VPI batch: nb_ops=%u, length=%u, reply=%u",
+			batch_nb_ops, batch_used - BATCH_HEADER_SIZE, batch_reply_length);
+
+	h_u32_to_le(batch_buf, CMD_BATCH);
+	h_u32_to_le(batch_buf + 4, batch_nb_ops);
+	h_u32_to_le(batch_buf + 8, batch_used - BATCH_HEADER_SIZE);
+	jtag_vpi_send_all(batch_buf, batch_used);
+
+	uint8_t header[8];
+	jtag_vpi_receive_all(header, sizeof(header));
+	if (le_to_h_u32(header) != CMD_BATCH ||
+			le_to_h_u32(header + 4) != batch_reply_length) {
+		LOG_ERROR("jtag_vpi: unexpected reply to batch "
+				"(cmd=%" PRIu32 ", length=%" PRIu32 ", expected length=%u)",
+				le_to_h_u32(header), le_to_h_u32(header + 4), batch_reply_length);
+		exit(-1);
+	}
+
+	uint8_t *reply = NULL;
+	if (batch_reply_length) {
+		reply = malloc(batch_reply_length);
+		if (!reply) {
+			LOG_ERROR("jtag_vpi: out of memory");
+			exit(-1);
+		}
+		jtag_vpi_receive_all(reply, batch_reply_length);
+	}
+
+	for (unsigned int i = 0; i < batch_nb_scans; i++) {
+		struct vpi_batch_scan *scan = &batch_scans[i];
+		int scan_bits = jtag_scan_size(scan->cmd);
+
+		if (scan_bits > 0)
+			memcpy(scan->buf, reply + scan->reply_offset, DIV_ROUND_UP(scan_bits, 8));
+		int retval = jtag_read_buffer(scan->buf, scan->cmd);
+		if (retval != ERROR_OK && batch_retval == ERROR_OK)
+			batch_retval = retval;
+		free(scan->buf);
+	}
+	free(reply);
+
+	batch_used = BATCH_HEADER_SIZE;
+	batch_nb_ops = 0;
+	batch_nb_scans = 0;
+	batch_reply_length = 0;
+}
+
+/**
+ * jtag_vpi_batch_complete - flush the batch at the end of a queue
+ *
+ * Returns ERROR_OK, or the first error reported by jtag_read_buffer().
+ */
+static int jtag_vpi_batch_complete(void)
+{
+	jtag_vpi_batch_flush();
+
+	int retval = batch_retval;
+	batch_retval = ERROR_OK;
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @param trst 1 if TRST is to be asserted
@@ -203,6 +416,10 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 static int jtag_vpi_reset(int trst, int srst)
 {
 	struct vpi_cmd vpi;
+
+	/* the reset must not overtake what is already batched */
+	jtag_vpi_batch_flush();
+
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 
 	vpi.cmd = CMD_RESET;
@@ -226,6 +443,9 @@ static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 	struct vpi_cmd vpi;
 	int nb_bytes;
 
+	if (jtag_vpi_batch_enabled())
+		return jtag_vpi_batch_add(BATCH_OP_TMS_SEQ, bits, nb_bits);
+
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
@@ -340,6 +560,12 @@ static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 	int nb_xfer = DIV_ROUND_UP(nb_bits, XFERT_MAX_SIZE * 8);
 	int retval;
 
+	/* batched scans with data go through jtag_vpi_batch_add_scan() */
+	if (jtag_vpi_batch_enabled() && !bits) {
+		assert(tap_shift == NO_TAP_SHIFT);
+		return jtag_vpi_batch_add(BATCH_OP_CLOCKS, NULL, nb_bits);
+	}
+
 	while (nb_xfer) {
 		if (nb_xfer ==  1) {
 			retval = jtag_vpi_queue_tdi_xfer(bits, nb_bits, tap_shift);
@@ -400,7 +626,14 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			return retval;
 	}
 
-	if (cmd->end_state == TAP_DRSHIFT) {
+	if (jtag_vpi_batch_enabled()) {
+		retval = jtag_vpi_batch_add_scan(cmd, buf, scan_bits,
+				cmd->end_state == TAP_DRSHIFT ? NO_TAP_SHIFT : TAP_SHIFT);
+		if (retval != ERROR_OK) {
+			free(buf);
+			return retval;
+		}
+	} else if (cmd->end_state == TAP_DRSHIFT) {
 		retval = jtag_vpi_queue_tdi(buf, scan_bits, NO_TAP_SHIFT);
 		if (retval != ERROR_OK)
 			return retval;
@@ -425,11 +658,13 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (!jtag_vpi_batch_enabled()) {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
 
-	free(buf);
+		free(buf);
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -508,6 +743,7 @@ static int jtag_vpi_execute_queue(struct jtag_command *cmd_queue)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			jtag_vpi_batch_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -521,9 +757,56 @@ static int jtag_vpi_execute_queue(struct jtag_command *cmd_queue)
 		}
 	}
 
+	/* complete the scans of the batch even if the queue failed */
+	int complete_retval = jtag_vpi_batch_complete();
+	if (retval == ERROR_OK)
+		retval = complete_retval;
+
 	return retval;
 }
 
+/**
+ * jtag_vpi_negotiate - ask the server for the batched protocol
+ *
+ * Legacy servers ignore CMD_NEGOTIATE. If no answer arrives within
+ * NEGOTIATE_TIMEOUT_MS, the legacy framing is used.
+ */
+static void jtag_vpi_negotiate(void)
+{
+	struct vpi_cmd vpi;
+
+	memset(&vpi, 0, sizeof(struct vpi_cmd));
+	vpi.cmd = CMD_NEGOTIATE;
+	h_u32_to_le(vpi.buffer_out, PROTOCOL_VERSION_BATCH);
+	vpi.length = 4;
+	jtag_vpi_send_cmd(&vpi);
+
+	fd_set read_fds;
+	FD_ZERO(&read_fds);
+	FD_SET(sockfd, &read_fds);
+	struct timeval tv = {
+		.tv_sec = NEGOTIATE_TIMEOUT_MS / 1000,
+		.tv_usec = (NEGOTIATE_TIMEOUT_MS % 1000) * 1000,
+	};
+	if (socket_select(sockfd + 1, &read_fds, NULL, NULL, &tv) <= 0) {
+		LOG_WARNING("jtag_vpi: server does not support batched transfers, "
+				"using the legacy protocol");
+		return;
+	}
+
+	jtag_vpi_receive_cmd(&vpi);
+	if (vpi.cmd != CMD_NEGOTIATE || vpi.length < 4 ||
+			le_to_h_u32(vpi.buffer_in) < PROTOCOL_VERSION_BATCH) {
+		LOG_WARNING("jtag_vpi: server declined batched transfers, "
+				"using the legacy protocol");
+		return;
+	}
+
+	protocol_version = PROTOCOL_VERSION_BATCH;
+	batch_used = BATCH_HEADER_SIZE;
+	LOG_INFO("jtag_vpi: using batched transfers");
+}
+
 static int jtag_vpi_init(void)
 {
 	int flag = 1;
@@ -564,6 +847,9 @@ static int jtag_vpi_init(void)
 
 	LOG_INFO("jtag_vpi: Connection to %s : %u successful", server_address, server_port);
 
+	if (batch_requested)
+		jtag_vpi_negotiate();
+
 	return ERROR_OK;
 }
 
@@ -588,6 +874,8 @@ static int jtag_vpi_quit(void)
 		log_socket_error("jtag_vpi");
 	}
 	free(server_address);
+	free(batch_buf);
+	free(batch_scans);
 	return ERROR_OK;
 }
 
@@ -624,6 +912,15 @@ COMMAND_HANDLER(jtag_vpi_stop_sim_on_exit_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_batch_handler)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], batch_requested);
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -647,6 +944,14 @@ static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 			"before OpenOCD exits (default: off)",
 		.usage = "<on|off>",
 	},
+	{
+		.name = "batch",
+		.handler = &jtag_vpi_batch_handler,
+		.mode = COMMAND_CONFIG,
+		.help = "Configure if whole command queues shall be sent as one "
+			"message, if the server supports it (default: off)",
+		.usage = "<on|off>",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
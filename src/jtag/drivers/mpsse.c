@@ -52,6 +52,35 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+/* Buffers handed to the device and not completed yet. While the next
+ * buffer is filled, up to this many wait in the USB stack, so the chip gets
+ * its next commands without waiting for the host. */
+#define MPSSE_FLIGHTS 4
+
+struct mpsse_flight;
+
+struct transfer_result {
+	struct mpsse_flight *flight;
+	bool done;
+	unsigned transferred;
+};
+
+struct mpsse_flight {
+	struct mpsse_ctx *ctx;
+	uint8_t *write_buffer;
+	unsigned write_count;
+	uint8_t *read_buffer;
+	unsigned read_count;
+	uint8_t *read_chunk;
+	struct bit_copy_queue read_queue;
+	struct libusb_transfer *write_transfer;
+	struct libusb_transfer *read_transfer;
+	struct transfer_result write_result;
+	struct transfer_result read_result;
+	bool read_submitted;
+	int usb_retval;
+};
+
 struct mpsse_ctx {
 	struct libusb_context *usb_ctx;
 	struct libusb_device_handle *usb_dev;
@@ -73,6 +102,12 @@ struct mpsse_ctx {
 	unsigned read_chunk_size;
 	struct bit_copy_queue read_queue;
 	int retval;
+	/* flush started by mpsse_flush_submit(), not yet completed */
+	bool flush_pending;
+	/* ring of submitted buffers, oldest at flight_head */
+	struct mpsse_flight flights[MPSSE_FLIGHTS];
+	unsigned int flight_head;
+	unsigned int flight_count;
 };
 
 /* Returns true if the string descriptor indexed by str_index in device matches string */
@@ -349,6 +384,24 @@ struct mpsse_ctx *mpsse_open(const uint16_t vids[], const uint16_t pids[], const
 	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
 		goto error;
 
+	/* buffers are swapped between the context and the flights, all have
+	 * the same sizes */
+	for (unsigned int i = 0; i < MPSSE_FLIGHTS; i++) {
+		struct mpsse_flight *flight = &ctx->flights[i];
+
+		flight->ctx = ctx;
+		bit_copy_queue_init(&flight->read_queue);
+		flight->read_chunk = malloc(ctx->read_chunk_size);
+		flight->read_buffer = malloc(ctx->read_size);
+		flight->write_buffer = calloc(1, ctx->write_size);
+		flight->write_transfer = libusb_alloc_transfer(0);
+		flight->read_transfer = libusb_alloc_transfer(0);
+
+		if (!flight->read_chunk || !flight->read_buffer || !flight->write_buffer ||
+				!flight->write_transfer || !flight->read_transfer)
+			goto error;
+	}
+
 	ctx->interface = channel;
 	ctx->index = channel + 1;
 	ctx->usb_read_timeout = 5000;
@@ -399,8 +452,38 @@ error:
 	return NULL;
 }
 
+static void mpsse_flights_abort(struct mpsse_ctx *ctx);
+static int mpsse_flight_complete(struct mpsse_ctx *ctx);
+static int mpsse_submit_buffer(struct mpsse_ctx *ctx);
+
+/* The buffers belong to the USB transfers while a flush is pending, so
+ * anything touching them waits for the completion first. An error is
+ * reported by the next flush, like errors while queuing. */
+static void mpsse_flush_wait_pending(struct mpsse_ctx *ctx)
+{
+	if (!ctx->flush_pending)
+		return;
+
+	int retval = mpsse_flush_complete(ctx);
+	if (retval != ERROR_OK)
+		ctx->retval = retval;
+}
+
 void mpsse_close(struct mpsse_ctx *ctx)
 {
+	mpsse_flush_wait_pending(ctx);
+	mpsse_flights_abort(ctx);
+
+	for (unsigned int i = 0; i < MPSSE_FLIGHTS; i++) {
+		struct mpsse_flight *flight = &ctx->flights[i];
+
+		libusb_free_transfer(flight->write_transfer);
+		libusb_free_transfer(flight->read_transfer);
+		free(flight->write_buffer);
+		free(flight->read_buffer);
+		free(flight->read_chunk);
+	}
+
 	if (ctx->usb_dev)
 		libusb_close(ctx->usb_dev);
 	if (ctx->usb_ctx)
@@ -422,6 +505,8 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 {
 	int err;
 	LOG_DEBUG("-");
+	mpsse_flush_wait_pending(ctx);
+	mpsse_flights_abort(ctx);
 	ctx->write_count = 0;
 	ctx->read_count = 0;
 	ctx->retval = ERROR_OK;
@@ -498,6 +583,8 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 	/* TODO: Fix MSB first modes */
 	LOG_DEBUG_IO("%s%s %d bits", in ? "in" : "", out ? "out" : "", length);
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
@@ -512,8 +599,11 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
-				|| (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+				|| (in && buffer_read_space(ctx) < 1)) {
+			ctx->retval = mpsse_submit_buffer(ctx);
+			if (ctx->retval != ERROR_OK)
+				return;
+		}
 
 		if (length < 8) {
 			/* Transfer remaining bits in bit mode */
@@ -575,6 +665,8 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 	LOG_DEBUG_IO("%sout %d bits, tdi=%d", in ? "in" : "", length, tdi);
 	assert(out);
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
@@ -586,8 +678,11 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
-		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1)) {
+			ctx->retval = mpsse_submit_buffer(ctx);
+			if (ctx->retval != ERROR_OK)
+				return;
+		}
 
 		/* Byte transfer */
 		unsigned this_bits = length;
@@ -624,13 +719,18 @@ void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t d
 {
 	LOG_DEBUG_IO("-");
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 3) {
+		ctx->retval = mpsse_submit_buffer(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
 
 	buffer_write_byte(ctx, 0x80);
 	buffer_write_byte(ctx, data);
@@ -641,13 +741,18 @@ void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t
 {
 	LOG_DEBUG_IO("-");
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 3) {
+		ctx->retval = mpsse_submit_buffer(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
 
 	buffer_write_byte(ctx, 0x82);
 	buffer_write_byte(ctx, data);
@@ -658,13 +763,18 @@ void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data)
 {
 	LOG_DEBUG_IO("-");
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1) {
+		ctx->retval = mpsse_submit_buffer(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
 
 	buffer_write_byte(ctx, 0x81);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -674,13 +784,18 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 {
 	LOG_DEBUG_IO("-");
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1) {
+		ctx->retval = mpsse_submit_buffer(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
 
 	buffer_write_byte(ctx, 0x83);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -689,13 +804,18 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 static void single_byte_boolean_helper(struct mpsse_ctx *ctx, bool var, uint8_t val_if_true,
 	uint8_t val_if_false)
 {
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 1) {
+		ctx->retval = mpsse_submit_buffer(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
 
 	buffer_write_byte(ctx, var ? val_if_true : val_if_false);
 }
@@ -710,13 +830,18 @@ void mpsse_set_divisor(struct mpsse_ctx *ctx, uint16_t divisor)
 {
 	LOG_DEBUG("%d", divisor);
 
+	mpsse_flush_wait_pending(ctx);
+
 	if (ctx->retval != ERROR_OK) {
 		LOG_DEBUG_IO("Ignoring command due to previous error");
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 3) {
+		ctx->retval = mpsse_submit_buffer(ctx);
+		if (ctx->retval != ERROR_OK)
+			return;
+	}
 
 	buffer_write_byte(ctx, 0x86);
 	buffer_write_byte(ctx, divisor & 0xff);
@@ -776,17 +901,21 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 	return frequency;
 }
 
-/* Context needed by the callbacks */
-struct transfer_result {
-	struct mpsse_ctx *ctx;
-	bool done;
-	unsigned transferred;
-};
+static void mpsse_flights_submit_read(struct mpsse_ctx *ctx);
 
+/* Partial transfers are resubmitted unless they were cancelled or failed */
+static bool transfer_can_continue(const struct libusb_transfer *transfer)
+{
+	return transfer->status == LIBUSB_TRANSFER_COMPLETED ||
+		transfer->status == LIBUSB_TRANSFER_TIMED_OUT;
+}
+
+/* Context needed by the callbacks */
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 {
 	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_flight *flight = res->flight;
+	struct mpsse_ctx *ctx = flight->ctx;
 
 	unsigned packet_size = ctx->max_packet_size;
 
@@ -800,103 +929,161 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 		unsigned this_size = packet_size - 2;
 		if (this_size > chunk_remains - 2)
 			this_size = chunk_remains - 2;
-		if (this_size > ctx->read_count - res->transferred)
-			this_size = ctx->read_count - res->transferred;
-		memcpy(ctx->read_buffer + res->transferred,
-			ctx->read_chunk + packet_size * i + 2,
+		if (this_size > flight->read_count - res->transferred)
+			this_size = flight->read_count - res->transferred;
+		memcpy(flight->read_buffer + res->transferred,
+			flight->read_chunk + packet_size * i + 2,
 			this_size);
 		res->transferred += this_size;
 		chunk_remains -= this_size + 2;
-		if (res->transferred == ctx->read_count) {
+		if (res->transferred == flight->read_count) {
 			res->done = true;
 			break;
 		}
 	}
 
 	LOG_DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
-		ctx->read_count);
+		flight->read_count);
 
-	if (!res->done)
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
-			res->done = true;
+	/* the short count reports the error */
+	if (!res->done && (!transfer_can_continue(transfer) ||
+			libusb_submit_transfer(transfer) != LIBUSB_SUCCESS))
+		res->done = true;
+
+	/* the next flight's data follows on the same endpoint */
+	if (res->done)
+		mpsse_flights_submit_read(ctx);
 }
 
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 {
 	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_flight *flight = res->flight;
+	struct mpsse_ctx *ctx = flight->ctx;
 
 	res->transferred += transfer->actual_length;
 
-	LOG_DEBUG_IO("transferred %d of %d", res->transferred, ctx->write_count);
+	LOG_DEBUG_IO("transferred %d of %d", res->transferred, flight->write_count);
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
-	if (res->transferred == ctx->write_count)
+	if (res->transferred == flight->write_count)
+		res->done = true;
+	else if (!transfer_can_continue(transfer) ||
+			flight != &ctx->flights[(ctx->flight_head + ctx->flight_count - 1) % MPSSE_FLIGHTS])
+		/* the rest can't be sent behind the writes queued after this one */
 		res->done = true;
 	else {
-		transfer->length = ctx->write_count - res->transferred;
-		transfer->buffer = ctx->write_buffer + res->transferred;
+		transfer->length = flight->write_count - res->transferred;
+		transfer->buffer = flight->write_buffer + res->transferred;
 		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
 	}
 }
 
-int mpsse_flush(struct mpsse_ctx *ctx)
+/* Only one read transfer is in flight at a time: a short read is resubmitted
+ * and must not end up behind the read of a later flight. Start the read of
+ * the oldest flight still waiting for data, once the one before is done. */
+static void mpsse_flights_submit_read(struct mpsse_ctx *ctx)
 {
-	int retval = ctx->retval;
+	for (unsigned int i = 0; i < ctx->flight_count; i++) {
+		struct mpsse_flight *flight = &ctx->flights[(ctx->flight_head + i) % MPSSE_FLIGHTS];
 
-	if (retval != ERROR_OK) {
-		LOG_DEBUG_IO("Ignoring flush due to previous error");
-		assert(ctx->write_count == 0 && ctx->read_count == 0);
-		ctx->retval = ERROR_OK;
-		return retval;
+		if (flight->read_result.done)
+			continue;
+		if (flight->read_submitted)
+			return;
+
+		libusb_fill_bulk_transfer(flight->read_transfer, ctx->usb_dev, ctx->in_ep,
+			flight->read_chunk, ctx->read_chunk_size, read_cb, &flight->read_result,
+			ctx->usb_read_timeout);
+		int retval = libusb_submit_transfer(flight->read_transfer);
+		if (retval != LIBUSB_SUCCESS) {
+			flight->usb_retval = retval;
+			flight->read_result.done = true;
+			continue;
+		}
+		flight->read_submitted = true;
+		return;
+	}
+}
+
+/* Hand the buffer filled so far to the device and continue in a free one */
+static int mpsse_submit_buffer(struct mpsse_ctx *ctx)
+{
+	if (ctx->write_count == 0)
+		return ERROR_OK;
+
+	/* wait for the oldest flight if all are busy */
+	if (ctx->flight_count == MPSSE_FLIGHTS) {
+		int retval = mpsse_flight_complete(ctx);
+		if (retval != ERROR_OK)
+			return retval;
 	}
 
 	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
 			ctx->read_count);
-	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
-
-	if (ctx->write_count == 0)
-		return retval;
 
-	struct libusb_transfer *read_transfer = NULL;
-	struct transfer_result read_result = { .ctx = ctx, .done = true };
-	if (ctx->read_count) {
+	if (ctx->read_count)
 		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
-		read_result.done = false;
-		/* delay read transaction to ensure the FTDI chip can support us with data
-		   immediately after processing the MPSSE commands in the write transaction */
-	}
-
-	struct transfer_result write_result = { .ctx = ctx, .done = false };
-	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
-	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
-		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
-	retval = libusb_submit_transfer(write_transfer);
-	if (retval != LIBUSB_SUCCESS)
-		goto error_check;
-
-	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
-			ctx->read_chunk_size, read_cb, &read_result,
-			ctx->usb_read_timeout);
-		retval = libusb_submit_transfer(read_transfer);
-		if (retval != LIBUSB_SUCCESS)
-			goto error_check;
+
+	struct mpsse_flight *flight = &ctx->flights[(ctx->flight_head + ctx->flight_count) % MPSSE_FLIGHTS];
+	uint8_t *write_buffer = flight->write_buffer;
+	uint8_t *read_buffer = flight->read_buffer;
+	uint8_t *read_chunk = flight->read_chunk;
+
+	flight->write_buffer = ctx->write_buffer;
+	flight->write_count = ctx->write_count;
+	flight->read_buffer = ctx->read_buffer;
+	flight->read_count = ctx->read_count;
+	flight->read_chunk = ctx->read_chunk;
+	list_splice_init(&ctx->read_queue.list, &flight->read_queue.list);
+
+	ctx->write_buffer = write_buffer;
+	ctx->write_count = 0;
+	ctx->read_buffer = read_buffer;
+	ctx->read_count = 0;
+	ctx->read_chunk = read_chunk;
+
+	flight->write_result = (struct transfer_result){ .flight = flight, .done = false };
+	flight->read_result = (struct transfer_result){ .flight = flight, .done = !flight->read_count };
+	flight->read_submitted = false;
+	ctx->flight_count++;
+
+	libusb_fill_bulk_transfer(flight->write_transfer, ctx->usb_dev, ctx->out_ep, flight->write_buffer,
+		flight->write_count, write_cb, &flight->write_result, ctx->usb_write_timeout);
+	flight->usb_retval = libusb_submit_transfer(flight->write_transfer);
+	if (flight->usb_retval != LIBUSB_SUCCESS) {
+		/* reported when the flight completes */
+		flight->write_result.done = true;
+		flight->read_result.done = true;
+		return ERROR_OK;
 	}
 
+	/* delay the read transaction to ensure the FTDI chip can support us with
+	 * data immediately after processing the MPSSE commands in the write */
+	mpsse_flights_submit_read(ctx);
+
+	/* run callbacks that are due, so reads chained behind finished ones get
+	 * submitted while the next buffer is filled */
+	struct timeval poll_usb = { .tv_sec = 0, .tv_usec = 0 };
+	libusb_handle_events_timeout_completed(ctx->usb_ctx, &poll_usb, NULL);
+
+	return ERROR_OK;
+}
+
+static void mpsse_flight_wait(struct mpsse_ctx *ctx, struct mpsse_flight *flight)
+{
 	/* Polling loop, more or less taken from libftdi */
 	int64_t start = timeval_ms();
 	int64_t warn_after = 2000;
-	while (!write_result.done || !read_result.done) {
+	while (!flight->write_result.done || !flight->read_result.done) {
 		struct timeval timeout_usb;
 
 		timeout_usb.tv_sec = 1;
 		timeout_usb.tv_usec = 0;
 
-		retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
+		int retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
 		keep_alive();
 
 		int64_t now = timeval_ms();
@@ -910,43 +1097,125 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 			continue;
 
 		if (retval != LIBUSB_SUCCESS) {
-			libusb_cancel_transfer(write_transfer);
-			if (read_transfer)
-				libusb_cancel_transfer(read_transfer);
+			if (flight->usb_retval == LIBUSB_SUCCESS)
+				flight->usb_retval = retval;
+			if (!flight->write_result.done)
+				libusb_cancel_transfer(flight->write_transfer);
+			if (flight->read_submitted && !flight->read_result.done)
+				libusb_cancel_transfer(flight->read_transfer);
 		}
 	}
+}
+
+/* Cancel whatever is still in flight and drop its read data */
+static void mpsse_flights_abort(struct mpsse_ctx *ctx)
+{
+	for (unsigned int i = 0; i < ctx->flight_count; i++) {
+		struct mpsse_flight *flight = &ctx->flights[(ctx->flight_head + i) % MPSSE_FLIGHTS];
+
+		if (!flight->write_result.done)
+			libusb_cancel_transfer(flight->write_transfer);
+		if (!flight->read_submitted)
+			flight->read_result.done = true;	/* never start it */
+		else if (!flight->read_result.done)
+			libusb_cancel_transfer(flight->read_transfer);
+	}
+
+	while (ctx->flight_count) {
+		struct mpsse_flight *flight = &ctx->flights[ctx->flight_head];
 
-error_check:
+		mpsse_flight_wait(ctx, flight);
+		bit_copy_discard(&flight->read_queue);
+		ctx->flight_head = (ctx->flight_head + 1) % MPSSE_FLIGHTS;
+		ctx->flight_count--;
+	}
+}
+
+/* Wait for the oldest flight and copy its read data out */
+static int mpsse_flight_complete(struct mpsse_ctx *ctx)
+{
+	struct mpsse_flight *flight = &ctx->flights[ctx->flight_head];
+
+	mpsse_flight_wait(ctx, flight);
+
+	int retval = flight->usb_retval;
 	if (retval != LIBUSB_SUCCESS) {
 		LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(retval));
 		retval = ERROR_FAIL;
-	} else if (write_result.transferred < ctx->write_count) {
+	} else if (flight->write_result.transferred < flight->write_count) {
 		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
-			write_result.transferred,
-			ctx->write_count);
+			flight->write_result.transferred,
+			flight->write_count);
 		retval = ERROR_FAIL;
-	} else if (read_result.transferred < ctx->read_count) {
+	} else if (flight->read_result.transferred < flight->read_count) {
 		LOG_ERROR("ftdi device did not return all data: %d, expected %d",
-			read_result.transferred,
-			ctx->read_count);
+			flight->read_result.transferred,
+			flight->read_count);
 		retval = ERROR_FAIL;
-	} else if (ctx->read_count) {
-		ctx->write_count = 0;
-		ctx->read_count = 0;
-		bit_copy_execute(&ctx->read_queue);
-		retval = ERROR_OK;
 	} else {
-		ctx->write_count = 0;
-		bit_copy_discard(&ctx->read_queue);
+		bit_copy_execute(&flight->read_queue);
 		retval = ERROR_OK;
 	}
 
-	if (retval != ERROR_OK)
-		mpsse_purge(ctx);
+	bit_copy_discard(&flight->read_queue);
+	ctx->flight_head = (ctx->flight_head + 1) % MPSSE_FLIGHTS;
+	ctx->flight_count--;
 
-	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
+	if (retval != ERROR_OK) {
+		/* the ones behind it have lost sync with the command stream */
+		ctx->flush_pending = false;
+		mpsse_purge(ctx);
+	}
 
 	return retval;
 }
+
+int mpsse_flush_submit(struct mpsse_ctx *ctx)
+{
+	mpsse_flush_wait_pending(ctx);
+
+	int retval = ctx->retval;
+
+	if (retval != ERROR_OK) {
+		LOG_DEBUG_IO("Ignoring flush due to previous error");
+		assert(ctx->write_count == 0 && ctx->read_count == 0);
+		ctx->retval = ERROR_OK;
+		return retval;
+	}
+
+	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
+
+	retval = mpsse_submit_buffer(ctx);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* buffers submitted while queuing are waited for too */
+	ctx->flush_pending = ctx->flight_count > 0;
+
+	return ERROR_OK;
+}
+
+int mpsse_flush_complete(struct mpsse_ctx *ctx)
+{
+	if (!ctx->flush_pending)
+		return ERROR_OK;
+
+	ctx->flush_pending = false;
+
+	while (ctx->flight_count) {
+		int retval = mpsse_flight_complete(ctx);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+int mpsse_flush(struct mpsse_ctx *ctx)
+{
+	int retval = mpsse_flush_submit(ctx);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mpsse_flush_complete(ctx);
+}
@@ -68,6 +68,11 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency);
 
 /* Queue handling */
 int mpsse_flush(struct mpsse_ctx *ctx);
+/* Split flush: mpsse_flush_submit() starts the USB transfers and returns,
+ * mpsse_flush_complete() waits for them and copies the read data out. Any
+ * other call on the context in between waits for the completion first. */
+int mpsse_flush_submit(struct mpsse_ctx *ctx);
+int mpsse_flush_complete(struct mpsse_ctx *ctx);
 void mpsse_purge(struct mpsse_ctx *ctx);
 
 #endif /* OPENOCD_JTAG_DRIVERS_MPSSE_H */
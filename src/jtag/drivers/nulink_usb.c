@@ -477,6 +477,79 @@ static int nulink_usb_write_reg(void *handle, unsigned int regsel, uint32_t val)
 	return nulink_usb_xfer(handle, h->databuf, 4 * 2);
 }
 
+/* Registers per CMD_WRITE_REG, as many as the memory accesses use */
+#define NULINK_REGS_PER_COMMAND	3
+
+/* Read a set of registers into vals_in, or write them from vals_out */
+static int nulink_usb_access_regs(void *handle, const unsigned int *regsels,
+		uint32_t *vals_in, const uint32_t *vals_out, unsigned int count)
+{
+	struct nulink_usb_handle *h = handle;
+
+	assert(handle);
+
+	while (count) {
+		unsigned int n = MIN(count, NULINK_REGS_PER_COMMAND);
+
+		nulink_usb_init_buffer(handle, 8 + 12 * n);
+		/* set command ID */
+		h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_REG);
+		h->cmdidx += 4;
+		/* Count of registers */
+		h->cmdbuf[h->cmdidx] = n;
+		h->cmdidx += 1;
+		/* Array of bool value (u8ReadOld) */
+		h->cmdbuf[h->cmdidx] = vals_out ? 0x00 : 0xFF;
+		h->cmdidx += 1;
+		/* Array of bool value (u8Verify) */
+		h->cmdbuf[h->cmdidx] = 0x00;
+		h->cmdidx += 1;
+		/* ignore */
+		h->cmdbuf[h->cmdidx] = 0;
+		h->cmdidx += 1;
+
+		for (unsigned int i = 0; i < n; i++) {
+			/* u32Addr */
+			h_u32_to_le(h->cmdbuf + h->cmdidx, regsels[i]);
+			h->cmdidx += 4;
+			/* u32Data */
+			h_u32_to_le(h->cmdbuf + h->cmdidx, vals_out ? vals_out[i] : 0);
+			h->cmdidx += 4;
+			/* u32Mask */
+			h_u32_to_le(h->cmdbuf + h->cmdidx, vals_out ? 0x00000000UL : 0xFFFFFFFFUL);
+			h->cmdidx += 4;
+		}
+
+		int res = nulink_usb_xfer(handle, h->databuf, 4 * n * 2);
+		if (res != ERROR_OK)
+			return res;
+
+		if (vals_in) {
+			for (unsigned int i = 0; i < n; i++)
+				vals_in[i] = le_to_h_u32(h->databuf + 4 * (2 * i + 1));
+			vals_in += n;
+		}
+		if (vals_out)
+			vals_out += n;
+		regsels += n;
+		count -= n;
+	}
+
+	return ERROR_OK;
+}
+
+static int nulink_usb_read_regs(void *handle, const unsigned int *regsels,
+		uint32_t *vals, unsigned int count)
+{
+	return nulink_usb_access_regs(handle, regsels, vals, NULL, count);
+}
+
+static int nulink_usb_write_regs(void *handle, const unsigned int *regsels,
+		const uint32_t *vals, unsigned int count)
+{
+	return nulink_usb_access_regs(handle, regsels, NULL, vals, count);
+}
+
 static int nulink_usb_read_mem8(void *handle, uint32_t addr, uint16_t len,
 		uint8_t *buffer)
 {
@@ -1166,6 +1239,8 @@ struct hl_layout_api nulink_usb_layout_api = {
 	.step = nulink_usb_step,
 	.read_reg = nulink_usb_read_reg,
 	.write_reg = nulink_usb_write_reg,
+	.read_regs = nulink_usb_read_regs,
+	.write_regs = nulink_usb_write_regs,
 	.read_mem = nulink_usb_read_mem,
 	.write_mem = nulink_usb_write_mem,
 	.write_debug_reg = nulink_usb_write_debug_reg,
@@ -19,30 +19,46 @@
 #include "helper/system.h"
 #include "helper/replacements.h"
 #include <jtag/interface.h>
+#include <jtag/commands.h>
 #include "bitbang.h"
+#include "sim_shm.h"
 
 /* arbitrary limit on host name length: */
 #define REMOTE_BITBANG_HOST_MAX 255
 
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
+static char *remote_bitbang_shm_path;
+
+/* used instead of remote_bitbang_fd if "remote_bitbang shm" is set */
+static struct sim_shm *remote_bitbang_shm;
+
+/* Both buffers start small and grow with the queues being executed, up to
+ * REMOTE_BITBANG_BUF_MAX bytes. A larger receive buffer lets more TDO
+ * samples be outstanding before bitbang has to wait for them. */
+#define REMOTE_BITBANG_BUF_MIN 256
+#define REMOTE_BITBANG_BUF_MAX (64 * 1024)
 
 static int remote_bitbang_fd;
-static uint8_t remote_bitbang_send_buf[512];
+static uint8_t *remote_bitbang_send_buf;
+static unsigned int remote_bitbang_send_buf_size;
 static unsigned int remote_bitbang_send_buf_used;
 
 static bool use_remote_sleep;
 
 /* Circular buffer. When start == end, the buffer is empty. */
-static char remote_bitbang_recv_buf[256];
+static char *remote_bitbang_recv_buf;
+static unsigned int remote_bitbang_recv_buf_size;
 static unsigned int remote_bitbang_recv_buf_start;
 static unsigned int remote_bitbang_recv_buf_end;
 
+static struct bitbang_interface remote_bitbang_bitbang;
+
 static bool remote_bitbang_recv_buf_full(void)
 {
 	return remote_bitbang_recv_buf_end ==
-		((remote_bitbang_recv_buf_start + sizeof(remote_bitbang_recv_buf) - 1) %
-		 sizeof(remote_bitbang_recv_buf));
+		((remote_bitbang_recv_buf_start + remote_bitbang_recv_buf_size - 1) %
+		 remote_bitbang_recv_buf_size);
 }
 
 static bool remote_bitbang_recv_buf_empty(void)
@@ -53,7 +69,7 @@ static bool remote_bitbang_recv_buf_empty(void)
 static unsigned int remote_bitbang_recv_buf_contiguous_available_space(void)
 {
 	if (remote_bitbang_recv_buf_end >= remote_bitbang_recv_buf_start) {
-		unsigned int space = sizeof(remote_bitbang_recv_buf) -
+		unsigned int space = remote_bitbang_recv_buf_size -
 				     remote_bitbang_recv_buf_end;
 		if (remote_bitbang_recv_buf_start == 0)
 			space -= 1;
@@ -64,15 +80,87 @@ static unsigned int remote_bitbang_recv_buf_contiguous_available_space(void)
 	}
 }
 
+/* Resize the (empty) receive buffer to hold @a size bytes. */
+static int remote_bitbang_recv_buf_resize(unsigned int size)
+{
+	assert(remote_bitbang_recv_buf_empty());
+
+	char *buf = realloc(remote_bitbang_recv_buf, size);
+	if (!buf) {
+		LOG_ERROR("remote_bitbang: out of memory");
+		return ERROR_FAIL;
+	}
+
+	remote_bitbang_recv_buf = buf;
+	remote_bitbang_recv_buf_size = size;
+	remote_bitbang_recv_buf_start = 0;
+	remote_bitbang_recv_buf_end = 0;
+	/* one slot always stays free to tell a full buffer from an empty one */
+	remote_bitbang_bitbang.buf_size = size - 1;
+	return ERROR_OK;
+}
+
+static bool remote_bitbang_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+enum block_bool {
+	NO_BLOCK,
+	BLOCK
+};
+
+static int remote_bitbang_fill_buf(enum block_bool block);
+
+/* The remote end stopped accepting data, most likely because it is stuck
+ * writing replies we have not read yet. Take in what is there and wait until
+ * the socket becomes writable again. */
+static int remote_bitbang_wait_writable(void)
+{
+	if (remote_bitbang_fill_buf(NO_BLOCK) != ERROR_OK)
+		return ERROR_FAIL;
+
+	fd_set write_fds, read_fds;
+	FD_ZERO(&write_fds);
+	FD_ZERO(&read_fds);
+	FD_SET(remote_bitbang_fd, &write_fds);
+	if (!remote_bitbang_recv_buf_full())
+		FD_SET(remote_bitbang_fd, &read_fds);
+
+	if (socket_select(remote_bitbang_fd + 1, &read_fds, &write_fds, NULL, NULL) < 0) {
+		log_socket_error("remote_bitbang_wait_writable");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
 static int remote_bitbang_flush(void)
 {
 	if (remote_bitbang_send_buf_used <= 0)
 		return ERROR_OK;
 
+	if (remote_bitbang_shm) {
+		int retval = sim_shm_write(remote_bitbang_shm, remote_bitbang_send_buf,
+				remote_bitbang_send_buf_used);
+		remote_bitbang_send_buf_used = 0;
+		return retval;
+	}
+
 	unsigned int offset = 0;
 	while (offset < remote_bitbang_send_buf_used) {
 		ssize_t written = write_socket(remote_bitbang_fd, remote_bitbang_send_buf + offset,
 									   remote_bitbang_send_buf_used - offset);
+		if (written < 0 && remote_bitbang_would_block()) {
+			if (remote_bitbang_wait_writable() != ERROR_OK) {
+				remote_bitbang_send_buf_used = 0;
+				return ERROR_FAIL;
+			}
+			continue;
+		}
 		if (written < 0) {
 			log_socket_error("remote_bitbang_putc");
 			remote_bitbang_send_buf_used = 0;
@@ -84,11 +172,6 @@ static int remote_bitbang_flush(void)
 	return ERROR_OK;
 }
 
-enum block_bool {
-	NO_BLOCK,
-	BLOCK
-};
-
 /* Read any incoming data, placing it into the buffer. */
 static int remote_bitbang_fill_buf(enum block_bool block)
 {
@@ -102,9 +185,29 @@ static int remote_bitbang_fill_buf(enum block_bool block)
 	if (block == BLOCK) {
 		if (remote_bitbang_flush() != ERROR_OK)
 			return ERROR_FAIL;
-		socket_block(remote_bitbang_fd);
 	}
 
+	if (remote_bitbang_shm) {
+		while (!remote_bitbang_recv_buf_full()) {
+			int count = sim_shm_read(remote_bitbang_shm,
+					remote_bitbang_recv_buf + remote_bitbang_recv_buf_end,
+					remote_bitbang_recv_buf_contiguous_available_space(),
+					block == BLOCK);
+			if (count < 0)
+				return ERROR_FAIL;
+			if (count == 0)
+				break;
+			remote_bitbang_recv_buf_end += count;
+			if (remote_bitbang_recv_buf_end == remote_bitbang_recv_buf_size)
+				remote_bitbang_recv_buf_end = 0;
+			block = NO_BLOCK;
+		}
+		return ERROR_OK;
+	}
+
+	if (block == BLOCK)
+		socket_block(remote_bitbang_fd);
+
 	bool first = true;
 	while (!remote_bitbang_recv_buf_full()) {
 		unsigned int contiguous_available_space =
@@ -116,7 +219,7 @@ static int remote_bitbang_fill_buf(enum block_bool block)
 			socket_nonblock(remote_bitbang_fd);
 		if (count > 0) {
 			remote_bitbang_recv_buf_end += count;
-			if (remote_bitbang_recv_buf_end == sizeof(remote_bitbang_recv_buf))
+			if (remote_bitbang_recv_buf_end == remote_bitbang_recv_buf_size)
 				remote_bitbang_recv_buf_end = 0;
 		} else if (count == 0) {
 			/* When read_socket returns 0, socket reached EOF and there is
@@ -128,11 +231,7 @@ static int remote_bitbang_fill_buf(enum block_bool block)
 			}
 			return ERROR_OK;
 		} else if (count < 0) {
-#ifdef _WIN32
-			if (WSAGetLastError() == WSAEWOULDBLOCK) {
-#else
-			if (errno == EAGAIN) {
-#endif
+			if (remote_bitbang_would_block()) {
 				return ERROR_OK;
 			} else {
 				log_socket_error("remote_bitbang_fill_buf");
@@ -152,9 +251,21 @@ typedef enum {
 
 static int remote_bitbang_queue(int c, flush_bool_t flush)
 {
+	if (remote_bitbang_send_buf_used == remote_bitbang_send_buf_size) {
+		/* grow before falling back to a write of a full buffer */
+		uint8_t *buf = NULL;
+		if (remote_bitbang_send_buf_size < REMOTE_BITBANG_BUF_MAX)
+			buf = realloc(remote_bitbang_send_buf, 2 * remote_bitbang_send_buf_size);
+		if (buf) {
+			remote_bitbang_send_buf = buf;
+			remote_bitbang_send_buf_size *= 2;
+		} else if (remote_bitbang_flush() != ERROR_OK) {
+			return ERROR_FAIL;
+		}
+	}
+
 	remote_bitbang_send_buf[remote_bitbang_send_buf_used++] = c;
-	if (flush == FLUSH_SEND_BUF ||
-			remote_bitbang_send_buf_used >= ARRAY_SIZE(remote_bitbang_send_buf))
+	if (flush == FLUSH_SEND_BUF)
 		return remote_bitbang_flush();
 	return ERROR_OK;
 }
@@ -164,13 +275,23 @@ static int remote_bitbang_quit(void)
 	if (remote_bitbang_queue('Q', FLUSH_SEND_BUF) == ERROR_FAIL)
 		return ERROR_FAIL;
 
-	if (close_socket(remote_bitbang_fd) != 0) {
+	if (remote_bitbang_shm) {
+		sim_shm_close(remote_bitbang_shm);
+		remote_bitbang_shm = NULL;
+	} else if (close_socket(remote_bitbang_fd) != 0) {
 		log_socket_error("close_socket");
 		return ERROR_FAIL;
 	}
 
 	free(remote_bitbang_host);
 	free(remote_bitbang_port);
+	free(remote_bitbang_shm_path);
+	free(remote_bitbang_send_buf);
+	remote_bitbang_send_buf = NULL;
+	remote_bitbang_send_buf_size = 0;
+	free(remote_bitbang_recv_buf);
+	remote_bitbang_recv_buf = NULL;
+	remote_bitbang_recv_buf_size = 0;
 
 	LOG_INFO("remote_bitbang interface quit");
 	return ERROR_OK;
@@ -207,7 +328,7 @@ static bb_value_t remote_bitbang_read_sample(void)
 	assert(!remote_bitbang_recv_buf_empty());
 	int c = remote_bitbang_recv_buf[remote_bitbang_recv_buf_start];
 	remote_bitbang_recv_buf_start =
-		(remote_bitbang_recv_buf_start + 1) % sizeof(remote_bitbang_recv_buf);
+		(remote_bitbang_recv_buf_start + 1) % remote_bitbang_recv_buf_size;
 	return char_to_int(c);
 }
 
@@ -217,6 +338,23 @@ static int remote_bitbang_write(int tck, int tms, int tdi)
 	return remote_bitbang_queue(c, NO_FLUSH);
 }
 
+/* Out-only runs, TDO samples always go through remote_bitbang_sample(). */
+static int remote_bitbang_shift(const struct bitbang_shift *shift)
+{
+	if (shift->tdo)
+		return ERROR_NOT_IMPLEMENTED;
+
+	for (unsigned int i = 0; i < shift->num_bits; i++) {
+		char c = '0' + ((bitbang_shift_tms(shift, i) ? 0x2 : 0x0) |
+				(bitbang_shift_tdi(shift, i) ? 0x1 : 0x0));
+		if (remote_bitbang_queue(c, NO_FLUSH) != ERROR_OK ||
+				remote_bitbang_queue(c + 0x4, NO_FLUSH) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_reset(int trst, int srst)
 {
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
@@ -279,10 +417,11 @@ static int remote_bitbang_swd_write(int swclk, int swdio)
 }
 
 static struct bitbang_interface remote_bitbang_bitbang = {
-	.buf_size = sizeof(remote_bitbang_recv_buf) - 1,
+	/* set by remote_bitbang_recv_buf_resize() */
 	.sample = &remote_bitbang_sample,
 	.read_sample = &remote_bitbang_read_sample,
 	.write = &remote_bitbang_write,
+	.shift = &remote_bitbang_shift,
 	.swdio_read = &remote_bitbang_swdio_read,
 	.swdio_drive = &remote_bitbang_swdio_drive,
 	.swd_write = &remote_bitbang_swd_write,
@@ -372,10 +511,32 @@ static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
 
+	remote_bitbang_send_buf = malloc(REMOTE_BITBANG_BUF_MIN);
+	if (!remote_bitbang_send_buf) {
+		LOG_ERROR("remote_bitbang: out of memory");
+		return ERROR_FAIL;
+	}
+	remote_bitbang_send_buf_size = REMOTE_BITBANG_BUF_MIN;
+	remote_bitbang_send_buf_used = 0;
+
 	remote_bitbang_recv_buf_start = 0;
 	remote_bitbang_recv_buf_end = 0;
+	if (remote_bitbang_recv_buf_resize(REMOTE_BITBANG_BUF_MIN) != ERROR_OK)
+		return ERROR_FAIL;
 
 	LOG_INFO("Initializing remote_bitbang driver");
+	if (remote_bitbang_shm_path) {
+		remote_bitbang_shm = sim_shm_open(remote_bitbang_shm_path);
+		if (!remote_bitbang_shm)
+			return ERROR_FAIL;
+		size_t ring_size = sim_shm_ring_size(remote_bitbang_shm);
+		if (ring_size < REMOTE_BITBANG_BUF_MIN &&
+				remote_bitbang_recv_buf_resize(ring_size + 1) != ERROR_OK)
+			return ERROR_FAIL;
+		LOG_INFO("remote_bitbang driver initialized");
+		return ERROR_OK;
+	}
+
 	if (!remote_bitbang_port)
 		remote_bitbang_fd = remote_bitbang_init_unix();
 	else
@@ -412,6 +573,16 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_shm_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(remote_bitbang_shm_path);
+	remote_bitbang_shm_path = strdup(CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
 static const char * const remote_bitbang_transports[] = { "jtag", "swd", NULL };
 
 COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_use_remote_sleep_command)
@@ -441,6 +612,14 @@ static const struct command_registration remote_bitbang_subcommand_handlers[] =
 			"  if port is 0 or unset, this is the name of the unix socket to use.",
 		.usage = "host_name",
 	},
+	{
+		.name = "shm",
+		.handler = remote_bitbang_handle_remote_bitbang_shm_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Talk to the remote jtag through a shared memory file "
+			"instead of a socket.",
+		.usage = "path",
+	},
 	{
 		.name = "use_remote_sleep",
 		.handler = remote_bitbang_handle_remote_bitbang_use_remote_sleep_command,
@@ -469,6 +648,26 @@ static int remote_bitbang_execute_queue(struct jtag_command *cmd_queue)
 	 * previous transactions */
 	assert(remote_bitbang_send_buf_used == 0);
 
+	/* Size the receive buffer so that all TDO samples of the queue can be
+	 * outstanding at once, and bitbang only waits for them at the end. */
+	size_t in_bits = 0;
+	for (struct jtag_command *cmd = cmd_queue; cmd; cmd = cmd->next) {
+		if (cmd->type == JTAG_SCAN && jtag_scan_type(cmd->cmd.scan) != SCAN_OUT)
+			in_bits += jtag_scan_size(cmd->cmd.scan);
+	}
+	/* With shared memory, all outstanding replies must fit in the ring, or
+	 * both sides could end up waiting for space. */
+	unsigned int max_size = REMOTE_BITBANG_BUF_MAX;
+	if (remote_bitbang_shm)
+		max_size = MIN(max_size, sim_shm_ring_size(remote_bitbang_shm) + 1);
+	if (in_bits >= remote_bitbang_recv_buf_size &&
+			remote_bitbang_recv_buf_size < max_size &&
+			remote_bitbang_recv_buf_empty()) {
+		unsigned int size = MIN(in_bits + 1, max_size);
+		if (remote_bitbang_recv_buf_resize(size) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
 	/* process the JTAG command queue */
 	int ret = bitbang_execute_queue(cmd_queue);
 	if (ret != ERROR_OK)
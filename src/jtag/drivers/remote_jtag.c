@@ -0,0 +1,504 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Adapter driver that sends whole JTAG queues to the remote_jtag_server of
+ * an OpenOCD next to the probe, see jtag/remote_jtag.h. Unlike
+ * remote_bitbang, which needs a round trip for every TDO sample, a queue
+ * costs one round trip however long it is, which makes probes usable over
+ * links with a high latency.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _WIN32
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#endif
+#include "helper/system.h"
+#include "helper/replacements.h"
+#include <jtag/interface.h>
+#include <jtag/commands.h>
+#include <jtag/remote_jtag.h>
+
+static char *remote_jtag_host;
+static char *remote_jtag_port;
+static int remote_jtag_fd = -1;
+
+/* Request being built, grows with the queues */
+static uint8_t *remote_jtag_buf;
+static size_t remote_jtag_buf_size;
+static size_t remote_jtag_buf_used;
+static bool remote_jtag_buf_error;
+
+static void remote_jtag_put(const void *data, size_t length)
+{
+	if (remote_jtag_buf_error)
+		return;
+
+	if (remote_jtag_buf_used + length > remote_jtag_buf_size) {
+		size_t size = MAX(2 * remote_jtag_buf_size, remote_jtag_buf_used + length);
+		uint8_t *buf = realloc(remote_jtag_buf, size);
+		if (!buf) {
+			LOG_ERROR("Out of memory");
+			remote_jtag_buf_error = true;
+			return;
+		}
+		remote_jtag_buf = buf;
+		remote_jtag_buf_size = size;
+	}
+
+	memcpy(remote_jtag_buf + remote_jtag_buf_used, data, length);
+	remote_jtag_buf_used += length;
+}
+
+static void remote_jtag_put_u8(uint8_t value)
+{
+	remote_jtag_put(&value, 1);
+}
+
+static void remote_jtag_put_u32(uint32_t value)
+{
+	uint8_t buf[4];
+	h_u32_to_le(buf, value);
+	remote_jtag_put(buf, sizeof(buf));
+}
+
+static int remote_jtag_write_all(const uint8_t *data, size_t length)
+{
+	while (length > 0) {
+		int written = write_socket(remote_jtag_fd, data, length);
+		if (written <= 0) {
+			log_socket_error("remote_jtag");
+			return ERROR_FAIL;
+		}
+		data += written;
+		length -= written;
+	}
+	return ERROR_OK;
+}
+
+static int remote_jtag_read_all(uint8_t *data, size_t length)
+{
+	while (length > 0) {
+		int count = read_socket(remote_jtag_fd, data, length);
+		if (count == 0) {
+			LOG_ERROR("remote_jtag: connection closed by the server");
+			return ERROR_FAIL;
+		}
+		if (count < 0) {
+			log_socket_error("remote_jtag");
+			return ERROR_FAIL;
+		}
+		data += count;
+		length -= count;
+	}
+	return ERROR_OK;
+}
+
+/* Send the frame, wait for the answer of type "reply_type" and decode it. */
+static int remote_jtag_transact(unsigned int type, const uint8_t *payload, size_t length,
+		unsigned int reply_type, uint8_t **reply, size_t *reply_length)
+{
+	size_t frame_length;
+	uint8_t *frame = remote_jtag_frame(type, payload, length, &frame_length);
+	if (!frame)
+		return ERROR_FAIL;
+	int retval = remote_jtag_write_all(frame, frame_length);
+	free(frame);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint8_t header[REMOTE_JTAG_HEADER_SIZE];
+	retval = remote_jtag_read_all(header, sizeof(header));
+	if (retval != ERROR_OK)
+		return retval;
+
+	unsigned int received_type;
+	size_t wire_length, raw_length;
+	if (remote_jtag_parse_header(header, &received_type, &wire_length, &raw_length) != ERROR_OK ||
+			received_type != reply_type) {
+		LOG_ERROR("remote_jtag: invalid answer from the server");
+		return ERROR_FAIL;
+	}
+
+	uint8_t *wire = malloc(wire_length + 1);
+	uint8_t *raw = malloc(raw_length + 1);
+	if (!wire || !raw) {
+		free(wire);
+		free(raw);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = remote_jtag_read_all(wire, wire_length);
+	if (retval == ERROR_OK) {
+		retval = remote_jtag_decode_payload(header, wire, raw);
+		if (retval != ERROR_OK)
+			LOG_ERROR("remote_jtag: corrupt answer from the server");
+	}
+	free(wire);
+	if (retval != ERROR_OK) {
+		free(raw);
+		return retval;
+	}
+
+	*reply = raw;
+	*reply_length = raw_length;
+	return ERROR_OK;
+}
+
+/* Run the request built so far, "captured" gets the captured bits. */
+static int remote_jtag_run(uint8_t **captured, size_t captured_length)
+{
+	if (remote_jtag_buf_error) {
+		remote_jtag_buf_used = 0;
+		remote_jtag_buf_error = false;
+		return ERROR_FAIL;
+	}
+
+	uint8_t *reply;
+	size_t reply_length;
+	int retval = remote_jtag_transact(REMOTE_JTAG_REQUEST, remote_jtag_buf,
+			remote_jtag_buf_used, REMOTE_JTAG_REPLY, &reply, &reply_length);
+	remote_jtag_buf_used = 0;
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (reply_length == 4 && captured_length && (int32_t)le_to_h_u32(reply) != ERROR_OK) {
+		/* the server refused the request, nothing was captured */
+		retval = (int32_t)le_to_h_u32(reply);
+		free(reply);
+		return retval;
+	}
+
+	if (reply_length != 4 + captured_length) {
+		LOG_ERROR("remote_jtag: answer of %zu bytes, expected %zu", reply_length,
+				4 + captured_length);
+		free(reply);
+		return ERROR_FAIL;
+	}
+
+	retval = (int32_t)le_to_h_u32(reply);
+	if (captured)
+		*captured = reply;
+	else
+		free(reply);
+	return retval;
+}
+
+static int remote_jtag_execute_queue(struct jtag_command *cmd_queue)
+{
+	size_t captured_length = 0;
+
+	if (!cmd_queue)
+		return ERROR_OK;
+
+	for (struct jtag_command *cmd = cmd_queue; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+		case JTAG_SCAN: {
+			struct scan_command *scan = cmd->cmd.scan;
+			const bool capture = jtag_scan_type(scan) != SCAN_OUT;
+			uint8_t *buffer;
+			int num_bits = jtag_build_buffer(scan, &buffer);
+			remote_jtag_put_u8(REMOTE_JTAG_OP_SCAN);
+			remote_jtag_put_u8((scan->ir_scan ? REMOTE_JTAG_SCAN_IR : 0) |
+					(capture ? REMOTE_JTAG_SCAN_CAPTURE : 0));
+			remote_jtag_put_u8(scan->end_state);
+			remote_jtag_put_u32(num_bits);
+			if (!buffer)
+				remote_jtag_buf_error = true;
+			else
+				remote_jtag_put(buffer, DIV_ROUND_UP(num_bits, 8));
+			free(buffer);
+			if (capture)
+				captured_length += DIV_ROUND_UP(num_bits, 8);
+			tap_set_state(scan->end_state);
+			break;
+		}
+		case JTAG_TLR_RESET:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_TLR);
+			tap_set_state(TAP_RESET);
+			break;
+		case JTAG_RUNTEST:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_RUNTEST);
+			remote_jtag_put_u32(cmd->cmd.runtest->num_cycles);
+			remote_jtag_put_u8(cmd->cmd.runtest->end_state);
+			tap_set_state(cmd->cmd.runtest->end_state);
+			break;
+		case JTAG_RESET:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_RESET);
+			remote_jtag_put_u8(cmd->cmd.reset->trst);
+			remote_jtag_put_u8(cmd->cmd.reset->srst);
+			if (cmd->cmd.reset->trst == 1)
+				tap_set_state(TAP_RESET);
+			break;
+		case JTAG_PATHMOVE:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_PATHMOVE);
+			remote_jtag_put_u32(cmd->cmd.pathmove->num_states);
+			for (int i = 0; i < cmd->cmd.pathmove->num_states; i++)
+				remote_jtag_put_u8(cmd->cmd.pathmove->path[i]);
+			tap_set_state(cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1]);
+			break;
+		case JTAG_SLEEP:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_SLEEP);
+			remote_jtag_put_u32(cmd->cmd.sleep->us);
+			break;
+		case JTAG_STABLECLOCKS:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_CLOCKS);
+			remote_jtag_put_u32(cmd->cmd.stableclocks->num_cycles);
+			break;
+		case JTAG_TMS:
+			remote_jtag_put_u8(REMOTE_JTAG_OP_TMS);
+			remote_jtag_put_u32(cmd->cmd.tms->num_bits);
+			remote_jtag_put(cmd->cmd.tms->bits, DIV_ROUND_UP(cmd->cmd.tms->num_bits, 8));
+			break;
+		default:
+			LOG_ERROR("BUG: unknown JTAG command type 0x%X", cmd->type);
+			remote_jtag_buf_used = 0;
+			return ERROR_FAIL;
+		}
+	}
+
+	uint8_t *reply = NULL;
+	int retval = remote_jtag_run(&reply, captured_length);
+	if (retval != ERROR_OK) {
+		free(reply);
+		return retval;
+	}
+
+	/* The captured bits come in the order of the scans */
+	size_t offset = 4;
+	for (struct jtag_command *cmd = cmd_queue; cmd; cmd = cmd->next) {
+		if (cmd->type != JTAG_SCAN || jtag_scan_type(cmd->cmd.scan) == SCAN_OUT)
+			continue;
+		if (jtag_read_buffer(reply + offset, cmd->cmd.scan) != ERROR_OK)
+			retval = ERROR_JTAG_QUEUE_FAILED;
+		offset += DIV_ROUND_UP(jtag_scan_size(cmd->cmd.scan), 8);
+	}
+
+	free(reply);
+	return retval;
+}
+
+static int remote_jtag_reset(int trst, int srst)
+{
+	remote_jtag_put_u8(REMOTE_JTAG_OP_ADAPTER_RESET);
+	remote_jtag_put_u8(trst);
+	remote_jtag_put_u8(srst);
+	return remote_jtag_run(NULL, 0);
+}
+
+static int remote_jtag_speed(int speed)
+{
+	remote_jtag_put_u8(REMOTE_JTAG_OP_SPEED);
+	remote_jtag_put_u32(speed);
+	return remote_jtag_run(NULL, 0);
+}
+
+/* The speed is the frequency in kHz, the server converts it for its adapter */
+static int remote_jtag_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int remote_jtag_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static int remote_jtag_init_tcp(void)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *result, *rp;
+	int fd = -1;
+
+	LOG_INFO("Connecting to %s:%s", remote_jtag_host ? remote_jtag_host : "localhost",
+			remote_jtag_port);
+
+	int s = getaddrinfo(remote_jtag_host, remote_jtag_port, &hints, &result);
+	if (s != 0) {
+		LOG_ERROR("getaddrinfo: %s", gai_strerror(s));
+		return ERROR_FAIL;
+	}
+
+	for (rp = result; rp; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (fd == -1)
+			continue;
+
+		if (connect(fd, rp->ai_addr, rp->ai_addrlen) != -1)
+			break;
+
+		close(fd);
+	}
+
+	freeaddrinfo(result);
+
+	if (!rp) {
+		log_socket_error("Failed to connect");
+		return ERROR_FAIL;
+	}
+
+	/* Each queue goes in one write, don't wait for more */
+	int one = 1;
+	/* On Windows optval has to be a const char *. */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+
+	return fd;
+}
+
+static int remote_jtag_init_unix(void)
+{
+	if (!remote_jtag_host) {
+		LOG_ERROR("host/socket not specified");
+		return ERROR_FAIL;
+	}
+
+	LOG_INFO("Connecting to unix socket %s", remote_jtag_host);
+	int fd = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		log_socket_error("socket");
+		return ERROR_FAIL;
+	}
+
+	struct sockaddr_un addr;
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, remote_jtag_host, sizeof(addr.sun_path));
+	addr.sun_path[sizeof(addr.sun_path) - 1] = '\0';
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) < 0) {
+		log_socket_error("connect");
+		close(fd);
+		return ERROR_FAIL;
+	}
+
+	return fd;
+}
+
+static int remote_jtag_init(void)
+{
+	if (remote_jtag_port)
+		remote_jtag_fd = remote_jtag_init_tcp();
+	else
+		remote_jtag_fd = remote_jtag_init_unix();
+	if (remote_jtag_fd < 0)
+		return remote_jtag_fd;
+
+	uint8_t version[4];
+	h_u32_to_le(version, REMOTE_JTAG_VERSION);
+	uint8_t *reply;
+	size_t reply_length;
+	int retval = remote_jtag_transact(REMOTE_JTAG_HELLO, version, sizeof(version),
+			REMOTE_JTAG_HELLO, &reply, &reply_length);
+	if (retval != ERROR_OK)
+		return retval;
+
+	const uint32_t server_version = reply_length >= 4 ? le_to_h_u32(reply) : 0;
+	free(reply);
+	if (server_version < REMOTE_JTAG_VERSION) {
+		LOG_ERROR("remote_jtag: server speaks version %" PRIu32 ", need %d",
+				server_version, REMOTE_JTAG_VERSION);
+		return ERROR_FAIL;
+	}
+
+	LOG_INFO("remote_jtag driver initialized");
+	return ERROR_OK;
+}
+
+static int remote_jtag_quit(void)
+{
+	if (remote_jtag_fd >= 0 && close_socket(remote_jtag_fd) != 0)
+		log_socket_error("close_socket");
+	remote_jtag_fd = -1;
+
+	free(remote_jtag_buf);
+	remote_jtag_buf = NULL;
+	remote_jtag_buf_size = 0;
+	free(remote_jtag_host);
+	remote_jtag_host = NULL;
+	free(remote_jtag_port);
+	remote_jtag_port = NULL;
+
+	LOG_INFO("remote_jtag interface quit");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_jtag_handle_port_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	uint16_t port;
+	COMMAND_PARSE_NUMBER(u16, CMD_ARGV[0], port);
+	free(remote_jtag_port);
+	remote_jtag_port = port == 0 ? NULL : strdup(CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_jtag_handle_host_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(remote_jtag_host);
+	remote_jtag_host = strdup(CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
+static const struct command_registration remote_jtag_subcommand_handlers[] = {
+	{
+		.name = "port",
+		.handler = remote_jtag_handle_port_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the port of the remote_jtag server.\n"
+			"  if 0 or unset, use unix sockets to connect to the server.",
+		.usage = "port_number",
+	},
+	{
+		.name = "host",
+		.handler = remote_jtag_handle_host_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the host of the remote_jtag server.\n"
+			"  if port is 0 or unset, this is the name of the unix socket to use.",
+		.usage = "host_name",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration remote_jtag_command_handlers[] = {
+	{
+		.name = "remote_jtag",
+		.mode = COMMAND_ANY,
+		.help = "perform remote_jtag management",
+		.chain = remote_jtag_subcommand_handlers,
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const char * const remote_jtag_transports[] = { "jtag", NULL };
+
+static struct jtag_interface remote_jtag_interface = {
+	.supported = DEBUG_CAP_TMS_SEQ,
+	.execute_queue = remote_jtag_execute_queue,
+};
+
+struct adapter_driver remote_jtag_adapter_driver = {
+	.name = "remote_jtag",
+	.transports = remote_jtag_transports,
+	.commands = remote_jtag_command_handlers,
+
+	.init = remote_jtag_init,
+	.quit = remote_jtag_quit,
+	.reset = remote_jtag_reset,
+	.speed = remote_jtag_speed,
+	.khz = remote_jtag_khz,
+	.speed_div = remote_jtag_speed_div,
+
+	.jtag_ops = &remote_jtag_interface,
+};
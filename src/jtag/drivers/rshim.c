@@ -403,6 +403,48 @@ static int rshim_dp_run(struct adiv5_dap *dap)
 	return retval;
 }
 
+/*
+ * Bursts of 32-bit accesses go straight to coresight_read()/coresight_write()
+ * instead of through the emulation of TAR and DRW for every word. The
+ * emulated TAR is left alone, it matches what arm_adi_v5 has cached.
+ */
+static int rshim_mem_ap_read_buf(struct adiv5_ap *ap, uint8_t *buffer,
+		uint32_t size, uint32_t count, target_addr_t address)
+{
+	if (size != 4 || address % 4 || is_adiv6(ap->dap))
+		return ERROR_NOT_IMPLEMENTED;
+
+	int rc = rshim_dp_run(ap->dap);
+	for (uint32_t i = 0; rc == ERROR_OK && i < count; i++) {
+		uint32_t addr = address + 4 * i, data;
+		int tile;
+
+		ap_addr_2_tile(&tile, &addr);
+		rc = coresight_read(tile, addr, &data);
+		h_u32_to_le(buffer + 4 * i, data);
+	}
+
+	return rc;
+}
+
+static int rshim_mem_ap_write_buf(struct adiv5_ap *ap, const uint8_t *buffer,
+		uint32_t size, uint32_t count, target_addr_t address)
+{
+	if (size != 4 || address % 4 || is_adiv6(ap->dap))
+		return ERROR_NOT_IMPLEMENTED;
+
+	int rc = rshim_dp_run(ap->dap);
+	for (uint32_t i = 0; rc == ERROR_OK && i < count; i++) {
+		uint32_t addr = address + 4 * i;
+		int tile;
+
+		ap_addr_2_tile(&tile, &addr);
+		rc = coresight_write(tile, addr, le_to_h_u32(buffer + 4 * i));
+	}
+
+	return rc;
+}
+
 static int rshim_connect(struct adiv5_dap *dap)
 {
 	char *path = rshim_dev_path ? rshim_dev_path : RSHIM_DEV_PATH_DEFAULT;
@@ -504,6 +546,8 @@ static const struct dap_ops rshim_dap_ops = {
 	.queue_ap_read = rshim_ap_q_read,
 	.queue_ap_write = rshim_ap_q_write,
 	.queue_ap_abort = rshim_ap_q_abort,
+	.mem_ap_read_buf = rshim_mem_ap_read_buf,
+	.mem_ap_write_buf = rshim_mem_ap_write_buf,
 	.run = rshim_dp_run,
 	.quit = rshim_disconnect,
 };
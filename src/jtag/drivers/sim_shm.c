@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Shared memory ring transport for simulator drivers, see sim_shm.h for the
+ * layout shared with the simulator.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/replacements.h>
+#include "sim_shm.h"
+
+#ifdef HAVE_LINUX_FUTEX_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* sleep in slices of this length, to notice a simulator that went away */
+#define SIM_SHM_WAIT_NS	(100 * 1000 * 1000)
+
+struct sim_shm_ring {
+	struct sim_shm_ring_ctl *ctl;
+	uint8_t *data;
+};
+
+struct sim_shm {
+	struct sim_shm_header *header;
+	size_t map_size;
+	uint32_t ring_size;
+	struct sim_shm_ring to_sim;
+	struct sim_shm_ring from_sim;
+};
+
+static void sim_shm_futex_wait(uint32_t *addr, uint32_t val)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = SIM_SHM_WAIT_NS };
+	/* not FUTEX_PRIVATE: the word is shared with another process */
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void sim_shm_futex_wake(uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static bool sim_shm_closed(const struct sim_shm *shm)
+{
+	if (__atomic_load_n(&shm->header->closed, __ATOMIC_ACQUIRE)) {
+		LOG_ERROR("sim_shm: connection closed by the simulator");
+		return true;
+	}
+	return false;
+}
+
+struct sim_shm *sim_shm_open(const char *path)
+{
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		LOG_ERROR("sim_shm: cannot open %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		LOG_ERROR("sim_shm: cannot stat %s: %s", path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	size_t ctl_size = sizeof(struct sim_shm_header) + 2 * sizeof(struct sim_shm_ring_ctl);
+	if ((size_t)st.st_size < ctl_size) {
+		LOG_ERROR("sim_shm: %s is too small", path);
+		close(fd);
+		return NULL;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		LOG_ERROR("sim_shm: cannot map %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	struct sim_shm_header *header = map;
+	uint32_t ring_size = header->ring_size;
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SIM_SHM_MAGIC ||
+			header->version != SIM_SHM_VERSION ||
+			!ring_size || (ring_size & (ring_size - 1)) ||
+			(size_t)st.st_size < ctl_size + 2 * (size_t)ring_size) {
+		LOG_ERROR("sim_shm: %s is not a valid version %d shared memory file",
+				path, SIM_SHM_VERSION);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	struct sim_shm *shm = malloc(sizeof(*shm));
+	if (!shm) {
+		LOG_ERROR("sim_shm: out of memory");
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	struct sim_shm_ring_ctl *ctl = (struct sim_shm_ring_ctl *)(header + 1);
+	uint8_t *data = (uint8_t *)map + ctl_size;
+	*shm = (struct sim_shm){
+		.header = header,
+		.map_size = st.st_size,
+		.ring_size = ring_size,
+		.to_sim = { .ctl = &ctl[0], .data = data },
+		.from_sim = { .ctl = &ctl[1], .data = data + ring_size },
+	};
+
+	LOG_INFO("sim_shm: attached to %s, %" PRIu32 " bytes per direction", path, ring_size);
+	return shm;
+}
+
+void sim_shm_close(struct sim_shm *shm)
+{
+	if (!shm)
+		return;
+
+	__atomic_store_n(&shm->header->closed, 1, __ATOMIC_RELEASE);
+	/* let a waiting simulator notice */
+	sim_shm_futex_wake(&shm->to_sim.ctl->head);
+	sim_shm_futex_wake(&shm->from_sim.ctl->tail);
+
+	munmap(shm->header, shm->map_size);
+	free(shm);
+}
+
+size_t sim_shm_ring_size(const struct sim_shm *shm)
+{
+	return shm->ring_size;
+}
+
+int sim_shm_write(struct sim_shm *shm, const void *buf, size_t len)
+{
+	struct sim_shm_ring_ctl *ctl = shm->to_sim.ctl;
+	const uint8_t *src = buf;
+	uint32_t head = ctl->head;
+
+	while (len) {
+		uint32_t tail = __atomic_load_n(&ctl->tail, __ATOMIC_ACQUIRE);
+		uint32_t space = shm->ring_size - (head - tail);
+
+		if (!space) {
+			if (sim_shm_closed(shm))
+				return ERROR_FAIL;
+			__atomic_store_n(&ctl->producer_waiting, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&ctl->tail, __ATOMIC_SEQ_CST) == tail)
+				sim_shm_futex_wait(&ctl->tail, tail);
+			__atomic_store_n(&ctl->producer_waiting, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		uint32_t offset = head & (shm->ring_size - 1);
+		uint32_t n = MIN(MIN(space, shm->ring_size - offset), len);
+		memcpy(shm->to_sim.data + offset, src, n);
+		src += n;
+		len -= n;
+		head += n;
+
+		__atomic_store_n(&ctl->head, head, __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ctl->consumer_waiting, __ATOMIC_RELAXED))
+			sim_shm_futex_wake(&ctl->head);
+	}
+
+	return ERROR_OK;
+}
+
+int sim_shm_read(struct sim_shm *shm, void *buf, size_t len, bool block)
+{
+	struct sim_shm_ring_ctl *ctl = shm->from_sim.ctl;
+	uint32_t tail = ctl->tail;
+
+	if (!len)
+		return 0;
+
+	for (;;) {
+		uint32_t head = __atomic_load_n(&ctl->head, __ATOMIC_ACQUIRE);
+		uint32_t used = head - tail;
+
+		if (used) {
+			uint32_t offset = tail & (shm->ring_size - 1);
+			uint32_t n = MIN(MIN(used, shm->ring_size - offset), len);
+			memcpy(buf, shm->from_sim.data + offset, n);
+
+			__atomic_store_n(&ctl->tail, tail + n, __ATOMIC_RELEASE);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&ctl->producer_waiting, __ATOMIC_RELAXED))
+				sim_shm_futex_wake(&ctl->tail);
+			return n;
+		}
+
+		if (!block)
+			return 0;
+		if (sim_shm_closed(shm))
+			return ERROR_FAIL;
+
+		__atomic_store_n(&ctl->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ctl->head, __ATOMIC_SEQ_CST) == head)
+			sim_shm_futex_wait(&ctl->head, head);
+		__atomic_store_n(&ctl->consumer_waiting, 0, __ATOMIC_RELAXED);
+	}
+}
+
+int sim_shm_read_all(struct sim_shm *shm, void *buf, size_t len)
+{
+	uint8_t *dst = buf;
+
+	while (len) {
+		int n = sim_shm_read(shm, dst, len, true);
+		if (n < 0)
+			return n;
+		dst += n;
+		len -= n;
+	}
+
+	return ERROR_OK;
+}
+
+#else /* HAVE_LINUX_FUTEX_H */
+
+struct sim_shm *sim_shm_open(const char *path)
+{
+	LOG_ERROR("sim_shm: shared memory transport is not supported on this host");
+	return NULL;
+}
+
+void sim_shm_close(struct sim_shm *shm)
+{
+}
+
+size_t sim_shm_ring_size(const struct sim_shm *shm)
+{
+	return 0;
+}
+
+int sim_shm_write(struct sim_shm *shm, const void *buf, size_t len)
+{
+	return ERROR_FAIL;
+}
+
+int sim_shm_read(struct sim_shm *shm, void *buf, size_t len, bool block)
+{
+	return ERROR_FAIL;
+}
+
+int sim_shm_read_all(struct sim_shm *shm, void *buf, size_t len)
+{
+	return ERROR_FAIL;
+}
+
+#endif /* HAVE_LINUX_FUTEX_H */
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_DRIVERS_SIM_SHM_H
+#define OPENOCD_JTAG_DRIVERS_SIM_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared memory byte stream between a driver and a simulator running on the
+ * same host. It replaces the TCP or Unix socket of the simulator drivers, the
+ * bytes exchanged are exactly those of the socket protocol.
+ *
+ * The simulator creates and sizes the file (e.g. below /dev/shm), fills in
+ * the header and stores SIM_SHM_MAGIC last. The mapping is laid out as:
+ *
+ *   struct sim_shm_header      header
+ *   struct sim_shm_ring_ctl    to_sim     driver -> simulator
+ *   struct sim_shm_ring_ctl    from_sim   simulator -> driver
+ *   uint8_t to_sim_data[ring_size]
+ *   uint8_t from_sim_data[ring_size]
+ *
+ * Each direction is a single producer, single consumer ring. head and tail
+ * are free running byte counters, ring_size is a power of two. The producer
+ * only writes head, the consumer only writes tail. A side that finds the
+ * ring empty (consumer) or full (producer) sets its *_waiting flag and sleeps
+ * on the futex word it waits for to change, head resp. tail; the other side
+ * wakes it after moving its counter if the flag is set.
+ */
+
+#define SIM_SHM_MAGIC		0x4d48534fu	/* "OSHM" */
+#define SIM_SHM_VERSION		1
+
+struct sim_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	/* set by either side before it goes away */
+	uint32_t closed;
+	uint8_t reserved[48];
+};
+
+struct sim_shm_ring_ctl {
+	uint32_t head;
+	uint32_t consumer_waiting;
+	uint8_t pad0[56];
+	uint32_t tail;
+	uint32_t producer_waiting;
+	uint8_t pad1[56];
+};
+
+struct sim_shm;
+
+/** Attach to the shared memory file at @a path, created by the simulator. */
+struct sim_shm *sim_shm_open(const char *path);
+
+/** Mark the connection closed and detach. */
+void sim_shm_close(struct sim_shm *shm);
+
+/** Bytes of data each direction can hold. */
+size_t sim_shm_ring_size(const struct sim_shm *shm);
+
+/** Write all of @a buf, waiting for space as needed. */
+int sim_shm_write(struct sim_shm *shm, const void *buf, size_t len);
+
+/**
+ * Read up to @a len bytes. If @a block is set, wait until at least one byte
+ * is available.
+ * @returns the number of bytes read, possibly 0 if not blocking, or an
+ * ERROR_* code.
+ */
+int sim_shm_read(struct sim_shm *shm, void *buf, size_t len, bool block);
+
+/** Read exactly @a len bytes. */
+int sim_shm_read_all(struct sim_shm *shm, void *buf, size_t len);
+
+#endif /* OPENOCD_JTAG_DRIVERS_SIM_SHM_H */
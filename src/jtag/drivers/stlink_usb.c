@@ -2367,31 +2367,6 @@ static int stlink_usb_step(void *handle)
 	return stlink_cmd_allow_retry(handle, h->databuf, 2);
 }
 
-/** */
-static int stlink_usb_read_regs(void *handle)
-{
-	int res;
-	struct stlink_usb_handle *h = handle;
-
-	assert(handle);
-
-	stlink_usb_init_buffer(handle, h->rx_ep, 88);
-
-	h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_COMMAND;
-	if (h->version.jtag_api == STLINK_JTAG_API_V1) {
-
-		h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_APIV1_READALLREGS;
-		res = stlink_usb_xfer_noerrcheck(handle, h->databuf, 84);
-		/* regs data from offset 0 */
-	} else {
-		h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_APIV2_READALLREGS;
-		res = stlink_usb_xfer_errcheck(handle, h->databuf, 88);
-		/* status at offset 0, regs data from offset 4 */
-	}
-
-	return res;
-}
-
 /** */
 static int stlink_usb_read_reg(void *handle, unsigned int regsel, uint32_t *val)
 {
@@ -2433,6 +2408,60 @@ static int stlink_usb_read_reg(void *handle, unsigned int regsel, uint32_t *val)
 	}
 }
 
+/* READALLREGS returns R0..R15, xPSR, MSP and PSP first, in regsel order */
+#define STLINK_ALLREGS_NUM	19
+
+/** */
+static int stlink_usb_read_regs(void *handle, const unsigned int *regsels,
+		uint32_t *vals, unsigned int count)
+{
+	int res;
+	struct stlink_usb_handle *h = handle;
+	unsigned int num_allregs = 0;
+
+	assert(handle);
+
+	for (unsigned int i = 0; i < count; i++)
+		if (regsels[i] < STLINK_ALLREGS_NUM)
+			num_allregs++;
+
+	/* a single register is cheaper to read alone */
+	if (num_allregs > 1) {
+		const uint8_t *allregs;
+
+		stlink_usb_init_buffer(handle, h->rx_ep, 88);
+
+		h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_COMMAND;
+		if (h->version.jtag_api == STLINK_JTAG_API_V1) {
+			h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_APIV1_READALLREGS;
+			res = stlink_usb_xfer_noerrcheck(handle, h->databuf, 84);
+			/* regs data from offset 0 */
+			allregs = h->databuf;
+		} else {
+			h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_APIV2_READALLREGS;
+			res = stlink_usb_xfer_errcheck(handle, h->databuf, 88);
+			/* status at offset 0, regs data from offset 4 */
+			allregs = h->databuf + 4;
+		}
+		if (res != ERROR_OK)
+			return res;
+
+		for (unsigned int i = 0; i < count; i++)
+			if (regsels[i] < STLINK_ALLREGS_NUM)
+				vals[i] = le_to_h_u32(allregs + 4 * regsels[i]);
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (num_allregs > 1 && regsels[i] < STLINK_ALLREGS_NUM)
+			continue;
+		res = stlink_usb_read_reg(handle, regsels[i], &vals[i]);
+		if (res != ERROR_OK)
+			return res;
+	}
+
+	return ERROR_OK;
+}
+
 /** */
 static int stlink_usb_write_reg(void *handle, unsigned int regsel, uint32_t val)
 {
@@ -2839,6 +2868,112 @@ static uint32_t stlink_max_block_size(uint32_t tar_autoincr_block, uint32_t addr
 	return max_tar_block;
 }
 
+#ifdef USE_LIBUSB_ASYNCIO
+/* 32 bit memory chunks submitted back to back in one USB batch */
+#define STLINK_MEM_PIPELINE_DEPTH	8
+
+struct stlink_mem_chunk {
+	uint8_t cmd[STLINK_CMD_SIZE_V2];
+	uint8_t status_cmd[STLINK_CMD_SIZE_V2];
+	uint8_t status[12];
+	uint32_t len;
+};
+
+static bool stlink_usb_can_pipeline(struct stlink_usb_handle *h, uint8_t ap_num, uint32_t csw)
+{
+	if (h->backend->xfer_noerrcheck != stlink_usb_usb_xfer_noerrcheck)
+		return false;
+	if (h->version.stlink == 1 || h->version.jtag_api == STLINK_JTAG_API_V1)
+		return false;
+	if (h->st_mode == STLINK_MODE_DEBUG_SWIM)
+		return false;
+	return (ap_num == 0 && csw == 0) || (h->version.flags & STLINK_F_HAS_CSW);
+}
+
+/*
+ * Transfer an aligned run of 32 bit words as a sequence of chunks, each made
+ * of the memory command, its data phase and the last RW status request. The
+ * commands of several chunks are queued on the endpoints without waiting for
+ * the previous status, so the probe can start a chunk while the host is still
+ * collecting the result of the previous one.
+ * On return @a done holds the bytes transferred before the first chunk that
+ * failed; the caller resumes from there.
+ */
+static int stlink_usb_rw_mem32_pipelined(struct stlink_usb_handle *h, bool write,
+		uint8_t ap_num, uint32_t csw, uint32_t addr, uint32_t count,
+		uint8_t *buffer, uint32_t *done)
+{
+	struct stlink_mem_chunk chunks[STLINK_MEM_PIPELINE_DEPTH];
+	struct jtag_xfer transfers[4 * STLINK_MEM_PIPELINE_DEPTH];
+	bool status2 = h->version.flags & STLINK_F_HAS_GETLASTRWSTATUS2;
+	unsigned int status_len = status2 ? 12 : 2;
+
+	*done = 0;
+
+	while (count) {
+		unsigned int n_chunks = 0;
+		size_t n_transfers = 0;
+		uint32_t offset = 0;
+
+		memset(chunks, 0, sizeof(chunks));
+		memset(transfers, 0, sizeof(transfers));
+
+		while (count > offset && n_chunks < STLINK_MEM_PIPELINE_DEPTH) {
+			struct stlink_mem_chunk *c = &chunks[n_chunks++];
+			uint32_t chunk_addr = addr + offset;
+			uint32_t len = MIN(stlink_max_block_size(h->max_mem_packet, chunk_addr),
+					(uint32_t)STLINK_MAX_RW16_32);
+			len = MIN(len, count - offset);
+			c->len = len;
+
+			c->cmd[0] = STLINK_DEBUG_COMMAND;
+			c->cmd[1] = write ? STLINK_DEBUG_WRITEMEM_32BIT : STLINK_DEBUG_READMEM_32BIT;
+			h_u32_to_le(c->cmd + 2, chunk_addr);
+			h_u16_to_le(c->cmd + 6, len);
+			c->cmd[8] = ap_num;
+			h_u24_to_le(c->cmd + 9, csw >> 8);
+
+			c->status_cmd[0] = STLINK_DEBUG_COMMAND;
+			c->status_cmd[1] = status2 ? STLINK_DEBUG_APIV2_GETLASTRWSTATUS2
+					: STLINK_DEBUG_APIV2_GETLASTRWSTATUS;
+
+			transfers[n_transfers++] = (struct jtag_xfer){
+				.ep = h->tx_ep, .buf = c->cmd, .size = sizeof(c->cmd) };
+			transfers[n_transfers++] = (struct jtag_xfer){
+				.ep = write ? h->tx_ep : h->rx_ep, .buf = buffer + offset, .size = len };
+			transfers[n_transfers++] = (struct jtag_xfer){
+				.ep = h->tx_ep, .buf = c->status_cmd, .size = sizeof(c->status_cmd) };
+			transfers[n_transfers++] = (struct jtag_xfer){
+				.ep = h->rx_ep, .buf = c->status, .size = status_len };
+
+			offset += len;
+		}
+
+		int retval = jtag_libusb_bulk_transfer_n(h->usb_backend_priv.fd,
+				transfers, n_transfers, STLINK_WRITE_TIMEOUT);
+
+		for (unsigned int i = 0; i < n_chunks; i++) {
+			struct jtag_xfer *x = &transfers[4 * i];
+			if (x[0].retval || x[1].retval || x[2].retval || x[3].retval ||
+					x[1].transfer_size != chunks[i].len || x[3].transfer_size != status_len)
+				return retval == ERROR_OK ? ERROR_FAIL : retval;
+
+			h->databuf[0] = chunks[i].status[0];
+			int res = stlink_usb_error_check(h);
+			if (res != ERROR_OK)
+				return res;
+
+			buffer += chunks[i].len;
+			addr += chunks[i].len;
+			count -= chunks[i].len;
+			*done += chunks[i].len;
+		}
+	}
+
+	return ERROR_OK;
+}
+#endif
+
 static int stlink_usb_read_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 		uint32_t addr, uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -2854,6 +2989,21 @@ static int stlink_usb_read_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 	if (size == 2 && !(h->version.flags & STLINK_F_HAS_MEM_16BIT))
 		size = 1;
 
+#ifdef USE_LIBUSB_ASYNCIO
+	if (size == 4 && !(addr & 3) && !(count & 3) && count > h->max_mem_packet &&
+			stlink_usb_can_pipeline(h, ap_num, csw)) {
+		uint32_t done;
+		retval = stlink_usb_rw_mem32_pipelined(h, false, ap_num, csw, addr, count,
+				buffer, &done);
+		if (retval != ERROR_OK && retval != ERROR_WAIT)
+			return retval;
+		/* finish a chunk that got a wait response one at a time */
+		buffer += done;
+		addr += done;
+		count -= done;
+	}
+#endif
+
 	while (count) {
 		bytes_remaining = (size != 1) ?
 				stlink_max_block_size(h->max_mem_packet, addr) : stlink_usb_block(h);
@@ -2939,6 +3089,21 @@ static int stlink_usb_write_ap_mem(void *handle, uint8_t ap_num, uint32_t csw,
 	if (size == 2 && !(h->version.flags & STLINK_F_HAS_MEM_16BIT))
 		size = 1;
 
+#ifdef USE_LIBUSB_ASYNCIO
+	if (size == 4 && !(addr & 3) && !(count & 3) && count > h->max_mem_packet &&
+			stlink_usb_can_pipeline(h, ap_num, csw)) {
+		uint32_t done;
+		retval = stlink_usb_rw_mem32_pipelined(h, true, ap_num, csw, addr, count,
+				(uint8_t *)buffer, &done);
+		if (retval != ERROR_OK && retval != ERROR_WAIT)
+			return retval;
+		/* finish a chunk that got a wait response one at a time */
+		buffer += done;
+		addr += done;
+		count -= done;
+	}
+#endif
+
 	while (count) {
 
 		bytes_remaining = (size != 1) ?
@@ -4053,12 +4218,12 @@ struct hl_layout_api stlink_usb_layout_api = {
 	/** */
 	.step = stlink_usb_step,
 	/** */
-	.read_regs = stlink_usb_read_regs,
-	/** */
 	.read_reg = stlink_usb_read_reg,
 	/** */
 	.write_reg = stlink_usb_write_reg,
 	/** */
+	.read_regs = stlink_usb_read_regs,
+	/** */
 	.read_mem = stlink_usb_read_mem,
 	/** */
 	.write_mem = stlink_usb_write_mem,
@@ -459,12 +459,6 @@ static int icdi_usb_step(void *handle)
 	return result;
 }
 
-static int icdi_usb_read_regs(void *handle)
-{
-	/* currently unsupported */
-	return ERROR_OK;
-}
-
 static int icdi_usb_read_reg(void *handle, unsigned int regsel, uint32_t *val)
 {
 	int result;
@@ -753,7 +747,6 @@ struct hl_layout_api icdi_usb_layout_api = {
 	.run = icdi_usb_run,
 	.halt = icdi_usb_halt,
 	.step = icdi_usb_step,
-	.read_regs = icdi_usb_read_regs,
 	.read_reg = icdi_usb_read_reg,
 	.write_reg = icdi_usb_write_reg,
 	.read_mem = icdi_usb_read_mem,
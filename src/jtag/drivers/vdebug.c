@@ -52,6 +52,7 @@
 #include "helper/replacements.h"
 #include "helper/log.h"
 #include "helper/list.h"
+#include "sim_shm.h"
 
 #define VD_VERSION 48
 #define VD_BUFFER_LEN 4024
@@ -205,7 +206,9 @@ struct vd_client {
 	uint32_t poll_max;
 	uint32_t targ_time;
 	int hsocket;
+	struct sim_shm *shm;            /* used instead of hsocket if shm_path is set */
 	char server_name[32];
+	char shm_path[128];
 	char bfm_path[128];
 	char mem_path[VD_MAX_MEMORIES][128];
 	struct vd_rdata rdataq;
@@ -304,6 +307,13 @@ static int vdebug_socket_receive(int hsock, struct vd_shm *pmem)
 	int to_receive = VD_SHEADER_LEN + le_to_h_u16(pmem->rbytes);
 	char *pb = (char *)pmem;
 
+	if (vdc.shm) {
+		if (sim_shm_read_all(vdc.shm, pb + offset, to_receive) != ERROR_OK)
+			return -1;
+		LOG_DEBUG_IO("socket_receive: received %d from shared memory", to_receive);
+		return to_receive;
+	}
+
 	do {
 		rc = recv(hsock, pb + offset, to_receive, 0);
 		if (rc <= 0) {
@@ -321,6 +331,14 @@ static int vdebug_socket_receive(int hsock, struct vd_shm *pmem)
 
 static int vdebug_socket_send(int hsock, struct vd_shm *pmem)
 {
+	if (vdc.shm) {
+		int len = VD_CHEADER_LEN + le_to_h_u16(pmem->wbytes);
+		if (sim_shm_write(vdc.shm, &pmem->cmd, len) != ERROR_OK)
+			return -1;
+		LOG_DEBUG_IO("socket_send: sent %d to shared memory", len);
+		return len;
+	}
+
 	int rc = send(hsock, (const char *)&pmem->cmd, VD_CHEADER_LEN + le_to_h_u16(pmem->wbytes), 0);
 	if (rc <= 0)
 		LOG_WARNING("socket_send: send failed, error %d", vdebug_socket_error());
@@ -332,7 +350,7 @@ static int vdebug_socket_send(int hsock, struct vd_shm *pmem)
 
 static uint32_t vdebug_wait_server(int hsock, struct vd_shm *pmem)
 {
-	if (!hsock)
+	if (!hsock && !vdc.shm)
 		return VD_ERR_SOC_OPEN;
 
 	int st = vdebug_socket_send(hsock, pmem);
@@ -841,15 +859,25 @@ static void vdebug_mem_close(int hsock, struct vd_shm *pm, uint8_t ndx)
 
 static int vdebug_init(void)
 {
-	vdc.hsocket = vdebug_socket_open(vdc.server_name, vdc.server_port);
+	if (vdc.shm_path[0])
+		vdc.shm = sim_shm_open(vdc.shm_path);
+	else
+		vdc.hsocket = vdebug_socket_open(vdc.server_name, vdc.server_port);
 	pbuf = calloc(1, sizeof(struct vd_shm));
 	if (!pbuf) {
 		close_socket(vdc.hsocket);
 		vdc.hsocket = 0;
+		sim_shm_close(vdc.shm);
+		vdc.shm = NULL;
 		LOG_ERROR("cannot allocate %zu bytes", sizeof(struct vd_shm));
 		return ERROR_FAIL;
 	}
-	if (vdc.hsocket <= 0) {
+	if (vdc.shm_path[0] && !vdc.shm) {
+		free(pbuf);
+		pbuf = NULL;
+		return ERROR_FAIL;
+	}
+	if (!vdc.shm && vdc.hsocket <= 0) {
 		free(pbuf);
 		pbuf = NULL;
 		LOG_ERROR("cannot connect to vdebug server %s:%" PRIu16,
@@ -865,8 +893,11 @@ static int vdebug_init(void)
 	int rc = vdebug_open(vdc.hsocket, pbuf, vdc.bfm_path, vdc.bfm_type, vdc.bfm_period, sig_mask);
 	if (rc != 0) {
 		LOG_ERROR("0x%x cannot connect to %s", rc, vdc.bfm_path);
-		close_socket(vdc.hsocket);
+		if (vdc.hsocket)
+			close_socket(vdc.hsocket);
 		vdc.hsocket = 0;
+		sim_shm_close(vdc.shm);
+		vdc.shm = NULL;
 		free(pbuf);
 		pbuf = NULL;
 	} else {
@@ -893,6 +924,8 @@ static int vdebug_quit(void)
 		vdc.bfm_path, vdc.server_name, vdc.server_port, rc);
 	if (vdc.hsocket)
 		close_socket(vdc.hsocket);
+	sim_shm_close(vdc.shm);
+	vdc.shm = NULL;
 	free(pbuf);
 	pbuf = NULL;
 
@@ -1196,6 +1229,17 @@ COMMAND_HANDLER(vdebug_set_server)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(vdebug_set_shm)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	strncpy(vdc.shm_path, CMD_ARGV[0], sizeof(vdc.shm_path) - 1);
+	LOG_DEBUG("shm: %s", vdc.shm_path);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(vdebug_set_bfm)
 {
 	char prefix;
@@ -1282,6 +1326,13 @@ static const struct command_registration vdebug_command_handlers[] = {
 		.help = "set the vdebug server name or address",
 		.usage = "<host:port>",
 	},
+	{
+		.name = "shm",
+		.handler = &vdebug_set_shm,
+		.mode = COMMAND_CONFIG,
+		.help = "talk to the vdebug server through a shared memory file",
+		.usage = "<path>",
+	},
 	{
 		.name = "bfm_path",
 		.handler = &vdebug_set_bfm,
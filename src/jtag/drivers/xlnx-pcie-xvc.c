@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <linux/pci.h>
 
 #include <jtag/interface.h>
@@ -20,6 +21,7 @@
 #include <jtag/commands.h>
 #include <helper/replacements.h>
 #include <helper/bits.h>
+#include <helper/types.h>
 
 /* Available only from kernel v4.10 */
 #ifndef PCI_CFG_SPACE_EXP_SIZE
@@ -45,6 +47,15 @@ struct xlnx_pcie_xvc {
 	int fd;
 	unsigned offset;
 	char *device;
+	/* registers mapped from a BAR, instead of accessed in config space */
+	bool use_bar;
+	unsigned int bar;
+	uint32_t bar_offset;
+	void *bar_map;
+	size_t bar_map_size;
+	volatile uint32_t *regs;
+	/* last value written to the LEN register, UINT32_MAX if unknown */
+	uint32_t len;
 };
 
 static struct xlnx_pcie_xvc xlnx_pcie_xvc_state;
@@ -55,6 +66,13 @@ static int xlnx_pcie_xvc_read_reg(const int offset, uint32_t *val)
 	uint32_t res;
 	int err;
 
+	if (xlnx_pcie_xvc->regs) {
+		res = xlnx_pcie_xvc->regs[offset / 4];
+		if (val)
+			*val = le_to_h_u32((uint8_t *)&res);
+		return ERROR_OK;
+	}
+
 	/* Note: This should be ok endianness-wise because by going
 	 * through sysfs the kernel does the conversion in the config
 	 * space accessor functions
@@ -76,6 +94,13 @@ static int xlnx_pcie_xvc_write_reg(const int offset, const uint32_t val)
 {
 	int err;
 
+	if (xlnx_pcie_xvc->regs) {
+		uint32_t le;
+		h_u32_to_le((uint8_t *)&le, val);
+		xlnx_pcie_xvc->regs[offset / 4] = le;
+		return ERROR_OK;
+	}
+
 	/* Note: This should be ok endianness-wise because by going
 	 * through sysfs the kernel does the conversion in the config
 	 * space accessor functions
@@ -96,9 +121,15 @@ static int xlnx_pcie_xvc_transact(size_t num_bits, uint32_t tms, uint32_t tdi,
 {
 	int err;
 
-	err = xlnx_pcie_xvc_write_reg(XLNX_XVC_LEN_REG, num_bits);
-	if (err != ERROR_OK)
-		return err;
+	/* long shifts repeat the same length, don't rewrite it every time */
+	if (num_bits != xlnx_pcie_xvc->len) {
+		err = xlnx_pcie_xvc_write_reg(XLNX_XVC_LEN_REG, num_bits);
+		if (err != ERROR_OK) {
+			xlnx_pcie_xvc->len = UINT32_MAX;
+			return err;
+		}
+		xlnx_pcie_xvc->len = num_bits;
+	}
 
 	err = xlnx_pcie_xvc_write_reg(XLNX_XVC_TMS_REG, tms);
 	if (err != ERROR_OK)
@@ -380,12 +411,52 @@ static int xlnx_pcie_xvc_execute_queue(struct jtag_command *cmd_queue)
 }
 
 
+static int xlnx_pcie_xvc_init_bar(void)
+{
+	char filename[PATH_MAX];
+	long page_size = sysconf(_SC_PAGESIZE);
+	off_t map_offset = xlnx_pcie_xvc->bar_offset & ~(page_size - 1);
+	size_t map_size = xlnx_pcie_xvc->bar_offset - map_offset + XLNX_XVC_CAP_SIZE;
+
+	snprintf(filename, PATH_MAX, "/sys/bus/pci/devices/%s/resource%u",
+		 xlnx_pcie_xvc->device, xlnx_pcie_xvc->bar);
+	xlnx_pcie_xvc->fd = open(filename, O_RDWR | O_SYNC);
+	if (xlnx_pcie_xvc->fd < 0) {
+		LOG_ERROR("Failed to open device: %s", filename);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 xlnx_pcie_xvc->fd, map_offset);
+	if (map == MAP_FAILED) {
+		LOG_ERROR("Failed to map %s at offset 0x%" PRIx32, filename,
+			  xlnx_pcie_xvc->bar_offset);
+		close(xlnx_pcie_xvc->fd);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	xlnx_pcie_xvc->bar_map = map;
+	xlnx_pcie_xvc->bar_map_size = map_size;
+	xlnx_pcie_xvc->regs = (volatile uint32_t *)((uint8_t *)map +
+			(xlnx_pcie_xvc->bar_offset - map_offset));
+
+	LOG_INFO("Using Xilinx XVC/PCIe registers in BAR%u at offset: 0x%" PRIx32,
+		 xlnx_pcie_xvc->bar, xlnx_pcie_xvc->bar_offset);
+
+	return ERROR_OK;
+}
+
 static int xlnx_pcie_xvc_init(void)
 {
 	char filename[PATH_MAX];
 	uint32_t cap, vh;
 	int err;
 
+	xlnx_pcie_xvc->len = UINT32_MAX;
+
+	if (xlnx_pcie_xvc->use_bar)
+		return xlnx_pcie_xvc_init_bar();
+
 	snprintf(filename, PATH_MAX, "/sys/bus/pci/devices/%s/config",
 		 xlnx_pcie_xvc->device);
 	xlnx_pcie_xvc->fd = open(filename, O_RDWR | O_SYNC);
@@ -439,6 +510,12 @@ static int xlnx_pcie_xvc_quit(void)
 {
 	int err;
 
+	if (xlnx_pcie_xvc->bar_map) {
+		munmap(xlnx_pcie_xvc->bar_map, xlnx_pcie_xvc->bar_map_size);
+		xlnx_pcie_xvc->bar_map = NULL;
+		xlnx_pcie_xvc->regs = NULL;
+	}
+
 	err = close(xlnx_pcie_xvc->fd);
 	if (err)
 		return err;
@@ -461,6 +538,39 @@ COMMAND_HANDLER(xlnx_pcie_xvc_handle_config_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(xlnx_pcie_xvc_handle_bar_command)
+{
+	if (CMD_ARGC == 0) {
+		if (xlnx_pcie_xvc->use_bar)
+			command_print(CMD, "BAR%u offset 0x%" PRIx32, xlnx_pcie_xvc->bar,
+				      xlnx_pcie_xvc->bar_offset);
+		else
+			command_print(CMD, "config space");
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int bar;
+	uint32_t offset;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], bar);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], offset);
+	if (bar > 5) {
+		LOG_ERROR("BAR index must be between 0 and 5");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (offset % 4) {
+		LOG_ERROR("BAR offset must be 32 bit aligned");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	xlnx_pcie_xvc->use_bar = true;
+	xlnx_pcie_xvc->bar = bar;
+	xlnx_pcie_xvc->bar_offset = offset;
+	return ERROR_OK;
+}
+
 static const struct command_registration xlnx_pcie_xvc_subcommand_handlers[] = {
 	{
 		.name = "config",
@@ -469,6 +579,13 @@ static const struct command_registration xlnx_pcie_xvc_subcommand_handlers[] = {
 		.help = "Configure XVC/PCIe JTAG adapter",
 		.usage = "device",
 	},
+	{
+		.name = "bar",
+		.handler = xlnx_pcie_xvc_handle_bar_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Access the XVC registers mapped in a BAR instead of config space",
+		.usage = "[bar_index offset]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -39,8 +39,6 @@ struct hl_layout_api {
 	int (*halt)(void *handle);
 	/** */
 	int (*step)(void *handle);
-	/** */
-	int (*read_regs)(void *handle);
 	/**
 	 * Read one register from the target
 	 *
@@ -60,6 +58,23 @@ struct hl_layout_api {
 	 * @returns ERROR_OK on success, or an error code on failure.
 	 */
 	int (*write_reg)(void *handle, unsigned int regsel, uint32_t val);
+	/**
+	 * Optional; read a set of registers from the target with as few
+	 * transactions as the adapter allows
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param regsels Array of register selection indexes, see read_reg
+	 * @param vals Array to retrieve the register values
+	 * @param count Number of registers
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*read_regs)(void *handle, const unsigned int *regsels,
+			uint32_t *vals, unsigned int count);
+	/**
+	 * Optional; write a set of registers to the target, see read_regs
+	 */
+	int (*write_regs)(void *handle, const unsigned int *regsels,
+			const uint32_t *vals, unsigned int count);
 	/** */
 	int (*read_mem)(void *handle, uint32_t addr, uint32_t size,
 			uint32_t count, uint8_t *buffer);
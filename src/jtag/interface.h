@@ -193,6 +193,20 @@ struct jtag_interface {
 	 */
 
 	int (*execute_queue)(struct jtag_command *cmd_queue);
+
+	/**
+	 * Optional split version of execute_queue, see
+	 * jtag_execute_queue_async(). execute_queue_submit() hands the commands
+	 * to the adapter and returns without waiting for the result. The queue
+	 * is not accessed anymore once it returns, but the buffers of the
+	 * scan fields must only be written by execute_queue_complete(), which
+	 * waits for the adapter. The core calls execute_queue_complete() before
+	 * it calls any other function of the driver.
+	 * @param cmd_queue - a linked list of commands to execute
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*execute_queue_submit)(struct jtag_command *cmd_queue);
+	int (*execute_queue_complete)(void);
 };
 
 /**
@@ -392,6 +406,7 @@ extern struct adapter_driver osbdm_adapter_driver;
 extern struct adapter_driver parport_adapter_driver;
 extern struct adapter_driver presto_adapter_driver;
 extern struct adapter_driver remote_bitbang_adapter_driver;
+extern struct adapter_driver remote_jtag_adapter_driver;
 extern struct adapter_driver rlink_adapter_driver;
 extern struct adapter_driver rshim_dap_adapter_driver;
 extern struct adapter_driver stlink_dap_adapter_driver;
@@ -98,6 +98,16 @@ struct scan_field {
 	uint8_t *check_mask;
 };
 
+/** Scans queued for one TAP, see "jtag stats". */
+struct jtag_tap_stats {
+	uint64_t ir_scans;
+	uint64_t ir_bits;
+	uint64_t dr_scans;
+	uint64_t dr_bits;
+	/** IR scans not sent because the instruction was loaded already */
+	uint64_t ir_scans_cached;
+};
+
 struct jtag_tap {
 	char *chip;
 	char *tapname;
@@ -135,9 +145,15 @@ struct jtag_tap {
 
 	/** Bypass instruction value */
 	uint64_t ir_bypass_value;
+	/** ir_bypass_value prebuilt for IR scans, valid for bypass_instr_len bits */
+	uint8_t *bypass_instr;
+	int bypass_instr_len;
 
 	struct jtag_tap_event_action *event_action;
 
+	/** Scans addressed to this TAP */
+	struct jtag_tap_stats stats;
+
 	struct jtag_tap *next_tap;
 	/* private pointer to support none-jtag specific functions */
 	void *priv;
@@ -155,6 +171,14 @@ struct jtag_tap *jtag_tap_next_enabled(struct jtag_tap *p);
 unsigned jtag_tap_count_enabled(void);
 unsigned jtag_tap_count(void);
 
+/**
+ * Tell the scan code that TAPs were enabled or disabled, so layouts
+ * cached for bypassed TAPs get rebuilt. Code that sets jtag_tap::enabled
+ * directly must call this.
+ */
+void jtag_tap_chain_changed(void);
+unsigned int jtag_tap_chain_generation(void);
+
 /*
  * - TRST_ASSERTED triggers two sets of callbacks, after operations to
  *   reset the scan chain -- via TMS+TCK signaling, or deasserting the
@@ -256,6 +280,11 @@ void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
 bool jtag_will_verify_capture_ir(void);
 
+/** Enable or disable skipping IR scans of an instruction already loaded. */
+void jtag_set_ir_cache(bool enable);
+/** @returns True if IR scans of an instruction already loaded are skipped. */
+bool jtag_get_ir_cache(void);
+
 /** Set ms to sleep after jtag_execute_queue() flushes queue. Debug purposes. */
 void jtag_set_flush_queue_sleep(int ms);
 
@@ -319,6 +348,17 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
  */
 void jtag_add_dr_scan(struct jtag_tap *tap, int num_fields,
 		const struct scan_field *fields, tap_state_t endstate);
+/**
+ * A version of jtag_add_dr_scan() that queues the out_value buffers of
+ * @a fields by reference instead of copying them into the queue.
+ *
+ * The caller must keep them allocated and unchanged until the queue has
+ * been executed: until jtag_execute_queue() returns, or jtag_async_wait()
+ * for a queue started by jtag_execute_queue_async(). The @a fields array
+ * itself is copied and may be reused right away.
+ */
+void jtag_add_dr_scan_nocopy(struct jtag_tap *tap, int num_fields,
+		const struct scan_field *fields, tap_state_t endstate);
 /** A version of jtag_add_dr_scan() that uses the check_value/mask fields */
 void jtag_add_dr_scan_check(struct jtag_tap *tap, int num_fields,
 		struct scan_field *fields, tap_state_t endstate);
@@ -522,9 +562,59 @@ int jtag_execute_queue(void);
 /** same as jtag_execute_queue() but does not clear the error flag */
 void jtag_execute_queue_noclear(void);
 
+struct jtag_async;
+
+/**
+ * Start executing the queue and return without waiting for the adapter,
+ * so that the next queue can be prepared meanwhile. The buffers of the
+ * queued scans and the queued callbacks are only valid once
+ * jtag_async_wait() returns. Drivers that cannot split submission and
+ * completion execute the queue right away.
+ *
+ * Only one queue is in flight: any other execution of the queue first
+ * waits for it. jtag_async_wait() must be called on every handle.
+ */
+int jtag_execute_queue_async(struct jtag_async **async);
+
+/**
+ * Wait for a queue started by jtag_execute_queue_async(), run its callbacks
+ * and free the handle. @returns the same as jtag_execute_queue() would have.
+ */
+int jtag_async_wait(struct jtag_async *async);
+
 /** @returns the number of times the scan queue has been flushed */
 int jtag_get_flush_queue_count(void);
 
+/** Counters of everything sent to the adapter, see "jtag stats". Bits
+ * are counted over the whole chain, after the queue clean-up pass. */
+struct jtag_stats {
+	uint64_t flushes;
+	uint64_t ir_scans;
+	uint64_t ir_bits;
+	uint64_t dr_scans;
+	uint64_t dr_bits;
+	/** TCK cycles of runtest and stableclocks commands */
+	uint64_t idle_cycles;
+	/** Time spent in jtag_execute_queue(), including callbacks */
+	int64_t flush_us;
+	/** Time spent in the adapter's execute_queue() */
+	int64_t driver_us;
+	/** Longest single flush */
+	int64_t max_flush_us;
+	/** Largest number of bits in a single flush */
+	uint64_t max_flush_bits;
+	/** When the counters were last reset */
+	int64_t start_us;
+};
+
+const struct jtag_stats *jtag_get_stats(void);
+/** Reset the global and the per-TAP counters. */
+void jtag_reset_stats(void);
+/** Log a summary line every @a interval_ms while the queue is used, 0 to
+ * disable. */
+void jtag_set_stats_log_interval(unsigned int interval_ms);
+unsigned int jtag_get_stats_log_interval(void);
+
 /** Report Tcl event to all TAPs */
 void jtag_notify_event(enum jtag_event);
 
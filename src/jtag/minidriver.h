@@ -46,6 +46,9 @@ int interface_jtag_add_plain_ir_scan(
 int interface_jtag_add_dr_scan(struct jtag_tap *active,
 		int num_fields, const struct scan_field *fields,
 		tap_state_t endstate);
+int interface_jtag_add_dr_scan_nocopy(struct jtag_tap *active,
+		int num_fields, const struct scan_field *fields,
+		tap_state_t endstate);
 int interface_jtag_add_plain_dr_scan(
 		int num_bits, const uint8_t *out_bits, uint8_t *in_bits,
 		tap_state_t endstate);
@@ -69,11 +72,20 @@ int interface_jtag_add_reset(int trst, int srst);
 int interface_jtag_add_sleep(uint32_t us);
 int interface_jtag_add_clocks(int num_cycles);
 int interface_jtag_execute_queue(void);
+int interface_jtag_execute_queue_async(struct jtag_async **async);
+int interface_jtag_async_wait(struct jtag_async *async);
 
 /**
  * Calls the interface callback to execute the queue.  This routine
  * is used by the JTAG driver layer and should not be called directly.
  */
 int default_interface_jtag_execute_queue(void);
+/**
+ * Hands the queue to the interface without waiting for the result.
+ * @returns ERROR_NOT_IMPLEMENTED if the interface cannot do that.
+ */
+int default_interface_jtag_submit_queue(void);
+/** Waits for the queue handed over by default_interface_jtag_submit_queue(). */
+int default_interface_jtag_complete_queue(void);
 
 #endif /* OPENOCD_JTAG_MINIDRIVER_H */
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Framing and compression of the remote_jtag protocol, see remote_jtag.h.
+ *
+ * JTAG payloads are mostly runs of the same byte, all ones or all zeros
+ * while shifting through BYPASS or polling a status, so a simple run-length
+ * encoding carries most of the gain of a general purpose compressor without
+ * a new dependency. A control byte below 0x80 is followed by that many plus
+ * one literal bytes, from 0x80 it stands for a run of that many minus 0x7d
+ * copies of the next byte.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "remote_jtag.h"
+#include <helper/log.h>
+
+#define RLE_MAX_LITERAL		128
+#define RLE_MIN_RUN		3
+#define RLE_MAX_RUN		(0x7f + RLE_MIN_RUN)
+
+static size_t rle_encode(const uint8_t *in, size_t length, uint8_t *out)
+{
+	size_t out_length = 0;
+	size_t literal = 0;
+	size_t i = 0;
+
+	while (i < length) {
+		size_t run = 1;
+		while (i + run < length && run < RLE_MAX_RUN && in[i + run] == in[i])
+			run++;
+
+		if (run >= RLE_MIN_RUN) {
+			out[out_length++] = 0x80 + run - RLE_MIN_RUN;
+			out[out_length++] = in[i];
+			i += run;
+			continue;
+		}
+
+		/* A literal block, up to the next run worth encoding */
+		literal = out_length++;
+		size_t count = 0;
+		while (i < length && count < RLE_MAX_LITERAL) {
+			if (i + 2 < length && in[i] == in[i + 1] && in[i] == in[i + 2])
+				break;
+			out[out_length++] = in[i++];
+			count++;
+		}
+		out[literal] = count - 1;
+	}
+
+	return out_length;
+}
+
+static int rle_decode(const uint8_t *in, size_t length, uint8_t *out, size_t out_length)
+{
+	size_t o = 0;
+
+	for (size_t i = 0; i < length; ) {
+		const uint8_t control = in[i++];
+		if (control < 0x80) {
+			size_t count = control + 1;
+			if (i + count > length || o + count > out_length)
+				return ERROR_FAIL;
+			memcpy(out + o, in + i, count);
+			i += count;
+			o += count;
+		} else {
+			size_t count = control - 0x80 + RLE_MIN_RUN;
+			if (i >= length || o + count > out_length)
+				return ERROR_FAIL;
+			memset(out + o, in[i++], count);
+			o += count;
+		}
+	}
+
+	return o == out_length ? ERROR_OK : ERROR_FAIL;
+}
+
+uint8_t *remote_jtag_frame(unsigned int type, const uint8_t *payload, size_t length,
+		size_t *frame_length)
+{
+	/* Worst case, one control byte per literal block */
+	uint8_t *frame = malloc(REMOTE_JTAG_HEADER_SIZE + length + length / RLE_MAX_LITERAL + 1);
+	if (!frame) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+
+	uint8_t flags = REMOTE_JTAG_FLAG_RLE;
+	size_t encoded = rle_encode(payload, length, frame + REMOTE_JTAG_HEADER_SIZE);
+	if (encoded >= length) {
+		flags = 0;
+		encoded = length;
+		if (length)
+			memcpy(frame + REMOTE_JTAG_HEADER_SIZE, payload, length);
+	}
+
+	frame[0] = 'R';
+	frame[1] = 'J';
+	frame[2] = type;
+	frame[3] = flags;
+	h_u32_to_le(frame + 4, length);
+	h_u32_to_le(frame + 8, encoded);
+
+	*frame_length = REMOTE_JTAG_HEADER_SIZE + encoded;
+	return frame;
+}
+
+int remote_jtag_parse_header(const uint8_t *header, unsigned int *type,
+		size_t *length, size_t *raw_length)
+{
+	if (header[0] != 'R' || header[1] != 'J' || (header[3] & ~REMOTE_JTAG_FLAG_RLE))
+		return ERROR_FAIL;
+
+	*type = header[2];
+	*raw_length = le_to_h_u32(header + 4);
+	*length = le_to_h_u32(header + 8);
+	if (*raw_length > REMOTE_JTAG_MAX_FRAME || *length > REMOTE_JTAG_MAX_FRAME)
+		return ERROR_FAIL;
+	if (!(header[3] & REMOTE_JTAG_FLAG_RLE) && *length != *raw_length)
+		return ERROR_FAIL;
+
+	return ERROR_OK;
+}
+
+int remote_jtag_decode_payload(const uint8_t *header, const uint8_t *payload,
+		uint8_t *raw)
+{
+	const size_t raw_length = le_to_h_u32(header + 4);
+	const size_t length = le_to_h_u32(header + 8);
+
+	if (header[3] & REMOTE_JTAG_FLAG_RLE)
+		return rle_decode(payload, length, raw, raw_length);
+
+	if (length)
+		memcpy(raw, payload, length);
+	return ERROR_OK;
+}
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_REMOTE_JTAG_H
+#define OPENOCD_JTAG_REMOTE_JTAG_H
+
+#include <helper/types.h>
+
+/*
+ * Protocol between the remote_jtag adapter driver and the remote_jtag_server
+ * of another OpenOCD, which runs the JTAG queue of the first one through its
+ * own adapter. A whole queue travels in one request frame, answered by one
+ * reply frame, so there is one round trip per jtag_execute_queue().
+ *
+ * A frame is a 12 byte header followed by the payload, all little endian:
+ *   magic(2) "RJ", type(1), flags(1), raw length(4), payload length(4)
+ * With REMOTE_JTAG_FLAG_RLE the payload is run-length encoded and expands
+ * to "raw length" bytes, else both lengths are the same.
+ *
+ * HELLO:   version(4), both ways, the server answers with its version.
+ * REQUEST: a sequence of operations, each an op byte and its arguments:
+ *   SCAN      flags(1) end_state(1) num_bits(4) out bits
+ *   TLR
+ *   RUNTEST   num_cycles(4) end_state(1)
+ *   RESET     trst(1) srst(1), queued like JTAG_RESET
+ *   PATHMOVE  num_states(4) states(num_states)
+ *   SLEEP     us(4)
+ *   CLOCKS    num_cycles(4)
+ *   TMS       num_bits(4) bits
+ *   ADAPTER_RESET trst(1) srst(1), the signals right away
+ *   SPEED     khz(4)
+ * REPLY:   result(4), then the captured bits of every SCAN with
+ *          REMOTE_JTAG_SCAN_CAPTURE, in order.
+ * Bit strings take DIV_ROUND_UP(num_bits, 8) bytes, LSB first.
+ */
+
+#define REMOTE_JTAG_VERSION		1
+
+#define REMOTE_JTAG_HEADER_SIZE		12
+/* refuse frames larger than this */
+#define REMOTE_JTAG_MAX_FRAME		(64 * 1024 * 1024)
+
+#define REMOTE_JTAG_HELLO		1
+#define REMOTE_JTAG_REQUEST		2
+#define REMOTE_JTAG_REPLY		3
+
+#define REMOTE_JTAG_FLAG_RLE		0x01
+
+#define REMOTE_JTAG_OP_SCAN		1
+#define REMOTE_JTAG_OP_TLR		2
+#define REMOTE_JTAG_OP_RUNTEST		3
+#define REMOTE_JTAG_OP_RESET		4
+#define REMOTE_JTAG_OP_PATHMOVE		5
+#define REMOTE_JTAG_OP_SLEEP		6
+#define REMOTE_JTAG_OP_CLOCKS		7
+#define REMOTE_JTAG_OP_TMS		8
+#define REMOTE_JTAG_OP_ADAPTER_RESET	9
+#define REMOTE_JTAG_OP_SPEED		10
+
+#define REMOTE_JTAG_SCAN_IR		0x01
+#define REMOTE_JTAG_SCAN_CAPTURE	0x02
+
+/**
+ * Build a frame of "type" around "payload", run-length encoded if that
+ * makes it shorter.
+ * @returns the frame, to be freed by the caller, or NULL if out of memory.
+ */
+uint8_t *remote_jtag_frame(unsigned int type, const uint8_t *payload, size_t length,
+		size_t *frame_length);
+
+/**
+ * Check a frame header.
+ * @returns ERROR_OK and the type, the payload length on the wire and the
+ * decoded one, or ERROR_FAIL for a corrupt header.
+ */
+int remote_jtag_parse_header(const uint8_t *header, unsigned int *type,
+		size_t *length, size_t *raw_length);
+
+/**
+ * Decode the payload of a frame whose header is "header" into "raw", which
+ * has the raw length of the header.
+ */
+int remote_jtag_decode_payload(const uint8_t *header, const uint8_t *payload,
+		uint8_t *raw);
+
+#endif /* OPENOCD_JTAG_REMOTE_JTAG_H */
@@ -562,6 +562,7 @@ static void jtag_tap_handle_event(struct jtag_tap *tap, enum jtag_event e)
 				 * really be verifying the scan chains ...
 				 */
 			    tap->enabled = (e == JTAG_TAP_EVENT_ENABLE);
+			    jtag_tap_chain_changed();
 			    LOG_INFO("JTAG tap: %s %s", tap->dotted_name,
 				tap->enabled ? "enabled" : "disabled");
 			    break;
@@ -667,6 +668,120 @@ COMMAND_HANDLER(handle_jtag_names)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_queue_stats)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const struct cmd_queue_stats *stats = cmd_queue_get_stats();
+
+	command_print(CMD, "pages in use:      %u (high water %u)",
+		stats->pages, stats->pages_high_water);
+	command_print(CMD, "bytes in use:      %zu (high water %zu)",
+		stats->bytes, stats->bytes_high_water);
+	command_print(CMD, "pages kept free:   %u", stats->free_pages);
+	command_print(CMD, "queue resets:      %" PRIu64, stats->resets);
+	command_print(CMD, "pages allocated:   %" PRIu64, stats->page_allocs);
+	command_print(CMD, "IR scans dropped:  %" PRIu64, stats->ir_scans_dropped);
+	command_print(CMD, "runtests merged:   %" PRIu64, stats->runtests_merged);
+	command_print(CMD, "resets dropped:    %" PRIu64, stats->statemoves_dropped);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_stats)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		jtag_reset_stats();
+		return ERROR_OK;
+	}
+
+	const struct jtag_stats *stats = jtag_get_stats();
+	int64_t elapsed_us = stats->start_us ? timeval_us() - stats->start_us : 0;
+	uint64_t bits = stats->ir_bits + stats->dr_bits;
+
+	command_print(CMD, "elapsed:           %" PRId64 " ms", elapsed_us / 1000);
+	command_print(CMD, "flushes:           %" PRIu64, stats->flushes);
+	command_print(CMD, "in flush:          %" PRId64 " ms (longest %" PRId64 " us)",
+		stats->flush_us / 1000, stats->max_flush_us);
+	command_print(CMD, "in driver:         %" PRId64 " ms", stats->driver_us / 1000);
+	command_print(CMD, "IR scans:          %" PRIu64 " (%" PRIu64 " bits)",
+		stats->ir_scans, stats->ir_bits);
+	command_print(CMD, "DR scans:          %" PRIu64 " (%" PRIu64 " bits)",
+		stats->dr_scans, stats->dr_bits);
+	command_print(CMD, "idle cycles:       %" PRIu64, stats->idle_cycles);
+	command_print(CMD, "bits per flush:    %" PRIu64 " (largest %" PRIu64 ")",
+		stats->flushes ? bits / stats->flushes : 0, stats->max_flush_bits);
+	if (stats->driver_us > 0)
+		command_print(CMD, "driver throughput: %" PRIu64 " kbit/s",
+			(bits + stats->idle_cycles) * 1000 / stats->driver_us);
+
+	command_print(CMD, "   TapName                IR scans    IR bits   DR scans    DR bits  IR cached");
+	command_print(CMD, "-- ------------------- ---------- ---------- ---------- ---------- ----------");
+	for (struct jtag_tap *tap = jtag_all_taps(); tap; tap = tap->next_tap)
+		command_print(CMD, "%2d %-19s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+			" %10" PRIu64,
+			tap->abs_chain_position, tap->dotted_name,
+			tap->stats.ir_scans, tap->stats.ir_bits,
+			tap->stats.dr_scans, tap->stats.dr_bits,
+			tap->stats.ir_scans_cached);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_stats_interval)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int interval;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], interval);
+		jtag_set_stats_log_interval(interval);
+	}
+
+	command_print(CMD, "%u", jtag_get_stats_log_interval());
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_queue_optimize)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+		jtag_command_queue_set_optimize(enable);
+	}
+
+	command_print(CMD, "%s", jtag_command_queue_get_optimize() ? "on" : "off");
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_ir_cache)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+		jtag_set_ir_cache(enable);
+	}
+
+	command_print(CMD, "%s", jtag_get_ir_cache() ? "on" : "off");
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_jtag_init_command)
 {
 	if (CMD_ARGC != 0)
@@ -771,6 +886,44 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.help = "Returns list of all JTAG tap names.",
 		.usage = "",
 	},
+	{
+		.name = "queue_optimize",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_optimize,
+		.help = "Drop redundant IR scans and merge runtests before "
+			"the JTAG queue goes to the adapter.",
+		.usage = "['on'|'off']",
+	},
+	{
+		.name = "ir_cache",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_ir_cache,
+		.help = "Skip IR scans of the instruction the TAP holds already.",
+		.usage = "['on'|'off']",
+	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_stats,
+		.help = "Show memory usage of the JTAG command queue.",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_stats,
+		.help = "Show or reset scan and timing counters of the JTAG "
+			"queue, in total and per TAP.",
+		.usage = "['reset']",
+	},
+	{
+		.name = "stats_interval",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_stats_interval,
+		.help = "Log a line of JTAG counters every this many "
+			"milliseconds while the queue is in use, 0 to disable.",
+		.usage = "[milliseconds]",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
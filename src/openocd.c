@@ -18,9 +18,12 @@
 #include "openocd.h"
 #include <jtag/adapter.h>
 #include <jtag/jtag.h>
+#include <jtag/bscan/bscan.h>
 #include <transport/transport.h>
 #include <helper/util.h>
 #include <helper/configuration.h>
+#include <helper/perf.h>
+#include <helper/time_support.h>
 #include <flash/nor/core.h>
 #include <flash/nand/core.h>
 #include <pld/pld.h>
@@ -28,10 +31,12 @@
 #include <target/arm_adi_v5.h>
 #include <target/arm_tpiu_swo.h>
 #include <rtt/rtt.h>
+#include <rtos/rtos.h>
 
 #include <server/server.h>
 #include <server/gdb_server.h>
 #include <server/rtt_server.h>
+#include <server/remote_jtag_server.h>
 
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
@@ -50,6 +55,43 @@ static const char openocd_startup_tcl[] = {
 0 /* Terminate with zero */
 };
 
+/* Time spent in the startup phases, reported with --startup-profile */
+#define STARTUP_PHASES_MAX 10
+
+static struct {
+	const char *name;
+	int64_t us;
+} startup_phases[STARTUP_PHASES_MAX];
+static unsigned int startup_num_phases;
+static int64_t startup_phase_start;
+
+static void startup_phase_done(const char *name)
+{
+	const int64_t now = timeval_us();
+
+	if (startup_num_phases < STARTUP_PHASES_MAX) {
+		startup_phases[startup_num_phases].name = name;
+		startup_phases[startup_num_phases].us = now - startup_phase_start;
+		startup_num_phases++;
+	}
+	startup_phase_start = now;
+}
+
+static void startup_profile_report(void)
+{
+	if (!startup_profile_flag)
+		return;
+
+	int64_t total = 0;
+	for (unsigned int i = 0; i < startup_num_phases; i++) {
+		LOG_USER("startup: %-24s %6" PRId64 ".%03" PRId64 " ms", startup_phases[i].name,
+				startup_phases[i].us / 1000, startup_phases[i].us % 1000);
+		total += startup_phases[i].us;
+	}
+	LOG_USER("startup: %-24s %6" PRId64 ".%03" PRId64 " ms", "total",
+			total / 1000, total % 1000);
+}
+
 /* Give scripts and TELNET a way to find out what version this is */
 COMMAND_HANDLER(handler_version_command)
 {
@@ -238,6 +280,7 @@ static struct command_context *setup_command_handler(Jim_Interp *interp)
 	LOG_DEBUG("log_init: complete");
 
 	struct command_context *cmd_ctx = command_init(openocd_startup_tcl, interp);
+	startup_phase_done("embedded startup.tcl");
 
 	/* register subsystem commands */
 	typedef int (*command_registrant_t)(struct command_context *cmd_ctx_value);
@@ -246,7 +289,9 @@ static struct command_context *setup_command_handler(Jim_Interp *interp)
 		&server_register_commands,
 		&gdb_register_commands,
 		&log_register_commands,
+		&perf_register_commands,
 		&rtt_server_register_commands,
+		&remote_jtag_server_register_commands,
 		&transport_register_commands,
 		&adapter_register_commands,
 		&target_register_commands,
@@ -256,6 +301,7 @@ static struct command_context *setup_command_handler(Jim_Interp *interp)
 		&cti_register_commands,
 		&dap_register_commands,
 		&arm_tpiu_swo_register_commands,
+		&rtos_register_commands,
 		NULL
 	};
 	for (unsigned i = 0; command_registrants[i]; i++) {
@@ -266,6 +312,7 @@ static struct command_context *setup_command_handler(Jim_Interp *interp)
 		}
 	}
 	LOG_DEBUG("command registration: complete");
+	startup_phase_done("command registration");
 
 	LOG_OUTPUT(OPENOCD_VERSION "\n"
 		"Licensed under GNU GPL v2\n");
@@ -285,9 +332,11 @@ static int openocd_thread(int argc, char *argv[], struct command_context *cmd_ct
 
 	if (parse_cmdline_args(cmd_ctx, argc, argv) != ERROR_OK)
 		return ERROR_FAIL;
+	startup_phase_done("command line");
 
 	if (server_preinit() != ERROR_OK)
 		return ERROR_FAIL;
+	startup_phase_done("server preinit");
 
 	ret = parse_config_file(cmd_ctx);
 	if (ret == ERROR_COMMAND_CLOSE_CONNECTION) {
@@ -297,10 +346,12 @@ static int openocd_thread(int argc, char *argv[], struct command_context *cmd_ct
 		server_quit(); /* gdb server may be initialized by -c init */
 		return ERROR_FAIL;
 	}
+	startup_phase_done("configuration");
 
 	ret = server_init(cmd_ctx);
 	if (ret != ERROR_OK)
 		return ERROR_FAIL;
+	startup_phase_done("server init");
 
 	if (init_at_startup) {
 		ret = command_run_line(cmd_ctx, "init");
@@ -308,7 +359,9 @@ static int openocd_thread(int argc, char *argv[], struct command_context *cmd_ct
 			server_quit();
 			return ERROR_FAIL;
 		}
+		startup_phase_done("init");
 	}
+	startup_profile_report();
 
 	ret = server_loop(cmd_ctx);
 
@@ -331,6 +384,7 @@ int openocd_main(int argc, char *argv[])
 	/* initialize commandline interface */
 	struct command_context *cmd_ctx;
 
+	startup_phase_start = timeval_us();
 	cmd_ctx = setup_command_handler(NULL);
 
 	if (util_init(cmd_ctx) != ERROR_OK)
@@ -338,6 +392,7 @@ int openocd_main(int argc, char *argv[])
 
 	if (rtt_init() != ERROR_OK)
 		return EXIT_FAILURE;
+	startup_phase_done("utilities");
 
 	LOG_OUTPUT("For bug reports, read\n\t"
 		"http://openocd.org/doc/doxygen/bugs.html"
@@ -363,6 +418,8 @@ int openocd_main(int argc, char *argv[])
 	arm_cti_cleanup_all();
 	dap_cleanup_all();
 
+	bscan_cleanup_all();
+
 	adapter_quit();
 
 	server_host_os_close();
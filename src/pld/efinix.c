@@ -12,6 +12,7 @@
 #include <jtag/jtag.h>
 
 #include "pld.h"
+#include "pld_file.h"
 #include "raw_bit.h"
 
 #define PROGRAM   0x4
@@ -43,58 +44,60 @@ struct efinix_pld_device {
 
 static int efinix_read_bit_file(struct raw_bit_file *bit_file, const char *filename)
 {
-	FILE *input_file = fopen(filename, "r");
-	if (!input_file) {
-		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
+	struct pld_file *input_file = pld_file_open(filename);
+	if (!input_file)
 		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
-
-	fseek(input_file, 0, SEEK_END);
-	long length = ftell(input_file);
-	fseek(input_file, 0, SEEK_SET);
 
-	if (length < 0 || ((length % 3))) {
-		fclose(input_file);
-		LOG_ERROR("Failed to get length from file %s: %s", filename, strerror(errno));
-		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
-	bit_file->length = DIV_ROUND_UP(length, 3);
+	/* one byte per line, the size isn't known up front for a compressed file */
+	const size_t chunk_size = 64 * 1024;
+	size_t capacity = 0;
+	bit_file->length = 0;
+	bit_file->data = NULL;
 
-	bit_file->data = malloc(bit_file->length);
-	if (!bit_file->data) {
-		fclose(input_file);
-		LOG_ERROR("Out of memory");
-		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
-
-	bool end_detected = false;
 	char buffer[3];
-	for (size_t idx = 0; !end_detected && idx < bit_file->length; ++idx) {
-		size_t read_count = fread(buffer, sizeof(char), 3, input_file);
-		end_detected = feof(input_file);
-		if ((read_count == 3 && buffer[2] != '\n') ||
-			(read_count != 3 && !end_detected) ||
-			(read_count != 2 && end_detected)) {
-			fclose(input_file);
-			free(bit_file->data);
-			bit_file->data = NULL;
+	size_t read_count;
+	while ((read_count = pld_file_read(input_file, buffer, 3)) != 0) {
+		if ((read_count == 3 && buffer[2] != '\n') || read_count == 1) {
 			LOG_ERROR("unexpected line length");
-			return ERROR_PLD_FILE_LOAD_FAILED;
+			goto error;
 		}
 
 		if (!isxdigit(buffer[0]) || !isxdigit(buffer[1])) {
-			fclose(input_file);
-			free(bit_file->data);
-			bit_file->data = NULL;
 			LOG_ERROR("unexpected char in hex string");
-			return ERROR_PLD_FILE_LOAD_FAILED;
+			goto error;
 		}
-		unhexify(&bit_file->data[idx], buffer, 2);
+
+		if (bit_file->length == capacity) {
+			uint8_t *data = realloc(bit_file->data, capacity + chunk_size);
+			if (!data) {
+				LOG_ERROR("Out of memory");
+				goto error;
+			}
+			bit_file->data = data;
+			capacity += chunk_size;
+		}
+		unhexify(&bit_file->data[bit_file->length++], buffer, 2);
+
+		/* only the last line may lack its newline */
+		if (read_count == 2)
+			break;
 	}
 
-	fclose(input_file);
+	const char *error = pld_file_error(input_file);
+	if (error) {
+		LOG_ERROR("Failed to read file %s: %s", filename, error);
+		goto error;
+	}
+
+	pld_file_close(input_file);
 
 	return ERROR_OK;
+
+error:
+	pld_file_close(input_file);
+	free(bit_file->data);
+	bit_file->data = NULL;
+	return ERROR_PLD_FILE_LOAD_FAILED;
 }
 
 static int efinix_read_file(struct raw_bit_file *bit_file, const char *filename)
@@ -109,10 +112,10 @@ static int efinix_read_file(struct raw_bit_file *bit_file, const char *filename)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	if (strcasecmp(file_ending_pos, ".bin") == 0) {
+	if (pld_file_has_suffix(filename, ".bin")) {
 		return cpld_read_raw_bit_file(bit_file, filename);
-	} else if ((strcasecmp(file_ending_pos, ".bit") == 0) ||
-			(strcasecmp(file_ending_pos, ".hex") == 0)) {
+	} else if (pld_file_has_suffix(filename, ".bit") ||
+			pld_file_has_suffix(filename, ".hex")) {
 		return efinix_read_bit_file(bit_file, filename);
 	}
 
@@ -140,7 +143,7 @@ static int efinix_set_instr(struct jtag_tap *tap, uint8_t new_instr)
 static int efinix_load(struct pld_device *pld_device, const char *filename)
 {
 	struct raw_bit_file bit_file;
-	struct scan_field field[2];
+	struct scan_field field;
 
 	if (!pld_device || !pld_device->driver_priv)
 		return ERROR_FAIL;
@@ -167,28 +170,24 @@ static int efinix_load(struct pld_device *pld_device, const char *filename)
 	if (retval != ERROR_OK)
 		return retval;
 
-	for (size_t i = 0; i < bit_file.length; i++)
-		bit_file.data[i] = flip_u32(bit_file.data[i], 8);
-
 	/* shift in the bitstream */
-	field[0].num_bits = bit_file.length * 8;
-	field[0].out_value = bit_file.data;
-	field[0].in_value = NULL;
+	retval = pld_load_bitstream(tap, NULL, bit_file.data, bit_file.length, true, TAP_DRPAUSE);
+	free(bit_file.data);
+	if (retval != ERROR_OK)
+		return retval;
 
 	/* followed by zeros */
-	field[1].num_bits = TRAILING_ZEROS;
 	uint8_t *buf = calloc(TRAILING_ZEROS / 8, 1);
 	if (!buf) {
-		free(bit_file.data);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
-	field[1].out_value = buf;
-	field[1].in_value = NULL;
+	field.num_bits = TRAILING_ZEROS;
+	field.out_value = buf;
+	field.in_value = NULL;
 
-	jtag_add_dr_scan(tap, 2, field, TAP_DRPAUSE);
+	jtag_add_dr_scan(tap, 1, &field, TAP_DRPAUSE);
 	retval = jtag_execute_queue();
-	free(bit_file.data);
 	free(buf);
 	if (retval != ERROR_OK)
 		return retval;
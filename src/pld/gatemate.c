@@ -12,6 +12,7 @@
 #include <jtag/jtag.h>
 #include <jtag/adapter.h>
 #include "pld.h"
+#include "pld_file.h"
 #include "raw_bit.h"
 
 #define JTAG_CONFIGURE  0x06
@@ -75,7 +76,7 @@ static int gatemate_read_cfg_line(struct gatemate_bit_file *bit_file, const char
 	return ERROR_OK;
 }
 
-static int gatemate_getline(char **buffer, size_t *buf_size, FILE *input_file)
+static int gatemate_getline(char **buffer, size_t *buf_size, struct pld_file *input_file)
 {
 	const size_t chunk_size = 32;
 	if (!*buffer)
@@ -97,7 +98,7 @@ static int gatemate_getline(char **buffer, size_t *buf_size, FILE *input_file)
 			*buf_size += chunk_size;
 		}
 
-		int c = fgetc(input_file);
+		int c = pld_file_getc(input_file);
 		if ((c == EOF && read) || (char)c == '\n') {
 			(*buffer)[read++] = 0;
 			return read;
@@ -113,12 +114,10 @@ static int gatemate_getline(char **buffer, size_t *buf_size, FILE *input_file)
 
 static int gatemate_read_cfg_file(struct gatemate_bit_file *bit_file, const char *filename)
 {
-	FILE *input_file = fopen(filename, "r");
+	struct pld_file *input_file = pld_file_open(filename);
 
-	if (!input_file) {
-		LOG_ERROR("Couldn't open %s: %s", filename, strerror(errno));
+	if (!input_file)
 		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
 
 	int retval = ERROR_OK;
 	char *line_buffer = NULL;
@@ -130,7 +129,7 @@ static int gatemate_read_cfg_file(struct gatemate_bit_file *bit_file, const char
 	if (line_buffer)
 		free(line_buffer);
 
-	fclose(input_file);
+	pld_file_close(input_file);
 	if (retval != ERROR_OK)
 		free(bit_file->raw_file.data);
 	return retval;
@@ -150,9 +149,9 @@ static int gatemate_read_file(struct gatemate_bit_file *bit_file, const char *fi
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	if (strcasecmp(file_suffix_pos, ".bit") == 0)
+	if (pld_file_has_suffix(filename, ".bit"))
 		return cpld_read_raw_bit_file(&bit_file->raw_file, filename);
-	else if (strcasecmp(file_suffix_pos, ".cfg") == 0)
+	else if (pld_file_has_suffix(filename, ".cfg"))
 		return gatemate_read_cfg_file(bit_file, filename);
 
 	LOG_ERROR("Filetype not supported, expecting .bit or .cfg file");
@@ -199,13 +198,8 @@ static int gatemate_load(struct pld_device *pld_device, const char *filename)
 		return retval;
 	}
 
-	struct scan_field field;
-	field.num_bits = bit_file.raw_file.length * 8;
-	field.out_value = bit_file.raw_file.data;
-	field.in_value = NULL;
-	jtag_add_dr_scan(tap, 1, &field, TAP_IDLE);
-
-	retval = jtag_execute_queue();
+	retval = pld_load_bitstream(tap, NULL, bit_file.raw_file.data,
+		bit_file.raw_file.length, false, TAP_IDLE);
 	free(bit_file.raw_file.data);
 
 	return retval;
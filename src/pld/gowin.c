@@ -13,6 +13,7 @@
 #include <jtag/adapter.h>
 #include <helper/bits.h>
 #include "pld.h"
+#include "pld_file.h"
 #include "raw_bit.h"
 
 #define NO_OP                       0x02
@@ -81,7 +82,7 @@ static int gowin_add_byte_to_bit_file(struct gowin_bit_file *bit_file, uint8_t b
 	return ERROR_OK;
 }
 
-static int gowin_read_fs_file_header(struct gowin_bit_file *bit_file, FILE *stream)
+static int gowin_read_fs_file_header(struct gowin_bit_file *bit_file, struct pld_file *stream)
 {
 	if (!bit_file)
 		return ERROR_FAIL;
@@ -89,8 +90,8 @@ static int gowin_read_fs_file_header(struct gowin_bit_file *bit_file, FILE *stre
 	int end_of_header = 0;
 	while (!end_of_header) {
 		char buffer[256];
-		char *line = fgets(buffer, 256, stream);
-		if (!line || feof(stream) || ferror(stream))
+		char *line = pld_file_gets(stream, buffer, 256);
+		if (!line || pld_file_eof(stream) || pld_file_error(stream))
 			return ERROR_FAIL;
 
 		if (line[0] == '/')
@@ -125,28 +126,26 @@ static int gowin_read_fs_file_header(struct gowin_bit_file *bit_file, FILE *stre
 
 static int gowin_read_fs_file(struct gowin_bit_file *bit_file, const char *filename)
 {
-	FILE *input_file = fopen(filename, "r");
+	struct pld_file *input_file = pld_file_open(filename);
 
-	if (!input_file) {
-		LOG_ERROR("Couldn't open %s: %s", filename, strerror(errno));
+	if (!input_file)
 		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
 
 	int retval = gowin_read_fs_file_header(bit_file, input_file);
 	if (retval != ERROR_OK) {
 		free(bit_file->raw_file.data);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return retval;
 	}
 
 	char digits_buffer[9]; /* 8 + 1 trailing zero */
 	do {
-		char *digits = fgets(digits_buffer, 9, input_file);
-		if (feof(input_file))
+		char *digits = pld_file_gets(input_file, digits_buffer, 9);
+		if (pld_file_eof(input_file))
 			break;
-		if (!digits || ferror(input_file)) {
+		if (!digits || pld_file_error(input_file)) {
 			free(bit_file->raw_file.data);
-			fclose(input_file);
+			pld_file_close(input_file);
 			return ERROR_FAIL;
 		}
 		if (digits[0] == '\n')
@@ -154,19 +153,25 @@ static int gowin_read_fs_file(struct gowin_bit_file *bit_file, const char *filen
 
 		if (strlen(digits) != 8) {
 			free(bit_file->raw_file.data);
-			fclose(input_file);
+			pld_file_close(input_file);
+			return ERROR_FAIL;
+		}
+		uint8_t byte;
+		if (unbinarize(&byte, digits, 1) != 1) {
+			LOG_ERROR("unexpected char in bit string");
+			free(bit_file->raw_file.data);
+			pld_file_close(input_file);
 			return ERROR_FAIL;
 		}
-		uint8_t byte = gowin_read_fs_file_bitsequence(digits, 8);
 		retval = gowin_add_byte_to_bit_file(bit_file, byte);
 		if (retval != ERROR_OK) {
 			free(bit_file->raw_file.data);
-			fclose(input_file);
+			pld_file_close(input_file);
 			return ERROR_FAIL;
 		}
 	} while (1);
 
-	fclose(input_file);
+	pld_file_close(input_file);
 	return ERROR_OK;
 }
 
@@ -184,10 +189,10 @@ static int gowin_read_file(struct gowin_bit_file *bit_file, const char *filename
 	}
 
 	/* check if binary .bin or ascii .fs */
-	if (strcasecmp(file_suffix_pos, ".bin") == 0) {
+	if (pld_file_has_suffix(filename, ".bin")) {
 		*is_fs = false;
 		return cpld_read_raw_bit_file(&bit_file->raw_file, filename);
-	} else if (strcasecmp(file_suffix_pos, ".fs") == 0) {
+	} else if (pld_file_has_suffix(filename, ".fs")) {
 		*is_fs = true;
 		return gowin_read_fs_file(bit_file, filename);
 	}
@@ -358,9 +363,6 @@ static int gowin_load_to_sram(struct pld_device *pld_device, const char *filenam
 	if (retval != ERROR_OK)
 		return retval;
 
-	for (unsigned int i = 0; i < bit_file.raw_file.length; i++)
-		bit_file.raw_file.data[i] = flip_u32(bit_file.raw_file.data[i], 8);
-
 	uint32_t id;
 	retval = gowin_read_register(tap, IDCODE, &id);
 	if (retval != ERROR_OK) {
@@ -399,21 +401,18 @@ static int gowin_load_to_sram(struct pld_device *pld_device, const char *filenam
 	}
 
 	/* scan out the bitstream */
-	struct scan_field field;
-	field.num_bits = bit_file.raw_file.length * 8;
-	field.out_value = bit_file.raw_file.data;
-	field.in_value = bit_file.raw_file.data;
-	jtag_add_dr_scan(gowin_info->tap, 1, &field, TAP_IDLE);
-	jtag_add_runtest(3, TAP_IDLE);
+	retval = pld_load_bitstream(tap, NULL, bit_file.raw_file.data,
+		bit_file.raw_file.length, true, TAP_IDLE);
+	free(bit_file.raw_file.data);
+	if (retval != ERROR_OK)
+		return retval;
 
+	jtag_add_runtest(3, TAP_IDLE);
 	retval = jtag_execute_queue();
-	if (retval != ERROR_OK) {
-		free(bit_file.raw_file.data);
+	if (retval != ERROR_OK)
 		return retval;
-	}
 
 	retval = gowin_disable_config(tap);
-	free(bit_file.raw_file.data);
 	if (retval != ERROR_OK)
 		return retval;
 
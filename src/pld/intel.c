@@ -15,6 +15,7 @@
 #include <helper/log.h>
 
 #include "pld.h"
+#include "pld_file.h"
 #include "raw_bit.h"
 
 #define BYPASS 0x3FF
@@ -65,7 +66,7 @@ static int intel_read_file(struct raw_bit_file *bit_file, const char *filename)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	if (strcasecmp(file_ending_pos, ".rbf") == 0)
+	if (pld_file_has_suffix(filename, ".rbf"))
 		return cpld_read_raw_bit_file(bit_file, filename);
 
 	LOG_ERROR("Unable to detect filetype");
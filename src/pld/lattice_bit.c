@@ -11,6 +11,7 @@
 #include "lattice_bit.h"
 #include "raw_bit.h"
 #include "pld.h"
+#include "pld_file.h"
 #include <helper/system.h>
 #include <helper/log.h>
 #include <helper/binarybuffer.h>
@@ -79,8 +80,8 @@ static int lattice_read_bit_file(struct lattice_bit_file *bit_file, const char *
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	for (size_t i = bit_file->offset; i < bit_file->raw_bit.length; i++)
-		bit_file->raw_bit.data[i] = flip_u32(bit_file->raw_bit.data[i], 8);
+	buf_flip_bytes(bit_file->raw_bit.data + bit_file->offset,
+			bit_file->raw_bit.length - bit_file->offset);
 
 	return ERROR_OK;
 }
@@ -97,7 +98,7 @@ int lattice_read_file(struct lattice_bit_file *bit_file, const char *filename, e
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	if (strcasecmp(file_suffix_pos, ".bit") == 0)
+	if (pld_file_has_suffix(filename, ".bit"))
 		return lattice_read_bit_file(bit_file, filename, family);
 
 	LOG_ERROR("Filetype not supported");
@@ -10,7 +10,9 @@
 #endif
 
 #include "pld.h"
+#include "pld_file.h"
 #include <sys/stat.h>
+#include <helper/binarybuffer.h>
 #include <helper/log.h>
 #include <helper/replacements.h>
 #include <helper/time_support.h>
@@ -158,6 +160,96 @@ int pld_disconnect_spi_from_jtag(struct pld_device *pld_device)
 	return ERROR_FAIL;
 }
 
+/* big enough to keep the adapter busy, small enough to be read quickly */
+#define PLD_LOAD_CHUNK_SIZE (64 * 1024)
+
+/* Queue a DR scan of zeros for the bypass registers of other TAPs. */
+static int pld_add_bypass_scan(unsigned int num_bits, tap_state_t end_state)
+{
+	uint8_t *zeros = calloc(DIV_ROUND_UP(num_bits, 8), 1);
+	if (!zeros) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	jtag_add_plain_dr_scan(num_bits, zeros, NULL, end_state);
+	free(zeros);
+	return ERROR_OK;
+}
+
+int pld_load_bitstream(struct jtag_tap *tap, struct pld_file *file, const uint8_t *data,
+		size_t length, bool flip, tap_state_t end_state)
+{
+	/* The chunks are plain scans, so that the bypass bit of the other TAPs
+	 * is shifted once for the whole bitstream and not once per chunk. */
+	unsigned int bypass_before = 0, bypass_after = 0;
+	bool after = false;
+	for (struct jtag_tap *t = jtag_tap_next_enabled(NULL); t; t = jtag_tap_next_enabled(t)) {
+		if (t == tap)
+			after = true;
+		else if (after)
+			bypass_after++;
+		else
+			bypass_before++;
+	}
+
+	uint8_t *chunk = malloc(MIN(length, PLD_LOAD_CHUNK_SIZE));
+	if (!chunk && length) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+	if (bypass_before)
+		retval = pld_add_bypass_scan(bypass_before, length ? TAP_DRPAUSE : end_state);
+
+	struct jtag_async *async = NULL;
+	for (size_t offset = 0; offset < length && retval == ERROR_OK; ) {
+		const size_t size = MIN(length - offset, PLD_LOAD_CHUNK_SIZE);
+		const bool last = offset + size == length;
+
+		if (file) {
+			if (pld_file_read(file, chunk, size) != size) {
+				const char *error = pld_file_error(file);
+				LOG_ERROR("couldn't read bitstream: %s",
+					error ? error : "unexpected end of file");
+				retval = ERROR_PLD_FILE_LOAD_FAILED;
+				break;
+			}
+		} else {
+			memcpy(chunk, data + offset, size);
+		}
+		if (flip)
+			buf_flip_bytes(chunk, size);
+
+		/* the scan copies the chunk, it can be refilled right away */
+		jtag_add_plain_dr_scan(size * 8, chunk, NULL,
+			(last && !bypass_after) ? end_state : TAP_DRPAUSE);
+		if (last && bypass_after)
+			retval = pld_add_bypass_scan(bypass_after, end_state);
+		offset += size;
+
+		int wait_retval = jtag_async_wait(async);
+		async = NULL;
+		if (retval == ERROR_OK)
+			retval = wait_retval;
+		if (retval == ERROR_OK)
+			retval = jtag_execute_queue_async(&async);
+
+		keep_alive();
+	}
+
+	int wait_retval = jtag_async_wait(async);
+	if (retval == ERROR_OK)
+		retval = wait_retval;
+	/* anything still queued, e.g. the padding of an empty bitstream */
+	wait_retval = jtag_execute_queue();
+	if (retval == ERROR_OK)
+		retval = wait_retval;
+
+	free(chunk);
+	return retval;
+}
+
 COMMAND_HANDLER(handle_pld_create_command)
 {
 	if (CMD_ARGC < 2)
@@ -9,8 +9,10 @@
 #define OPENOCD_PLD_PLD_H
 
 #include <helper/command.h>
+#include <jtag/jtag.h>
 
 struct pld_device;
+struct pld_file;
 
 #define __PLD_CREATE_COMMAND(name) \
 	COMMAND_HELPER(name, struct pld_device *pld)
@@ -28,6 +30,17 @@ int pld_get_jtagspi_stuff_bits(struct pld_device *pld_device, unsigned int *faci
 int pld_connect_spi_to_jtag(struct pld_device *pld_device);
 int pld_disconnect_spi_from_jtag(struct pld_device *pld_device);
 
+/**
+ * Shift a bitstream into the DR of @a tap, which is left in @a end_state.
+ * The bitstream is @a length bytes read from @a file, from its current
+ * position, or taken from @a data if @a file is NULL. It is sent in chunks,
+ * each one read and, if @a flip is set, bit reversed while the previous one
+ * is shifted. The chain idles in DRPAUSE between chunks, which neither
+ * captures nor updates the DRs, so the device sees one long scan.
+ */
+int pld_load_bitstream(struct jtag_tap *tap, struct pld_file *file, const uint8_t *data,
+		size_t length, bool flip, tap_state_t end_state);
+
 struct pld_driver {
 	const char *name;
 	__PLD_CREATE_COMMAND((*pld_create_command));
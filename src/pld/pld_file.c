@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "pld_file.h"
+#include "pld.h"
+
+#include <helper/log.h>
+#include <helper/replacements.h>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define PLD_FILE_COMPRESSED_SUFFIX ".gz"
+#define PLD_FILE_BUFFER_SIZE (64 * 1024)
+
+struct pld_file {
+#if HAVE_ZLIB
+	/* reads uncompressed files as they are */
+	gzFile gz;
+#else
+	FILE *file;
+#endif
+};
+
+static bool pld_file_is_compressed(const char *filename)
+{
+	size_t len = strlen(filename);
+	size_t suffix_len = strlen(PLD_FILE_COMPRESSED_SUFFIX);
+
+	return len > suffix_len &&
+		strcasecmp(filename + len - suffix_len, PLD_FILE_COMPRESSED_SUFFIX) == 0;
+}
+
+bool pld_file_has_suffix(const char *filename, const char *suffix)
+{
+	size_t len = strlen(filename);
+	size_t suffix_len = strlen(suffix);
+
+	if (pld_file_is_compressed(filename))
+		len -= strlen(PLD_FILE_COMPRESSED_SUFFIX);
+
+	return len >= suffix_len &&
+		strncasecmp(filename + len - suffix_len, suffix, suffix_len) == 0;
+}
+
+struct pld_file *pld_file_open(const char *filename)
+{
+	struct pld_file *file = malloc(sizeof(*file));
+	if (!file) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+
+#if HAVE_ZLIB
+	file->gz = gzopen(filename, "rb");
+	if (!file->gz) {
+		LOG_ERROR("couldn't open %s: %s", filename,
+			errno ? strerror(errno) : "out of memory");
+		free(file);
+		return NULL;
+	}
+	gzbuffer(file->gz, PLD_FILE_BUFFER_SIZE);
+#else
+	if (pld_file_is_compressed(filename)) {
+		LOG_ERROR("couldn't open %s: OpenOCD was built without zlib", filename);
+		free(file);
+		return NULL;
+	}
+	file->file = fopen(filename, "rb");
+	if (!file->file) {
+		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
+		free(file);
+		return NULL;
+	}
+#endif
+
+	return file;
+}
+
+void pld_file_close(struct pld_file *file)
+{
+	if (!file)
+		return;
+
+#if HAVE_ZLIB
+	gzclose(file->gz);
+#else
+	fclose(file->file);
+#endif
+	free(file);
+}
+
+size_t pld_file_read(struct pld_file *file, void *buf, size_t size)
+{
+#if HAVE_ZLIB
+	uint8_t *dst = buf;
+	size_t read = 0;
+
+	/* gzread() takes an unsigned int */
+	while (read < size) {
+		int n = gzread(file->gz, dst + read, MIN(size - read, 1u << 30));
+		if (n <= 0)
+			break;
+		read += n;
+	}
+	return read;
+#else
+	return fread(buf, 1, size, file->file);
+#endif
+}
+
+char *pld_file_gets(struct pld_file *file, char *buf, int size)
+{
+#if HAVE_ZLIB
+	return gzgets(file->gz, buf, size);
+#else
+	return fgets(buf, size, file->file);
+#endif
+}
+
+int pld_file_getc(struct pld_file *file)
+{
+#if HAVE_ZLIB
+	return gzgetc(file->gz);
+#else
+	return fgetc(file->file);
+#endif
+}
+
+bool pld_file_eof(struct pld_file *file)
+{
+#if HAVE_ZLIB
+	return gzeof(file->gz);
+#else
+	return feof(file->file);
+#endif
+}
+
+const char *pld_file_error(struct pld_file *file)
+{
+#if HAVE_ZLIB
+	int errnum;
+	const char *msg = gzerror(file->gz, &errnum);
+	if (errnum == Z_OK)
+		return NULL;
+	return errnum == Z_ERRNO ? strerror(errno) : msg;
+#else
+	return ferror(file->file) ? strerror(errno) : NULL;
+#endif
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_PLD_PLD_FILE_H
+#define OPENOCD_PLD_PLD_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Bitstream file opened for reading. Files compressed with gzip are
+ * decompressed on the fly when OpenOCD is built with zlib, so that they
+ * can be read in chunks without an uncompressed copy on disk or in memory.
+ */
+struct pld_file;
+
+/** Open @a filename for reading, errors are logged. */
+struct pld_file *pld_file_open(const char *filename);
+void pld_file_close(struct pld_file *file);
+
+/** Read up to @a size bytes, fewer at the end of the file or on error. */
+size_t pld_file_read(struct pld_file *file, void *buf, size_t size);
+/** Like fgets(). */
+char *pld_file_gets(struct pld_file *file, char *buf, int size);
+/** Like fgetc(). */
+int pld_file_getc(struct pld_file *file);
+bool pld_file_eof(struct pld_file *file);
+/** @returns a description of the last read error, or NULL if there was none. */
+const char *pld_file_error(struct pld_file *file);
+
+/**
+ * @returns true if @a filename ends with @a suffix, ignoring case and the
+ * suffix of a compressed file, e.g. "top.bit.gz" has the suffix ".bit".
+ */
+bool pld_file_has_suffix(const char *filename, const char *suffix);
+
+#endif /* OPENOCD_PLD_PLD_FILE_H */
@@ -11,45 +11,52 @@
 
 #include "raw_bit.h"
 #include "pld.h"
+#include "pld_file.h"
 
 #include <helper/system.h>
 #include <helper/log.h>
 
+#define RAW_BIT_FILE_MIN_SIZE (64 * 1024)
 
 int cpld_read_raw_bit_file(struct raw_bit_file *bit_file, const char *filename)
 {
-	FILE *input_file = fopen(filename, "rb");
-
-	if (!input_file) {
-		LOG_ERROR("Couldn't open %s: %s", filename, strerror(errno));
-		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
-
-	fseek(input_file, 0, SEEK_END);
-	long length = ftell(input_file);
-	fseek(input_file, 0, SEEK_SET);
-
-	if (length < 0) {
-		fclose(input_file);
-		LOG_ERROR("Failed to get length of file %s: %s", filename, strerror(errno));
+	struct pld_file *input_file = pld_file_open(filename);
+	if (!input_file)
 		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
-	bit_file->length = (size_t)length;
-
-	bit_file->data = malloc(bit_file->length);
-	if (!bit_file->data) {
-		fclose(input_file);
-		LOG_ERROR("Out of memory");
-		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
 
-	size_t read_count = fread(bit_file->data, sizeof(char), bit_file->length, input_file);
-	fclose(input_file);
-	if (read_count != bit_file->length) {
+	/* the size isn't known up front for a compressed file */
+	size_t capacity = 0;
+	bit_file->length = 0;
+	bit_file->data = NULL;
+	do {
+		if (bit_file->length == capacity) {
+			capacity = MAX(2 * capacity, RAW_BIT_FILE_MIN_SIZE);
+			uint8_t *data = realloc(bit_file->data, capacity);
+			if (!data) {
+				pld_file_close(input_file);
+				free(bit_file->data);
+				bit_file->data = NULL;
+				LOG_ERROR("Out of memory");
+				return ERROR_PLD_FILE_LOAD_FAILED;
+			}
+			bit_file->data = data;
+		}
+		size_t read_count = pld_file_read(input_file, bit_file->data + bit_file->length,
+			capacity - bit_file->length);
+		bit_file->length += read_count;
+		if (!read_count)
+			break;
+	} while (true);
+
+	const char *error = pld_file_error(input_file);
+	if (error) {
+		LOG_ERROR("Failed to read file %s: %s", filename, error);
+		pld_file_close(input_file);
 		free(bit_file->data);
 		bit_file->data = NULL;
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
+	pld_file_close(input_file);
 
 	return ERROR_OK;
 }
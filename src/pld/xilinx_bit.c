@@ -11,15 +11,15 @@
 
 #include "xilinx_bit.h"
 #include "pld.h"
+#include "pld_file.h"
 #include <helper/log.h>
 
 #include <helper/system.h>
 
-static int read_section(FILE *input_file, int length_size, char section,
-	uint32_t *buffer_length, uint8_t **buffer)
+static int read_section_length(struct pld_file *input_file, int length_size, char section,
+	uint32_t *length)
 {
 	uint8_t length_buffer[4];
-	int length;
 	char section_char;
 	int read_count;
 
@@ -28,47 +28,61 @@ static int read_section(FILE *input_file, int length_size, char section,
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	read_count = fread(&section_char, 1, 1, input_file);
+	read_count = pld_file_read(input_file, &section_char, 1);
 	if (read_count != 1)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
 	if (section_char != section)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
-	read_count = fread(length_buffer, 1, length_size, input_file);
+	read_count = pld_file_read(input_file, length_buffer, length_size);
 	if (read_count != length_size)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
 	if (length_size == 4)
-		length = be_to_h_u32(length_buffer);
+		*length = be_to_h_u32(length_buffer);
 	else	/* (length_size == 2) */
-		length = be_to_h_u16(length_buffer);
+		*length = be_to_h_u16(length_buffer);
+
+	return ERROR_OK;
+}
+
+static int read_section(struct pld_file *input_file, int length_size, char section,
+	uint32_t *buffer_length, uint8_t **buffer)
+{
+	uint32_t length;
+	size_t read_count;
+
+	int retval = read_section_length(input_file, length_size, section, &length);
+	if (retval != ERROR_OK)
+		return retval;
 
 	if (buffer_length)
 		*buffer_length = length;
 
 	*buffer = malloc(length);
+	if (!*buffer)
+		return ERROR_PLD_FILE_LOAD_FAILED;
 
-	read_count = fread(*buffer, 1, length, input_file);
+	read_count = pld_file_read(input_file, *buffer, length);
 	if (read_count != length)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
 	return ERROR_OK;
 }
 
-int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
+int xilinx_open_bit_file(struct xilinx_bit_file *bit_file, const char *filename,
+	struct pld_file **file)
 {
-	FILE *input_file;
+	struct pld_file *input_file;
 	int read_count;
 
 	if (!filename || !bit_file)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	input_file = fopen(filename, "rb");
-	if (!input_file) {
-		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
+	input_file = pld_file_open(filename);
+	if (!input_file)
 		return ERROR_PLD_FILE_LOAD_FAILED;
-	}
 
 	bit_file->source_file = NULL;
 	bit_file->part_name = NULL;
@@ -76,47 +90,69 @@ int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
 	bit_file->time = NULL;
 	bit_file->data = NULL;
 
-	read_count = fread(bit_file->unknown_header, 1, 13, input_file);
+	read_count = pld_file_read(input_file, bit_file->unknown_header, 13);
 	if (read_count != 13) {
 		LOG_ERROR("couldn't read unknown_header from file '%s'", filename);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
 	if (read_section(input_file, 2, 'a', NULL, &bit_file->source_file) != ERROR_OK) {
 		xilinx_free_bit_file(bit_file);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
 	if (read_section(input_file, 2, 'b', NULL, &bit_file->part_name) != ERROR_OK) {
 		xilinx_free_bit_file(bit_file);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
 	if (read_section(input_file, 2, 'c', NULL, &bit_file->date) != ERROR_OK) {
 		xilinx_free_bit_file(bit_file);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
 	if (read_section(input_file, 2, 'd', NULL, &bit_file->time) != ERROR_OK) {
 		xilinx_free_bit_file(bit_file);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	if (read_section(input_file, 4, 'e', &bit_file->length, &bit_file->data) != ERROR_OK) {
+	if (read_section_length(input_file, 4, 'e', &bit_file->length) != ERROR_OK) {
 		xilinx_free_bit_file(bit_file);
-		fclose(input_file);
+		pld_file_close(input_file);
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
 	LOG_DEBUG("bit_file: %s %s %s,%s %" PRIu32 "", bit_file->source_file, bit_file->part_name,
 		bit_file->date, bit_file->time, bit_file->length);
 
-	fclose(input_file);
+	*file = input_file;
+
+	return ERROR_OK;
+}
+
+int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
+{
+	struct pld_file *input_file;
+
+	int retval = xilinx_open_bit_file(bit_file, filename, &input_file);
+	if (retval != ERROR_OK)
+		return retval;
+
+	bit_file->data = malloc(bit_file->length);
+	if (!bit_file->data ||
+		pld_file_read(input_file, bit_file->data, bit_file->length) != bit_file->length) {
+		LOG_ERROR("couldn't read the configuration data from file '%s'", filename);
+		xilinx_free_bit_file(bit_file);
+		pld_file_close(input_file);
+		return ERROR_PLD_FILE_LOAD_FAILED;
+	}
+
+	pld_file_close(input_file);
 
 	return ERROR_OK;
 }
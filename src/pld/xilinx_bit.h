@@ -10,6 +10,8 @@
 
 #include "helper/types.h"
 
+struct pld_file;
+
 struct xilinx_bit_file {
 	uint8_t unknown_header[13];
 	uint8_t *source_file;
@@ -22,6 +24,13 @@ struct xilinx_bit_file {
 
 int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename);
 
+/*
+ * Read the header of a .bit file, leaving the returned file at the start of
+ * the bit_file->length bytes of configuration data, which are not read.
+ */
+int xilinx_open_bit_file(struct xilinx_bit_file *bit_file, const char *filename,
+	struct pld_file **file);
+
 void xilinx_free_bit_file(struct xilinx_bit_file *bit_file);
 
 #endif /* OPENOCD_PLD_XILINX_BIT_H */
@@ -21,6 +21,8 @@
 
 #define FREERTOS_MAX_PRIORITIES	63
 #define FREERTOS_THREAD_NAME_STR_SIZE 200
+/* Fits a List_t and a ListItem_t with 64 bit pointers and ticks */
+#define FREERTOS_LIST_BUF_SIZE 40
 #define FREERTOS_CURRENT_EXECUTION_ID 1
 
 struct freertos_params {
@@ -36,6 +38,22 @@ struct freertos_thread_entry {
 	target_addr_t tcb;
 };
 
+/* State of the walk of one task list, see freertos_update_threads() */
+struct freertos_list_walk {
+	uint64_t remaining;
+	target_addr_t elem;
+	target_addr_t prev_elem;
+	bool queued;
+	/* the list header, then the current list item */
+	uint8_t buf[FREERTOS_LIST_BUF_SIZE];
+};
+
+struct freertos_task_found {
+	unsigned int list;
+	target_addr_t tcb;
+	char name[FREERTOS_THREAD_NAME_STR_SIZE];
+};
+
 struct FreeRTOS {
 	const struct freertos_params *param;
 	threadid_t last_threadid;
@@ -62,7 +80,15 @@ struct FreeRTOS {
 	unsigned list_next_size;
 	unsigned thread_stack_offset;
 	unsigned thread_stack_size;
+	unsigned thread_stack_limit_offset;
 	unsigned thread_name_offset;
+	/* As of the last full walk of the task lists. If neither changed since,
+	 * the set of tasks is still the same and only the current task needs to
+	 * be read again. */
+	bool thread_list_valid;
+	int thread_list_count;
+	uint64_t ux_task_number;
+	uint64_t ux_current_number_of_tasks;
 };
 
 static int cortex_m_stacking(struct rtos *rtos, const struct rtos_register_stacking **stacking,
@@ -234,6 +260,8 @@ static int freertos_get_thread_reg_value(struct rtos *rtos, threadid_t thread_id
 		uint32_t reg_num, uint32_t *size, uint8_t **value);
 static int freertos_set_reg(struct rtos *rtos, uint32_t reg_num, uint8_t *reg_value);
 static int freertos_get_symbol_list_to_lookup(struct symbol_table_elem *symbol_list[]);
+static int freertos_get_thread_stacks(struct rtos *rtos,
+		struct rtos_thread_stack *stacks, unsigned int num_stacks);
 
 const struct rtos_type freertos_rtos = {
 	.name = "FreeRTOS",
@@ -245,6 +273,7 @@ const struct rtos_type freertos_rtos = {
 	.get_thread_reg_value = freertos_get_thread_reg_value,
 	.set_reg = freertos_set_reg,
 	.get_symbol_list_to_lookup = freertos_get_symbol_list_to_lookup,
+	.get_thread_stacks = freertos_get_thread_stacks,
 };
 
 enum freertos_symbol_values {
@@ -260,6 +289,7 @@ enum freertos_symbol_values {
 	FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS = 9,
 	FREERTOS_VAL_UX_TOP_USED_PRIORITY = 10,
 	FREERTOS_VAL_X_SCHEDULER_RUNNING = 11,
+	FREERTOS_VAL_UX_TASK_NUMBER = 12,
 };
 
 struct symbols {
@@ -280,6 +310,7 @@ static const struct symbols freertos_symbol_list[] = {
 	{ "uxCurrentNumberOfTasks", false },
 	{ "uxTopUsedPriority", true }, /* Unavailable since v7.5.3 */
 	{ "xSchedulerRunning", false },
+	{ "uxTaskNumber", true }, /* Incremented for every task created */
 	{ NULL, false }
 };
 
@@ -430,6 +461,7 @@ static void freertos_compute_offsets(struct rtos *rtos)
 		freertos, task_control_block_info, ARRAY_SIZE(task_control_block_info));
 	freertos->thread_stack_offset = task_control_block_info[0].offset;
 	freertos->thread_stack_size = task_control_block_info[0].size;
+	freertos->thread_stack_limit_offset = task_control_block_info[4].offset;
 	freertos->thread_name_offset = task_control_block_info[5].offset;
 }
 
@@ -455,6 +487,40 @@ struct freertos_thread_entry *thread_entry_list_find_by_id(
 	return NULL;
 }
 
+/* Keep the thread list of the previous update if no task was created or
+ * deleted since, only updating which one is running. Returns true if the
+ * thread list is up to date. */
+static bool freertos_update_current_thread(struct rtos *rtos, uint64_t ux_task_number,
+		uint64_t thread_list_size, target_addr_t px_current_tcb)
+{
+	struct FreeRTOS *freertos = (struct FreeRTOS *) rtos->rtos_specific_params;
+
+	if (!freertos->thread_list_valid || !rtos->thread_details ||
+			rtos->thread_count != freertos->thread_list_count ||
+			rtos->current_thread == FREERTOS_CURRENT_EXECUTION_ID ||
+			ux_task_number != freertos->ux_task_number ||
+			thread_list_size != freertos->ux_current_number_of_tasks)
+		return false;
+
+	const struct freertos_thread_entry *current =
+		thread_entry_list_find_by_tcb(&freertos->thread_entry_list, px_current_tcb);
+	if (!current)
+		return false;
+
+	char running_str[] = "State: Running";
+	for (int i = 0; i < rtos->thread_count; i++) {
+		struct thread_detail *detail = &rtos->thread_details[i];
+		free(detail->extra_info_str);
+		detail->extra_info_str = NULL;
+		if (detail->threadid == current->threadid)
+			detail->extra_info_str = strdup(running_str);
+	}
+	rtos->current_thread = current->threadid;
+	LOG_DEBUG("FreeRTOS: Task list unchanged, current thread is %" PRId64,
+			rtos->current_thread);
+	return true;
+}
+
 static int freertos_update_threads(struct rtos *rtos)
 {
 	int retval;
@@ -492,9 +558,6 @@ static int freertos_update_threads(struct rtos *rtos)
 		return retval;
 	}
 
-	/* wipe out previous thread details if any */
-	rtos_free_threadlist(rtos);
-
 	/* read the current thread */
 	target_addr_t px_current_tcb;
 	retval = freertos_read_struct_value(rtos->target,
@@ -525,6 +588,26 @@ static int freertos_update_threads(struct rtos *rtos)
 										rtos->symbols[FREERTOS_VAL_X_SCHEDULER_RUNNING].address,
 										scheduler_running);
 
+	/* uxTaskNumber is only there with configUSE_TRACE_FACILITY. Without it
+	 * a task could have been created and another deleted, so the whole list
+	 * has to be read every time. */
+	bool have_task_number = false;
+	uint64_t ux_task_number = 0;
+	if (rtos->symbols[FREERTOS_VAL_UX_TASK_NUMBER].address != 0)
+		have_task_number = freertos_read_struct_value(rtos->target,
+				rtos->symbols[FREERTOS_VAL_UX_TASK_NUMBER].address, 0,
+				freertos->ubasetype_size, &ux_task_number) == ERROR_OK;
+
+	if (have_task_number && thread_list_size != 0 && px_current_tcb != 0 &&
+			scheduler_running == 1 &&
+			freertos_update_current_thread(rtos, ux_task_number, thread_list_size,
+				px_current_tcb))
+		return ERROR_OK;
+
+	/* wipe out previous thread details if any */
+	rtos_free_threadlist(rtos);
+	freertos->thread_list_valid = false;
+
 	if (thread_list_size  == 0 || px_current_tcb == 0 || scheduler_running != 1) {
 		/* Either : No RTOS threads - there is always at least the current execution though */
 		/* OR     : No current thread - all threads suspended - show the current execution
@@ -610,67 +693,117 @@ static int freertos_update_threads(struct rtos *rtos)
 	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_SUSPENDED_TASK_LIST].address;
 	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_TASKS_WAITING_TERMINATION].address;
 
+	/* Walk all lists side by side, reading one item of each list per pass
+	 * and the list headers and the task names in a single pass each, so the
+	 * number of round trips to the target only depends on the length of
+	 * the longest list. */
+	struct freertos_list_walk *walks = calloc(num_lists, sizeof(*walks));
+	struct freertos_task_found *found = calloc(thread_list_size, sizeof(*found));
+	struct target_memory_read_block *blocks = calloc(MAX(num_lists, thread_list_size),
+			sizeof(*blocks));
+	if (!walks || !found || !blocks) {
+		LOG_ERROR("Error allocating memory for the FreeRTOS task lists");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	unsigned int num_blocks = 0;
 	for (unsigned int i = 0; i < num_lists; i++) {
 		if (list_of_lists[i] == 0)
 			continue;
+		blocks[num_blocks++] = (struct target_memory_read_block){
+			.address = list_of_lists[i],
+			.size = freertos->list_width,
+			.buffer = walks[i].buf,
+		};
+	}
+	retval = target_read_buffer_list(rtos->target, blocks, num_blocks);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading FreeRTOS thread lists");
+		goto out;
+	}
 
-		/* Read the number of threads in this list */
-		uint64_t list_thread_count = 0;
-		retval = freertos_read_struct_value(rtos->target,
-											list_of_lists[i],
-											freertos->list_uxNumberOfItems_offset,
-											freertos->list_uxNumberOfItems_size,
-											&list_thread_count);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading number of threads in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
-		}
-		LOG_DEBUG("FreeRTOS: Read thread count for list %u at 0x%" PRIx64 ", value %" PRIu64,
-								i, list_of_lists[i] + freertos->list_uxNumberOfItems_offset, list_thread_count);
-
-		if (list_thread_count == 0)
+	for (unsigned int i = 0; i < num_lists; i++) {
+		if (list_of_lists[i] == 0)
 			continue;
+		walks[i].remaining = buf_get_u64(walks[i].buf + freertos->list_uxNumberOfItems_offset,
+				0, freertos->list_uxNumberOfItems_size * 8);
+		walks[i].elem = buf_get_u64(walks[i].buf + freertos->list_next_offset,
+				0, freertos->list_next_size * 8);
+		walks[i].prev_elem = -1;
+		LOG_DEBUG("FreeRTOS: Read list %u at 0x%" PRIx64 ", %" PRIu64 " items, first 0x%" PRIx64,
+				i, list_of_lists[i], walks[i].remaining, walks[i].elem);
+	}
 
-		/* Read the location of first list item */
-		target_addr_t prev_list_elem_ptr = -1;
-		target_addr_t list_elem_ptr = 0;
-		retval = freertos_read_struct_value(rtos->target,
-											list_of_lists[i],
-											freertos->list_next_offset,
-											freertos->list_next_size,
-											&list_elem_ptr);
+	unsigned int num_found = 0;
+	for (;;) {
+		num_blocks = 0;
+		for (unsigned int i = 0; i < num_lists; i++) {
+			struct freertos_list_walk *walk = &walks[i];
+			if (walk->remaining == 0 || walk->elem == 0 || walk->elem == walk->prev_elem ||
+					tasks_found + num_found + num_blocks >= thread_list_size)
+				continue;
+			blocks[num_blocks++] = (struct target_memory_read_block){
+				.address = walk->elem,
+				.size = freertos->list_item_width,
+				.buffer = walk->buf,
+			};
+			walk->queued = true;
+		}
+		if (num_blocks == 0)
+			break;
+
+		retval = target_read_buffer_list(rtos->target, blocks, num_blocks);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
+			LOG_ERROR("Error reading thread list items in FreeRTOS thread list");
+			goto out;
 		}
-		LOG_DEBUG("FreeRTOS: Read first item for list %u at 0x%" PRIx64 ", value 0x%" PRIx64,
-				  i, list_of_lists[i] + freertos->list_next_offset, list_elem_ptr);
-
-		while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
-				(list_elem_ptr != prev_list_elem_ptr) &&
-				(tasks_found < thread_list_size)) {
-			/* Get the location of the thread structure. */
-			rtos->thread_details[tasks_found].threadid = 0;
-			target_addr_t tcb;
-			retval = freertos_read_struct_value(rtos->target,
-												list_elem_ptr,
-												freertos->list_elem_content_offset,
-												freertos->list_elem_content_size,
-												&tcb);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading thread list item object in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
+
+		for (unsigned int i = 0; i < num_lists; i++) {
+			struct freertos_list_walk *walk = &walks[i];
+			if (!walk->queued)
+				continue;
+			walk->queued = false;
+
+			found[num_found].list = i;
+			found[num_found].tcb = buf_get_u64(walk->buf + freertos->list_elem_content_offset,
+					0, freertos->list_elem_content_size * 8);
+			LOG_DEBUG("FreeRTOS: TCB 0x%" TARGET_PRIxADDR " read from 0x%" PRIx64,
+					found[num_found].tcb, walk->elem + freertos->list_elem_content_offset);
+			num_found++;
+
+			walk->remaining--;
+			walk->prev_elem = walk->elem;
+			walk->elem = buf_get_u64(walk->buf + freertos->list_elem_next_offset,
+					0, freertos->list_elem_next_size * 8);
+		}
+	}
+
+	for (unsigned int i = 0; i < num_found; i++) {
+		blocks[i] = (struct target_memory_read_block){
+			.address = found[i].tcb + freertos->thread_name_offset,
+			.size = FREERTOS_THREAD_NAME_STR_SIZE,
+			.buffer = (uint8_t *)found[i].name,
+		};
+	}
+	retval = target_read_buffer_list(rtos->target, blocks, num_found);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading thread names in FreeRTOS thread list");
+		goto out;
+	}
+
+	/* Keep the tasks in the order of the lists */
+	for (unsigned int i = 0; i < num_lists; i++) {
+		for (unsigned int j = 0; j < num_found; j++) {
+			if (found[j].list != i)
+				continue;
 
 			const struct freertos_thread_entry *value =
-				thread_entry_list_find_by_tcb(&freertos->thread_entry_list, tcb);
+				thread_entry_list_find_by_tcb(&freertos->thread_entry_list, found[j].tcb);
 
 			if (!value) {
 				struct freertos_thread_entry *new_value = calloc(1, sizeof(struct freertos_thread_entry));
-				new_value->tcb = tcb;
+				new_value->tcb = found[j].tcb;
 				/* threadid can't be 0.
 				 * plus 1 to avoid duplication with "Current Execution" */
 				new_value->threadid = ++freertos->last_threadid + FREERTOS_CURRENT_EXECUTION_ID;
@@ -684,72 +817,41 @@ static int freertos_update_threads(struct rtos *rtos)
 
 			rtos->thread_details[tasks_found].threadid = value->threadid;
 
-			LOG_DEBUG("FreeRTOS: Thread %" PRId64 " has TCB 0x%" TARGET_PRIxADDR
-					  "; read from 0x%" PRIx64,
-					  value->threadid, value->tcb,
-					  list_elem_ptr + freertos->list_elem_content_offset);
-
-			/* get thread name */
-
-			char tmp_str[FREERTOS_THREAD_NAME_STR_SIZE];
-
-			/* Read the thread name */
-			retval = target_read_buffer(rtos->target,
-					value->tcb + freertos->thread_name_offset,
-					FREERTOS_THREAD_NAME_STR_SIZE,
-					(uint8_t *)&tmp_str);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
+			char *tmp_str = found[j].name;
 			tmp_str[FREERTOS_THREAD_NAME_STR_SIZE-1] = '\x00';
-			LOG_DEBUG("FreeRTOS: Read Thread Name at 0x%" PRIx64 ", value '%s'",
-										value->tcb + freertos->thread_name_offset,
-										tmp_str);
+			LOG_DEBUG("FreeRTOS: Thread %" PRId64 " has TCB 0x%" TARGET_PRIxADDR ", name '%s'",
+					value->threadid, value->tcb, tmp_str);
 
 			if (tmp_str[0] == '\x00')
 				strcpy(tmp_str, "No Name");
 
-			rtos->thread_details[tasks_found].thread_name_str =
-				malloc(strlen(tmp_str)+1);
-			strcpy(rtos->thread_details[tasks_found].thread_name_str, tmp_str);
+			rtos->thread_details[tasks_found].thread_name_str = strdup(tmp_str);
 			rtos->thread_details[tasks_found].exists = true;
 
 			if (value->tcb == px_current_tcb && rtos->current_thread != FREERTOS_CURRENT_EXECUTION_ID) {
 				char running_str[] = "State: Running";
 				rtos->current_thread = value->threadid;
-				rtos->thread_details[tasks_found].extra_info_str = malloc(
-						sizeof(running_str));
-				strcpy(rtos->thread_details[tasks_found].extra_info_str,
-					running_str);
+				rtos->thread_details[tasks_found].extra_info_str = strdup(running_str);
 			} else
 				rtos->thread_details[tasks_found].extra_info_str = NULL;
 
 			tasks_found++;
-			list_thread_count--;
 			rtos->thread_count = tasks_found;
-
-			prev_list_elem_ptr = list_elem_ptr;
-			list_elem_ptr = 0;
-			retval = freertos_read_struct_value(rtos->target,
-												prev_list_elem_ptr,
-												freertos->list_elem_next_offset,
-												freertos->list_elem_next_size,
-												&list_elem_ptr);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading next thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			LOG_DEBUG("FreeRTOS: Read next thread location at " TARGET_ADDR_FMT
-					  ", value " TARGET_ADDR_FMT,
-					  prev_list_elem_ptr + freertos->list_elem_next_offset,
-					  list_elem_ptr);
 		}
 	}
 
+out:
+	free(blocks);
+	free(found);
+	free(walks);
 	free(list_of_lists);
+	if (retval != ERROR_OK)
+		return retval;
+
+	freertos->thread_list_valid = have_task_number;
+	freertos->thread_list_count = rtos->thread_count;
+	freertos->ux_task_number = ux_task_number;
+	freertos->ux_current_number_of_tasks = thread_list_size;
 	return 0;
 }
 
@@ -795,6 +897,66 @@ static int freertos_get_stacking_info(struct rtos *rtos, threadid_t thread_id,
 	return ERROR_OK;
 }
 
+/* pxStack and pxTopOfStack of all the threads, read in one batch. */
+static int freertos_get_thread_stacks(struct rtos *rtos,
+		struct rtos_thread_stack *stacks, unsigned int num_stacks)
+{
+	if (!rtos->rtos_specific_params)
+		return ERROR_FAIL;
+
+	freertos_compute_offsets(rtos);
+
+	struct FreeRTOS *freertos = (struct FreeRTOS *) rtos->rtos_specific_params;
+	const unsigned int window = MAX(freertos->thread_stack_offset + freertos->thread_stack_size,
+			freertos->thread_stack_limit_offset + freertos->pointer_size);
+
+	struct target_memory_read_block *blocks = calloc(num_stacks, sizeof(*blocks));
+	uint8_t *buf = calloc(num_stacks, window);
+	unsigned int *index = calloc(num_stacks, sizeof(*index));
+	int retval = ERROR_FAIL;
+	if (!blocks || !buf || !index) {
+		LOG_ERROR("Out of memory");
+		goto out;
+	}
+
+	unsigned int num_blocks = 0;
+	for (unsigned int i = 0; i < num_stacks; i++) {
+		stacks[i].limit = 0;
+		stacks[i].sp = 0;
+
+		const struct freertos_thread_entry *entry =
+			thread_entry_list_find_by_id(&freertos->thread_entry_list, stacks[i].threadid);
+		if (!entry)
+			continue;
+
+		blocks[num_blocks].address = entry->tcb;
+		blocks[num_blocks].size = window;
+		blocks[num_blocks].buffer = buf + num_blocks * window;
+		index[num_blocks] = i;
+		num_blocks++;
+	}
+
+	retval = target_read_buffer_list(rtos->target, blocks, num_blocks);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading the FreeRTOS task control blocks");
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < num_blocks; i++) {
+		struct rtos_thread_stack *stack = &stacks[index[i]];
+		stack->sp = buf_get_u64(blocks[i].buffer + freertos->thread_stack_offset, 0,
+				freertos->thread_stack_size * 8);
+		stack->limit = buf_get_u64(blocks[i].buffer + freertos->thread_stack_limit_offset, 0,
+				freertos->pointer_size * 8);
+	}
+
+out:
+	free(index);
+	free(buf);
+	free(blocks);
+	return retval;
+}
+
 static int freertos_get_thread_reg_list(struct rtos *rtos, threadid_t thread_id,
 		struct rtos_reg **reg_list, int *num_regs)
 {
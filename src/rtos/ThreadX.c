@@ -346,62 +346,50 @@ static int threadx_update_threads(struct rtos *rtos)
 		return retval;
 	}
 
+	/* Each TX_THREAD is read at once up to tx_thread_created_next, the
+	 * names of all threads are read in a single batch after the walk */
+	#define THREADX_THREAD_NAME_STR_SIZE (200)
+	uint32_t tcb_size = param->thread_next_offset + param->pointer_width;
+	uint8_t *tcb = malloc(tcb_size);
+	char (*names)[THREADX_THREAD_NAME_STR_SIZE] = calloc(thread_list_size,
+			THREADX_THREAD_NAME_STR_SIZE);
+	struct target_memory_read_block *name_blocks = calloc(thread_list_size,
+			sizeof(*name_blocks));
+	unsigned int num_names = 0;
+	if (!tcb || !names || !name_blocks) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
 	/* loop over all threads */
 	int64_t prev_thread_ptr = 0;
 	while ((thread_ptr != prev_thread_ptr) && (tasks_found < thread_list_size)) {
-
-		#define THREADX_THREAD_NAME_STR_SIZE (200)
-		char tmp_str[THREADX_THREAD_NAME_STR_SIZE];
 		unsigned int i = 0;
-		int64_t name_ptr = 0;
 
 		/* Save the thread pointer */
 		rtos->thread_details[tasks_found].threadid = thread_ptr;
 
-		/* read the name pointer */
-		retval = target_read_buffer(rtos->target,
-				thread_ptr + param->thread_name_offset,
-				param->pointer_width,
-				(uint8_t *)&name_ptr);
+		retval = target_read_buffer(rtos->target, thread_ptr, tcb_size, tcb);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Could not read ThreadX thread name pointer from target");
-			return retval;
+			LOG_ERROR("Could not read ThreadX thread control block from target");
+			goto out;
 		}
 
-		/* Read the thread name */
-		tmp_str[0] = '\x00';
-
-		/* Check if thread has a valid name */
+		/* Queue the read of the name, if the thread has one */
+		uint32_t name_ptr = target_buffer_get_u32(rtos->target,
+				tcb + param->thread_name_offset);
 		if (name_ptr != 0) {
-			retval =
-				target_read_buffer(rtos->target,
-					name_ptr,
-					THREADX_THREAD_NAME_STR_SIZE,
-					(uint8_t *)&tmp_str);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading thread name from ThreadX target");
-				return retval;
-			}
-			tmp_str[THREADX_THREAD_NAME_STR_SIZE - 1] = '\x00';
+			name_blocks[num_names++] = (struct target_memory_read_block){
+				.address = name_ptr,
+				.size = THREADX_THREAD_NAME_STR_SIZE,
+				.buffer = (uint8_t *)names[tasks_found],
+			};
 		}
 
-		if (tmp_str[0] == '\x00')
-			strcpy(tmp_str, "No Name");
-
-		rtos->thread_details[tasks_found].thread_name_str =
-			malloc(strlen(tmp_str)+1);
-		strcpy(rtos->thread_details[tasks_found].thread_name_str, tmp_str);
-
-		/* Read the thread status */
-		int64_t thread_status = 0;
-		retval = target_read_buffer(rtos->target,
-				thread_ptr + param->thread_state_offset,
-				4,
-				(uint8_t *)&thread_status);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading thread state from ThreadX target");
-			return retval;
-		}
+		/* Decode the thread status */
+		int64_t thread_status = target_buffer_get_u32(rtos->target,
+				tcb + param->thread_state_offset);
 
 		for (i = 0; (i < THREADX_NUM_STATES) &&
 				(threadx_thread_states[i].value != thread_status); i++) {
@@ -418,23 +406,44 @@ static int threadx_update_threads(struct rtos *rtos)
 					state_desc)+8);
 		sprintf(rtos->thread_details[tasks_found].extra_info_str, "State: %s", state_desc);
 
+		rtos->thread_details[tasks_found].thread_name_str = NULL;
 		rtos->thread_details[tasks_found].exists = true;
 
 		tasks_found++;
 		prev_thread_ptr = thread_ptr;
 
 		/* Get the location of the next thread structure. */
-		thread_ptr = 0;
-		retval = target_read_buffer(rtos->target,
-				prev_thread_ptr + param->thread_next_offset,
-				param->pointer_width,
-				(uint8_t *) &thread_ptr);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading next thread pointer in ThreadX thread list");
-			return retval;
-		}
+		thread_ptr = target_buffer_get_u32(rtos->target,
+				tcb + param->thread_next_offset);
 	}
 
+	retval = target_read_buffer_list(rtos->target, name_blocks, num_names);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading thread name from ThreadX target");
+		goto out;
+	}
+
+	for (int i = 0; i < tasks_found; i++) {
+		struct thread_detail *detail = &rtos->thread_details[i];
+		char *tmp_str = names[i];
+
+		if (detail->thread_name_str)
+			continue;
+
+		tmp_str[THREADX_THREAD_NAME_STR_SIZE - 1] = '\x00';
+		if (tmp_str[0] == '\x00')
+			strcpy(tmp_str, "No Name");
+
+		detail->thread_name_str = strdup(tmp_str);
+	}
+
+out:
+	free(name_blocks);
+	free(names);
+	free(tcb);
+	if (retval != ERROR_OK)
+		return retval;
+
 	rtos->thread_count = tasks_found;
 
 	return 0;
@@ -259,6 +259,80 @@ static int chibios_update_stacking(struct rtos *rtos)
 	return -1;
 }
 
+/* If no thread was created or has exited since the last update, the
+ * registry still links the threads of rtos->thread_details, in this order.
+ * Check that with one batch of reads, which also gets the states of the
+ * threads and the current one, instead of walking the registry again.
+ * Returns true if the thread list could be updated that way. */
+static bool chibios_update_known_threads(struct rtos *rtos, uint32_t rlist)
+{
+	const struct chibios_params *param = rtos->rtos_specific_params;
+	const struct chibios_chdebug *signature = param->signature;
+	const int count = rtos->thread_count;
+
+	/* Nothing to compare with after a broken registry, see below */
+	if (!rtos->thread_details || count <= 0 ||
+			(count == 1 && rtos->thread_details[0].threadid == 1))
+		return false;
+
+	/* newer links of rlist and the threads, current thread, states */
+	const unsigned int num_blocks = 2 * count + 2;
+	struct target_memory_read_block *blocks = calloc(num_blocks, sizeof(*blocks));
+	uint8_t *buf = calloc(count + 2, sizeof(uint32_t) + 1);
+	bool unchanged = false;
+	if (!blocks || !buf)
+		goto out;
+
+	uint8_t *links = buf;
+	uint8_t *states = buf + (count + 2) * sizeof(uint32_t);
+	for (int i = 0; i <= count; i++) {
+		uint32_t thread = i ? rtos->thread_details[i - 1].threadid : rlist;
+		blocks[i].address = thread + signature->cf_off_newer;
+		blocks[i].size = sizeof(uint32_t);
+		blocks[i].buffer = links + i * sizeof(uint32_t);
+	}
+	/* NOTE: By design, cf_off_name equals readylist_current_offset */
+	blocks[count + 1].address = rlist + signature->cf_off_name;
+	blocks[count + 1].size = sizeof(uint32_t);
+	blocks[count + 1].buffer = links + (count + 1) * sizeof(uint32_t);
+	for (int i = 0; i < count; i++) {
+		blocks[count + 2 + i].address = rtos->thread_details[i].threadid +
+			signature->cf_off_state;
+		blocks[count + 2 + i].size = 1;
+		blocks[count + 2 + i].buffer = states + i;
+	}
+
+	if (target_read_buffer_list(rtos->target, blocks, num_blocks) != ERROR_OK)
+		goto out;
+
+	for (int i = 0; i <= count; i++) {
+		uint32_t newer = target_buffer_get_u32(rtos->target, links + i * sizeof(uint32_t));
+		uint32_t expected = i < count ? rtos->thread_details[i].threadid : rlist;
+		if (newer != expected)
+			goto out;
+	}
+
+	for (int i = 0; i < count; i++) {
+		const char *state_desc = states[i] < CHIBIOS_NUM_STATES ?
+			chibios_thread_states[states[i]] : "Unknown";
+		char *extra_info = malloc(strlen(state_desc) + 8);
+		if (!extra_info)
+			goto out;
+		sprintf(extra_info, "State: %s", state_desc);
+		free(rtos->thread_details[i].extra_info_str);
+		rtos->thread_details[i].extra_info_str = extra_info;
+	}
+
+	rtos->current_thread = target_buffer_get_u32(rtos->target,
+			links + (count + 1) * sizeof(uint32_t));
+	unchanged = true;
+
+out:
+	free(buf);
+	free(blocks);
+	return unchanged;
+}
+
 static int chibios_update_threads(struct rtos *rtos)
 {
 	int retval;
@@ -284,15 +358,19 @@ static int chibios_update_threads(struct rtos *rtos)
 		}
 	}
 
+	const uint32_t rlist = rtos->symbols[CHIBIOS_VAL_RLIST].address ?
+		rtos->symbols[CHIBIOS_VAL_RLIST].address :
+		rtos->symbols[CHIBIOS_VAL_CH].address + CH_RLIST_OFFSET /* ChibiOS3 */;
+
+	if (chibios_update_known_threads(rtos, rlist))
+		return ERROR_OK;
+
 	/* wipe out previous thread details if any */
 	rtos_free_threadlist(rtos);
 
 	/* ChibiOS does not save the current thread count. We have to first
 	 * parse the double linked thread list to check for errors and the number of
 	 * threads. */
-	const uint32_t rlist = rtos->symbols[CHIBIOS_VAL_RLIST].address ?
-		rtos->symbols[CHIBIOS_VAL_RLIST].address :
-		rtos->symbols[CHIBIOS_VAL_CH].address + CH_RLIST_OFFSET /* ChibiOS3 */;
 	const struct chibios_chdebug *signature = param->signature;
 	uint32_t current;
 	uint32_t previous;
@@ -252,6 +252,10 @@ static int hwthread_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* Not fatal: whatever isn't fetched is read register by register below. */
+	if (target_fetch_registers(curr, reg_list, reg_list_size) != ERROR_OK)
+		LOG_DEBUG("Couldn't fetch the register set of %s in bulk.", target_name(curr));
+
 	int j = 0;
 	for (int i = 0; i < reg_list_size; i++) {
 		if (!reg_list[i] || reg_list[i]->exist == false || reg_list[i]->hidden)
@@ -434,7 +438,7 @@ static int hwthread_read_buffer(struct rtos *rtos, target_addr_t address,
 	if (!curr)
 		return ERROR_FAIL;
 
-	return target_read_buffer(curr, address, size, buffer);
+	return rtos_cached_read_buffer(curr, address, size, buffer);
 }
 
 static int hwthread_write_buffer(struct rtos *rtos, target_addr_t address,
@@ -26,6 +26,9 @@
 #include "linux_header.h"
 #define PHYS
 #define MAX_THREADS 200
+/*  window of task_struct covering all the fields read by fill_task() */
+#define TASK_WINDOW_SIZE \
+	(MAX(MAX(MAX(NEXT, MEM), MAX(ONCPU, PID)), COMM + 12) + 4)
 /*  specific task  */
 struct linux_os {
 	const char *name;
@@ -64,6 +67,10 @@ struct threads {
 	int status;		/* dead = 1 alive = 2 current = 3 alive and current */
 	/*  value that should not change during the live of a thread ? */
 	uint32_t thread_info_addr;	/*  contain latest thread_info_addr computed */
+	/*  next task read along with the other fields by fill_task(), valid
+	 *  while next_read_at is base_addr */
+	uint32_t next_base_addr;
+	uint32_t next_read_at;
 	/*  retrieve from thread_info */
 	struct cpu_context *context;
 	struct threads *next;
@@ -280,58 +287,61 @@ int fill_task_pid(struct target *target, struct threads *t)
 }
 #endif
 
+/*  decode the 16 bytes of task_struct comm */
+static void decode_name(struct target *target, struct threads *t,
+	const uint8_t *comm)
+{
+	for (int i = 0; i < 16; i += 4) {
+		uint32_t raw_name = target_buffer_get_u32(target, comm + i);
+		t->name[i + 3] = raw_name >> 24;
+		t->name[i + 2] = raw_name >> 16;
+		t->name[i + 1] = raw_name >> 8;
+		t->name[i] = raw_name;
+	}
+	t->name[16] = 0;
+}
+
+/*  read all the task_struct fields used at once, the next task is kept
+ *  for next_task() */
 static int fill_task(struct target *target, struct threads *t)
 {
 	int retval;
-	uint32_t pid_addr = t->base_addr + PID;
-	uint32_t mem_addr = t->base_addr + MEM;
-	uint32_t on_cpu = t->base_addr + ONCPU;
-	uint8_t *buffer = calloc(1, 4);
-	retval = fill_buffer(target, t->base_addr, buffer);
-
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
-		t->state = val;
-	} else
-		LOG_ERROR("fill_task: unable to read memory");
-
-	retval = fill_buffer(target, pid_addr, buffer);
-
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
-		t->pid = val;
-	} else
-		LOG_ERROR("fill task: unable to read memory");
+	uint8_t *buffer = malloc(TASK_WINDOW_SIZE);
 
-	retval = fill_buffer(target, on_cpu, buffer);
+	if (!buffer) {
+		LOG_ERROR("fill_task: out of memory");
+		return ERROR_FAIL;
+	}
 
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
-		t->oncpu = val;
-	} else
-		LOG_ERROR("fill task: unable to read memory");
+	retval = linux_read_memory(target, t->base_addr, 4, TASK_WINDOW_SIZE / 4,
+			buffer);
 
-	retval = fill_buffer(target, mem_addr, buffer);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("fill_task: unable to read memory");
+		free(buffer);
+		return retval;
+	}
 
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
+	t->state = get_buffer(target, buffer);
+	t->pid = get_buffer(target, buffer + PID);
+	t->oncpu = get_buffer(target, buffer + ONCPU);
+	t->next_base_addr = get_buffer(target, buffer + NEXT) - NEXT;
+	t->next_read_at = t->base_addr;
+	decode_name(target, t, buffer + COMM);
+	uint32_t val = get_buffer(target, buffer + MEM);
+	free(buffer);
 
-		if (val != 0) {
-			uint32_t asid_addr = val + MM_CTX;
-			retval = fill_buffer(target, asid_addr, buffer);
+	if (val != 0) {
+		uint32_t asid_addr = val + MM_CTX;
+		uint8_t asid[4];
+		retval = fill_buffer(target, asid_addr, asid);
 
-			if (retval == ERROR_OK) {
-				val = get_buffer(target, buffer);
-				t->asid = val;
-			} else
-				LOG_ERROR
-					("fill task: unable to read memory -- ASID");
-		} else
-			t->asid = 0;
+		if (retval == ERROR_OK)
+			t->asid = get_buffer(target, asid);
+		else
+			LOG_ERROR("fill task: unable to read memory -- ASID");
 	} else
-		LOG_ERROR("fill task: unable to read memory");
-
-	free(buffer);
+		t->asid = 0;
 
 	return retval;
 }
@@ -339,45 +349,18 @@ static int fill_task(struct target *target, struct threads *t)
 static int get_name(struct target *target, struct threads *t)
 {
 	int retval;
-	uint32_t full_name[4];
+	uint8_t full_name[16];
 	uint32_t comm = t->base_addr + COMM;
-	int i;
 
-	for (i = 0; i < 17; i++)
-		t->name[i] = 0;
-
-	retval = linux_read_memory(target, comm, 4, 4, (uint8_t *) full_name);
+	retval = linux_read_memory(target, comm, 4, 4, full_name);
 
 	if (retval != ERROR_OK) {
+		memset(t->name, 0, sizeof(t->name));
 		LOG_ERROR("get_name: unable to read memory\n");
 		return ERROR_FAIL;
 	}
 
-	uint32_t raw_name = target_buffer_get_u32(target,
-			(const uint8_t *)
-			&full_name[0]);
-	t->name[3] = raw_name >> 24;
-	t->name[2] = raw_name >> 16;
-	t->name[1] = raw_name >> 8;
-	t->name[0] = raw_name;
-	raw_name =
-		target_buffer_get_u32(target, (const uint8_t *)&full_name[1]);
-	t->name[7] = raw_name >> 24;
-	t->name[6] = raw_name >> 16;
-	t->name[5] = raw_name >> 8;
-	t->name[4] = raw_name;
-	raw_name =
-		target_buffer_get_u32(target, (const uint8_t *)&full_name[2]);
-	t->name[11] = raw_name >> 24;
-	t->name[10] = raw_name >> 16;
-	t->name[9] = raw_name >> 8;
-	t->name[8] = raw_name;
-	raw_name =
-		target_buffer_get_u32(target, (const uint8_t *)&full_name[3]);
-	t->name[15] = raw_name >> 24;
-	t->name[14] = raw_name >> 16;
-	t->name[13] = raw_name >> 8;
-	t->name[12] = raw_name;
+	decode_name(target, t, full_name);
 	return ERROR_OK;
 
 }
@@ -445,7 +428,6 @@ static int get_current(struct target *target, int create)
 					t = calloc(1, sizeof(struct threads));
 					t->base_addr = ct->TS;
 					fill_task(target, t);
-					get_name(target, t);
 					t->oncpu = cpu;
 					insert_into_threadlist(target, t);
 					t->status = 3;
@@ -566,6 +548,12 @@ retry:
 
 static uint32_t next_task(struct target *target, struct threads *t)
 {
+	/*  already read by fill_task() */
+	if (t->next_read_at == t->base_addr && t->base_addr != 0) {
+		t->next_read_at = 0;
+		return t->next_base_addr;
+	}
+
 	uint8_t *buffer = calloc(1, 4);
 	uint32_t next_addr = t->base_addr + NEXT;
 	int retval = fill_buffer(target, next_addr, buffer);
@@ -693,8 +681,7 @@ static int linux_get_tasks(struct target *target, int context)
 	while (((t->base_addr != linux_os->init_task_addr) &&
 		(t->base_addr != 0)) || (loop == 0)) {
 		loop++;
-		fill_task(target, t);
-		retval = get_name(target, t);
+		retval = fill_task(target, t);
 
 		if (loop > MAX_THREADS) {
 			free(t);
@@ -859,7 +846,6 @@ error_handling:
 				if (fill_task(target, t) != ERROR_OK)
 					goto error_handling;
 
-				get_name(target, t);
 				insert_into_threadlist(target, t);
 				t->thread_info_addr = 0xdeadbeef;
 			}
@@ -901,6 +887,66 @@ error_handling:
 #endif
 }
 
+#ifndef PID_CHECK
+/*  Check with a single batch of reads of the task list links whether the
+ *  list still only links known tasks, in which case it needn't be walked
+ *  again. Returns the tasks in the list, flagged in @a in_list by their
+ *  position in thread_list. */
+static bool linux_task_list_unchanged(struct target *target, bool *in_list)
+{
+	struct linux_os *linux_os = (struct linux_os *)
+		target->rtos->rtos_specific_params;
+	unsigned int count = 0;
+	bool unchanged = false;
+
+	for (struct threads *t = linux_os->thread_list; t; t = t->next)
+		count++;
+
+	if (count == 0)
+		return false;
+
+	struct target_memory_read_block *blocks = calloc(count, sizeof(*blocks));
+	uint8_t *links = calloc(count, 4);
+	struct threads **tasks = calloc(count, sizeof(*tasks));
+	if (!blocks || !links || !tasks)
+		goto out;
+
+	unsigned int i = 0;
+	for (struct threads *t = linux_os->thread_list; t; t = t->next, i++) {
+		if (t->base_addr + NEXT < LINUX_USER_KERNEL_BORDER)
+			goto out;
+		tasks[i] = t;
+		blocks[i].address = t->base_addr + NEXT;
+		blocks[i].size = 4;
+		blocks[i].buffer = links + 4 * i;
+	}
+
+	if (target_read_buffer_list(target, blocks, count) != ERROR_OK)
+		goto out;
+
+	/*  follow the links from init_task, each has to be a known task */
+	uint32_t base_addr = linux_os->init_task_addr;
+	do {
+		for (i = 0; i < count; i++) {
+			if (tasks[i]->base_addr == base_addr)
+				break;
+		}
+		if (i == count || in_list[i])
+			goto out;
+		in_list[i] = true;
+		base_addr = get_buffer(target, links + 4 * i) - NEXT;
+	} while (base_addr != linux_os->init_task_addr);
+
+	unchanged = true;
+
+out:
+	free(tasks);
+	free(links);
+	free(blocks);
+	return unchanged;
+}
+#endif
+
 static int linux_task_update(struct target *target, int context)
 {
 	struct linux_os *linux_os = (struct linux_os *)
@@ -934,6 +980,40 @@ static int linux_task_update(struct target *target, int context)
 	/*check that all current threads have been identified  */
 	linux_identify_current_threads(target);
 
+#ifndef PID_CHECK
+	int count = 0;
+	for (thread_list = linux_os->thread_list; thread_list; thread_list = thread_list->next)
+		count++;
+
+	bool *in_list = calloc(count ? count : 1, sizeof(*in_list));
+	if (in_list && linux_task_list_unchanged(target, in_list)) {
+		int i = 0;
+		for (thread_list = linux_os->thread_list; thread_list;
+				thread_list = thread_list->next, i++) {
+			if (!in_list[i])
+				continue;
+
+			if (!thread_list->status) {
+				thread_list->status = 1;
+				if (context)
+					thread_list->context =
+						cpu_context_read(target,
+							thread_list->base_addr,
+							&thread_list->thread_info_addr);
+			}
+			linux_os->thread_count++;
+		}
+
+		LOG_DEBUG("task list unchanged, update done %" PRId64,
+			timeval_ms() - start);
+		free(in_list);
+		free(t);
+		linux_os->threads_needs_update = 0;
+		return ERROR_OK;
+	}
+	free(in_list);
+#endif
+
 	while (((t->base_addr != linux_os->init_task_addr) &&
 		(t->base_addr != previous)) || (loop == 0)) {
 		/*  for avoiding any permanent loop for any reason possibly due to
@@ -994,7 +1074,6 @@ static int linux_task_update(struct target *target, int context)
 		if (found == 0) {
 			uint32_t base_addr;
 			fill_task(target, t);
-			get_name(target, t);
 			retval = insert_into_threadlist(target, t);
 			t->thread_info_addr = 0xdeadbeef;
 
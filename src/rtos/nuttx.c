@@ -51,6 +51,18 @@ struct tcbinfo {
 	target_addr_t xcpreg_off;	/* Offset pointer of xcp.regs       */
 };
 
+/* Per target state, in rtos_specific_params */
+struct nuttx_state {
+	const struct nuttx_params *params;
+	/* The pidhash table, offsets and PIDs of the threads as of the last
+	 * full update. The same pidhash content means the same threads, see
+	 * nuttx_update_known_threads(). */
+	uint8_t *pidhash;
+	uint32_t npidhash;
+	struct tcbinfo tcbinfo;
+	uint16_t *pids;
+};
+
 struct symbols {
 	const char *name;
 	bool optional;
@@ -166,8 +178,15 @@ static int nuttx_create(struct target *target)
 		return JIM_ERR;
 	}
 
+	struct nuttx_state *state = calloc(1, sizeof(*state));
+	if (!state) {
+		LOG_ERROR("NUTTX: out of memory");
+		return JIM_ERR;
+	}
+
 	/* We found a target in our list, copy its reference. */
-	target->rtos->rtos_specific_params = (void *)param;
+	state->params = param;
+	target->rtos->rtos_specific_params = state;
 
 	return JIM_OK;
 }
@@ -188,8 +207,79 @@ static target_addr_t target_buffer_get_addr(struct target *target, const uint8_t
 #endif
 }
 
+static void nuttx_set_extra_info(struct thread_detail *thread, uint16_t pid, uint8_t state)
+{
+	free(thread->extra_info_str);
+	thread->extra_info_str = NULL;
+
+	if (state < ARRAY_SIZE(task_state_str)) {
+		thread->extra_info_str = malloc(EXTRAINFO_SIZE);
+		if (thread->extra_info_str)
+			snprintf(thread->extra_info_str, EXTRAINFO_SIZE, "pid:%d, %s",
+				pid, task_state_str[state]);
+	}
+}
+
+static void nuttx_forget_threads(struct nuttx_state *state)
+{
+	free(state->pidhash);
+	state->pidhash = NULL;
+	free(state->pids);
+	state->pids = NULL;
+}
+
+/* If the pidhash table didn't change since the last full update, the
+ * threads are still the same ones and only their states need to be read
+ * again, all in one batch. Their names are kept. */
+static bool nuttx_update_known_threads(struct rtos *rtos, const uint8_t *pidhash,
+	uint32_t npidhash)
+{
+	struct nuttx_state *state = rtos->rtos_specific_params;
+
+	if (!state->pidhash || state->npidhash != npidhash ||
+			!rtos->thread_details || rtos->thread_count <= 0 ||
+			memcmp(state->pidhash, pidhash, npidhash * PTR_WIDTH))
+		return false;
+
+	/* The PIDs are read again too, a TCB could have been reused */
+	unsigned int count = rtos->thread_count;
+	struct target_memory_read_block *blocks = calloc(2 * count, sizeof(*blocks));
+	uint8_t *buf = calloc(count, 3);
+	bool unchanged = false;
+	if (!blocks || !buf)
+		goto out;
+
+	for (unsigned int i = 0; i < count; i++) {
+		target_addr_t tcb = rtos->thread_details[i].threadid;
+		blocks[2 * i].address = tcb + state->tcbinfo.pid_off;
+		blocks[2 * i].size = 2;
+		blocks[2 * i].buffer = &buf[3 * i];
+		blocks[2 * i + 1].address = tcb + state->tcbinfo.state_off;
+		blocks[2 * i + 1].size = 1;
+		blocks[2 * i + 1].buffer = &buf[3 * i + 2];
+	}
+
+	if (target_read_buffer_list(rtos->target, blocks, 2 * count) != ERROR_OK)
+		goto out;
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (target_buffer_get_u16(rtos->target, &buf[3 * i]) != state->pids[i])
+			goto out;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		nuttx_set_extra_info(&rtos->thread_details[i], state->pids[i], buf[3 * i + 2]);
+	unchanged = true;
+
+out:
+	free(buf);
+	free(blocks);
+	return unchanged;
+}
+
 static int nuttx_update_threads(struct rtos *rtos)
 {
+	struct nuttx_state *nx = rtos->rtos_specific_params;
 	struct tcbinfo tcbinfo;
 	uint32_t pidhashaddr, npidhash, tcbaddr;
 	uint16_t pid;
@@ -200,9 +290,6 @@ static int nuttx_update_threads(struct rtos *rtos)
 		return ERROR_FAIL;
 	}
 
-	/* Free previous thread details */
-	rtos_free_threadlist(rtos);
-
 	/* NuttX provides a hash table that keeps track of all the TCBs.
 	 * We first read its size from g_npidhash and its address from g_pidhash.
 	 * Its content is then read from these values.
@@ -264,6 +351,22 @@ static int nuttx_update_threads(struct rtos *rtos)
 	}
 	rtos->current_thread = current_thread;
 
+	if (nuttx_update_known_threads(rtos, pidhash, npidhash)) {
+		ret = ERROR_OK;
+		goto errout;
+	}
+
+	/* Free previous thread details */
+	rtos_free_threadlist(rtos);
+	nuttx_forget_threads(nx);
+
+	uint16_t *pids = calloc(npidhash, sizeof(*pids));
+	if (!pids) {
+		LOG_ERROR("Failed to allocate pids");
+		ret = ERROR_FAIL;
+		goto errout;
+	}
+
 	uint32_t thread_count = 0;
 
 	for (unsigned int i = 0; i < npidhash; i++) {
@@ -276,53 +379,52 @@ static int nuttx_update_threads(struct rtos *rtos)
 		if (ret != ERROR_OK) {
 			LOG_ERROR("Failed to read PID of TCB@0x%x from pidhash[%d]: ret = %d",
 				tcbaddr, i, ret);
-			goto errout;
+			goto errout_pids;
 		}
 
 		ret = target_read_u8(rtos->target, tcbaddr + tcbinfo.state_off, &state);
 		if (ret != ERROR_OK) {
 			LOG_ERROR("Failed to read state of TCB@0x%x from pidhash[%d]: ret = %d",
 				tcbaddr, i, ret);
-			goto errout;
+			goto errout_pids;
 		}
 
 		struct thread_detail *new_thread_details = realloc(rtos->thread_details,
 			sizeof(struct thread_detail) * (thread_count + 1));
 		if (!new_thread_details) {
 			ret = ERROR_FAIL;
-			goto errout;
+			goto errout_pids;
 		}
 
 		struct thread_detail *thread = &new_thread_details[thread_count];
 		thread->threadid = tcbaddr;
 		thread->exists = true;
 		thread->extra_info_str = NULL;
+		thread->thread_name_str = NULL;
 
 		rtos->thread_details = new_thread_details;
+		pids[thread_count] = pid;
 		thread_count++;
+		/* for rtos_free_threadlist() in case of an error */
+		rtos->thread_count = thread_count;
 
-		if (state < ARRAY_SIZE(task_state_str)) {
-			thread->extra_info_str = malloc(EXTRAINFO_SIZE);
-			if (!thread->extra_info_str) {
-				ret = ERROR_FAIL;
-				goto errout;
-			}
-			snprintf(thread->extra_info_str, EXTRAINFO_SIZE, "pid:%d, %s",
-				pid,
-				task_state_str[state]);
+		nuttx_set_extra_info(thread, pid, state);
+		if (state < ARRAY_SIZE(task_state_str) && !thread->extra_info_str) {
+			ret = ERROR_FAIL;
+			goto errout_pids;
 		}
 
 		if (tcbinfo.name_off) {
 			thread->thread_name_str = calloc(NAME_SIZE + 1, sizeof(char));
 			if (!thread->thread_name_str) {
 				ret = ERROR_FAIL;
-				goto errout;
+				goto errout_pids;
 			}
 			ret = target_read_buffer(rtos->target, tcbaddr + tcbinfo.name_off,
 				sizeof(char) * NAME_SIZE, (uint8_t *)thread->thread_name_str);
 			if (ret != ERROR_OK) {
 				LOG_ERROR("Failed to read thread's name: ret = %d", ret);
-				goto errout;
+				goto errout_pids;
 			}
 		} else {
 			thread->thread_name_str = strdup("None");
@@ -331,6 +433,17 @@ static int nuttx_update_threads(struct rtos *rtos)
 
 	ret = ERROR_OK;
 	rtos->thread_count = thread_count;
+
+	/* Keep the table to recognize the same threads next time */
+	nx->pidhash = pidhash;
+	pidhash = NULL;
+	nx->npidhash = npidhash;
+	nx->tcbinfo = tcbinfo;
+	nx->pids = pids;
+	pids = NULL;
+
+errout_pids:
+	free(pids);
 errout:
 	free(pidhash);
 	return ret;
@@ -373,7 +486,8 @@ static int nuttx_getregs_fromstack(struct rtos *rtos, int64_t thread_id,
 {
 	uint16_t xcpreg_off;
 	uint32_t regsaddr;
-	const struct nuttx_params *priv = rtos->rtos_specific_params;
+	const struct nuttx_state *state = rtos->rtos_specific_params;
+	const struct nuttx_params *priv = state->params;
 	const struct rtos_register_stacking *stacking = priv->stacking;
 
 	if (!stacking) {
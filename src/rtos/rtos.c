@@ -13,6 +13,7 @@
 #include "target/target.h"
 #include "target/smp.h"
 #include "helper/log.h"
+#include "helper/align.h"
 #include "helper/binarybuffer.h"
 #include "server/gdb_server.h"
 
@@ -35,6 +36,17 @@ static const struct rtos_type *rtos_types[] = {
 	NULL
 };
 
+/* What is remembered of a target's RTOS across gdb connections. */
+struct rtos_symbol_cache {
+	/* Identifies the image the addresses belong to, NULL if not tagged */
+	char *tag;
+	/* The RTOS last detected, NULL if none yet */
+	const struct rtos_type *type;
+	/* Addresses of the symbols of "type", in its lookup order */
+	symbol_address_t *addresses;
+	size_t num_symbols;
+};
+
 static int rtos_try_next(struct target *target);
 
 int rtos_smp_init(struct target *target)
@@ -55,6 +67,149 @@ static int rtos_target_for_threadid(struct connection *connection,
 	return ERROR_OK;
 }
 
+static struct rtos_symbol_cache *rtos_get_symbol_cache(struct target *target)
+{
+	if (!target->rtos_symbol_cache)
+		target->rtos_symbol_cache = calloc(1, sizeof(*target->rtos_symbol_cache));
+	return target->rtos_symbol_cache;
+}
+
+static void rtos_forget_symbols(struct rtos_symbol_cache *cache)
+{
+	free(cache->addresses);
+	cache->addresses = NULL;
+	cache->num_symbols = 0;
+}
+
+int rtos_set_symbol_tag(struct target *target, const char *tag)
+{
+	struct rtos_symbol_cache *cache = rtos_get_symbol_cache(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (cache->tag && !strcmp(cache->tag, tag))
+		return ERROR_OK;
+
+	/* The addresses were resolved for another image */
+	rtos_forget_symbols(cache);
+	free(cache->tag);
+	cache->tag = NULL;
+	if (!tag[0])
+		return ERROR_OK;
+
+	cache->tag = strdup(tag);
+	return cache->tag ? ERROR_OK : ERROR_FAIL;
+}
+
+const char *rtos_get_symbol_tag(struct target *target)
+{
+	struct rtos_symbol_cache *cache = target->rtos_symbol_cache;
+	return cache && cache->tag ? cache->tag : "";
+}
+
+/* Remember the RTOS just detected and, if the image is tagged, the
+ * addresses of its symbols. */
+static void rtos_symbols_to_cache(struct target *target)
+{
+	struct rtos *os = target->rtos;
+	struct rtos_symbol_cache *cache = rtos_get_symbol_cache(target);
+	if (!cache)
+		return;
+
+	cache->type = os->type;
+	rtos_forget_symbols(cache);
+	if (!cache->tag || !os->symbols)
+		return;
+
+	size_t num_symbols = 0;
+	while (os->symbols[num_symbols].symbol_name)
+		num_symbols++;
+
+	cache->addresses = calloc(num_symbols + 1, sizeof(*cache->addresses));
+	if (!cache->addresses)
+		return;
+	for (size_t i = 0; i < num_symbols; i++)
+		cache->addresses[i] = os->symbols[i].address;
+	cache->num_symbols = num_symbols;
+}
+
+/* Take the symbol addresses from the cache instead of asking gdb for
+ * them again, if they were resolved for the same image before.
+ * @returns true if the RTOS is ready to be used. */
+static bool rtos_symbols_from_cache(struct target *target)
+{
+	struct rtos *os = target->rtos;
+	struct rtos_symbol_cache *cache = target->rtos_symbol_cache;
+
+	if (!cache || !cache->tag || !cache->type || !cache->addresses)
+		return false;
+	if (!target->rtos_auto_detect && os->type != cache->type)
+		return false;
+
+	struct symbol_table_elem *symbols = NULL;
+	if (cache->type->get_symbol_list_to_lookup(&symbols) != ERROR_OK || !symbols)
+		return false;
+
+	size_t num_symbols = 0;
+	while (symbols[num_symbols].symbol_name)
+		num_symbols++;
+	if (num_symbols != cache->num_symbols) {
+		free(symbols);
+		return false;
+	}
+	for (size_t i = 0; i < num_symbols; i++)
+		symbols[i].address = cache->addresses[i];
+
+	const struct rtos_type *prev_type = os->type;
+	free(os->symbols);
+	os->symbols = symbols;
+	os->type = cache->type;
+
+	if (target->rtos_auto_detect && !os->type->detect_rtos(target)) {
+		LOG_DEBUG("RTOS: cached symbols of %s don't match, looking them up again",
+				os->type->name);
+		free(os->symbols);
+		os->symbols = NULL;
+		os->type = prev_type;
+		return false;
+	}
+
+	LOG_INFO("RTOS %s: using the symbol addresses cached for '%s'",
+			os->type->name, cache->tag);
+	return true;
+}
+
+/* Auto-detection tries the RTOS last detected on the target first, then
+ * the others in the order of rtos_types[]. hwthread is never tried out of
+ * order, as it matches anything. Returns the type to try after "cur", or
+ * the first one if "cur" is NULL. */
+static const struct rtos_type *rtos_auto_next_type(struct target *target,
+		const struct rtos_type *cur)
+{
+	const struct rtos_type *preferred = target->rtos_symbol_cache ?
+		target->rtos_symbol_cache->type : NULL;
+	const struct rtos_type **type = rtos_types;
+
+	if (preferred == &hwthread_rtos)
+		preferred = NULL;
+
+	if (!cur && preferred)
+		return preferred;
+
+	if (cur && cur != preferred) {
+		while (*type && *type != cur)
+			type++;
+		if (!*type)
+			return NULL;
+		type++;
+	}
+
+	if (*type && *type == preferred)
+		type++;
+
+	return *type;
+}
+
 static int os_alloc(struct target *target, const struct rtos_type *ostype,
 					struct command_context *cmd_ctx)
 {
@@ -82,6 +237,7 @@ static void os_free(struct target *target)
 	if (!target->rtos)
 		return;
 
+	rtos_reg_cache_invalidate(target);
 	free(target->rtos->symbols);
 	rtos_free_threadlist(target->rtos);
 	free(target->rtos);
@@ -133,7 +289,7 @@ int rtos_create(struct jim_getopt_info *goi, struct target *target)
 
 		/* rtos_qsymbol() will iterate over all RTOSes. Allocate
 		 * target->rtos here, and set it to the first RTOS type. */
-		return os_alloc(target, rtos_types[0], cmd_ctx);
+		return os_alloc(target, rtos_auto_next_type(target, NULL), cmd_ctx);
 	}
 
 	for (x = 0; rtos_types[x]; x++)
@@ -152,6 +308,13 @@ int rtos_create(struct jim_getopt_info *goi, struct target *target)
 void rtos_destroy(struct target *target)
 {
 	os_free(target);
+
+	if (target->rtos_symbol_cache) {
+		rtos_forget_symbols(target->rtos_symbol_cache);
+		free(target->rtos_symbol_cache->tag);
+		free(target->rtos_symbol_cache);
+		target->rtos_symbol_cache = NULL;
+	}
 }
 
 int gdb_thread_packet(struct connection *connection, char const *packet, int packet_size)
@@ -231,6 +394,11 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 	if (!os)
 		goto done;
 
+	if (!strcmp(packet, "qSymbol::") && rtos_symbols_from_cache(target)) {
+		rtos_detected = 1;
+		goto done;
+	}
+
 	/* Decode any symbol name in the packet*/
 	size_t len = unhexify((uint8_t *)cur_sym, strchr(packet + 8, ':') + 1, strlen(strchr(packet + 8, ':') + 1));
 	cur_sym[len] = 0;
@@ -296,12 +464,14 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 		/* No more symbols need looking up */
 
 		if (!target->rtos_auto_detect) {
+			rtos_symbols_to_cache(target);
 			rtos_detected = 1;
 			goto done;
 		}
 
 		if (os->type->detect_rtos(target)) {
 			LOG_INFO("Auto-detected RTOS: %s", os->type->name);
+			rtos_symbols_to_cache(target);
 			rtos_detected = 1;
 			goto done;
 		} else {
@@ -508,6 +678,64 @@ static int rtos_put_gdb_reg_list(struct connection *connection,
 }
 
 /** Look through all registers to find this register. */
+struct rtos_reg_cache {
+	threadid_t threadid;
+	struct rtos_reg *reg_list;
+	int num_regs;
+	struct rtos_reg_cache *next;
+};
+
+void rtos_reg_cache_invalidate(struct target *target)
+{
+	struct rtos *rtos = target->rtos;
+	if (!rtos)
+		return;
+
+	while (rtos->reg_cache) {
+		struct rtos_reg_cache *entry = rtos->reg_cache;
+		rtos->reg_cache = entry->next;
+		free(entry->reg_list);
+		free(entry);
+	}
+}
+
+/* Get the registers of a thread, read them only the first time after a stop.
+ * The list stays owned by the cache. */
+static int rtos_get_cached_reg_list(struct rtos *rtos, threadid_t threadid,
+		struct rtos_reg **reg_list, int *num_regs)
+{
+	struct rtos_reg_cache *entry;
+
+	for (entry = rtos->reg_cache; entry; entry = entry->next) {
+		if (entry->threadid == threadid) {
+			*reg_list = entry->reg_list;
+			*num_regs = entry->num_regs;
+			return ERROR_OK;
+		}
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (!entry) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = rtos->type->get_thread_reg_list(rtos, threadid,
+			&entry->reg_list, &entry->num_regs);
+	if (retval != ERROR_OK) {
+		free(entry);
+		return retval;
+	}
+
+	entry->threadid = threadid;
+	entry->next = rtos->reg_cache;
+	rtos->reg_cache = entry;
+
+	*reg_list = entry->reg_list;
+	*num_regs = entry->num_regs;
+	return ERROR_OK;
+}
+
 int rtos_get_gdb_reg(struct connection *connection, int reg_num)
 {
 	struct target *target = get_target_from_connection(connection);
@@ -556,27 +784,28 @@ int rtos_get_gdb_reg(struct connection *connection, int reg_num)
 		free(reg_value);
 		num_regs = 1;
 	} else {
-		retval = target->rtos->type->get_thread_reg_list(target->rtos,
-				current_threadid,
-				&reg_list,
-				&num_regs);
+		retval = rtos_get_cached_reg_list(target->rtos, current_threadid,
+				&reg_list, &num_regs);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("RTOS: failed to get register list");
 			return retval;
 		}
 	}
 
+	retval = ERROR_FAIL;
 	for (int i = 0; i < num_regs; ++i) {
 		if (reg_list[i].number == (uint32_t)reg_num) {
 			rtos_put_gdb_reg_list(connection, reg_list + i, 1);
-			free(reg_list);
-			return ERROR_OK;
+			retval = ERROR_OK;
+			break;
 		}
 	}
 
-	free(reg_list);
+	/* only the list from get_thread_reg_value() is ours */
+	if (target->rtos->type->get_thread_reg_value)
+		free(reg_list);
 
-	return ERROR_FAIL;
+	return retval;
 }
 
 /** Return a list of general registers. */
@@ -595,17 +824,14 @@ int rtos_get_gdb_reg_list(struct connection *connection)
 			  ", target->rtos->current_thread=0x%" PRIx64,
 			  current_threadid, target->rtos->current_thread);
 
-		int retval = target->rtos->type->get_thread_reg_list(target->rtos,
-				current_threadid,
-				&reg_list,
-				&num_regs);
+		int retval = rtos_get_cached_reg_list(target->rtos, current_threadid,
+				&reg_list, &num_regs);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("RTOS: failed to get register list");
 			return retval;
 		}
 
 		rtos_put_gdb_reg_list(connection, reg_list, num_regs);
-		free(reg_list);
 
 		return ERROR_OK;
 	}
@@ -621,6 +847,7 @@ int rtos_set_reg(struct connection *connection, int reg_num,
 			(target->rtos->type->set_reg) &&
 			(current_threadid != -1) &&
 			(current_threadid != 0)) {
+		rtos_reg_cache_invalidate(target);
 		return target->rtos->type->set_reg(target->rtos, reg_num, reg_value);
 	}
 	return ERROR_FAIL;
@@ -647,7 +874,8 @@ int rtos_generic_stack_read(struct target *target,
 	if (stacking->read_stack)
 		retval = stacking->read_stack(target, address, stacking, stack_data);
 	else
-		retval = target_read_buffer(target, address, stacking->stack_registers_size, stack_data);
+		retval = rtos_cached_read_buffer(target, address, stacking->stack_registers_size,
+				stack_data);
 	if (retval != ERROR_OK) {
 		free(stack_data);
 		LOG_ERROR("Error reading stack frame from thread");
@@ -722,7 +950,7 @@ int rtos_generic_stack_read_reg(struct target *target,
 		if (stacking->stack_growth_direction == 1)
 			address -= stacking->stack_registers_size;
 
-		if (target_read_buffer(
+		if (rtos_cached_read_buffer(
 				target, address + offsets->offset,
 				width_bytes, reg->value) != ERROR_OK)
 			return ERROR_FAIL;
@@ -790,18 +1018,15 @@ int rtos_generic_stack_write_reg(struct target *target,
 static int rtos_try_next(struct target *target)
 {
 	struct rtos *os = target->rtos;
-	const struct rtos_type **type = rtos_types;
 
 	if (!os)
 		return 0;
 
-	while (*type && os->type != *type)
-		type++;
-
-	if (!*type || !*(++type))
+	const struct rtos_type *type = rtos_auto_next_type(target, os->type);
+	if (!type)
 		return 0;
 
-	os->type = *type;
+	os->type = type;
 
 	free(os->symbols);
 	os->symbols = NULL;
@@ -827,11 +1052,53 @@ struct rtos *rtos_of_target(struct target *target)
 	return NULL;
 }
 
+/* Bytes read ahead from the stack pointer of each thread after the threads
+ * were updated, see "rtos prefetch". 0 disables it. */
+static uint32_t rtos_prefetch_size;
+
+/* Read the top of the stacks of all the threads but the running one into
+ * the memory cache in one batch, before gdb asks for their registers and
+ * unwinds them one after the other, e.g. for "thread apply all bt". */
+static void rtos_prefetch_stacks(struct rtos *rtos)
+{
+	if (!rtos_prefetch_size || !rtos->type->get_thread_stacks ||
+			!rtos->thread_details || rtos->thread_count <= 0)
+		return;
+
+	unsigned int count = rtos->thread_count;
+	struct rtos_thread_stack *stacks = calloc(count, sizeof(*stacks));
+	target_addr_t *addresses = calloc(count, sizeof(*addresses));
+	if (!stacks || !addresses)
+		goto out;
+
+	for (unsigned int i = 0; i < count; i++)
+		stacks[i].threadid = rtos->thread_details[i].threadid;
+	if (rtos->type->get_thread_stacks(rtos, stacks, count) != ERROR_OK)
+		goto out;
+
+	unsigned int num_addresses = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		/* The registers of the running thread are the core's */
+		if (stacks[i].sp && stacks[i].threadid != rtos->current_thread)
+			addresses[num_addresses++] = stacks[i].sp;
+	}
+
+	rtos_memory_cache_prefetch(rtos->target, addresses, num_addresses,
+			rtos_prefetch_size);
+
+out:
+	free(addresses);
+	free(stacks);
+}
+
 int rtos_update_threads(struct target *target)
 {
 	struct rtos *rtos = rtos_of_target(target);
-	if (rtos)
+	if (rtos) {
+		rtos_reg_cache_invalidate(rtos->target);
 		rtos->type->update_threads(rtos);
+		rtos_prefetch_stacks(rtos);
+	}
 	return ERROR_OK;
 }
 
@@ -883,3 +1150,131 @@ struct target *rtos_swbp_target(struct target *target, target_addr_t address,
 		return target->rtos->type->swbp_target(target->rtos, address, length, type);
 	return target;
 }
+
+COMMAND_HANDLER(handle_rtos_stack_usage_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* FreeRTOS' tskSTACK_FILL_BYTE */
+	uint32_t fill = 0xa5a5a5a5;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], fill);
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct rtos *rtos = rtos_of_target(target);
+	if (!rtos || !rtos->type->get_thread_stacks) {
+		command_print(CMD, "The RTOS of target %s doesn't provide thread stacks",
+				target_name(target));
+		return ERROR_FAIL;
+	}
+	if (rtos->target->state != TARGET_HALTED) {
+		command_print(CMD, "Error: [%s] not halted", target_name(rtos->target));
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	rtos_update_threads(target);
+	if (!rtos->thread_details || rtos->thread_count <= 0) {
+		command_print(CMD, "No threads");
+		return ERROR_OK;
+	}
+
+	unsigned int count = rtos->thread_count;
+	struct rtos_thread_stack *stacks = calloc(count, sizeof(*stacks));
+	struct target_memory_check_block *blocks = calloc(count, sizeof(*blocks));
+	int retval = ERROR_FAIL;
+	if (!stacks || !blocks) {
+		LOG_ERROR("Out of memory");
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		stacks[i].threadid = rtos->thread_details[i].threadid;
+
+	retval = rtos->type->get_thread_stacks(rtos, stacks, count);
+	if (retval != ERROR_OK)
+		goto out;
+
+	/* The part of the stack below the stack pointer which still holds the
+	 * fill pattern has never been used; it is scanned from the limit up. */
+	for (unsigned int i = 0; i < count; i++) {
+		target_addr_t start = ALIGN_UP(stacks[i].limit, 4);
+		target_addr_t end = ALIGN_DOWN(stacks[i].sp, 4);
+		blocks[i].address = start;
+		blocks[i].size = stacks[i].limit && end > start ? end - start : 0;
+	}
+
+	retval = target_fill_check_memory(rtos->target, blocks, count, fill);
+	if (retval != ERROR_OK)
+		goto out;
+
+	command_print(CMD, "%-18s %-20s %-18s %-18s %s", "thread", "name",
+			"stack limit", "stack pointer", "never used");
+	for (unsigned int i = 0; i < count; i++) {
+		const struct thread_detail *detail = &rtos->thread_details[i];
+		const char *name = detail->thread_name_str ? detail->thread_name_str : "";
+
+		if (!stacks[i].limit) {
+			command_print(CMD, "0x%016" PRIx64 " %-20s unknown", detail->threadid, name);
+			continue;
+		}
+		command_print(CMD, "0x%016" PRIx64 " %-20s " TARGET_ADDR_FMT " " TARGET_ADDR_FMT
+				" %" PRIu32 "%s", detail->threadid, name, stacks[i].limit, stacks[i].sp,
+				blocks[i].result,
+				blocks[i].size && blocks[i].result == blocks[i].size ? " (up to the stack pointer)" : "");
+	}
+
+out:
+	free(blocks);
+	free(stacks);
+	return retval;
+}
+
+COMMAND_HANDLER(handle_rtos_prefetch_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], rtos_prefetch_size);
+
+	command_print(CMD, "%" PRIu32, rtos_prefetch_size);
+	return ERROR_OK;
+}
+
+static const struct command_registration rtos_subcommand_handlers[] = {
+	{
+		.name = "prefetch",
+		.handler = handle_rtos_prefetch_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set how many bytes of the stack of each thread "
+			"are read into the gdb memory cache in one batch after each "
+			"stop, 0 to disable.",
+		.usage = "[bytes]",
+	},
+	{
+		.name = "stack_usage",
+		.handler = handle_rtos_stack_usage_command,
+		.mode = COMMAND_EXEC,
+		.help = "Show how many bytes at the end of each thread's stack "
+			"still hold the fill pattern, i.e. have never been used.",
+		.usage = "[fill_word]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration rtos_command_handlers[] = {
+	{
+		.name = "rtos",
+		.mode = COMMAND_ANY,
+		.help = "RTOS commands",
+		.chain = rtos_subcommand_handlers,
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int rtos_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, rtos_command_handlers);
+}
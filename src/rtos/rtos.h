@@ -51,6 +51,9 @@ struct rtos {
 	void *rtos_specific_params;
 	/* Populated in rtos.c, so that individual RTOSes can register commands. */
 	struct command_context *cmd_ctx;
+	/* Register lists of the threads read since the last stop, see
+	 * rtos_reg_cache_invalidate() */
+	struct rtos_reg_cache *reg_cache;
 };
 
 struct rtos_reg {
@@ -61,6 +64,15 @@ struct rtos_reg {
 	 * element of this struct. Any new fields should be added *before* value. */
 };
 
+/** Stack of a thread, see rtos_type::get_thread_stacks(). */
+struct rtos_thread_stack {
+	threadid_t threadid;
+	/* Lowest address of the stack, 0 if unknown */
+	target_addr_t limit;
+	/* Stack pointer saved for the thread */
+	target_addr_t sp;
+};
+
 struct rtos_type {
 	const char *name;
 	bool (*detect_rtos)(struct target *target);
@@ -98,6 +110,10 @@ struct rtos_type {
 	 * breakpoint_add() use a different target. */
 	struct target * (*swbp_target)(struct rtos *rtos, target_addr_t address,
 				     uint32_t length, enum breakpoint_type type);
+	/* Fill in the limit and stack pointer of the (downward growing) stacks
+	 * of the threads "stacks[i].threadid", for "rtos stack_usage". */
+	int (*get_thread_stacks)(struct rtos *rtos, struct rtos_thread_stack *stacks,
+			unsigned int num_stacks);
 };
 
 struct stack_register_offset {
@@ -141,6 +157,15 @@ struct rtos_register_stacking {
 
 int rtos_create(struct jim_getopt_info *goi, struct target *target);
 void rtos_destroy(struct target *target);
+/**
+ * Tag the image running on @a target, e.g. with its build-id, so that the
+ * RTOS symbol addresses looked up through gdb are remembered for it and
+ * reused on the next gdb connection with the same tag. An empty tag turns
+ * this off.
+ */
+int rtos_set_symbol_tag(struct target *target, const char *tag);
+/** @returns the tag set with rtos_set_symbol_tag(), "" if none. */
+const char *rtos_get_symbol_tag(struct target *target);
 int rtos_set_reg(struct connection *connection, int reg_num,
 		uint8_t *reg_value);
 int rtos_generic_stack_read(struct target *target,
@@ -161,8 +186,35 @@ int rtos_thread_packet(struct connection *connection, const char *packet, int pa
 int rtos_get_gdb_reg(struct connection *connection, int reg_num);
 int rtos_get_gdb_reg_list(struct connection *connection);
 int rtos_update_threads(struct target *target);
+/** Forget the register values of the threads read so far, e.g. because the
+ * target was resumed or a register or memory was written. */
+void rtos_reg_cache_invalidate(struct target *target);
 void rtos_free_threadlist(struct rtos *rtos);
 int rtos_smp_init(struct target *target);
+int rtos_register_commands(struct command_context *cmd_ctx);
+
+/* Halt-scoped memory cache shared by gdb and the RTOS support, see
+ * rtos_memory_cache.c. */
+extern const struct command_registration rtos_memory_cache_command_handlers[];
+/** Read through the cache if it's enabled and @a target is halted. */
+int rtos_cached_read_buffer(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer);
+/**
+ * Read the blocks covering @a size bytes from each of @a addresses into the
+ * cache, in one batch. Does nothing if the cache is disabled.
+ */
+int rtos_memory_cache_prefetch(struct target *target, const target_addr_t *addresses,
+		unsigned int count, uint32_t size);
+/** Drop all cached memory, memory may have changed. */
+void rtos_memory_cache_invalidate(void);
+/**
+ * Stamp of the memory from @a address to @a address + @a size, which is
+ * unchanged as long as the stamp stays the same. 0 if the memory isn't
+ * cached: the cache is disabled, the target runs or the range is volatile.
+ */
+unsigned int rtos_memory_cache_stamp(struct target *target, target_addr_t address,
+		target_addr_t size);
+void rtos_memory_cache_free(void);
 /*  function for handling symbol access */
 int rtos_qsymbol(struct connection *connection, char const *packet, int packet_size);
 bool rtos_needs_fake_step(struct target *target, threadid_t thread_id);
@@ -0,0 +1,304 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Halt-scoped cache of target memory, enabled with "gdb_memory_cache" and
+ * shared by gdb memory reads and the RTOS support, which reads the same
+ * thread stacks gdb unwinds right after. Blocks are read aligned on a miss
+ * and all of them are dropped whenever memory may have changed: on target
+ * events, gdb packets that may write, and any write through the target API.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rtos.h"
+#include "target/target.h"
+#include "helper/align.h"
+#include "helper/command.h"
+#include "helper/list.h"
+#include "helper/log.h"
+
+#define RTOS_MEMORY_CACHE_BLOCK_SIZE 1024
+/* enough for the top of the stacks of many threads, see "rtos prefetch" */
+#define RTOS_MEMORY_CACHE_BLOCKS 256
+
+struct rtos_memory_cache_block {
+	/* NULL if the block is unused. */
+	struct target *target;
+	/* The block is only valid if equal to rtos_memory_cache_generation. */
+	unsigned int generation;
+	target_addr_t address;
+	uint8_t data[RTOS_MEMORY_CACHE_BLOCK_SIZE];
+};
+
+/* Address range that is never cached, e.g. memory-mapped I/O. */
+struct rtos_volatile_region {
+	struct list_head list;
+	target_addr_t address;
+	target_addr_t size;
+};
+
+static bool rtos_memory_cache_enabled;
+static struct rtos_memory_cache_block *rtos_memory_cache;
+/* Bumped to drop all blocks at once, writes invalidate very often. */
+static unsigned int rtos_memory_cache_generation = 1;
+/* Next block to replace, round robin. */
+static unsigned int rtos_memory_cache_victim;
+static LIST_HEAD(rtos_volatile_regions);
+
+void rtos_memory_cache_invalidate(void)
+{
+	/* 0 is never a valid stamp */
+	if (!++rtos_memory_cache_generation)
+		rtos_memory_cache_generation++;
+}
+
+static bool rtos_memory_is_volatile(target_addr_t address, target_addr_t size)
+{
+	struct rtos_volatile_region *region;
+	list_for_each_entry(region, &rtos_volatile_regions, list) {
+		if (address < region->address + region->size &&
+				region->address < address + size)
+			return true;
+	}
+	return false;
+}
+
+unsigned int rtos_memory_cache_stamp(struct target *target, target_addr_t address,
+		target_addr_t size)
+{
+	if (!rtos_memory_cache_enabled || target->state != TARGET_HALTED ||
+			rtos_memory_is_volatile(address, size))
+		return 0;
+	return rtos_memory_cache_generation;
+}
+
+static struct rtos_memory_cache_block *rtos_memory_cache_find(struct target *target,
+		target_addr_t address)
+{
+	for (unsigned int i = 0; i < RTOS_MEMORY_CACHE_BLOCKS; i++) {
+		struct rtos_memory_cache_block *block = &rtos_memory_cache[i];
+		if (block->target == target && block->address == address &&
+				block->generation == rtos_memory_cache_generation)
+			return block;
+	}
+	return NULL;
+}
+
+static struct rtos_memory_cache_block *rtos_memory_cache_lookup(struct target *target,
+		target_addr_t address)
+{
+	struct rtos_memory_cache_block *block = rtos_memory_cache_find(target, address);
+	if (block)
+		return block;
+
+	block = &rtos_memory_cache[rtos_memory_cache_victim];
+	if (target_read_buffer(target, address, RTOS_MEMORY_CACHE_BLOCK_SIZE,
+				block->data) != ERROR_OK) {
+		block->target = NULL;
+		return NULL;
+	}
+	/* The read itself may have invalidated the cache, e.g. through a
+	 * working area, only tag the block now */
+	block->target = target;
+	block->generation = rtos_memory_cache_generation;
+	block->address = address;
+	rtos_memory_cache_victim = (rtos_memory_cache_victim + 1) % RTOS_MEMORY_CACHE_BLOCKS;
+	return block;
+}
+
+int rtos_memory_cache_prefetch(struct target *target, const target_addr_t *addresses,
+		unsigned int count, uint32_t size)
+{
+	if (!rtos_memory_cache_enabled || !rtos_memory_cache ||
+			target->state != TARGET_HALTED)
+		return ERROR_OK;
+
+	struct target_memory_read_block *reads = calloc(RTOS_MEMORY_CACHE_BLOCKS,
+			sizeof(*reads));
+	if (!reads) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* Pick the blocks not cached yet, each one once */
+	unsigned int num_reads = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		const target_addr_t end = addresses[i] + size;
+		if (end < addresses[i])
+			continue;
+		for (target_addr_t a = ALIGN_DOWN(addresses[i], RTOS_MEMORY_CACHE_BLOCK_SIZE);
+				a < end && num_reads < RTOS_MEMORY_CACHE_BLOCKS;
+				a += RTOS_MEMORY_CACHE_BLOCK_SIZE) {
+			/* Blocks at the very top of the address space aren't cached. */
+			if (a + RTOS_MEMORY_CACHE_BLOCK_SIZE < a)
+				break;
+			if (rtos_memory_is_volatile(a, RTOS_MEMORY_CACHE_BLOCK_SIZE) ||
+					rtos_memory_cache_find(target, a))
+				continue;
+			bool queued = false;
+			for (unsigned int j = 0; j < num_reads && !queued; j++)
+				queued = reads[j].address == a;
+			if (queued)
+				continue;
+
+			struct rtos_memory_cache_block *block =
+				&rtos_memory_cache[rtos_memory_cache_victim];
+			rtos_memory_cache_victim = (rtos_memory_cache_victim + 1) % RTOS_MEMORY_CACHE_BLOCKS;
+			block->target = NULL;
+			reads[num_reads].address = a;
+			reads[num_reads].size = RTOS_MEMORY_CACHE_BLOCK_SIZE;
+			reads[num_reads].buffer = block->data;
+			num_reads++;
+		}
+	}
+
+	LOG_DEBUG("prefetching %u blocks of %u bytes", num_reads, RTOS_MEMORY_CACHE_BLOCK_SIZE);
+
+	/* A bogus stack pointer fails the whole batch, then read the blocks
+	 * one by one and only keep the ones that could be read */
+	int retval = target_read_buffer_list(target, reads, num_reads);
+	const unsigned int generation = rtos_memory_cache_generation;
+	for (unsigned int i = 0; i < num_reads; i++) {
+		struct rtos_memory_cache_block *block = (struct rtos_memory_cache_block *)
+			(reads[i].buffer - offsetof(struct rtos_memory_cache_block, data));
+		if (retval != ERROR_OK && target_read_buffer(target, reads[i].address,
+					reads[i].size, reads[i].buffer) != ERROR_OK)
+			continue;
+		block->target = target;
+		block->generation = generation;
+		block->address = reads[i].address;
+	}
+
+	free(reads);
+	return ERROR_OK;
+}
+
+int rtos_cached_read_buffer(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer)
+{
+	if (!rtos_memory_cache_enabled || !rtos_memory_cache ||
+			target->state != TARGET_HALTED)
+		return target_read_buffer(target, address, size, buffer);
+
+	while (size > 0) {
+		const target_addr_t block_address =
+			address & ~(target_addr_t)(RTOS_MEMORY_CACHE_BLOCK_SIZE - 1);
+		const uint32_t offset = address - block_address;
+		const uint32_t n = MIN(size, RTOS_MEMORY_CACHE_BLOCK_SIZE - offset);
+
+		struct rtos_memory_cache_block *block = NULL;
+		/* Blocks at the very top of the address space aren't cached. */
+		if (block_address + RTOS_MEMORY_CACHE_BLOCK_SIZE > block_address &&
+				!rtos_memory_is_volatile(block_address, RTOS_MEMORY_CACHE_BLOCK_SIZE))
+			block = rtos_memory_cache_lookup(target, block_address);
+
+		if (block) {
+			memcpy(buffer, block->data + offset, n);
+		} else {
+			/* Read exactly what was asked for, so errors are reported
+			 * for the requested bytes only. */
+			int retval = target_read_buffer(target, address, n, buffer);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		address += n;
+		buffer += n;
+		size -= n;
+	}
+	return ERROR_OK;
+}
+
+void rtos_memory_cache_free(void)
+{
+	free(rtos_memory_cache);
+	rtos_memory_cache = NULL;
+	struct rtos_volatile_region *region, *tmp;
+	list_for_each_entry_safe(region, tmp, &rtos_volatile_regions, list) {
+		list_del(&region->list);
+		free(region);
+	}
+}
+
+COMMAND_HANDLER(handle_gdb_memory_cache_command)
+{
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%s", rtos_memory_cache_enabled ? "enabled" : "disabled");
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	bool enable;
+	COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+	if (enable && !rtos_memory_cache) {
+		rtos_memory_cache = calloc(RTOS_MEMORY_CACHE_BLOCKS, sizeof(*rtos_memory_cache));
+		if (!rtos_memory_cache) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
+	rtos_memory_cache_invalidate();
+	rtos_memory_cache_enabled = enable;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_memory_cache_volatile_command)
+{
+	if (CMD_ARGC == 0) {
+		struct rtos_volatile_region *region;
+		list_for_each_entry(region, &rtos_volatile_regions, list)
+			command_print(CMD, "0x%" TARGET_PRIxADDR " 0x%" TARGET_PRIxADDR,
+					region->address, region->size);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "clear")) {
+		struct rtos_volatile_region *region, *tmp;
+		list_for_each_entry_safe(region, tmp, &rtos_volatile_regions, list) {
+			list_del(&region->list);
+			free(region);
+		}
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t address, size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], size);
+	if (size == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	struct rtos_volatile_region *region = malloc(sizeof(*region));
+	if (!region) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	region->address = address;
+	region->size = size;
+	list_add_tail(&region->list, &rtos_volatile_regions);
+	rtos_memory_cache_invalidate();
+	return ERROR_OK;
+}
+
+const struct command_registration rtos_memory_cache_command_handlers[] = {
+	{
+		.name = "gdb_memory_cache",
+		.handler = handle_gdb_memory_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "Display, enable or disable caching of target memory "
+			"read by gdb and the RTOS support while the target is halted",
+		.usage = "['enable'|'disable']"
+	},
+	{
+		.name = "gdb_memory_cache_volatile",
+		.handler = handle_gdb_memory_cache_volatile_command,
+		.mode = COMMAND_ANY,
+		.help = "List, add or clear address ranges that are never cached",
+		.usage = "[address size | 'clear']"
+	},
+	COMMAND_REGISTRATION_DONE
+};
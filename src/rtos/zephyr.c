@@ -66,6 +66,11 @@ struct zephyr_params {
 	uint8_t pointer_width;
 	uint32_t num_offsets;
 	uint32_t offsets[OFFSET_MAX];
+	/* Address the offsets were loaded from, 0 if not loaded yet */
+	uint32_t offsets_address;
+	/* Part of k_thread covering all the fields read by zephyr_fetch_thread() */
+	uint32_t thread_window_start;
+	uint32_t thread_window_size;
 	const struct rtos_register_stacking *callee_saved_stacking;
 	const struct rtos_register_stacking *cpu_saved_nofp_stacking;
 	const struct rtos_register_stacking *cpu_saved_fp_stacking;
@@ -445,6 +450,7 @@ static int zephyr_create(struct target *target)
 	for (struct zephyr_params *p = zephyr_params_list; p->target_name; p++) {
 		if (!strcmp(p->target_name, name)) {
 			LOG_INFO("Zephyr: target known, params at %p", p);
+			p->offsets_address = 0;
 			target->rtos->rtos_specific_params = p;
 			return ERROR_OK;
 		}
@@ -503,60 +509,77 @@ static uint32_t zephyr_kptr(const struct rtos *rtos, enum zephyr_offsets off)
 	return rtos->symbols[ZEPHYR_VAL__KERNEL].address + params->offsets[off];
 }
 
+/* Compute the part of k_thread zephyr_fetch_thread() reads at once */
+static void zephyr_compute_thread_window(struct zephyr_params *param)
+{
+	static const struct {
+		enum zephyr_offsets offset;
+		uint32_t size;
+	} fields[] = {
+		{ OFFSET_T_ENTRY, 4 },
+		{ OFFSET_T_NEXT_THREAD, 4 },
+		{ OFFSET_T_STACK_POINTER, 4 },
+		{ OFFSET_T_STATE, 1 },
+		{ OFFSET_T_USER_OPTIONS, 1 },
+		{ OFFSET_T_PRIO, 1 },
+		{ OFFSET_T_NAME, sizeof(((struct zephyr_thread *)NULL)->name) - 1 },
+	};
+	uint32_t start = UINT32_MAX, end = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(fields); i++) {
+		uint32_t offset = param->offsets[fields[i].offset];
+		if (offset == UNIMPLEMENTED)
+			continue;
+		start = MIN(start, offset);
+		end = MAX(end, offset + fields[i].size);
+	}
+
+	param->thread_window_start = start;
+	param->thread_window_size = end - start;
+}
+
 static int zephyr_fetch_thread(const struct rtos *rtos,
 				struct zephyr_thread *thread, uint32_t ptr)
 {
 	const struct zephyr_params *param = rtos->rtos_specific_params;
+	uint8_t *window = malloc(param->thread_window_size);
 	int retval;
 
-	thread->ptr = ptr;
-
-	retval = target_read_u32(rtos->target, ptr + param->offsets[OFFSET_T_ENTRY],
-				 &thread->entry);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = target_read_u32(rtos->target,
-				 ptr + param->offsets[OFFSET_T_NEXT_THREAD],
-				 &thread->next_ptr);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = target_read_u32(rtos->target,
-				 ptr + param->offsets[OFFSET_T_STACK_POINTER],
-				 &thread->stack_pointer);
-	if (retval != ERROR_OK)
-		return retval;
+	if (!window) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 
-	retval = target_read_u8(rtos->target, ptr + param->offsets[OFFSET_T_STATE],
-				&thread->state);
-	if (retval != ERROR_OK)
-		return retval;
+	thread->ptr = ptr;
 
-	retval = target_read_u8(rtos->target,
-				ptr + param->offsets[OFFSET_T_USER_OPTIONS],
-				&thread->user_options);
-	if (retval != ERROR_OK)
+	/* Read all the fields at once and decode them here */
+	retval = target_read_buffer(rtos->target, ptr + param->thread_window_start,
+			param->thread_window_size, window);
+	if (retval != ERROR_OK) {
+		free(window);
 		return retval;
+	}
 
-	uint8_t prio;
-	retval = target_read_u8(rtos->target,
-				ptr + param->offsets[OFFSET_T_PRIO], &prio);
-	if (retval != ERROR_OK)
-		return retval;
-	thread->prio = prio;
+	const uint8_t *t = window - param->thread_window_start;
+	thread->entry = target_buffer_get_u32(rtos->target,
+			t + param->offsets[OFFSET_T_ENTRY]);
+	thread->next_ptr = target_buffer_get_u32(rtos->target,
+			t + param->offsets[OFFSET_T_NEXT_THREAD]);
+	thread->stack_pointer = target_buffer_get_u32(rtos->target,
+			t + param->offsets[OFFSET_T_STACK_POINTER]);
+	thread->state = t[param->offsets[OFFSET_T_STATE]];
+	thread->user_options = t[param->offsets[OFFSET_T_USER_OPTIONS]];
+	thread->prio = t[param->offsets[OFFSET_T_PRIO]];
 
 	thread->name[0] = '\0';
 	if (param->offsets[OFFSET_T_NAME] != UNIMPLEMENTED) {
-		retval = target_read_buffer(rtos->target,
-					ptr + param->offsets[OFFSET_T_NAME],
-					sizeof(thread->name) - 1, (uint8_t *)thread->name);
-		if (retval != ERROR_OK)
-			return retval;
-
+		memcpy(thread->name, t + param->offsets[OFFSET_T_NAME],
+				sizeof(thread->name) - 1);
 		thread->name[sizeof(thread->name) - 1] = '\0';
 	}
 
+	free(window);
+
 	LOG_DEBUG("Fetched thread%" PRIx32 ": {entry@0x%" PRIx32
 		", state=%" PRIu8 ", useropts=%" PRIu8 ", prio=%" PRId8 "}",
 		ptr, thread->entry, thread->state, thread->user_options, thread->prio);
@@ -657,74 +680,84 @@ static int zephyr_update_threads(struct rtos *rtos)
 		return ERROR_FAIL;
 	}
 
-	retval = target_read_u8(rtos->target,
-		rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_SIZE_T_SIZE].address,
-		&param->size_width);
-	if (retval != ERROR_OK) {
-		LOG_ERROR("Couldn't determine size of size_t from host");
-		return retval;
-	}
-
-	if (param->size_width != 4) {
-		LOG_ERROR("Only size_t of 4 bytes are supported");
-		return ERROR_FAIL;
-	}
-
-	if (rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_NUM_OFFSETS].address) {
-		retval = target_read_u32(rtos->target,
-				rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_NUM_OFFSETS].address,
-				&param->num_offsets);
+	/* The offset table only changes with the firmware, it is loaded once */
+	if (param->offsets_address !=
+			rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address) {
+		retval = target_read_u8(rtos->target,
+			rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_SIZE_T_SIZE].address,
+			&param->size_width);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Couldn't not fetch number of offsets from Zephyr");
+			LOG_ERROR("Couldn't determine size of size_t from host");
 			return retval;
 		}
 
-		if (param->num_offsets <= OFFSET_T_STACK_POINTER) {
-			LOG_ERROR("Number of offsets too small");
+		if (param->size_width != 4) {
+			LOG_ERROR("Only size_t of 4 bytes are supported");
 			return ERROR_FAIL;
 		}
-	} else {
-		retval = target_read_u32(rtos->target,
-				rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address,
-				&param->offsets[OFFSET_VERSION]);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Couldn't not fetch offsets from Zephyr");
-			return retval;
-		}
 
-		if (param->offsets[OFFSET_VERSION] > 1) {
-			LOG_ERROR("Unexpected OpenOCD support version %" PRIu32,
-					param->offsets[OFFSET_VERSION]);
-			return ERROR_FAIL;
+		if (rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_NUM_OFFSETS].address) {
+			retval = target_read_u32(rtos->target,
+					rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_NUM_OFFSETS].address,
+					&param->num_offsets);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("Couldn't not fetch number of offsets from Zephyr");
+				return retval;
+			}
+
+			if (param->num_offsets <= OFFSET_T_STACK_POINTER) {
+				LOG_ERROR("Number of offsets too small");
+				return ERROR_FAIL;
+			}
+		} else {
+			retval = target_read_u32(rtos->target,
+					rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address,
+					&param->offsets[OFFSET_VERSION]);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("Couldn't not fetch offsets from Zephyr");
+				return retval;
+			}
+
+			if (param->offsets[OFFSET_VERSION] > 1) {
+				LOG_ERROR("Unexpected OpenOCD support version %" PRIu32,
+						param->offsets[OFFSET_VERSION]);
+				return ERROR_FAIL;
+			}
+			switch (param->offsets[OFFSET_VERSION]) {
+			case 0:
+				param->num_offsets = OFFSET_T_STACK_POINTER + 1;
+				break;
+			case 1:
+				param->num_offsets = OFFSET_T_COOP_FLOAT + 1;
+				break;
+			}
 		}
-		switch (param->offsets[OFFSET_VERSION]) {
-		case 0:
-			param->num_offsets = OFFSET_T_STACK_POINTER + 1;
-			break;
-		case 1:
-			param->num_offsets = OFFSET_T_COOP_FLOAT + 1;
-			break;
-		}
-	}
-	/* We can fetch the whole array for version 0, as they're supposed
-	 * to grow only */
-	uint32_t address;
-	address  = rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address;
-	for (size_t i = 0; i < OFFSET_MAX; i++, address += param->size_width) {
-		if (i >= param->num_offsets) {
-			param->offsets[i] = UNIMPLEMENTED;
-			continue;
-		}
-
-		retval = target_read_u32(rtos->target, address, &param->offsets[i]);
+		/* We can fetch the whole array for version 0, as they're supposed
+		 * to grow only */
+		uint8_t offsets[OFFSET_MAX * 4];
+		size_t num_offsets = MIN(param->num_offsets, OFFSET_MAX);
+		retval = target_read_buffer(rtos->target,
+				rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address,
+				num_offsets * param->size_width, offsets);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("Could not fetch offsets from Zephyr");
 			return ERROR_FAIL;
 		}
-	}
 
-	LOG_DEBUG("Zephyr OpenOCD support version %" PRId32,
-			  param->offsets[OFFSET_VERSION]);
+		for (size_t i = 0; i < OFFSET_MAX; i++) {
+			if (i >= num_offsets)
+				param->offsets[i] = UNIMPLEMENTED;
+			else
+				param->offsets[i] = target_buffer_get_u32(rtos->target,
+						offsets + i * param->size_width);
+		}
+
+		param->offsets_address = rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address;
+		zephyr_compute_thread_window(param);
+
+		LOG_DEBUG("Zephyr OpenOCD support version %" PRId32,
+				  param->offsets[OFFSET_VERSION]);
+	}
 
 	uint32_t current_thread;
 	retval = target_read_u32(rtos->target,
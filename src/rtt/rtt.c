@@ -40,9 +40,16 @@ static struct {
 	bool found_cb;
 
 	struct rtt_sink_list **sink_list;
+	/** Statistics of each up-channel in sink_list. */
+	struct rtt_channel_stats *stats;
 	size_t sink_list_length;
 
 	unsigned int polling_interval;
+	/** Whether the polling interval follows the channel fill level. */
+	bool adaptive_polling;
+	/** Bounds of the polling interval with adaptive polling. */
+	unsigned int polling_min;
+	unsigned int polling_max;
 } rtt;
 
 int rtt_init(void)
@@ -50,14 +57,21 @@ int rtt_init(void)
 	rtt.sink_list_length = 1;
 	rtt.sink_list = calloc(rtt.sink_list_length,
 		sizeof(struct rtt_sink_list *));
+	rtt.stats = calloc(rtt.sink_list_length, sizeof(struct rtt_channel_stats));
 
-	if (!rtt.sink_list)
+	if (!rtt.sink_list || !rtt.stats) {
+		free(rtt.sink_list);
+		free(rtt.stats);
 		return ERROR_FAIL;
+	}
 
 	rtt.sink_list[0] = NULL;
 	rtt.started = false;
 
 	rtt.polling_interval = 100;
+	rtt.adaptive_polling = false;
+	rtt.polling_min = 1;
+	rtt.polling_max = 100;
 
 	return ERROR_OK;
 }
@@ -65,15 +79,66 @@ int rtt_init(void)
 int rtt_exit(void)
 {
 	free(rtt.sink_list);
+	free(rtt.stats);
 
 	return ERROR_OK;
 }
 
+static int read_channel_callback(void *user_data);
+
+static void reschedule_polling(unsigned int interval)
+{
+	if (rtt.polling_interval == interval)
+		return;
+
+	rtt.polling_interval = interval;
+
+	if (!rtt.started)
+		return;
+
+	target_unregister_timer_callback(&read_channel_callback, NULL);
+	target_register_timer_callback(&read_channel_callback, interval, 1, NULL);
+}
+
+/*
+ * Poll faster while a channel is at least half full, so bursts do not
+ * overflow the target buffers, and back off while all channels are empty.
+ */
+static void adapt_polling_interval(void)
+{
+	bool busy = false;
+	bool idle = true;
+	unsigned int interval = rtt.polling_interval;
+
+	for (size_t i = 0; i < rtt.sink_list_length; i++) {
+		const struct rtt_channel_stats *stats = &rtt.stats[i];
+
+		if (!rtt.sink_list[i] || !stats->size)
+			continue;
+
+		if (stats->fill)
+			idle = false;
+
+		if (stats->fill >= stats->size / 2)
+			busy = true;
+	}
+
+	if (busy)
+		interval = MAX(interval / 2, rtt.polling_min);
+	else if (idle)
+		interval = MIN(interval * 2, rtt.polling_max);
+
+	if (interval != rtt.polling_interval)
+		LOG_DEBUG("rtt: Polling interval %u ms", interval);
+
+	reschedule_polling(interval);
+}
+
 static int read_channel_callback(void *user_data)
 {
 	int ret;
 
-	ret = rtt.source.read(rtt.target, &rtt.ctrl, rtt.sink_list,
+	ret = rtt.source.read(rtt.target, &rtt.ctrl, rtt.sink_list, rtt.stats,
 		rtt.sink_list_length, NULL);
 
 	if (ret != ERROR_OK) {
@@ -82,6 +147,9 @@ static int read_channel_callback(void *user_data)
 		return ret;
 	}
 
+	if (rtt.adaptive_polling)
+		adapt_polling_interval();
+
 	return ERROR_OK;
 }
 
@@ -155,6 +223,8 @@ int rtt_start(void)
 	if (ret != ERROR_OK)
 		return ret;
 
+	memset(rtt.stats, 0, rtt.sink_list_length * sizeof(struct rtt_channel_stats));
+
 	target_register_timer_callback(&read_channel_callback,
 		rtt.polling_interval, 1, NULL);
 	rtt.started = true;
@@ -185,10 +255,20 @@ int rtt_stop(void)
 static int adjust_sink_list(size_t length)
 {
 	struct rtt_sink_list **tmp;
+	struct rtt_channel_stats *stats;
 
 	if (length <= rtt.sink_list_length)
 		return ERROR_OK;
 
+	stats = realloc(rtt.stats, sizeof(struct rtt_channel_stats) * length);
+
+	if (!stats)
+		return ERROR_FAIL;
+
+	memset(stats + rtt.sink_list_length, 0,
+		sizeof(struct rtt_channel_stats) * (length - rtt.sink_list_length));
+	rtt.stats = stats;
+
 	tmp = realloc(rtt.sink_list, sizeof(struct rtt_sink_list *) * length);
 
 	if (!tmp)
@@ -274,17 +354,44 @@ int rtt_set_polling_interval(unsigned int interval)
 	if (!interval)
 		return ERROR_FAIL;
 
-	if (rtt.polling_interval != interval) {
-		target_unregister_timer_callback(&read_channel_callback, NULL);
-		target_register_timer_callback(&read_channel_callback, interval, 1,
-			NULL);
+	rtt.adaptive_polling = false;
+	reschedule_polling(interval);
+
+	return ERROR_OK;
+}
+
+bool rtt_get_adaptive_polling(unsigned int *min, unsigned int *max)
+{
+	*min = rtt.polling_min;
+	*max = rtt.polling_max;
+
+	return rtt.adaptive_polling;
+}
+
+int rtt_set_adaptive_polling(bool enable, unsigned int min, unsigned int max)
+{
+	if (enable) {
+		if (!min || min > max)
+			return ERROR_FAIL;
+
+		rtt.polling_min = min;
+		rtt.polling_max = max;
+		reschedule_polling(MIN(MAX(rtt.polling_interval, min), max));
 	}
 
-	rtt.polling_interval = interval;
+	rtt.adaptive_polling = enable;
 
 	return ERROR_OK;
 }
 
+const struct rtt_channel_stats *rtt_get_channel_stats(unsigned int channel_index)
+{
+	if (channel_index >= rtt.sink_list_length || !rtt.stats[channel_index].size)
+		return NULL;
+
+	return &rtt.stats[channel_index];
+}
+
 int rtt_write_channel(unsigned int channel_index, const uint8_t *buffer,
 		size_t *length)
 {
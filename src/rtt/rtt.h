@@ -77,6 +77,23 @@ struct rtt_channel_info {
 	uint32_t flags;
 };
 
+/** Up-channel statistics, updated by the source on every poll. */
+struct rtt_channel_stats {
+	/** Bytes read from the channel. */
+	uint64_t bytes;
+	/**
+	 * Polls that found the channel buffer full. Depending on the channel
+	 * mode, the target dropped or blocked on data since the previous poll.
+	 */
+	uint32_t overflows;
+	/** Bytes a sink failed to take. */
+	uint64_t drops;
+	/** Bytes pending in the channel buffer at the last poll. */
+	uint32_t fill;
+	/** Channel buffer size in bytes, 0 if the channel was not polled. */
+	uint32_t size;
+};
+
 typedef int (*rtt_sink_read)(unsigned int channel, const uint8_t *buffer,
 		size_t length, void *user_data);
 
@@ -110,7 +127,8 @@ typedef int (*rtt_source_start)(struct target *target,
 typedef int (*rtt_source_stop)(struct target *target, void *user_data);
 typedef int (*rtt_source_read)(struct target *target,
 		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
-		size_t num_channels, void *user_data);
+		struct rtt_channel_stats *stats, size_t num_channels,
+		void *user_data);
 typedef int (*rtt_source_write)(struct target *target,
 		struct rtt_control *ctrl, unsigned int channel,
 		const uint8_t *buffer, size_t *length, void *user_data);
@@ -194,6 +212,40 @@ int rtt_get_polling_interval(unsigned int *interval);
  */
 int rtt_set_polling_interval(unsigned int interval);
 
+/**
+ * Get the adaptive polling bounds.
+ *
+ * @param[out] min Shortest polling interval in milliseconds.
+ * @param[out] max Longest polling interval in milliseconds.
+ *
+ * @returns Whether adaptive polling is enabled.
+ */
+bool rtt_get_adaptive_polling(unsigned int *min, unsigned int *max);
+
+/**
+ * Enable or disable adaptive polling.
+ *
+ * With adaptive polling, the polling interval is halved after a poll that
+ * found an up-channel at least half full, and doubled after a poll that
+ * found all up-channels empty, within @a min and @a max.
+ *
+ * @param[in] enable Whether to enable adaptive polling.
+ * @param[in] min Shortest polling interval in milliseconds.
+ * @param[in] max Longest polling interval in milliseconds.
+ *
+ * @returns ERROR_OK on success, an error code on failure.
+ */
+int rtt_set_adaptive_polling(bool enable, unsigned int min, unsigned int max);
+
+/**
+ * Get the statistics of an up-channel.
+ *
+ * @param[in] channel_index Up-channel index.
+ *
+ * @returns The statistics, NULL if the channel has never been polled.
+ */
+const struct rtt_channel_stats *rtt_get_channel_stats(unsigned int channel_index);
+
 /**
  * Get whether RTT is started.
  *
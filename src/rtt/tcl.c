@@ -69,7 +69,7 @@ COMMAND_HANDLER(handle_rtt_polling_interval_command)
 {
 	if (CMD_ARGC == 0) {
 		int ret;
-		unsigned int interval;
+		unsigned int interval, min, max;
 
 		ret = rtt_get_polling_interval(&interval);
 
@@ -78,7 +78,11 @@ COMMAND_HANDLER(handle_rtt_polling_interval_command)
 			return ret;
 		}
 
-		command_print(CMD, "%u ms", interval);
+		if (rtt_get_adaptive_polling(&min, &max))
+			command_print(CMD, "%u ms, adaptive from %u to %u ms", interval,
+				min, max);
+		else
+			command_print(CMD, "%u ms", interval);
 	} else if (CMD_ARGC == 1) {
 		int ret;
 		unsigned int interval;
@@ -90,6 +94,18 @@ COMMAND_HANDLER(handle_rtt_polling_interval_command)
 			command_print(CMD, "Failed to set polling interval");
 			return ret;
 		}
+	} else if (CMD_ARGC == 3 && !strcmp(CMD_ARGV[0], "adaptive")) {
+		int ret;
+		unsigned int min, max;
+
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], min);
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], max);
+		ret = rtt_set_adaptive_polling(true, min, max);
+
+		if (ret != ERROR_OK) {
+			command_print(CMD, "Invalid adaptive polling bounds");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
 	} else {
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
@@ -97,6 +113,34 @@ COMMAND_HANDLER(handle_rtt_polling_interval_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_rtt_statistics_command)
+{
+	const struct rtt_control *ctrl;
+
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!rtt_found_cb()) {
+		command_print(CMD, "rtt: Control block not available");
+		return ERROR_FAIL;
+	}
+
+	ctrl = rtt_get_control();
+
+	for (unsigned int i = 0; i < ctrl->num_up_channels; i++) {
+		const struct rtt_channel_stats *stats = rtt_get_channel_stats(i);
+
+		if (!stats)
+			continue;
+
+		command_print(CMD, "%u: bytes %" PRIu64 ", overflows %" PRIu32
+			", drops %" PRIu64 ", fill %" PRIu32 "/%" PRIu32, i, stats->bytes,
+			stats->overflows, stats->drops, stats->fill, stats->size);
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_rtt_channels_command)
 {
 	int ret;
@@ -238,8 +282,16 @@ static const struct command_registration rtt_subcommand_handlers[] = {
 		.name = "polling_interval",
 		.handler = handle_rtt_polling_interval_command,
 		.mode = COMMAND_EXEC,
-		.help = "show or set polling interval in ms",
-		.usage = "[interval]"
+		.help = "show or set polling interval in ms, or let it adapt "
+			"to the channel fill level within min and max",
+		.usage = "[interval | 'adaptive' min max]"
+	},
+	{
+		.name = "statistics",
+		.handler = handle_rtt_statistics_command,
+		.mode = COMMAND_EXEC,
+		.help = "show statistics of the polled up-channels",
+		.usage = ""
 	},
 	{
 		.name = "channels",
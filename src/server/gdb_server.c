@@ -38,6 +38,7 @@
 #include "gdb_server.h"
 #include <target/image.h>
 #include <jtag/jtag.h>
+#include <helper/perf.h>
 #include "rtos/rtos.h"
 #include "target/smp.h"
 
@@ -59,11 +60,29 @@ enum gdb_output_flag {
 	GDB_OUTPUT_ALL,
 };
 
-struct target_desc_format {
-	char *tdesc;
-	uint32_t tdesc_length;
+/* vFlashWrite data not programmed yet with gdb_flash_stream, see
+ * gdb_vflash_stream_write() */
+struct gdb_vflash_stream {
+	struct flash_bank *bank;
+	/* address of data[0] */
+	target_addr_t address;
+	uint8_t *data;
+	uint32_t size;
+	/* TARGET_EVENT_GDB_FLASH_WRITE_START was sent */
+	bool started;
+};
+
+/* qCRC result, reused while rtos_memory_cache_stamp() is unchanged */
+struct gdb_crc_entry {
+	target_addr_t address;
+	uint32_t size;
+	uint32_t crc;
+	unsigned int stamp;
 };
 
+/* compare-sections asks for a few regions per loaded image */
+#define GDB_CRC_CACHE_SIZE 64
+
 /* private connection data for GDB */
 struct gdb_connection {
 	char buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
@@ -72,6 +91,11 @@ struct gdb_connection {
 	bool ctrl_c;
 	enum target_state frontend_state;
 	struct image *vflash_image;
+	struct gdb_vflash_stream vflash_stream;
+	/* regions qCRC was asked for, the stale ones are checksummed again
+	 * together on the next miss */
+	struct gdb_crc_entry crc_cache[GDB_CRC_CACHE_SIZE];
+	unsigned int crc_cache_count;
 	bool closed;
 	/* set to prevent re-entrance from log messages during gdb_get_packet()
 	 * and gdb_put_packet(). */
@@ -93,20 +117,39 @@ struct gdb_connection {
 	bool attached;
 	/* set when extended protocol is used */
 	bool extended_protocol;
-	/* temporarily used for target description support */
-	struct target_desc_format target_desc;
-	/* temporarily used for thread list support */
+	/* qXfer:threads:read snapshot, kept until the next stop or resume */
 	char *thread_list;
 	/* flag to mask the output from gdb_log_callback() */
 	enum gdb_output_flag output_flag;
 	/* Unique index for this GDB connection. */
 	unsigned int unique_index;
+	/* first core of a halting SMP group, the stop reply is deferred until
+	 * the other cores of the group have halted too */
+	struct target *halt_target;
+	/* non-stop mode, enabled by gdb with QNonStop:1 */
+	bool non_stop;
+	/* halted targets not reported yet in non-stop mode, see gdb_stop_event */
+	struct list_head stop_events;
+	/* the first of stop_events was reported, gdb acknowledges it with vStopped */
+	bool stop_notif_sent;
+	/* the halt was requested by gdb, it is reported with signal 0 */
+	bool stop_requested;
+};
+
+/* A target that halted while gdb runs in non-stop mode */
+struct gdb_stop_event {
+	struct list_head lh;
+	struct target *target;
+	int signal;
 };
 
 #if 0
 #define _DEBUG_GDB_IO_
 #endif
 
+/* longest time the stop reply waits for the other cores of an SMP group */
+#define GDB_SMP_HALT_TIMEOUT_MS 1000
+
 static struct gdb_connection *current_gdb_connection;
 
 static int gdb_breakpoint_override;
@@ -131,12 +174,23 @@ static int gdb_actual_connections;
 static bool gdb_use_memory_map = true;
 /* enabled by default*/
 static bool gdb_flash_program = true;
+/* program the sectors received by vFlashWrite before vFlashDone,
+ * disabled by default */
+static bool gdb_flash_stream;
+
+/* gdb_flash_stream programs at least this many bytes at once */
+#define GDB_VFLASH_STREAM_CHUNK 0x10000
 
 /* if set, data aborts cause an error to be reported in memory read packets
  * see the code in gdb_read_memory_packet() for further explanations.
  * Disabled by default.
  */
 static int gdb_report_data_abort;
+/* Largest packet gdb may send, advertised as PacketSize in qSupported. */
+static unsigned int gdb_packet_size = GDB_BUFFER_SIZE;
+/* Buffer for incoming packets, gdb_packet_size bytes plus null-termination. */
+static char *gdb_packet_buffer;
+
 /* If set, errors when accessing registers are reported to gdb. Disabled by
  * default. */
 static int gdb_report_register_access_error;
@@ -261,6 +315,9 @@ static int gdb_get_char_inner(struct connection *connection, int *next_char)
 #ifdef _DEBUG_GDB_IO_
 	char *debug_buffer;
 #endif
+	/* gdb may be waiting for our buffered output */
+	connection_flush(connection);
+
 	for (;; ) {
 		if (connection->service->type != CONNECTION_TCP)
 			gdb_con->buf_cnt = read(connection->fd, gdb_con->buffer, GDB_BUFFER_SIZE);
@@ -812,6 +869,42 @@ static int gdb_output(struct command_context *context, const char *line)
 	return ERROR_OK;
 }
 
+static void gdb_thread_list_invalidate(struct gdb_connection *gdb_connection)
+{
+	free(gdb_connection->thread_list);
+	gdb_connection->thread_list = NULL;
+}
+
+/* The watchpoint part of a stop reply, empty if none was hit. */
+static void gdb_stop_reason(struct target *ct, char *stop_reason, size_t size)
+{
+	stop_reason[0] = '\0';
+	if (ct->debug_reason != DBG_REASON_WATCHPOINT)
+		return;
+
+	enum watchpoint_rw hit_wp_type;
+	target_addr_t hit_wp_address;
+	if (watchpoint_hit(ct, &hit_wp_type, &hit_wp_address) != ERROR_OK)
+		return;
+
+	switch (hit_wp_type) {
+		case WPT_WRITE:
+			snprintf(stop_reason, size,
+					"watch:%08" TARGET_PRIxADDR ";", hit_wp_address);
+			break;
+		case WPT_READ:
+			snprintf(stop_reason, size,
+					"rwatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
+			break;
+		case WPT_ACCESS:
+			snprintf(stop_reason, size,
+					"awatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
+			break;
+		default:
+			break;
+	}
+}
+
 static void gdb_signal_reply(struct target *target, struct connection *connection)
 {
 	struct gdb_connection *gdb_connection = connection->priv;
@@ -822,6 +915,7 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 	int signal_var;
 
 	rtos_update_threads(target);
+	gdb_thread_list_invalidate(gdb_connection);
 
 	if (target->debug_reason == DBG_REASON_EXIT) {
 		sig_reply_len = snprintf(sig_reply, sizeof(sig_reply), "W00");
@@ -843,31 +937,7 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 		} else
 			signal_var = gdb_last_signal(ct);
 
-		stop_reason[0] = '\0';
-		if (ct->debug_reason == DBG_REASON_WATCHPOINT) {
-			enum watchpoint_rw hit_wp_type;
-			target_addr_t hit_wp_address;
-
-			if (watchpoint_hit(ct, &hit_wp_type, &hit_wp_address) == ERROR_OK) {
-
-				switch (hit_wp_type) {
-					case WPT_WRITE:
-						snprintf(stop_reason, sizeof(stop_reason),
-								"watch:%08" TARGET_PRIxADDR ";", hit_wp_address);
-						break;
-					case WPT_READ:
-						snprintf(stop_reason, sizeof(stop_reason),
-								"rwatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
-						break;
-					case WPT_ACCESS:
-						snprintf(stop_reason, sizeof(stop_reason),
-								"awatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
-						break;
-					default:
-						break;
-				}
-			}
-		}
+		gdb_stop_reason(ct, stop_reason, sizeof(stop_reason));
 
 		current_thread[0] = '\0';
 		if (rtos)
@@ -969,7 +1039,228 @@ static void gdb_fileio_reply(struct target *target, struct connection *connectio
 	} else {
 		gdb_connection->frontend_state = TARGET_HALTED;
 		rtos_update_threads(target);
+		gdb_thread_list_invalidate(gdb_connection);
+	}
+}
+
+static void gdb_frontend_halted_reply(struct target *target, struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	/* stop forwarding log packets! */
+	gdb_connection->output_flag = GDB_OUTPUT_NO;
+
+	/* check fileio first */
+	if (target_get_gdb_fileio_info(target, target->fileio_info) == ERROR_OK)
+		gdb_fileio_reply(target, connection);
+	else
+		gdb_signal_reply(target, connection);
+}
+
+/* Send an asynchronous notification, gdb doesn't acknowledge it. */
+static void gdb_put_notification(struct connection *connection, const char *notif)
+{
+	unsigned char checksum = 0;
+	for (const char *c = notif; *c; c++)
+		checksum += *c;
+
+	char *buf = alloc_printf("%%%s#%2.2x", notif, checksum);
+	if (!buf)
+		return;
+
+#ifdef _DEBUG_GDB_IO_
+	LOG_DEBUG("sending notification '%s'", buf);
+#endif
+
+	gdb_write(connection, buf, strlen(buf));
+	free(buf);
+}
+
+/* Thread id gdb knows "target" by, 0 without RTOS support. */
+static int64_t gdb_target_thread_id(struct connection *connection, struct target *target)
+{
+	struct rtos *rtos = rtos_of_target(target);
+	if (!rtos)
+		return 0;
+
+	for (int i = 0; i < rtos->thread_count; i++) {
+		struct target *t = NULL;
+		threadid_t id = rtos->thread_details[i].threadid;
+		if (rtos->gdb_target_for_threadid(connection, id, &t) == ERROR_OK && t == target)
+			return id;
 	}
+	return rtos->current_thread;
+}
+
+/* Stop reply for one target in non-stop mode, always naming its thread. */
+static int gdb_non_stop_reply(struct connection *connection,
+		const struct gdb_stop_event *event, char *buf, size_t size)
+{
+	struct target *target = event->target;
+	char stop_reason[32];
+	char thread[25] = "";
+
+	gdb_stop_reason(target, stop_reason, sizeof(stop_reason));
+	int64_t thread_id = gdb_target_thread_id(connection, target);
+	if (thread_id)
+		snprintf(thread, sizeof(thread), "thread:%" PRIx64 ";", thread_id);
+
+	int signal_var = event->signal >= 0 ? event->signal : gdb_last_signal(target);
+	return snprintf(buf, size, "T%2.2x%s%s", signal_var, stop_reason, thread);
+}
+
+static struct gdb_stop_event *gdb_stop_event_find(struct gdb_connection *gdb_connection,
+		struct target *target)
+{
+	struct gdb_stop_event *event;
+	list_for_each_entry(event, &gdb_connection->stop_events, lh) {
+		if (event->target == target)
+			return event;
+	}
+	return NULL;
+}
+
+/* Queue the halt of "target", the first one is reported with a %Stop
+ * notification and the others in reply to vStopped. */
+static void gdb_non_stop_halted(struct target *target, struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (target->state != TARGET_HALTED || gdb_stop_event_find(gdb_connection, target))
+		return;
+
+	struct gdb_stop_event *event = malloc(sizeof(*event));
+	if (!event) {
+		LOG_ERROR("Out of memory");
+		return;
+	}
+	event->target = target;
+	event->signal = gdb_connection->stop_requested ? 0 : -1;
+	list_add_tail(&event->lh, &gdb_connection->stop_events);
+
+	rtos_update_threads(target);
+	gdb_thread_list_invalidate(gdb_connection);
+
+	if (gdb_connection->stop_notif_sent)
+		return;
+
+	char notif[80];
+	int len = snprintf(notif, sizeof(notif), "Stop:");
+	gdb_non_stop_reply(connection, event, notif + len, sizeof(notif) - len);
+	gdb_put_notification(connection, notif);
+	gdb_connection->stop_notif_sent = true;
+}
+
+/* A resumed target has nothing to report anymore, unless gdb was told
+ * about it already. */
+static void gdb_non_stop_resumed(struct gdb_connection *gdb_connection, struct target *target)
+{
+	struct gdb_stop_event *event = gdb_stop_event_find(gdb_connection, target);
+	if (!event)
+		return;
+	if (gdb_connection->stop_notif_sent &&
+			event == list_first_entry(&gdb_connection->stop_events, struct gdb_stop_event, lh))
+		return;
+	list_del(&event->lh);
+	free(event);
+}
+
+static void gdb_stop_events_clear(struct gdb_connection *gdb_connection)
+{
+	struct gdb_stop_event *event, *tmp;
+	list_for_each_entry_safe(event, tmp, &gdb_connection->stop_events, lh) {
+		list_del(&event->lh);
+		free(event);
+	}
+	gdb_connection->stop_notif_sent = false;
+}
+
+/* Reply with the stop reply of the first queued target, or OK if there is
+ * none, after which the next halt is notified again. */
+static void gdb_put_next_stop(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (list_empty(&gdb_connection->stop_events)) {
+		gdb_connection->stop_notif_sent = false;
+		gdb_put_packet(connection, "OK", 2);
+		return;
+	}
+
+	char reply[80];
+	struct gdb_stop_event *event =
+		list_first_entry(&gdb_connection->stop_events, struct gdb_stop_event, lh);
+	int len = gdb_non_stop_reply(connection, event, reply, sizeof(reply));
+	gdb_connection->stop_notif_sent = true;
+	gdb_put_packet(connection, reply, len);
+}
+
+/* vStopped: gdb is done with the stop reported last, report the next one. */
+static void gdb_vstopped_packet(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (gdb_connection->stop_notif_sent && !list_empty(&gdb_connection->stop_events)) {
+		struct gdb_stop_event *event =
+			list_first_entry(&gdb_connection->stop_events, struct gdb_stop_event, lh);
+		list_del(&event->lh);
+		free(event);
+	}
+	gdb_put_next_stop(connection);
+}
+
+/* '?' in non-stop mode reports every halted target, from the start. */
+static void gdb_non_stop_status(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+
+	gdb_stop_events_clear(gdb_connection);
+	/* don't notify, the halted targets are the reply */
+	gdb_connection->stop_notif_sent = true;
+	if (target->smp) {
+		struct target_list *tlist;
+		foreach_smp_target(tlist, target->smp_targets)
+			gdb_non_stop_halted(tlist->target, connection);
+	} else {
+		gdb_non_stop_halted(target, connection);
+	}
+	gdb_put_next_stop(connection);
+}
+
+static void gdb_set_non_stop(struct connection *connection, bool non_stop)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct gdb_service *gdb_service = connection->service->priv;
+	struct target *target = gdb_service->target;
+
+	gdb_connection->non_stop = non_stop;
+	gdb_stop_events_clear(gdb_connection);
+	if (target->smp) {
+		struct target_list *tlist;
+		foreach_smp_target(tlist, target->smp_targets)
+			tlist->target->smp_non_stop = non_stop;
+	} else {
+		target->smp_non_stop = non_stop;
+	}
+}
+
+static int gdb_smp_halt_timeout(void *priv)
+{
+	struct connection *connection = priv;
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = gdb_connection->halt_target;
+
+	if (!target)
+		return ERROR_OK;
+
+	gdb_connection->halt_target = NULL;
+	if (gdb_connection->frontend_state == TARGET_RUNNING) {
+		LOG_TARGET_WARNING(target, "not all cores of the SMP group halted");
+		gdb_frontend_halted_reply(target, connection);
+	}
+
+	return ERROR_OK;
 }
 
 static void gdb_frontend_halted(struct target *target, struct connection *connection)
@@ -985,16 +1276,34 @@ static void gdb_frontend_halted(struct target *target, struct connection *connec
 	 * out of the running state so we'll see lots of TARGET_EVENT_XXX
 	 * that are to be ignored.
 	 */
-	if (gdb_connection->frontend_state == TARGET_RUNNING) {
-		/* stop forwarding log packets! */
-		gdb_connection->output_flag = GDB_OUTPUT_NO;
+	if (gdb_connection->non_stop) {
+		gdb_non_stop_halted(target, connection);
+		return;
+	}
 
-		/* check fileio first */
-		if (target_get_gdb_fileio_info(target, target->fileio_info) == ERROR_OK)
-			gdb_fileio_reply(target, connection);
-		else
-			gdb_signal_reply(target, connection);
+	if (gdb_connection->frontend_state != TARGET_RUNNING)
+		return;
+
+	/* Every core of an SMP group reports its halt. Reply once, when the
+	 * last one has halted, instead of refreshing the thread list and the
+	 * registers of the group for each of them. */
+	if (smp_halt_pending(target)) {
+		if (!gdb_connection->halt_target) {
+			gdb_connection->halt_target = target;
+			target_register_timer_callback(gdb_smp_halt_timeout,
+				GDB_SMP_HALT_TIMEOUT_MS, TARGET_TIMER_TYPE_ONESHOT, connection);
+		}
+		return;
+	}
+
+	if (gdb_connection->halt_target) {
+		/* report the core that halted first */
+		target = gdb_connection->halt_target;
+		gdb_connection->halt_target = NULL;
+		target_unregister_timer_callback(gdb_smp_halt_timeout, connection);
 	}
+
+	gdb_frontend_halted_reply(target, connection);
 }
 
 static int gdb_target_callback_event_handler(struct target *target,
@@ -1002,10 +1311,16 @@ static int gdb_target_callback_event_handler(struct target *target,
 {
 	struct connection *connection = priv;
 
+	/* Resume, halt, reset, ... all may change memory. */
+	rtos_memory_cache_invalidate();
+
 	/* Propagate this event if it's for any of the targets on this gdb connection. */
 	if (!gdb_connection_includes_target(connection, target))
 		return ERROR_OK;
 
+	gdb_thread_list_invalidate(connection->priv);
+	rtos_reg_cache_invalidate(get_target_from_connection(connection));
+
 	switch (event) {
 		case TARGET_EVENT_GDB_HALT:
 			gdb_frontend_halted(target, connection);
@@ -1038,6 +1353,8 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->ctrl_c = false;
 	gdb_connection->frontend_state = TARGET_HALTED;
 	gdb_connection->vflash_image = NULL;
+	memset(&gdb_connection->vflash_stream, 0, sizeof(gdb_connection->vflash_stream));
+	gdb_connection->crc_cache_count = 0;
 	gdb_connection->closed = false;
 	gdb_connection->busy = false;
 	gdb_connection->noack_mode = 0;
@@ -1045,11 +1362,14 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->mem_write_error = false;
 	gdb_connection->attached = true;
 	gdb_connection->extended_protocol = false;
-	gdb_connection->target_desc.tdesc = NULL;
-	gdb_connection->target_desc.tdesc_length = 0;
 	gdb_connection->thread_list = NULL;
 	gdb_connection->output_flag = GDB_OUTPUT_NO;
 	gdb_connection->unique_index = next_unique_id++;
+	gdb_connection->halt_target = NULL;
+	gdb_connection->non_stop = false;
+	INIT_LIST_HEAD(&gdb_connection->stop_events);
+	gdb_connection->stop_notif_sent = false;
+	gdb_connection->stop_requested = false;
 
 	/* output goes through gdb connection */
 	command_set_output_handler(connection->cmd_ctx, gdb_output, connection);
@@ -1083,6 +1403,7 @@ static int gdb_new_connection(struct connection *connection)
 
 		/* update threads */
 		rtos_update_threads(target);
+		gdb_thread_list_invalidate(connection->priv);
 	}
 
 	if (gdb_use_memory_map) {
@@ -1105,8 +1426,7 @@ static int gdb_new_connection(struct connection *connection)
 		}
 	}
 
-	log_printf_lf(all_targets->next ? LOG_LVL_INFO : LOG_LVL_DEBUG,
-			__FILE__, __LINE__, __func__,
+	LOG_CUSTOM_LEVEL(all_targets->next ? LOG_LVL_INFO : LOG_LVL_DEBUG,
 			"New GDB Connection: %d, Target %s, state: %s",
 			gdb_connection->unique_index,
 			target_name(target),
@@ -1159,6 +1479,16 @@ static int gdb_connection_closed(struct connection *connection)
 		free(gdb_connection->vflash_image);
 		gdb_connection->vflash_image = NULL;
 	}
+	free(gdb_connection->vflash_stream.data);
+
+	gdb_thread_list_invalidate(gdb_connection);
+
+	if (gdb_connection->halt_target)
+		target_unregister_timer_callback(gdb_smp_halt_timeout, connection);
+
+	/* leave the targets in all-stop mode */
+	if (gdb_connection->non_stop)
+		gdb_set_non_stop(connection, false);
 
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
@@ -1265,8 +1595,11 @@ static int gdb_get_reg_value_as_str(struct target *target, char *tstr, struct re
 {
 	int retval = ERROR_OK;
 
-	if (!reg->valid)
+	if (!reg->valid) {
+		int64_t start = perf_begin();
 		retval = reg->type->get(reg);
+		perf_end(PERF_GET_REGISTER, start, DIV_ROUND_UP(reg->size, 8));
+	}
 
 	const unsigned int len = DIV_ROUND_UP(reg->size, 8) * 2;
 	switch (retval) {
@@ -1307,6 +1640,10 @@ static int gdb_get_registers_packet(struct connection *connection,
 	if (retval != ERROR_OK)
 		return gdb_error(connection, retval);
 
+	/* Not fatal: whatever isn't fetched is read register by register below. */
+	if (target_fetch_registers(target, reg_list, reg_list_size) != ERROR_OK)
+		LOG_DEBUG("Couldn't fetch the register set in bulk.");
+
 	for (i = 0; i < reg_list_size; i++) {
 		if (!reg_list[i] || reg_list[i]->exist == false || reg_list[i]->hidden)
 			continue;
@@ -1392,7 +1729,9 @@ static int gdb_set_registers_packet(struct connection *connection,
 		bin_buf = malloc(DIV_ROUND_UP(reg_list[i]->size, 8));
 		gdb_target_to_reg(target, packet_p, chars, bin_buf);
 
+		int64_t start = perf_begin();
 		retval = reg_list[i]->type->set(reg_list[i], bin_buf);
+		perf_end(PERF_SET_REGISTER, start, DIV_ROUND_UP(reg_list[i]->size, 8));
 		if (retval != ERROR_OK && gdb_report_register_access_error) {
 			LOG_DEBUG("Couldn't set register %s.", reg_list[i]->name);
 			free(reg_list);
@@ -1519,7 +1858,9 @@ static int gdb_set_register_packet(struct connection *connection,
 
 	gdb_target_to_reg(target, separator + 1, chars, bin_buf);
 
+	int64_t start = perf_begin();
 	retval = reg_list[reg_num]->type->set(reg_list[reg_num], bin_buf);
+	perf_end(PERF_SET_REGISTER, start, DIV_ROUND_UP(reg_list[reg_num]->size, 8));
 	if (retval != ERROR_OK && gdb_report_register_access_error) {
 		LOG_DEBUG("Couldn't set register %s.", reg_list[reg_num]->name);
 		free(bin_buf);
@@ -1546,6 +1887,49 @@ static int gdb_error(struct connection *connection, int retval)
 	return ERROR_OK;
 }
 
+/* Packets that can't change target memory keep the memory cache. */
+static bool gdb_packet_keeps_memory_cache(const char *packet)
+{
+	switch (packet[0]) {
+		case 'm':
+		case 'x':
+		case 'g':
+		case 'p':
+		case '?':
+		case 'T':
+		case 'H':
+			return true;
+		case 'q':
+			/* Monitor commands can do anything. */
+			return strncmp(packet, "qRcmd,", 6) != 0;
+		default:
+			return false;
+	}
+}
+
+/* Target memory is read and written in chunks of this many bytes, with
+ * server_yield() in between, so timer callbacks keep running during large
+ * transfers. */
+#define GDB_MEMORY_CHUNK 4096
+
+/* Append "len" bytes to "out" as escaped binary data ('x' reply). Returns the
+ * number of characters written, at most 2 * len. */
+static size_t gdb_escape_binary(char *out, const uint8_t *data, size_t len)
+{
+	size_t pos = 0;
+	for (size_t i = 0; i < len; i++) {
+		const uint8_t c = data[i];
+		if (c == '#' || c == '$' || c == '}' || c == '*') {
+			out[pos++] = '}';
+			out[pos++] = c ^ 0x20;
+		} else {
+			out[pos++] = c;
+		}
+	}
+	return pos;
+}
+
+/* Handles 'm' (hex) and 'x' (binary) memory read packets. */
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -1553,9 +1937,7 @@ static int gdb_read_memory_packet(struct connection *connection,
 	char *separator;
 	uint64_t addr = 0;
 	uint32_t len = 0;
-
-	uint8_t *buffer;
-	char *hex_buffer;
+	const bool binary = packet[0] == 'x';
 
 	int retval;
 
@@ -1572,51 +1954,86 @@ static int gdb_read_memory_packet(struct connection *connection,
 	len = strtoul(separator + 1, NULL, 16);
 
 	if (!len) {
+		if (binary) {
+			/* Empty, but successful, read. */
+			gdb_put_packet(connection, "b", 1);
+			return ERROR_OK;
+		}
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, "", 0);
 		return ERROR_OK;
 	}
 
-	buffer = malloc(len);
-
 	LOG_DEBUG("addr: 0x%16.16" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-	retval = ERROR_NOT_IMPLEMENTED;
-	if (target->rtos)
-		retval = rtos_read_buffer(target, addr, len, buffer);
-	if (retval == ERROR_NOT_IMPLEMENTED)
-		retval = target_read_buffer(target, addr, len, buffer);
-
-	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
-		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
-		 * At some point this might be fixed in GDB, in which case this code can be removed.
-		 *
-		 * OpenOCD developers are acutely aware of this problem, but there is nothing
-		 * gained by involving the user in this problem that hopefully will get resolved
-		 * eventually
-		 *
-		 * http://sourceware.org/cgi-bin/gnatsweb.pl? \
-		 * cmd = view%20audit-trail&database = gdb&pr = 2395
-		 *
-		 * For now, the default is to fix up things to make current GDB versions work.
-		 * This can be overwritten using the gdb_report_data_abort <'enable'|'disable'> command.
-		 */
-		memset(buffer, 0, len);
-		retval = ERROR_OK;
+	/* Both encodings need at most two characters per byte, 'x' replies are
+	 * prefixed with 'b'. */
+	char *reply = malloc((size_t)len * 2 + 2);
+	uint8_t *chunk = malloc(MIN(len, GDB_MEMORY_CHUNK));
+	if (!reply || !chunk) {
+		LOG_ERROR("Out of memory");
+		free(reply);
+		free(chunk);
+		return gdb_error(connection, ERROR_FAIL);
 	}
 
-	if (retval == ERROR_OK) {
-		hex_buffer = malloc(len * 2 + 1);
+	size_t pos = 0;
+	if (binary)
+		reply[pos++] = 'b';
+
+	/* Read the target in chunks, appending every chunk to the reply as it
+	 * arrives, so only the encoded reply is kept in memory. */
+	retval = ERROR_OK;
+	uint32_t done = 0;
+	while (done < len) {
+		const uint32_t n = MIN(len - done, GDB_MEMORY_CHUNK);
+		retval = ERROR_NOT_IMPLEMENTED;
+		if (target->rtos)
+			retval = rtos_read_buffer(target, addr + done, n, chunk);
+		if (retval == ERROR_NOT_IMPLEMENTED)
+			retval = rtos_cached_read_buffer(target, addr + done, n, chunk);
+
+		if (retval != ERROR_OK && !gdb_report_data_abort) {
+			/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
+			 * At some point this might be fixed in GDB, in which case this code can be removed.
+			 *
+			 * OpenOCD developers are acutely aware of this problem, but there is nothing
+			 * gained by involving the user in this problem that hopefully will get resolved
+			 * eventually
+			 *
+			 * http://sourceware.org/cgi-bin/gnatsweb.pl? \
+			 * cmd = view%20audit-trail&database = gdb&pr = 2395
+			 *
+			 * For now, the default is to fix up things to make current GDB versions work.
+			 * This can be overwritten using the gdb_report_data_abort <'enable'|'disable'> command.
+			 */
+			memset(chunk, 0, n);
+			retval = ERROR_OK;
+		}
+		if (retval != ERROR_OK)
+			break;
 
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
+		if (binary)
+			pos += gdb_escape_binary(reply + pos, chunk, n);
+		else
+			pos += hexify(reply + pos, chunk, n, (size_t)len * 2 + 2 - pos);
+		done += n;
 
-		gdb_put_packet(connection, hex_buffer, pkt_len);
+		if (done < len)
+			server_yield();
+	}
 
-		free(hex_buffer);
-	} else
+	/* gdb accepts a reply with fewer bytes than requested if only part of the
+	 * memory could be read. */
+	if (retval == ERROR_OK || done > 0) {
+		gdb_put_packet(connection, reply, pos);
+		retval = ERROR_OK;
+	} else {
 		retval = gdb_error(connection, retval);
+	}
 
-	free(buffer);
+	free(chunk);
+	free(reply);
 
 	return retval;
 }
@@ -1729,11 +2146,21 @@ static int gdb_write_memory_binary_packet(struct connection *connection,
 	if (len) {
 		LOG_DEBUG("addr: 0x%" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-		retval = ERROR_NOT_IMPLEMENTED;
-		if (target->rtos)
-			retval = rtos_write_buffer(target, addr, len, (uint8_t *)separator);
-		if (retval == ERROR_NOT_IMPLEMENTED)
-			retval = target_write_buffer(target, addr, len, (uint8_t *)separator);
+		const uint8_t *data = (const uint8_t *)separator;
+		for (uint32_t done = 0; done < len; ) {
+			const uint32_t n = MIN(len - done, GDB_MEMORY_CHUNK);
+			retval = ERROR_NOT_IMPLEMENTED;
+			if (target->rtos)
+				retval = rtos_write_buffer(target, addr + done, n, data + done);
+			if (retval == ERROR_NOT_IMPLEMENTED)
+				retval = target_write_buffer(target, addr + done, n, data + done);
+			if (retval != ERROR_OK)
+				break;
+
+			done += n;
+			if (done < len)
+				server_yield();
+		}
 
 		if (retval != ERROR_OK)
 			gdb_connection->mem_write_error = true;
@@ -2606,25 +3033,135 @@ error:
 	return retval;
 }
 
-static int gdb_get_target_description_chunk(struct target *target, struct target_desc_format *target_desc,
-		char **chunk, int32_t offset, uint32_t length)
+/* Target description of a target, kept until its register layout changes. */
+struct gdb_tdesc_cache_entry {
+	struct list_head list;
+	struct target *target;
+	uint64_t layout;
+	char *tdesc;
+	uint32_t tdesc_length;
+};
+
+static LIST_HEAD(gdb_tdesc_cache);
+
+static uint64_t fnv1a_add(uint64_t hash, const void *data, size_t size)
 {
-	if (!target_desc) {
-		LOG_ERROR("Unable to Generate Target Description");
-		return ERROR_FAIL;
+	const uint8_t *p = data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+static uint64_t fnv1a_add_str(uint64_t hash, const char *str)
+{
+	return str ? fnv1a_add(hash, str, strlen(str) + 1) : fnv1a_add(hash, "", 1);
+}
+
+/* Fingerprint everything of the register list that ends up in the target
+ * description. This is much cheaper than generating the description. */
+static int gdb_reg_layout_fingerprint(struct target *target, uint64_t *layout)
+{
+	struct reg **reg_list = NULL;
+	int reg_list_size;
+	int retval = smp_reg_list_noread(target, &reg_list, &reg_list_size,
+			REG_CLASS_ALL);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hash = fnv1a_add_str(hash, target_get_gdb_arch(target));
+	hash = fnv1a_add(hash, &reg_list_size, sizeof(reg_list_size));
+	for (int i = 0; i < reg_list_size; i++) {
+		const struct reg *reg = reg_list[i];
+		const bool visible = reg->exist && !reg->hidden;
+		hash = fnv1a_add(hash, &visible, sizeof(visible));
+		if (!visible)
+			continue;
+		hash = fnv1a_add_str(hash, reg->name);
+		hash = fnv1a_add(hash, &reg->number, sizeof(reg->number));
+		hash = fnv1a_add(hash, &reg->size, sizeof(reg->size));
+		hash = fnv1a_add(hash, &reg->caller_save, sizeof(reg->caller_save));
+		hash = fnv1a_add_str(hash, reg->group);
+		hash = fnv1a_add_str(hash, reg->feature ? reg->feature->name : NULL);
+		hash = fnv1a_add(hash, &reg->reg_data_type, sizeof(reg->reg_data_type));
+		hash = fnv1a_add_str(hash, reg->reg_data_type ? reg->reg_data_type->id : NULL);
 	}
+	free(reg_list);
 
-	char *tdesc = target_desc->tdesc;
-	uint32_t tdesc_length = target_desc->tdesc_length;
+	*layout = hash;
+	return ERROR_OK;
+}
 
-	if (!tdesc) {
-		int retval = gdb_generate_target_description(target, &tdesc);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Unable to Generate Target Description");
-			return ERROR_FAIL;
+/* Return the cached target description of "target". On the first chunk
+ * ("revalidate") check that the register layout is still the same, and
+ * regenerate the description otherwise. */
+static struct gdb_tdesc_cache_entry *gdb_cached_target_description(struct target *target,
+		bool revalidate)
+{
+	struct gdb_tdesc_cache_entry *entry = NULL, *candidate;
+	list_for_each_entry(candidate, &gdb_tdesc_cache, list) {
+		if (candidate->target == target) {
+			entry = candidate;
+			break;
+		}
+	}
+	const bool found = entry;
+	if (found && !revalidate)
+		return entry;
+
+	uint64_t layout;
+	if (gdb_reg_layout_fingerprint(target, &layout) != ERROR_OK)
+		return NULL;
+	if (found && entry->tdesc && entry->layout == layout)
+		return entry;
+
+	if (!found) {
+		entry = calloc(1, sizeof(*entry));
+		if (!entry) {
+			LOG_ERROR("Unable to allocate memory");
+			return NULL;
 		}
+		entry->target = target;
+		list_add(&entry->list, &gdb_tdesc_cache);
+	}
+
+	free(entry->tdesc);
+	entry->tdesc = NULL;
+	entry->tdesc_length = 0;
+	if (gdb_generate_target_description(target, &entry->tdesc) != ERROR_OK)
+		return NULL;
+	entry->tdesc_length = strlen(entry->tdesc);
+	entry->layout = layout;
+	LOG_TARGET_DEBUG(target, "Generated %" PRIu32 " bytes of target description.",
+			entry->tdesc_length);
+	return entry;
+}
 
-		tdesc_length = strlen(tdesc);
+static void gdb_free_target_description_cache(void)
+{
+	struct gdb_tdesc_cache_entry *entry, *tmp;
+	list_for_each_entry_safe(entry, tmp, &gdb_tdesc_cache, list) {
+		list_del(&entry->list);
+		free(entry->tdesc);
+		free(entry);
+	}
+}
+
+static int gdb_get_target_description_chunk(struct target *target,
+		char **chunk, int32_t offset, uint32_t length)
+{
+	const struct gdb_tdesc_cache_entry *entry =
+		gdb_cached_target_description(target, offset == 0);
+	if (!entry || !entry->tdesc) {
+		LOG_ERROR("Unable to Generate Target Description");
+		return ERROR_FAIL;
+	}
+
+	const char *tdesc = entry->tdesc;
+	uint32_t tdesc_length = entry->tdesc_length;
+	if (offset < 0 || (uint32_t)offset > tdesc_length) {
+		LOG_ERROR("Target description offset out of range");
+		return ERROR_FAIL;
 	}
 
 	char transfer_type;
@@ -2647,16 +3184,8 @@ static int gdb_get_target_description_chunk(struct target *target, struct target
 	} else {
 		strncpy((*chunk) + 1, tdesc + offset, tdesc_length - offset);
 		(*chunk)[1 + (tdesc_length - offset)] = '\0';
-
-		/* After gdb-server sends out last chunk, invalidate tdesc. */
-		free(tdesc);
-		tdesc = NULL;
-		tdesc_length = 0;
 	}
 
-	target_desc->tdesc = tdesc;
-	target_desc->tdesc_length = tdesc_length;
-
 	return ERROR_OK;
 }
 
@@ -2776,6 +3305,11 @@ static int gdb_get_thread_list_chunk(struct target *target, char **thread_list,
 	size_t thread_list_length = strlen(*thread_list);
 	char transfer_type;
 
+	if (offset < 0 || (size_t)offset > thread_list_length) {
+		LOG_ERROR("Thread list offset %" PRId32 " out of range", offset);
+		return ERROR_FAIL;
+	}
+
 	length = MIN(length, thread_list_length - offset);
 	if (length < (thread_list_length - offset))
 		transfer_type = 'm';
@@ -2796,12 +3330,80 @@ static int gdb_get_thread_list_chunk(struct target *target, char **thread_list,
 	strncpy((*chunk) + 1, (*thread_list) + offset, length);
 	(*chunk)[1 + length] = '\0';
 
-	/* After gdb-server sends out last chunk, invalidate thread list. */
-	if (transfer_type == 'l') {
-		free(*thread_list);
-		*thread_list = NULL;
+	/* The snapshot is kept after the last chunk: gdb may read the list
+	 * again before the next stop, and the thread details cannot change
+	 * until then. It is dropped by gdb_thread_list_invalidate(). */
+
+	return ERROR_OK;
+}
+
+/* Checksum memory for qCRC. Every region asked for is remembered, gdb asks
+ * for the same ones again on the next compare-sections. On a miss all the
+ * regions that may have changed are checksummed with one algorithm run, so
+ * the following requests are answered from the cache. */
+static int gdb_crc_checksum(struct connection *connection, struct target *target,
+		target_addr_t addr, uint32_t len, uint32_t *checksum)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct gdb_crc_entry *entry = NULL;
+
+	for (unsigned int i = 0; i < gdb_connection->crc_cache_count && !entry; i++) {
+		if (gdb_connection->crc_cache[i].address == addr &&
+				gdb_connection->crc_cache[i].size == len)
+			entry = &gdb_connection->crc_cache[i];
+	}
+	if (!entry && gdb_connection->crc_cache_count < GDB_CRC_CACHE_SIZE) {
+		entry = &gdb_connection->crc_cache[gdb_connection->crc_cache_count++];
+		entry->address = addr;
+		entry->size = len;
+		entry->stamp = 0;
 	}
 
+	const unsigned int stamp = rtos_memory_cache_stamp(target, addr, len);
+	if (entry && stamp && entry->stamp == stamp) {
+		LOG_DEBUG("qCRC of " TARGET_ADDR_FMT " from cache", addr);
+		*checksum = entry->crc;
+		return ERROR_OK;
+	}
+	if (!entry || !stamp)
+		return target_checksum_memory(target, addr, len, checksum);
+
+	struct target_memory_checksum_block *blocks =
+		calloc(gdb_connection->crc_cache_count, sizeof(*blocks));
+	struct gdb_crc_entry **entries =
+		calloc(gdb_connection->crc_cache_count, sizeof(*entries));
+	int retval = ERROR_FAIL;
+	if (blocks && entries) {
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < gdb_connection->crc_cache_count; i++) {
+			struct gdb_crc_entry *e = &gdb_connection->crc_cache[i];
+			unsigned int s = rtos_memory_cache_stamp(target, e->address, e->size);
+			if (e != entry && (!s || e->stamp == s))
+				continue;
+			blocks[count].address = e->address;
+			blocks[count].size = e->size;
+			entries[count++] = e;
+		}
+		LOG_DEBUG("checksumming %u regions for qCRC", count);
+		retval = target_checksum_memory_list(target, blocks, count);
+		if (retval == ERROR_OK) {
+			/* the algorithm run itself bumps the stamp */
+			for (unsigned int i = 0; i < count; i++) {
+				entries[i]->crc = blocks[i].checksum;
+				entries[i]->stamp = rtos_memory_cache_stamp(target,
+						entries[i]->address, entries[i]->size);
+			}
+			*checksum = entry->crc;
+		}
+	}
+	free(blocks);
+	free(entries);
+
+	/* a region remembered from before may not be readable anymore */
+	if (retval != ERROR_OK) {
+		entry->stamp = 0;
+		return target_checksum_memory(target, addr, len, checksum);
+	}
 	return ERROR_OK;
 }
 
@@ -2909,7 +3511,7 @@ static int gdb_query_packet(struct connection *connection,
 			len = strtoul(separator + 1, NULL, 16);
 
 			gdb_connection->output_flag = GDB_OUTPUT_NOTIF;
-			retval = target_checksum_memory(target, addr, len, &checksum);
+			retval = gdb_crc_checksum(connection, target, addr, len, &checksum);
 			gdb_connection->output_flag = GDB_OUTPUT_NO;
 
 			if (retval == ERROR_OK) {
@@ -2950,8 +3552,8 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+",
-			GDB_BUFFER_SIZE,
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;QNonStop+;vContSupported+;binary-upload+",
+			gdb_packet_size,
 			(gdb_use_memory_map && (flash_get_bank_count() > 0)) ? '+' : '-',
 			gdb_target_desc_supported ? '+' : '-');
 
@@ -2987,8 +3589,7 @@ static int gdb_query_packet(struct connection *connection,
 		 * there are *more* chunks to transfer. 'l' for it is the *last*
 		 * chunk of target description.
 		 */
-		retval = gdb_get_target_description_chunk(target, &gdb_connection->target_desc,
-				&xml, offset, length);
+		retval = gdb_get_target_description_chunk(target, &xml, offset, length);
 		if (retval != ERROR_OK) {
 			gdb_error(connection, retval);
 			return retval;
@@ -3033,6 +3634,11 @@ static int gdb_query_packet(struct connection *connection,
 		gdb_connection->noack_mode = 1;
 		gdb_put_packet(connection, "OK", 2);
 		return ERROR_OK;
+	} else if (strncmp(packet, "QNonStop:", 9) == 0) {
+		gdb_set_non_stop(connection, packet[9] == '1');
+		LOG_DEBUG("gdb %s non-stop mode", gdb_connection->non_stop ? "enabled" : "disabled");
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
 	} else if (target->type->gdb_query_custom) {
 		char *buffer = NULL;
 		int ret = target->type->gdb_query_custom(target, packet, &buffer);
@@ -3044,6 +3650,129 @@ static int gdb_query_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
+/* Apply one vCont action to one target in non-stop mode. */
+static void gdb_vcont_non_stop_action(struct connection *connection, struct target *target,
+		char action)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	int retval = ERROR_OK;
+
+	switch (action) {
+		case 'c':
+		case 'C':
+		case 's':
+		case 'S':
+			if (target->state != TARGET_HALTED)
+				return;
+			gdb_non_stop_resumed(gdb_connection, target);
+			target_call_event_callbacks(target, TARGET_EVENT_GDB_START);
+			/* the halt after the step is notified like any other */
+			if (action == 'c' || action == 'C')
+				retval = target_resume(target, 1, 0, 0, 0);
+			else
+				retval = target_step(target, 1, 0, 0);
+			break;
+		case 't':
+			if (target->state != TARGET_RUNNING)
+				return;
+			gdb_connection->stop_requested = true;
+			retval = target_halt(target);
+			if (retval == ERROR_OK)
+				retval = target_poll(target);
+			gdb_connection->stop_requested = false;
+			break;
+	}
+
+	if (retval != ERROR_OK)
+		LOG_TARGET_DEBUG(target, "vCont;%c failed", action);
+}
+
+/* vCont in non-stop mode: reply right away, the targets that halt are
+ * notified later. An action without thread id applies to all the threads
+ * no earlier action of the packet named. */
+static bool gdb_handle_vcont_non_stop(struct connection *connection, const char *parse)
+{
+	struct target *target = get_target_from_connection(connection);
+	struct list_head *targets = NULL;
+	unsigned int num_targets = 1;
+	struct target_list *tlist;
+
+	if (target->smp) {
+		targets = target->smp_targets;
+		num_targets = 0;
+		foreach_smp_target(tlist, targets)
+			num_targets++;
+	}
+
+	struct target **named = calloc(num_targets, sizeof(*named));
+	if (!named) {
+		LOG_ERROR("Out of memory");
+		return false;
+	}
+
+	char actions[32];
+	int64_t thread_ids[32];
+	unsigned int num_actions = 0;
+	while (*parse == ';' && num_actions < ARRAY_SIZE(actions)) {
+		parse++;
+		char action = *parse++;
+		if (!strchr("cCsSt", action)) {
+			free(named);
+			return false;
+		}
+		char *end;
+		/* signals aren't delivered */
+		if (action == 'C' || action == 'S') {
+			strtoul(parse, &end, 16);
+			parse = end;
+		}
+		int64_t thread_id = -1;
+		if (*parse == ':') {
+			thread_id = strtoll(parse + 1, &end, 16);
+			parse = end;
+		}
+		actions[num_actions] = action;
+		thread_ids[num_actions++] = thread_id;
+	}
+
+	gdb_put_packet(connection, "OK", 2);
+
+	unsigned int num_named = 0;
+	for (unsigned int i = 0; i < num_actions; i++) {
+		if (thread_ids[i] > 0) {
+			struct target *ct = target;
+			if (target->rtos)
+				target->rtos->gdb_target_for_threadid(connection, thread_ids[i], &ct);
+			bool done = false;
+			for (unsigned int j = 0; j < num_named && !done; j++)
+				done = named[j] == ct;
+			if (done || num_named == num_targets)
+				continue;
+			named[num_named++] = ct;
+			gdb_vcont_non_stop_action(connection, ct, actions[i]);
+			continue;
+		}
+
+		if (!targets) {
+			if (!num_named)
+				gdb_vcont_non_stop_action(connection, target, actions[i]);
+			num_named = num_targets;
+			continue;
+		}
+		foreach_smp_target(tlist, targets) {
+			bool done = false;
+			for (unsigned int j = 0; j < num_named && !done; j++)
+				done = named[j] == tlist->target;
+			if (!done)
+				gdb_vcont_non_stop_action(connection, tlist->target, actions[i]);
+		}
+		num_named = num_targets;
+	}
+
+	free(named);
+	return true;
+}
+
 static bool gdb_handle_vcont_packet(struct connection *connection, const char *packet,
 	__attribute__((unused)) int packet_size)
 {
@@ -3056,12 +3785,18 @@ static bool gdb_handle_vcont_packet(struct connection *connection, const char *p
 	if (parse[0] == '?') {
 		if (target->type->step) {
 			/* gdb doesn't accept c without C and s without S */
-			gdb_put_packet(connection, "vCont;c;C;s;S", 13);
+			if (gdb_connection->non_stop)
+				gdb_put_packet(connection, "vCont;c;C;s;S;t", 15);
+			else
+				gdb_put_packet(connection, "vCont;c;C;s;S", 13);
 			return true;
 		}
 		return false;
 	}
 
+	if (gdb_connection->non_stop)
+		return gdb_handle_vcont_non_stop(connection, parse);
+
 	if (parse[0] == ';') {
 		++parse;
 	}
@@ -3345,6 +4080,153 @@ static bool gdb_handle_vrun_packet(struct connection *connection, const char *pa
 	return true;
 }
 
+/* End of the sector of "bank" containing "addr", 0 if there is none. */
+static target_addr_t gdb_vflash_sector_end(struct flash_bank *bank, target_addr_t addr)
+{
+	for (unsigned int i = 0; i < bank->num_sectors; i++) {
+		target_addr_t end = bank->base + bank->sectors[i].offset + bank->sectors[i].size;
+		if (addr >= bank->base + bank->sectors[i].offset && addr < end)
+			return end;
+	}
+	return 0;
+}
+
+/* Program the first "count" buffered bytes and drop them from the buffer. */
+static int gdb_vflash_stream_flush(struct connection *connection, uint32_t count)
+{
+	struct gdb_vflash_stream *stream = &((struct gdb_connection *)connection->priv)->vflash_stream;
+	struct target *target = get_available_target_from_connection(connection);
+
+	if (!count)
+		return ERROR_OK;
+
+	struct image image;
+	int retval = image_open(&image, "", "build");
+	if (retval != ERROR_OK)
+		return retval;
+	retval = image_add_section(&image, stream->address, count, 0x0, stream->data);
+	if (retval == ERROR_OK) {
+		if (!stream->started) {
+			target_call_event_callbacks(target, TARGET_EVENT_GDB_FLASH_WRITE_START);
+			stream->started = true;
+		}
+		uint32_t written;
+		retval = flash_write(target, &image, &written, false);
+		LOG_DEBUG("streamed %" PRIu32 " bytes at " TARGET_ADDR_FMT " to flash",
+				count, stream->address);
+	}
+	image_close(&image);
+	if (retval != ERROR_OK)
+		return retval;
+
+	stream->size -= count;
+	stream->address += count;
+	memmove(stream->data, stream->data + count, stream->size);
+	if (!stream->size)
+		stream->bank = NULL;
+	return ERROR_OK;
+}
+
+/* Buffer vFlashWrite data and program the sectors complete so far, while gdb
+ * sends the next ones. gdb erases all the regions first and then sends the
+ * data in order, so a sector is complete as soon as data past its end
+ * arrives. Returns ERROR_NOT_IMPLEMENTED if the data goes back to an address
+ * that may have been programmed already, the caller collects the rest in
+ * the vFlash image then. */
+static int gdb_vflash_stream_write(struct connection *connection, target_addr_t addr,
+		const uint8_t *data, uint32_t length)
+{
+	struct gdb_vflash_stream *stream = &((struct gdb_connection *)connection->priv)->vflash_stream;
+	struct target *target = get_available_target_from_connection(connection);
+	int retval;
+
+	if (stream->bank) {
+		const target_addr_t end = stream->address + stream->size;
+		if (addr < end)
+			return ERROR_NOT_IMPLEMENTED;
+		/* The buffered sector is complete if the data goes on in
+		 * another one, else the gap is padded like flash_write() does. */
+		const target_addr_t sector_end = gdb_vflash_sector_end(stream->bank, end - 1);
+		if (addr >= sector_end) {
+			retval = gdb_vflash_stream_flush(connection, stream->size);
+			if (retval != ERROR_OK)
+				return retval;
+		} else if (addr > end) {
+			uint8_t *buf = realloc(stream->data, addr - stream->address);
+			if (!buf)
+				return ERROR_FAIL;
+			memset(buf + stream->size, stream->bank->default_padded_value, addr - end);
+			stream->data = buf;
+			stream->size = addr - stream->address;
+		}
+	}
+
+	if (!stream->bank) {
+		struct flash_bank *bank;
+		retval = get_flash_bank_by_addr(target, addr, true, &bank);
+		if (retval != ERROR_OK)
+			return retval;
+		if (!bank || !bank->num_sectors)
+			return ERROR_NOT_IMPLEMENTED;
+		stream->bank = bank;
+		stream->address = addr;
+	}
+
+	/* The rest of the data goes to the next bank, if any */
+	const target_addr_t bank_end = stream->bank->base + stream->bank->size;
+	const uint32_t n = MIN(length, bank_end - addr);
+	uint8_t *buf = realloc(stream->data, stream->size + n);
+	if (!buf)
+		return ERROR_FAIL;
+	memcpy(buf + stream->size, data, n);
+	stream->data = buf;
+	stream->size += n;
+
+	if (n < length) {
+		retval = gdb_vflash_stream_flush(connection, stream->size);
+		if (retval != ERROR_OK)
+			return retval;
+		return gdb_vflash_stream_write(connection, addr + n, data + n, length - n);
+	}
+
+	/* Program the complete sectors, once there are enough of them to
+	 * make up for the overhead of a flash write */
+	const target_addr_t end = stream->address + stream->size;
+	target_addr_t complete = stream->address;
+	for (target_addr_t a = stream->address; a < end; ) {
+		const target_addr_t sector_end = gdb_vflash_sector_end(stream->bank, a);
+		if (!sector_end || sector_end > end)
+			break;
+		complete = sector_end;
+		a = sector_end;
+	}
+	if (complete - stream->address < GDB_VFLASH_STREAM_CHUNK)
+		return ERROR_OK;
+	return gdb_vflash_stream_flush(connection, complete - stream->address);
+}
+
+/* Move the data gdb_vflash_stream_write() didn't program yet to the vFlash
+ * image. */
+static int gdb_vflash_stream_to_image(struct gdb_connection *gdb_connection)
+{
+	struct gdb_vflash_stream *stream = &gdb_connection->vflash_stream;
+	int retval = ERROR_OK;
+
+	if (stream->size) {
+		if (!gdb_connection->vflash_image) {
+			gdb_connection->vflash_image = malloc(sizeof(struct image));
+			image_open(gdb_connection->vflash_image, "", "build");
+		}
+		retval = image_add_section(gdb_connection->vflash_image,
+				stream->address, stream->size, 0x0, stream->data);
+	}
+	free(stream->data);
+	stream->data = NULL;
+	stream->size = 0;
+	stream->bank = NULL;
+	return retval;
+}
+
 static int gdb_v_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -3353,6 +4235,11 @@ static int gdb_v_packet(struct connection *connection,
 
 	struct target *target = get_available_target_from_connection(connection);
 
+	if (strncmp(packet, "vStopped", 8) == 0) {
+		gdb_vstopped_packet(connection);
+		return ERROR_OK;
+	}
+
 	if (strncmp(packet, "vCont", 5) == 0) {
 		bool handled;
 
@@ -3457,6 +4344,29 @@ static int gdb_v_packet(struct connection *connection,
 		}
 		length = packet_size - (parse - packet);
 
+		if (gdb_flash_stream && !gdb_connection->vflash_image) {
+			retval = gdb_vflash_stream_write(connection, addr,
+					(const uint8_t *)parse, length);
+			if (retval == ERROR_OK) {
+				gdb_put_packet(connection, "OK", 2);
+				return ERROR_OK;
+			}
+			if (retval != ERROR_NOT_IMPLEMENTED) {
+				/* gdb gives up the load */
+				free(gdb_connection->vflash_stream.data);
+				memset(&gdb_connection->vflash_stream, 0,
+						sizeof(gdb_connection->vflash_stream));
+				if (retval == ERROR_FLASH_DST_OUT_OF_BANK)
+					gdb_put_packet(connection, "E.memtype", 9);
+				else
+					gdb_send_error(connection, EIO);
+				return ERROR_OK;
+			}
+			retval = gdb_vflash_stream_to_image(gdb_connection);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+
 		/* create a new image if there isn't already one */
 		if (!gdb_connection->vflash_image) {
 			gdb_connection->vflash_image = malloc(sizeof(struct image));
@@ -3477,17 +4387,28 @@ static int gdb_v_packet(struct connection *connection,
 	if (strncmp(packet, "vFlashDone", 10) == 0) {
 		uint32_t written;
 
+		/* the sectors not streamed yet are written with the image */
+		bool streamed = gdb_connection->vflash_stream.started;
+		gdb_connection->vflash_stream.started = false;
+		result = gdb_vflash_stream_to_image(gdb_connection);
+		if (result != ERROR_OK)
+			return result;
+
 		/* GDB command 'flash-erase' does not send a vFlashWrite,
 		 * so nothing to write here. */
 		if (!gdb_connection->vflash_image) {
+			if (streamed)
+				target_call_event_callbacks(target,
+					TARGET_EVENT_GDB_FLASH_WRITE_END);
 			gdb_put_packet(connection, "OK", 2);
 			return ERROR_OK;
 		}
 
 		/* process the flashing buffer. No need to erase as GDB
 		 * always issues a vFlashErase first. */
-		target_call_event_callbacks(target,
-				TARGET_EVENT_GDB_FLASH_WRITE_START);
+		if (!streamed)
+			target_call_event_callbacks(target,
+					TARGET_EVENT_GDB_FLASH_WRITE_START);
 		result = flash_write(target, gdb_connection->vflash_image,
 			&written, false);
 		target_call_event_callbacks(target,
@@ -3599,11 +4520,8 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
-
 	struct target *target;
-	char const *packet = gdb_packet_buffer;
+	char const *packet;
 	int packet_size;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
@@ -3611,6 +4529,16 @@ static int gdb_input_inner(struct connection *connection)
 
 	target = get_target_from_connection(connection);
 
+	/* Do not allocate this on the stack */
+	if (!gdb_packet_buffer) {
+		gdb_packet_buffer = malloc(gdb_packet_size + 1); /* Extra byte for null-termination */
+		if (!gdb_packet_buffer) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
+	packet = gdb_packet_buffer;
+
 	/* drain input buffer. If one of the packets fail, then an error
 	 * packet is replied, if applicable.
 	 *
@@ -3623,7 +4551,7 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE;
+		packet_size = gdb_packet_size;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
@@ -3635,6 +4563,12 @@ static int gdb_input_inner(struct connection *connection)
 
 			gdb_log_incoming_packet(connection, gdb_packet_buffer);
 
+			if (!gdb_packet_keeps_memory_cache(packet)) {
+				rtos_memory_cache_invalidate();
+				gdb_thread_list_invalidate(gdb_con);
+				rtos_reg_cache_invalidate(get_target_from_connection(connection));
+			}
+
 			retval = ERROR_OK;
 			switch (packet[0]) {
 				case 'T':	/* Is thread alive? */
@@ -3663,6 +4597,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					gdb_con->output_flag = GDB_OUTPUT_NOTIF;
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					gdb_con->output_flag = GDB_OUTPUT_NO;
@@ -3677,7 +4612,10 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_breakpoint_watchpoint_packet(connection, packet, packet_size);
 					break;
 				case '?':
-					gdb_last_signal_packet(connection, packet, packet_size);
+					if (gdb_con->non_stop)
+						gdb_non_stop_status(connection);
+					else
+						gdb_last_signal_packet(connection, packet, packet_size);
 					/* '?' is sent after the eventual '!' */
 					if (!warn_use_ext && !gdb_con->extended_protocol) {
 						warn_use_ext = true;
@@ -3879,19 +4817,10 @@ static int gdb_input(struct connection *connection)
 static void gdb_async_notif(struct connection *connection)
 {
 	static unsigned char count;
-	unsigned char checksum = 0;
-	char buf[22];
-
-	int len = sprintf(buf, "%%oocd_keepalive:%2.2x", count++);
-	for (int i = 1; i < len; i++)
-		checksum += buf[i];
-	len += sprintf(buf + len, "#%2.2x", checksum);
+	char buf[18];
 
-#ifdef _DEBUG_GDB_IO_
-	LOG_DEBUG("sending packet '%s'", buf);
-#endif
-
-	gdb_write(connection, buf, len);
+	sprintf(buf, "oocd_keepalive:%2.2x", count++);
+	gdb_put_notification(connection, buf);
 }
 
 static void gdb_keep_client_alive(struct connection *connection)
@@ -3922,6 +4851,7 @@ static const struct service_driver gdb_service_driver = {
 	.input_handler = gdb_input,
 	.connection_closed_handler = gdb_connection_closed,
 	.keep_client_alive_handler = gdb_keep_client_alive,
+	.buffered_output = true,
 };
 
 static int gdb_target_start(struct target *target, const char *port)
@@ -4072,6 +5002,15 @@ COMMAND_HANDLER(handle_gdb_flash_program_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_flash_stream_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ENABLE(CMD_ARGV[0], gdb_flash_stream);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 {
 	if (CMD_ARGC != 1)
@@ -4081,6 +5020,29 @@ COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%u", gdb_packet_size);
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+	if (size < GDB_PACKET_SIZE_MIN || size > GDB_PACKET_SIZE_MAX) {
+		command_print(CMD, "packet size must be between %u and %u bytes",
+				GDB_PACKET_SIZE_MIN, GDB_PACKET_SIZE_MAX);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	gdb_packet_size = size;
+	free(gdb_packet_buffer);
+	gdb_packet_buffer = NULL;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_register_access_error)
 {
 	if (CMD_ARGC != 1)
@@ -4204,6 +5166,14 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable flash program",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_flash_stream",
+		.handler = handle_gdb_flash_stream_command,
+		.mode = COMMAND_ANY,
+		.help = "enable or disable programming flash while gdb "
+			"still sends the data",
+		.usage = "('enable'|'disable')"
+	},
 	{
 		.name = "gdb_report_data_abort",
 		.handler = handle_gdb_report_data_abort_command,
@@ -4211,6 +5181,16 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting data aborts",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Display or set the largest packet size advertised to gdb",
+		.usage = "[bytes]"
+	},
+	{
+		.chain = rtos_memory_cache_command_handlers,
+	},
 	{
 		.name = "gdb_report_register_access_error",
 		.handler = handle_gdb_report_register_access_error,
@@ -4254,6 +5234,12 @@ void gdb_service_free(void)
 {
 	free(gdb_port);
 	free(gdb_port_next);
+	free(gdb_packet_buffer);
+	gdb_packet_buffer = NULL;
+
+	gdb_free_target_description_cache();
+
+	rtos_memory_cache_free();
 }
 
 int gdb_get_actual_connections(void)
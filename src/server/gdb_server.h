@@ -23,6 +23,9 @@ struct reg;
 #include <server/server.h>
 
 #define GDB_BUFFER_SIZE 16384
+/* Limits of the packet size advertised to gdb ("gdb_packet_size"). */
+#define GDB_PACKET_SIZE_MIN 1024
+#define GDB_PACKET_SIZE_MAX (1024 * 1024)
 
 int gdb_target_add_all(struct target *target);
 int gdb_register_commands(struct command_context *command_context);
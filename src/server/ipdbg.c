@@ -24,6 +24,7 @@
 #define IPDBG_MAX_DR_LENGTH 13
 #define IPDBG_TCP_PORT_STR_MAX_LENGTH 6
 #define IPDBG_SCRATCH_MEMORY_SIZE 1024
+#define IPDBG_MAX_UP_BATCHES_PER_POLL 16
 
 /* private connection data for IPDBG */
 struct ipdbg_fifo {
@@ -446,8 +447,10 @@ static void ipdbg_check_for_xoff(struct ipdbg_hub *hub, size_t tool,
 	hub->last_dn_tool = tool;
 }
 
-static int ipdbg_shift_empty_data(struct ipdbg_hub *hub)
+static int ipdbg_shift_empty_data(struct ipdbg_hub *hub, size_t *num_valid)
 {
+	*num_valid = 0;
+
 	if (!hub)
 		return ERROR_FAIL;
 
@@ -473,6 +476,8 @@ static int ipdbg_shift_empty_data(struct ipdbg_hub *hub)
 			up_data = buf_get_u32(hub->scratch_memory.dr_in_vals +
 									i * dreg_buffer_size, 0,
 									hub->data_register_length);
+			if (up_data & hub->valid_mask)
+				(*num_valid)++;
 			int rv = ipdbg_distribute_data_from_hub(hub, up_data);
 			if (rv != ERROR_OK)
 				retval = rv;
@@ -589,10 +594,17 @@ static int ipdbg_polling_callback(void *priv)
 		}
 	}
 
-	/* some transfers to get data from jtag-hub in case there is no dn data */
-	ret = ipdbg_shift_empty_data(hub);
-	if (ret != ERROR_OK)
-		return ret;
+	/* some transfers to get data from jtag-hub in case there is no dn data.
+	   As long as every one of them returns data the hub likely has more,
+	   so fetch it now instead of a polling period later. */
+	for (unsigned int i = 0; i < IPDBG_MAX_UP_BATCHES_PER_POLL; ++i) {
+		size_t num_valid;
+		ret = ipdbg_shift_empty_data(hub, &num_valid);
+		if (ret != ERROR_OK)
+			return ret;
+		if (num_valid < hub->using_queue_size)
+			break;
+	}
 
 	/* write from up fifos to sockets */
 	for (size_t tool = 0; tool < hub->max_tools; ++tool) {
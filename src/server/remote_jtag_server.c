@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/**
+ * @file
+ *
+ * remote_jtag server.
+ *
+ * Runs the JTAG queues sent by the remote_jtag adapter driver of another
+ * OpenOCD through the local adapter, see jtag/remote_jtag.h. The operations
+ * are queued with the low level interface_jtag_add_*() functions, which take
+ * the scans and states as they are instead of going through the TAP
+ * definitions, so this OpenOCD doesn't need to know about the target.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/replacements.h>
+#include <helper/time_support.h>
+#include <jtag/adapter.h>
+#include <jtag/interface.h>
+#include <jtag/minidriver.h>
+#include <jtag/remote_jtag.h>
+#include <transport/transport.h>
+
+#include "server.h"
+#include "remote_jtag_server.h"
+
+extern struct adapter_driver *adapter_driver;
+
+struct remote_jtag_connection {
+	/* frames received so far, the first one possibly incomplete */
+	uint8_t *buf;
+	size_t size;
+	size_t used;
+};
+
+struct remote_jtag_reader {
+	const uint8_t *data;
+	size_t left;
+	bool error;
+};
+
+static const uint8_t *remote_jtag_get(struct remote_jtag_reader *r, size_t length)
+{
+	if (r->error || length > r->left) {
+		r->error = true;
+		return NULL;
+	}
+	const uint8_t *data = r->data;
+	r->data += length;
+	r->left -= length;
+	return data;
+}
+
+static unsigned int remote_jtag_get_u8(struct remote_jtag_reader *r)
+{
+	const uint8_t *data = remote_jtag_get(r, 1);
+	return data ? *data : 0;
+}
+
+static uint32_t remote_jtag_get_u32(struct remote_jtag_reader *r)
+{
+	const uint8_t *data = remote_jtag_get(r, 4);
+	return data ? le_to_h_u32(data) : 0;
+}
+
+static tap_state_t remote_jtag_get_state(struct remote_jtag_reader *r, bool stable)
+{
+	unsigned int state = remote_jtag_get_u8(r);
+	if (state > TAP_IRUPDATE || (stable && !tap_is_state_stable(state))) {
+		r->error = true;
+		return TAP_RESET;
+	}
+	return state;
+}
+
+/* Bit strings of up to num_bits, num_bits itself has to fit into an int */
+static const uint8_t *remote_jtag_get_bits(struct remote_jtag_reader *r, uint32_t num_bits)
+{
+	if (num_bits == 0 || num_bits > INT_MAX) {
+		r->error = true;
+		return NULL;
+	}
+	return remote_jtag_get(r, DIV_ROUND_UP(num_bits, 8));
+}
+
+static int remote_jtag_flush(int retval)
+{
+	int flushed = jtag_execute_queue();
+	return retval != ERROR_OK ? retval : flushed;
+}
+
+/*
+ * Walk the operations of a request. Without "captured" only check them and
+ * add up the size of the captured bits, else queue and run them, the
+ * captured bits go to "captured".
+ */
+static int remote_jtag_walk(const uint8_t *request, size_t length, uint8_t *captured,
+		size_t *captured_length)
+{
+	struct remote_jtag_reader r = { .data = request, .left = length, .error = false };
+	const bool run = captured;
+	size_t offset = 0;
+	int retval = ERROR_OK;
+
+	while (r.left > 0 && !r.error) {
+		unsigned int op = remote_jtag_get_u8(&r);
+		switch (op) {
+		case REMOTE_JTAG_OP_SCAN: {
+			unsigned int flags = remote_jtag_get_u8(&r);
+			tap_state_t end_state = remote_jtag_get_state(&r, true);
+			uint32_t num_bits = remote_jtag_get_u32(&r);
+			const uint8_t *bits = remote_jtag_get_bits(&r, num_bits);
+			uint8_t *in_bits = NULL;
+			if (flags & REMOTE_JTAG_SCAN_CAPTURE) {
+				if (run)
+					in_bits = captured + offset;
+				offset += DIV_ROUND_UP(num_bits, 8);
+			}
+			if (!run || r.error)
+				break;
+			if (flags & REMOTE_JTAG_SCAN_IR)
+				jtag_set_error(interface_jtag_add_plain_ir_scan(num_bits, bits,
+						in_bits, end_state));
+			else
+				jtag_set_error(interface_jtag_add_plain_dr_scan(num_bits, bits,
+						in_bits, end_state));
+			break;
+		}
+		case REMOTE_JTAG_OP_TLR:
+			if (run)
+				jtag_set_error(interface_jtag_add_tlr());
+			break;
+		case REMOTE_JTAG_OP_RUNTEST: {
+			uint32_t num_cycles = remote_jtag_get_u32(&r);
+			tap_state_t end_state = remote_jtag_get_state(&r, true);
+			if (num_cycles > INT_MAX)
+				r.error = true;
+			if (run && !r.error)
+				jtag_set_error(interface_jtag_add_runtest(num_cycles, end_state));
+			break;
+		}
+		case REMOTE_JTAG_OP_RESET: {
+			int trst = remote_jtag_get_u8(&r);
+			int srst = remote_jtag_get_u8(&r);
+			if (run && !r.error)
+				jtag_set_error(interface_jtag_add_reset(trst, srst));
+			break;
+		}
+		case REMOTE_JTAG_OP_PATHMOVE: {
+			uint32_t num_states = remote_jtag_get_u32(&r);
+			if (num_states == 0 || num_states > r.left) {
+				r.error = true;
+				break;
+			}
+			tap_state_t *path = run ? malloc(num_states * sizeof(*path)) : NULL;
+			if (run && !path) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+			for (uint32_t i = 0; i < num_states; i++) {
+				tap_state_t state = remote_jtag_get_state(&r, false);
+				if (path)
+					path[i] = state;
+			}
+			if (run && !r.error)
+				jtag_set_error(interface_jtag_add_pathmove(num_states, path));
+			/* the queue keeps its own copy */
+			free(path);
+			break;
+		}
+		case REMOTE_JTAG_OP_SLEEP: {
+			uint32_t us = remote_jtag_get_u32(&r);
+			if (run && !r.error)
+				jtag_set_error(interface_jtag_add_sleep(us));
+			break;
+		}
+		case REMOTE_JTAG_OP_CLOCKS: {
+			uint32_t num_cycles = remote_jtag_get_u32(&r);
+			if (num_cycles > INT_MAX)
+				r.error = true;
+			if (run && !r.error)
+				jtag_set_error(interface_jtag_add_clocks(num_cycles));
+			break;
+		}
+		case REMOTE_JTAG_OP_TMS: {
+			uint32_t num_bits = remote_jtag_get_u32(&r);
+			const uint8_t *bits = remote_jtag_get_bits(&r, num_bits);
+			if (!run && !(adapter_driver->jtag_ops->supported & DEBUG_CAP_TMS_SEQ)) {
+				LOG_ERROR("remote_jtag: the adapter can't send TMS sequences");
+				return ERROR_JTAG_NOT_IMPLEMENTED;
+			}
+			if (run && !r.error)
+				jtag_set_error(interface_add_tms_seq(num_bits, bits, TAP_INVALID));
+			break;
+		}
+		case REMOTE_JTAG_OP_ADAPTER_RESET: {
+			int trst = remote_jtag_get_u8(&r);
+			int srst = remote_jtag_get_u8(&r);
+			if (!run || r.error)
+				break;
+			/* the signals change right away, after what is queued */
+			retval = remote_jtag_flush(retval);
+			int reset = adapter_driver->reset ? adapter_driver->reset(trst, srst) :
+				interface_jtag_add_reset(trst, srst);
+			if (retval == ERROR_OK)
+				retval = reset;
+			break;
+		}
+		case REMOTE_JTAG_OP_SPEED: {
+			uint32_t khz = remote_jtag_get_u32(&r);
+			if (!run || r.error)
+				break;
+			retval = remote_jtag_flush(retval);
+			int speed = adapter_config_khz(khz);
+			if (retval == ERROR_OK)
+				retval = speed;
+			break;
+		}
+		default:
+			r.error = true;
+			break;
+		}
+	}
+
+	if (r.error) {
+		/* only possible in the first pass, the request doesn't change */
+		LOG_ERROR("remote_jtag: malformed request");
+		return ERROR_FAIL;
+	}
+
+	if (run)
+		return remote_jtag_flush(retval);
+
+	*captured_length = offset;
+	return ERROR_OK;
+}
+
+static int remote_jtag_send(struct connection *connection, unsigned int type,
+		const uint8_t *payload, size_t length)
+{
+	size_t frame_length;
+	uint8_t *frame = remote_jtag_frame(type, payload, length, &frame_length);
+	if (!frame) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* the socket is non-blocking, the client reads the reply right away */
+	const uint8_t *data = frame;
+	int retval = ERROR_OK;
+	while (frame_length > 0) {
+		int written = connection_write(connection, data, frame_length);
+		if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			alive_sleep(1);
+			continue;
+		}
+		if (written <= 0) {
+			log_socket_error("remote_jtag");
+			retval = ERROR_SERVER_REMOTE_CLOSED;
+			break;
+		}
+		data += written;
+		frame_length -= written;
+	}
+
+	free(frame);
+	return retval;
+}
+
+static int remote_jtag_request(struct connection *connection, const uint8_t *request,
+		size_t length)
+{
+	size_t captured_length = 0;
+	int result = ERROR_FAIL;
+
+	if (!transport_is_jtag())
+		LOG_ERROR("remote_jtag: the transport of this adapter isn't JTAG");
+	else
+		result = remote_jtag_walk(request, length, NULL, &captured_length);
+
+	/* a request that can't run is answered by the result alone */
+	if (result != ERROR_OK)
+		captured_length = 0;
+
+	uint8_t *reply = calloc(1, 4 + captured_length);
+	if (!reply) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	if (result == ERROR_OK)
+		result = remote_jtag_walk(request, length, reply + 4, NULL);
+
+	h_u32_to_le(reply, result);
+	int retval = remote_jtag_send(connection, REMOTE_JTAG_REPLY, reply, 4 + captured_length);
+	free(reply);
+	return retval;
+}
+
+static int remote_jtag_frame_received(struct connection *connection, unsigned int type,
+		const uint8_t *payload, size_t length)
+{
+	switch (type) {
+	case REMOTE_JTAG_HELLO: {
+		uint8_t version[4];
+		if (length < 4) {
+			LOG_ERROR("remote_jtag: malformed hello");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		LOG_INFO("remote_jtag: client with protocol version %" PRIu32,
+				le_to_h_u32(payload));
+		h_u32_to_le(version, REMOTE_JTAG_VERSION);
+		return remote_jtag_send(connection, REMOTE_JTAG_HELLO, version, sizeof(version));
+	}
+	case REMOTE_JTAG_REQUEST:
+		return remote_jtag_request(connection, payload, length);
+	default:
+		LOG_ERROR("remote_jtag: unexpected frame type %u", type);
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+}
+
+/* Handle the complete frames in the connection buffer */
+static int remote_jtag_frames(struct connection *connection)
+{
+	struct remote_jtag_connection *rj = connection->priv;
+	size_t start = 0;
+	int retval = ERROR_OK;
+
+	while (rj->used - start >= REMOTE_JTAG_HEADER_SIZE) {
+		const uint8_t *header = rj->buf + start;
+		unsigned int type;
+		size_t length, raw_length;
+		if (remote_jtag_parse_header(header, &type, &length, &raw_length) != ERROR_OK) {
+			LOG_ERROR("remote_jtag: corrupt frame header");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		if (rj->used - start - REMOTE_JTAG_HEADER_SIZE < length)
+			break;
+
+		uint8_t *raw = malloc(raw_length + 1);
+		if (!raw) {
+			LOG_ERROR("Out of memory");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		if (remote_jtag_decode_payload(header, header + REMOTE_JTAG_HEADER_SIZE,
+					raw) != ERROR_OK) {
+			LOG_ERROR("remote_jtag: corrupt frame");
+			free(raw);
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		retval = remote_jtag_frame_received(connection, type, raw, raw_length);
+		free(raw);
+		start += REMOTE_JTAG_HEADER_SIZE + length;
+		if (retval == ERROR_SERVER_REMOTE_CLOSED)
+			return retval;
+	}
+
+	memmove(rj->buf, rj->buf + start, rj->used - start);
+	rj->used -= start;
+	return ERROR_OK;
+}
+
+static int remote_jtag_input(struct connection *connection)
+{
+	struct remote_jtag_connection *rj = connection->priv;
+
+	if (rj->size - rj->used < 4096) {
+		size_t size = MAX(2 * rj->size, (size_t)64 * 1024);
+		if (size > REMOTE_JTAG_HEADER_SIZE + REMOTE_JTAG_MAX_FRAME + 64 * 1024) {
+			LOG_ERROR("remote_jtag: frame too large");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		uint8_t *buf = realloc(rj->buf, size);
+		if (!buf) {
+			LOG_ERROR("Out of memory");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		rj->buf = buf;
+		rj->size = size;
+	}
+
+	int bytes_read = connection_read(connection, rj->buf + rj->used, rj->size - rj->used);
+	if (!bytes_read)
+		return ERROR_SERVER_REMOTE_CLOSED;
+	if (bytes_read < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return ERROR_OK;
+		LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	rj->used += bytes_read;
+
+	return remote_jtag_frames(connection);
+}
+
+static int remote_jtag_new_connection(struct connection *connection)
+{
+	struct remote_jtag_connection *rj = calloc(1, sizeof(*rj));
+	if (!rj) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	connection->priv = rj;
+	LOG_INFO("remote_jtag: new connection");
+	return ERROR_OK;
+}
+
+static int remote_jtag_connection_closed(struct connection *connection)
+{
+	struct remote_jtag_connection *rj = connection->priv;
+	if (rj)
+		free(rj->buf);
+	free(rj);
+	connection->priv = NULL;
+	LOG_INFO("remote_jtag: connection closed");
+	return ERROR_OK;
+}
+
+static const struct service_driver remote_jtag_service_driver = {
+	.name = "remote_jtag",
+	.new_connection_during_keep_alive_handler = NULL,
+	.new_connection_handler = remote_jtag_new_connection,
+	.input_handler = remote_jtag_input,
+	.connection_closed_handler = remote_jtag_connection_closed,
+	.keep_client_alive_handler = NULL,
+};
+
+COMMAND_HANDLER(handle_remote_jtag_server_start_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* one client at a time, the queues of two would mix */
+	return add_service(&remote_jtag_service_driver, CMD_ARGV[0], 1, NULL);
+}
+
+COMMAND_HANDLER(handle_remote_jtag_server_stop_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	return remove_service("remote_jtag", CMD_ARGV[0]);
+}
+
+static const struct command_registration remote_jtag_server_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_remote_jtag_server_start_command,
+		.mode = COMMAND_ANY,
+		.help = "Start a server running the JTAG queues of remote_jtag clients",
+		.usage = "<port>",
+	},
+	{
+		.name = "stop",
+		.handler = handle_remote_jtag_server_stop_command,
+		.mode = COMMAND_ANY,
+		.help = "Stop a remote_jtag server",
+		.usage = "<port>",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration remote_jtag_server_command_handlers[] = {
+	{
+		.name = "remote_jtag_server",
+		.mode = COMMAND_ANY,
+		.help = "remote_jtag server",
+		.usage = "",
+		.chain = remote_jtag_server_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int remote_jtag_server_register_commands(struct command_context *ctx)
+{
+	return register_commands(ctx, NULL, remote_jtag_server_command_handlers);
+}
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_SERVER_REMOTE_JTAG_SERVER_H
+#define OPENOCD_SERVER_REMOTE_JTAG_SERVER_H
+
+#include <helper/command.h>
+
+int remote_jtag_server_register_commands(struct command_context *ctx);
+
+#endif /* OPENOCD_SERVER_REMOTE_JTAG_SERVER_H */
@@ -13,6 +13,7 @@
 
 #include "server.h"
 #include "rtt_server.h"
+#include "trace_stream.h"
 
 /**
  * @file
@@ -23,35 +24,68 @@
  * connections.
  */
 
+/* Default size of the per-channel ring buffer */
+#define RTT_SERVER_BUFFER_SIZE	(16 * 1024)
+
+/*
+ * The data read from a channel goes into a trace stream of the service, which
+ * each client drains at its own pace.
+ */
 struct rtt_service {
 	unsigned int channel;
 	char *hello_message;
+	char *port;
+	struct trace_stream *stream;
+	/* Bytes of history sent to a new client */
+	uint32_t replay;
+	bool sink_registered;
+	struct rtt_service *next;
 };
 
+static struct rtt_service *rtt_services;
+
 static int read_callback(unsigned int channel, const uint8_t *buffer,
 		size_t length, void *user_data)
+{
+	struct rtt_service *service;
+
+	service = (struct rtt_service *)user_data;
+
+	/* Also called without data on every poll, a chance to catch up */
+	if (length)
+		trace_stream_push(service->stream, buffer, length);
+	else
+		trace_stream_drain(service->stream);
+
+	return ERROR_OK;
+}
+
+static int register_sink(struct rtt_service *service)
 {
 	int ret;
-	struct connection *connection;
-	size_t offset;
 
-	connection = (struct connection *)user_data;
-	offset = 0;
+	if (service->sink_registered)
+		return ERROR_OK;
 
-	while (offset < length) {
-		ret = connection_write(connection, buffer + offset, length - offset);
+	ret = rtt_register_sink(service->channel, &read_callback, service);
 
-		if (ret < 0) {
-			LOG_ERROR("Failed to write data to socket.");
-			return ERROR_FAIL;
-		}
+	if (ret != ERROR_OK)
+		return ret;
 
-		offset += ret;
-	}
+	service->sink_registered = true;
 
 	return ERROR_OK;
 }
 
+static void unregister_sink(struct rtt_service *service)
+{
+	if (!service->sink_registered)
+		return;
+
+	rtt_unregister_sink(service->channel, &read_callback, service);
+	service->sink_registered = false;
+}
+
 static int rtt_new_connection(struct connection *connection)
 {
 	int ret;
@@ -61,7 +95,7 @@ static int rtt_new_connection(struct connection *connection)
 
 	LOG_DEBUG("rtt: New connection for channel %u", service->channel);
 
-	ret = rtt_register_sink(service->channel, &read_callback, connection);
+	ret = register_sink(service);
 
 	if (ret != ERROR_OK)
 		return ret;
@@ -69,7 +103,7 @@ static int rtt_new_connection(struct connection *connection)
 	if (service->hello_message)
 		connection_write(connection, service->hello_message, strlen(service->hello_message));
 
-	return ERROR_OK;
+	return trace_stream_subscribe(service->stream, connection, service->replay);
 }
 
 static int rtt_connection_closed(struct connection *connection)
@@ -77,7 +111,12 @@ static int rtt_connection_closed(struct connection *connection)
 	struct rtt_service *service;
 
 	service = (struct rtt_service *)connection->service->priv;
-	rtt_unregister_sink(service->channel, &read_callback, connection);
+	trace_stream_unsubscribe(service->stream, connection);
+
+	/* Without history there's no reason to keep reading a channel nobody
+	 * listens to, leave the data in the target buffer instead */
+	if (!service->replay && !trace_stream_subscribers(service->stream))
+		unregister_sink(service);
 
 	LOG_DEBUG("rtt: Connection for channel %u closed", service->channel);
 
@@ -116,14 +155,48 @@ static const struct service_driver rtt_service_driver = {
 	.keep_client_alive_handler = NULL,
 };
 
+static void free_rtt_service(struct rtt_service *service)
+{
+	trace_stream_free(service->stream);
+	free(service->hello_message);
+	free(service->port);
+	free(service);
+}
+
 COMMAND_HANDLER(handle_rtt_start_command)
 {
 	int ret;
 	struct rtt_service *service;
+	uint32_t ring_size = RTT_SERVER_BUFFER_SIZE;
+	uint32_t replay = 0;
+
+	while (CMD_ARGC >= 2 && CMD_ARGV[0][0] == '-') {
+		if (!strcmp(CMD_ARGV[0], "-buffer")) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], ring_size);
+		} else if (!strcmp(CMD_ARGV[0], "-replay")) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], replay);
+		} else {
+			command_print(CMD, "unknown option '%s'", CMD_ARGV[0]);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		CMD_ARGC -= 2;
+		CMD_ARGV += 2;
+	}
 
 	if (CMD_ARGC < 2 || CMD_ARGC > 3)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	if (!ring_size) {
+		command_print(CMD, "buffer size must not be zero");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (replay > ring_size) {
+		command_print(CMD, "replay size must not exceed the buffer size");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
 	service = calloc(1, sizeof(struct rtt_service));
 
 	if (!service)
@@ -131,6 +204,22 @@ COMMAND_HANDLER(handle_rtt_start_command)
 
 	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], service->channel);
 
+	service->replay = replay;
+	service->port = strdup(CMD_ARGV[0]);
+
+	if (service->port) {
+		char *name = alloc_printf("rtt server %s", service->port);
+		if (name)
+			service->stream = trace_stream_new(name, ring_size);
+		free(name);
+	}
+
+	if (!service->stream) {
+		LOG_ERROR("Out of memory");
+		free_rtt_service(service);
+		return ERROR_FAIL;
+	}
+
 	if (CMD_ARGC >= 3) {
 		const char *hello_message = CMD_ARGV[2];
 		size_t hello_length = strlen(hello_message);
@@ -138,30 +227,69 @@ COMMAND_HANDLER(handle_rtt_start_command)
 		service->hello_message = malloc(hello_length + 2);
 		if (!service->hello_message) {
 			LOG_ERROR("Out of memory");
-			free(service);
+			free_rtt_service(service);
 			return ERROR_FAIL;
 		}
 		strcpy(service->hello_message, hello_message);
 		service->hello_message[hello_length] = '\n';
 		service->hello_message[hello_length + 1] = '\0';
 	}
+
+	/* Keep the history even while no client is connected */
+	if (replay && register_sink(service) != ERROR_OK) {
+		free_rtt_service(service);
+		return ERROR_FAIL;
+	}
+
 	ret = add_service(&rtt_service_driver, CMD_ARGV[0], CONNECTION_LIMIT_UNLIMITED, service);
 
 	if (ret != ERROR_OK) {
-		free(service);
+		unregister_sink(service);
+		free_rtt_service(service);
 		return ERROR_FAIL;
 	}
 
+	service->next = rtt_services;
+	rtt_services = service;
+
 	return ERROR_OK;
 }
 
 COMMAND_HANDLER(handle_rtt_stop_command)
 {
+	struct rtt_service **prev;
+	struct rtt_service *service;
+	struct trace_stream *stream;
+	char *hello_message;
+	char *port;
+
 	if (CMD_ARGC != 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	for (prev = &rtt_services; *prev; prev = &(*prev)->next) {
+		if (!strcmp((*prev)->port, CMD_ARGV[0]))
+			break;
+	}
+
+	service = *prev;
+
+	if (!service)
+		return ERROR_OK;
+
+	*prev = service->next;
+	unregister_sink(service);
+
+	/* remove_service() only frees the service structure itself */
+	stream = service->stream;
+	hello_message = service->hello_message;
+	port = service->port;
+
 	remove_service("rtt", CMD_ARGV[0]);
 
+	trace_stream_free(stream);
+	free(hello_message);
+	free(port);
+
 	return ERROR_OK;
 }
 
@@ -171,7 +299,7 @@ static const struct command_registration rtt_server_subcommand_handlers[] = {
 		.handler = handle_rtt_start_command,
 		.mode = COMMAND_ANY,
 		.help = "Start a RTT server",
-		.usage = "<port> <channel> [message]"
+		.usage = "[-buffer size] [-replay size] <port> <channel> [message]"
 	},
 	{
 		.name = "stop",
@@ -19,6 +19,7 @@
 #include <helper/time_support.h>
 #include <target/target.h>
 #include <target/target_request.h>
+#include <jtag/jtag.h>
 #include <target/openrisc/jsp_server.h>
 #include "openocd.h"
 #include "tcl_server.h"
@@ -33,10 +34,42 @@
 
 #ifndef _WIN32
 #include <netinet/tcp.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
 #endif
 
 static struct service *services;
 
+/* size of the output buffer of services with buffered_output */
+#define CONNECTION_OUT_BUFFER_SIZE	16384
+
+/* number of connections with buffered output not yet sent */
+static unsigned int server_buffered_connections;
+
+/* set whenever a listener or connection fd is added or removed */
+static bool server_fds_changed = true;
+
+#ifdef HAVE_SYS_EPOLL_H
+/* max number of ready fds handled per server_loop() iteration */
+#define SERVER_EPOLL_EVENTS 64
+
+/* what an epoll event refers to; connection is NULL for a listener */
+struct server_watch {
+	struct service *service;
+	struct connection *connection;
+};
+
+static int server_epoll_fd = -1;
+/* set when some fd cannot be watched by epoll, e.g. stdin redirected from
+ * a regular file; server_loop() then falls back to select() */
+static bool server_epoll_disabled;
+static struct server_watch *server_watches;
+static struct epoll_event server_epoll_events[SERVER_EPOLL_EVENTS];
+#endif
+
 enum shutdown_reason {
 	CONTINUE_MAIN_LOOP,			/* stay in main event loop */
 	SHUTDOWN_REQUESTED,			/* set by shutdown command; exit the event loop and quit the debugger */
@@ -61,6 +94,8 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	int retval;
 	int flag = 1;
 
+	server_fds_changed = true;
+
 	c = malloc(sizeof(struct connection));
 	c->fd = -1;
 	c->fd_out = -1;
@@ -68,6 +103,9 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = false;
+	c->out_buf = NULL;
+	c->out_len = 0;
+	c->out_error = false;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -142,6 +180,13 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 		}
 	}
 
+	/* output written by new_connection() above went out unbuffered */
+	if (service->buffered_output) {
+		c->out_buf = malloc(CONNECTION_OUT_BUFFER_SIZE);
+		if (!c->out_buf)
+			LOG_WARNING("no output buffer for '%s' connection", service->name);
+	}
+
 	/* add to the end of linked list */
 	for (p = &service->connections; *p; p = &(*p)->next)
 		;
@@ -161,7 +206,9 @@ static int remove_connection(struct service *service, struct connection *connect
 	/* find connection */
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
+			server_fds_changed = true;
 			service->connection_closed(c);
+			connection_flush(c);
 			if (service->type == CONNECTION_TCP)
 				close_socket(c->fd);
 			else if (service->type == CONNECTION_PIPE) {
@@ -173,6 +220,7 @@ static int remove_connection(struct service *service, struct connection *connect
 
 			/* delete connection */
 			*p = c->next;
+			free(c->out_buf);
 			free(c);
 
 			if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
@@ -214,6 +262,8 @@ int add_service(const struct service_driver *driver, const char *port,
 	c->input = driver->input_handler;
 	c->connection_closed = driver->connection_closed_handler;
 	c->keep_client_alive = driver->keep_client_alive_handler;
+	c->buffered_output = driver->buffered_output;
+	c->flush = driver->flush_handler;
 	c->priv = priv;
 	c->next = NULL;
 	long portnumber;
@@ -333,6 +383,7 @@ int add_service(const struct service_driver *driver, const char *port,
 	for (p = &services; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_fds_changed = true;
 
 	return ERROR_OK;
 }
@@ -362,6 +413,7 @@ int remove_service(const char *name, const char *port)
 	for (tmp = services; tmp; prev = tmp, tmp = tmp->next) {
 		if (!strcmp(tmp->name, name) && !strcmp(tmp->port, port)) {
 			remove_connections(tmp);
+			server_fds_changed = true;
 
 			if (tmp == services)
 				services = tmp->next;
@@ -407,16 +459,175 @@ static int remove_services(void)
 	}
 
 	services = NULL;
+	server_fds_changed = true;
 
 	return ERROR_OK;
 }
 
+static void server_flush_connections(void)
+{
+	for (struct service *s = services; s; s = s->next)
+		if (s->flush)
+			for (struct connection *c = s->connections; c; c = c->next)
+				s->flush(c);
+
+	if (!server_buffered_connections)
+		return;
+
+	for (struct service *s = services; s; s = s->next)
+		for (struct connection *c = s->connections; c; c = c->next)
+			connection_flush(c);
+}
+
 void server_keep_clients_alive(void)
 {
 	for (struct service *s = services; s; s = s->next)
 		if (s->keep_client_alive)
 			for (struct connection *c = s->connections; c; c = c->next)
 				s->keep_client_alive(c);
+
+	/* long running commands only get here, not back to server_loop() */
+	server_flush_connections();
+}
+
+void server_yield(void)
+{
+	static bool yielding;
+
+	if (yielding || timeval_us() < target_timer_next_event_us())
+		return;
+
+	yielding = true;
+	bool save_poll_mask = jtag_poll_mask();
+	target_call_timer_callbacks();
+	jtag_poll_unmask(save_poll_mask);
+	yielding = false;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void server_epoll_close(void)
+{
+	if (server_epoll_fd != -1)
+		close(server_epoll_fd);
+	server_epoll_fd = -1;
+	free(server_watches);
+	server_watches = NULL;
+}
+
+static int server_epoll_watch(unsigned int index, int fd)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.u32 = index,
+	};
+
+	if (epoll_ctl(server_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		LOG_DEBUG("cannot watch fd %d with epoll: %s", fd, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+/* The epoll set is rebuilt from scratch whenever a service or connection
+ * comes or goes. That is rare, and it keeps the fd swapping done for pipes
+ * in add_connection()/remove_connection() out of the bookkeeping. */
+static int server_epoll_rebuild(void)
+{
+	unsigned int count = 0;
+
+	server_epoll_close();
+
+	for (struct service *s = services; s; s = s->next) {
+		count++;
+		for (struct connection *c = s->connections; c; c = c->next)
+			count++;
+	}
+
+	server_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server_watches = calloc(MAX(count, 1), sizeof(*server_watches));
+	if (server_epoll_fd == -1 || !server_watches)
+		goto fail;
+
+	unsigned int index = 0;
+	for (struct service *s = services; s; s = s->next) {
+		if (s->fd != -1) {
+			server_watches[index].service = s;
+			if (server_epoll_watch(index, s->fd) != ERROR_OK)
+				goto fail;
+			index++;
+		}
+
+		for (struct connection *c = s->connections; c; c = c->next) {
+			if (c->fd < 0)
+				continue;
+			server_watches[index].service = s;
+			server_watches[index].connection = c;
+			if (server_epoll_watch(index, c->fd) != ERROR_OK)
+				goto fail;
+			index++;
+		}
+	}
+
+	return ERROR_OK;
+
+fail:
+	LOG_DEBUG("falling back to select() in the server loop");
+	server_epoll_close();
+	server_epoll_disabled = true;
+	return ERROR_FAIL;
+}
+#endif
+
+static void server_accept(struct service *service, struct command_context *command_context)
+{
+	if (service->max_connections != 0) {
+		add_connection(service, command_context);
+		return;
+	}
+
+	if (service->type == CONNECTION_TCP) {
+		socklen_t address_size = sizeof(service->sin);
+		int tmp_fd;
+		tmp_fd = accept(service->fd,
+				(struct sockaddr *)&service->sin,
+				&address_size);
+		close_socket(tmp_fd);
+	}
+	LOG_INFO("rejected '%s' connection, no more connections allowed",
+		service->name);
+}
+
+static void server_connection_input(struct service *service, struct connection *c)
+{
+	int retval = service->input(c);
+	if (retval == ERROR_OK)
+		return;
+
+	if (service->type == CONNECTION_PIPE ||
+			service->type == CONNECTION_STDINOUT) {
+		/* if connection uses a pipe then
+		 * shutdown openocd on error */
+		shutdown_openocd = SHUTDOWN_REQUESTED;
+	}
+	remove_connection(service, c);
+	LOG_INFO("dropped '%s' connection", service->name);
+}
+
+static bool server_socket_error(void)
+{
+#ifdef _WIN32
+	errno = WSAGetLastError();
+
+	if (errno == WSAEINTR)
+		return false;
+#else
+	if (errno == EINTR)
+		return false;
+#endif
+
+	LOG_ERROR("error during select: %s", strerror(errno));
+	return true;
 }
 
 int server_loop(struct command_context *command_context)
@@ -429,10 +640,9 @@ int server_loop(struct command_context *command_context)
 	fd_set read_fds;
 	int fd_max;
 
-	/* used in accept() */
 	int retval;
 
-	int64_t next_event = timeval_ms() + polling_period;
+	int64_t next_event = timeval_us() + polling_period * 1000;
 
 #ifndef _WIN32
 	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
@@ -440,84 +650,86 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
+		int64_t timeout_us = 0;
+		bool use_epoll = false;
+
+		if (!poll_ok) {
+			/* Timeout when a target timer expires or every polling_period */
+			timeout_us = next_event - timeval_us();
+			if (timeout_us < 0)
+				timeout_us = 0;
+			else if (timeout_us > polling_period * 1000)
+				timeout_us = polling_period * 1000;
+		}
+		/* else we're just polling this iteration, this is faster on
+		 * embedded hosts */
+
+#ifdef HAVE_SYS_EPOLL_H
+		if (!server_epoll_disabled && server_fds_changed) {
+			server_fds_changed = false;
+			server_epoll_rebuild();
+		}
+		use_epoll = !server_epoll_disabled;
+
+		if (use_epoll) {
+			retval = epoll_wait(server_epoll_fd, server_epoll_events,
+					SERVER_EPOLL_EVENTS, DIV_ROUND_UP(timeout_us, 1000));
+			if (retval == -1) {
+				if (server_socket_error())
+					return ERROR_FAIL;
+				retval = 0;
 			}
+		}
+#endif
 
-			if (service->connections) {
-				struct connection *c;
+		if (!use_epoll) {
+			/* monitor sockets for activity */
+			fd_max = 0;
+			FD_ZERO(&read_fds);
 
-				for (c = service->connections; c; c = c->next) {
+			/* add service and connection fds to read_fds */
+			for (service = services; service; service = service->next) {
+				if (service->fd != -1) {
+					/* listen for new connections */
+					FD_SET(service->fd, &read_fds);
+
+					if (service->fd > fd_max)
+						fd_max = service->fd;
+				}
+
+				for (struct connection *c = service->connections; c; c = c->next) {
 					/* check for activity on the connection */
 					FD_SET(c->fd, &read_fds);
 					if (c->fd > fd_max)
 						fd_max = c->fd;
 				}
 			}
-		}
 
-		struct timeval tv;
-		tv.tv_sec = 0;
-		if (poll_ok) {
-			/* we're just polling this iteration, this is faster on embedded
-			 * hosts */
-			tv.tv_usec = 0;
+			struct timeval tv;
+			tv.tv_sec = 0;
+			tv.tv_usec = timeout_us;
 			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		} else {
-			/* Timeout socket_select() when a target timer expires or every polling_period */
-			int timeout_ms = next_event - timeval_ms();
-			if (timeout_ms < 0)
-				timeout_ms = 0;
-			else if (timeout_ms > polling_period)
-				timeout_ms = polling_period;
-			tv.tv_usec = timeout_ms * 1000;
-			/* Only while we're sleeping we'll let others run */
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		}
-
-		if (retval == -1) {
-#ifdef _WIN32
-
-			errno = WSAGetLastError();
-
-			if (errno == WSAEINTR)
+			if (retval == -1) {
+				if (server_socket_error())
+					return ERROR_FAIL;
 				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
 			}
-#else
-
-			if (errno == EINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
-			}
-#endif
 		}
 
 		if (retval == 0) {
 			/* Execute callbacks of expired timers when
 			 * - there was nothing to do if poll_ok was true
-			 * - socket_select() timed out if poll_ok was false, now one or more
+			 * - the wait timed out if poll_ok was false, now one or more
 			 *   timers expired or the polling period elapsed
 			 */
 			target_call_timer_callbacks();
-			next_event = target_timer_next_event();
+			next_event = target_timer_next_event_us();
 			process_jim_events(command_context);
+			/* write out buffered debug messages while there's nothing else to do */
+			log_flush();
 
-			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
+			if (!use_epoll)
+				FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
 
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
@@ -534,55 +746,56 @@ int server_loop(struct command_context *command_context)
 		 */
 		poll_ok = poll_ok || target_got_message();
 
-		for (service = services; service; service = service->next) {
-			/* handle new connections on listeners */
-			if ((service->fd != -1)
-				&& (FD_ISSET(service->fd, &read_fds))) {
-				if (service->max_connections != 0)
-					add_connection(service, command_context);
-				else {
-					if (service->type == CONNECTION_TCP) {
-						struct sockaddr_in sin;
-						socklen_t address_size = sizeof(sin);
-						int tmp_fd;
-						tmp_fd = accept(service->fd,
-								(struct sockaddr *)&service->sin,
-								&address_size);
-						close_socket(tmp_fd);
-					}
-					LOG_INFO(
-						"rejected '%s' connection, no more connections allowed",
-						service->name);
+#ifdef HAVE_SYS_EPOLL_H
+		if (use_epoll) {
+			/* only the ready fds are visited */
+			for (int i = 0; i < retval; i++) {
+				struct server_watch *watch = &server_watches[server_epoll_events[i].data.u32];
+
+				if (watch->connection)
+					server_connection_input(watch->service, watch->connection);
+				else
+					server_accept(watch->service, command_context);
+
+				/* a connection came or went, the remaining events may
+				 * refer to freed memory; level triggered epoll reports
+				 * them again on the next iteration */
+				if (server_fds_changed)
+					break;
+			}
+
+			/* data already buffered by a connection does not show up
+			 * on its fd */
+			for (service = services; service; service = service->next) {
+				for (struct connection *c = service->connections; c; ) {
+					struct connection *next = c->next;
+					if (c->input_pending)
+						server_connection_input(service, c);
+					c = next;
 				}
 			}
+		}
+#endif
 
-			/* handle activity on connections */
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; ) {
-					if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
-						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = SHUTDOWN_REQUESTED;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
-							c = next;
-							continue;
-						}
-					}
-					c = c->next;
+		if (!use_epoll) {
+			for (service = services; service; service = service->next) {
+				/* handle new connections on listeners */
+				if ((service->fd != -1)
+					&& (FD_ISSET(service->fd, &read_fds)))
+					server_accept(service, command_context);
+
+				/* handle activity on connections */
+				for (struct connection *c = service->connections; c; ) {
+					struct connection *next = c->next;
+					if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending)
+						server_connection_input(service, c);
+					c = next;
 				}
 			}
 		}
 
+		server_flush_connections();
+
 #ifdef _WIN32
 		MSG msg;
 		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
@@ -698,6 +911,9 @@ int server_init(struct command_context *cmd_ctx)
 int server_quit(void)
 {
 	remove_services();
+#ifdef HAVE_SYS_EPOLL_H
+	server_epoll_close();
+#endif
 	target_quit();
 
 #ifdef _WIN32
@@ -729,20 +945,115 @@ void exit_on_signal(int sig)
 #endif
 }
 
+static int connection_write_raw(struct connection *connection, const void *data, int len)
+{
+	if (connection->service->type == CONNECTION_TCP)
+		return write_socket(connection->fd_out, data, len);
+	else
+		return write(connection->fd_out, data, len);
+}
+
+/* write everything, possibly with several calls */
+static int connection_write_all(struct connection *connection, const char *data, int len)
+{
+	while (len > 0) {
+		int written = connection_write_raw(connection, data, len);
+		if (written <= 0)
+			return ERROR_FAIL;
+		data += written;
+		len -= written;
+	}
+
+	return ERROR_OK;
+}
+
+/* send the buffered output followed by data */
+static int connection_write_after_buffer(struct connection *connection,
+		const void *data, int len)
+{
+	int buffered = connection->out_len;
+
+	connection->out_len = 0;
+	server_buffered_connections--;
+
+#ifndef _WIN32
+	/* a single system call for both */
+	struct iovec iov[2] = {
+		{ .iov_base = connection->out_buf, .iov_len = buffered },
+		{ .iov_base = (void *)data, .iov_len = len },
+	};
+	ssize_t written = writev(connection->fd_out, iov, 2);
+	if (written <= 0)
+		return ERROR_FAIL;
+	if (written < buffered) {
+		if (connection_write_all(connection, connection->out_buf + written,
+				buffered - written) != ERROR_OK)
+			return ERROR_FAIL;
+		written = buffered;
+	}
+	return connection_write_all(connection, (const char *)data + (written - buffered),
+			len - (written - buffered));
+#else
+	if (connection_write_all(connection, connection->out_buf, buffered) != ERROR_OK)
+		return ERROR_FAIL;
+	return connection_write_all(connection, data, len);
+#endif
+}
+
 int connection_write(struct connection *connection, const void *data, int len)
 {
 	if (len == 0) {
 		/* successful no-op. Sockets and pipes behave differently here... */
 		return 0;
 	}
-	if (connection->service->type == CONNECTION_TCP)
-		return write_socket(connection->fd_out, data, len);
+
+	if (!connection->out_buf)
+		return connection_write_raw(connection, data, len);
+
+	if (connection->out_error)
+		return -1;
+
+	if (len <= CONNECTION_OUT_BUFFER_SIZE - connection->out_len) {
+		if (!connection->out_len)
+			server_buffered_connections++;
+		memcpy(connection->out_buf + connection->out_len, data, len);
+		connection->out_len += len;
+		return len;
+	}
+
+	int retval;
+	if (connection->out_len)
+		retval = connection_write_after_buffer(connection, data, len);
 	else
-		return write(connection->fd_out, data, len);
+		retval = connection_write_all(connection, data, len);
+
+	if (retval != ERROR_OK) {
+		connection->out_error = true;
+		return -1;
+	}
+
+	return len;
+}
+
+int connection_flush(struct connection *connection)
+{
+	if (connection->out_len) {
+		int len = connection->out_len;
+
+		connection->out_len = 0;
+		server_buffered_connections--;
+		if (connection_write_all(connection, connection->out_buf, len) != ERROR_OK)
+			connection->out_error = true;
+	}
+
+	return connection->out_error ? ERROR_FAIL : ERROR_OK;
 }
 
 int connection_read(struct connection *connection, void *data, int len)
 {
+	/* the peer may be waiting for our output before it sends more */
+	connection_flush(connection);
+
 	if (connection->service->type == CONNECTION_TCP)
 		return read_socket(connection->fd, data, len);
 	else
@@ -40,6 +40,10 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	bool input_pending;
+	/* output coalescing, only allocated for services with buffered_output */
+	char *out_buf;
+	int out_len;
+	bool out_error;
 	void *priv;
 	struct connection *next;
 };
@@ -62,6 +66,17 @@ struct service_driver {
 	int (*connection_closed_handler)(struct connection *connection);
 	/** called periodically to send keep-alive messages on the connection */
 	void (*keep_client_alive_handler)(struct connection *connection);
+	/**
+	 * collect the output of connection_write() and send it at the end of
+	 * the server_loop() iteration, before the next read from the connection
+	 * or when the buffer is full. See connection_flush().
+	 */
+	bool buffered_output;
+	/**
+	 * optional, called on every connection at the end of the server_loop()
+	 * iteration, right before the buffered output is sent
+	 */
+	void (*flush_handler)(struct connection *connection);
 };
 
 struct service {
@@ -78,6 +93,8 @@ struct service {
 	int (*input)(struct connection *connection);
 	int (*connection_closed)(struct connection *connection);
 	void (*keep_client_alive)(struct connection *connection);
+	bool buffered_output;
+	void (*flush)(struct connection *connection);
 	void *priv;
 	struct service *next;
 };
@@ -97,12 +114,21 @@ void exit_on_signal(int sig);
 
 void server_keep_clients_alive(void);
 
+/* Run the expired timer callbacks, e.g. RTT polling, from within a long
+ * operation. Target polling is masked, so target state changes are only
+ * noticed back in server_loop(). Must only be called between target
+ * accesses. */
+void server_yield(void);
+
 int server_loop(struct command_context *command_context);
 
 int server_register_commands(struct command_context *context);
 
 int connection_write(struct connection *connection, const void *data, int len);
 int connection_read(struct connection *connection, void *data, int len);
+/* Send the output buffered by connection_write(). A write error is also
+ * reported by the following connection_write() calls. */
+int connection_flush(struct connection *connection);
 
 bool openocd_is_shutdown_pending(void);
 
@@ -17,6 +17,24 @@
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
 
+/*
+ * Framed protocol, see "tcl_framing". Every frame starts with a header of
+ * little endian words: the request id, the request type or the status of
+ * the response, and the length of the payload that follows.
+ */
+#define TCL_FRAME_HEADER_SIZE		12
+/* Memory requests start with { uint64_t address, uint32_t size, uint32_t count } */
+#define TCL_FRAME_MEMORY_HEADER_SIZE	16
+/* Ids of the frames sent without a request */
+#define TCL_FRAME_ID_NOTIFICATION	0xffffffff
+#define TCL_FRAME_ID_TRACE		0xfffffffe
+
+enum tcl_frame_type {
+	TCL_FRAME_COMMAND = 0,
+	TCL_FRAME_READ_MEMORY = 1,
+	TCL_FRAME_WRITE_MEMORY = 2,
+};
+
 struct tcl_connection {
 	int tc_linedrop;
 	int tc_lineoffset;
@@ -26,6 +44,12 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	/* framed protocol in use, and requested by "tcl_framing" */
+	bool tc_framed;
+	bool tc_framing;
+	/* bytes of the current frame received, and its size with the header */
+	size_t tc_frame_received;
+	size_t tc_frame_size;
 };
 
 static char *tcl_port;
@@ -35,6 +59,9 @@ static int tcl_new_connection(struct connection *connection);
 static int tcl_input(struct connection *connection);
 static int tcl_output(struct connection *connection, const void *buf, ssize_t len);
 static int tcl_closed(struct connection *connection);
+static int tcl_output_async(struct connection *connection, const char *buf);
+static int tcl_output_frame(struct connection *connection, uint32_t id, int status,
+		const void *data, size_t len);
 
 static int tcl_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
@@ -47,14 +74,14 @@ static int tcl_target_callback_event_handler(struct target *target,
 
 	if (tclc->tc_notify) {
 		snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
-		tcl_output(connection, buf, strlen(buf));
+		tcl_output_async(connection, buf);
 	}
 
 	if (tclc->tc_laststate != target->state) {
 		tclc->tc_laststate = target->state;
 		if (tclc->tc_notify) {
 			snprintf(buf, sizeof(buf), "type target_state state %s\r\n\x1a", target_state_name(target));
-			tcl_output(connection, buf, strlen(buf));
+			tcl_output_async(connection, buf);
 		}
 	}
 
@@ -72,7 +99,7 @@ static int tcl_target_callback_reset_handler(struct target *target,
 
 	if (tclc->tc_notify) {
 		snprintf(buf, sizeof(buf), "type target_reset mode %s\r\n\x1a", target_reset_mode_name(reset_mode));
-		tcl_output(connection, buf, strlen(buf));
+		tcl_output_async(connection, buf);
 	}
 
 	return ERROR_OK;
@@ -91,12 +118,14 @@ static int tcl_target_callback_trace_handler(struct target *target,
 
 	tclc = connection->priv;
 
-	if (tclc->tc_trace) {
+	if (tclc->tc_trace && tclc->tc_framed) {
+		tcl_output_frame(connection, TCL_FRAME_ID_TRACE, ERROR_OK, data, len);
+	} else if (tclc->tc_trace) {
 		hex = malloc(hex_len);
 		buf = malloc(max_len);
 		hexify(hex, data, len, hex_len);
 		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
+		tcl_output_async(connection, buf);
 		free(hex);
 		free(buf);
 	}
@@ -160,59 +189,52 @@ static int tcl_new_connection(struct connection *connection)
 	return ERROR_OK;
 }
 
-static int tcl_input(struct connection *connection)
+/* Append a byte to the line buffer, growing it up to TCL_LINE_MAX */
+static void tcl_line_append(struct tcl_connection *tclc, unsigned char c)
 {
-	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
-	int retval;
-	int i;
-	ssize_t rlen;
-	const char *result;
-	int reslen;
-	struct tcl_connection *tclc;
-	unsigned char in[256];
 	char *tc_line_new;
 	int tc_line_size_new;
 
-	rlen = connection_read(connection, &in, sizeof(in));
-	if (rlen <= 0) {
-		if (rlen < 0)
-			LOG_ERROR("error during read: %s", strerror(errno));
-		return ERROR_SERVER_REMOTE_CLOSED;
-	}
+	tclc->tc_line[tclc->tc_lineoffset] = c;
+	if (tclc->tc_lineoffset + 1 < tclc->tc_line_size) {
+		tclc->tc_lineoffset++;
+	} else if (tclc->tc_line_size >= TCL_LINE_MAX) {
+		/* maximum line size reached, drop line */
+		tclc->tc_linedrop = 1;
+	} else {
+		/* grow line buffer: exponential below 1 MB, linear above */
+		if (tclc->tc_line_size <= 1*1024*1024)
+			tc_line_size_new = tclc->tc_line_size * 2;
+		else
+			tc_line_size_new = tclc->tc_line_size + 1*1024*1024;
 
-	tclc = connection->priv;
-	if (!tclc)
-		return ERROR_CONNECTION_REJECTED;
+		if (tc_line_size_new > TCL_LINE_MAX)
+			tc_line_size_new = TCL_LINE_MAX;
 
-	/* push as much data into the line as possible */
-	for (i = 0; i < rlen; i++) {
-		/* buffer the data */
-		tclc->tc_line[tclc->tc_lineoffset] = in[i];
-		if (tclc->tc_lineoffset + 1 < tclc->tc_line_size) {
-			tclc->tc_lineoffset++;
-		} else if (tclc->tc_line_size >= TCL_LINE_MAX) {
-			/* maximum line size reached, drop line */
+		tc_line_new = realloc(tclc->tc_line, tc_line_size_new);
+		if (!tc_line_new) {
 			tclc->tc_linedrop = 1;
 		} else {
-			/* grow line buffer: exponential below 1 MB, linear above */
-			if (tclc->tc_line_size <= 1*1024*1024)
-				tc_line_size_new = tclc->tc_line_size * 2;
-			else
-				tc_line_size_new = tclc->tc_line_size + 1*1024*1024;
-
-			if (tc_line_size_new > TCL_LINE_MAX)
-				tc_line_size_new = TCL_LINE_MAX;
+			tclc->tc_line = tc_line_new;
+			tclc->tc_line_size = tc_line_size_new;
+			tclc->tc_lineoffset++;
+		}
+	}
+}
 
-			tc_line_new = realloc(tclc->tc_line, tc_line_size_new);
-			if (!tc_line_new) {
-				tclc->tc_linedrop = 1;
-			} else {
-				tclc->tc_line = tc_line_new;
-				tclc->tc_line_size = tc_line_size_new;
-				tclc->tc_lineoffset++;
-			}
+/* Consume text input up to and including the end of the next command. */
+static int tcl_input_text(struct connection *connection, const unsigned char *in,
+		size_t len, size_t *used)
+{
+	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	struct tcl_connection *tclc = connection->priv;
+	const char *result;
+	int reslen;
+	int retval;
 
-		}
+	for (size_t i = 0; i < len; i++) {
+		/* buffer the data */
+		tcl_line_append(tclc, in[i]);
 
 		/* ctrl-z is end of command. When testing from telnet, just
 		 * press ctrl-z a couple of times first to put telnet into the
@@ -221,6 +243,8 @@ static int tcl_input(struct connection *connection)
 		if (in[i] != '\x1a')
 			continue;
 
+		*used = i + 1;
+
 		/* process the line */
 		if (tclc->tc_linedrop) {
 #define ESTR "line too long\n"
@@ -241,6 +265,203 @@ static int tcl_input(struct connection *connection)
 
 		tclc->tc_lineoffset = 0;
 		tclc->tc_linedrop = 0;
+		/* "tcl_framing on" applies to what follows its result */
+		tclc->tc_framed = tclc->tc_framing;
+		return ERROR_OK;
+	}
+
+	*used = len;
+	return ERROR_OK;
+}
+
+static int tcl_output_frame(struct connection *connection, uint32_t id, int status,
+		const void *data, size_t len)
+{
+	uint8_t header[TCL_FRAME_HEADER_SIZE];
+
+	h_u32_to_le(header, id);
+	h_u32_to_le(header + 4, status);
+	h_u32_to_le(header + 8, len);
+	int retval = tcl_output(connection, header, sizeof(header));
+	if (retval != ERROR_OK || !len)
+		return retval;
+	return tcl_output(connection, data, len);
+}
+
+/* Notifications are sent as is in text mode, and without the trailing
+ * \x1a in a frame of their own in framed mode. */
+static int tcl_output_async(struct connection *connection, const char *buf)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t len = strlen(buf);
+
+	if (!tclc->tc_framed)
+		return tcl_output(connection, buf, len);
+
+	if (len && buf[len - 1] == '\x1a')
+		len--;
+	return tcl_output_frame(connection, TCL_FRAME_ID_NOTIFICATION, ERROR_OK, buf, len);
+}
+
+static int tcl_frame_error(struct connection *connection, uint32_t id,
+		int status, const char *message)
+{
+	return tcl_output_frame(connection, id, status, message, strlen(message));
+}
+
+/* Read or write memory of the current target, the request starts with
+ * { uint64_t address, uint32_t size, uint32_t count } */
+static int tcl_frame_memory(struct connection *connection, uint32_t id,
+		uint32_t type, const uint8_t *payload, uint32_t len)
+{
+	if (len < TCL_FRAME_MEMORY_HEADER_SIZE)
+		return tcl_frame_error(connection, id, ERROR_COMMAND_SYNTAX_ERROR,
+				"short memory request");
+
+	const target_addr_t address = le_to_h_u64(payload);
+	const uint32_t size = le_to_h_u32(payload + 8);
+	const uint32_t count = le_to_h_u32(payload + 12);
+	const uint64_t bytes = (uint64_t)size * count;
+
+	if ((size != 1 && size != 2 && size != 4 && size != 8) || bytes > TCL_LINE_MAX)
+		return tcl_frame_error(connection, id, ERROR_COMMAND_ARGUMENT_INVALID,
+				"invalid memory access size or count");
+
+	struct target *target = get_current_target_or_null(connection->cmd_ctx);
+	if (!target)
+		return tcl_frame_error(connection, id, ERROR_FAIL, "no current target");
+
+	if (type == TCL_FRAME_WRITE_MEMORY) {
+		if (len - TCL_FRAME_MEMORY_HEADER_SIZE != bytes)
+			return tcl_frame_error(connection, id, ERROR_COMMAND_SYNTAX_ERROR,
+					"written data doesn't match size and count");
+		int retval = target_write_memory(target, address, size, count,
+				payload + TCL_FRAME_MEMORY_HEADER_SIZE);
+		return tcl_output_frame(connection, id, retval, NULL, 0);
+	}
+
+	uint8_t *buffer = malloc(bytes ? bytes : 1);
+	if (!buffer)
+		return tcl_frame_error(connection, id, ERROR_FAIL, "out of memory");
+	int retval = target_read_memory(target, address, size, count, buffer);
+	if (retval == ERROR_OK)
+		retval = tcl_output_frame(connection, id, ERROR_OK, buffer, bytes);
+	else
+		retval = tcl_output_frame(connection, id, retval, NULL, 0);
+	free(buffer);
+	return retval;
+}
+
+static int tcl_process_frame(struct connection *connection)
+{
+	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	struct tcl_connection *tclc = connection->priv;
+	uint8_t *frame = (uint8_t *)tclc->tc_line;
+	const uint32_t id = le_to_h_u32(frame);
+	const uint32_t type = le_to_h_u32(frame + 4);
+	const uint32_t len = le_to_h_u32(frame + 8);
+	uint8_t *payload = frame + TCL_FRAME_HEADER_SIZE;
+
+	if (tclc->tc_linedrop)
+		return tcl_frame_error(connection, id, ERROR_FAIL, "frame too long");
+
+	switch (type) {
+	case TCL_FRAME_COMMAND: {
+		/* there's always room for the terminator, see tcl_input_frame() */
+		payload[len] = '\0';
+		int retval = command_run_line(connection->cmd_ctx, (char *)payload);
+		int reslen;
+		const char *result = Jim_GetString(Jim_GetResult(interp), &reslen);
+		return tcl_output_frame(connection, id, retval, result, reslen);
+	}
+	case TCL_FRAME_READ_MEMORY:
+	case TCL_FRAME_WRITE_MEMORY:
+		return tcl_frame_memory(connection, id, type, payload, len);
+	default:
+		return tcl_frame_error(connection, id, ERROR_COMMAND_SYNTAX_ERROR,
+				"unknown frame type");
+	}
+}
+
+/* Consume framed input up to and including the end of the next frame.
+ * Only the bytes of the current frame are buffered, so that a switch back
+ * to text mode applies right after it. */
+static int tcl_input_frame(struct connection *connection, const unsigned char *in,
+		size_t len, size_t *used)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t i = 0;
+
+	while (i < len) {
+		if (tclc->tc_frame_received < TCL_FRAME_HEADER_SIZE) {
+			tclc->tc_line[tclc->tc_frame_received++] = in[i++];
+			if (tclc->tc_frame_received < TCL_FRAME_HEADER_SIZE)
+				continue;
+
+			tclc->tc_frame_size = TCL_FRAME_HEADER_SIZE +
+				(size_t)le_to_h_u32((uint8_t *)tclc->tc_line + 8);
+			/* room for a terminator after the payload of commands */
+			if (tclc->tc_frame_size + 1 > TCL_LINE_MAX) {
+				tclc->tc_linedrop = 1;
+			} else if (tclc->tc_frame_size + 1 > (size_t)tclc->tc_line_size) {
+				char *tc_line_new = realloc(tclc->tc_line, tclc->tc_frame_size + 1);
+				if (tc_line_new) {
+					tclc->tc_line = tc_line_new;
+					tclc->tc_line_size = tclc->tc_frame_size + 1;
+				} else {
+					tclc->tc_linedrop = 1;
+				}
+			}
+		} else {
+			size_t n = MIN(len - i, tclc->tc_frame_size - tclc->tc_frame_received);
+			if (!tclc->tc_linedrop)
+				memcpy(tclc->tc_line + tclc->tc_frame_received, in + i, n);
+			tclc->tc_frame_received += n;
+			i += n;
+		}
+
+		if (tclc->tc_frame_received < tclc->tc_frame_size)
+			continue;
+
+		int retval = tcl_process_frame(connection);
+		tclc->tc_frame_received = 0;
+		tclc->tc_linedrop = 0;
+		tclc->tc_framed = tclc->tc_framing;
+		*used = i;
+		return retval;
+	}
+
+	*used = len;
+	return ERROR_OK;
+}
+
+static int tcl_input(struct connection *connection)
+{
+	ssize_t rlen;
+	struct tcl_connection *tclc;
+	unsigned char in[4096];
+
+	rlen = connection_read(connection, &in, sizeof(in));
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	tclc = connection->priv;
+	if (!tclc)
+		return ERROR_CONNECTION_REJECTED;
+
+	/* Handle every command of the data read, pipelined requests are
+	 * answered with a single write in the end thanks to buffered output */
+	for (size_t offset = 0; offset < (size_t)rlen; ) {
+		size_t used;
+		int retval = tclc->tc_framed ?
+			tcl_input_frame(connection, in + offset, rlen - offset, &used) :
+			tcl_input_text(connection, in + offset, rlen - offset, &used);
+		if (retval != ERROR_OK)
+			return retval;
+		offset += used;
 	}
 
 	return ERROR_OK;
@@ -272,6 +493,7 @@ static const struct service_driver tcl_service_driver = {
 	.input_handler = tcl_input,
 	.connection_closed_handler = tcl_closed,
 	.keep_client_alive_handler = NULL,
+	.buffered_output = true,
 };
 
 int tcl_init(void)
@@ -323,6 +545,23 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 	}
 }
 
+COMMAND_HANDLER(handle_tcl_framing_command)
+{
+	struct connection *connection = NULL;
+	struct tcl_connection *tclc = NULL;
+
+	if (CMD_CTX->output_handler_priv)
+		connection = CMD_CTX->output_handler_priv;
+
+	if (connection && !strcmp(connection->service->name, "tcl")) {
+		tclc = connection->priv;
+		return CALL_COMMAND_HANDLER(handle_command_parse_bool, &tclc->tc_framing, "Framed protocol ");
+	} else {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+}
+
 static const struct command_registration tcl_command_handlers[] = {
 	{
 		.name = "tcl_port",
@@ -347,6 +586,13 @@ static const struct command_registration tcl_command_handlers[] = {
 		.help = "Target trace output",
 		.usage = "[on|off]",
 	},
+	{
+		.name = "tcl_framing",
+		.handler = handle_tcl_framing_command,
+		.mode = COMMAND_EXEC,
+		.help = "Switch this connection to the framed binary protocol",
+		.usage = "[on|off]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -98,8 +98,6 @@ static void telnet_log_callback(void *priv, const char *file, unsigned line,
 {
 	struct connection *connection = priv;
 	struct telnet_connection *t_con = connection->priv;
-	size_t i;
-	size_t tmp;
 
 	/* If the prompt is not visible, simply output the message. */
 	if (!t_con->prompt_visible) {
@@ -107,28 +105,38 @@ static void telnet_log_callback(void *priv, const char *file, unsigned line,
 		return;
 	}
 
-	/* Clear the command line. */
-	tmp = strlen(t_con->prompt) + t_con->line_size;
-
-	for (i = 0; i < tmp; i += 16)
-		telnet_write(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b",
-			MIN(tmp - i, 16));
+	/* Clear the command line once for all the messages logged until the
+	 * end of the server loop iteration, see telnet_show_prompt(). */
+	if (!t_con->prompt_hidden) {
+		size_t len = strlen(t_con->prompt) + t_con->line_size;
+
+		/* the prompt is always placed at the line beginning */
+		telnet_write(connection, "\r", 1);
+		for (size_t i = 0; i < len; i += 16)
+			telnet_write(connection, "                ", MIN(len - i, 16));
+		telnet_write(connection, "\r", 1);
+		t_con->prompt_hidden = true;
+	}
 
-	for (i = 0; i < tmp; i += 16)
-		telnet_write(connection, "                ", MIN(tmp - i, 16));
+	telnet_outputline(connection, string);
+}
 
-	for (i = 0; i < tmp; i += 16)
-		telnet_write(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b",
-			MIN(tmp - i, 16));
+/* Put the command line back to its state before log messages erased it. */
+static void telnet_show_prompt(struct connection *connection)
+{
+	struct telnet_connection *t_con = connection->priv;
 
-	telnet_outputline(connection, string);
+	if (!t_con->prompt_hidden)
+		return;
+	t_con->prompt_hidden = false;
 
-	/* Put the command line to its previous state. */
 	telnet_prompt(connection);
 	telnet_write(connection, t_con->line, t_con->line_size);
 
-	for (i = t_con->line_cursor; i < t_con->line_size; i++)
-		telnet_write(connection, "\b", 1);
+	size_t len = t_con->line_size - t_con->line_cursor;
+	for (size_t i = 0; i < len; i += 16)
+		telnet_write(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b",
+			MIN(len - i, 16));
 }
 
 static void telnet_load_history(struct telnet_connection *t_con)
@@ -765,6 +773,9 @@ static int telnet_input(struct connection *connection)
 
 	buf_p = buffer;
 	while (bytes_read) {
+		/* edit the command line where the user sees it */
+		telnet_show_prompt(connection);
+
 		switch (t_con->state) {
 			case TELNET_STATE_DATA:
 				if (*buf_p == 0xff) {
@@ -937,6 +948,8 @@ static const struct service_driver telnet_service_driver = {
 	.input_handler = telnet_input,
 	.connection_closed_handler = telnet_connection_closed,
 	.keep_client_alive_handler = NULL,
+	.buffered_output = true,
+	.flush_handler = telnet_show_prompt,
 };
 
 int telnet_init(char *banner)
@@ -36,6 +36,8 @@ enum telnet_states {
 struct telnet_connection {
 	char *prompt;
 	bool prompt_visible;
+	/* prompt erased for log messages, redrawn by telnet_show_prompt() */
+	bool prompt_hidden;
 	enum telnet_states state;
 	char line[TELNET_LINE_MAX_SIZE];
 	size_t line_size;
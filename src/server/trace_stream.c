@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Ring buffered forwarding of trace data to TCP clients, see trace_stream.h.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "server.h"
+#include "trace_stream.h"
+
+struct trace_stream_client {
+	struct connection *connection;
+	/* Position in the ring, in terms of trace_stream.head */
+	uint64_t pos;
+	uint64_t lost;
+	struct trace_stream_client *next;
+};
+
+struct trace_stream {
+	char *name;
+	uint8_t *ring;
+	size_t size;
+	/* Free running count of the bytes pushed */
+	uint64_t head;
+	unsigned int num_clients;
+	struct trace_stream_client *clients;
+};
+
+struct trace_stream *trace_stream_new(const char *name, size_t size)
+{
+	struct trace_stream *stream = calloc(1, sizeof(*stream));
+	if (!stream)
+		goto fail;
+
+	stream->name = strdup(name);
+	stream->ring = malloc(size);
+	if (!stream->name || !stream->ring)
+		goto fail;
+	stream->size = size;
+
+	return stream;
+
+fail:
+	LOG_ERROR("Out of memory");
+	trace_stream_free(stream);
+	return NULL;
+}
+
+void trace_stream_free(struct trace_stream *stream)
+{
+	if (!stream)
+		return;
+
+	while (stream->clients)
+		trace_stream_unsubscribe(stream, stream->clients->connection);
+
+	free(stream->ring);
+	free(stream->name);
+	free(stream);
+}
+
+static bool socket_would_block(struct connection *connection)
+{
+	if (connection->service->type != CONNECTION_TCP)
+		return errno == EAGAIN;
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* Send as much of the ring as the client takes without blocking */
+static void trace_stream_drain_client(struct trace_stream *stream,
+		struct trace_stream_client *client)
+{
+	if (stream->head - client->pos > stream->size) {
+		uint64_t lost = stream->head - client->pos - stream->size;
+
+		if (!client->lost)
+			LOG_WARNING("%s: client is too slow, dropping data", stream->name);
+
+		client->lost += lost;
+		client->pos += lost;
+	}
+
+	while (client->pos != stream->head) {
+		size_t offset = client->pos % stream->size;
+		size_t len = MIN(stream->head - client->pos, stream->size - offset);
+		int ret = connection_write(client->connection, stream->ring + offset, len);
+
+		if (ret < 0) {
+			/* a broken connection is noticed and closed by its input handler */
+			if (!socket_would_block(client->connection))
+				LOG_DEBUG("%s: write failed: %s", stream->name, strerror(errno));
+			break;
+		}
+
+		client->pos += ret;
+	}
+}
+
+void trace_stream_drain(struct trace_stream *stream)
+{
+	for (struct trace_stream_client *c = stream->clients; c; c = c->next)
+		trace_stream_drain_client(stream, c);
+}
+
+void trace_stream_push(struct trace_stream *stream, const void *data, size_t len)
+{
+	const uint8_t *buf = data;
+
+	/* Only the tail end of the data fits */
+	if (len > stream->size) {
+		stream->head += len - stream->size;
+		buf += len - stream->size;
+		len = stream->size;
+	}
+
+	size_t offset = stream->head % stream->size;
+	size_t first = MIN(len, stream->size - offset);
+
+	memcpy(stream->ring + offset, buf, first);
+	memcpy(stream->ring, buf + first, len - first);
+	stream->head += len;
+
+	trace_stream_drain(stream);
+}
+
+int trace_stream_subscribe(struct trace_stream *stream,
+		struct connection *connection, size_t replay)
+{
+	struct trace_stream_client *client = malloc(sizeof(*client));
+	if (!client) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	replay = MIN(replay, stream->size);
+	client->connection = connection;
+	client->pos = stream->head - MIN(stream->head, replay);
+	client->lost = 0;
+	client->next = stream->clients;
+	stream->clients = client;
+	stream->num_clients++;
+
+	trace_stream_drain_client(stream, client);
+
+	return ERROR_OK;
+}
+
+void trace_stream_unsubscribe(struct trace_stream *stream,
+		struct connection *connection)
+{
+	for (struct trace_stream_client **p = &stream->clients; *p; p = &(*p)->next) {
+		struct trace_stream_client *client = *p;
+
+		if (client->connection != connection)
+			continue;
+
+		if (client->lost)
+			LOG_WARNING("%s: client lost %" PRIu64 " bytes", stream->name,
+				client->lost);
+
+		*p = client->next;
+		stream->num_clients--;
+		free(client);
+		return;
+	}
+}
+
+unsigned int trace_stream_subscribers(const struct trace_stream *stream)
+{
+	return stream->num_clients;
+}
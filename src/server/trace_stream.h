@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_SERVER_TRACE_STREAM_H
+#define OPENOCD_SERVER_TRACE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Host side ring buffer for a stream of trace data (RTT, SWO, ...) forwarded
+ * to TCP clients. The producer pushes the data once, each subscribed
+ * connection drains the ring at its own pace with non-blocking writes, so a
+ * slow client neither blocks the producer nor the other clients. A client
+ * that falls behind by more than the ring size loses the oldest data; the
+ * loss is accounted per client and reported in the log.
+ */
+
+struct connection;
+struct trace_stream;
+
+/** Create a stream named @a name (used in log messages) keeping @a size bytes. */
+struct trace_stream *trace_stream_new(const char *name, size_t size);
+
+/** Free the stream, which must not have subscribers anymore. */
+void trace_stream_free(struct trace_stream *stream);
+
+/** Append data to the stream and send what the clients take right away. */
+void trace_stream_push(struct trace_stream *stream, const void *data, size_t len);
+
+/** Retry sending pending data to all clients. */
+void trace_stream_drain(struct trace_stream *stream);
+
+/**
+ * Start sending the stream to @a connection. If @a replay is not zero, up
+ * to that many bytes of the most recent data are sent first.
+ */
+int trace_stream_subscribe(struct trace_stream *stream,
+		struct connection *connection, size_t replay);
+
+/** Stop sending the stream to @a connection. */
+void trace_stream_unsubscribe(struct trace_stream *stream,
+		struct connection *connection);
+
+/** Number of connections the stream is sent to. */
+unsigned int trace_stream_subscribers(const struct trace_stream *stream);
+
+#endif /* OPENOCD_SERVER_TRACE_STREAM_H */
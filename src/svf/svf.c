@@ -199,15 +199,22 @@ struct svf_check_tdo_para {
 	int enabled;		/* check is enabled or not */
 	int buffer_offset;	/* buffer_offset to buffers */
 	int bit_len;		/* bit length to check */
+	int body_len;		/* bit length of the SIR/SDR data of one device */
+	bool ir;			/* scan is SIR, else SDR */
 };
 
+/* Initial number of checks, the array grows as needed */
 #define SVF_CHECK_TDO_PARA_SIZE 1024
+/* Scans queued before the queue is executed, each one has a check */
+#define SVF_MAX_CHECKS_TO_COMMIT (16 * 1024)
 static struct svf_check_tdo_para *svf_check_tdo_para;
 static int svf_check_tdo_para_index;
+static int svf_check_tdo_para_size;
 
 static int svf_read_command_from_file(FILE *fd);
 static int svf_check_tdo(void);
-static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
+static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len,
+		int body_len, bool ir);
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
 static int svf_execute_tap(void);
 
@@ -232,6 +239,17 @@ static int svf_addcycles;
 static int svf_tap_is_specified;
 static int svf_set_padding(struct svf_xxr_para *para, int len, unsigned char tdi);
 
+/*
+ * Identical taps targeted by the same SIR/SDR data, sorted by chain
+ * position. The bypass paddings between two of them go to the gaps, the
+ * ones before the first and after the last to HIR/HDR and TIR/TDR.
+ */
+#define SVF_MAX_TAPS 32
+static struct jtag_tap *svf_taps[SVF_MAX_TAPS];
+static unsigned int svf_num_taps;
+static struct svf_xxr_para svf_gap_ir_para[SVF_MAX_TAPS - 1];
+static struct svf_xxr_para svf_gap_dr_para[SVF_MAX_TAPS - 1];
+
 /* Progress Indicator */
 static int svf_progress_enabled;
 static long svf_total_lines;
@@ -253,6 +271,9 @@ static void svf_hexbuf_print(int dbg_lvl, const char *file, unsigned line,
 	int byte_len = DIV_ROUND_UP(bit_len, 8);
 	int msbits = bit_len % 8;
 
+	if (!LOG_LEVEL_IS(dbg_lvl))
+		return;
+
 	/* allocate 2 bytes per hex digit */
 	char *prbuf = malloc((byte_len * 2) + 2 + 1);
 	if (!prbuf)
@@ -378,21 +399,100 @@ static const struct nvp svf_cmd_opts[] = {
 	{ .name = NULL,            .value = -1 }
 };
 
+static int svf_add_tap(struct command_invocation *cmd, const char *name)
+{
+	struct jtag_tap *tap = jtag_tap_by_string(name);
+	if (!tap) {
+		command_print(cmd, "Tap: %s unknown", name);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (svf_num_taps == SVF_MAX_TAPS) {
+		command_print(cmd, "at most %d taps can be targeted", SVF_MAX_TAPS);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	/* The same SIR data is shifted into every one of them */
+	if (svf_num_taps && tap->ir_length != svf_taps[0]->ir_length) {
+		command_print(cmd, "Tap: %s has an IR length of %d, %s of %d",
+				tap->dotted_name, tap->ir_length,
+				svf_taps[0]->dotted_name, svf_taps[0]->ir_length);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	/* Keep the list sorted by chain position */
+	unsigned int i = svf_num_taps;
+	while (i > 0 && svf_taps[i - 1]->abs_chain_position >= tap->abs_chain_position) {
+		if (svf_taps[i - 1] == tap) {
+			command_print(cmd, "Tap: %s specified twice", name);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		i--;
+	}
+	memmove(&svf_taps[i + 1], &svf_taps[i], (svf_num_taps - i) * sizeof(*svf_taps));
+	svf_taps[i] = tap;
+	svf_num_taps++;
+
+	return ERROR_OK;
+}
+
+/* Bypass all taps but svf_taps, see HIR/HDR/TIR/TDR in the SVF spec */
+static int svf_set_tap_paddings(void)
+{
+	int header_ir_len = 0, header_dr_len = 0, trailer_ir_len = 0, trailer_dr_len = 0;
+	int gap_ir_len[SVF_MAX_TAPS - 1] = { 0 }, gap_dr_len[SVF_MAX_TAPS - 1] = { 0 };
+	unsigned int next = 0;
+	int ret = ERROR_OK;
+
+	svf_tap_is_specified = 1;
+
+	for (struct jtag_tap *tap = jtag_all_taps(); tap; tap = tap->next_tap) {
+		if (next < svf_num_taps && tap == svf_taps[next]) {
+			next++;
+		} else if (next == 0) {
+			/* Header */
+			header_ir_len += tap->ir_length;
+			header_dr_len++;
+		} else if (next == svf_num_taps) {
+			/* Trailer */
+			trailer_ir_len += tap->ir_length;
+			trailer_dr_len++;
+		} else {
+			/* Between svf_taps[next - 1] and svf_taps[next] */
+			gap_ir_len[next - 1] += tap->ir_length;
+			gap_dr_len[next - 1]++;
+		}
+	}
+
+	/* HDR %d TDI (0), HIR %d TDI (0xFF), TDR %d TDI (0), TIR %d TDI (0xFF) */
+	ret |= svf_set_padding(&svf_para.hdr_para, header_dr_len, 0);
+	ret |= svf_set_padding(&svf_para.hir_para, header_ir_len, 0xFF);
+	ret |= svf_set_padding(&svf_para.tdr_para, trailer_dr_len, 0);
+	ret |= svf_set_padding(&svf_para.tir_para, trailer_ir_len, 0xFF);
+	for (unsigned int i = 0; i + 1 < svf_num_taps; i++) {
+		ret |= svf_set_padding(&svf_gap_dr_para[i], gap_dr_len[i], 0);
+		ret |= svf_set_padding(&svf_gap_ir_para[i], gap_ir_len[i], 0xFF);
+	}
+
+	return ret;
+}
+
 COMMAND_HANDLER(handle_svf_command)
 {
 #define SVF_MIN_NUM_OF_OPTIONS 1
-#define SVF_MAX_NUM_OF_OPTIONS 8
+#define SVF_MAX_NUM_OF_OPTIONS (8 + 2 * (SVF_MAX_TAPS - 1))
 	int command_num = 0;
 	int ret = ERROR_OK;
 	int64_t time_measure_ms;
 	int time_measure_s, time_measure_m;
 
 	/*
-	 * use NULL to indicate a "plain" svf file which accounts for
-	 * any additional devices in the scan chain, otherwise the device
-	 * that should be affected
+	 * no tap indicates a "plain" svf file which accounts for any
+	 * additional devices in the scan chain, otherwise the devices
+	 * that should be affected are put in svf_taps
 	 */
-	struct jtag_tap *tap = NULL;
+	svf_num_taps = 0;
+	svf_tap_is_specified = 0;
 
 	if ((CMD_ARGC < SVF_MIN_NUM_OF_OPTIONS) || (CMD_ARGC > SVF_MAX_NUM_OF_OPTIONS))
 		return ERROR_COMMAND_SYNTAX_ERROR;
@@ -421,13 +521,18 @@ COMMAND_HANDLER(handle_svf_command)
 			break;
 
 		case OPT_TAP:
-			tap = jtag_tap_by_string(CMD_ARGV[i+1]);
-			if (!tap) {
-				command_print(CMD, "Tap: %s unknown", CMD_ARGV[i+1]);
+			if (i + 1 >= CMD_ARGC) {
 				if (svf_fd)
 					fclose(svf_fd);
 				svf_fd = NULL;
-				return ERROR_COMMAND_ARGUMENT_INVALID;
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			}
+			ret = svf_add_tap(CMD, CMD_ARGV[i + 1]);
+			if (ret != ERROR_OK) {
+				if (svf_fd)
+					fclose(svf_fd);
+				svf_fd = NULL;
+				return ret;
 			}
 			i++;
 			break;
@@ -488,7 +593,8 @@ COMMAND_HANDLER(handle_svf_command)
 	svf_command_buffer_size = 0;
 
 	svf_check_tdo_para_index = 0;
-	svf_check_tdo_para = malloc(sizeof(struct svf_check_tdo_para) * SVF_CHECK_TDO_PARA_SIZE);
+	svf_check_tdo_para_size = SVF_CHECK_TDO_PARA_SIZE;
+	svf_check_tdo_para = malloc(sizeof(struct svf_check_tdo_para) * svf_check_tdo_para_size);
 	if (!svf_check_tdo_para) {
 		LOG_ERROR("not enough memory");
 		ret = ERROR_FAIL;
@@ -512,52 +618,15 @@ COMMAND_HANDLER(handle_svf_command)
 		jtag_add_tlr();
 	}
 
-	if (tap) {
-		/* Tap is specified, set header/trailer paddings */
-		int header_ir_len = 0, header_dr_len = 0, trailer_ir_len = 0, trailer_dr_len = 0;
-		struct jtag_tap *check_tap;
-
-		svf_tap_is_specified = 1;
-
-		for (check_tap = jtag_all_taps(); check_tap; check_tap = check_tap->next_tap) {
-			if (check_tap->abs_chain_position < tap->abs_chain_position) {
-				/* Header */
-				header_ir_len += check_tap->ir_length;
-				header_dr_len++;
-			} else if (check_tap->abs_chain_position > tap->abs_chain_position) {
-				/* Trailer */
-				trailer_ir_len += check_tap->ir_length;
-				trailer_dr_len++;
-			}
-		}
-
-		/* HDR %d TDI (0) */
-		ret = svf_set_padding(&svf_para.hdr_para, header_dr_len, 0);
-		if (ret != ERROR_OK) {
-			command_print(CMD, "failed to set data header");
-			goto free_all;
-		}
-
-		/* HIR %d TDI (0xFF) */
-		ret = svf_set_padding(&svf_para.hir_para, header_ir_len, 0xFF);
-		if (ret != ERROR_OK) {
-			command_print(CMD, "failed to set instruction header");
-			goto free_all;
-		}
-
-		/* TDR %d TDI (0) */
-		ret = svf_set_padding(&svf_para.tdr_para, trailer_dr_len, 0);
-		if (ret != ERROR_OK) {
-			command_print(CMD, "failed to set data trailer");
-			goto free_all;
-		}
-
-		/* TIR %d TDI (0xFF) */
-		ret = svf_set_padding(&svf_para.tir_para, trailer_ir_len, 0xFF);
+	if (svf_num_taps) {
+		/* Taps are specified, set header/trailer paddings */
+		ret = svf_set_tap_paddings();
 		if (ret != ERROR_OK) {
-			command_print(CMD, "failed to set instruction trailer");
+			command_print(CMD, "failed to set paddings");
 			goto free_all;
 		}
+		if (svf_num_taps > 1)
+			LOG_INFO("programming %u devices at once", svf_num_taps);
 	}
 
 	if (svf_progress_enabled) {
@@ -625,6 +694,7 @@ free_all:
 	free(svf_check_tdo_para);
 	svf_check_tdo_para = NULL;
 	svf_check_tdo_para_index = 0;
+	svf_check_tdo_para_size = 0;
 
 	free(svf_tdi_buffer);
 	svf_tdi_buffer = NULL;
@@ -644,6 +714,14 @@ free_all:
 	svf_free_xxd_para(&svf_para.tir_para);
 	svf_free_xxd_para(&svf_para.sdr_para);
 	svf_free_xxd_para(&svf_para.sir_para);
+	for (unsigned int i = 0; i < ARRAY_SIZE(svf_gap_ir_para); i++) {
+		svf_free_xxd_para(&svf_gap_ir_para[i]);
+		svf_gap_ir_para[i].len = 0;
+		svf_free_xxd_para(&svf_gap_dr_para[i]);
+		svf_gap_dr_para[i].len = 0;
+	}
+	svf_num_taps = 0;
+	svf_tap_is_specified = 0;
 
 	if (ret == ERROR_OK)
 		command_print(CMD,
@@ -660,7 +738,7 @@ free_all:
 
 static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 {
-#define MIN_CHUNK 16	/* Buffer is increased by this size each time as required */
+#define MIN_CHUNK 16	/* Initial buffer size, doubled each time as required */
 	size_t i = 0;
 
 	if (!*lineptr) {
@@ -670,22 +748,31 @@ static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 			return -1;
 	}
 
-	(*lineptr)[0] = fgetc(stream);
-	while ((*lineptr)[i] != '\n') {
-		(*lineptr)[++i] = fgetc(stream);
-		if (feof(stream)) {
+	/* Lines holding a long bit string can be megabytes, read them in
+	 * as large chunks as the buffer allows */
+	while (true) {
+		if (*n - i < 2) {
+			char *line = realloc(*lineptr, 2 * *n);
+			if (!line)
+				return -1;
+			*lineptr = line;
+			*n *= 2;
+		}
+
+		if (!fgets(*lineptr + i, *n - i, stream)) {
 			(*lineptr)[0] = 0;
 			return -1;
 		}
-		if ((i + 2) > *n) {
-			*n += MIN_CHUNK;
-			*lineptr = realloc(*lineptr, *n);
+		i += strlen(*lineptr + i);
+
+		if (i > 0 && (*lineptr)[i - 1] == '\n')
+			return i;
+		/* An unterminated last line is ignored */
+		if (feof(stream)) {
+			(*lineptr)[0] = 0;
+			return -1;
 		}
 	}
-
-	(*lineptr)[++i] = 0;
-
-	return sizeof(*lineptr);
 }
 
 #define SVFP_CMD_INC_CNT 1024
@@ -749,12 +836,14 @@ static int svf_read_command_from_file(FILE *fd)
 				 *  - terminating NUL ('\0')
 				 */
 				if (cmd_pos + 3 > svf_command_buffer_size) {
-					svf_command_buffer = realloc(svf_command_buffer, cmd_pos + 3);
-					svf_command_buffer_size = cmd_pos + 3;
-					if (!svf_command_buffer) {
+					size_t size = MAX(2 * svf_command_buffer_size, SVFP_CMD_INC_CNT);
+					char *buffer = realloc(svf_command_buffer, size);
+					if (!buffer) {
 						LOG_ERROR("not enough memory");
 						return ERROR_FAIL;
 					}
+					svf_command_buffer = buffer;
+					svf_command_buffer_size = size;
 				}
 
 				/* insert a space before '(' */
@@ -873,6 +962,17 @@ static int svf_copy_hexstring_to_binary(char *str, uint8_t **bin, int orig_bit_l
 
 	/* fill from LSB (end of str) to MSB (beginning of str) */
 	for (i = 0; i < str_hbyte_len; i++) {
+		/* Long bit strings rarely have whitespace, take a whole byte at once
+		 * while both of its digits are there */
+		while (!(i % 2) && i + 1 < str_hbyte_len && str_len >= 2 &&
+				unhexify(&(*bin)[i / 2], &str[str_len - 2], 1) == 1) {
+			ch = (*bin)[i / 2] >> 4;
+			str_len -= 2;
+			i += 2;
+		}
+		if (i == str_hbyte_len)
+			break;
+
 		ch = 0;
 		while (str_len > 0) {
 			ch = str[--str_len];
@@ -924,6 +1024,84 @@ static int svf_copy_hexstring_to_binary(char *str, uint8_t **bin, int orig_bit_l
 	return ERROR_OK;
 }
 
+static const uint8_t *svf_xxr_data(const struct svf_xxr_para *para, int data)
+{
+	switch (data) {
+	case XXR_TDO:
+		return para->tdo;
+	case XXR_MASK:
+		return para->mask;
+	default:
+		return para->tdi;
+	}
+}
+
+/*
+ * Assemble the TDI, TDO or MASK data of a chain wide SIR or SDR scan in
+ * @a buf: the header, the SIR/SDR data once per targeted tap with the
+ * gaps in between, then the trailer. Returns the length in bits.
+ */
+static int svf_assemble_scan(uint8_t *buf, bool ir, int data)
+{
+	const struct svf_xxr_para *header = ir ? &svf_para.hir_para : &svf_para.hdr_para;
+	const struct svf_xxr_para *body = ir ? &svf_para.sir_para : &svf_para.sdr_para;
+	const struct svf_xxr_para *trailer = ir ? &svf_para.tir_para : &svf_para.tdr_para;
+	const struct svf_xxr_para *gaps = ir ? svf_gap_ir_para : svf_gap_dr_para;
+	const unsigned int copies = MAX(svf_num_taps, 1U);
+	int i = 0;
+
+	buf_set_buf(svf_xxr_data(header, data), 0, buf, i, header->len);
+	i += header->len;
+	for (unsigned int n = 0; n < copies; n++) {
+		if (n > 0) {
+			buf_set_buf(svf_xxr_data(&gaps[n - 1], data), 0, buf, i, gaps[n - 1].len);
+			i += gaps[n - 1].len;
+		}
+		buf_set_buf(svf_xxr_data(body, data), 0, buf, i, body->len);
+		i += body->len;
+	}
+	buf_set_buf(svf_xxr_data(trailer, data), 0, buf, i, trailer->len);
+	i += trailer->len;
+
+	return i;
+}
+
+static int svf_scan_length(bool ir)
+{
+	const struct svf_xxr_para *gaps = ir ? svf_gap_ir_para : svf_gap_dr_para;
+	int len = ir ? svf_para.hir_para.len + svf_para.tir_para.len
+		: svf_para.hdr_para.len + svf_para.tdr_para.len;
+
+	len += MAX(svf_num_taps, 1U) * (ir ? svf_para.sir_para.len : svf_para.sdr_para.len);
+	for (unsigned int n = 1; n < svf_num_taps; n++)
+		len += gaps[n - 1].len;
+
+	return len;
+}
+
+/* Tell which of the targeted taps failed a TDO check */
+static void svf_log_failed_taps(const struct svf_check_tdo_para *check)
+{
+	const uint8_t *read = &svf_tdi_buffer[check->buffer_offset];
+	const uint8_t *want = &svf_tdo_buffer[check->buffer_offset];
+	const uint8_t *mask = &svf_mask_buffer[check->buffer_offset];
+	const struct svf_xxr_para *gaps = check->ir ? svf_gap_ir_para : svf_gap_dr_para;
+	int offset = check->ir ? svf_para.hir_para.len : svf_para.hdr_para.len;
+
+	for (unsigned int n = 0; n < svf_num_taps; n++) {
+		if (n > 0)
+			offset += gaps[n - 1].len;
+		for (int bit = offset; bit < offset + check->body_len; bit++) {
+			if (buf_get_u32(mask, bit, 1) &&
+					buf_get_u32(read, bit, 1) != buf_get_u32(want, bit, 1)) {
+				LOG_ERROR("tdo check error on tap %s", svf_taps[n]->dotted_name);
+				break;
+			}
+		}
+		offset += check->body_len;
+	}
+}
+
 static int svf_check_tdo(void)
 {
 	int i, len, index_var;
@@ -936,6 +1114,8 @@ static int svf_check_tdo(void)
 				&svf_mask_buffer[index_var], len)) {
 			LOG_ERROR("tdo check error at line %d",
 				svf_check_tdo_para[i].line_num);
+			if (svf_num_taps > 1)
+				svf_log_failed_taps(&svf_check_tdo_para[i]);
 			SVF_BUF_LOG(ERROR, &svf_tdi_buffer[index_var], len, "READ");
 			SVF_BUF_LOG(ERROR, &svf_tdo_buffer[index_var], len, "WANT");
 			SVF_BUF_LOG(ERROR, &svf_mask_buffer[index_var], len, "MASK");
@@ -951,17 +1131,26 @@ static int svf_check_tdo(void)
 	return ERROR_OK;
 }
 
-static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
+static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len,
+		int body_len, bool ir)
 {
-	if (svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE) {
-		LOG_ERROR("toooooo many operation undone");
-		return ERROR_FAIL;
+	if (svf_check_tdo_para_index >= svf_check_tdo_para_size) {
+		struct svf_check_tdo_para *para = realloc(svf_check_tdo_para,
+				2 * sizeof(*para) * svf_check_tdo_para_size);
+		if (!para) {
+			LOG_ERROR("not enough memory");
+			return ERROR_FAIL;
+		}
+		svf_check_tdo_para = para;
+		svf_check_tdo_para_size *= 2;
 	}
 
 	svf_check_tdo_para[svf_check_tdo_para_index].line_num = svf_line_number;
 	svf_check_tdo_para[svf_check_tdo_para_index].bit_len = bit_len;
 	svf_check_tdo_para[svf_check_tdo_para_index].enabled = enabled;
 	svf_check_tdo_para[svf_check_tdo_para_index].buffer_offset = buffer_offset;
+	svf_check_tdo_para[svf_check_tdo_para_index].body_len = body_len;
+	svf_check_tdo_para[svf_check_tdo_para_index].ir = ir;
 	svf_check_tdo_para_index++;
 
 	return ERROR_OK;
@@ -1186,10 +1375,12 @@ xxr_common:
 				memset(xxr_para_tmp->mask, 0, (xxr_para_tmp->len + 7) >> 3);
 			}
 			/* do scan if necessary */
-			if (command == SDR) {
+			if (command == SDR || command == SIR) {
+				const bool ir = command == SIR;
+				const struct svf_xxr_para *body = ir ? &svf_para.sir_para : &svf_para.sdr_para;
+
 				/* check buffer size first, reallocate if necessary */
-				i = svf_para.hdr_para.len + svf_para.sdr_para.len +
-						svf_para.tdr_para.len;
+				i = svf_scan_length(ir);
 				if ((svf_buffer_size - svf_buffer_index) < ((i + 7) >> 3)) {
 					/* reallocate buffer */
 					if (svf_realloc_buffers(svf_buffer_index + ((i + 7) >> 3)) != ERROR_OK) {
@@ -1198,177 +1389,36 @@ xxr_common:
 					}
 				}
 
-				/* assemble dr data */
-				i = 0;
-				buf_set_buf(svf_para.hdr_para.tdi,
-						0,
-						&svf_tdi_buffer[svf_buffer_index],
-						i,
-						svf_para.hdr_para.len);
-				i += svf_para.hdr_para.len;
-				buf_set_buf(svf_para.sdr_para.tdi,
-						0,
-						&svf_tdi_buffer[svf_buffer_index],
-						i,
-						svf_para.sdr_para.len);
-				i += svf_para.sdr_para.len;
-				buf_set_buf(svf_para.tdr_para.tdi,
-						0,
-						&svf_tdi_buffer[svf_buffer_index],
-						i,
-						svf_para.tdr_para.len);
-				i += svf_para.tdr_para.len;
+				/* assemble data */
+				i = svf_assemble_scan(&svf_tdi_buffer[svf_buffer_index], ir, XXR_TDI);
 
 				/* add check data */
-				if (svf_para.sdr_para.data_mask & XXR_TDO) {
-					/* assemble dr mask data */
-					i = 0;
-					buf_set_buf(svf_para.hdr_para.mask,
-							0,
-							&svf_mask_buffer[svf_buffer_index],
-							i,
-							svf_para.hdr_para.len);
-					i += svf_para.hdr_para.len;
-					buf_set_buf(svf_para.sdr_para.mask,
-							0,
-							&svf_mask_buffer[svf_buffer_index],
-							i,
-							svf_para.sdr_para.len);
-					i += svf_para.sdr_para.len;
-					buf_set_buf(svf_para.tdr_para.mask,
-							0,
-							&svf_mask_buffer[svf_buffer_index],
-							i,
-							svf_para.tdr_para.len);
-
-					/* assemble dr check data */
-					i = 0;
-					buf_set_buf(svf_para.hdr_para.tdo,
-							0,
-							&svf_tdo_buffer[svf_buffer_index],
-							i,
-							svf_para.hdr_para.len);
-					i += svf_para.hdr_para.len;
-					buf_set_buf(svf_para.sdr_para.tdo,
-							0,
-							&svf_tdo_buffer[svf_buffer_index],
-							i,
-							svf_para.sdr_para.len);
-					i += svf_para.sdr_para.len;
-					buf_set_buf(svf_para.tdr_para.tdo,
-							0,
-							&svf_tdo_buffer[svf_buffer_index],
-							i,
-							svf_para.tdr_para.len);
-					i += svf_para.tdr_para.len;
-
-					svf_add_check_para(1, svf_buffer_index, i);
+				if (body->data_mask & XXR_TDO) {
+					svf_assemble_scan(&svf_mask_buffer[svf_buffer_index], ir, XXR_MASK);
+					svf_assemble_scan(&svf_tdo_buffer[svf_buffer_index], ir, XXR_TDO);
+					svf_add_check_para(1, svf_buffer_index, i, body->len, ir);
 				} else
-					svf_add_check_para(0, svf_buffer_index, i);
+					svf_add_check_para(0, svf_buffer_index, i, body->len, ir);
 				field.num_bits = i;
 				field.out_value = &svf_tdi_buffer[svf_buffer_index];
 				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
 				if (!svf_nil) {
 					/* NOTE:  doesn't use SVF-specified state paths */
-					jtag_add_plain_dr_scan(field.num_bits,
-							field.out_value,
-							field.in_value,
-							svf_para.dr_end_state);
+					if (ir)
+						jtag_add_plain_ir_scan(field.num_bits,
+								field.out_value,
+								field.in_value,
+								svf_para.ir_end_state);
+					else
+						jtag_add_plain_dr_scan(field.num_bits,
+								field.out_value,
+								field.in_value,
+								svf_para.dr_end_state);
 				}
 
-				if (svf_addcycles)
+				if (!ir && svf_addcycles)
 					jtag_add_clocks(svf_addcycles);
 
-				svf_buffer_index += (i + 7) >> 3;
-			} else if (command == SIR) {
-				/* check buffer size first, reallocate if necessary */
-				i = svf_para.hir_para.len + svf_para.sir_para.len +
-						svf_para.tir_para.len;
-				if ((svf_buffer_size - svf_buffer_index) < ((i + 7) >> 3)) {
-					if (svf_realloc_buffers(svf_buffer_index + ((i + 7) >> 3)) != ERROR_OK) {
-						LOG_ERROR("not enough memory");
-						return ERROR_FAIL;
-					}
-				}
-
-				/* assemble ir data */
-				i = 0;
-				buf_set_buf(svf_para.hir_para.tdi,
-						0,
-						&svf_tdi_buffer[svf_buffer_index],
-						i,
-						svf_para.hir_para.len);
-				i += svf_para.hir_para.len;
-				buf_set_buf(svf_para.sir_para.tdi,
-						0,
-						&svf_tdi_buffer[svf_buffer_index],
-						i,
-						svf_para.sir_para.len);
-				i += svf_para.sir_para.len;
-				buf_set_buf(svf_para.tir_para.tdi,
-						0,
-						&svf_tdi_buffer[svf_buffer_index],
-						i,
-						svf_para.tir_para.len);
-				i += svf_para.tir_para.len;
-
-				/* add check data */
-				if (svf_para.sir_para.data_mask & XXR_TDO) {
-					/* assemble dr mask data */
-					i = 0;
-					buf_set_buf(svf_para.hir_para.mask,
-							0,
-							&svf_mask_buffer[svf_buffer_index],
-							i,
-							svf_para.hir_para.len);
-					i += svf_para.hir_para.len;
-					buf_set_buf(svf_para.sir_para.mask,
-							0,
-							&svf_mask_buffer[svf_buffer_index],
-							i,
-							svf_para.sir_para.len);
-					i += svf_para.sir_para.len;
-					buf_set_buf(svf_para.tir_para.mask,
-							0,
-							&svf_mask_buffer[svf_buffer_index],
-							i,
-							svf_para.tir_para.len);
-
-					/* assemble dr check data */
-					i = 0;
-					buf_set_buf(svf_para.hir_para.tdo,
-							0,
-							&svf_tdo_buffer[svf_buffer_index],
-							i,
-							svf_para.hir_para.len);
-					i += svf_para.hir_para.len;
-					buf_set_buf(svf_para.sir_para.tdo,
-							0,
-							&svf_tdo_buffer[svf_buffer_index],
-							i,
-							svf_para.sir_para.len);
-					i += svf_para.sir_para.len;
-					buf_set_buf(svf_para.tir_para.tdo,
-							0,
-							&svf_tdo_buffer[svf_buffer_index],
-							i,
-							svf_para.tir_para.len);
-					i += svf_para.tir_para.len;
-
-					svf_add_check_para(1, svf_buffer_index, i);
-				} else
-					svf_add_check_para(0, svf_buffer_index, i);
-				field.num_bits = i;
-				field.out_value = &svf_tdi_buffer[svf_buffer_index];
-				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
-				if (!svf_nil) {
-					/* NOTE:  doesn't use SVF-specified state paths */
-					jtag_add_plain_ir_scan(field.num_bits,
-							field.out_value,
-							field.in_value,
-							svf_para.ir_end_state);
-				}
-
 				svf_buffer_index += (i + 7) >> 3;
 			}
 			break;
@@ -1620,7 +1670,7 @@ xxr_common:
 		/* for fast executing, execute tap if necessary */
 		/* half of the buffer is for the next command */
 		if (((svf_buffer_index >= SVF_MAX_BUFFER_SIZE_TO_COMMIT) ||
-				(svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE / 2)) &&
+				(svf_check_tdo_para_index >= SVF_MAX_CHECKS_TO_COMMIT)) &&
 				(((command != STATE) && (command != RUNTEST)) ||
 						((command == STATE) && (num_of_argu == 2))))
 			return svf_execute_tap();
@@ -1635,7 +1685,7 @@ static const struct command_registration svf_command_handlers[] = {
 		.handler = handle_svf_command,
 		.mode = COMMAND_EXEC,
 		.help = "Runs a SVF file.",
-		.usage = "[-tap device.tap] [-quiet] [-nil] [-progress] [-ignore_error] [-noreset] [-addcycles numcycles] file",
+		.usage = "[-tap device.tap]... [-quiet] [-nil] [-progress] [-ignore_error] [-noreset] [-addcycles numcycles] file",
 	},
 	COMMAND_REGISTRATION_DONE
 };
@@ -37,6 +37,7 @@ enum halt_mode {
 struct aarch64_private_config {
 	struct adiv5_private_config adiv5_config;
 	struct arm_cti *cti;
+	uint64_t sys_ap_num;
 };
 
 static int aarch64_poll(struct target *target);
@@ -2128,28 +2129,25 @@ static int aarch64_write_cpu_memory_fast(struct target *target,
 
 	armv8_reg_current(arm, 1)->dirty = true;
 
-	/* Step 1.d   - Change DCC to memory mode */
+	/* Step 1.d   - Change DCC to memory mode, queued with the data */
 	*dscr |= DSCR_MA;
-	retval =  mem_ap_write_atomic_u32(armv8->debug_ap,
+	retval =  mem_ap_write_u32(armv8->debug_ap,
 			armv8->debug_base + CPUV8_DBG_DSCR, *dscr);
 	if (retval != ERROR_OK)
 		return retval;
 
-
-	/* Step 2.a   - Do the write */
+	/* Step 2.a   - Do the write, no status polls, abort flags are sticky
+	 * and checked by the caller when done */
 	retval = mem_ap_write_buf_noincr(armv8->debug_ap,
 					buffer, 4, count, armv8->debug_base + CPUV8_DBG_DTRRX);
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* Step 3.a   - Switch DTR mode back to Normal mode */
+	/* Step 3.a   - Switch DTR mode back to Normal mode, flushed together
+	 * with the sticky abort check of the caller */
 	*dscr &= ~DSCR_MA;
-	retval = mem_ap_write_atomic_u32(armv8->debug_ap,
+	return mem_ap_write_u32(armv8->debug_ap,
 				armv8->debug_base + CPUV8_DBG_DSCR, *dscr);
-	if (retval != ERROR_OK)
-		return retval;
-
-	return ERROR_OK;
 }
 
 static int aarch64_write_cpu_memory(struct target *target,
@@ -2183,9 +2181,9 @@ static int aarch64_write_cpu_memory(struct target *target,
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* Set Normal access mode  */
+	/* Set Normal access mode, queued with the address write */
 	dscr = (dscr & ~DSCR_MA);
-	retval = mem_ap_write_atomic_u32(armv8->debug_ap,
+	retval = mem_ap_write_u32(armv8->debug_ap,
 			armv8->debug_base + CPUV8_DBG_DSCR, dscr);
 	if (retval != ERROR_OK)
 		return retval;
@@ -2348,13 +2346,13 @@ static int aarch64_read_cpu_memory_fast(struct target *target,
 
 	/* Step 1.e - Change DCC to memory mode */
 	*dscr |= DSCR_MA;
-	retval =  mem_ap_write_atomic_u32(armv8->debug_ap,
+	retval =  mem_ap_write_u32(armv8->debug_ap,
 			armv8->debug_base + CPUV8_DBG_DSCR, *dscr);
 	if (retval != ERROR_OK)
 		return retval;
 
 	/* Step 1.f - read DBGDTRTX and discard the value */
-	retval = mem_ap_read_atomic_u32(armv8->debug_ap,
+	retval = mem_ap_read_u32(armv8->debug_ap,
 			armv8->debug_base + CPUV8_DBG_DTRTX, &value);
 	if (retval != ERROR_OK)
 		return retval;
@@ -2364,6 +2362,9 @@ static int aarch64_read_cpu_memory_fast(struct target *target,
 	 * Abort flags are sticky, so can be read at end of transactions
 	 *
 	 * This data is read in aligned to 32 bit boundary.
+	 *
+	 * All the reads are queued behind the mode switch above without any
+	 * status poll in between and run in a single transaction.
 	 */
 
 	if (count) {
@@ -2376,18 +2377,24 @@ static int aarch64_read_cpu_memory_fast(struct target *target,
 	}
 
 	/* Step 3.a - set DTR access mode back to Normal mode	*/
-	*dscr &= ~DSCR_MA;
-	retval =  mem_ap_write_atomic_u32(armv8->debug_ap,
-					armv8->debug_base + CPUV8_DBG_DSCR, *dscr);
+	uint32_t dscr_normal = *dscr & ~DSCR_MA;
+	retval =  mem_ap_write_u32(armv8->debug_ap,
+					armv8->debug_base + CPUV8_DBG_DSCR, dscr_normal);
 	if (retval != ERROR_OK)
 		return retval;
 
 	/* Step 3.b - read DBGDTRTX for the final value */
-	retval = mem_ap_read_atomic_u32(armv8->debug_ap,
+	retval = mem_ap_read_u32(armv8->debug_ap,
 			armv8->debug_base + CPUV8_DBG_DTRTX, &value);
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* keep DSCR_MA set on failure so the caller switches back */
+	retval = dap_run(armv8->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	*dscr = dscr_normal;
 	target_buffer_set_u32(target, buffer + count * 4, value);
 	return retval;
 }
@@ -2426,9 +2433,9 @@ static int aarch64_read_cpu_memory(struct target *target,
 
 	/* This algorithm comes from DDI0487A.g, chapter J9.1 */
 
-	/* Set Normal access mode  */
+	/* Set Normal access mode, queued with the address write */
 	dscr &= ~DSCR_MA;
-	retval =  mem_ap_write_atomic_u32(armv8->debug_ap,
+	retval =  mem_ap_write_u32(armv8->debug_ap,
 			armv8->debug_base + CPUV8_DBG_DSCR, dscr);
 	if (retval != ERROR_OK)
 		return retval;
@@ -2483,6 +2490,50 @@ static int aarch64_read_cpu_memory(struct target *target,
 	return ERROR_OK;
 }
 
+/*
+ * Physical memory access through the system bus MEM-AP, at bus speed
+ * instead of one DCC word per instruction. Disabling the D-cache for the
+ * access cleans it first, so the bus sees the data the core wrote. After
+ * a write the core may still have stale instructions of the range cached.
+ */
+static int aarch64_read_sys_ap_memory(struct target *target,
+	target_addr_t address, uint32_t size,
+	uint32_t count, uint8_t *buffer)
+{
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	int retval;
+
+	retval = aarch64_mmu_modify(target, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mem_ap_read_buf(aarch64->sys_ap, buffer, size, count, address);
+}
+
+static int aarch64_write_sys_ap_memory(struct target *target,
+	target_addr_t address, uint32_t size,
+	uint32_t count, const uint8_t *buffer)
+{
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	struct armv8_common *armv8 = &aarch64->armv8_common;
+	int retval;
+
+	retval = aarch64_mmu_modify(target, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = mem_ap_write_buf(aarch64->sys_ap, buffer, size, count, address);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = armv8_cache_i_inner_inval_virt(armv8, address, (size_t)size * count);
+	if (retval == ERROR_TARGET_INVALID)
+		/* I-cache disabled */
+		retval = ERROR_OK;
+
+	return retval;
+}
+
 static int aarch64_read_phys_memory(struct target *target,
 	target_addr_t address, uint32_t size,
 	uint32_t count, uint8_t *buffer)
@@ -2490,6 +2541,14 @@ static int aarch64_read_phys_memory(struct target *target,
 	int retval = ERROR_COMMAND_SYNTAX_ERROR;
 
 	if (count && buffer) {
+		if (target_to_aarch64(target)->sys_ap) {
+			if (target->state != TARGET_HALTED) {
+				LOG_TARGET_ERROR(target, "not halted");
+				return ERROR_TARGET_NOT_HALTED;
+			}
+			return aarch64_read_sys_ap_memory(target, address, size, count, buffer);
+		}
+
 		/* read memory through APB-AP */
 		retval = aarch64_mmu_modify(target, 0);
 		if (retval != ERROR_OK)
@@ -2515,6 +2574,9 @@ static int aarch64_read_memory(struct target *target, target_addr_t address,
 		retval = aarch64_mmu_modify(target, 1);
 		if (retval != ERROR_OK)
 			return retval;
+	} else if (target_to_aarch64(target)->sys_ap) {
+		/* flat mapping, virtual addresses are physical */
+		return aarch64_read_sys_ap_memory(target, address, size, count, buffer);
 	}
 	return aarch64_read_cpu_memory(target, address, size, count, buffer);
 }
@@ -2526,6 +2588,14 @@ static int aarch64_write_phys_memory(struct target *target,
 	int retval = ERROR_COMMAND_SYNTAX_ERROR;
 
 	if (count && buffer) {
+		if (target_to_aarch64(target)->sys_ap) {
+			if (target->state != TARGET_HALTED) {
+				LOG_TARGET_ERROR(target, "not halted");
+				return ERROR_TARGET_NOT_HALTED;
+			}
+			return aarch64_write_sys_ap_memory(target, address, size, count, buffer);
+		}
+
 		/* write memory through APB-AP */
 		retval = aarch64_mmu_modify(target, 0);
 		if (retval != ERROR_OK)
@@ -2552,6 +2622,9 @@ static int aarch64_write_memory(struct target *target, target_addr_t address,
 		retval = aarch64_mmu_modify(target, 1);
 		if (retval != ERROR_OK)
 			return retval;
+	} else if (target_to_aarch64(target)->sys_ap) {
+		/* flat mapping, virtual addresses are physical */
+		return aarch64_write_sys_ap_memory(target, address, size, count, buffer);
 	}
 	return aarch64_write_cpu_memory(target, address, size, count, buffer);
 }
@@ -2629,6 +2702,20 @@ static int aarch64_examine_first(struct target *target)
 
 	armv8->debug_ap->memaccess_tck = 10;
 
+	if (pc->sys_ap_num != DP_APSEL_INVALID && !aarch64->sys_ap) {
+		aarch64->sys_ap = dap_get_ap(swjdp, pc->sys_ap_num);
+		if (!aarch64->sys_ap) {
+			LOG_ERROR("Cannot get system AP");
+			return ERROR_FAIL;
+		}
+
+		retval = mem_ap_init(aarch64->sys_ap);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Could not initialize the system AP");
+			return retval;
+		}
+	}
+
 	if (!target->dbgbase_set) {
 		/* Lookup Processor DAP */
 		retval = dap_lookup_cs_component(armv8->debug_ap, ARM_CS_C9_DEVTYPE_CORE_DEBUG,
@@ -2833,6 +2920,8 @@ static void aarch64_deinit_target(struct target *target)
 
 	if (armv8->debug_ap)
 		dap_put_ap(armv8->debug_ap);
+	if (aarch64->sys_ap)
+		dap_put_ap(aarch64->sys_ap);
 
 	armv8_free_reg_cache(target);
 	free(aarch64->brp_list);
@@ -2868,10 +2957,12 @@ static int aarch64_virt2phys(struct target *target, target_addr_t virt,
  */
 enum aarch64_cfg_param {
 	CFG_CTI,
+	CFG_SYS_AP,
 };
 
 static const struct jim_nvp nvp_config_opts[] = {
 	{ .name = "-cti", .value = CFG_CTI },
+	{ .name = "-sys-ap-num", .value = CFG_SYS_AP },
 	{ .name = NULL, .value = -1 }
 };
 
@@ -2885,6 +2976,7 @@ static int aarch64_jim_configure(struct target *target, struct jim_getopt_info *
 	if (!pc) {
 			pc = calloc(1, sizeof(struct aarch64_private_config));
 			pc->adiv5_config.ap_num = DP_APSEL_INVALID;
+			pc->sys_ap_num = DP_APSEL_INVALID;
 			target->private_config = pc;
 	}
 
@@ -2944,6 +3036,35 @@ static int aarch64_jim_configure(struct target *target, struct jim_getopt_info *
 			break;
 		}
 
+		case CFG_SYS_AP: {
+			if (goi->isconfigure) {
+				jim_wide ap_num;
+				e = jim_getopt_wide(goi, &ap_num);
+				if (e != JIM_OK)
+					return e;
+				/* same constraints as -ap-num */
+				if (ap_num < 0 || (ap_num > DP_APSEL_MAX && (ap_num & 0xfff))) {
+					Jim_SetResultString(goi->interp, "Invalid AP number!", -1);
+					return JIM_ERR;
+				}
+				pc->sys_ap_num = ap_num;
+			} else {
+				if (goi->argc != 0) {
+					Jim_WrongNumArgs(goi->interp,
+							goi->argc, goi->argv,
+							"NO PARAMS");
+					return JIM_ERR;
+				}
+
+				if (pc->sys_ap_num == DP_APSEL_INVALID) {
+					Jim_SetResultString(goi->interp, "system AP not configured", -1);
+					return JIM_ERR;
+				}
+				Jim_SetResult(goi->interp, Jim_NewIntObj(goi->interp, pc->sys_ap_num));
+			}
+			break;
+		}
+
 		default:
 			return JIM_CONTINUE;
 		}
@@ -58,6 +58,9 @@ struct aarch64_common {
 	struct aarch64_brp *wp_list;
 
 	enum aarch64_isrmasking_mode isrmasking_mode;
+
+	/* optional system bus MEM-AP used for physical memory accesses */
+	struct adiv5_ap *sys_ap;
 };
 
 static inline struct aarch64_common *
@@ -889,22 +889,13 @@ static int arc_save_context(struct target *target)
 			aux_addrs[aux_cnt++] = arc_reg->arch_num;
 	}
 
-	/* Read data from target. */
-	if (core_cnt > 0) {
-		retval = arc_jtag_read_core_reg(&arc->jtag_info, core_addrs, core_cnt, core_values);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Attempt to read core registers failed.");
-			retval = ERROR_FAIL;
-			goto exit;
-		}
-	}
-	if (aux_cnt > 0) {
-		retval = arc_jtag_read_aux_reg(&arc->jtag_info, aux_addrs, aux_cnt, aux_values);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Attempt to read aux registers failed.");
-			retval = ERROR_FAIL;
-			goto exit;
-		}
+	/* Read data from target, core and aux registers in one go. */
+	retval = arc_jtag_read_core_aux_regs(&arc->jtag_info, core_addrs, core_cnt,
+		core_values, aux_addrs, aux_cnt, aux_values);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Attempt to read core and aux registers failed.");
+		retval = ERROR_FAIL;
+		goto exit;
 	}
 
 	/* Parse core regs */
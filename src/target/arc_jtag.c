@@ -263,6 +263,20 @@ static int arc_jtag_write_registers(struct arc_jtag *jtag_info, uint32_t type,
 	return jtag_execute_queue();
 }
 
+/* Helper function: Adding read of core or aux registers to queue */
+static void arc_jtag_enque_read_registers(struct arc_jtag *jtag_info,
+	uint32_t type, uint32_t *addr, uint8_t *data_buf, uint32_t count)
+{
+	arc_jtag_enque_reset_transaction(jtag_info);
+
+	/* What type of registers we are reading? */
+	const uint32_t transaction = (type == ARC_JTAG_CORE_REG ?
+			ARC_JTAG_READ_FROM_CORE_REG : ARC_JTAG_READ_FROM_AUX_REG);
+	arc_jtag_enque_set_transaction(jtag_info, transaction, TAP_DRPAUSE);
+
+	arc_jtag_enque_register_rw(jtag_info, addr, data_buf, NULL, count);
+}
+
 /**
  * Read registers. addr is an array of addresses, and those addresses can be in
  * any order, though it is recommended that they are in sequential order where
@@ -291,16 +305,13 @@ static int arc_jtag_read_registers(struct arc_jtag *jtag_info, uint32_t type,
 		return ERROR_FAIL;
 	}
 
-	arc_jtag_enque_reset_transaction(jtag_info);
-
-	/* What type of registers we are reading? */
-	const uint32_t transaction = (type == ARC_JTAG_CORE_REG ?
-			ARC_JTAG_READ_FROM_CORE_REG : ARC_JTAG_READ_FROM_AUX_REG);
-	arc_jtag_enque_set_transaction(jtag_info, transaction, TAP_DRPAUSE);
-
 	uint8_t *data_buf = calloc(count * 4, sizeof(uint8_t));
+	if (!data_buf) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
 
-	arc_jtag_enque_register_rw(jtag_info, addr, data_buf, NULL, count);
+	arc_jtag_enque_read_registers(jtag_info, type, addr, data_buf, count);
 
 	retval = jtag_execute_queue();
 	if (retval != ERROR_OK) {
@@ -321,7 +332,6 @@ exit:
 	return retval;
 }
 
-
 /** Wrapper function to ease writing of one core register. */
 int arc_jtag_write_core_reg_one(struct arc_jtag *jtag_info, uint32_t addr,
 	uint32_t value)
@@ -370,6 +380,67 @@ int arc_jtag_read_core_reg(struct arc_jtag *jtag_info, uint32_t *addr,
 			buffer);
 }
 
+/**
+ * Read core and AUX registers in a single JTAG queue execution. Either count
+ * may be 0, then the respective group is skipped.
+ *
+ * @param jtag_info
+ * @param core_addr	Array of core register numbers.
+ * @param core_count	Amount of core registers in arrays.
+ * @param core_buffer	Array of core register values.
+ * @param aux_addr	Array of AUX register numbers.
+ * @param aux_count	Amount of AUX registers in arrays.
+ * @param aux_buffer	Array of AUX register values.
+ */
+int arc_jtag_read_core_aux_regs(struct arc_jtag *jtag_info,
+	uint32_t *core_addr, uint32_t core_count, uint32_t *core_buffer,
+	uint32_t *aux_addr, uint32_t aux_count, uint32_t *aux_buffer)
+{
+	int retval;
+	uint32_t i;
+
+	assert(jtag_info);
+	assert(jtag_info->tap);
+
+	LOG_DEBUG("Reading %" PRIu32 " core and %" PRIu32 " aux registers",
+		core_count, aux_count);
+
+	if (!core_count && !aux_count)
+		return ERROR_OK;
+
+	uint8_t *data_buf = calloc((core_count + aux_count) * 4, sizeof(uint8_t));
+	if (!data_buf) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+	uint8_t *aux_data = data_buf + core_count * 4;
+
+	if (core_count)
+		arc_jtag_enque_read_registers(jtag_info, ARC_JTAG_CORE_REG, core_addr,
+			data_buf, core_count);
+	if (aux_count)
+		arc_jtag_enque_read_registers(jtag_info, ARC_JTAG_AUX_REG, aux_addr,
+			aux_data, aux_count);
+
+	retval = jtag_execute_queue();
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Failed to execute jtag queue: %d", retval);
+		retval = ERROR_FAIL;
+		goto exit;
+	}
+
+	/* Convert byte-buffers to host /presentation. */
+	for (i = 0; i < core_count; i++)
+		core_buffer[i] = buf_get_u32(data_buf + 4 * i, 0, 32);
+	for (i = 0; i < aux_count; i++)
+		aux_buffer[i] = buf_get_u32(aux_data + 4 * i, 0, 32);
+
+exit:
+	free(data_buf);
+
+	return retval;
+}
+
 /** Wrapper function to ease writing of one AUX register. */
 int arc_jtag_write_aux_reg_one(struct arc_jtag *jtag_info, uint32_t addr,
 	uint32_t value)
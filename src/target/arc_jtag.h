@@ -63,6 +63,10 @@ int arc_jtag_read_aux_reg(struct arc_jtag *jtag_info, uint32_t *addr,
 int arc_jtag_read_aux_reg_one(struct arc_jtag *jtag_info, uint32_t addr,
 	uint32_t *value);
 
+int arc_jtag_read_core_aux_regs(struct arc_jtag *jtag_info,
+	uint32_t *core_addr, uint32_t core_count, uint32_t *core_buffer,
+	uint32_t *aux_addr, uint32_t aux_count, uint32_t *aux_buffer);
+
 int arc_jtag_write_memory(struct arc_jtag *jtag_info, uint32_t addr,
 		uint32_t count, const uint32_t *buffer);
 int arc_jtag_read_memory(struct arc_jtag *jtag_info, uint32_t addr,
@@ -195,32 +195,34 @@ static void mem_ap_update_tar_cache(struct adiv5_ap *ap)
 }
 
 /**
- * Queue transactions setting up transfer parameters for the
- * currently selected MEM-AP.
+ * Queue transactions setting up transfer parameters for a banked access
+ * through MEM_AP_REG_BD0..3 to the currently selected MEM-AP.
  *
- * Subsequent transfers using registers like MEM_AP_REG_DRW or MEM_AP_REG_BD2
- * initiate data reads or writes using memory or peripheral addresses.
- * If the CSW is configured for it, the TAR may be automatically
- * incremented after each transfer.
+ * Banked accesses take the address from TAR[63:4] only, so a cached TAR
+ * anywhere in the same 16 byte block, e.g. left there by a previous block
+ * transfer, is used as is. Banked accesses don't increment the TAR.
  *
  * @param ap The MEM-AP.
  * @param csw MEM-AP Control/Status Word (CSW) register to assign.  If this
  *	matches the cached value, the register is not changed.
- * @param tar MEM-AP Transfer Address Register (TAR) to assign.  If this
- *	matches the cached address, the register is not changed.
+ * @param address Address of the access. TAR is only written if the cached
+ *	TAR is invalid or points to a different 16 byte block.
  *
  * @return ERROR_OK if the transaction was properly queued, else a fault code.
  */
-static int mem_ap_setup_transfer(struct adiv5_ap *ap, uint32_t csw, target_addr_t tar)
+static int mem_ap_setup_transfer(struct adiv5_ap *ap, uint32_t csw, target_addr_t address)
 {
+	target_addr_t block = address & 0xFFFFFFFFFFFFFFF0ull;
 	int retval;
+
 	retval = mem_ap_setup_csw(ap, csw);
 	if (retval != ERROR_OK)
 		return retval;
-	retval = mem_ap_setup_tar(ap, tar);
-	if (retval != ERROR_OK)
-		return retval;
-	return ERROR_OK;
+
+	if (ap->tar_valid && (ap->tar_value & 0xFFFFFFFFFFFFFFF0ull) == block)
+		return ERROR_OK;
+
+	return mem_ap_setup_tar(ap, block);
 }
 
 /**
@@ -243,8 +245,7 @@ int mem_ap_read_u32(struct adiv5_ap *ap, target_addr_t address,
 	 * (updating TAR) when reading several consecutive addresses.
 	 */
 	retval = mem_ap_setup_transfer(ap,
-			CSW_32BIT | (ap->csw_value & CSW_ADDRINC_MASK),
-			address & 0xFFFFFFFFFFFFFFF0ull);
+			CSW_32BIT | (ap->csw_value & CSW_ADDRINC_MASK), address);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -295,8 +296,7 @@ int mem_ap_write_u32(struct adiv5_ap *ap, target_addr_t address,
 	 * (updating TAR) when writing several consecutive addresses.
 	 */
 	retval = mem_ap_setup_transfer(ap,
-			CSW_32BIT | (ap->csw_value & CSW_ADDRINC_MASK),
-			address & 0xFFFFFFFFFFFFFFF0ull);
+			CSW_32BIT | (ap->csw_value & CSW_ADDRINC_MASK), address);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -512,6 +512,13 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 	if (ap->unaligned_access_bad && (address % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
+	if (addrinc && dap->ops->mem_ap_write_buf) {
+		retval = dap->ops->mem_ap_write_buf(ap, buffer, size, count, address);
+		if (retval != ERROR_NOT_IMPLEMENTED)
+			return retval;
+		retval = ERROR_OK;
+	}
+
 	/* Nuvoton NPCX quirks prevent packed writes */
 	bool pack = !dap->nu_npcx_quirks;
 
@@ -624,6 +631,13 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	if (ap->unaligned_access_bad && (adr % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
+	if (addrinc && dap->ops->mem_ap_read_buf) {
+		retval = dap->ops->mem_ap_read_buf(ap, buffer, size, count, adr);
+		if (retval != ERROR_NOT_IMPLEMENTED)
+			return retval;
+		retval = ERROR_OK;
+	}
+
 	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
 	 * over-allocation if packed transfers are going to be used, but determining the real need at
 	 * this point would be messy. */
@@ -1333,30 +1347,78 @@ static int dap_queue_read_reg(enum coresight_access_mode mode, struct adiv5_ap *
 	return mem_ap_read_u32(ap, component_base + reg, value);
 }
 
+/** Raw values of the CoreSight registers read during ROM Table Parsing (RTP) */
+struct cs_component_regs {
+	uint32_t devarch;
+	uint32_t devid;
+	uint32_t devtype_memtype;
+	uint32_t pid[5];
+	uint32_t cid[4];
+};
+
 /**
- * Read the CoreSight registers needed during ROM Table Parsing (RTP).
- *
- * @param mode           Method to access the component (AP or MEM-AP).
- * @param ap             Pointer to AP containing the component.
- * @param component_base On MEM-AP access method, base address of the component.
- * @param v              Pointer to the struct holding the value of registers.
- *
- * @return ERROR_OK on success, else a fault code.
+ * CoreSight component or ROM table seen during ROM Table Parsing (RTP).
+ * ID registers and ROM tables don't change, so the entries are kept in
+ * adiv5_dap::rom_cache and re-examining a target doesn't walk the ROM
+ * tables on the wire again. Failed reads are not cached.
  */
-static int rtp_read_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap,
-		target_addr_t component_base, struct cs_component_vals *v)
+struct rtp_cache_entry {
+	struct list_head lh;
+	uint64_t ap_num;
+	enum coresight_access_mode mode;
+	target_addr_t component_base;
+	/* Registers of the component, "ap" is not valid */
+	bool vals_valid;
+	struct cs_component_vals v;
+	/* Entries of the ROM table up to the end marker, if it's one */
+	uint64_t *romentries;
+	unsigned int num_romentries;
+};
+
+/* ROM table words and components read with one dap_run() */
+#define RTP_ROM_TABLE_WORDS_PER_RUN	32
+#define RTP_COMPONENTS_PER_RUN		16
+
+void dap_rom_cache_clear(struct adiv5_dap *dap)
 {
-	assert(IS_ALIGNED(component_base, ARM_CS_ALIGN));
-	assert(ap && v);
+	struct rtp_cache_entry *entry, *tmp;
 
-	uint32_t cid0, cid1, cid2, cid3;
-	uint32_t pid0, pid1, pid2, pid3, pid4;
-	int retval = ERROR_OK;
+	list_for_each_entry_safe(entry, tmp, &dap->rom_cache, lh) {
+		list_del(&entry->lh);
+		free(entry->romentries);
+		free(entry);
+	}
+}
 
-	v->ap = ap;
-	v->component_base = component_base;
-	v->mode = mode;
+static struct rtp_cache_entry *rtp_cache_find(enum coresight_access_mode mode,
+		struct adiv5_ap *ap, target_addr_t component_base, bool create)
+{
+	struct rtp_cache_entry *entry;
+
+	list_for_each_entry(entry, &ap->dap->rom_cache, lh) {
+		if (entry->ap_num == ap->ap_num && entry->mode == mode &&
+				entry->component_base == component_base)
+			return entry;
+	}
+
+	if (!create)
+		return NULL;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+	entry->ap_num = ap->ap_num;
+	entry->mode = mode;
+	entry->component_base = component_base;
+	list_add_tail(&entry->lh, &ap->dap->rom_cache);
+	return entry;
+}
 
+static int rtp_queue_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap,
+		target_addr_t component_base, struct cs_component_regs *regs)
+{
 	/* sort by offset to gain speed */
 
 	/*
@@ -1364,37 +1426,93 @@ static int rtp_read_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap
 	 * only, but are at offset above 0xf00, so can be read on any device
 	 * without triggering error. Read them for eventual use on Class 0x9.
 	 */
-	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVARCH, &v->devarch);
+	int retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVARCH, &regs->devarch);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVID, &v->devid);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVID, &regs->devid);
 
 	/* Same address as ARM_CS_C1_MEMTYPE */
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVTYPE, &v->devtype_memtype);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVTYPE,
+				&regs->devtype_memtype);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR4, &pid4);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR4, &regs->pid[4]);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR0, &pid0);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR0, &regs->pid[0]);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR1, &pid1);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR1, &regs->pid[1]);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR2, &pid2);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR2, &regs->pid[2]);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR3, &pid3);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR3, &regs->pid[3]);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR0, &cid0);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR0, &regs->cid[0]);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR1, &cid1);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR1, &regs->cid[1]);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR2, &cid2);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR2, &regs->cid[2]);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR3, &cid3);
+		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR3, &regs->cid[3]);
+
+	return retval;
+}
+
+/* Fill "v" from the registers and keep it in the cache. */
+static void rtp_decode_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap,
+		target_addr_t component_base, const struct cs_component_regs *regs,
+		struct cs_component_vals *v)
+{
+	v->ap = ap;
+	v->component_base = component_base;
+	v->mode = mode;
+	v->devarch = regs->devarch;
+	v->devid = regs->devid;
+	v->devtype_memtype = regs->devtype_memtype;
+	v->cid = (regs->cid[3] & 0xff) << 24
+			| (regs->cid[2] & 0xff) << 16
+			| (regs->cid[1] & 0xff) << 8
+			| (regs->cid[0] & 0xff);
+	v->pid = (uint64_t)(regs->pid[4] & 0xff) << 32
+			| (regs->pid[3] & 0xff) << 24
+			| (regs->pid[2] & 0xff) << 16
+			| (regs->pid[1] & 0xff) << 8
+			| (regs->pid[0] & 0xff);
+
+	struct rtp_cache_entry *entry = rtp_cache_find(mode, ap, component_base, true);
+	if (entry) {
+		entry->v = *v;
+		entry->vals_valid = true;
+	}
+}
 
+/**
+ * Read the CoreSight registers needed during ROM Table Parsing (RTP).
+ *
+ * @param mode           Method to access the component (AP or MEM-AP).
+ * @param ap             Pointer to AP containing the component.
+ * @param component_base On MEM-AP access method, base address of the component.
+ * @param v              Pointer to the struct holding the value of registers.
+ *
+ * @return ERROR_OK on success, else a fault code.
+ */
+static int rtp_read_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap,
+		target_addr_t component_base, struct cs_component_vals *v)
+{
+	assert(IS_ALIGNED(component_base, ARM_CS_ALIGN));
+	assert(ap && v);
+
+	struct rtp_cache_entry *entry = rtp_cache_find(mode, ap, component_base, false);
+	if (entry && entry->vals_valid) {
+		*v = entry->v;
+		v->ap = ap;
+		return ERROR_OK;
+	}
+
+	struct cs_component_regs regs;
+	int retval = rtp_queue_cs_regs(mode, ap, component_base, &regs);
 	if (retval == ERROR_OK)
 		retval = dap_run(ap->dap);
 	if (retval != ERROR_OK) {
@@ -1402,16 +1520,7 @@ static int rtp_read_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap
 		return retval;
 	}
 
-	v->cid = (cid3 & 0xff) << 24
-			| (cid2 & 0xff) << 16
-			| (cid1 & 0xff) << 8
-			| (cid0 & 0xff);
-	v->pid = (uint64_t)(pid4 & 0xff) << 32
-			| (pid3 & 0xff) << 24
-			| (pid2 & 0xff) << 16
-			| (pid1 & 0xff) << 8
-			| (pid0 & 0xff);
-
+	rtp_decode_cs_regs(mode, ap, component_base, &regs, v);
 	return ERROR_OK;
 }
 
@@ -1839,48 +1948,147 @@ static int rtp_ap(const struct rtp_ops *ops, struct adiv5_ap *ap, int depth);
 static int rtp_cs_component(enum coresight_access_mode mode, const struct rtp_ops *ops,
 		struct adiv5_ap *ap, target_addr_t dbgbase, bool *is_mem_ap, int depth);
 
-static int rtp_rom_loop(enum coresight_access_mode mode, const struct rtp_ops *ops,
-		struct adiv5_ap *ap, target_addr_t base_address, int depth,
-		unsigned int width, unsigned int max_entries)
+static target_addr_t rtp_romentry_base(struct adiv5_ap *ap, target_addr_t base_address,
+		unsigned int width, uint64_t romentry)
 {
-	/* ADIv6 AP ROM table provide offset from current AP */
-	if (mode == CS_ACCESS_AP)
-		base_address = ap->ap_num;
+	if (width == 64)
+		return base_address + ((romentry & 0xFFFFFFFF00000000ull) |
+				(romentry & ARM_CS_ROMENTRY_OFFSET_MASK));
 
-	assert(IS_ALIGNED(base_address, ARM_CS_ALIGN));
+	/* "romentry" is signed */
+	target_addr_t component_base = base_address + (int32_t)(romentry & ARM_CS_ROMENTRY_OFFSET_MASK);
+	if (!is_64bit_ap(ap))
+		component_base = (uint32_t)component_base;
+	return component_base;
+}
 
-	unsigned int offset = 0;
-	while (max_entries--) {
-		uint64_t romentry;
-		uint32_t romentry_low, romentry_high;
-		target_addr_t component_base;
-		unsigned int saved_offset = offset;
-
-		int retval = dap_queue_read_reg(mode, ap, base_address, offset, &romentry_low);
-		offset += 4;
-		if (retval == ERROR_OK && width == 64) {
-			retval = dap_queue_read_reg(mode, ap, base_address, offset, &romentry_high);
-			offset += 4;
-		}
+/* Read the entries of a ROM table up to the end marker, several per dap_run(). */
+static int rtp_read_rom_table(enum coresight_access_mode mode, struct adiv5_ap *ap,
+		target_addr_t base_address, unsigned int width, unsigned int max_entries,
+		struct rtp_cache_entry **rom_table)
+{
+	struct rtp_cache_entry *entry = rtp_cache_find(mode, ap, base_address, true);
+	if (!entry)
+		return ERROR_FAIL;
+	*rom_table = entry;
+	if (entry->romentries)
+		return ERROR_OK;
+
+	const unsigned int words_per_entry = width / 32;
+	uint32_t *words = malloc(max_entries * words_per_entry * sizeof(*words));
+	uint64_t *romentries = malloc(max_entries * sizeof(*romentries));
+	if (!words || !romentries) {
+		free(words);
+		free(romentries);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	unsigned int num_entries = 0;
+	bool end = false;
+	int retval = ERROR_OK;
+	while (!end && num_entries < max_entries) {
+		const unsigned int batch = MIN(max_entries - num_entries,
+				RTP_ROM_TABLE_WORDS_PER_RUN / words_per_entry);
+		const unsigned int first = num_entries * words_per_entry;
+
+		for (unsigned int i = 0; retval == ERROR_OK && i < batch * words_per_entry; i++)
+			retval = dap_queue_read_reg(mode, ap, base_address, (first + i) * 4, &words[first + i]);
 		if (retval == ERROR_OK)
 			retval = dap_run(ap->dap);
 		if (retval != ERROR_OK) {
 			LOG_DEBUG("Failed read ROM table entry");
-			return retval;
+			break;
 		}
 
-		if (width == 64) {
-			romentry = (((uint64_t)romentry_high) << 32) | romentry_low;
-			component_base = base_address +
-				((((uint64_t)romentry_high) << 32) | (romentry_low & ARM_CS_ROMENTRY_OFFSET_MASK));
+		for (unsigned int i = 0; !end && i < batch; i++) {
+			uint64_t romentry = words[num_entries * words_per_entry];
+			if (width == 64)
+				romentry |= (uint64_t)words[num_entries * words_per_entry + 1] << 32;
+			romentries[num_entries++] = romentry;
+			/* End of ROM table */
+			end = romentry == 0;
+		}
+	}
+
+	free(words);
+	if (retval != ERROR_OK) {
+		free(romentries);
+		return retval;
+	}
+
+	entry->romentries = romentries;
+	entry->num_romentries = num_entries;
+	return ERROR_OK;
+}
+
+/*
+ * Read the registers of the components listed in a ROM table behind a
+ * MEM-AP, several components per dap_run(). If a batch fails, e.g. on
+ * a powered down component, its components are read again one by one
+ * while parsing them.
+ */
+static void rtp_prefetch_cs_regs(struct adiv5_ap *ap, target_addr_t base_address,
+		unsigned int width, const struct rtp_cache_entry *rom_table)
+{
+	struct cs_component_regs regs[RTP_COMPONENTS_PER_RUN];
+	target_addr_t bases[RTP_COMPONENTS_PER_RUN];
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i <= rom_table->num_romentries; i++) {
+		if (i < rom_table->num_romentries &&
+				(rom_table->romentries[i] & ARM_CS_ROMENTRY_PRESENT)) {
+			target_addr_t component_base = rtp_romentry_base(ap, base_address, width,
+					rom_table->romentries[i]);
+			struct rtp_cache_entry *entry = rtp_cache_find(CS_ACCESS_MEM_AP, ap,
+					component_base, false);
+			if (!entry || !entry->vals_valid)
+				bases[n++] = component_base;
+		}
+
+		if (n == 0 || (n < RTP_COMPONENTS_PER_RUN && i < rom_table->num_romentries))
+			continue;
+
+		int retval = ERROR_OK;
+		for (unsigned int j = 0; retval == ERROR_OK && j < n; j++)
+			retval = rtp_queue_cs_regs(CS_ACCESS_MEM_AP, ap, bases[j], &regs[j]);
+		if (retval == ERROR_OK)
+			retval = dap_run(ap->dap);
+		if (retval == ERROR_OK) {
+			struct cs_component_vals v;
+			for (unsigned int j = 0; j < n; j++)
+				rtp_decode_cs_regs(CS_ACCESS_MEM_AP, ap, bases[j], &regs[j], &v);
 		} else {
-			romentry = romentry_low;
-			/* "romentry" is signed */
-			component_base = base_address + (int32_t)(romentry_low & ARM_CS_ROMENTRY_OFFSET_MASK);
-			if (!is_64bit_ap(ap))
-				component_base = (uint32_t)component_base;
+			LOG_DEBUG("Failed read CoreSight registers of %u components", n);
 		}
-		retval = rtp_ops_rom_table_entry(ops, retval, depth, saved_offset, romentry);
+		n = 0;
+	}
+}
+
+static int rtp_rom_loop(enum coresight_access_mode mode, const struct rtp_ops *ops,
+		struct adiv5_ap *ap, target_addr_t base_address, int depth,
+		unsigned int width, unsigned int max_entries)
+{
+	/* ADIv6 AP ROM table provide offset from current AP */
+	if (mode == CS_ACCESS_AP)
+		base_address = ap->ap_num;
+
+	assert(IS_ALIGNED(base_address, ARM_CS_ALIGN));
+
+	struct rtp_cache_entry *rom_table;
+	int retval = rtp_read_rom_table(mode, ap, base_address, width, max_entries, &rom_table);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (mode == CS_ACCESS_MEM_AP && depth < ROM_TABLE_MAX_DEPTH)
+		rtp_prefetch_cs_regs(ap, base_address, width, rom_table);
+
+	for (unsigned int i = 0; i < rom_table->num_romentries; i++) {
+		uint64_t romentry = rom_table->romentries[i];
+		target_addr_t component_base = rtp_romentry_base(ap, base_address, width, romentry);
+		unsigned int saved_offset = i * width / 8;
+
+		retval = rtp_ops_rom_table_entry(ops, ERROR_OK, depth, saved_offset, romentry);
 		if (retval != ERROR_OK)
 			return retval;
 
@@ -2228,7 +2436,10 @@ int dap_info_command(struct command_invocation *cmd, struct adiv5_ap *ap)
 		.priv            = cmd,
 	};
 
-	return rtp_ap(&dap_info_ops, ap, 0);
+	int retval = rtp_ap(&dap_info_ops, ap, 0);
+	if (!ap->dap->rom_cache_enabled)
+		dap_rom_cache_clear(ap->dap);
+	return retval;
 }
 
 /* Actions for dap_lookup_cs_component() */
@@ -2288,6 +2499,8 @@ int dap_lookup_cs_component(struct adiv5_ap *ap, uint8_t type,
 	};
 
 	int retval = rtp_ap(&dap_lookup_cs_component_ops, ap, 0);
+	if (!ap->dap->rom_cache_enabled)
+		dap_rom_cache_clear(ap->dap);
 	if (retval == CORESIGHT_COMPONENT_FOUND) {
 		if (lookup.ap_num != ap->ap_num) {
 			/* TODO: handle search from root ROM table */
@@ -2881,6 +3094,27 @@ COMMAND_HANDLER(dap_ti_be_32_quirks_command)
 		"TI BE-32 quirks mode");
 }
 
+COMMAND_HANDLER(dap_rom_cache_command)
+{
+	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (!strcmp(CMD_ARGV[0], "clear")) {
+			dap_rom_cache_clear(dap);
+			return ERROR_OK;
+		}
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], dap->rom_cache_enabled);
+		if (!dap->rom_cache_enabled)
+			dap_rom_cache_clear(dap);
+	}
+
+	command_print(CMD, "ROM table cache %s", dap->rom_cache_enabled ? "enabled" : "disabled");
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(dap_nu_npcx_quirks_command)
 {
 	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
@@ -2967,5 +3201,13 @@ const struct command_registration dap_instance_commands[] = {
 		.help = "set/get quirks mode for Nuvoton NPCX controllers",
 		.usage = "[enable]",
 	},
+	{
+		.name = "rom_cache",
+		.handler = dap_rom_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "set/get whether ROM tables and CoreSight component IDs "
+			"are cached, or clear the cache",
+		.usage = "['enable'|'disable'|'clear']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
@@ -434,6 +434,11 @@ struct adiv5_dap {
 
 	/* ADIv6 only field indicating ROM Table address size */
 	unsigned int asize;
+
+	/** ROM tables and CoreSight components found by ROM table parsing */
+	struct list_head rom_cache;
+	/** Keep rom_cache across ROM table parsing, e.g. target re-examination */
+	bool rom_cache_enabled;
 };
 
 /**
@@ -470,6 +475,18 @@ struct dap_ops {
 	/** AP operation abort. */
 	int (*queue_ap_abort)(struct adiv5_dap *dap, uint8_t *ack);
 
+	/**
+	 * Optional; read or write memory through a MEM-AP with address
+	 * increment without going through its registers, e.g. when the
+	 * memory can be accessed directly. Executes the queued operations
+	 * first and leaves the AP registers alone. Returns
+	 * ERROR_NOT_IMPLEMENTED to fall back to DRW accesses.
+	 */
+	int (*mem_ap_read_buf)(struct adiv5_ap *ap, uint8_t *buffer,
+			uint32_t size, uint32_t count, target_addr_t address);
+	int (*mem_ap_write_buf)(struct adiv5_ap *ap, const uint8_t *buffer,
+			uint32_t size, uint32_t count, target_addr_t address);
+
 	/** Executes all queued DAP operations. */
 	int (*run)(struct adiv5_dap *dap);
 
@@ -762,6 +779,9 @@ static inline bool dap_is_multidrop(struct adiv5_dap *dap)
 int dap_lookup_cs_component(struct adiv5_ap *ap,
 			uint8_t type, target_addr_t *addr, int32_t idx);
 
+/* Forget the ROM tables and CoreSight components found so far */
+void dap_rom_cache_clear(struct adiv5_dap *dap);
+
 struct target;
 
 /* Put debug link into SWD mode */
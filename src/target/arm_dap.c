@@ -49,6 +49,8 @@ static void dap_instance_init(struct adiv5_dap *dap)
 	}
 	INIT_LIST_HEAD(&dap->cmd_journal);
 	INIT_LIST_HEAD(&dap->cmd_pool);
+	INIT_LIST_HEAD(&dap->rom_cache);
+	dap->rom_cache_enabled = true;
 }
 
 const char *adiv5_dap_name(struct adiv5_dap *self)
@@ -170,6 +172,7 @@ int dap_cleanup_all(void)
 		}
 		if (dap->ops && dap->ops->quit)
 			dap->ops->quit(dap);
+		dap_rom_cache_clear(dap);
 
 		free(obj->name);
 		free(obj);
@@ -33,6 +33,7 @@
 #include <helper/types.h>
 #include <jtag/interface.h>
 #include <server/server.h>
+#include <server/trace_stream.h>
 #include <target/arm_adi_v5.h>
 #include <target/target.h>
 #include <transport/transport.h>
@@ -65,6 +66,8 @@
 #define TPIU_DEVID_SUPPORT_MANCHESTER   BIT(10)
 #define TPIU_DEVID_SUPPORT_UART         BIT(11)
 
+#define ARM_ITM_STIM_PORTS              32
+
 enum arm_tpiu_swo_event {
 	TPIU_SWO_EVENT_PRE_ENABLE,
 	TPIU_SWO_EVENT_POST_ENABLE,
@@ -110,18 +113,30 @@ struct arm_tpiu_swo_object {
 	unsigned int swo_pin_freq;
 	/** where to dump the captured output trace data */
 	char *out_filename;
-	/** track TCP connections */
-	struct list_head connections;
+	/** prefix of the files the ITM stimulus ports are demultiplexed to */
+	char *itm_prefix;
+	struct arm_itm_decoder {
+		enum {
+			ITM_DEC_HEADER,
+			ITM_DEC_PAYLOAD,
+			ITM_DEC_SKIP,
+			ITM_DEC_CONTINUATION,
+		} state;
+		unsigned int port;
+		unsigned int remaining;
+		uint8_t payload[4];
+		unsigned int len;
+		/* the previous header was 0x00, i.e. within a sync packet */
+		bool in_sync;
+		FILE *files[ARM_ITM_STIM_PORTS];
+	} itm;
+	/** trace data sent to the TCP clients */
+	struct trace_stream *stream;
 	/* START_DEPRECATED_TPIU */
 	bool recheck_ap_cur_target;
 	/* END_DEPRECATED_TPIU */
 };
 
-struct arm_tpiu_swo_connection {
-	struct list_head lh;
-	struct connection *connection;
-};
-
 struct arm_tpiu_swo_priv_connection {
 	struct arm_tpiu_swo_object *obj;
 };
@@ -130,19 +145,102 @@ static LIST_HEAD(all_tpiu_swo);
 
 #define ARM_TPIU_SWO_TRACE_BUF_SIZE	4096
 
-static int arm_tpiu_swo_poll_trace(void *priv)
+/* Trace data kept for TCP clients that can't keep up for a moment */
+#define ARM_TPIU_SWO_STREAM_SIZE	(256 * 1024)
+
+/* Upper bound of adapter reads per poll, so a flood of trace data can't
+ * starve the rest of OpenOCD */
+#define ARM_TPIU_SWO_MAX_READS_PER_POLL	16
+
+static void arm_itm_write_port(struct arm_tpiu_swo_object *obj)
 {
-	struct arm_tpiu_swo_object *obj = priv;
-	uint8_t buf[ARM_TPIU_SWO_TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
-	struct arm_tpiu_swo_connection *c;
+	struct arm_itm_decoder *itm = &obj->itm;
+	FILE **file = &itm->files[itm->port];
+
+	if (!*file) {
+		char *name = alloc_printf("%s%u", obj->itm_prefix, itm->port);
+		if (name)
+			*file = fopen(name, "ab");
+		if (!*file) {
+			LOG_ERROR("Can't open ITM stimulus port output \"%s\"", name ? name : obj->itm_prefix);
+			free(name);
+			return;
+		}
+		free(name);
+	}
 
-	int retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
+	fwrite(itm->payload, 1, itm->len, *file);
+}
 
+/*
+ * Demultiplex the software source packets of an unformatted ITM stream into
+ * one file per stimulus port. Hardware source (DWT) and protocol packets are
+ * skipped. See ARMv7-M Architecture Reference Manual, Appendix D4.
+ */
+static void arm_itm_decode(struct arm_tpiu_swo_object *obj, const uint8_t *buf, size_t size)
+{
+	struct arm_itm_decoder *itm = &obj->itm;
+
+	for (size_t i = 0; i < size; i++) {
+		uint8_t b = buf[i];
+
+		switch (itm->state) {
+		case ITM_DEC_HEADER:
+			if (b & 0x03) {
+				/* source packet, 1, 2 or 4 bytes of payload */
+				itm->remaining = (b & 0x03) == 3 ? 4 : (b & 0x03);
+				itm->port = b >> 3;
+				itm->len = 0;
+				itm->state = (b & 0x04) ? ITM_DEC_SKIP : ITM_DEC_PAYLOAD;
+			} else if ((b & 0x80) && !itm->in_sync) {
+				/* timestamp or extension packet with continuation bytes;
+				 * sync (zeros then 0x80) and overflow (0x70) stand alone */
+				itm->state = ITM_DEC_CONTINUATION;
+			}
+			itm->in_sync = !b;
+			break;
+		case ITM_DEC_PAYLOAD:
+			itm->payload[itm->len++] = b;
+			if (--itm->remaining == 0) {
+				arm_itm_write_port(obj);
+				itm->state = ITM_DEC_HEADER;
+			}
+			break;
+		case ITM_DEC_SKIP:
+			if (--itm->remaining == 0)
+				itm->state = ITM_DEC_HEADER;
+			break;
+		case ITM_DEC_CONTINUATION:
+			if (!(b & 0x80))
+				itm->state = ITM_DEC_HEADER;
+			break;
+		}
+	}
+
+	for (unsigned int port = 0; port < ARM_ITM_STIM_PORTS; port++)
+		if (itm->files[port])
+			fflush(itm->files[port]);
+}
+
+static void arm_itm_close(struct arm_tpiu_swo_object *obj)
+{
+	for (unsigned int port = 0; port < ARM_ITM_STIM_PORTS; port++) {
+		if (obj->itm.files[port]) {
+			fclose(obj->itm.files[port]);
+			obj->itm.files[port] = NULL;
+		}
+	}
+	obj->itm.state = ITM_DEC_HEADER;
+	obj->itm.in_sync = false;
+}
+
+static int arm_tpiu_swo_forward_trace(struct arm_tpiu_swo_object *obj, uint8_t *buf, size_t size)
+{
 	target_call_trace_callbacks(/*target*/NULL, size, buf);
 
+	if (obj->itm_prefix)
+		arm_itm_decode(obj, buf, size);
+
 	if (obj->file) {
 		if (fwrite(buf, 1, size, obj->file) == size) {
 			fflush(obj->file);
@@ -152,10 +250,37 @@ static int arm_tpiu_swo_poll_trace(void *priv)
 		}
 	}
 
-	if (obj->out_filename[0] == ':')
-		list_for_each_entry(c, &obj->connections, lh)
-			if (connection_write(c->connection, buf, size) != (int)size)
-				LOG_ERROR("Error writing to connection"); /* FIXME: which connection? */
+	if (obj->stream)
+		trace_stream_push(obj->stream, buf, size);
+
+	return ERROR_OK;
+}
+
+static int arm_tpiu_swo_poll_trace(void *priv)
+{
+	struct arm_tpiu_swo_object *obj = priv;
+	uint8_t buf[ARM_TPIU_SWO_TRACE_BUF_SIZE];
+
+	/* A full buffer means the adapter likely holds more, fetch it now
+	 * rather than a poll period later, when it may have overflowed */
+	for (unsigned int i = 0; i < ARM_TPIU_SWO_MAX_READS_PER_POLL; i++) {
+		size_t size = sizeof(buf);
+
+		int retval = adapter_poll_trace(buf, &size);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (!size) {
+			/* give clients that couldn't take it all another chance */
+			if (obj->stream)
+				trace_stream_drain(obj->stream);
+			return ERROR_OK;
+		}
+
+		retval = arm_tpiu_swo_forward_trace(obj, buf, size);
+		if (retval != ERROR_OK || size < sizeof(buf))
+			return retval;
+	}
 
 	return ERROR_OK;
 }
@@ -202,8 +327,11 @@ static void arm_tpiu_swo_close_output(struct arm_tpiu_swo_object *obj)
 		fclose(obj->file);
 		obj->file = NULL;
 	}
+	arm_itm_close(obj);
 	if (obj->out_filename[0] == ':')
 		remove_service(TCP_SERVICE_NAME, &obj->out_filename[1]);
+	trace_stream_free(obj->stream);
+	obj->stream = NULL;
 }
 
 int arm_tpiu_swo_cleanup_all(void)
@@ -240,6 +368,7 @@ int arm_tpiu_swo_cleanup_all(void)
 
 		free(obj->name);
 		free(obj->out_filename);
+		free(obj->itm_prefix);
 		free(obj);
 	}
 
@@ -250,14 +379,8 @@ static int arm_tpiu_swo_service_new_connection(struct connection *connection)
 {
 	struct arm_tpiu_swo_priv_connection *priv = connection->service->priv;
 	struct arm_tpiu_swo_object *obj = priv->obj;
-	struct arm_tpiu_swo_connection *c = malloc(sizeof(*c));
-	if (!c) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
-	c->connection = connection;
-	list_add(&c->lh, &obj->connections);
-	return ERROR_OK;
+
+	return trace_stream_subscribe(obj->stream, connection, 0);
 }
 
 static int arm_tpiu_swo_service_input(struct connection *connection)
@@ -280,16 +403,9 @@ static int arm_tpiu_swo_service_connection_closed(struct connection *connection)
 {
 	struct arm_tpiu_swo_priv_connection *priv = connection->service->priv;
 	struct arm_tpiu_swo_object *obj = priv->obj;
-	struct arm_tpiu_swo_connection *c, *tmp;
 
-	list_for_each_entry_safe(c, tmp, &obj->connections, lh)
-		if (c->connection == connection) {
-			list_del(&c->lh);
-			free(c);
-			return ERROR_OK;
-		}
-	LOG_ERROR("Failed to find connection to close!");
-	return ERROR_FAIL;
+	trace_stream_unsubscribe(obj->stream, connection);
+	return ERROR_OK;
 }
 
 COMMAND_HANDLER(handle_arm_tpiu_swo_event_list)
@@ -317,6 +433,7 @@ enum arm_tpiu_swo_cfg_param {
 	CFG_TRACECLKIN,
 	CFG_BITRATE,
 	CFG_OUTFILE,
+	CFG_ITM_OUTFILE,
 	CFG_EVENT,
 };
 
@@ -327,6 +444,7 @@ static const struct jim_nvp nvp_arm_tpiu_swo_config_opts[] = {
 	{ .name = "-traceclk",      .value = CFG_TRACECLKIN },
 	{ .name = "-pin-freq",      .value = CFG_BITRATE },
 	{ .name = "-output",        .value = CFG_OUTFILE },
+	{ .name = "-itm-output",    .value = CFG_ITM_OUTFILE },
 	{ .name = "-event",         .value = CFG_EVENT },
 	/* handled by mem_ap_spot, added for jim_getopt_nvp_unknown() */
 	{ .name = "-dap",           .value = -1 },
@@ -490,6 +608,29 @@ static int arm_tpiu_swo_configure(struct jim_getopt_info *goi, struct arm_tpiu_s
 					Jim_SetResult(goi->interp, Jim_NewStringObj(goi->interp, obj->out_filename, -1));
 			}
 			break;
+		case CFG_ITM_OUTFILE:
+			if (goi->isconfigure) {
+				const char *s;
+				e = jim_getopt_string(goi, &s, NULL);
+				if (e != JIM_OK)
+					return e;
+				char *itm_prefix = NULL;
+				if (s[0]) {
+					itm_prefix = strdup(s);
+					if (!itm_prefix) {
+						LOG_ERROR("Out of memory");
+						return JIM_ERR;
+					}
+				}
+				free(obj->itm_prefix);
+				obj->itm_prefix = itm_prefix;
+			} else {
+				if (goi->argc)
+					goto err_no_params;
+				Jim_SetResult(goi->interp, Jim_NewStringObj(goi->interp,
+					obj->itm_prefix ? obj->itm_prefix : "", -1));
+			}
+			break;
 		case CFG_EVENT:
 			if (goi->isconfigure) {
 				if (goi->argc < 2) {
@@ -726,11 +867,18 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 				return ERROR_FAIL;
 			}
 			priv->obj = obj;
+			obj->stream = trace_stream_new(obj->name, ARM_TPIU_SWO_STREAM_SIZE);
+			if (!obj->stream) {
+				free(priv);
+				return ERROR_FAIL;
+			}
 			LOG_INFO("starting trace server for %s on %s", obj->name, &obj->out_filename[1]);
 			retval = add_service(&arm_tpiu_swo_service_driver, &obj->out_filename[1],
 				CONNECTION_LIMIT_UNLIMITED, priv);
 			if (retval != ERROR_OK) {
 				command_print(CMD, "Can't configure trace TCP port %s", &obj->out_filename[1]);
+				trace_stream_free(obj->stream);
+				obj->stream = NULL;
 				return retval;
 			}
 		} else if (strcmp(obj->out_filename, "-")) {
@@ -741,6 +889,9 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 			}
 		}
 
+		if (obj->itm_prefix && obj->en_formatter)
+			LOG_WARNING("%s: ITM decoding needs the formatter disabled", obj->name);
+
 		retval = adapter_config_trace(true, obj->pin_protocol, obj->port_width,
 			&swo_pin_freq, obj->traceclkin_freq, &prescaler);
 		if (retval != ERROR_OK) {
@@ -958,7 +1109,6 @@ static int jim_arm_tpiu_swo_create(Jim_Interp *interp, int argc, Jim_Obj *const
 		LOG_ERROR("Out of memory");
 		return JIM_ERR;
 	}
-	INIT_LIST_HEAD(&obj->connections);
 	adiv5_mem_ap_spot_init(&obj->spot);
 	obj->spot.base = TPIU_SWO_DEFAULT_BASE;
 	obj->port_width = 1;
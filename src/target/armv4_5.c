@@ -1620,13 +1620,15 @@ int arm_checksum_memory(struct target *target,
 		return retval;
 
 	/* convert code into a buffer in target endianness */
-	for (i = 0; i < ARRAY_SIZE(arm_crc_code_le) / 4; i++) {
-		retval = target_write_u32(target,
-				crc_algorithm->address + i * sizeof(uint32_t),
+	uint8_t crc_code[sizeof(arm_crc_code_le)];
+	for (i = 0; i < ARRAY_SIZE(arm_crc_code_le) / 4; i++)
+		target_buffer_set_u32(target, &crc_code[i * 4],
 				le_to_h_u32(&arm_crc_code_le[i * 4]));
-		if (retval != ERROR_OK)
-			goto cleanup;
-	}
+
+	retval = target_write_working_area_code(target, crc_algorithm,
+			crc_code, sizeof(crc_code));
+	if (retval != ERROR_OK)
+		goto cleanup;
 
 	arm_algo.common_magic = ARM_COMMON_MAGIC;
 	arm_algo.core_mode = ARM_MODE_SVC;
@@ -1700,14 +1702,15 @@ int arm_blank_check_memory(struct target *target,
 		return retval;
 
 	/* convert code into a buffer in target endianness */
-	for (i = 0; i < ARRAY_SIZE(check_code_le) / 4; i++) {
-		retval = target_write_u32(target,
-				check_algorithm->address
-				+ i * sizeof(uint32_t),
+	uint8_t check_code[sizeof(check_code_le)];
+	for (i = 0; i < ARRAY_SIZE(check_code_le) / 4; i++)
+		target_buffer_set_u32(target, &check_code[i * 4],
 				le_to_h_u32(&check_code_le[i * 4]));
-		if (retval != ERROR_OK)
-			goto cleanup;
-	}
+
+	retval = target_write_working_area_code(target, check_algorithm,
+			check_code, sizeof(check_code));
+	if (retval != ERROR_OK)
+		goto cleanup;
 
 	arm_algo.common_magic = ARM_COMMON_MAGIC;
 	arm_algo.core_mode = ARM_MODE_SVC;
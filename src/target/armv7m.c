@@ -176,6 +176,23 @@ int armv7m_restore_context(struct target *target)
 	if (armv7m->pre_restore_context)
 		armv7m->pre_restore_context(target);
 
+	if (armv7m->store_dirty_core_regs) {
+		/* Merge the packed registers into their dirty containers,
+		 * in the same descending order as below */
+		for (i = cache->num_regs - 1; i >= 0; i--) {
+			struct reg *r = &cache->reg_list[i];
+
+			if (r->exist && r->dirty && r->size <= 8) {
+				int retval = armv7m->arm.write_core_reg(target, r, i, ARM_MODE_ANY, r->value);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+		}
+
+		/* whatever is still dirty on failure is written below */
+		armv7m->store_dirty_core_regs(target);
+	}
+
 	/* The descending order of register writes is crucial for correct
 	 * packing of ARMV7M_PMSK_BPRI_FLTMSK_CTRL!
 	 * See also comments in the register table above */
@@ -895,8 +912,8 @@ int armv7m_checksum_memory(struct target *target,
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = target_write_buffer(target, crc_algorithm->address,
-			sizeof(cortex_m_crc_code), (uint8_t *)cortex_m_crc_code);
+	retval = target_write_working_area_code(target, crc_algorithm,
+			cortex_m_crc_code, sizeof(cortex_m_crc_code));
 	if (retval != ERROR_OK)
 		goto cleanup;
 
@@ -952,8 +969,8 @@ int armv7m_blank_check_memory(struct target *target,
 		&erase_check_algorithm) != ERROR_OK)
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-	retval = target_write_buffer(target, erase_check_algorithm->address,
-			code_size, erase_check_code);
+	retval = target_write_working_area_code(target, erase_check_algorithm,
+			erase_check_code, code_size);
 	if (retval != ERROR_OK)
 		goto cleanup1;
 
@@ -1062,6 +1079,325 @@ cleanup1:
 	return retval;
 }
 
+/** Counts the bytes at the start of each block that hold the fill word,
+ * returns the number of blocks checked. */
+int armv7m_fill_check_memory(struct target *target,
+	struct target_memory_check_block *blocks, int num_blocks, uint32_t fill)
+{
+	struct working_area *fill_check_algorithm;
+	struct working_area *fill_check_params;
+	struct reg_param reg_params[2];
+	struct armv7m_algorithm armv7m_info;
+	int retval;
+
+	static bool timed_out;
+
+	static const uint8_t fill_check_code[] = {
+#include "../../contrib/loaders/erase_check/armv7m_fill_check.inc"
+	};
+
+	const uint32_t code_size = sizeof(fill_check_code);
+
+	/* a zero size ends the list of blocks for the algorithm */
+	if (blocks[0].size < sizeof(uint32_t)) {
+		blocks[0].result = 0;
+		return 1;
+	}
+
+	/* make sure we have a working area */
+	if (target_alloc_working_area(target, code_size,
+		&fill_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = target_write_working_area_code(target, fill_check_algorithm,
+			fill_check_code, code_size);
+	if (retval != ERROR_OK)
+		goto cleanup1;
+
+	/* prepare blocks array for algo */
+	struct algo_block {
+		union {
+			uint32_t size;
+			uint32_t result;
+		};
+		uint32_t address;
+	};
+
+	uint32_t avail = target_get_working_area_avail(target);
+	int blocks_to_check = avail / sizeof(struct algo_block) - 1;
+	if (num_blocks < blocks_to_check)
+		blocks_to_check = num_blocks;
+	for (int i = 1; i < blocks_to_check; i++) {
+		if (blocks[i].size < sizeof(uint32_t)) {
+			blocks_to_check = i;
+			break;
+		}
+	}
+
+	struct algo_block *params = malloc((blocks_to_check+1)*sizeof(struct algo_block));
+	if (!params) {
+		retval = ERROR_FAIL;
+		goto cleanup1;
+	}
+
+	int i;
+	uint32_t total_size = 0;
+	for (i = 0; i < blocks_to_check; i++) {
+		total_size += blocks[i].size;
+		target_buffer_set_u32(target, (uint8_t *)&(params[i].size),
+						blocks[i].size / sizeof(uint32_t));
+		target_buffer_set_u32(target, (uint8_t *)&(params[i].address),
+						blocks[i].address);
+	}
+	target_buffer_set_u32(target, (uint8_t *)&(params[blocks_to_check].size), 0);
+
+	uint32_t param_size = (blocks_to_check + 1) * sizeof(struct algo_block);
+	if (target_alloc_working_area(target, param_size,
+			&fill_check_params) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = target_write_buffer(target, fill_check_params->address,
+				param_size, (uint8_t *)params);
+	if (retval != ERROR_OK)
+		goto cleanup3;
+
+	LOG_DEBUG("Starting fill check of %d blocks, parameters@"
+		 TARGET_ADDR_FMT, blocks_to_check, fill_check_params->address);
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	buf_set_u32(reg_params[0].value, 0, 32, fill_check_params->address);
+
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	buf_set_u32(reg_params[1].value, 0, 32, fill);
+
+	/* assume CPU clk at least 1 MHz */
+	unsigned int timeout = (timed_out ? 30000 : 2000) + total_size * 3 / 1000;
+
+	retval = target_run_algorithm(target,
+				0, NULL,
+				ARRAY_SIZE(reg_params), reg_params,
+				fill_check_algorithm->address,
+				fill_check_algorithm->address + (code_size - 2),
+				timeout,
+				&armv7m_info);
+
+	/* Unlike for the erase check, the blocks not reached can't be told
+	 * from the others: a result may equal the size. Allow more time for
+	 * the next run, the blocks of this one are read instead. */
+	timed_out = retval == ERROR_TARGET_TIMEOUT;
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	retval = target_read_buffer(target, fill_check_params->address,
+				param_size, (uint8_t *)params);
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	for (i = 0; i < blocks_to_check; i++) {
+		/* words left from the first one not holding the fill value */
+		uint32_t left = target_buffer_get_u32(target,
+					(uint8_t *)&(params[i].result));
+		uint32_t words = blocks[i].size / sizeof(uint32_t);
+		if (left > words)
+			break;
+
+		blocks[i].result = (words - left) * sizeof(uint32_t);
+	}
+
+	retval = i;		/* return number of blocks really checked */
+
+cleanup4:
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+cleanup3:
+	target_free_working_area(target, fill_check_params);
+cleanup2:
+	free(params);
+cleanup1:
+	target_free_working_area(target, fill_check_algorithm);
+
+	return retval;
+}
+
+/** Fills count elements of size bytes at address with value. */
+int armv7m_fill_memory(struct target *target, target_addr_t address,
+	uint32_t size, uint32_t count, uint64_t value)
+{
+	struct working_area *fill_algorithm;
+	struct reg_param reg_params[4];
+	struct armv7m_algorithm armv7m_info;
+	int retval;
+
+	static const uint8_t fill_code[] = {
+#include "../../contrib/loaders/fill/armv7m_fill.inc"
+	};
+
+	if (size > 4)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (target_alloc_working_area(target, sizeof(fill_code),
+			&fill_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* The algorithm can't overwrite itself */
+	const target_addr_t end = address + size * count;
+	if (address < fill_algorithm->address + fill_algorithm->size &&
+			fill_algorithm->address < end) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup;
+	}
+
+	retval = target_write_working_area_code(target, fill_algorithm,
+			fill_code, sizeof(fill_code));
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, end);
+	buf_set_u32(reg_params[2].value, 0, 32, value);
+	buf_set_u32(reg_params[3].value, 0, 32, size);
+
+	/* assume CPU clk at least 1 MHz, a few cycles per store */
+	unsigned int timeout = 2000 + count / 200;
+
+	retval = target_run_algorithm(target, 0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			fill_algorithm->address,
+			fill_algorithm->address + (sizeof(fill_code) - 2),
+			timeout, &armv7m_info);
+	if (retval != ERROR_OK)
+		LOG_ERROR("error executing cortex_m fill algorithm");
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+cleanup:
+	target_free_working_area(target, fill_algorithm);
+
+	return retval;
+}
+
+/** Runs a memory test, see the memory_test target hook. */
+int armv7m_memory_test(struct target *target, target_addr_t address,
+	uint32_t size, enum target_memory_test test, uint32_t state,
+	struct target_memory_test_failure *failures, unsigned int max_failures)
+{
+	struct working_area *memtest_algorithm;
+	struct working_area *memtest_log;
+	struct reg_param reg_params[6];
+	struct armv7m_algorithm armv7m_info;
+	int retval;
+
+	static const uint8_t memtest_code[] = {
+#include "../../contrib/loaders/memtest/armv7m_memtest.inc"
+	};
+
+	/* struct { uint32_t address, uint32_t expected, uint32_t actual } */
+	const uint32_t entry_size = 12;
+	const uint32_t log_size = MAX(max_failures, 1) * entry_size;
+	const target_addr_t end = address + size;
+
+	if (target_alloc_working_area(target, sizeof(memtest_code),
+			&memtest_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (target_alloc_working_area(target, log_size, &memtest_log) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup1;
+	}
+
+	if ((address < memtest_algorithm->address + memtest_algorithm->size &&
+			memtest_algorithm->address < end) ||
+			(address < memtest_log->address + memtest_log->size &&
+			memtest_log->address < end)) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = target_write_working_area_code(target, memtest_algorithm,
+			memtest_code, sizeof(memtest_code));
+	if (retval != ERROR_OK)
+		goto cleanup2;
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, size / 4);
+	buf_set_u32(reg_params[2].value, 0, 32, test);
+	buf_set_u32(reg_params[3].value, 0, 32, state);
+	buf_set_u32(reg_params[4].value, 0, 32, memtest_log->address);
+	buf_set_u32(reg_params[5].value, 0, 32, max_failures);
+
+	/* assume CPU clk at least 1 MHz, about 30 cycles per word */
+	unsigned int timeout = 2000 + size / 4 * 30 / 1000;
+
+	retval = target_run_algorithm(target, 0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			memtest_algorithm->address,
+			memtest_algorithm->address + (sizeof(memtest_code) - 2),
+			timeout, &armv7m_info);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("error executing cortex_m memory test algorithm");
+		goto cleanup3;
+	}
+
+	uint32_t num_failures = buf_get_u32(reg_params[0].value, 0, 32);
+	uint32_t logged = MIN(num_failures, max_failures);
+	if (logged) {
+		uint8_t *log_buf = malloc(logged * entry_size);
+		if (!log_buf) {
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+			goto cleanup3;
+		}
+		retval = target_read_buffer(target, memtest_log->address,
+				logged * entry_size, log_buf);
+		for (uint32_t i = 0; retval == ERROR_OK && i < logged; i++) {
+			const uint8_t *entry = log_buf + i * entry_size;
+			failures[i].address = target_buffer_get_u32(target, entry);
+			failures[i].expected = target_buffer_get_u32(target, entry + 4);
+			failures[i].actual = target_buffer_get_u32(target, entry + 8);
+		}
+		free(log_buf);
+		if (retval != ERROR_OK)
+			goto cleanup3;
+	}
+
+	retval = MIN(num_failures, (uint32_t)INT_MAX);
+
+cleanup3:
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+cleanup2:
+	target_free_working_area(target, memtest_log);
+cleanup1:
+	target_free_working_area(target, memtest_algorithm);
+
+	return retval;
+}
+
 int armv7m_maybe_skip_bkpt_inst(struct target *target, bool *inst_found)
 {
 	struct armv7m_common *armv7m = target_to_armv7m(target);
@@ -240,6 +240,9 @@ struct armv7m_common {
 	/* Direct processor core register read and writes */
 	int (*load_core_reg_u32)(struct target *target, uint32_t regsel, uint32_t *value);
 	int (*store_core_reg_u32)(struct target *target, uint32_t regsel, uint32_t value);
+	/* Optional, write all dirty 32 and 64-bit core registers at once. Registers
+	 * left dirty on failure are written one by one by store_core_reg_u32 */
+	int (*store_dirty_core_regs)(struct target *target);
 
 	int (*examine_debug_reason)(struct target *target);
 	int (*post_debug_entry)(struct target *target);
@@ -343,6 +346,13 @@ int armv7m_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t count, uint32_t *checksum);
 int armv7m_blank_check_memory(struct target *target,
 		struct target_memory_check_block *blocks, int num_blocks, uint8_t erased_value);
+int armv7m_fill_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks, uint32_t fill);
+int armv7m_fill_memory(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint64_t value);
+int armv7m_memory_test(struct target *target, target_addr_t address,
+		uint32_t size, enum target_memory_test test, uint32_t state,
+		struct target_memory_test_failure *failures, unsigned int max_failures);
 
 int armv7m_maybe_skip_bkpt_inst(struct target *target, bool *inst_found);
 
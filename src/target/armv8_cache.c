@@ -101,6 +101,21 @@ done:
 	return retval;
 }
 
+/* total size in bytes of the data or instruction caches up to the level of coherence */
+static size_t armv8_cache_size(struct armv8_cache_common *cache, bool data)
+{
+	size_t total = 0;
+
+	for (int cl = 0; cl < cache->loc; cl++) {
+		if (data && cache->arch[cl].ctype >= CACHE_LEVEL_HAS_D_CACHE)
+			total += cache->arch[cl].d_u_size.cachesize * 1024;
+		else if (!data && (cache->arch[cl].ctype & CACHE_LEVEL_HAS_I_CACHE))
+			total += cache->arch[cl].i_size.cachesize * 1024;
+	}
+
+	return total;
+}
+
 int armv8_cache_d_inner_flush_virt(struct armv8_common *armv8, target_addr_t va, size_t size)
 {
 	struct arm_dpm *dpm = armv8->arm.dpm;
@@ -113,6 +128,12 @@ int armv8_cache_d_inner_flush_virt(struct armv8_common *armv8, target_addr_t va,
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* Past the size of the caches, cleaning all of them by set/way takes
+	 * fewer operations than going line by line through the range */
+	size_t cache_size = armv8_cache_size(armv8_cache, true);
+	if (cache_size && size > cache_size)
+		return armv8_cache_d_inner_clean_inval_all(armv8);
+
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
 		goto done;
@@ -156,6 +177,17 @@ int armv8_cache_i_inner_inval_virt(struct armv8_common *armv8, target_addr_t va,
 	if (retval != ERROR_OK)
 		goto done;
 
+	size_t cache_size = armv8_cache_size(armv8_cache, false);
+	if (cache_size && size > cache_size) {
+		/* IC IALLUIS - Invalidate all instruction caches to PoU, Inner Shareable */
+		retval = dpm->instr_execute(dpm, armv8_opcode(armv8, ARMV8_OPC_ICIALLUIS));
+		if (retval != ERROR_OK)
+			goto done;
+
+		dpm->finish(dpm);
+		return retval;
+	}
+
 	va_line = va & (-linelen);
 	va_end = va + size;
 
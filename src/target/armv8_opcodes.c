@@ -32,6 +32,7 @@ static const uint32_t a64_opcodes[ARMV8_OPC_NUM] = {
 		[ARMV8_OPC_DCCISW]	= ARMV8_SYS(SYSTEM_DCCISW, 0),
 		[ARMV8_OPC_DCCIVAC]	= ARMV8_SYS(SYSTEM_DCCIVAC, 0),
 		[ARMV8_OPC_ICIVAU]	= ARMV8_SYS(SYSTEM_ICIVAU, 0),
+		[ARMV8_OPC_ICIALLUIS]	= ARMV8_SYS(SYSTEM_ICIALLUIS, 0),
 		[ARMV8_OPC_HLT]		= ARMV8_HLT(11),
 		[ARMV8_OPC_LDRB_IP]	= ARMV8_LDRB_IP(1, 0),
 		[ARMV8_OPC_LDRH_IP]	= ARMV8_LDRH_IP(1, 0),
@@ -61,6 +62,7 @@ static const uint32_t t32_opcodes[ARMV8_OPC_NUM] = {
 		[ARMV8_OPC_DCCISW]	= ARMV4_5_MCR(15, 0, 0, 7, 14, 2),
 		[ARMV8_OPC_DCCIVAC]	= ARMV4_5_MCR(15, 0, 0, 7, 14, 1),
 		[ARMV8_OPC_ICIVAU]	= ARMV4_5_MCR(15, 0, 0, 7, 5, 1),
+		[ARMV8_OPC_ICIALLUIS]	= ARMV4_5_MCR(15, 0, 0, 7, 1, 0),
 		[ARMV8_OPC_HLT]		= ARMV8_HLT_T1(11),
 		[ARMV8_OPC_LDRB_IP]	= ARMV8_LDRB_IP_T3(1, 0),
 		[ARMV8_OPC_LDRH_IP]	= ARMV8_LDRH_IP_T3(1, 0),
@@ -74,6 +74,7 @@
 #define SYSTEM_ICIVAU			0x5BA9
 #define SYSTEM_DCCVAU			0x5BD9
 #define SYSTEM_DCCIVAC			0x5BF1
+#define SYSTEM_ICIALLUIS		0x4388
 
 #define SYSTEM_MPIDR			0xC005
 
@@ -198,6 +199,7 @@ enum armv8_opcode {
 	ARMV8_OPC_DCCISW,
 	ARMV8_OPC_DCCIVAC,
 	ARMV8_OPC_ICIVAU,
+	ARMV8_OPC_ICIALLUIS,
 	ARMV8_OPC_HLT,
 	ARMV8_OPC_STRB_IP,
 	ARMV8_OPC_STRH_IP,
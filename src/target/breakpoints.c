@@ -37,6 +37,108 @@ static const char * const watchpoint_rw_strings[] = {
 /* monotonic counter/id-number for breakpoints and watch points */
 static int bpwp_unique_id;
 
+/* When set, hardware breakpoints removed from a halted target stay set until
+ * the target is resumed, so a breakpoint that is removed and added again in
+ * between (as gdb does around every stop) never has to touch the target. */
+static bool defer_removal;
+
+void breakpoint_set_defer_removal(bool enable)
+{
+	defer_removal = enable;
+}
+
+bool breakpoint_get_defer_removal(void)
+{
+	return defer_removal;
+}
+
+static int breakpoint_remove_deferred_internal(struct target *target)
+{
+	int retval = ERROR_OK;
+
+	while (target->breakpoints_removed) {
+		struct breakpoint *breakpoint = target->breakpoints_removed;
+		target->breakpoints_removed = breakpoint->next;
+
+		int status = target_remove_breakpoint(target, breakpoint);
+		if (status != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "could not remove breakpoint #%d on this target",
+							breakpoint->number);
+			retval = status;
+		}
+
+		LOG_TARGET_DEBUG(target, "free deferred BPID: %" PRIu32 " --> %d", breakpoint->unique_id, status);
+		free(breakpoint->orig_instr);
+		free(breakpoint);
+	}
+
+	return retval;
+}
+
+/* Remove the breakpoints whose removal was deferred. */
+int breakpoint_remove_deferred(struct target *target)
+{
+	if (!target->smp)
+		return breakpoint_remove_deferred_internal(target);
+
+	int retval = ERROR_OK;
+	struct target_list *head;
+	foreach_smp_target(head, target->smp_targets) {
+		int status = breakpoint_remove_deferred_internal(head->target);
+		if (status != ERROR_OK)
+			retval = status;
+	}
+	return retval;
+}
+
+static bool breakpoint_can_defer_removal(struct target *target,
+		struct breakpoint *breakpoint)
+{
+	return defer_removal && target->state == TARGET_HALTED &&
+		breakpoint->type == BKPT_HARD && breakpoint->is_set &&
+		breakpoint->asid == 0;
+}
+
+/* Unlink the breakpoint from the list of breakpoints, but leave it set on the
+ * target until breakpoint_remove_deferred() is called. */
+static int breakpoint_defer_free(struct target *target,
+		struct breakpoint *breakpoint_to_remove)
+{
+	struct breakpoint **breakpoint_p = &target->breakpoints;
+
+	while (*breakpoint_p && *breakpoint_p != breakpoint_to_remove)
+		breakpoint_p = &(*breakpoint_p)->next;
+
+	if (!*breakpoint_p)
+		return ERROR_BREAKPOINT_NOT_FOUND;
+
+	*breakpoint_p = breakpoint_to_remove->next;
+	breakpoint_to_remove->next = target->breakpoints_removed;
+	target->breakpoints_removed = breakpoint_to_remove;
+
+	LOG_TARGET_DEBUG(target, "deferred removal of BPID: %" PRIu32, breakpoint_to_remove->unique_id);
+	return ERROR_OK;
+}
+
+/* Take back a breakpoint that is still set because its removal was deferred. */
+static struct breakpoint *breakpoint_take_deferred(struct target *target,
+		target_addr_t address, uint32_t length, enum breakpoint_type type)
+{
+	struct breakpoint **breakpoint_p = &target->breakpoints_removed;
+
+	for (; *breakpoint_p; breakpoint_p = &(*breakpoint_p)->next) {
+		struct breakpoint *breakpoint = *breakpoint_p;
+		if (breakpoint->address == address && breakpoint->length == (int)length &&
+				breakpoint->type == type) {
+			*breakpoint_p = breakpoint->next;
+			breakpoint->next = NULL;
+			return breakpoint;
+		}
+	}
+
+	return NULL;
+}
+
 static int breakpoint_add_internal(struct target *target,
 	target_addr_t address,
 	uint32_t length,
@@ -61,6 +163,14 @@ static int breakpoint_add_internal(struct target *target,
 		breakpoint = breakpoint->next;
 	}
 
+	(*breakpoint_p) = breakpoint_take_deferred(target, address, length, type);
+	if (*breakpoint_p) {
+		LOG_TARGET_DEBUG(target, "reused %s breakpoint at " TARGET_ADDR_FMT
+				" that was still set, (BPID: %" PRIu32 ")",
+			breakpoint_type_strings[type], address, (*breakpoint_p)->unique_id);
+		return ERROR_OK;
+	}
+
 	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
 	(*breakpoint_p)->address = address;
 	(*breakpoint_p)->asid = 0;
@@ -72,6 +182,12 @@ static int breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
 
 	retval = target_add_breakpoint(target, *breakpoint_p);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE && target->breakpoints_removed) {
+		/* Free the resources held by breakpoints that are only still set
+		 * because their removal was deferred. */
+		if (breakpoint_remove_deferred_internal(target) == ERROR_OK)
+			retval = target_add_breakpoint(target, *breakpoint_p);
+	}
 	switch (retval) {
 		case ERROR_OK:
 			break;
@@ -329,6 +445,10 @@ static int breakpoint_remove_all_internal(struct target *target)
 			retval = status;
 	}
 
+	int status = breakpoint_remove_deferred_internal(target);
+	if (status != ERROR_OK)
+		retval = status;
+
 	return retval;
 }
 
@@ -336,9 +456,11 @@ int breakpoint_remove(struct target *target, target_addr_t address)
 {
 	if (!target->smp) {
 		struct breakpoint *breakpoint = breakpoint_find(target, address);
-		if (breakpoint)
-			return breakpoint_free(target, target, breakpoint);
-		return ERROR_BREAKPOINT_NOT_FOUND;
+		if (!breakpoint)
+			return ERROR_BREAKPOINT_NOT_FOUND;
+		if (breakpoint_can_defer_removal(target, breakpoint))
+			return breakpoint_defer_free(target, breakpoint);
+		return breakpoint_free(target, target, breakpoint);
 	}
 
 	int retval = ERROR_OK;
@@ -379,7 +501,11 @@ int breakpoint_remove(struct target *target, target_addr_t address)
 				software_breakpoint = breakpoint;
 			}
 		} else {
-			int status = breakpoint_free(curr, curr, breakpoint);
+			int status;
+			if (breakpoint_can_defer_removal(curr, breakpoint))
+				status = breakpoint_defer_free(curr, breakpoint);
+			else
+				status = breakpoint_free(curr, curr, breakpoint);
 			if (status != ERROR_OK)
 				retval = status;
 		}
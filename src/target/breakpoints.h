@@ -62,6 +62,10 @@ int breakpoint_remove_all(struct target *target);
 
 struct breakpoint *breakpoint_find(struct target *target, target_addr_t address);
 
+void breakpoint_set_defer_removal(bool enable);
+bool breakpoint_get_defer_removal(void);
+int breakpoint_remove_deferred(struct target *target);
+
 static inline void breakpoint_hw_set(struct breakpoint *breakpoint, unsigned int hw_number)
 {
 	breakpoint->is_set = true;
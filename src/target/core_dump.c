@@ -0,0 +1,516 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * "core_dump" writes an ELF core file of the halted target: one PT_LOAD
+ * segment per memory region and one NT_PRSTATUS note per hart, or per
+ * thread if an RTOS is detected, that gdb loads with "target core" (or
+ * "core-file").
+ *
+ * The prstatus notes use the layout of the Linux elf_prstatus, which is what
+ * gdb expects in bare-metal core files too. Only what gdb reads is filled
+ * in: the signal, the thread id and the general registers.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "core_dump.h"
+#include "register.h"
+#include "smp.h"
+#include "target.h"
+#include "rtos/rtos.h"
+#include <helper/binarybuffer.h>
+#include <helper/command.h>
+#include <helper/fileio.h>
+#include <helper/log.h>
+#include <helper/time_support.h>
+
+#define EM_ARM		40
+#define EM_AARCH64	183
+#define EM_RISCV	243
+
+#define ET_CORE		4
+#define PT_LOAD		1
+#define PT_NOTE		4
+#define NT_PRSTATUS	1
+
+#define CORE_DUMP_SIGTRAP	5
+
+/* Memory is read in blocks of this size, this many at a time with
+ * target_read_buffer_list(), which targets queue in one transaction. */
+#define CORE_DUMP_BLOCK_SIZE	0x10000
+#define CORE_DUMP_BLOCKS	16
+
+#define CORE_DUMP_MAX_REGIONS	64
+
+/* A register of elf_gregset_t, missing ones are left 0 */
+struct core_dump_reg_name {
+	const char *name;
+	const char *alias;
+};
+
+struct core_dump_arch {
+	uint16_t machine;
+	const struct core_dump_reg_name *regs;
+	unsigned int num_regs;
+};
+
+static const struct core_dump_reg_name core_dump_riscv_regs[] = {
+	{ "pc", NULL }, { "ra", NULL }, { "sp", NULL }, { "gp", NULL },
+	{ "tp", NULL }, { "t0", NULL }, { "t1", NULL }, { "t2", NULL },
+	{ "fp", "s0" }, { "s1", NULL }, { "a0", NULL }, { "a1", NULL },
+	{ "a2", NULL }, { "a3", NULL }, { "a4", NULL }, { "a5", NULL },
+	{ "a6", NULL }, { "a7", NULL }, { "s2", NULL }, { "s3", NULL },
+	{ "s4", NULL }, { "s5", NULL }, { "s6", NULL }, { "s7", NULL },
+	{ "s8", NULL }, { "s9", NULL }, { "s10", NULL }, { "s11", NULL },
+	{ "t3", NULL }, { "t4", NULL }, { "t5", NULL }, { "t6", NULL },
+};
+
+static const struct core_dump_reg_name core_dump_arm_regs[] = {
+	{ "r0", NULL }, { "r1", NULL }, { "r2", NULL }, { "r3", NULL },
+	{ "r4", NULL }, { "r5", NULL }, { "r6", NULL }, { "r7", NULL },
+	{ "r8", NULL }, { "r9", NULL }, { "r10", NULL }, { "r11", NULL },
+	{ "r12", NULL }, { "sp", "r13" }, { "lr", "r14" }, { "pc", "r15" },
+	{ "cpsr", "xPSR" }, { "orig_r0", NULL },
+};
+
+static const struct core_dump_reg_name core_dump_aarch64_regs[] = {
+	{ "x0", NULL }, { "x1", NULL }, { "x2", NULL }, { "x3", NULL },
+	{ "x4", NULL }, { "x5", NULL }, { "x6", NULL }, { "x7", NULL },
+	{ "x8", NULL }, { "x9", NULL }, { "x10", NULL }, { "x11", NULL },
+	{ "x12", NULL }, { "x13", NULL }, { "x14", NULL }, { "x15", NULL },
+	{ "x16", NULL }, { "x17", NULL }, { "x18", NULL }, { "x19", NULL },
+	{ "x20", NULL }, { "x21", NULL }, { "x22", NULL }, { "x23", NULL },
+	{ "x24", NULL }, { "x25", NULL }, { "x26", NULL }, { "x27", NULL },
+	{ "x28", NULL }, { "x29", NULL }, { "x30", NULL }, { "sp", NULL },
+	{ "pc", NULL }, { "cpsr", NULL },
+};
+
+static const struct core_dump_arch core_dump_riscv = {
+	.machine = EM_RISCV,
+	.regs = core_dump_riscv_regs,
+	.num_regs = ARRAY_SIZE(core_dump_riscv_regs),
+};
+
+static const struct core_dump_arch core_dump_arm = {
+	.machine = EM_ARM,
+	.regs = core_dump_arm_regs,
+	.num_regs = ARRAY_SIZE(core_dump_arm_regs),
+};
+
+static const struct core_dump_arch core_dump_aarch64 = {
+	.machine = EM_AARCH64,
+	.regs = core_dump_aarch64_regs,
+	.num_regs = ARRAY_SIZE(core_dump_aarch64_regs),
+};
+
+struct core_dump {
+	struct target *target;
+	const struct core_dump_arch *arch;
+	bool elf64;
+	/* gdb register number of each register of arch, -1 if there's none */
+	int *reg_numbers;
+	/* NT_PRSTATUS notes */
+	uint8_t *notes;
+	size_t notes_size;
+	unsigned int num_threads;
+};
+
+static int core_dump_find_reg(struct reg **reg_list, int reg_list_size,
+		const struct core_dump_reg_name *name)
+{
+	for (int i = 0; i < reg_list_size; i++) {
+		if (!strcmp(reg_list[i]->name, name->name) ||
+				(name->alias && !strcmp(reg_list[i]->name, name->alias)))
+			return i;
+	}
+	return -1;
+}
+
+/* Pick the architecture by the registers gdb knows the target by. */
+static int core_dump_init(struct core_dump *dump, struct target *target)
+{
+	struct reg **reg_list;
+	int reg_list_size;
+	int retval = target_get_gdb_reg_list(target, &reg_list, &reg_list_size, REG_CLASS_ALL);
+	if (retval != ERROR_OK)
+		return retval;
+
+	const char *type = target_type_name(target);
+	const struct core_dump_reg_name any_psr = { "cpsr", "xPSR" };
+	if (!strcmp(type, "riscv"))
+		dump->arch = &core_dump_riscv;
+	else if (!strcmp(type, "aarch64"))
+		dump->arch = &core_dump_aarch64;
+	else if (core_dump_find_reg(reg_list, reg_list_size, &core_dump_arm_regs[0]) >= 0 &&
+			core_dump_find_reg(reg_list, reg_list_size, &any_psr) >= 0)
+		dump->arch = &core_dump_arm;
+
+	if (!dump->arch) {
+		free(reg_list);
+		LOG_TARGET_ERROR(target, "core dumps of %s targets are not supported", type);
+		return ERROR_NOT_IMPLEMENTED;
+	}
+
+	dump->reg_numbers = calloc(dump->arch->num_regs, sizeof(*dump->reg_numbers));
+	if (!dump->reg_numbers) {
+		free(reg_list);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < dump->arch->num_regs; i++)
+		dump->reg_numbers[i] = core_dump_find_reg(reg_list, reg_list_size, &dump->arch->regs[i]);
+
+	/* RV64 and AArch64 have 64 bit general registers */
+	dump->elf64 = dump->arch == &core_dump_aarch64;
+	if (dump->arch == &core_dump_riscv && dump->reg_numbers[0] >= 0)
+		dump->elf64 = reg_list[dump->reg_numbers[0]]->size == 64;
+
+	dump->target = target;
+	free(reg_list);
+	return ERROR_OK;
+}
+
+static size_t core_dump_prstatus_size(const struct core_dump *dump)
+{
+	if (dump->elf64)
+		return 112 + dump->arch->num_regs * 8 + 8;
+	return 72 + dump->arch->num_regs * 4 + 4;
+}
+
+/* Append a NT_PRSTATUS note and return the registers to fill in. */
+static uint8_t *core_dump_add_thread(struct core_dump *dump, uint32_t pid)
+{
+	/* "CORE" padded to 8 bytes */
+	const size_t desc_size = core_dump_prstatus_size(dump);
+	const size_t note_size = 12 + 8 + desc_size;
+	uint8_t *notes = realloc(dump->notes, dump->notes_size + note_size);
+	if (!notes) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+	dump->notes = notes;
+
+	uint8_t *note = notes + dump->notes_size;
+	memset(note, 0, note_size);
+	target_buffer_set_u32(dump->target, note, 5);
+	target_buffer_set_u32(dump->target, note + 4, desc_size);
+	target_buffer_set_u32(dump->target, note + 8, NT_PRSTATUS);
+	memcpy(note + 12, "CORE", 5);
+
+	uint8_t *prstatus = note + 20;
+	target_buffer_set_u16(dump->target, prstatus + 12, CORE_DUMP_SIGTRAP);
+	target_buffer_set_u32(dump->target, prstatus + (dump->elf64 ? 32 : 24), pid);
+
+	dump->notes_size += note_size;
+	dump->num_threads++;
+	return prstatus + (dump->elf64 ? 112 : 72);
+}
+
+static void core_dump_set_reg(const struct core_dump *dump, uint8_t *regs, unsigned int i,
+		uint64_t value)
+{
+	if (dump->elf64)
+		target_buffer_set_u64(dump->target, regs + i * 8, value);
+	else
+		target_buffer_set_u32(dump->target, regs + i * 4, value);
+}
+
+/* A hart, with the registers from its register cache. */
+static int core_dump_add_hart(struct core_dump *dump, struct target *target)
+{
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_WARNING(target, "not halted, its registers are not dumped");
+		return ERROR_OK;
+	}
+
+	struct reg **reg_list;
+	int reg_list_size;
+	int retval = target_get_gdb_reg_list(target, &reg_list, &reg_list_size, REG_CLASS_ALL);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint8_t *regs = core_dump_add_thread(dump, target->coreid + 1);
+	for (unsigned int i = 0; regs && i < dump->arch->num_regs; i++) {
+		int n = dump->reg_numbers[i];
+		if (n < 0 || n >= reg_list_size || !reg_list[n]->exist)
+			continue;
+		struct reg *reg = reg_list[n];
+		if (!reg->valid && reg->type->get(reg) != ERROR_OK) {
+			LOG_TARGET_WARNING(target, "can't read %s", reg->name);
+			continue;
+		}
+		core_dump_set_reg(dump, regs, i, buf_get_u64(reg->value, 0, MIN(reg->size, 64)));
+	}
+
+	free(reg_list);
+	return regs ? ERROR_OK : ERROR_FAIL;
+}
+
+/* An RTOS thread, with the registers the RTOS support reports. */
+static int core_dump_add_rtos_thread(struct core_dump *dump, struct rtos *rtos,
+		threadid_t thread_id)
+{
+	struct rtos_reg *reg_list;
+	int num_regs;
+	if (rtos->type->get_thread_reg_list(rtos, thread_id, &reg_list, &num_regs) != ERROR_OK) {
+		LOG_TARGET_WARNING(dump->target, "can't get the registers of thread %" PRId64,
+				thread_id);
+		return ERROR_OK;
+	}
+
+	uint8_t *regs = core_dump_add_thread(dump, thread_id);
+	for (unsigned int i = 0; regs && i < dump->arch->num_regs; i++) {
+		for (int j = 0; j < num_regs; j++) {
+			if ((int)reg_list[j].number != dump->reg_numbers[i])
+				continue;
+			uint64_t value = reg_list[j].size > 32 ?
+				target_buffer_get_u64(dump->target, reg_list[j].value) :
+				target_buffer_get_u32(dump->target, reg_list[j].value);
+			core_dump_set_reg(dump, regs, i, value);
+			break;
+		}
+	}
+
+	free(reg_list);
+	return regs ? ERROR_OK : ERROR_FAIL;
+}
+
+static int core_dump_add_threads(struct core_dump *dump)
+{
+	struct target *target = dump->target;
+	struct rtos *rtos = target->rtos;
+	int retval;
+
+	if (rtos) {
+		rtos_update_threads(target);
+		if (rtos->thread_count > 0 && rtos->type->get_thread_reg_list &&
+				strcmp(rtos->type->name, "hwthread")) {
+			for (int i = 0; i < rtos->thread_count; i++) {
+				retval = core_dump_add_rtos_thread(dump, rtos,
+						rtos->thread_details[i].threadid);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			return ERROR_OK;
+		}
+	}
+
+	if (!target->smp)
+		return core_dump_add_hart(dump, target);
+
+	struct target_list *tlist;
+	foreach_smp_target(tlist, target->smp_targets) {
+		retval = core_dump_add_hart(dump, tlist->target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	return ERROR_OK;
+}
+
+static void core_dump_set_word(const struct core_dump *dump, uint8_t *buf, uint64_t value)
+{
+	if (dump->elf64)
+		target_buffer_set_u64(dump->target, buf, value);
+	else
+		target_buffer_set_u32(dump->target, buf, value);
+}
+
+/* ELF header and program headers, followed by the notes. */
+static int core_dump_write_headers(struct core_dump *dump, struct fileio *fileio,
+		const target_addr_t *addresses, const target_addr_t *sizes, unsigned int num_regions)
+{
+	struct target *target = dump->target;
+	const size_t ehdr_size = dump->elf64 ? 64 : 52;
+	const size_t phdr_size = dump->elf64 ? 56 : 32;
+	const size_t word = dump->elf64 ? 8 : 4;
+	const unsigned int num_phdrs = num_regions + 1;
+	const size_t headers_size = ehdr_size + num_phdrs * phdr_size;
+
+	uint8_t *headers = calloc(1, headers_size);
+	if (!headers) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* ELF header */
+	memcpy(headers, "\x7f" "ELF", 4);
+	headers[4] = dump->elf64 ? 2 : 1;
+	headers[5] = target->endianness == TARGET_BIG_ENDIAN ? 2 : 1;
+	headers[6] = 1;
+	target_buffer_set_u16(target, headers + 16, ET_CORE);
+	target_buffer_set_u16(target, headers + 18, dump->arch->machine);
+	target_buffer_set_u32(target, headers + 20, 1);
+	/* e_entry, then e_phoff */
+	core_dump_set_word(dump, headers + 24 + word, ehdr_size);
+	uint8_t *p = headers + 24 + 3 * word + 4;
+	target_buffer_set_u16(target, p, ehdr_size);
+	target_buffer_set_u16(target, p + 2, phdr_size);
+	target_buffer_set_u16(target, p + 4, num_phdrs);
+
+	/* The note, then the memory */
+	uint64_t offset = headers_size;
+	for (unsigned int i = 0; i < num_phdrs; i++) {
+		uint8_t *phdr = headers + ehdr_size + i * phdr_size;
+		const bool note = i == 0;
+		const uint64_t vaddr = note ? 0 : addresses[i - 1];
+		const uint64_t size = note ? dump->notes_size : sizes[i - 1];
+
+		target_buffer_set_u32(target, phdr, note ? PT_NOTE : PT_LOAD);
+		if (dump->elf64) {
+			target_buffer_set_u32(target, phdr + 4, note ? 0 : 7);
+			target_buffer_set_u64(target, phdr + 8, offset);
+			target_buffer_set_u64(target, phdr + 16, vaddr);
+			target_buffer_set_u64(target, phdr + 24, vaddr);
+			target_buffer_set_u64(target, phdr + 32, size);
+			target_buffer_set_u64(target, phdr + 40, note ? 0 : size);
+			target_buffer_set_u64(target, phdr + 48, note ? 4 : 1);
+		} else {
+			target_buffer_set_u32(target, phdr + 4, offset);
+			target_buffer_set_u32(target, phdr + 8, vaddr);
+			target_buffer_set_u32(target, phdr + 12, vaddr);
+			target_buffer_set_u32(target, phdr + 16, size);
+			target_buffer_set_u32(target, phdr + 20, note ? 0 : size);
+			target_buffer_set_u32(target, phdr + 24, note ? 0 : 7);
+			target_buffer_set_u32(target, phdr + 28, note ? 4 : 1);
+		}
+		offset += size;
+	}
+
+	size_t written;
+	int retval = fileio_write(fileio, headers_size, headers, &written);
+	free(headers);
+	if (retval == ERROR_OK)
+		retval = fileio_write(fileio, dump->notes_size, dump->notes, &written);
+	return retval;
+}
+
+/* Stream a region to the file, several blocks per target access. */
+static int core_dump_write_region(struct target *target, struct fileio *fileio,
+		uint8_t *buffer, target_addr_t address, target_addr_t size)
+{
+	struct target_memory_read_block blocks[CORE_DUMP_BLOCKS];
+
+	while (size > 0) {
+		unsigned int num_blocks = 0;
+		target_addr_t chunk = 0;
+		while (num_blocks < CORE_DUMP_BLOCKS && chunk < size) {
+			blocks[num_blocks].address = address + chunk;
+			blocks[num_blocks].size = MIN(size - chunk, CORE_DUMP_BLOCK_SIZE);
+			blocks[num_blocks].buffer = buffer + chunk;
+			chunk += blocks[num_blocks].size;
+			num_blocks++;
+		}
+
+		int retval = target_read_buffer_list(target, blocks, num_blocks);
+		if (retval != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "can't read memory at " TARGET_ADDR_FMT, address);
+			return retval;
+		}
+
+		size_t written;
+		retval = fileio_write(fileio, chunk, buffer, &written);
+		if (retval != ERROR_OK)
+			return retval;
+
+		address += chunk;
+		size -= chunk;
+		keep_alive();
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_core_dump_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	target_addr_t addresses[CORE_DUMP_MAX_REGIONS];
+	target_addr_t sizes[CORE_DUMP_MAX_REGIONS];
+
+	if (CMD_ARGC < 1 || CMD_ARGC % 2 != 1 || CMD_ARGC / 2 > CORE_DUMP_MAX_REGIONS)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const unsigned int num_regions = CMD_ARGC / 2;
+	target_addr_t total = 0;
+	for (unsigned int i = 0; i < num_regions; i++) {
+		COMMAND_PARSE_ADDRESS(CMD_ARGV[1 + 2 * i], addresses[i]);
+		COMMAND_PARSE_ADDRESS(CMD_ARGV[2 + 2 * i], sizes[i]);
+		total += sizes[i];
+	}
+
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD, "Error: target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	struct core_dump dump = { 0 };
+	int retval = core_dump_init(&dump, target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (!dump.elf64) {
+		for (unsigned int i = 0; i < num_regions; i++) {
+			if (addresses[i] + sizes[i] > 0x100000000ull) {
+				command_print(CMD, "region " TARGET_ADDR_FMT " doesn't fit in a 32 bit core file",
+						addresses[i]);
+				free(dump.reg_numbers);
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+	}
+
+	struct fileio *fileio = NULL;
+	uint8_t *buffer = NULL;
+	struct duration bench;
+	duration_start(&bench);
+
+	retval = core_dump_add_threads(&dump);
+	if (retval != ERROR_OK)
+		goto out;
+
+	buffer = malloc(CORE_DUMP_BLOCKS * CORE_DUMP_BLOCK_SIZE);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	retval = fileio_open(&fileio, CMD_ARGV[0], FILEIO_WRITE, FILEIO_BINARY);
+	if (retval != ERROR_OK) {
+		fileio = NULL;
+		goto out;
+	}
+
+	retval = core_dump_write_headers(&dump, fileio, addresses, sizes, num_regions);
+	for (unsigned int i = 0; retval == ERROR_OK && i < num_regions; i++)
+		retval = core_dump_write_region(target, fileio, buffer, addresses[i], sizes[i]);
+
+	if (retval == ERROR_OK && duration_measure(&bench) == ERROR_OK)
+		command_print(CMD, "dumped %u threads and %" PRIu64 " bytes of memory "
+				"in %fs (%0.3f KiB/s)", dump.num_threads, (uint64_t)total,
+				duration_elapsed(&bench), duration_kbps(&bench, total));
+
+out:
+	if (fileio) {
+		int retvaltemp = fileio_close(fileio);
+		if (retval == ERROR_OK)
+			retval = retvaltemp;
+	}
+	free(buffer);
+	free(dump.notes);
+	free(dump.reg_numbers);
+	return retval;
+}
+
+const struct command_registration core_dump_command_handlers[] = {
+	{
+		.name = "core_dump",
+		.handler = handle_core_dump_command,
+		.mode = COMMAND_EXEC,
+		.help = "Write an ELF core file with the registers of all the "
+			"harts or RTOS threads and the given memory regions",
+		.usage = "filename [address size]...",
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_CORE_DUMP_H
+#define OPENOCD_TARGET_CORE_DUMP_H
+
+#include <helper/command.h>
+
+extern const struct command_registration core_dump_command_handlers[];
+
+#endif /* OPENOCD_TARGET_CORE_DUMP_H */
@@ -158,6 +158,7 @@ static int cortex_m_read_dhcsr_atomic_sticky(struct target *target)
 	struct cortex_m_common *cortex_m = target_to_cm(target);
 	struct armv7m_common *armv7m = target_to_armv7m(target);
 
+	cortex_m->dcb_dhcsr_prefetched = false;
 	int retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR,
 				&cortex_m->dcb_dhcsr);
 	if (retval != ERROR_OK)
@@ -438,12 +439,122 @@ static int cortex_m_store_core_reg_u32(struct target *target,
 	return retval;
 }
 
+static int cortex_m_queue_reg_write(struct target *target, uint32_t regsel,
+		uint32_t value, uint32_t *dhcsr)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	int retval;
+
+	retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRDR, value);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, regsel | DCRSR_WNR);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* S_REGRDY must be set before the next DCRDR write of the queue */
+	return mem_ap_read_u32(armv7m->debug_ap, DCB_DHCSR, dhcsr);
+}
+
+/* Write every dirty 32 and 64-bit register in a single DAP run. If any transfer
+ * was not complete when checked, all registers are left dirty to be rewritten
+ * one by one with S_REGRDY polling. */
+static int cortex_m_store_dirty_core_regs(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	int retval;
+	uint32_t dcrdr;
+
+	const unsigned int num_regs = armv7m->arm.core_cache->num_regs;
+	const unsigned int n_r32 = ARMV7M_LAST_REG - ARMV7M_CORE_FIRST_REG + 1
+							   + ARMV7M_FPU_LAST_REG - ARMV7M_FPU_FIRST_REG + 1;
+	uint32_t dhcsr[n_r32];
+	unsigned int wi = 0;
+
+	/* the core was too slow for the fast read, it won't keep up with writes */
+	if (cortex_m->slow_register_read)
+		return ERROR_TIMEOUT_REACHED;
+
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DCRDR, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (unsigned int reg_id = 0; reg_id < num_regs; reg_id++) {
+		struct reg *r = &armv7m->arm.core_cache->reg_list[reg_id];
+		if (!r->exist || !r->dirty || r->size <= 8)
+			continue;
+
+		assert(r->size == 32 || r->size == 64);
+		struct arm_reg *arm_reg = r->arch_info;
+		uint32_t regsel = armv7m_map_id_to_regsel(arm_reg->num);
+
+		retval = cortex_m_queue_reg_write(target, regsel,
+				buf_get_u32(r->value, 0, 32), &dhcsr[wi++]);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (r->size == 64) {
+			retval = cortex_m_queue_reg_write(target, regsel + 1,
+					buf_get_u32(r->value + 4, 0, 32), &dhcsr[wi++]);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	assert(wi <= n_r32);
+	if (!wi)
+		return ERROR_OK;
+
+	cortex_m->dcb_dhcsr_prefetched = false;
+	retval = dap_run(armv7m->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (target->dbg_msg_enabled) {
+		/* restore DCB_DCRDR - this needs to be in a separate
+		 * transaction otherwise the emulated DCC channel breaks */
+		retval = mem_ap_write_atomic_u32(armv7m->debug_ap, DCB_DCRDR, dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	bool not_ready = false;
+	for (unsigned int i = 0; i < wi; i++) {
+		if ((dhcsr[i] & S_REGRDY) == 0)
+			not_ready = true;
+		cortex_m_cumulate_dhcsr_sticky(cortex_m, dhcsr[i]);
+	}
+
+	if (not_ready) {
+		LOG_TARGET_DEBUG(target, "register not ready during fast write, retrying one by one");
+		return ERROR_TIMEOUT_REACHED;
+	}
+
+	for (unsigned int reg_id = 0; reg_id < num_regs; reg_id++) {
+		struct reg *r = &armv7m->arm.core_cache->reg_list[reg_id];
+		if (!r->exist || !r->dirty || r->size <= 8)
+			continue;
+
+		r->valid = true;
+		r->dirty = false;
+	}
+
+	LOG_TARGET_DEBUG(target, "wrote %u 32-bit registers", wi);
+	return ERROR_OK;
+}
+
 static int cortex_m_write_debug_halt_mask(struct target *target,
 	uint32_t mask_on, uint32_t mask_off)
 {
 	struct cortex_m_common *cortex_m = target_to_cm(target);
 	struct armv7m_common *armv7m = &cortex_m->armv7m;
 
+	cortex_m->dcb_dhcsr_prefetched = false;
+
 	/* mask off status bits */
 	cortex_m->dcb_dhcsr &= ~((0xFFFFul << 16) | mask_off);
 	/* create new register mask */
@@ -900,11 +1011,17 @@ static int cortex_m_poll_one(struct target *target)
 	struct cortex_m_common *cortex_m = target_to_cm(target);
 	struct armv7m_common *armv7m = &cortex_m->armv7m;
 
-	/* Read from Debug Halting Control and Status Register */
-	retval = cortex_m_read_dhcsr_atomic_sticky(target);
-	if (retval != ERROR_OK) {
-		target->state = TARGET_UNKNOWN;
-		return retval;
+	/* Read from Debug Halting Control and Status Register,
+	 * unless it was read already together with the other SMP cores */
+	if (cortex_m->dcb_dhcsr_prefetched) {
+		cortex_m->dcb_dhcsr_prefetched = false;
+		cortex_m->dcb_dhcsr = cortex_m->dcb_dhcsr_prefetch;
+	} else {
+		retval = cortex_m_read_dhcsr_atomic_sticky(target);
+		if (retval != ERROR_OK) {
+			target->state = TARGET_UNKNOWN;
+			return retval;
+		}
 	}
 
 	/* Recover from lockup.  See ARMv7-M architecture spec,
@@ -1092,8 +1209,66 @@ static int cortex_m_poll_smp(struct list_head *smp_targets)
 	return retval;
 }
 
+static bool cortex_m_can_prefetch_dhcsr(struct target *target, struct target *curr)
+{
+	if (curr->type != target->type || !target_was_examined(curr))
+		return false;
+
+	struct armv7m_common *armv7m = target_to_armv7m(curr);
+	return !armv7m->is_hla_target && armv7m->debug_ap &&
+		armv7m->debug_ap->dap == target_to_armv7m(target)->debug_ap->dap;
+}
+
+/* Queue the DHCSR reads of all cores of the SMP group behind the same DAP,
+ * possibly on different APs, and run them at once. The next poll of each core
+ * uses the prefetched value instead of a DAP round trip of its own.
+ * On any error nothing is prefetched and each core reads DHCSR itself.
+ */
+static void cortex_m_prefetch_dhcsr_smp(struct target *target)
+{
+	struct target_list *head;
+	unsigned int queued = 0;
+	int retval = ERROR_OK;
+
+	if (!cortex_m_can_prefetch_dhcsr(target, target))
+		return;
+
+	foreach_smp_target(head, target->smp_targets) {
+		struct target *curr = head->target;
+		if (!cortex_m_can_prefetch_dhcsr(target, curr))
+			continue;
+
+		retval = mem_ap_read_u32(target_to_armv7m(curr)->debug_ap, DCB_DHCSR,
+				&target_to_cm(curr)->dcb_dhcsr_prefetch);
+		if (retval != ERROR_OK)
+			break;
+		queued++;
+	}
+
+	/* run whatever got queued, the reads clear the sticky bits */
+	if (dap_run(target_to_armv7m(target)->debug_ap->dap) != ERROR_OK)
+		return;
+
+	foreach_smp_target(head, target->smp_targets) {
+		struct target *curr = head->target;
+		if (!queued)
+			break;
+		if (!cortex_m_can_prefetch_dhcsr(target, curr))
+			continue;
+
+		struct cortex_m_common *cm = target_to_cm(curr);
+		cortex_m_cumulate_dhcsr_sticky(cm, cm->dcb_dhcsr_prefetch);
+		cm->dcb_dhcsr_prefetched = true;
+		queued--;
+	}
+}
+
 static int cortex_m_poll(struct target *target)
 {
+	/* The first core of the SMP group polled reads DHCSR for all of them */
+	if (target->smp && !target_to_cm(target)->dcb_dhcsr_prefetched)
+		cortex_m_prefetch_dhcsr_smp(target);
+
 	int retval = cortex_m_poll_one(target);
 
 	if (target->smp) {
@@ -2163,6 +2338,57 @@ static int cortex_m_read_memory(struct target *target, target_addr_t address,
 	return mem_ap_read_buf(armv7m->debug_ap, buffer, size, count, address);
 }
 
+/* Queue the word aligned blocks as single word accesses and run them all at
+ * once, read the rest with the usual alignment handling. */
+static int cortex_m_read_buffer_list(struct target *target,
+	struct target_memory_read_block *blocks, unsigned int num_blocks)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	unsigned int num_words = 0;
+	int retval = ERROR_OK;
+
+	for (unsigned int i = 0; i < num_blocks; i++) {
+		if (!(blocks[i].address & 0x3u) && !(blocks[i].size & 0x3u))
+			num_words += blocks[i].size / 4;
+	}
+
+	uint32_t *words = NULL;
+	if (num_words) {
+		words = malloc(num_words * sizeof(*words));
+		if (!words) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+
+		uint32_t *w = words;
+		for (unsigned int i = 0; i < num_blocks && retval == ERROR_OK; i++) {
+			if ((blocks[i].address & 0x3u) || (blocks[i].size & 0x3u))
+				continue;
+			for (uint32_t offset = 0; offset < blocks[i].size && retval == ERROR_OK; offset += 4)
+				retval = mem_ap_read_u32(armv7m->debug_ap, blocks[i].address + offset, w++);
+		}
+		if (retval == ERROR_OK)
+			retval = dap_run(armv7m->debug_ap->dap);
+
+		w = words;
+		for (unsigned int i = 0; i < num_blocks && retval == ERROR_OK; i++) {
+			if ((blocks[i].address & 0x3u) || (blocks[i].size & 0x3u))
+				continue;
+			for (uint32_t offset = 0; offset < blocks[i].size; offset += 4)
+				target_buffer_set_u32(target, blocks[i].buffer + offset, *w++);
+		}
+		free(words);
+	}
+
+	for (unsigned int i = 0; i < num_blocks && retval == ERROR_OK; i++) {
+		if ((blocks[i].address & 0x3u) || (blocks[i].size & 0x3u))
+			retval = target_read_buffer(target, blocks[i].address, blocks[i].size,
+					blocks[i].buffer);
+	}
+
+	return retval;
+}
+
 static int cortex_m_write_memory(struct target *target, target_addr_t address,
 	uint32_t size, uint32_t count, const uint8_t *buffer)
 {
@@ -2625,6 +2851,7 @@ int cortex_m_examine(struct target *target)
 				armv7m->debug_ap->tar_autoincr_block = (1 << 12);
 		}
 
+		cortex_m->dcb_dhcsr_prefetched = false;
 		retval = target_read_u32(target, DCB_DHCSR, &cortex_m->dcb_dhcsr);
 		if (retval != ERROR_OK)
 			return retval;
@@ -2808,6 +3035,7 @@ static int cortex_m_init_arch_info(struct target *target,
 
 	armv7m->load_core_reg_u32 = cortex_m_load_core_reg_u32;
 	armv7m->store_core_reg_u32 = cortex_m_store_core_reg_u32;
+	armv7m->store_dirty_core_regs = cortex_m_store_dirty_core_regs;
 
 	target_register_timer_callback(cortex_m_handle_target_request, 1,
 		TARGET_TIMER_TYPE_PERIODIC, target);
@@ -3099,9 +3327,13 @@ struct target_type cortexm_target = {
 	.get_gdb_reg_list = armv7m_get_gdb_reg_list,
 
 	.read_memory = cortex_m_read_memory,
+	.read_buffer_list = cortex_m_read_buffer_list,
 	.write_memory = cortex_m_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
+	.fill_check_memory = armv7m_fill_check_memory,
+	.fill_memory = armv7m_fill_memory,
+	.memory_test = armv7m_memory_test,
 
 	.run_algorithm = armv7m_run_algorithm,
 	.start_algorithm = armv7m_start_algorithm,
@@ -226,6 +226,10 @@ struct cortex_m_common {
 	uint32_t dcb_dhcsr_cumulated_sticky;
 	/* DCB DHCSR has been at least once read, so the sticky bits have been reset */
 	bool dcb_dhcsr_sticky_is_recent;
+	/* DHCSR read together with the other cores of the SMP group, not yet
+	 * consumed by a poll. Cleared by any other DHCSR access */
+	uint32_t dcb_dhcsr_prefetch;
+	bool dcb_dhcsr_prefetched;
 	uint32_t nvic_dfsr;  /* Debug Fault Status Register - shows reason for debug halt */
 	uint32_t nvic_icsr;  /* Interrupt Control State Register - shows active and pending IRQ */
 
@@ -604,6 +604,7 @@ static int switch_tap(struct target *target, struct jtag_tap *master_tap,
 		err_check_propagate(retval);
 		core_tap->enabled = true;
 		master_tap->enabled = false;
+		jtag_tap_chain_changed();
 	} else {
 		instr = 0x08;
 		retval =
@@ -617,6 +618,7 @@ static int switch_tap(struct target *target, struct jtag_tap *master_tap,
 		err_check_propagate(retval);
 		core_tap->enabled = false;
 		master_tap->enabled = true;
+		jtag_tap_chain_changed();
 	}
 	return retval;
 }
@@ -734,6 +736,7 @@ static int eonce_enter_debug_mode(struct target *target,
 	/* Enable master tap */
 	tap_chp->enabled = true;
 	tap_cpu->enabled = false;
+	jtag_tap_chain_changed();
 
 	instr = MASTER_TAP_CMD_IDCODE;
 	retval =
@@ -754,6 +757,7 @@ static int eonce_enter_debug_mode(struct target *target,
 
 	/* Enable core tap */
 	tap_chp->enabled = true;
+	jtag_tap_chain_changed();
 	retval = switch_tap(target, tap_chp, tap_cpu);
 	err_check_propagate(retval);
 
@@ -2133,6 +2137,7 @@ int dsp5680xx_f_unlock(struct target *target)
 
 	/* Enable core tap */
 	tap_chp->enabled = true;
+	jtag_tap_chain_changed();
 	retval = switch_tap(target, tap_chp, tap_cpu);
 	err_check_propagate(retval);
 
@@ -2147,6 +2152,7 @@ int dsp5680xx_f_unlock(struct target *target)
 
 	/* Enable master tap */
 	tap_chp->enabled = false;
+	jtag_tap_chain_changed();
 	retval = switch_tap(target, tap_chp, tap_cpu);
 	err_check_propagate(retval);
 
@@ -2188,6 +2194,7 @@ int dsp5680xx_f_unlock(struct target *target)
 
 	tap_cpu->enabled = true;
 	tap_chp->enabled = false;
+	jtag_tap_chain_changed();
 	target->state = TARGET_RUNNING;
 	dsp5680xx_context.debug_mode_enabled = false;
 	return retval;
@@ -2230,6 +2237,7 @@ int dsp5680xx_f_lock(struct target *target)
 	dsp5680xx_context.debug_mode_enabled = false;
 	tap_cpu->enabled = false;
 	tap_chp->enabled = true;
+	jtag_tap_chain_changed();
 	retval = switch_tap(target, tap_chp, tap_cpu);
 	return retval;
 }
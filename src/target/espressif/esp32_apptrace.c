@@ -964,7 +964,11 @@ static int esp32_apptrace_data_processor(void *priv)
 	return ERROR_OK;
 }
 
-static int esp32_apptrace_check_connection(struct esp32_apptrace_cmd_ctx *ctx)
+/* Check that every core still sees the host connected. The control register
+ * read for this also tells the block state, which is returned in target_state
+ * so that the poll doesn't need to read it again. */
+static int esp32_apptrace_check_connection(struct esp32_apptrace_cmd_ctx *ctx,
+	struct esp32_apptrace_target_state *target_state)
 {
 	if (!ctx)
 		return ERROR_FAIL;
@@ -973,12 +977,15 @@ static int esp32_apptrace_check_connection(struct esp32_apptrace_cmd_ctx *ctx)
 
 	for (unsigned int i = 0; i < ctx->cores_num; i++) {
 		bool conn = true;
-		int res = ctx->hw->ctrl_reg_read(ctx->cpus[i], NULL, NULL, &conn);
+		int res = ctx->hw->ctrl_reg_read(ctx->cpus[i], &target_state[i].block_id,
+			&target_state[i].data_len, &conn);
 		if (res != ERROR_OK) {
 			LOG_ERROR("Failed to read apptrace control reg for cpu(%d) res(%d)!", i, res);
 			return res;
 		}
 		if (!conn) {
+			target_state[i].block_id = 0;
+			target_state[i].data_len = 0;
 			uint32_t stat = 0;
 			LOG_TARGET_WARNING(ctx->cpus[i], "apptrace connection is lost. Re-connect.");
 			res = ctx->hw->status_reg_read(ctx->cpus[i], &stat);
@@ -1032,7 +1039,7 @@ static int esp32_apptrace_poll(void *priv)
 
 	/*  Check for connection is alive.For some reason target and therefore host_connected flag
 	 *  might have been reset */
-	res = esp32_apptrace_check_connection(ctx);
+	res = esp32_apptrace_check_connection(ctx, target_state);
 	if (res != ERROR_OK) {
 		if (res != ERROR_WAIT)
 			ctx->running = 0;
@@ -1040,11 +1047,14 @@ static int esp32_apptrace_poll(void *priv)
 	}
 
 	/* check for data from target */
-	res = esp32_apptrace_get_data_info(ctx, target_state, &fired_target_num);
-	if (res != ERROR_OK) {
-		ctx->running = 0;
-		LOG_ERROR("Failed to read data len!");
-		return res;
+	fired_target_num = UINT32_MAX;
+	for (unsigned int i = 0; i < ctx->cores_num; i++) {
+		if (target_state[i].data_len) {
+			LOG_TARGET_DEBUG(ctx->cpus[i], "Block %" PRId32 ", len %" PRId32 " bytes on fired",
+				target_state[i].block_id, target_state[i].data_len);
+			fired_target_num = i;
+			break;
+		}
 	}
 	/* LOG_DEBUG("Block %d (%d bytes) on target (%s)!", target_state[0].block_id,
 	 * target_state[0].data_len, target_name(ctx->cpus[0])); */
@@ -1109,6 +1119,14 @@ static int esp32_apptrace_poll(void *priv)
 		}
 	}
 	struct esp32_apptrace_block *block = esp32_apptrace_free_block_get(ctx);
+	if (!block && ctx->mode != ESP_APPTRACE_CMD_MODE_SYNC) {
+		/* The destination is slower than the target right now: rather than
+		 * giving up, hand the oldest block over first to free its buffer */
+		res = esp32_apptrace_data_processor(ctx);
+		if (res != ERROR_OK)
+			return res;
+		block = esp32_apptrace_free_block_get(ctx);
+	}
 	if (!block) {
 		ctx->running = 0;
 		LOG_TARGET_ERROR(ctx->cpus[fired_target_num], "Failed to get free block for data!");
@@ -432,7 +432,8 @@ static int esp32s2_target_init(struct command_context *cmd_ctx, struct target *t
 static const struct xtensa_debug_ops esp32s2_dbg_ops = {
 	.queue_enable = xtensa_dm_queue_enable,
 	.queue_reg_read = xtensa_dm_queue_reg_read,
-	.queue_reg_write = xtensa_dm_queue_reg_write
+	.queue_reg_write = xtensa_dm_queue_reg_write,
+	.queue_reg_read_n = xtensa_dm_queue_reg_read_n
 };
 
 static const struct xtensa_power_ops esp32s2_pwr_ops = {
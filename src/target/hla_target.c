@@ -55,6 +55,57 @@ static int adapter_store_core_reg_u32(struct target *target,
 	return adapter->layout->api->write_reg(adapter->handle, regsel, value);
 }
 
+/* Write all dirty 32 and 64-bit registers with a single adapter call */
+static int adapter_store_dirty_core_regs(struct target *target)
+{
+	struct hl_interface *adapter = target_to_adapter(target);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	const unsigned int n_r32 = ARMV7M_LAST_REG - ARMV7M_CORE_FIRST_REG + 1
+							   + ARMV7M_FPU_LAST_REG - ARMV7M_FPU_FIRST_REG + 1;
+	unsigned int regsels[n_r32];
+	uint32_t vals[n_r32];
+	unsigned int wi = 0;
+
+	if (!adapter->layout->api->write_regs)
+		return ERROR_NOT_IMPLEMENTED;
+
+	for (unsigned int reg_id = 0; reg_id < cache->num_regs; reg_id++) {
+		struct reg *r = &cache->reg_list[reg_id];
+		if (!r->exist || !r->dirty || r->size <= 8)
+			continue;
+
+		assert(r->size == 32 || r->size == 64);
+		struct arm_reg *arm_reg = r->arch_info;
+		uint32_t regsel = armv7m_map_id_to_regsel(arm_reg->num);
+
+		regsels[wi] = regsel;
+		vals[wi++] = buf_get_u32(r->value, 0, 32);
+		if (r->size == 64) {
+			regsels[wi] = regsel + 1;
+			vals[wi++] = buf_get_u32(r->value + 4, 0, 32);
+		}
+	}
+
+	assert(wi <= n_r32);
+	if (!wi)
+		return ERROR_OK;
+
+	int retval = adapter->layout->api->write_regs(adapter->handle, regsels, vals, wi);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int reg_id = 0; reg_id < cache->num_regs; reg_id++) {
+		struct reg *r = &cache->reg_list[reg_id];
+		if (r->exist && r->dirty && r->size > 8) {
+			r->valid = true;
+			r->dirty = false;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int adapter_examine_debug_reason(struct target *target)
 {
 	if ((target->debug_reason != DBG_REASON_DBGRQ)
@@ -167,6 +218,7 @@ static int adapter_init_arch_info(struct target *target,
 
 	armv7m->load_core_reg_u32 = adapter_load_core_reg_u32;
 	armv7m->store_core_reg_u32 = adapter_store_core_reg_u32;
+	armv7m->store_dirty_core_regs = adapter_store_dirty_core_regs;
 
 	armv7m->examine_debug_reason = adapter_examine_debug_reason;
 	armv7m->is_hla_target = true;
@@ -210,11 +262,78 @@ static int adapter_target_create(struct target *target,
 	return ERROR_OK;
 }
 
+/* Read all the registers not cached yet with a single adapter call,
+ * see cortex_m_fast_read_all_regs() */
+static int adapter_fast_load_context(struct target *target)
+{
+	struct hl_interface *adapter = target_to_adapter(target);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	const unsigned int n_r32 = ARMV7M_LAST_REG - ARMV7M_CORE_FIRST_REG + 1
+							   + ARMV7M_FPU_LAST_REG - ARMV7M_FPU_FIRST_REG + 1;
+	unsigned int regsels[n_r32];
+	uint32_t vals[n_r32];
+	unsigned int wi = 0;
+
+	for (unsigned int reg_id = 0; reg_id < cache->num_regs; reg_id++) {
+		struct reg *r = &cache->reg_list[reg_id];
+		if (!r->exist || r->valid || r->size <= 8)
+			continue;
+
+		assert(r->size == 32 || r->size == 64);
+		uint32_t regsel = armv7m_map_id_to_regsel(reg_id);
+		regsels[wi++] = regsel;
+		if (r->size == 64)
+			regsels[wi++] = regsel + 1;
+	}
+
+	assert(wi <= n_r32);
+	if (wi) {
+		int retval = adapter->layout->api->read_regs(adapter->handle, regsels, vals, wi);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	LOG_TARGET_DEBUG(target, "read %u 32-bit registers", wi);
+
+	unsigned int ri = 0;
+	for (unsigned int reg_id = 0; reg_id < cache->num_regs; reg_id++) {
+		struct reg *r = &cache->reg_list[reg_id];
+		if (!r->exist || r->valid)
+			continue;
+
+		r->dirty = false;
+
+		unsigned int reg32_id;
+		uint32_t offset;
+		if (armv7m_map_reg_packing(reg_id, &reg32_id, &offset)) {
+			/* The container register precedes the registers packed into it */
+			struct reg *r32 = &cache->reg_list[reg32_id];
+			if (!r32->valid)
+				continue;
+			buf_cpy(r32->value + offset, r->value, r->size);
+		} else {
+			buf_set_u32(r->value, 0, 32, vals[ri++]);
+			if (r->size == 64)
+				buf_set_u32(r->value + 4, 0, 32, vals[ri++]);
+		}
+		r->valid = true;
+	}
+	assert(ri == wi);
+
+	return ERROR_OK;
+}
+
 static int adapter_load_context(struct target *target)
 {
+	struct hl_interface *adapter = target_to_adapter(target);
 	struct armv7m_common *armv7m = target_to_armv7m(target);
 	int num_regs = armv7m->arm.core_cache->num_regs;
 
+	if (adapter->layout->api->read_regs &&
+			adapter_fast_load_context(target) == ERROR_OK)
+		return ERROR_OK;
+
 	for (int i = 0; i < num_regs; i++) {
 
 		struct reg *r = &armv7m->arm.core_cache->reg_list[i];
@@ -665,6 +784,9 @@ struct target_type hla_target = {
 	.write_memory = adapter_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
+	.fill_check_memory = armv7m_fill_check_memory,
+	.fill_memory = armv7m_fill_memory,
+	.memory_test = armv7m_memory_test,
 
 	.run_algorithm = armv7m_run_algorithm,
 	.start_algorithm = armv7m_start_algorithm,
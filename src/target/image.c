@@ -24,6 +24,7 @@
 #include "image.h"
 #include "target.h"
 #include <helper/log.h>
+#include <helper/crc32.h>
 
 /* convert ELF header field to host endianness */
 #define field16(elf, field) \
@@ -118,6 +119,38 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+/* value of each hex digit plus one, zero for anything else */
+static const uint8_t image_hex_digit[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/**
+ * Decode @a count bytes from the hex digits at @a hex into @a buffer and add
+ * them to @a checksum. Stops at the first character that isn't a hex digit,
+ * including the end of the line.
+ * @returns false if the line doesn't hold @a count bytes.
+ */
+static bool image_decode_hex(const char *hex, uint32_t count, uint8_t *buffer,
+	uint8_t *checksum)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		unsigned int hi = image_hex_digit[(uint8_t)hex[2 * i]];
+		if (!hi)
+			return false;
+		unsigned int lo = image_hex_digit[(uint8_t)hex[2 * i + 1]];
+		if (!lo)
+			return false;
+
+		buffer[i] = ((hi - 1) << 4) | (lo - 1);
+		*checksum += buffer[i];
+	}
+
+	return true;
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
 	char *lpsz_line,
 	struct imagesection *section)
@@ -193,16 +226,15 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 					full_address = (full_address & 0xffff0000) | address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					ihex->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
+				if (!image_decode_hex(&lpsz_line[bytes_read], count,
+						&ihex->buffer[cooked_bytes], &cal_checksum)) {
+					LOG_ERROR("truncated data record found in IHEX file");
+					return ERROR_IMAGE_FORMAT_ERROR;
 				}
+				bytes_read += 2 * count;
+				cooked_bytes += count;
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 1) {	/* End of File Record */
 				/* finish the current section */
 				image->num_sections++;
@@ -853,6 +885,11 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					 */
 					if (section[image->num_sections].size != 0) {
 						image->num_sections++;
+						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+							/* too many sections */
+							LOG_ERROR("Too many sections found in S19 file");
+							return ERROR_IMAGE_FORMAT_ERROR;
+						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
 						section[image->num_sections].private =
@@ -862,16 +899,15 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					full_address = address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					mot->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
+				if (!image_decode_hex(&lpsz_line[bytes_read], count,
+						&mot->buffer[cooked_bytes], &cal_checksum)) {
+					LOG_ERROR("truncated data record found in S19 file");
+					return ERROR_IMAGE_FORMAT_ERROR;
 				}
+				bytes_read += 2 * count;
+				cooked_bytes += count;
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 5 || record_type == 6) {
 				/* S5 and S6 are the data count records, we ignore them */
 				uint32_t dummy;
@@ -1170,6 +1206,42 @@ int image_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+int image_map_section(struct image *image,
+	int section,
+	target_addr_t offset,
+	uint32_t size,
+	const uint8_t **data)
+{
+	if (offset + size > image->sections[section].size)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		return fileio_map(image_binary->fileio, offset, size, data);
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		uint64_t file_offset;
+
+		if (elf->is_64_bit) {
+			Elf64_Phdr *segment = image->sections[section].private;
+			file_offset = field64(elf, segment->p_offset);
+		} else {
+			Elf32_Phdr *segment = image->sections[section].private;
+			file_offset = field32(elf, segment->p_offset);
+		}
+
+		return fileio_map(elf->fileio, file_offset + offset, size, data);
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD ||
+			image->type == IMAGE_BUILDER) {
+		/* these keep the whole section in memory already */
+		*data = (const uint8_t *)image->sections[section].private + offset;
+		return ERROR_OK;
+	}
+
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+}
+
 int image_add_section(struct image *image, target_addr_t base, uint32_t size, uint64_t flags, uint8_t const *data)
 {
 	struct imagesection *section;
@@ -1269,31 +1341,14 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
-
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-
-		first_init = true;
-	}
-
 	while (nbytes > 0) {
-		int run = nbytes;
-		if (run > 32768)
-			run = 32768;
+		uint32_t run = nbytes;
+		if (run > 1024 * 1024)
+			run = 1024 * 1024;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
+		/* as per gdb */
+		crc = crc32_be(crc, buffer, run);
+		buffer += run;
 		keep_alive();
 	}
 
@@ -94,6 +94,14 @@ struct image_mot {
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, target_addr_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+/**
+ * Point @a data at @a size bytes of @a section, starting at @a offset,
+ * without copying them. Works for images held in memory and for binary and
+ * ELF files the host could map; the data stays valid until image_close().
+ * On ERROR_FILEIO_OPERATION_NOT_SUPPORTED use image_read_section() instead.
+ */
+int image_map_section(struct image *image, int section, target_addr_t offset,
+		uint32_t size, const uint8_t **data);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, target_addr_t base, uint32_t size,
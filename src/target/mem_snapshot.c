@@ -0,0 +1,426 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * "mem_snapshot" keeps host copies of target memory regions and writes them
+ * back on request, e.g. to put RAM back into the same state before every
+ * test case without reloading the whole image.
+ *
+ * The copy is split into blocks and the checksum of each block is kept with
+ * it. A restore checksums all the blocks on the target, with a single
+ * algorithm run where the target supports target_checksum_memory_list(),
+ * and only writes the blocks that differ. As most test cases change little
+ * memory, this is much faster than writing everything.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mem_snapshot.h"
+#include "mem_track.h"
+#include "image.h"
+#include "target.h"
+#include "target_type.h"
+#include <helper/command.h>
+#include <helper/log.h>
+#include <helper/time_support.h>
+
+/* Granularity of the comparison */
+#define MEM_SNAPSHOT_BLOCK_SIZE		0x1000
+/* Blocks read with a single target_read_buffer_list() call */
+#define MEM_SNAPSHOT_READ_BLOCKS	64
+
+#define MEM_SNAPSHOT_MAX_REGIONS	64
+
+struct mem_snapshot_region {
+	target_addr_t address;
+	uint32_t size;
+	uint8_t *data;
+	/* image_calculate_checksum() of each block */
+	uint32_t *crcs;
+	unsigned int num_blocks;
+};
+
+struct mem_snapshot {
+	char *name;
+	struct target *target;
+	struct mem_snapshot_region regions[MEM_SNAPSHOT_MAX_REGIONS];
+	unsigned int num_regions;
+	struct mem_snapshot *next;
+};
+
+static struct mem_snapshot *mem_snapshots;
+
+static uint32_t mem_snapshot_block_size(const struct mem_snapshot_region *region,
+		unsigned int block)
+{
+	return MIN(region->size - block * MEM_SNAPSHOT_BLOCK_SIZE, MEM_SNAPSHOT_BLOCK_SIZE);
+}
+
+static void mem_snapshot_free(struct mem_snapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+	for (unsigned int i = 0; i < snapshot->num_regions; i++) {
+		free(snapshot->regions[i].data);
+		free(snapshot->regions[i].crcs);
+	}
+	free(snapshot->name);
+	free(snapshot);
+}
+
+static struct mem_snapshot **mem_snapshot_find(const char *name)
+{
+	struct mem_snapshot **prev;
+	for (prev = &mem_snapshots; *prev; prev = &(*prev)->next) {
+		if (!strcmp((*prev)->name, name))
+			break;
+	}
+	return prev;
+}
+
+void mem_snapshot_free_all(void)
+{
+	while (mem_snapshots) {
+		struct mem_snapshot *next = mem_snapshots->next;
+		mem_snapshot_free(mem_snapshots);
+		mem_snapshots = next;
+	}
+}
+
+static uint64_t mem_snapshot_size(const struct mem_snapshot *snapshot)
+{
+	uint64_t size = 0;
+	for (unsigned int i = 0; i < snapshot->num_regions; i++)
+		size += snapshot->regions[i].size;
+	return size;
+}
+
+static int mem_snapshot_read_region(struct target *target, struct mem_snapshot_region *region)
+{
+	struct target_memory_read_block blocks[MEM_SNAPSHOT_READ_BLOCKS];
+
+	for (unsigned int first = 0; first < region->num_blocks;
+			first += MEM_SNAPSHOT_READ_BLOCKS) {
+		unsigned int num_blocks = MIN(region->num_blocks - first, MEM_SNAPSHOT_READ_BLOCKS);
+		for (unsigned int i = 0; i < num_blocks; i++) {
+			blocks[i].address = region->address + (first + i) * MEM_SNAPSHOT_BLOCK_SIZE;
+			blocks[i].size = mem_snapshot_block_size(region, first + i);
+			blocks[i].buffer = region->data + (first + i) * MEM_SNAPSHOT_BLOCK_SIZE;
+		}
+
+		int retval = target_read_buffer_list(target, blocks, num_blocks);
+		if (retval != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "can't read memory at " TARGET_ADDR_FMT,
+					blocks[0].address);
+			return retval;
+		}
+
+		for (unsigned int i = 0; i < num_blocks; i++) {
+			retval = image_calculate_checksum(blocks[i].buffer, blocks[i].size,
+					&region->crcs[first + i]);
+			if (retval != ERROR_OK)
+				return retval;
+			mem_track_set_checksum(target, blocks[i].address, blocks[i].size,
+					region->crcs[first + i]);
+		}
+		keep_alive();
+	}
+
+	return ERROR_OK;
+}
+
+/*
+ * Mark the blocks of the snapshot whose checksum on the target differs.
+ * @returns ERROR_OK and the marks in "dirty", one per block of all regions
+ * in order, or an error if the target can't checksum its memory.
+ */
+static int mem_snapshot_compare(struct target *target, const struct mem_snapshot *snapshot,
+		bool *dirty)
+{
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < snapshot->num_regions; i++)
+		total += snapshot->regions[i].num_blocks;
+
+	struct target_memory_checksum_block *blocks = calloc(total, sizeof(*blocks));
+	if (!blocks) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < snapshot->num_regions; i++) {
+		const struct mem_snapshot_region *region = &snapshot->regions[i];
+		for (unsigned int b = 0; b < region->num_blocks; b++, n++) {
+			blocks[n].address = region->address + b * MEM_SNAPSHOT_BLOCK_SIZE;
+			blocks[n].size = mem_snapshot_block_size(region, b);
+		}
+	}
+
+	int retval = target_checksum_memory_list(target, blocks, total);
+	if (retval == ERROR_OK) {
+		n = 0;
+		for (unsigned int i = 0; i < snapshot->num_regions; i++) {
+			const struct mem_snapshot_region *region = &snapshot->regions[i];
+			for (unsigned int b = 0; b < region->num_blocks; b++, n++)
+				dirty[n] = blocks[n].checksum != region->crcs[b];
+		}
+	}
+
+	free(blocks);
+	return retval;
+}
+
+/* Write the runs of dirty blocks of the region, add up what was written */
+static int mem_snapshot_write_region(struct target *target,
+		const struct mem_snapshot_region *region, const bool *dirty,
+		uint64_t *written, unsigned int *written_blocks)
+{
+	unsigned int b = 0;
+	while (b < region->num_blocks) {
+		if (!dirty[b]) {
+			b++;
+			continue;
+		}
+
+		unsigned int end = b;
+		uint32_t size = 0;
+		while (end < region->num_blocks && dirty[end])
+			size += mem_snapshot_block_size(region, end++);
+
+		target_addr_t address = region->address + b * MEM_SNAPSHOT_BLOCK_SIZE;
+		int retval = target_write_buffer(target, address, size,
+				region->data + b * MEM_SNAPSHOT_BLOCK_SIZE);
+		if (retval != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "can't write memory at " TARGET_ADDR_FMT, address);
+			return retval;
+		}
+
+		/* the next restore needn't checksum them again */
+		for (unsigned int i = b; i < end; i++)
+			mem_track_set_checksum(target, region->address + i * MEM_SNAPSHOT_BLOCK_SIZE,
+					mem_snapshot_block_size(region, i), region->crcs[i]);
+
+		*written += size;
+		*written_blocks += end - b;
+		b = end;
+		keep_alive();
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_snapshot_save_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC < 3 || CMD_ARGC % 2 != 1 || CMD_ARGC / 2 > MEM_SNAPSHOT_MAX_REGIONS)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const unsigned int num_regions = CMD_ARGC / 2;
+	target_addr_t addresses[MEM_SNAPSHOT_MAX_REGIONS];
+	uint32_t sizes[MEM_SNAPSHOT_MAX_REGIONS];
+	for (unsigned int i = 0; i < num_regions; i++) {
+		COMMAND_PARSE_ADDRESS(CMD_ARGV[1 + 2 * i], addresses[i]);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2 + 2 * i], sizes[i]);
+		if (!sizes[i]) {
+			command_print(CMD, "region " TARGET_ADDR_FMT " is empty", addresses[i]);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD, "Error: target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	struct mem_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+	if (!snapshot) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	snapshot->target = target;
+
+	int retval = ERROR_OK;
+	for (unsigned int i = 0; i < num_regions; i++) {
+		struct mem_snapshot_region *region = &snapshot->regions[i];
+		region->address = addresses[i];
+		region->size = sizes[i];
+		region->num_blocks = DIV_ROUND_UP(region->size, MEM_SNAPSHOT_BLOCK_SIZE);
+		region->data = malloc(region->size);
+		region->crcs = calloc(region->num_blocks, sizeof(*region->crcs));
+		snapshot->num_regions++;
+		if (!region->data || !region->crcs) {
+			LOG_ERROR("Out of memory");
+			mem_snapshot_free(snapshot);
+			return ERROR_FAIL;
+		}
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+
+	for (unsigned int i = 0; i < snapshot->num_regions && retval == ERROR_OK; i++)
+		retval = mem_snapshot_read_region(target, &snapshot->regions[i]);
+
+	snapshot->name = strdup(CMD_ARGV[0]);
+	if (retval == ERROR_OK && !snapshot->name) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+	}
+
+	if (retval != ERROR_OK) {
+		mem_snapshot_free(snapshot);
+		return retval;
+	}
+
+	/* Saving under an existing name replaces it */
+	struct mem_snapshot **prev = mem_snapshot_find(snapshot->name);
+	if (*prev) {
+		struct mem_snapshot *old = *prev;
+		*prev = old->next;
+		mem_snapshot_free(old);
+	}
+	snapshot->next = mem_snapshots;
+	mem_snapshots = snapshot;
+
+	const uint64_t size = mem_snapshot_size(snapshot);
+	if (duration_measure(&bench) == ERROR_OK)
+		command_print(CMD, "saved %" PRIu64 " bytes in %fs (%0.3f KiB/s)", size,
+				duration_elapsed(&bench), duration_kbps(&bench, size));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_snapshot_restore_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct mem_snapshot *snapshot = *mem_snapshot_find(CMD_ARGV[0]);
+	if (!snapshot) {
+		command_print(CMD, "no snapshot '%s'", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct target *target = snapshot->target;
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD, "Error: target %s not halted", target_name(target));
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < snapshot->num_regions; i++)
+		total += snapshot->regions[i].num_blocks;
+
+	bool *dirty = malloc(total * sizeof(*dirty));
+	if (!dirty) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+
+	/* Without a way to checksum on the target, comparing costs as much as
+	 * writing everything */
+	int retval = ERROR_FAIL;
+	if (target->type->checksum_memory_list || target->type->checksum_memory)
+		retval = mem_snapshot_compare(target, snapshot, dirty);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_DEBUG(target, "can't compare the snapshot, writing all of it");
+		for (unsigned int i = 0; i < total; i++)
+			dirty[i] = true;
+	}
+
+	uint64_t written = 0;
+	unsigned int written_blocks = 0;
+	retval = ERROR_OK;
+	const bool *region_dirty = dirty;
+	for (unsigned int i = 0; i < snapshot->num_regions && retval == ERROR_OK; i++) {
+		retval = mem_snapshot_write_region(target, &snapshot->regions[i], region_dirty,
+				&written, &written_blocks);
+		region_dirty += snapshot->regions[i].num_blocks;
+	}
+	free(dirty);
+
+	if (retval == ERROR_OK && duration_measure(&bench) == ERROR_OK)
+		command_print(CMD, "restored %u of %u blocks, %" PRIu64 " of %" PRIu64
+				" bytes in %fs", written_blocks, total, written,
+				mem_snapshot_size(snapshot), duration_elapsed(&bench));
+	return retval;
+}
+
+COMMAND_HANDLER(handle_mem_snapshot_delete_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct mem_snapshot **prev = mem_snapshot_find(CMD_ARGV[0]);
+	struct mem_snapshot *snapshot = *prev;
+	if (!snapshot) {
+		command_print(CMD, "no snapshot '%s'", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	*prev = snapshot->next;
+	mem_snapshot_free(snapshot);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_snapshot_list_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (struct mem_snapshot *snapshot = mem_snapshots; snapshot; snapshot = snapshot->next) {
+		command_print(CMD, "%s: target %s, %" PRIu64 " bytes", snapshot->name,
+				target_name(snapshot->target), mem_snapshot_size(snapshot));
+		for (unsigned int i = 0; i < snapshot->num_regions; i++)
+			command_print(CMD, "  " TARGET_ADDR_FMT " 0x%" PRIx32,
+					snapshot->regions[i].address, snapshot->regions[i].size);
+	}
+	return ERROR_OK;
+}
+
+static const struct command_registration mem_snapshot_subcommand_handlers[] = {
+	{
+		.name = "save",
+		.handler = handle_mem_snapshot_save_command,
+		.mode = COMMAND_EXEC,
+		.help = "Keep a copy of the memory regions of the current target",
+		.usage = "name address size [address size]...",
+	},
+	{
+		.name = "restore",
+		.handler = handle_mem_snapshot_restore_command,
+		.mode = COMMAND_EXEC,
+		.help = "Write back the blocks that differ from the snapshot",
+		.usage = "name",
+	},
+	{
+		.name = "delete",
+		.handler = handle_mem_snapshot_delete_command,
+		.mode = COMMAND_ANY,
+		.help = "Forget a snapshot",
+		.usage = "name",
+	},
+	{
+		.name = "list",
+		.handler = handle_mem_snapshot_list_command,
+		.mode = COMMAND_ANY,
+		.help = "List the snapshots and their regions",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration mem_snapshot_command_handlers[] = {
+	{
+		.name = "mem_snapshot",
+		.mode = COMMAND_ANY,
+		.help = "Save target memory regions and restore what changed",
+		.usage = "",
+		.chain = mem_snapshot_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
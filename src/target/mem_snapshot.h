@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEM_SNAPSHOT_H
+#define OPENOCD_TARGET_MEM_SNAPSHOT_H
+
+#include <helper/command.h>
+
+extern const struct command_registration mem_snapshot_command_handlers[];
+
+void mem_snapshot_free_all(void);
+
+#endif /* OPENOCD_TARGET_MEM_SNAPSHOT_H */
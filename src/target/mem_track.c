@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Write tracking of target memory, see mem_track.h.
+ *
+ * Instead of a dirty bit, each tracked block keeps the stamp of its last
+ * write, from a counter bumped on every event. That way any number of
+ * users can tell whether a range was written since they last looked at it,
+ * by comparing the stamps of its blocks with the one they noted. Only the
+ * blocks written get a page of stamps; when the target runs, or memory
+ * changes in a way that can't be tracked, all the pages are dropped and
+ * everything counts as written at that stamp.
+ *
+ * The tracker is per target, writes and invalidations reach all the
+ * targets of an SMP group, which share their memory.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mem_track.h"
+#include "smp.h"
+#include "target.h"
+#include <helper/align.h>
+#include <helper/log.h>
+
+#define MEM_TRACK_BLOCK_SIZE	0x1000
+/* A page covers 1 MiB */
+#define MEM_TRACK_PAGE_BLOCKS	256
+/* More pages written than this counts as everything written */
+#define MEM_TRACK_MAX_PAGES	64
+/* Checksums remembered, the oldest is replaced */
+#define MEM_TRACK_CHECKSUMS	512
+
+struct mem_track_page {
+	target_addr_t base;
+	/* largest of the stamps, to skip the page quickly */
+	uint64_t newest;
+	uint64_t stamps[MEM_TRACK_PAGE_BLOCKS];
+};
+
+struct mem_track_checksum {
+	target_addr_t address;
+	uint32_t size;
+	uint32_t checksum;
+	/* 0 for an unused entry */
+	uint64_t stamp;
+};
+
+struct mem_track {
+	uint64_t now;
+	/* all of the memory may have changed at this stamp */
+	uint64_t all_written;
+	struct mem_track_page *pages[MEM_TRACK_MAX_PAGES];
+	unsigned int num_pages;
+	struct mem_track_checksum checksums[MEM_TRACK_CHECKSUMS];
+	unsigned int next_checksum;
+	/* nesting of mem_track_read_only_begin() */
+	unsigned int read_only;
+	uint64_t reused;
+	uint64_t recorded;
+};
+
+#define MEM_TRACK_PAGE_SIZE	((target_addr_t)MEM_TRACK_BLOCK_SIZE * MEM_TRACK_PAGE_BLOCKS)
+
+static void mem_track_drop_pages(struct mem_track *t)
+{
+	for (unsigned int i = 0; i < t->num_pages; i++)
+		free(t->pages[i]);
+	t->num_pages = 0;
+}
+
+static void mem_track_invalidate_one(struct mem_track *t)
+{
+	t->all_written = ++t->now;
+	mem_track_drop_pages(t);
+}
+
+static struct mem_track_page *mem_track_page(struct mem_track *t, target_addr_t base,
+		bool create)
+{
+	for (unsigned int i = 0; i < t->num_pages; i++) {
+		if (t->pages[i]->base == base)
+			return t->pages[i];
+	}
+
+	if (!create || t->num_pages == MEM_TRACK_MAX_PAGES)
+		return NULL;
+
+	struct mem_track_page *page = calloc(1, sizeof(*page));
+	if (!page)
+		return NULL;
+	page->base = base;
+	t->pages[t->num_pages++] = page;
+	return page;
+}
+
+static void mem_track_written_one(struct mem_track *t, target_addr_t address,
+		target_addr_t size)
+{
+	const target_addr_t last = address + size - 1;
+	const uint64_t stamp = ++t->now;
+
+	/* e.g. a flash bank, cheaper to forget about everything */
+	if (last < address || size > MEM_TRACK_MAX_PAGES * MEM_TRACK_PAGE_SIZE) {
+		mem_track_invalidate_one(t);
+		return;
+	}
+
+	target_addr_t block = ALIGN_DOWN(address, MEM_TRACK_BLOCK_SIZE);
+	while (true) {
+		const target_addr_t base = ALIGN_DOWN(block, MEM_TRACK_PAGE_SIZE);
+		struct mem_track_page *page = mem_track_page(t, base, true);
+		if (!page) {
+			mem_track_invalidate_one(t);
+			return;
+		}
+		page->stamps[(block - base) / MEM_TRACK_BLOCK_SIZE] = stamp;
+		page->newest = stamp;
+
+		if (last - block < MEM_TRACK_BLOCK_SIZE)
+			break;
+		block += MEM_TRACK_BLOCK_SIZE;
+	}
+}
+
+/* Whether memory from address to address + size may have changed after stamp */
+static bool mem_track_changed(struct mem_track *t, target_addr_t address, uint32_t size,
+		uint64_t stamp)
+{
+	if (t->all_written > stamp)
+		return true;
+
+	const target_addr_t last = address + size - 1;
+	for (unsigned int i = 0; i < t->num_pages; i++) {
+		const struct mem_track_page *page = t->pages[i];
+		if (page->newest <= stamp || page->base > last ||
+				page->base + MEM_TRACK_PAGE_SIZE - 1 < address)
+			continue;
+
+		const target_addr_t first = MAX(address, page->base);
+		const target_addr_t end = MIN(last, page->base + MEM_TRACK_PAGE_SIZE - 1);
+		for (unsigned int b = (first - page->base) / MEM_TRACK_BLOCK_SIZE;
+				b <= (end - page->base) / MEM_TRACK_BLOCK_SIZE; b++) {
+			if (page->stamps[b] > stamp)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void mem_track_written(struct target *target, target_addr_t address, target_addr_t size)
+{
+	if (!size)
+		return;
+
+	if (!target->smp) {
+		if (target->mem_track)
+			mem_track_written_one(target->mem_track, address, size);
+		return;
+	}
+
+	struct target_list *head;
+	foreach_smp_target(head, target->smp_targets) {
+		if (head->target->mem_track)
+			mem_track_written_one(head->target->mem_track, address, size);
+	}
+}
+
+void mem_track_invalidate(struct target *target)
+{
+	if (target->mem_track && target->mem_track->read_only)
+		return;
+
+	if (!target->smp) {
+		if (target->mem_track)
+			mem_track_invalidate_one(target->mem_track);
+		return;
+	}
+
+	struct target_list *head;
+	foreach_smp_target(head, target->smp_targets) {
+		if (head->target->mem_track)
+			mem_track_invalidate_one(head->target->mem_track);
+	}
+}
+
+void mem_track_read_only_begin(struct target *target)
+{
+	if (target->mem_track)
+		target->mem_track->read_only++;
+}
+
+void mem_track_read_only_end(struct target *target)
+{
+	if (target->mem_track && target->mem_track->read_only)
+		target->mem_track->read_only--;
+}
+
+static struct mem_track_checksum *mem_track_find_checksum(struct mem_track *t,
+		target_addr_t address, uint32_t size)
+{
+	for (unsigned int i = 0; i < MEM_TRACK_CHECKSUMS; i++) {
+		struct mem_track_checksum *c = &t->checksums[i];
+		if (c->stamp && c->address == address && c->size == size)
+			return c;
+	}
+	return NULL;
+}
+
+bool mem_track_get_checksum(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t *checksum)
+{
+	struct mem_track *t = target->mem_track;
+	if (!t || target->state != TARGET_HALTED || !size)
+		return false;
+
+	const struct mem_track_checksum *c = mem_track_find_checksum(t, address, size);
+	if (!c || mem_track_changed(t, address, size, c->stamp))
+		return false;
+
+	*checksum = c->checksum;
+	t->reused++;
+	return true;
+}
+
+void mem_track_set_checksum(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t checksum)
+{
+	struct mem_track *t = target->mem_track;
+	if (!t || target->state != TARGET_HALTED || !size)
+		return;
+
+	struct mem_track_checksum *c = mem_track_find_checksum(t, address, size);
+	if (!c) {
+		c = &t->checksums[t->next_checksum];
+		t->next_checksum = (t->next_checksum + 1) % MEM_TRACK_CHECKSUMS;
+	}
+	c->address = address;
+	c->size = size;
+	c->checksum = checksum;
+	c->stamp = t->now;
+	t->recorded++;
+}
+
+void mem_track_free(struct target *target)
+{
+	if (!target->mem_track)
+		return;
+	mem_track_drop_pages(target->mem_track);
+	free(target->mem_track);
+	target->mem_track = NULL;
+}
+
+COMMAND_HANDLER(handle_track_writes_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		if (!enable) {
+			mem_track_free(target);
+		} else {
+			if (!target->mem_track)
+				target->mem_track = calloc(1, sizeof(*target->mem_track));
+			if (!target->mem_track) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+			/* nothing is known about the memory yet, or anymore */
+			mem_track_invalidate_one(target->mem_track);
+		}
+	}
+
+	struct mem_track *t = target->mem_track;
+	if (t)
+		command_print(CMD, "enabled, %" PRIu64 " checksums reused, %" PRIu64 " recorded",
+				t->reused, t->recorded);
+	else
+		command_print(CMD, "disabled");
+	return ERROR_OK;
+}
+
+const struct command_registration mem_track_command_handlers[] = {
+	{
+		.name = "track_writes",
+		.handler = handle_track_writes_command,
+		.mode = COMMAND_ANY,
+		.help = "Display, enable or disable tracking of the memory written "
+			"while the target is halted, to reuse checksums of memory that "
+			"didn't change",
+		.usage = "['enable'|'disable']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
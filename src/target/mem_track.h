@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEM_TRACK_H
+#define OPENOCD_TARGET_MEM_TRACK_H
+
+#include <helper/command.h>
+#include <helper/types.h>
+
+/*
+ * Tracking of the memory written through the target API while the target
+ * is halted, enabled with "$target_name track_writes". It lets checksums of
+ * memory computed before be reused as long as nothing could have changed
+ * the memory since, see target_checksum_memory().
+ */
+
+struct target;
+struct mem_track;
+
+extern const struct command_registration mem_track_command_handlers[];
+
+/** Note a write of @a size bytes at @a address through the target API. */
+void mem_track_written(struct target *target, target_addr_t address, target_addr_t size);
+/**
+ * Forget everything, any memory may have changed: the target ran, was
+ * reset or had memory written in a way that can't be tracked.
+ */
+void mem_track_invalidate(struct target *target);
+/**
+ * Ignore mem_track_invalidate() between begin and end, around algorithms
+ * that only write memory through the target API, e.g. the checksum ones.
+ */
+void mem_track_read_only_begin(struct target *target);
+void mem_track_read_only_end(struct target *target);
+/**
+ * @returns true and the checksum of the block in @a checksum if it was
+ * computed before and the memory can't have changed since.
+ */
+bool mem_track_get_checksum(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t *checksum);
+/** Remember the checksum of a block, just computed. */
+void mem_track_set_checksum(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t checksum);
+void mem_track_free(struct target *target);
+
+#endif /* OPENOCD_TARGET_MEM_TRACK_H */
@@ -1245,7 +1245,7 @@ int mips32_checksum_memory(struct target *target, target_addr_t address,
 	target_buffer_set_u32_array(target, mips_crc_code_8,
 					ARRAY_SIZE(mips_crc_code), mips_crc_code);
 
-	int retval = target_write_buffer(target, crc_algorithm->address, sizeof(mips_crc_code), mips_crc_code_8);
+	int retval = target_write_working_area_code(target, crc_algorithm, mips_crc_code_8, sizeof(mips_crc_code));
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1313,8 +1313,8 @@ int mips32_blank_check_memory(struct target *target,
 	target_buffer_set_u32_array(target, erase_check_code_8,
 					ARRAY_SIZE(erase_check_code), erase_check_code);
 
-	int retval = target_write_buffer(target, erase_check_algorithm->address,
-						sizeof(erase_check_code), erase_check_code_8);
+	int retval = target_write_working_area_code(target, erase_check_algorithm,
+						erase_check_code_8, sizeof(erase_check_code));
 	if (retval != ERROR_OK)
 		goto cleanup;
 
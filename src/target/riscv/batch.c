@@ -8,17 +8,57 @@
 #include "debug_defines.h"
 #include "riscv.h"
 #include "field_helpers.h"
+#include <helper/time_support.h>
 
 #define DTM_DMI_MAX_ADDRESS_LENGTH	((1<<DTM_DTMCS_ABITS_LENGTH)-1)
 #define DMI_SCAN_MAX_BIT_LENGTH (DTM_DMI_MAX_ADDRESS_LENGTH + DTM_DMI_DATA_LENGTH + DTM_DMI_OP_LENGTH)
 #define DMI_SCAN_BUF_SIZE (DIV_ROUND_UP(DMI_SCAN_MAX_BIT_LENGTH, 8))
 
+/* Binary trace of all DMI scans, see "riscv dmi_trace" and
+ * contrib/riscv_dmi_trace.c for the format. */
+static FILE *dmi_trace_file;
+static int64_t dmi_trace_start_us;
+
 /* Reserve extra room in the batch (needed for the last NOP operation) */
 #define BATCH_RESERVED_SCANS 1
 
+static void batch_free_buffers(struct riscv_batch *batch);
+
+/* Batches larger than this are not worth keeping around. */
+#define BATCH_POOL_MAX_SCANS (RISCV_BATCH_SIZE_MAX + BATCH_RESERVED_SCANS)
+
+static struct riscv_batch *batch_pool_take(struct target *target, size_t scans)
+{
+	struct riscv_info *r = riscv_info(target);
+	const bool needs_bscan_ctxt = bscan_tunnel_ir_width != 0;
+	unsigned int best = r->batch_pool_used;
+	for (unsigned int i = 0; i < r->batch_pool_used; ++i) {
+		const struct riscv_batch *candidate = r->batch_pool[i];
+		if (candidate->capacity < scans ||
+				(candidate->bscan_ctxt != NULL) != needs_bscan_ctxt)
+			continue;
+		if (best == r->batch_pool_used ||
+				candidate->capacity < r->batch_pool[best]->capacity)
+			best = i;
+	}
+	if (best == r->batch_pool_used)
+		return NULL;
+	struct riscv_batch *batch = r->batch_pool[best];
+	r->batch_pool[best] = r->batch_pool[--r->batch_pool_used];
+	return batch;
+}
+
 struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans)
 {
 	scans += BATCH_RESERVED_SCANS;
+	struct riscv_batch *reused = batch_pool_take(target, scans);
+	if (reused) {
+		reused->target = target;
+		reused->allocated_scans = scans;
+		riscv_batch_reset(reused);
+		return reused;
+	}
+
 	struct riscv_batch *out = calloc(1, sizeof(*out));
 	if (!out) {
 		LOG_ERROR("Failed to allocate struct riscv_batch");
@@ -27,6 +67,7 @@ struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans)
 
 	out->target = target;
 	out->allocated_scans = scans;
+	out->capacity = scans;
 	out->last_scan = RISCV_SCAN_TYPE_INVALID;
 	out->was_run = false;
 	out->last_scan_delay = 0;
@@ -77,11 +118,29 @@ struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans)
 	return out;
 
 alloc_error:
-	riscv_batch_free(out);
+	batch_free_buffers(out);
 	return NULL;
 }
 
 void riscv_batch_free(struct riscv_batch *batch)
+{
+	struct riscv_info *r = riscv_info(batch->target);
+	if (r->batch_pool_used < RISCV_BATCH_POOL_SIZE &&
+			batch->capacity <= BATCH_POOL_MAX_SCANS) {
+		r->batch_pool[r->batch_pool_used++] = batch;
+		return;
+	}
+	batch_free_buffers(batch);
+}
+
+void riscv_batch_pool_release(struct target *target)
+{
+	struct riscv_info *r = riscv_info(target);
+	while (r->batch_pool_used > 0)
+		batch_free_buffers(r->batch_pool[--r->batch_pool_used]);
+}
+
+static void batch_free_buffers(struct riscv_batch *batch)
 {
 	free(batch->data_in);
 	free(batch->data_out);
@@ -92,6 +151,26 @@ void riscv_batch_free(struct riscv_batch *batch)
 	free(batch);
 }
 
+void riscv_batch_reset(struct riscv_batch *batch)
+{
+	batch->used_scans = 0;
+	batch->read_keys_used = 0;
+	batch->last_scan = RISCV_SCAN_TYPE_INVALID;
+	batch->was_run = false;
+	batch->last_scan_delay = 0;
+	batch->last_run_us = 0;
+	batch->last_run_flushes = 0;
+}
+
+void riscv_batch_rewind(struct riscv_batch *batch)
+{
+	assert(batch->last_scan == RISCV_SCAN_TYPE_NOP);
+	batch->was_run = false;
+	batch->last_scan_delay = 0;
+	batch->last_run_us = 0;
+	batch->last_run_flushes = 0;
+}
+
 bool riscv_batch_full(struct riscv_batch *batch)
 {
 	return riscv_batch_available_scans(batch) == 0;
@@ -142,7 +221,7 @@ static int get_delay(const struct riscv_batch *batch, size_t scan_idx,
 	return delay;
 }
 
-int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
+void riscv_batch_queue_from(struct riscv_batch *batch, size_t start_idx,
 		const struct riscv_scan_delays *delays, bool resets_delays,
 		size_t reset_delays_after)
 {
@@ -161,7 +240,8 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 		if (bscan_tunnel_ir_width != 0)
 			riscv_add_bscan_tunneled_scan(batch->target, batch->fields + i, batch->bscan_ctxt + i);
 		else
-			jtag_add_dr_scan(batch->target->tap, 1, batch->fields + i, TAP_IDLE);
+			/* data_out stays allocated until the batch is run */
+			jtag_add_dr_scan_nocopy(batch->target->tap, 1, batch->fields + i, TAP_IDLE);
 
 		const bool delays_were_reset = resets_delays
 			&& (i >= reset_delays_after);
@@ -170,16 +250,89 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 		if (!delays_were_reset)
 			jtag_add_runtest(delay, TAP_IDLE);
 	}
+}
 
-	keep_alive();
+int riscv_dmi_trace_start(const char *filename)
+{
+	riscv_dmi_trace_stop();
 
-	if (jtag_execute_queue() != ERROR_OK) {
-		LOG_TARGET_ERROR(batch->target, "Unable to execute JTAG queue");
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		LOG_ERROR("Can't open DMI trace file \"%s\": %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+	/* Records are small and come in bursts, let stdio collect them. */
+	setvbuf(f, NULL, _IOFBF, RISCV_DMI_TRACE_BUFFER_SIZE);
+
+	uint8_t header[RISCV_DMI_TRACE_HEADER_SIZE] = RISCV_DMI_TRACE_MAGIC;
+	header[RISCV_DMI_TRACE_HEADER_SIZE - 1] = RISCV_DMI_TRACE_VERSION;
+	if (fwrite(header, sizeof(header), 1, f) != 1) {
+		LOG_ERROR("Can't write DMI trace file \"%s\"", filename);
+		fclose(f);
 		return ERROR_FAIL;
 	}
 
-	keep_alive();
+	dmi_trace_file = f;
+	dmi_trace_start_us = timeval_us();
+	return ERROR_OK;
+}
+
+void riscv_dmi_trace_stop(void)
+{
+	if (!dmi_trace_file)
+		return;
 
+	if (fclose(dmi_trace_file))
+		LOG_ERROR("Failed to write the DMI trace file: %s", strerror(errno));
+	dmi_trace_file = NULL;
+}
+
+bool riscv_dmi_trace_enabled(void)
+{
+	return dmi_trace_file;
+}
+
+void riscv_dmi_trace_batch(const struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays)
+{
+	/* All the scans of the batch were run by one queue flush. */
+	const uint64_t time_us = timeval_us() - dmi_trace_start_us;
+	const uint16_t tap = batch->target->tap->abs_chain_position;
+
+	for (size_t i = start_idx; i < batch->used_scans; ++i) {
+		const struct scan_field *field = batch->fields + i;
+		const uint64_t out = buf_get_u64(field->out_value, 0, field->num_bits);
+		uint64_t in = 0;
+		uint8_t status = RISCV_DMI_TRACE_NOT_CAPTURED;
+		if (field->in_value) {
+			in = buf_get_u64(field->in_value, 0, field->num_bits);
+			status = get_field(in, DTM_DMI_OP);
+		}
+
+		uint8_t record[RISCV_DMI_TRACE_RECORD_SIZE];
+		h_u64_to_le(record, time_us);
+		h_u32_to_le(record + 8, out >> DTM_DMI_ADDRESS_OFFSET);
+		h_u32_to_le(record + 12, get_field(out, DTM_DMI_DATA));
+		h_u32_to_le(record + 16, in >> DTM_DMI_ADDRESS_OFFSET);
+		h_u32_to_le(record + 20, get_field(in, DTM_DMI_DATA));
+		h_u16_to_le(record + 24, tap);
+		h_u16_to_le(record + 26, MIN(get_delay(batch, i, delays), UINT16_MAX));
+		record[28] = get_field(out, DTM_DMI_OP);
+		record[29] = status;
+		record[30] = field->num_bits;
+		record[31] = 0;
+
+		if (fwrite(record, sizeof(record), 1, dmi_trace_file) != 1) {
+			LOG_ERROR("Failed to write the DMI trace file, closing it");
+			riscv_dmi_trace_stop();
+			return;
+		}
+	}
+}
+
+void riscv_batch_finish_queued(struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays)
+{
 	if (bscan_tunnel_ir_width != 0) {
 		/* need to right-shift "in" by one bit, because of clock skew between BSCAN TAP and DM TAP */
 		for (size_t i = start_idx; i < batch->used_scans; ++i) {
@@ -192,9 +345,39 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 		const int delay = get_delay(batch, i, delays);
 		riscv_log_dmi_scan(batch->target, delay, batch->fields + i);
 	}
+	if (dmi_trace_file)
+		riscv_dmi_trace_batch(batch, start_idx, delays);
 
 	batch->was_run = true;
 	batch->last_scan_delay = get_delay(batch, batch->used_scans - 1, delays);
+}
+
+int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays, bool resets_delays,
+		size_t reset_delays_after)
+{
+	struct duration run_duration;
+	duration_start(&run_duration);
+	const int flush_count_before = jtag_get_flush_queue_count();
+
+	riscv_batch_queue_from(batch, start_idx, delays, resets_delays,
+			reset_delays_after);
+
+	keep_alive();
+
+	if (jtag_execute_queue() != ERROR_OK) {
+		LOG_TARGET_ERROR(batch->target, "Unable to execute JTAG queue");
+		return ERROR_FAIL;
+	}
+
+	keep_alive();
+
+	duration_measure(&run_duration);
+	batch->last_run_us = (int64_t)run_duration.elapsed.tv_sec * 1000000
+		+ run_duration.elapsed.tv_usec;
+	batch->last_run_flushes = jtag_get_flush_queue_count() - flush_count_before;
+
+	riscv_batch_finish_queued(batch, start_idx, delays);
 	return ERROR_OK;
 }
 
@@ -235,6 +418,25 @@ size_t riscv_batch_add_dmi_read(struct riscv_batch *batch, uint64_t address,
 	return batch->read_keys_used++;
 }
 
+/* The "op" and "data" fields of a DMI scan always occupy the first 34 bits of
+ * the scan, so they can be extracted from the first 5 bytes directly
+ * instead of going through the generic bit-by-bit "buf_get_u32()". */
+static inline unsigned int dmi_scan_get_op(const uint8_t *scan)
+{
+	assert(DTM_DMI_OP_OFFSET == 0);
+	return scan[0] & ((1 << DTM_DMI_OP_LENGTH) - 1);
+}
+
+static inline uint32_t dmi_scan_get_data(const uint8_t *scan)
+{
+	assert(DTM_DMI_DATA_OFFSET + DTM_DMI_DATA_LENGTH <= 40);
+	assert(DMI_SCAN_BUF_SIZE >= 5);
+	const uint64_t low_bits = (uint64_t)scan[0] | ((uint64_t)scan[1] << 8)
+		| ((uint64_t)scan[2] << 16) | ((uint64_t)scan[3] << 24)
+		| ((uint64_t)scan[4] << 32);
+	return (uint32_t)(low_bits >> DTM_DMI_DATA_OFFSET);
+}
+
 unsigned int riscv_batch_get_dmi_read_op(const struct riscv_batch *batch, size_t key)
 {
 	assert(key < batch->read_keys_used);
@@ -242,7 +444,7 @@ unsigned int riscv_batch_get_dmi_read_op(const struct riscv_batch *batch, size_t
 	assert(index < batch->used_scans);
 	uint8_t *base = batch->data_in + DMI_SCAN_BUF_SIZE * index;
 	/* extract "op" field from the DMI read result */
-	return (unsigned int)buf_get_u32(base, DTM_DMI_OP_OFFSET, DTM_DMI_OP_LENGTH);
+	return dmi_scan_get_op(base);
 }
 
 uint32_t riscv_batch_get_dmi_read_data(const struct riscv_batch *batch, size_t key)
@@ -252,7 +454,49 @@ uint32_t riscv_batch_get_dmi_read_data(const struct riscv_batch *batch, size_t k
 	assert(index < batch->used_scans);
 	uint8_t *base = batch->data_in + DMI_SCAN_BUF_SIZE * index;
 	/* extract "data" field from the DMI read result */
-	return buf_get_u32(base, DTM_DMI_DATA_OFFSET, DTM_DMI_DATA_LENGTH);
+	return dmi_scan_get_data(base);
+}
+
+size_t riscv_batch_get_dmi_read_elements(const struct riscv_batch *batch,
+		size_t first_key, size_t count, unsigned int element_size,
+		uint8_t *buffer)
+{
+	assert(element_size <= 16);
+	const unsigned int reads_per_element = DIV_ROUND_UP(element_size, 4);
+	assert(first_key + count * reads_per_element <= batch->read_keys_used);
+	const size_t *keys = batch->read_keys + first_key;
+	for (size_t i = 0; i < count; ++i, buffer += element_size) {
+		uint64_t value = 0;
+		for (unsigned int r = 0; r < reads_per_element; ++r, ++keys) {
+			assert(*keys < batch->used_scans);
+			const uint8_t *scan = batch->data_in + DMI_SCAN_BUF_SIZE * *keys;
+			if (dmi_scan_get_op(scan) != DTM_DMI_OP_SUCCESS)
+				return i;
+			if (element_size == 16)
+				h_u32_to_le(buffer + 4 * (reads_per_element - 1 - r),
+						dmi_scan_get_data(scan));
+			else
+				value = (value << 32) | dmi_scan_get_data(scan);
+		}
+		switch (element_size) {
+		case 16:
+			break;
+		case 8:
+			h_u64_to_le(buffer, value);
+			break;
+		case 4:
+			h_u32_to_le(buffer, value);
+			break;
+		case 2:
+			h_u16_to_le(buffer, value);
+			break;
+		default:
+			assert(element_size == 1);
+			buffer[0] = value;
+			break;
+		}
+	}
+	return count;
 }
 
 void riscv_batch_add_nop(struct riscv_batch *batch)
@@ -285,6 +529,17 @@ bool riscv_batch_was_batch_busy(const struct riscv_batch *batch)
 	return riscv_batch_was_scan_busy(batch, batch->used_scans - 1);
 }
 
+void riscv_batch_decay_delays(const struct riscv_batch *batch, size_t start_idx,
+		struct riscv_scan_delays *delays)
+{
+	assert(!riscv_batch_was_batch_busy(batch));
+	size_t clean_scans[RISCV_SCAN_DELAY_CLASS_COUNT] = {0};
+	for (size_t i = start_idx; i < batch->used_scans; ++i)
+		++clean_scans[batch->delay_classes[i]];
+	for (unsigned int c = 0; c < RISCV_SCAN_DELAY_CLASS_COUNT; ++c)
+		riscv_scan_decay_delay(delays, c, clean_scans[c]);
+}
+
 size_t riscv_batch_finished_scans(const struct riscv_batch *batch)
 {
 	if (!riscv_batch_was_batch_busy(batch)) {
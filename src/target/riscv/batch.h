@@ -28,6 +28,8 @@ enum riscv_scan_delay_class {
 	RISCV_DELAY_SYSBUS_WRITE
 };
 
+#define RISCV_SCAN_DELAY_CLASS_COUNT (RISCV_DELAY_SYSBUS_WRITE + 1)
+
 static inline const char *
 riscv_scan_delay_class_name(enum riscv_scan_delay_class delay_class)
 {
@@ -54,11 +56,29 @@ riscv_scan_delay_class_name(enum riscv_scan_delay_class delay_class)
  */
 #define RISCV_SCAN_DELAY_MAX (INT_MAX / 2)
 
+/* A learned delay is decreased after this many consecutive scans of its class
+ * completed without a busy response. Each time a decreased delay turns out to
+ * be too short, the number of scans required for the next decrease is doubled
+ * (up to RISCV_SCAN_DELAY_DECAY_MAX_BACKOFF times).
+ */
+#define RISCV_SCAN_DELAY_DECAY_SCANS 4096
+#define RISCV_SCAN_DELAY_DECAY_MAX_BACKOFF 8
+
+struct riscv_scan_delay_decay {
+	/* Number of consecutive scans without a busy response. */
+	size_t clean_scans;
+	/* log2 of the multiplier of RISCV_SCAN_DELAY_DECAY_SCANS. */
+	unsigned int backoff;
+	/* The delay was decreased and no busy response was seen since. */
+	bool decreased;
+};
+
 struct riscv_scan_delays {
 	unsigned int base_delay;
 	unsigned int ac_delay;
 	unsigned int sb_read_delay;
 	unsigned int sb_write_delay;
+	struct riscv_scan_delay_decay decay[RISCV_SCAN_DELAY_CLASS_COUNT];
 };
 
 static inline unsigned int
@@ -102,9 +122,34 @@ static inline void riscv_scan_set_delay(struct riscv_scan_delays *delays,
 	assert(0);
 }
 
+static inline unsigned int *
+riscv_scan_delay_component(struct riscv_scan_delays *delays,
+		enum riscv_scan_delay_class delay_class)
+{
+	switch (delay_class) {
+	case RISCV_DELAY_BASE:
+		return &delays->base_delay;
+	case RISCV_DELAY_ABSTRACT_COMMAND:
+		return &delays->ac_delay;
+	case RISCV_DELAY_SYSBUS_READ:
+		return &delays->sb_read_delay;
+	case RISCV_DELAY_SYSBUS_WRITE:
+		return &delays->sb_write_delay;
+	}
+	assert(0);
+	return NULL;
+}
+
 static inline int riscv_scan_increase_delay(struct riscv_scan_delays *delays,
 		enum riscv_scan_delay_class delay_class)
 {
+	struct riscv_scan_delay_decay *decay = &delays->decay[delay_class];
+	if (decay->decreased &&
+			decay->backoff < RISCV_SCAN_DELAY_DECAY_MAX_BACKOFF)
+		++decay->backoff;
+	decay->decreased = false;
+	decay->clean_scans = 0;
+
 	const unsigned int delay = riscv_scan_get_delay(delays, delay_class);
 	const unsigned int delay_step = delay / 10 + 1;
 	if (delay > RISCV_SCAN_DELAY_MAX - delay_step) {
@@ -120,6 +165,30 @@ static inline int riscv_scan_increase_delay(struct riscv_scan_delays *delays,
 	return ERROR_OK;
 }
 
+/* Account "clean_scans" scans of the given class that completed without a
+ * busy response, and decrease the learned delay of the class if there was
+ * a long enough run of such scans. This way a single busy response (e.g.
+ * caused by a cold cache) does not slow down all the following accesses. */
+static inline void riscv_scan_decay_delay(struct riscv_scan_delays *delays,
+		enum riscv_scan_delay_class delay_class, size_t clean_scans)
+{
+	struct riscv_scan_delay_decay *decay = &delays->decay[delay_class];
+	decay->clean_scans += clean_scans;
+	if (decay->clean_scans <
+			((size_t)RISCV_SCAN_DELAY_DECAY_SCANS << decay->backoff))
+		return;
+	decay->clean_scans = 0;
+
+	unsigned int * const delay = riscv_scan_delay_component(delays, delay_class);
+	if (*delay == 0)
+		return;
+	*delay -= *delay / 16 + 1;
+	decay->decreased = true;
+	LOG_DEBUG("%s delay is decreased to %u.",
+			riscv_scan_delay_class_name(delay_class),
+			riscv_scan_get_delay(delays, delay_class));
+}
+
 /* A batch of multiple JTAG scans, which are grouped together to avoid the
  * overhead of some JTAG adapters when sending single commands.  This is
  * designed to support block copies, as that's what we actually need to go
@@ -129,6 +198,9 @@ struct riscv_batch {
 
 	size_t allocated_scans;
 	size_t used_scans;
+	/* Number of scans the buffers below have room for. May be larger than
+	 * "allocated_scans" when the batch is reused from the pool. */
+	size_t capacity;
 
 	uint8_t *data_out;
 	uint8_t *data_in;
@@ -159,13 +231,32 @@ struct riscv_batch {
 	 * Only valid when `was_run` is set.
 	 */
 	unsigned int last_scan_delay;
+	/* Wall-clock duration (in microseconds) of the last run and the number
+	 * of JTAG queue flushes it took. Only valid when `was_run` is set. */
+	int64_t last_run_us;
+	unsigned int last_run_flushes;
 };
 
 /* Allocates (or frees) a new scan set.  "scans" is the maximum number of JTAG
- * scans that can be issued to this object. */
+ * scans that can be issued to this object.
+ * Freed batches are kept in a small per-target pool and are reused by the
+ * following allocations of the same or smaller size, so short-lived batches
+ * (e.g. single DMI accesses) don't go through malloc()/free(). */
 struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans);
 void riscv_batch_free(struct riscv_batch *batch);
 
+/* Releases the memory of all the batches kept in the pool of the target. */
+void riscv_batch_pool_release(struct target *target);
+
+/* Drops all the scans queued in the batch, so the allocated buffers can be
+ * filled and run again without going through "riscv_batch_alloc()". */
+void riscv_batch_reset(struct riscv_batch *batch);
+
+/* Makes a batch that has been run (and ends with a NOP) ready to be run again
+ * with exactly the same scans, so a DMI access sequence that is issued over
+ * and over doesn't have to be rebuilt every time. */
+void riscv_batch_rewind(struct riscv_batch *batch);
+
 /* Checks to see if this batch is full. */
 bool riscv_batch_full(struct riscv_batch *batch);
 
@@ -186,9 +277,25 @@ int riscv_batch_run_from(struct riscv_batch *batch, size_t start_idx,
 		const struct riscv_scan_delays *delays, bool resets_delays,
 		size_t reset_delays_after);
 
+/* The two halves of "riscv_batch_run_from()": the first one only adds the
+ * scans of the batch to the JTAG queue, the second one has to be called after
+ * the queue was executed successfully. This allows the batches of several
+ * targets (e.g. harts behind different DMs or TAPs) to be run in a single
+ * JTAG queue flush. */
+void riscv_batch_queue_from(struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays, bool resets_delays,
+		size_t reset_delays_after);
+void riscv_batch_finish_queued(struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays);
+
 /* Get the number of scans successfully executed form this batch. */
 size_t riscv_batch_finished_scans(const struct riscv_batch *batch);
 
+/* Account the scans [start_idx, used_scans) of a batch, that was run without
+ * a busy response, in the decay of the learned delays. */
+void riscv_batch_decay_delays(const struct riscv_batch *batch, size_t start_idx,
+		struct riscv_scan_delays *delays);
+
 /* Adds a DM register write to this batch. */
 void riscv_batch_add_dmi_write(struct riscv_batch *batch, uint64_t address, uint32_t data,
 	bool read_back, enum riscv_scan_delay_class delay_class);
@@ -219,6 +326,14 @@ riscv_batch_add_dm_read(struct riscv_batch *batch, uint64_t address,
 unsigned int riscv_batch_get_dmi_read_op(const struct riscv_batch *batch, size_t key);
 uint32_t riscv_batch_get_dmi_read_data(const struct riscv_batch *batch, size_t key);
 
+/* Decode the results of consecutive DMI reads straight into "buffer".
+ * Each element of "element_size" bytes is obtained from one read or, for
+ * 8 and 16-byte elements, from two or four reads (upper word first). Decoding stops at the
+ * first read that did not succeed. Returns the number of elements stored. */
+size_t riscv_batch_get_dmi_read_elements(const struct riscv_batch *batch,
+		size_t first_key, size_t count, unsigned int element_size,
+		uint8_t *buffer);
+
 /* Scans in a NOP. */
 void riscv_batch_add_nop(struct riscv_batch *batch);
 
@@ -228,6 +343,31 @@ size_t riscv_batch_available_scans(struct riscv_batch *batch);
 /* Return true iff the last scan in the batch returned DMI_OP_BUSY. */
 bool riscv_batch_was_batch_busy(const struct riscv_batch *batch);
 
+/* Binary trace of the DMI scans: a header of the magic and the version
+ * byte, then one record of little endian fields per scan:
+ *   u64 time since the start of the trace in us, taken when the batch ran
+ *   u32 address and u32 data scanned out,
+ *   u32 address and u32 data scanned in,
+ *   u16 absolute position of the TAP in the chain,
+ *   u16 run-test/idle cycles after the scan,
+ *   u8 op scanned out, u8 op/status scanned in (0xff if not captured),
+ *   u8 scan length in bits, u8 reserved.
+ * contrib/riscv_dmi_trace.c decodes it. */
+#define RISCV_DMI_TRACE_MAGIC		"OCDDMI"
+#define RISCV_DMI_TRACE_VERSION		1
+#define RISCV_DMI_TRACE_HEADER_SIZE	8
+#define RISCV_DMI_TRACE_RECORD_SIZE	32
+#define RISCV_DMI_TRACE_NOT_CAPTURED	0xff
+#define RISCV_DMI_TRACE_BUFFER_SIZE	(1024 * 1024)
+
+/* Start writing all the scans of the batches to a new trace file, closing
+ * a previous trace first. */
+int riscv_dmi_trace_start(const char *filename);
+void riscv_dmi_trace_stop(void);
+bool riscv_dmi_trace_enabled(void);
+void riscv_dmi_trace_batch(const struct riscv_batch *batch, size_t start_idx,
+		const struct riscv_scan_delays *delays);
+
 /* TODO: The function is defined in `riscv-013.c`. This is done to reduce the
  * diff of the commit. The intention is to move the function definition to
  * a separate module (e.g. `riscv013-jtag-dtm.c/h`) in another commit. */
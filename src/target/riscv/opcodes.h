@@ -3,9 +3,13 @@
 #include "encoding.h"
 
 #define ZERO	0
+#define RA	1
 #define T0      5
 #define S0      8
 #define S1      9
+#define A0	10
+#define A1	11
+#define A2	12
 
 static uint32_t bits(uint32_t value, unsigned int hi, unsigned int lo)
 {
@@ -71,6 +75,18 @@ static uint32_t jal(unsigned int rd, uint32_t imm)
 	return imm_j(imm) | inst_rd(rd) | MATCH_JAL;
 }
 
+static uint32_t jalr(unsigned int rd, unsigned int base, uint16_t offset) __attribute__ ((unused));
+static uint32_t jalr(unsigned int rd, unsigned int base, uint16_t offset)
+{
+	return imm_i(offset) | inst_rs1(base) | inst_rd(rd) | MATCH_JALR;
+}
+
+static uint32_t bne(unsigned int rs1, unsigned int rs2, uint32_t imm) __attribute__ ((unused));
+static uint32_t bne(unsigned int rs1, unsigned int rs2, uint32_t imm)
+{
+	return imm_b(imm) | inst_rs2(rs2) | inst_rs1(rs1) | MATCH_BNE;
+}
+
 static uint32_t csrsi(unsigned int csr, uint16_t imm) __attribute__ ((unused));
 static uint32_t csrsi(unsigned int csr, uint16_t imm)
 {
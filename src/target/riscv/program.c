@@ -30,13 +30,11 @@ int riscv_program_init(struct riscv_program *p, struct target *target)
 
 int riscv_program_write(struct riscv_program *program)
 {
-	for (unsigned i = 0; i < program->instruction_count; ++i) {
+	for (unsigned i = 0; i < program->instruction_count; ++i)
 		LOG_TARGET_DEBUG(program->target, "progbuf[%02x] = DASM(0x%08x)",
 				i, program->progbuf[i]);
-		if (riscv_write_progbuf(program->target, i, program->progbuf[i]) != ERROR_OK)
-			return ERROR_FAIL;
-	}
-	return ERROR_OK;
+	return riscv_write_program(program->target, program->progbuf,
+			program->instruction_count);
 }
 
 /** Add ebreak and execute the program. */
@@ -390,7 +390,7 @@ static void dump_field(const struct scan_field *field)
 	static const char * const op_string[] = {"nop", "r", "w", "?"};
 	static const char * const status_string[] = {"+", "?", "F", "b"};
 
-	if (debug_level < LOG_LVL_DEBUG)
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
 		return;
 
 	uint64_t out = buf_get_u64(field->out_value, 0, field->num_bits);
@@ -1366,6 +1366,7 @@ int riscv011_get_register(struct target *target, riscv_reg_t *value,
 
 		if (cache_write(target, 4, true) != ERROR_OK)
 			return ERROR_FAIL;
+		*value = cache_get(target, SLOT0);
 	} else if (regid == GDB_REGNO_PRIV) {
 		*value = get_field(info->dcsr, DCSR_PRV);
 	} else {
@@ -1377,6 +1378,175 @@ int riscv011_get_register(struct target *target, riscv_reg_t *value,
 	return ERROR_OK;
 }
 
+/* Most registers read per register_read_batch_chunk(), so that the scans fit
+ * in the usual 256 entry scans_t. */
+#define REGISTER_BATCH_MAX	64
+
+/* dpc and dcsr are kept in riscv011_info_t, they are never read this way. */
+static bool register_batch_readable(enum gdb_regno regno, bool fpu_enabled)
+{
+	if (regno >= GDB_REGNO_FPR0 && regno <= GDB_REGNO_FPR31)
+		return fpu_enabled;
+	return regno >= GDB_REGNO_CSR0 && regno <= GDB_REGNO_CSR4095 &&
+		regno != GDB_REGNO_DPC && regno != GDB_REGNO_DCSR;
+}
+
+/* Instruction that copies "regno" to s0. */
+static uint32_t register_batch_insn(struct target *target, enum gdb_regno regno)
+{
+	if (regno >= GDB_REGNO_FPR0 && regno <= GDB_REGNO_FPR31) {
+		if (riscv_xlen(target) == 32)
+			return fmv_x_w(S0, regno - GDB_REGNO_FPR0);
+		return fmv_x_d(S0, regno - GDB_REGNO_FPR0);
+	}
+	return csrr(S0, regno - GDB_REGNO_CSR0);
+}
+
+/**
+ * Read "count" CSRs and FPRs in a single scans_t execution. The program in
+ * Debug RAM is "copy to s0; store s0 to SLOT0; jump back", only its first
+ * word changes from one register to the next. The exception word is checked
+ * once, at the end: if an exception happened, or a scan wasn't done in time,
+ * none of the registers is valid and they have to be read one at a time.
+ */
+static int register_read_batch_chunk(struct target *target,
+		const enum gdb_regno *regnos, unsigned int count, riscv_reg_t *values,
+		bool *valid)
+{
+	riscv011_info_t *info = get_info(target);
+	const unsigned int words = riscv_xlen(target) / 32;
+
+	scans_t *scans = scans_new(target, 2 + count * (1 + words) + 2);
+	if (!scans)
+		return ERROR_FAIL;
+
+	scans_add_write_store(scans, 1, S0, SLOT0, false);
+	scans_add_write_jump(scans, 2, false);
+	for (unsigned int i = 0; i < count; i++) {
+		scans_add_write32(scans, 0, register_batch_insn(target, regnos[i]), true);
+		scans_add_read(scans, SLOT0, false);
+	}
+	/* Scan out the last value, then the exception word. */
+	scans_add_read32(scans, info->dramsize - 1, false);
+	scans_add_read32(scans, info->dramsize - 1, false);
+
+	int retval = scans_execute(scans);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("JTAG execute failed: %d", retval);
+		goto done;
+	}
+
+	/* Every scan returns the result of the previous one. */
+	unsigned int dbus_busy = 0;
+	unsigned int interrupt_set = 0;
+	for (unsigned int i = 1; i < scans->next_scan; i++) {
+		dbus_status_t status = scans_get_u32(scans, i, DBUS_OP_START,
+				DBUS_OP_SIZE);
+		switch (status) {
+			case DBUS_STATUS_SUCCESS:
+				break;
+			case DBUS_STATUS_FAILED:
+				LOG_ERROR("Debug access failed. Hardware error?");
+				retval = ERROR_FAIL;
+				goto done;
+			case DBUS_STATUS_BUSY:
+				dbus_busy++;
+				break;
+			default:
+				LOG_ERROR("Got invalid bus access status: %d", status);
+				retval = ERROR_FAIL;
+				goto done;
+		}
+		if (scans_get_u64(scans, i, DBUS_DATA_START, DBUS_DATA_SIZE) &
+				DMCONTROL_INTERRUPT)
+			interrupt_set++;
+	}
+
+	if (dbus_busy) {
+		increase_dbus_busy_delay(target);
+		goto done;
+	}
+	if (interrupt_set) {
+		increase_interrupt_high_delay(target);
+		retval = wait_for_debugint_clear(target, false);
+		goto done;
+	}
+
+	const uint32_t exception = scans_get_u32(scans, scans->next_scan - 1,
+			DBUS_DATA_START, 32);
+	if (exception) {
+		LOG_DEBUG("Got exception 0x%x in a batch of %u register reads",
+				exception, count);
+		goto done;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		const unsigned int read = 2 + i * (1 + words) + 1;
+		values[i] = scans_get_u32(scans, read + 1, DBUS_DATA_START, 32);
+		if (words > 1)
+			values[i] |= (uint64_t)scans_get_u32(scans, read + 2,
+					DBUS_DATA_START, 32) << 32;
+		valid[i] = true;
+	}
+
+done:
+	scans_delete(scans);
+	/* The program and SLOT0 were written behind the cache's back. */
+	cache_invalidate(target);
+	return retval;
+}
+
+static int register_read_batch(struct target *target, const enum gdb_regno *regnos,
+		unsigned int count, riscv_reg_t *values, bool *valid)
+{
+	riscv011_info_t *info = get_info(target);
+	for (unsigned int i = 0; i < count; i++)
+		valid[i] = false;
+
+	maybe_write_tselect(target);
+
+	bool fpu_enabled = false;
+	for (unsigned int i = 0; i < count; i++) {
+		if (regnos[i] >= GDB_REGNO_FPR0 && regnos[i] <= GDB_REGNO_FPR31) {
+			fpu_enabled = update_mstatus_actual(target) == ERROR_OK &&
+				get_field(info->mstatus_actual, MSTATUS_FS) != 0;
+			break;
+		}
+	}
+
+	enum gdb_regno batch_regnos[REGISTER_BATCH_MAX];
+	unsigned int batch_index[REGISTER_BATCH_MAX];
+	riscv_reg_t batch_values[REGISTER_BATCH_MAX];
+	bool batch_valid[REGISTER_BATCH_MAX];
+
+	jtag_add_ir_scan(target->tap, &select_dbus, TAP_IDLE);
+
+	unsigned int i = 0;
+	while (i < count) {
+		unsigned int n = 0;
+		for (; i < count && n < REGISTER_BATCH_MAX; i++) {
+			if (!register_batch_readable(regnos[i], fpu_enabled))
+				continue;
+			batch_regnos[n] = regnos[i];
+			batch_index[n] = i;
+			n++;
+		}
+		if (n == 0)
+			break;
+		if (register_read_batch_chunk(target, batch_regnos, n, batch_values,
+					batch_valid) != ERROR_OK)
+			return ERROR_FAIL;
+		for (unsigned int j = 0; j < n; j++) {
+			values[batch_index[j]] = batch_values[j];
+			valid[batch_index[j]] = batch_valid[j];
+			if (batch_valid[j] && batch_regnos[j] == GDB_REGNO_MSTATUS)
+				info->mstatus_actual = batch_values[j];
+		}
+	}
+
+	return ERROR_OK;
+}
+
 /* This function is intended to handle accesses to registers through register
  * cache. */
 int riscv011_set_register(struct target *target, enum gdb_regno regid,
@@ -2394,6 +2564,7 @@ static int init_target(struct command_context *cmd_ctx,
 	LOG_DEBUG("init");
 	RISCV_INFO(generic_info);
 	generic_info->read_memory = read_memory;
+	generic_info->read_registers = register_read_batch;
 	generic_info->authdata_read = &riscv011_authdata_read;
 	generic_info->authdata_write = &riscv011_authdata_write;
 	generic_info->print_info = &riscv011_print_info;
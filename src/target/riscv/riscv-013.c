@@ -43,6 +43,14 @@ static int riscv013_clear_abstract_error(struct target *target);
 static int dm013_select_hart(struct target *target, int hart_index);
 static int riscv013_halt_prep(struct target *target);
 static int riscv013_halt_go(struct target *target);
+static void sample_batch_free(struct target *target);
+static int wait_for_idle_if_needed(struct target *target);
+static int is_fpu_reg(enum gdb_regno gdb_regno);
+static int prep_for_register_access(struct target *target,
+		riscv_reg_t *orig_mstatus, enum gdb_regno regno);
+static int cleanup_after_register_access(struct target *target,
+		riscv_reg_t mstatus, enum gdb_regno regno);
+static int vector_context_restore(struct target *target);
 static int riscv013_resume_go(struct target *target);
 static int riscv013_step_current_hart(struct target *target);
 static int riscv013_on_step(struct target *target);
@@ -53,6 +61,8 @@ static int riscv013_write_progbuf(struct target *target, unsigned int index,
 static riscv_insn_t riscv013_read_progbuf(struct target *target, unsigned int
 		index);
 static int riscv013_invalidate_cached_progbuf(struct target *target);
+static int riscv013_write_program(struct target *target, const riscv_insn_t *insns,
+		unsigned int count);
 static int riscv013_execute_progbuf(struct target *target, uint32_t *cmderr);
 static void riscv013_fill_dmi_write(struct target *target, char *buf, uint64_t a, uint32_t d);
 static void riscv013_fill_dmi_read(struct target *target, char *buf, uint64_t a);
@@ -65,6 +75,12 @@ static int register_write_direct(struct target *target, enum gdb_regno number,
 		riscv_reg_t value);
 static int read_memory(struct target *target, target_addr_t address,
 		uint32_t size, uint32_t count, uint8_t *buffer, uint32_t increment);
+static int read_memory_group(struct target **targets, unsigned int target_count,
+		target_addr_t address, uint32_t size, uint32_t count, uint8_t **buffers);
+static bool sb_group_read_supported(struct target *target, uint32_t size);
+static int sb_stream_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer, bool autoincrement,
+		uint32_t *done);
 static int write_memory(struct target *target, target_addr_t address,
 		uint32_t size, uint32_t count, const uint8_t *buffer);
 
@@ -72,6 +88,7 @@ typedef enum {
 	HALT_GROUP,
 	RESUME_GROUP
 } grouptype_t;
+static unsigned int halt_group(const struct target *target);
 static int set_group(struct target *target, bool *supported, unsigned int group,
 		grouptype_t grouptype);
 
@@ -110,6 +127,18 @@ typedef enum {
 #define HART_INDEX_MULTIPLE	-1
 #define HART_INDEX_UNKNOWN	-2
 
+/* Number of programs that can be resident in the program buffer at the
+ * same time, see riscv013_write_program(). */
+#define PROGBUF_RESIDENTS	4
+
+struct progbuf_resident {
+	/* First word of the program, 0 if the entry is unused. */
+	unsigned int start;
+	unsigned int count;
+	/* Value of dm013_info_t::progbuf_use when the program last ran. */
+	unsigned int last_use;
+};
+
 typedef struct {
 	struct list_head list;
 	int abs_chain_position;
@@ -133,6 +162,12 @@ typedef struct {
 	 * so we use 0 to mean the cached value is invalid. */
 	uint32_t progbuf_cache[16];
 
+	/* Programs kept in the program buffer behind progbuf0, which holds a
+	 * jump to the one to run next. Their words are in progbuf_cache. */
+	struct progbuf_resident progbuf_residents[PROGBUF_RESIDENTS];
+	/* Bumped on every program run from progbuf_residents. */
+	unsigned int progbuf_use;
+
 	/* Some operations are illegal when an abstract command is running.
 	 * The field is used to track whether the last command timed out, and
 	 * abstractcs.busy may have remained set. In that case we may need to
@@ -175,10 +210,22 @@ typedef struct {
 
 	bool abstract_read_csr_supported;
 	bool abstract_write_csr_supported;
+	/* The spec allows abstract commands to access some CSRs and not others,
+	 * so "not supported" is remembered per CSR. abstract_*_csr_supported
+	 * is only cleared if no CSR could be accessed at all. */
+	DECLARE_BITMAP(abstract_read_csr_unsupported, GDB_REGNO_CSR4095 - GDB_REGNO_CSR0 + 1);
+	DECLARE_BITMAP(abstract_write_csr_unsupported, GDB_REGNO_CSR4095 - GDB_REGNO_CSR0 + 1);
+	bool abstract_read_csr_succeeded;
+	bool abstract_write_csr_succeeded;
+	unsigned int abstract_read_csr_failures;
+	unsigned int abstract_write_csr_failures;
 	bool abstract_read_fpr_supported;
 	bool abstract_write_fpr_supported;
 
 	yes_no_maybe_t has_aampostincrement;
+	/* Whether access register commands support aarpostincrement (combined
+	 * with abstractauto) to read consecutive registers. */
+	yes_no_maybe_t has_aarpostincrement;
 
 	/* Some fields from hartinfo. */
 	uint8_t datasize;
@@ -197,6 +244,33 @@ typedef struct {
 
 	/* This hart was placed into a halt group in examine(). */
 	bool haltgroup_supported;
+	/* The halt group the hart currently is in, see halt_group(). */
+	unsigned int haltgroup;
+
+	/* vtype/vl (and mstatus.VS) set up for vector register access. The
+	 * set-up is kept while the hart stays halted, so accessing all the
+	 * vector registers doesn't save and restore them every time. While
+	 * active, the register cache holds the original values, which are
+	 * written back before the hart resumes. */
+	struct {
+		bool active;
+		riscv_reg_t mstatus;
+		riscv_reg_t vtype;
+		riscv_reg_t vl;
+		unsigned int debug_vl;
+		unsigned int debug_vsew;
+	} vector_context;
+
+	/* Memory sampling batch. It is built for one generation of the sample
+	 * configuration and then run unchanged on every sampling iteration. */
+	struct {
+		struct riscv_batch *batch;
+		unsigned int generation;
+		/* How often each bucket is read by one run of the batch. */
+		unsigned int repeat;
+		unsigned int result_bytes;
+		size_t sbcs_read_index;
+	} sample;
 } riscv013_info_t;
 
 static LIST_HEAD(dm_list);
@@ -308,7 +382,7 @@ static riscv_debug_reg_ctx_t get_riscv_debug_reg_ctx(const struct target *target
 static void log_debug_reg(struct target *target, enum riscv_debug_reg_ordinal reg,
 		riscv_reg_t value, const char *file, unsigned int line, const char *func)
 {
-	if (debug_level < LOG_LVL_DEBUG)
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
 		return;
 	const riscv_debug_reg_ctx_t context = get_riscv_debug_reg_ctx(target);
 	char * const buf = malloc(riscv_debug_reg_to_s(NULL, reg, context, value, RISCV_DEBUG_REG_HIDE_UNNAMED_0) + 1);
@@ -380,7 +454,7 @@ void riscv_log_dmi_scan(const struct target *target, int idle,
 	static const char * const op_string[] = {"-", "r", "w", "?"};
 	static const char * const status_string[] = {"+", "?", "F", "b"};
 
-	if (debug_level < LOG_LVL_DEBUG)
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
 		return;
 
 	assert(field->out_value);
@@ -732,7 +806,7 @@ static int execute_abstract_command(struct target *target, uint32_t command,
 {
 	assert(cmderr);
 	*cmderr = CMDERR_NONE;
-	if (debug_level >= LOG_LVL_DEBUG) {
+	if (LOG_LEVEL_IS(LOG_LVL_DEBUG)) {
 		switch (get_field(command, DM_COMMAND_CMDTYPE)) {
 			case 0:
 				LOG_DEBUG_REG(target, AC_ACCESS_REGISTER, command);
@@ -787,7 +861,7 @@ static void abstract_data_read_fill_batch(struct riscv_batch *batch, unsigned in
 }
 
 static riscv_reg_t abstract_data_get_from_batch(struct riscv_batch *batch,
-		unsigned int index, unsigned int size_bits)
+		size_t first_key, unsigned int size_bits)
 {
 	assert(size_bits >= 32);
 	assert(size_bits % 32 == 0);
@@ -795,7 +869,7 @@ static riscv_reg_t abstract_data_get_from_batch(struct riscv_batch *batch,
 	assert(size_in_words * sizeof(uint32_t) <= sizeof(riscv_reg_t));
 	riscv_reg_t value = 0;
 	for (unsigned int i = 0; i < size_in_words; ++i) {
-		const uint32_t v = riscv_batch_get_dmi_read_data(batch, i);
+		const uint32_t v = riscv_batch_get_dmi_read_data(batch, first_key + i);
 		value |= ((riscv_reg_t)v) << (i * 32);
 	}
 	return value;
@@ -812,7 +886,7 @@ static int read_abstract_arg(struct target *target, riscv_reg_t *value,
 	abstract_data_read_fill_batch(batch, index, size_bits);
 	int result = batch_run_timeout(target, batch);
 	if (result == ERROR_OK)
-		*value = abstract_data_get_from_batch(batch, index, size_bits);
+		*value = abstract_data_get_from_batch(batch, 0, size_bits);
 	riscv_batch_free(batch);
 	return result;
 }
@@ -905,6 +979,63 @@ static uint32_t access_register_command(struct target *target, uint32_t number,
 	return command;
 }
 
+/* Number of different CSRs that have to fail before abstract access to
+ * CSRs is disabled altogether, as long as none succeeded. */
+#define ABSTRACT_CSR_FAILURES_TO_DISABLE	4
+
+static bool is_csr(enum gdb_regno number)
+{
+	return number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095;
+}
+
+static bool abstract_csr_supported(const riscv013_info_t *info,
+		enum gdb_regno number, bool write)
+{
+	if (write)
+		return info->abstract_write_csr_supported &&
+			!test_bit(number - GDB_REGNO_CSR0, info->abstract_write_csr_unsupported);
+	return info->abstract_read_csr_supported &&
+		!test_bit(number - GDB_REGNO_CSR0, info->abstract_read_csr_unsupported);
+}
+
+static void abstract_csr_succeeded(riscv013_info_t *info, bool write)
+{
+	if (write)
+		info->abstract_write_csr_succeeded = true;
+	else
+		info->abstract_read_csr_succeeded = true;
+}
+
+/* Called when an abstract command accessing CSR "number" failed with
+ * "not supported", so the program buffer is used for it from now on. */
+static void abstract_csr_not_supported(struct target *target,
+		enum gdb_regno number, bool write)
+{
+	RISCV013_INFO(info);
+	const char * const what = write ? "writes to" : "reads from";
+	unsigned long * const unsupported = write ?
+		info->abstract_write_csr_unsupported : info->abstract_read_csr_unsupported;
+	unsigned int * const failures = write ?
+		&info->abstract_write_csr_failures : &info->abstract_read_csr_failures;
+	const bool succeeded = write ?
+		info->abstract_write_csr_succeeded : info->abstract_read_csr_succeeded;
+
+	if (test_bit(number - GDB_REGNO_CSR0, unsupported))
+		return;
+	set_bit(number - GDB_REGNO_CSR0, unsupported);
+
+	if (!succeeded && ++*failures >= ABSTRACT_CSR_FAILURES_TO_DISABLE) {
+		if (write)
+			info->abstract_write_csr_supported = false;
+		else
+			info->abstract_read_csr_supported = false;
+		LOG_TARGET_INFO(target, "Disabling abstract command %s CSRs.", what);
+		return;
+	}
+	LOG_TARGET_INFO(target, "Disabling abstract command %s %s.", what,
+			riscv_reg_gdb_regno_name(target, number));
+}
+
 static int register_read_abstract_with_size(struct target *target,
 		riscv_reg_t *value, enum gdb_regno number, unsigned int size)
 {
@@ -913,8 +1044,7 @@ static int register_read_abstract_with_size(struct target *target,
 	if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31 &&
 			!info->abstract_read_fpr_supported)
 		return ERROR_FAIL;
-	if (number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095 &&
-			!info->abstract_read_csr_supported)
+	if (is_csr(number) && !abstract_csr_supported(info, number, false))
 		return ERROR_FAIL;
 	/* The spec doesn't define abstract register numbers for vector registers. */
 	if (number >= GDB_REGNO_V0 && number <= GDB_REGNO_V31)
@@ -930,13 +1060,14 @@ static int register_read_abstract_with_size(struct target *target,
 			if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31) {
 				info->abstract_read_fpr_supported = false;
 				LOG_TARGET_INFO(target, "Disabling abstract command reads from FPRs.");
-			} else if (number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095) {
-				info->abstract_read_csr_supported = false;
-				LOG_TARGET_INFO(target, "Disabling abstract command reads from CSRs.");
+			} else if (is_csr(number)) {
+				abstract_csr_not_supported(target, number, false);
 			}
 		}
 		return result;
 	}
+	if (is_csr(number))
+		abstract_csr_succeeded(info, false);
 
 	if (value)
 		return read_abstract_arg(target, value, 0, size);
@@ -944,6 +1075,486 @@ static int register_read_abstract_with_size(struct target *target,
 	return ERROR_OK;
 }
 
+static bool register_group_read_supported(struct target *target,
+		enum gdb_regno number)
+{
+	RISCV013_INFO(info);
+	if (!target_was_examined(target) || target->state != TARGET_HALTED)
+		return false;
+	if (number <= GDB_REGNO_XPR31)
+		return true;
+	if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31)
+		return info->abstract_read_fpr_supported;
+	if (is_csr(number))
+		return abstract_csr_supported(info, number, false);
+	return false;
+}
+
+/**
+ * Queue an abstract command that reads register "number" into data0 (data1)
+ * followed by the reads of abstractcs and the data registers. Returns the key
+ * of the abstractcs read; the data reads use the following keys.
+ */
+static size_t register_read_abstract_fill_batch(struct target *target,
+		struct riscv_batch *batch, enum gdb_regno number, unsigned int size)
+{
+	const size_t abstractcs_read_key = abstract_cmd_fill_batch(batch,
+			access_register_command(target, number, size,
+				AC_ACCESS_REGISTER_TRANSFER));
+	abstract_data_read_fill_batch(batch, 0, size);
+	return abstractcs_read_key;
+}
+
+/* Scans per hart queued by "register_read_group_on_dm()" (besides data). */
+#define REGISTER_GROUP_READ_HART_SCANS (1 + ABSTRACT_COMMAND_BATCH_SIZE)
+
+/**
+ * Read register "number" of all the harts in "targets" (which all belong to
+ * "dm") in a single batch: for every hart, select it, execute the abstract
+ * command and read abstractcs and the data registers.
+ *
+ * Abstract commands operate only on the hart selected by hartsel, so the
+ * hart array mask can't be used here; the win is to pay for a single
+ * round trip instead of one select/command/read sequence per hart.
+ */
+static int register_read_group_on_dm(dm013_info_t *dm, struct target **targets,
+		unsigned int target_count, enum gdb_regno number, riscv_reg_t *values,
+		bool *valid)
+{
+	assert(target_count > 0);
+	struct target * const first = targets[0];
+	int result = wait_for_idle_if_needed(first);
+	if (result != ERROR_OK)
+		return result;
+
+	size_t scans = 1;
+	for (unsigned int i = 0; i < target_count; ++i)
+		scans += REGISTER_GROUP_READ_HART_SCANS
+			+ register_size(targets[i], number) / 32;
+	struct riscv_batch *batch = riscv_batch_alloc(first, scans);
+	if (!batch)
+		return ERROR_FAIL;
+
+	size_t *abstractcs_keys = calloc(target_count, sizeof(*abstractcs_keys));
+	if (!abstractcs_keys) {
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < target_count; ++i) {
+		const unsigned int size = register_size(targets[i], number);
+		uint32_t dmcontrol = set_dmcontrol_hartsel(DM_DMCONTROL_DMACTIVE,
+				get_info(targets[i])->index);
+		riscv_batch_add_dm_write(batch, DM_DMCONTROL, dmcontrol,
+				/* read_back */ true, RISCV_DELAY_BASE);
+		abstractcs_keys[i] = register_read_abstract_fill_batch(targets[i],
+				batch, number, size);
+	}
+	riscv_batch_add_nop(batch);
+
+	dm->abstract_cmd_maybe_busy = true;
+	result = batch_run_timeout(first, batch);
+	/* The last hart in the batch is the one that remains selected. */
+	dm->current_hartid = result == ERROR_OK ?
+		(int)get_info(targets[target_count - 1])->index : HART_INDEX_UNKNOWN;
+	if (result != ERROR_OK)
+		goto cleanup;
+
+	/* "cmderr" is sticky: once a command fails, the following ones are not
+	 * executed, so stop at the first failure. */
+	for (unsigned int i = 0; i < target_count; ++i) {
+		uint32_t cmderr;
+		if (abstract_cmd_batch_check_and_clear_cmderr(targets[i], batch,
+					abstractcs_keys[i], &cmderr) != ERROR_OK) {
+			LOG_TARGET_DEBUG(targets[i], "Group read of %s stopped "
+					"(cmderr=%" PRIu32 ").",
+					riscv_reg_gdb_regno_name(targets[i], number), cmderr);
+			break;
+		}
+		values[i] = abstract_data_get_from_batch(batch, abstractcs_keys[i] + 1,
+				register_size(targets[i], number));
+		valid[i] = true;
+	}
+
+cleanup:
+	free(abstractcs_keys);
+	riscv_batch_free(batch);
+	return result;
+}
+
+static int register_read_group(struct target **targets, unsigned int target_count,
+		enum gdb_regno number, riscv_reg_t *values, bool *valid)
+{
+	for (unsigned int i = 0; i < target_count; ++i)
+		valid[i] = false;
+
+	struct target **group = calloc(target_count, sizeof(*group));
+	unsigned int *group_index = calloc(target_count, sizeof(*group_index));
+	riscv_reg_t *group_values = calloc(target_count, sizeof(*group_values));
+	bool *group_valid = calloc(target_count, sizeof(*group_valid));
+	bool *done = calloc(target_count, sizeof(*done));
+	int result = ERROR_OK;
+	if (!group || !group_index || !group_values || !group_valid || !done) {
+		LOG_ERROR("Out of memory");
+		result = ERROR_FAIL;
+		goto cleanup;
+	}
+
+	/* Harts behind different DMs are read by separate batches. */
+	for (unsigned int i = 0; i < target_count; ++i) {
+		if (done[i])
+			continue;
+		dm013_info_t * const dm = get_dm(targets[i]);
+		if (!dm) {
+			result = ERROR_FAIL;
+			goto cleanup;
+		}
+		unsigned int group_count = 0;
+		for (unsigned int j = i; j < target_count; ++j) {
+			if (done[j] || get_info(targets[j])->dm != dm)
+				continue;
+			done[j] = true;
+			if (!register_group_read_supported(targets[j], number))
+				continue;
+			group[group_count] = targets[j];
+			group_index[group_count] = j;
+			group_valid[group_count] = false;
+			++group_count;
+		}
+		if (group_count == 0)
+			continue;
+		result = register_read_group_on_dm(dm, group, group_count, number,
+				group_values, group_valid);
+		if (result != ERROR_OK)
+			goto cleanup;
+		for (unsigned int k = 0; k < group_count; ++k) {
+			values[group_index[k]] = group_values[k];
+			valid[group_index[k]] = group_valid[k];
+		}
+	}
+
+cleanup:
+	free(group);
+	free(group_index);
+	free(group_values);
+	free(group_valid);
+	free(done);
+	return result;
+}
+
+/**
+ * Read as many of "regnos[0]", "regnos[1]", ... of a single hart as fit in one
+ * batch. "*done" is the number of registers read successfully. If a command
+ * failed, "*failed" is set and "regnos[*done]" is the failing register
+ * ("cmderr" is sticky, so the commands queued after it were not executed).
+ */
+static int register_read_batch_chunk(struct target *target,
+		const enum gdb_regno *regnos, unsigned int count, riscv_reg_t *values,
+		unsigned int *done, bool *failed)
+{
+	*done = 0;
+	*failed = false;
+	const unsigned int batch_size = riscv_get_batch_size(target);
+	unsigned int chunk = 0;
+	size_t scans = 1;
+	while (chunk < count) {
+		const size_t needed = ABSTRACT_COMMAND_BATCH_SIZE
+			+ register_size(target, regnos[chunk]) / 32;
+		if (chunk > 0 && scans + needed > batch_size)
+			break;
+		scans += needed;
+		++chunk;
+	}
+
+	struct riscv_batch *batch = riscv_batch_alloc(target, scans);
+	size_t *abstractcs_keys = calloc(chunk, sizeof(*abstractcs_keys));
+	if (!batch || !abstractcs_keys) {
+		free(abstractcs_keys);
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < chunk; ++i)
+		abstractcs_keys[i] = register_read_abstract_fill_batch(target, batch,
+				regnos[i], register_size(target, regnos[i]));
+	riscv_batch_add_nop(batch);
+
+	get_dm(target)->abstract_cmd_maybe_busy = true;
+	int result = batch_run_timeout(target, batch);
+	if (result != ERROR_OK)
+		goto cleanup;
+
+	for (unsigned int i = 0; i < chunk; ++i) {
+		uint32_t cmderr;
+		if (abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+					abstractcs_keys[i], &cmderr) != ERROR_OK) {
+			LOG_TARGET_DEBUG(target, "Batched read of %s failed (cmderr=%" PRIu32 ").",
+					riscv_reg_gdb_regno_name(target, regnos[i]), cmderr);
+			if (cmderr == CMDERR_NOT_SUPPORTED && is_csr(regnos[i]))
+				abstract_csr_not_supported(target, regnos[i], false);
+			*failed = true;
+			break;
+		}
+		if (is_csr(regnos[i]))
+			abstract_csr_succeeded(get_info(target), false);
+		values[i] = abstract_data_get_from_batch(batch, abstractcs_keys[i] + 1,
+				register_size(target, regnos[i]));
+		*done = i + 1;
+	}
+
+cleanup:
+	free(abstractcs_keys);
+	riscv_batch_free(batch);
+	return result;
+}
+
+/* Return the number of registers starting at "regnos[0]" that are consecutive
+ * GPRs or consecutive FPRs, i.e. that can be read with aarpostincrement. */
+static unsigned int register_postincrement_run(const enum gdb_regno *regnos,
+		unsigned int count)
+{
+	const bool is_gpr = regnos[0] <= GDB_REGNO_XPR31;
+	if (!is_gpr && !is_fpu_reg(regnos[0]))
+		return 0;
+	const enum gdb_regno last = is_gpr ? GDB_REGNO_XPR31 : GDB_REGNO_FPR31;
+	unsigned int run = 1;
+	while (run < count && regnos[run] == regnos[0] + run && regnos[run] <= last)
+		++run;
+	return run;
+}
+
+/**
+ * Read "count" consecutive registers starting at "first" with a single access
+ * register command using aarpostincrement: with abstractauto.autoexecdata[0]
+ * set, every read of data0 returns one register and executes the command
+ * again for the next one. Only one cmderr check is done, at the end.
+ */
+static int register_read_postincrement(struct target *target,
+		enum gdb_regno first, unsigned int count, riscv_reg_t *values)
+{
+	RISCV013_INFO(info);
+	assert(count >= 2);
+	const unsigned int size = register_size(target, first);
+	const unsigned int size_in_words = size / 32;
+
+	struct riscv_batch *batch = riscv_batch_alloc(target,
+			ABSTRACT_COMMAND_BATCH_SIZE + 2 + count * size_in_words + 1);
+	if (!batch)
+		return ERROR_FAIL;
+
+	riscv_batch_add_dm_write(batch, DM_COMMAND,
+			access_register_command(target, first, size,
+				AC_ACCESS_REGISTER_TRANSFER | AC_ACCESS_REGISTER_AARPOSTINCREMENT),
+			/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+	riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+			set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1), /* read_back */ true,
+			RISCV_DELAY_BASE);
+	for (unsigned int i = 0; i < count; ++i) {
+		const bool is_last = i == count - 1;
+		if (is_last)
+			riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+					/* read_back */ true, RISCV_DELAY_BASE);
+		/* Read the upper half first: accessing data0 starts the next command. */
+		if (size_in_words > 1)
+			riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+		riscv_batch_add_dm_read(batch, DM_DATA0,
+				is_last ? RISCV_DELAY_BASE : RISCV_DELAY_ABSTRACT_COMMAND);
+	}
+	const size_t abstractcs_read_key = riscv_batch_add_dm_read(batch,
+			DM_ABSTRACTCS, RISCV_DELAY_BASE);
+	riscv_batch_add_nop(batch);
+
+	get_dm(target)->abstract_cmd_maybe_busy = true;
+	int result = batch_run_timeout(target, batch);
+	if (result != ERROR_OK) {
+		/* Don't leave the DM re-executing the command on data0 accesses. */
+		dm_write(target, DM_ABSTRACTAUTO, 0);
+		goto cleanup;
+	}
+
+	uint32_t cmderr;
+	result = abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+			abstractcs_read_key, &cmderr);
+	if (result != ERROR_OK) {
+		if (cmderr == CMDERR_NOT_SUPPORTED && info->has_aarpostincrement == YNM_MAYBE) {
+			LOG_TARGET_DEBUG(target, "aarpostincrement is not supported on this target.");
+			info->has_aarpostincrement = YNM_NO;
+		}
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		riscv_reg_t value = 0;
+		for (unsigned int w = 0; w < size_in_words; ++w) {
+			const uint32_t v = riscv_batch_get_dmi_read_data(batch,
+					i * size_in_words + w);
+			value = (value << 32) | v;
+		}
+		values[i] = value;
+	}
+
+	if (info->has_aarpostincrement == YNM_MAYBE) {
+		/* Safety: double-check that the register number really was
+		 * incremented (and abstractauto really re-executed the command). */
+		riscv_reg_t value;
+		result = register_read_abstract_with_size(target, &value,
+				first + count - 1, size);
+		if (result != ERROR_OK)
+			goto cleanup;
+		if (value == values[count - 1]) {
+			LOG_TARGET_DEBUG(target, "aarpostincrement is supported on this target.");
+			info->has_aarpostincrement = YNM_YES;
+		} else {
+			LOG_TARGET_WARNING(target, "Buggy aarpostincrement! "
+					"Register number not incremented correctly.");
+			info->has_aarpostincrement = YNM_NO;
+			result = ERROR_FAIL;
+		}
+	}
+
+cleanup:
+	riscv_batch_free(batch);
+	return result;
+}
+
+static int register_read_batch(struct target *target, const enum gdb_regno *regnos,
+		unsigned int count, riscv_reg_t *values, bool *valid)
+{
+	RISCV013_INFO(info);
+	for (unsigned int i = 0; i < count; ++i)
+		valid[i] = false;
+
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* FPRs can only be accessed with mstatus.FS enabled. */
+	enum gdb_regno fpr = GDB_REGNO_COUNT;
+	for (unsigned int i = 0; i < count && fpr == GDB_REGNO_COUNT; ++i) {
+		if (is_fpu_reg(regnos[i]))
+			fpr = regnos[i];
+	}
+	riscv_reg_t mstatus = 0;
+	if (fpr != GDB_REGNO_COUNT &&
+			prep_for_register_access(target, &mstatus, fpr) != ERROR_OK)
+		return ERROR_FAIL;
+
+	int result = ERROR_OK;
+	unsigned int i = 0;
+	while (i < count) {
+		const unsigned int postincrement_run =
+			register_postincrement_run(regnos + i, count - i);
+		if (postincrement_run >= 2 && info->has_aarpostincrement != YNM_NO &&
+				register_group_read_supported(target, regnos[i]) &&
+				register_read_postincrement(target, regnos[i], postincrement_run,
+					values + i) == ERROR_OK) {
+			for (unsigned int j = 0; j < postincrement_run; ++j)
+				valid[i + j] = true;
+			i += postincrement_run;
+			continue;
+		}
+
+		if (!register_group_read_supported(target, regnos[i])) {
+			++i;
+			continue;
+		}
+		/* Collect a run of registers that can be read by abstract commands. */
+		unsigned int run = 1;
+		while (i + run < count && register_group_read_supported(target, regnos[i + run]))
+			++run;
+		unsigned int done;
+		bool failed;
+		result = register_read_batch_chunk(target, regnos + i, run, values + i,
+				&done, &failed);
+		if (result != ERROR_OK)
+			break;
+		for (unsigned int j = 0; j < done; ++j)
+			valid[i + j] = true;
+		/* Skip the register that failed. */
+		i += failed ? done + 1 : done;
+	}
+
+	if (fpr != GDB_REGNO_COUNT &&
+			cleanup_after_register_access(target, mstatus, fpr) != ERROR_OK)
+		return ERROR_FAIL;
+	return result;
+}
+
+/* Scans queued per trigger by "riscv013_read_triggers_tdata1()" besides the
+ * data of the tselect write and the tdata1 read. */
+#define TRIGGER_READ_SCANS (2 * ABSTRACT_COMMAND_BATCH_SIZE)
+
+/**
+ * Read tdata1 of the given triggers with one tselect write and one tdata1
+ * read abstract command each, all queued in as few batches as possible
+ * instead of one round trip per access.
+ */
+static int riscv013_read_triggers_tdata1(struct target *target,
+		const unsigned int *indexes, unsigned int count, riscv_reg_t *values,
+		bool *valid)
+{
+	RISCV013_INFO(info);
+	for (unsigned int i = 0; i < count; ++i)
+		valid[i] = false;
+	if (count == 0 || !register_group_read_supported(target, GDB_REGNO_TDATA1) ||
+			!abstract_csr_supported(info, GDB_REGNO_TSELECT, true))
+		return ERROR_OK;
+
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	const unsigned int xlen = riscv_xlen(target);
+	const unsigned int per_trigger = TRIGGER_READ_SCANS + 2 * xlen / 32;
+	const unsigned int chunk = MAX(1, riscv_get_batch_size(target) / per_trigger);
+	const uint32_t write_tselect = access_register_command(target,
+			GDB_REGNO_TSELECT, xlen,
+			AC_ACCESS_REGISTER_TRANSFER | AC_ACCESS_REGISTER_WRITE);
+
+	for (unsigned int done = 0; done < count; ) {
+		const unsigned int n = MIN(chunk, count - done);
+		struct riscv_batch *batch = riscv_batch_alloc(target, n * per_trigger + 1);
+		if (!batch)
+			return ERROR_FAIL;
+		size_t write_keys[n];
+		size_t read_keys[n];
+		for (unsigned int i = 0; i < n; ++i) {
+			abstract_data_write_fill_batch(batch, indexes[done + i],
+					/* index */ 0, xlen);
+			write_keys[i] = abstract_cmd_fill_batch(batch, write_tselect);
+			read_keys[i] = register_read_abstract_fill_batch(target, batch,
+					GDB_REGNO_TDATA1, xlen);
+		}
+		riscv_batch_add_nop(batch);
+
+		get_dm(target)->abstract_cmd_maybe_busy = true;
+		int result = batch_run_timeout(target, batch);
+		if (result != ERROR_OK) {
+			riscv_batch_free(batch);
+			return result;
+		}
+
+		/* cmderr is sticky, nothing after the first failure was executed */
+		bool failed = false;
+		for (unsigned int i = 0; i < n; ++i) {
+			uint32_t cmderr;
+			if (abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+						write_keys[i], &cmderr) != ERROR_OK ||
+					abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+						read_keys[i], &cmderr) != ERROR_OK) {
+				LOG_TARGET_DEBUG(target, "Batched read of trigger %u failed "
+						"(cmderr=%" PRIu32 ").", indexes[done + i], cmderr);
+				failed = true;
+				break;
+			}
+			values[done + i] = abstract_data_get_from_batch(batch,
+					read_keys[i] + 1, xlen);
+			valid[done + i] = true;
+		}
+		riscv_batch_free(batch);
+		if (failed)
+			return ERROR_OK;
+		done += n;
+	}
+	return ERROR_OK;
+}
+
 static int register_read_abstract(struct target *target, riscv_reg_t *value,
 		enum gdb_regno number)
 {
@@ -964,8 +1575,7 @@ static int register_write_abstract(struct target *target, enum gdb_regno number,
 	if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31 &&
 			!info->abstract_write_fpr_supported)
 		return ERROR_FAIL;
-	if (number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095 &&
-			!info->abstract_write_csr_supported)
+	if (is_csr(number) && !abstract_csr_supported(info, number, true))
 		return ERROR_FAIL;
 
 	const unsigned int size_bits = register_size(target, number);
@@ -997,11 +1607,12 @@ static int register_write_abstract(struct target *target, enum gdb_regno number,
 			if (number >= GDB_REGNO_FPR0 && number <= GDB_REGNO_FPR31) {
 				info->abstract_write_fpr_supported = false;
 				LOG_TARGET_INFO(target, "Disabling abstract command writes to FPRs.");
-			} else if (number >= GDB_REGNO_CSR0 && number <= GDB_REGNO_CSR4095) {
-				info->abstract_write_csr_supported = false;
-				LOG_TARGET_INFO(target, "Disabling abstract command writes to CSRs.");
+			} else if (is_csr(number)) {
+				abstract_csr_not_supported(target, number, true);
 			}
 		}
+	} else if (is_csr(number)) {
+		abstract_csr_succeeded(info, true);
 	}
 cleanup:
 	riscv_batch_free(batch);
@@ -1760,11 +2371,12 @@ static int halt_set_dcsr_ebreak(struct target *target)
 	/* Add it back to the halt group. */
 	if (info->haltgroup_supported) {
 		bool supported;
-		if (set_group(target, &supported, target->smp, HALT_GROUP) != ERROR_OK)
+		info->haltgroup = halt_group(target);
+		if (set_group(target, &supported, info->haltgroup, HALT_GROUP) != ERROR_OK)
 			return ERROR_FAIL;
 		if (!supported)
 			LOG_TARGET_ERROR(target, "Couldn't place hart back in halt group %d. "
-						 "Some harts may be unexpectedly halted.", target->smp);
+						 "Some harts may be unexpectedly halted.", info->haltgroup);
 	}
 
 	return result;
@@ -1779,13 +2391,25 @@ static void deinit_target(struct target *target)
 	if (!info)
 		return;
 
+	if (target->state == TARGET_HALTED && vector_context_restore(target) != ERROR_OK)
+		LOG_TARGET_ERROR(target, "Failed to restore vtype/vl. Ignoring this error.");
+
+	sample_batch_free(target);
 	riscv013_dm_free(target);
+	riscv_batch_pool_release(target);
 
 	free(info->version_specific);
 	/* TODO: free register arch_info */
 	info->version_specific = NULL;
 }
 
+/* The halt group the hart belongs to. In gdb non-stop mode the other harts
+ * of the SMP group must keep running when this one halts. */
+static unsigned int halt_group(const struct target *target)
+{
+	return target->smp_non_stop ? 0 : target->smp;
+}
+
 static int set_group(struct target *target, bool *supported, unsigned int group,
 		grouptype_t grouptype)
 {
@@ -1896,6 +2520,87 @@ static int reset_dm(struct target *target)
 	return ERROR_OK;
 }
 
+/* Number of harts selected and probed by a single batch in enumerate_harts() */
+#define ENUMERATE_HARTS_PER_BATCH 32
+
+/**
+ * Count the harts of the DM of "target" by selecting one after the other
+ * until one doesn't exist, acknowledging the resets found on the way. The
+ * selects and dmstatus reads of ENUMERATE_HARTS_PER_BATCH harts are queued
+ * in one batch, so a DM with a lot of harts costs a few JTAG queue flushes
+ * instead of two per hart.
+ */
+static int enumerate_harts(struct target *target, int max_hart_count)
+{
+	dm013_info_t *dm = get_dm(target);
+	size_t keys[ENUMERATE_HARTS_PER_BATCH];
+	bool done = false;
+
+	for (int first = 0; first < max_hart_count && !done;
+			first += ENUMERATE_HARTS_PER_BATCH) {
+		const int count = MIN(max_hart_count - first, ENUMERATE_HARTS_PER_BATCH);
+
+		/* `hartsel` should not be changed if `abstractcs.busy` is set. */
+		int result = wait_for_idle_if_needed(target);
+		if (result != ERROR_OK)
+			return result;
+
+		struct riscv_batch *batch = riscv_batch_alloc(target, 2 * count + 1);
+		if (!batch)
+			return ERROR_FAIL;
+		for (int i = 0; i < count; ++i) {
+			riscv_batch_add_dm_write(batch, DM_DMCONTROL,
+					set_dmcontrol_hartsel(DM_DMCONTROL_DMACTIVE, first + i),
+					/* read_back */ true, RISCV_DELAY_BASE);
+			keys[i] = riscv_batch_add_dm_read(batch, DM_DMSTATUS, RISCV_DELAY_BASE);
+		}
+
+		result = batch_run_timeout(target, batch);
+		/* The last hart in the batch is the one that remains selected. */
+		dm->current_hartid = result == ERROR_OK ? first + count - 1 : HART_INDEX_UNKNOWN;
+
+		for (int i = 0; i < count && result == ERROR_OK && !done; ++i) {
+			const int hart = first + i;
+			uint32_t s = riscv_batch_get_dmi_read_data(batch, keys[i]);
+			const unsigned int version = get_field32(s, DM_DMSTATUS_VERSION);
+			if ((version != 2 && version != 3) ||
+					!get_field32(s, DM_DMSTATUS_AUTHENTICATED)) {
+				/* Read it again the usual way, which reports the problem. */
+				result = dm013_select_hart(target, hart);
+				if (result == ERROR_OK)
+					result = dmstatus_read(target, &s, /*authenticated*/ true);
+				if (result != ERROR_OK)
+					break;
+			}
+
+			if (get_field(s, DM_DMSTATUS_ANYNONEXISTENT)) {
+				done = true;
+				break;
+			}
+
+			dm->hart_count = hart + 1;
+
+			if (get_field(s, DM_DMSTATUS_ANYHAVERESET)) {
+				/* If `abstractcs.busy` is set, debugger should not
+				 * change `hartsel`.
+				 */
+				result = wait_for_idle_if_needed(target);
+				if (result != ERROR_OK)
+					break;
+				uint32_t dmcontrol = DM_DMCONTROL_DMACTIVE | DM_DMCONTROL_ACKHAVERESET;
+				dmcontrol = set_dmcontrol_hartsel(dmcontrol, hart);
+				result = dm_write(target, DM_DMCONTROL, dmcontrol);
+				dm->current_hartid = result == ERROR_OK ? hart : HART_INDEX_UNKNOWN;
+			}
+		}
+		riscv_batch_free(batch);
+		if (result != ERROR_OK)
+			return result;
+	}
+
+	return ERROR_OK;
+}
+
 static int examine_dm(struct target *target)
 {
 	dm013_info_t *dm = get_dm(target);
@@ -1941,48 +2646,87 @@ static int examine_dm(struct target *target)
 	/* Before doing anything else we must first enumerate the harts. */
 	const int max_hart_count = MIN(RISCV_MAX_HARTS, hartsel + 1);
 	if (dm->hart_count < 0) {
-		for (int i = 0; i < max_hart_count; ++i) {
-			/* TODO: This is extremely similar to
-			 * riscv013_get_hart_state().
-			 * It would be best to reuse the code.
-			 */
-			result = dm013_select_hart(target, i);
-			if (result != ERROR_OK)
-				return result;
+		result = enumerate_harts(target, max_hart_count);
+		if (result != ERROR_OK)
+			return result;
+		LOG_TARGET_DEBUG(target, "Detected %d harts.", dm->hart_count);
+	}
 
-			uint32_t s;
-			result = dmstatus_read(target, &s, /*authenticated*/ true);
-			if (result != ERROR_OK)
-				return result;
+	if (dm->hart_count <= 0) {
+		LOG_TARGET_ERROR(target, "No harts found!");
+		return ERROR_FAIL;
+	}
 
-			if (get_field(s, DM_DMSTATUS_ANYNONEXISTENT))
-				break;
+	dm->was_examined = true;
+	return ERROR_OK;
+}
 
-			dm->hart_count = i + 1;
+/* Find XLEN and the registers that tell what the hart supports. */
+static int examine_registers(struct target *target)
+{
+	RISCV_INFO(r);
 
-			if (get_field(s, DM_DMSTATUS_ANYHAVERESET)) {
-				dmcontrol = DM_DMCONTROL_DMACTIVE | DM_DMCONTROL_ACKHAVERESET;
-				/* If `abstractcs.busy` is set, debugger should not
-				 * change `hartsel`.
-				 */
-				result = wait_for_idle_if_needed(target);
-				if (result != ERROR_OK)
-					return result;
-				dmcontrol = set_dmcontrol_hartsel(dmcontrol, i);
-				result = dm_write(target, DM_DMCONTROL, dmcontrol);
-				if (result != ERROR_OK)
-					return result;
-			}
+	int result = register_read_abstract_with_size(target, NULL, GDB_REGNO_S0, 64);
+	if (result == ERROR_OK)
+		r->xlen = 64;
+	else
+		r->xlen = 32;
+
+	/* Save s0 and s1. The register cache hasn't be initialized yet so we
+	 * need to take care of this manually. */
+	uint64_t s0, s1;
+	if (register_read_abstract(target, &s0, GDB_REGNO_S0) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Fatal: Failed to read s0.");
+		return ERROR_FAIL;
+	}
+	if (register_read_abstract(target, &s1, GDB_REGNO_S1) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Fatal: Failed to read s1.");
+		return ERROR_FAIL;
+	}
+
+	if (register_read_direct(target, &r->misa, GDB_REGNO_MISA)) {
+		LOG_TARGET_ERROR(target, "Fatal: Failed to read MISA.");
+		return ERROR_FAIL;
+	}
+
+	uint64_t value;
+	if (register_read_direct(target, &value, GDB_REGNO_VLENB) != ERROR_OK) {
+		if (riscv_supports_extension(target, 'V'))
+			LOG_TARGET_WARNING(target, "Couldn't read vlenb; vector register access won't work.");
+		r->vlenb = 0;
+	} else {
+		r->vlenb = value;
+		LOG_TARGET_INFO(target, "Vector support with vlenb=%d", r->vlenb);
+	}
+
+	if (register_read_direct(target, &value, GDB_REGNO_MTOPI) == ERROR_OK) {
+		r->mtopi_readable = true;
+
+		if (register_read_direct(target, &value, GDB_REGNO_MTOPEI) == ERROR_OK) {
+			LOG_TARGET_INFO(target, "S?aia detected with IMSIC");
+			r->mtopei_readable = true;
+		} else {
+			r->mtopei_readable = false;
+			LOG_TARGET_INFO(target, "S?aia detected without IMSIC");
 		}
-		LOG_TARGET_DEBUG(target, "Detected %d harts.", dm->hart_count);
+	} else {
+		r->mtopi_readable = false;
 	}
 
-	if (dm->hart_count <= 0) {
-		LOG_TARGET_ERROR(target, "No harts found!");
+	/* Display this as early as possible to help people who are using
+	 * really slow simulators. */
+	LOG_TARGET_DEBUG(target, " XLEN=%d, misa=0x%" PRIx64, r->xlen, r->misa);
+
+	/* Restore s0 and s1. */
+	if (register_write_direct(target, GDB_REGNO_S0, s0) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Fatal: Failed to write back s0.");
+		return ERROR_FAIL;
+	}
+	if (register_write_direct(target, GDB_REGNO_S1, s1) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Fatal: Failed to write back s1.");
 		return ERROR_FAIL;
 	}
 
-	dm->was_examined = true;
 	return ERROR_OK;
 }
 
@@ -1993,6 +2737,9 @@ static int examine(struct target *target)
 	target->state = TARGET_UNKNOWN;
 	target->debug_reason = DBG_REASON_UNDEFINED;
 
+	/* The DMI scan length and the system bus capabilities may change. */
+	sample_batch_free(target);
+
 	/* Don't need to select dbus, since the first thing we do is read dtmcontrol. */
 	LOG_TARGET_DEBUG(target, "dbgbase=0x%x", target->dbgbase);
 
@@ -2075,6 +2822,17 @@ static int examine(struct target *target)
 	RISCV_INFO(r);
 	r->impebreak = get_field(dmstatus, DM_DMSTATUS_IMPEBREAK);
 
+	r->examine_identity = (struct riscv_examine_identity) {
+		.idcode = target->tap->idcode,
+		.dtmcs = dtmcontrol,
+		.hartinfo = hartinfo,
+		.abstractcs = abstractcs,
+		.sbcs = info->sbcs,
+	};
+	r->examine_identity_valid = true;
+	const struct riscv_examine_snapshot *snapshot = riscv_examine_snapshot_match(target);
+	r->examine_snapshot_used = !!snapshot;
+
 	if (!has_sufficient_progbuf(target, 2)) {
 		LOG_TARGET_WARNING(target, "We won't be able to execute fence instructions on this "
 				"target. Memory may not always appear consistent. "
@@ -2112,64 +2870,14 @@ static int examine(struct target *target)
 	 * program buffer. */
 	r->progbuf_size = info->progbufsize;
 
-	result = register_read_abstract_with_size(target, NULL, GDB_REGNO_S0, 64);
-	if (result == ERROR_OK)
-		r->xlen = 64;
-	else
-		r->xlen = 32;
-
-	/* Save s0 and s1. The register cache hasn't be initialized yet so we
-	 * need to take care of this manually. */
-	uint64_t s0, s1;
-	if (register_read_abstract(target, &s0, GDB_REGNO_S0) != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Fatal: Failed to read s0.");
-		return ERROR_FAIL;
-	}
-	if (register_read_abstract(target, &s1, GDB_REGNO_S1) != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Fatal: Failed to read s1.");
-		return ERROR_FAIL;
-	}
-
-	if (register_read_direct(target, &r->misa, GDB_REGNO_MISA)) {
-		LOG_TARGET_ERROR(target, "Fatal: Failed to read MISA.");
-		return ERROR_FAIL;
-	}
-
-	uint64_t value;
-	if (register_read_direct(target, &value, GDB_REGNO_VLENB) != ERROR_OK) {
-		if (riscv_supports_extension(target, 'V'))
-			LOG_TARGET_WARNING(target, "Couldn't read vlenb; vector register access won't work.");
-		r->vlenb = 0;
-	} else {
-		r->vlenb = value;
-		LOG_TARGET_INFO(target, "Vector support with vlenb=%d", r->vlenb);
-	}
-
-	if (register_read_direct(target, &value, GDB_REGNO_MTOPI) == ERROR_OK) {
-		r->mtopi_readable = true;
-
-		if (register_read_direct(target, &value, GDB_REGNO_MTOPEI) == ERROR_OK) {
-			LOG_TARGET_INFO(target, "S?aia detected with IMSIC");
-			r->mtopei_readable = true;
-		} else {
-			r->mtopei_readable = false;
-			LOG_TARGET_INFO(target, "S?aia detected without IMSIC");
-		}
-	} else {
-		r->mtopi_readable = false;
-	}
-
-	/* Display this as early as possible to help people who are using
-	 * really slow simulators. */
-	LOG_TARGET_DEBUG(target, " XLEN=%d, misa=0x%" PRIx64, r->xlen, r->misa);
-
-	/* Restore s0 and s1. */
-	if (register_write_direct(target, GDB_REGNO_S0, s0) != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Fatal: Failed to write back s0.");
-		return ERROR_FAIL;
-	}
-	if (register_write_direct(target, GDB_REGNO_S1, s1) != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Fatal: Failed to write back s1.");
+	if (snapshot) {
+		r->xlen = snapshot->xlen;
+		r->misa = snapshot->misa;
+		r->vlenb = snapshot->vlenb;
+		r->mtopi_readable = snapshot->mtopi_readable;
+		r->mtopei_readable = snapshot->mtopei_readable;
+		LOG_TARGET_INFO(target, "Using the examine snapshot");
+	} else if (examine_registers(target) != ERROR_OK) {
 		return ERROR_FAIL;
 	}
 
@@ -2192,6 +2900,7 @@ static int examine(struct target *target)
 	if (target->smp) {
 		if (set_group(target, &info->haltgroup_supported, target->smp, HALT_GROUP) != ERROR_OK)
 			return ERROR_FAIL;
+		info->haltgroup = target->smp;
 		if (info->haltgroup_supported)
 			LOG_TARGET_INFO(target, "Core %d made part of halt group %d.", info->index,
 					target->smp);
@@ -2255,14 +2964,14 @@ static int riscv013_authdata_write(struct target *target, uint32_t value, unsign
 	return ERROR_OK;
 }
 
-/* Try to find out the widest memory access size depending on the selected memory access methods. */
-static unsigned riscv013_data_bits(struct target *target)
+/* Try to find out the widest memory access size depending on the given
+ * memory access methods. Returns 0 if none of them is usable. */
+static unsigned int widest_access_bits(struct target *target, const int *methods)
 {
 	RISCV013_INFO(info);
-	RISCV_INFO(r);
 
 	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
-		int method = r->mem_access_methods[i];
+		int method = methods[i];
 
 		if (method == RISCV_MEM_ACCESS_PROGBUF) {
 			if (has_sufficient_progbuf(target, 3))
@@ -2287,10 +2996,44 @@ static unsigned riscv013_data_bits(struct target *target)
 			/* No further mem access method to try. */
 			break;
 	}
+	return 0;
+}
+
+static unsigned int riscv013_data_bits(struct target *target)
+{
+	RISCV_INFO(r);
+	const unsigned int bits = widest_access_bits(target, r->mem_access_methods);
+	if (bits)
+		return bits;
 	LOG_TARGET_ERROR(target, "Unable to determine supported data bits on this target. Assuming 32 bits.");
 	return 32;
 }
 
+/* Like "riscv013_data_bits()", but for the methods used for the given range.
+ * The system bus only counts if it can reach all of it. */
+static unsigned int riscv013_bulk_access_size(struct target *target,
+		target_addr_t address, uint32_t count)
+{
+	RISCV013_INFO(info);
+	struct riscv_mem_access_region *region;
+	const int *methods = riscv_mem_access_methods(target, address, count, &region);
+
+	int usable[RISCV_NUM_MEM_ACCESS_METHODS];
+	unsigned int n = 0;
+	const unsigned int sbasize = get_field(info->sbcs, DM_SBCS_SBASIZE);
+	const target_addr_t last = address + count - 1;
+	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
+		if (methods[i] == RISCV_MEM_ACCESS_SYSBUS &&
+				sizeof(last) * 8 > sbasize && (last >> sbasize))
+			continue;
+		usable[n++] = methods[i];
+	}
+	while (n < RISCV_NUM_MEM_ACCESS_METHODS)
+		usable[n++] = RISCV_MEM_ACCESS_UNSPECIFIED;
+
+	return widest_access_bits(target, usable) / 8;
+}
+
 static COMMAND_HELPER(riscv013_print_info, struct target *target)
 {
 	RISCV013_INFO(info);
@@ -2354,29 +3097,61 @@ static int try_set_vsew(struct target *target, unsigned int *debug_vsew)
 	return ERROR_OK;
 }
 
+static bool is_vector_context_reg(enum gdb_regno regno)
+{
+	return regno == GDB_REGNO_VTYPE || regno == GDB_REGNO_VL ||
+		regno == GDB_REGNO_MSTATUS;
+}
+
+/* Write the original vtype, vl and mstatus back to the hart. */
+static int vector_context_restore(struct target *target)
+{
+	RISCV013_INFO(info);
+	if (!info->vector_context.active)
+		return ERROR_OK;
+	info->vector_context.active = false;
+
+	LOG_TARGET_DEBUG(target, "Restoring vtype, vl and mstatus.");
+	/* The cache holds the original values, which the hart doesn't have. */
+	riscv_reg_cache_invalidate(target, GDB_REGNO_VTYPE);
+	riscv_reg_cache_invalidate(target, GDB_REGNO_VL);
+	riscv_reg_cache_invalidate(target, GDB_REGNO_MSTATUS);
+
+	if (riscv_reg_write(target, GDB_REGNO_VTYPE, info->vector_context.vtype) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv_reg_write(target, GDB_REGNO_VL, info->vector_context.vl) != ERROR_OK)
+		return ERROR_FAIL;
+	return cleanup_after_register_access(target, info->vector_context.mstatus,
+			GDB_REGNO_VL);
+}
+
 static int prep_for_vector_access(struct target *target,
-		riscv_reg_t *orig_mstatus, riscv_reg_t *orig_vtype, riscv_reg_t *orig_vl,
 		unsigned int *debug_vl, unsigned int *debug_vsew)
 {
-	assert(orig_mstatus);
-	assert(orig_vtype);
-	assert(orig_vl);
 	assert(debug_vl);
 	assert(debug_vsew);
 
 	RISCV_INFO(r);
+	RISCV013_INFO(info);
 	if (target->state != TARGET_HALTED) {
 		LOG_TARGET_ERROR(target,
 				"Unable to access vector register: target not halted");
 		return ERROR_FAIL;
 	}
-	if (prep_for_register_access(target, orig_mstatus, GDB_REGNO_VL) != ERROR_OK)
+	if (info->vector_context.active) {
+		*debug_vl = info->vector_context.debug_vl;
+		*debug_vsew = info->vector_context.debug_vsew;
+		return ERROR_OK;
+	}
+
+	riscv_reg_t orig_mstatus, orig_vtype, orig_vl;
+	if (prep_for_register_access(target, &orig_mstatus, GDB_REGNO_VL) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Save vtype and vl. */
-	if (riscv_reg_get(target, orig_vtype, GDB_REGNO_VTYPE) != ERROR_OK)
+	if (riscv_reg_get(target, &orig_vtype, GDB_REGNO_VTYPE) != ERROR_OK)
 		return ERROR_FAIL;
-	if (riscv_reg_get(target, orig_vl, GDB_REGNO_VL) != ERROR_OK)
+	if (riscv_reg_get(target, &orig_vl, GDB_REGNO_VL) != ERROR_OK)
 		return ERROR_FAIL;
 
 	if (try_set_vsew(target, debug_vsew) != ERROR_OK)
@@ -2385,40 +3160,31 @@ static int prep_for_vector_access(struct target *target,
 	 * instruction, for the vslide1down instruction.
 	 * Set it so the entire V register is updated. */
 	*debug_vl = DIV_ROUND_UP(r->vlenb * 8, *debug_vsew);
-	return riscv_reg_write(target, GDB_REGNO_VL, *debug_vl);
-}
-
-static int cleanup_after_vector_access(struct target *target,
-		riscv_reg_t mstatus, riscv_reg_t vtype, riscv_reg_t vl)
-{
-	/* Restore vtype and vl. */
-	if (riscv_reg_write(target, GDB_REGNO_VTYPE, vtype) != ERROR_OK)
+	if (riscv_reg_write(target, GDB_REGNO_VL, *debug_vl) != ERROR_OK)
 		return ERROR_FAIL;
-	if (riscv_reg_write(target, GDB_REGNO_VL, vl) != ERROR_OK)
-		return ERROR_FAIL;
-	return cleanup_after_register_access(target, mstatus, GDB_REGNO_VL);
-}
-
-int riscv013_get_register_buf(struct target *target, uint8_t *value,
-		enum gdb_regno regno)
-{
-	assert(regno >= GDB_REGNO_V0 && regno <= GDB_REGNO_V31);
-
-	if (dm013_select_target(target) != ERROR_OK)
-		return ERROR_FAIL;
-
-	riscv_reg_t mstatus, vtype, vl;
-	unsigned int debug_vl, debug_vsew;
 
-	if (prep_for_vector_access(target, &mstatus, &vtype, &vl,
-				&debug_vl, &debug_vsew) != ERROR_OK)
-		return ERROR_FAIL;
-
-	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
-		return ERROR_FAIL;
+	info->vector_context.active = true;
+	info->vector_context.mstatus = orig_mstatus;
+	info->vector_context.vtype = orig_vtype;
+	info->vector_context.vl = orig_vl;
+	info->vector_context.debug_vl = *debug_vl;
+	info->vector_context.debug_vsew = *debug_vsew;
 
-	unsigned int vnum = regno - GDB_REGNO_V0;
+	/* Whoever looks at these registers until the context is restored must
+	 * see the original values. */
+	const enum gdb_regno regnos[] = { GDB_REGNO_VTYPE, GDB_REGNO_VL, GDB_REGNO_MSTATUS };
+	const riscv_reg_t values[] = { orig_vtype, orig_vl, orig_mstatus };
+	for (unsigned int i = 0; i < ARRAY_SIZE(regnos); ++i) {
+		if (riscv_reg_cache_needs_read(target, regnos[i]))
+			riscv_reg_cache_fill(target, regnos[i], values[i]);
+	}
+	return ERROR_OK;
+}
 
+static int vreg_read_progbuf(struct target *target, unsigned int vnum,
+		unsigned int debug_vl, unsigned int debug_vsew, uint8_t *value)
+{
+	const enum gdb_regno regno = GDB_REGNO_V0 + vnum;
 	int result = ERROR_OK;
 	for (unsigned int i = 0; i < debug_vl; i++) {
 		/* Can't reuse the same program because riscv_program_exec() adds
@@ -2448,12 +3214,207 @@ int riscv013_get_register_buf(struct target *target, uint8_t *value,
 		}
 	}
 
-	if (cleanup_after_vector_access(target, mstatus, vtype, vl) != ERROR_OK)
+	return result;
+}
+
+/**
+ * Stream "count" values out of the hart in a single batch. Every execution of
+ * "program" (already written to the program buffer) must leave the next value
+ * in s0, which the caller has saved.
+ *
+ * An access register command reads s0 into data0 and then executes the program
+ * (postexec). With abstractauto.autoexecdata[0] set, every read of data0
+ * repeats the command, so the values stream out of data0. The last value is
+ * fetched by a transfer-only command, so the program is executed exactly
+ * "count" times.
+ *
+ * Data reads are, in order: the stale s0, value 0, ..., value count-1. Each
+ * value is stored as "element_bits" bits of "buffer".
+ */
+static int progbuf_stream_read(struct target *target, unsigned int count,
+		unsigned int element_bits, uint8_t *buffer)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	const unsigned int words = xlen / 32;
+	struct riscv_batch *batch = riscv_batch_alloc(target,
+			4 + (count + 1) * words + 1 + 1);
+	if (!batch)
+		return ERROR_FAIL;
+
+	riscv_batch_add_dm_write(batch, DM_COMMAND,
+			access_register_command(target, GDB_REGNO_S0, xlen,
+				AC_ACCESS_REGISTER_TRANSFER | AC_ACCESS_REGISTER_POSTEXEC),
+			/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+	riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+			set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1), /* read_back */ true,
+			RISCV_DELAY_BASE);
+	for (unsigned int i = 0; i <= count; ++i) {
+		if (i + 1 == count)
+			riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+					/* read_back */ true, RISCV_DELAY_BASE);
+		if (i == count)
+			riscv_batch_add_dm_write(batch, DM_COMMAND,
+					access_register_command(target, GDB_REGNO_S0, xlen,
+						AC_ACCESS_REGISTER_TRANSFER),
+					/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+		/* Read the upper half first: accessing data0 repeats the command. */
+		if (words > 1)
+			riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+		riscv_batch_add_dm_read(batch, DM_DATA0, i + 1 < count ?
+				RISCV_DELAY_ABSTRACT_COMMAND : RISCV_DELAY_BASE);
+	}
+	const size_t abstractcs_read_key = riscv_batch_add_dm_read(batch,
+			DM_ABSTRACTCS, RISCV_DELAY_BASE);
+	riscv_batch_add_nop(batch);
+
+	get_dm(target)->abstract_cmd_maybe_busy = true;
+	int result = batch_run_timeout(target, batch);
+	if (result != ERROR_OK) {
+		dm_write(target, DM_ABSTRACTAUTO, 0);
+		goto cleanup;
+	}
+
+	uint32_t cmderr;
+	result = abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+			abstractcs_read_key, &cmderr);
+	if (result != ERROR_OK) {
+		LOG_TARGET_DEBUG(target, "Program buffer stream failed (cmderr=%" PRIu32 ").",
+				cmderr);
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		/* Skip the stale s0 value. */
+		const size_t key = (i + 1) * words;
+		riscv_reg_t v = 0;
+		for (unsigned int w = 0; w < words; ++w)
+			v = (v << 32) | riscv_batch_get_dmi_read_data(batch, key + w);
+		buf_set_u64(buffer, element_bits * i, element_bits, v);
+	}
+
+cleanup:
+	riscv_batch_free(batch);
+	return result;
+}
+
+/**
+ * Read vector register "vnum" in a single batch, running
+ * "vmv.x.s s0, vN; vslide1down.vx vN, vN, s0" once per element. After
+ * "debug_vl" slides the register ends up rotated back to its original value.
+ */
+static int vreg_read_batched(struct target *target, unsigned int vnum,
+		unsigned int debug_vl, unsigned int debug_vsew, uint8_t *value)
+{
+	struct riscv_program program;
+	riscv_program_init(&program, target);
+	if (riscv_program_insert(&program, vmv_x_s(S0, vnum)) != ERROR_OK ||
+			riscv_program_insert(&program, vslide1down_vx(vnum, vnum, S0, true)) != ERROR_OK ||
+			riscv_program_ebreak(&program) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv_program_write(&program) != ERROR_OK)
+		return ERROR_FAIL;
+
+	int result = progbuf_stream_read(target, debug_vl, debug_vsew, value);
+	if (result != ERROR_OK)
+		LOG_TARGET_ERROR(target, "Failed to execute vmv/vslide1down while reading v%u",
+				vnum);
+	return result;
+}
+
+/**
+ * Read "count" XLEN-bit values produced by running the user-supplied
+ * "insns" once per value (see "riscv define_matrix_tile").
+ */
+static int riscv013_read_progbuf_stream(struct target *target,
+		const uint32_t *insns, unsigned int insn_count, unsigned int count,
+		uint8_t *buffer)
+{
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "Not halted.");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv_reg_flush_all(target) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
+		return ERROR_FAIL;
+
+	struct riscv_program program;
+	riscv_program_init(&program, target);
+	for (unsigned int i = 0; i < insn_count; ++i) {
+		if (riscv_program_insert(&program, insns[i]) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+	if (riscv_program_ebreak(&program) != ERROR_OK)
+		return ERROR_FAIL;
+	if (riscv_program_write(&program) != ERROR_OK)
 		return ERROR_FAIL;
 
+	/* Split the stream into batches of a reasonable size. Every batch starts
+	 * by reading the last value of the previous one (which is discarded), so
+	 * the stream simply continues. */
+	const unsigned int xlen = riscv_xlen(target);
+	const unsigned int words = xlen / 32;
+	const unsigned int batch_size = riscv_get_batch_size(target);
+	const unsigned int per_batch = batch_size > 6 + 2 * words ?
+		(batch_size - 6) / words - 1 : 1;
+	int result = ERROR_OK;
+	for (unsigned int done = 0; done < count && result == ERROR_OK; ) {
+		const unsigned int n = MIN(per_batch, count - done);
+		result = progbuf_stream_read(target, n, xlen, buffer + done * (xlen / 8));
+		done += n;
+	}
+	if (result != ERROR_OK)
+		LOG_TARGET_ERROR(target, "Failed to stream values out of the program buffer.");
 	return result;
 }
 
+/**
+ * Read "count" vector registers starting at "first" into "values" (vlenb
+ * bytes each), setting vtype/vl up only once for all of them.
+ */
+int riscv013_get_vector_registers(struct target *target, enum gdb_regno first,
+		unsigned int count, uint8_t *values)
+{
+	RISCV_INFO(r);
+	RISCV013_INFO(info);
+	assert(first >= GDB_REGNO_V0 && first + count - 1 <= GDB_REGNO_V31);
+
+	if (dm013_select_target(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	unsigned int debug_vl, debug_vsew;
+
+	if (prep_for_vector_access(target, &debug_vl, &debug_vsew) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* Two instructions plus ebreak. */
+	const bool batched = info->progbufsize + r->impebreak >= 3;
+	int result = ERROR_OK;
+	for (unsigned int n = 0; n < count && result == ERROR_OK; ++n) {
+		uint8_t *value = values + n * r->vlenb;
+		unsigned int vnum = first + n - GDB_REGNO_V0;
+		if (batched)
+			result = vreg_read_batched(target, vnum, debug_vl, debug_vsew, value);
+		else
+			result = vreg_read_progbuf(target, vnum, debug_vl, debug_vsew, value);
+	}
+
+	/* vtype/vl are restored before the hart resumes. */
+	return result;
+}
+
+int riscv013_get_register_buf(struct target *target, uint8_t *value,
+		enum gdb_regno regno)
+{
+	assert(regno >= GDB_REGNO_V0 && regno <= GDB_REGNO_V31);
+	return riscv013_get_vector_registers(target, regno, 1, value);
+}
+
 int riscv013_set_register_buf(struct target *target, enum gdb_regno regno,
 		const uint8_t *value)
 {
@@ -2462,11 +3423,9 @@ int riscv013_set_register_buf(struct target *target, enum gdb_regno regno,
 	if (dm013_select_target(target) != ERROR_OK)
 		return ERROR_FAIL;
 
-	riscv_reg_t mstatus, vtype, vl;
 	unsigned int debug_vl, debug_vsew;
 
-	if (prep_for_vector_access(target, &mstatus, &vtype, &vl,
-				&debug_vl, &debug_vsew) != ERROR_OK)
+	if (prep_for_vector_access(target, &debug_vl, &debug_vsew) != ERROR_OK)
 		return ERROR_FAIL;
 
 	if (riscv013_reg_save(target, GDB_REGNO_S0) != ERROR_OK)
@@ -2487,9 +3446,7 @@ int riscv013_set_register_buf(struct target *target, enum gdb_regno regno,
 			break;
 	}
 
-	if (cleanup_after_vector_access(target, mstatus, vtype, vl) != ERROR_OK)
-		return ERROR_FAIL;
-
+	/* vtype/vl are restored before the hart resumes. */
 	return result;
 }
 
@@ -2549,12 +3506,12 @@ static int sb_write_address(struct target *target, target_addr_t address,
 	return res;
 }
 
-static int batch_run(struct target *target, struct riscv_batch *batch)
+/* Same as batch_run(), for a batch that already ends with a NOP. */
+static int batch_run_scans(struct target *target, struct riscv_batch *batch)
 {
 	RISCV_INFO(r);
 	RISCV013_INFO(info);
 	select_dmi(target);
-	riscv_batch_add_nop(batch);
 	const int result = riscv_batch_run_from(batch, 0, &info->learned_delays,
 			/*resets_delays*/  r->reset_delays_wait >= 0,
 			r->reset_delays_wait);
@@ -2567,9 +3524,27 @@ static int batch_run(struct target *target, struct riscv_batch *batch)
 	decrement_reset_delays_counter(target, finished_scans);
 	if (riscv_batch_was_batch_busy(batch))
 		return increase_dmi_busy_delay(target);
+	riscv_batch_decay_delays(batch, 0, &info->learned_delays);
 	return ERROR_OK;
 }
 
+static int batch_run(struct target *target, struct riscv_batch *batch)
+{
+	riscv_batch_add_nop(batch);
+	return batch_run_scans(target, batch);
+}
+
+/* Same as batch_run(), but the run is accounted by the batch sizer. To be used
+ * for batches allocated with "riscv_get_batch_size()" scans. */
+static int block_access_batch_run(struct target *target, struct riscv_batch *batch)
+{
+	const int result = batch_run(target, batch);
+	if (result == ERROR_OK)
+		riscv_batch_size_account(target, batch->used_scans,
+				batch->last_run_flushes, batch->last_run_us);
+	return result;
+}
+
 /* It is expected that during creation of the batch
  * "riscv_batch_add_dm_write(..., false)" was not used.
  */
@@ -2595,11 +3570,13 @@ static int batch_run_timeout(struct target *target, struct riscv_batch *batch)
 		const size_t new_finished_scans = riscv_batch_finished_scans(batch);
 		assert(new_finished_scans >= finished_scans);
 		decrement_reset_delays_counter(target, new_finished_scans - finished_scans);
-		finished_scans = new_finished_scans;
 		if (!riscv_batch_was_batch_busy(batch)) {
-			assert(finished_scans == batch->used_scans);
+			assert(new_finished_scans == batch->used_scans);
+			riscv_batch_decay_delays(batch, finished_scans,
+					&info->learned_delays);
 			return ERROR_OK;
 		}
+		finished_scans = new_finished_scans;
 		result = increase_dmi_busy_delay(target);
 		if (result != ERROR_OK)
 			return result;
@@ -2641,23 +3618,43 @@ static int sba_supports_access(struct target *target, unsigned int size_bytes)
 	}
 }
 
-static int sample_memory_bus_v1(struct target *target,
-								struct riscv_sample_buf *buf,
-								const riscv_sample_config_t *config,
-								int64_t until_ms)
+static void sample_batch_free(struct target *target)
+{
+	RISCV013_INFO(info);
+	if (info->sample.batch)
+		riscv_batch_free(info->sample.batch);
+	info->sample.batch = NULL;
+}
+
+/* Build the batch that samples every enabled bucket a few times in a row. The
+ * batch sets up sbcs and sbaddress itself, so it can be run over and over
+ * without knowing what happened on the bus in between. */
+static int sample_batch_build(struct target *target,
+		const riscv_sample_config_t *config)
 {
 	RISCV013_INFO(info);
 	unsigned int sbasize = get_field(info->sbcs, DM_SBCS_SBASIZE);
-	if (sbasize > 64) {
-		LOG_TARGET_ERROR(target, "Memory sampling is only implemented for sbasize <= 64.");
-		return ERROR_NOT_IMPLEMENTED;
-	}
 
-	if (get_field(info->sbcs, DM_SBCS_SBVERSION) != 1) {
-		LOG_TARGET_ERROR(target, "Memory sampling is only implemented for SBA version 1.");
-		return ERROR_NOT_IMPLEMENTED;
+	/* How often to read each value in a batch. */
+	const unsigned int repeat = 5;
+
+	unsigned int enabled_count = 0;
+	for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
+		if (config->bucket[i].enabled) {
+			if (!sba_supports_access(target, config->bucket[i].size_bytes)) {
+				LOG_TARGET_ERROR(target, "Hardware does not support SBA access for %d-byte memory sampling.",
+						config->bucket[i].size_bytes);
+				return ERROR_NOT_IMPLEMENTED;
+			}
+			enabled_count++;
+		}
 	}
 
+	struct riscv_batch *batch = riscv_batch_alloc(
+		target, 2 + enabled_count * 5 * repeat);
+	if (!batch)
+		return ERROR_FAIL;
+
 	uint32_t sbcs = 0;
 	uint32_t sbcs_valid = false;
 
@@ -2666,86 +3663,93 @@ static int sample_memory_bus_v1(struct target *target,
 	uint32_t sbaddress1 = 0;
 	bool sbaddress1_valid = false;
 
-	/* How often to read each value in a batch. */
-	const unsigned int repeat = 5;
-
-	unsigned int enabled_count = 0;
-	for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
-		if (config->bucket[i].enabled)
-			enabled_count++;
-	}
-
-	while (timeval_ms() < until_ms) {
-		/*
-		 * batch_run() adds to the batch, so we can't simply reuse the same
-		 * batch over and over. So we create a new one every time through the
-		 * loop.
-		 */
-		struct riscv_batch *batch = riscv_batch_alloc(
-			target, 1 + enabled_count * 5 * repeat);
-		if (!batch)
-			return ERROR_FAIL;
+	unsigned int result_bytes = 0;
+	for (unsigned int n = 0; n < repeat; n++) {
+		for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
+			if (config->bucket[i].enabled) {
+				uint32_t sbcs_write = DM_SBCS_SBREADONADDR;
+				if (enabled_count == 1)
+					sbcs_write |= DM_SBCS_SBREADONDATA;
+				sbcs_write |= sb_sbaccess(config->bucket[i].size_bytes);
+				if (!sbcs_valid || sbcs_write != sbcs) {
+					riscv_batch_add_dm_write(batch, DM_SBCS, sbcs_write,
+							true, RISCV_DELAY_BASE);
+					sbcs = sbcs_write;
+					sbcs_valid = true;
+				}
 
-		unsigned int result_bytes = 0;
-		for (unsigned int n = 0; n < repeat; n++) {
-			for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
-				if (config->bucket[i].enabled) {
-					if (!sba_supports_access(target, config->bucket[i].size_bytes)) {
-						LOG_TARGET_ERROR(target, "Hardware does not support SBA access for %d-byte memory sampling.",
-								config->bucket[i].size_bytes);
-						return ERROR_NOT_IMPLEMENTED;
-					}
-
-					uint32_t sbcs_write = DM_SBCS_SBREADONADDR;
-					if (enabled_count == 1)
-						sbcs_write |= DM_SBCS_SBREADONDATA;
-					sbcs_write |= sb_sbaccess(config->bucket[i].size_bytes);
-					if (!sbcs_valid || sbcs_write != sbcs) {
-						riscv_batch_add_dm_write(batch, DM_SBCS, sbcs_write,
-								true, RISCV_DELAY_BASE);
-						sbcs = sbcs_write;
-						sbcs_valid = true;
-					}
-
-					if (sbasize > 32 &&
-							(!sbaddress1_valid ||
-							sbaddress1 != config->bucket[i].address >> 32)) {
-						sbaddress1 = config->bucket[i].address >> 32;
-						riscv_batch_add_dm_write(batch, DM_SBADDRESS1,
-								sbaddress1, true, RISCV_DELAY_BASE);
-						sbaddress1_valid = true;
-					}
-					if (!sbaddress0_valid ||
-							sbaddress0 != (config->bucket[i].address & 0xffffffff)) {
-						sbaddress0 = config->bucket[i].address;
-						riscv_batch_add_dm_write(batch, DM_SBADDRESS0,
-								sbaddress0, true,
-								RISCV_DELAY_SYSBUS_READ);
-						sbaddress0_valid = true;
-					}
-					if (config->bucket[i].size_bytes > 4)
-						riscv_batch_add_dm_read(batch, DM_SBDATA1,
-								RISCV_DELAY_SYSBUS_READ);
-					riscv_batch_add_dm_read(batch, DM_SBDATA0,
+				if (sbasize > 32 &&
+						(!sbaddress1_valid ||
+						sbaddress1 != config->bucket[i].address >> 32)) {
+					sbaddress1 = config->bucket[i].address >> 32;
+					riscv_batch_add_dm_write(batch, DM_SBADDRESS1,
+							sbaddress1, true, RISCV_DELAY_BASE);
+					sbaddress1_valid = true;
+				}
+				if (!sbaddress0_valid ||
+						sbaddress0 != (config->bucket[i].address & 0xffffffff)) {
+					sbaddress0 = config->bucket[i].address;
+					riscv_batch_add_dm_write(batch, DM_SBADDRESS0,
+							sbaddress0, true,
 							RISCV_DELAY_SYSBUS_READ);
-					result_bytes += 1 + config->bucket[i].size_bytes;
+					sbaddress0_valid = true;
 				}
+				if (config->bucket[i].size_bytes > 4)
+					riscv_batch_add_dm_read(batch, DM_SBDATA1,
+							RISCV_DELAY_SYSBUS_READ);
+				riscv_batch_add_dm_read(batch, DM_SBDATA0,
+						RISCV_DELAY_SYSBUS_READ);
+				result_bytes += 1 + config->bucket[i].size_bytes;
 			}
 		}
+	}
 
-		if (buf->used + result_bytes >= buf->size) {
-			riscv_batch_free(batch);
-			break;
-		}
+	info->sample.sbcs_read_index = riscv_batch_add_dm_read(batch, DM_SBCS,
+			RISCV_DELAY_BASE);
+	riscv_batch_add_nop(batch);
 
-		size_t sbcs_read_index = riscv_batch_add_dm_read(batch, DM_SBCS,
-				RISCV_DELAY_BASE);
+	info->sample.batch = batch;
+	info->sample.generation = config->generation;
+	info->sample.repeat = repeat;
+	info->sample.result_bytes = result_bytes;
+	return ERROR_OK;
+}
 
-		int result = batch_run(target, batch);
-		if (result != ERROR_OK) {
-			riscv_batch_free(batch);
+static int sample_memory_bus_v1(struct target *target,
+								struct riscv_sample_buf *buf,
+								const riscv_sample_config_t *config,
+								int64_t until_ms)
+{
+	RISCV013_INFO(info);
+	unsigned int sbasize = get_field(info->sbcs, DM_SBCS_SBASIZE);
+	if (sbasize > 64) {
+		LOG_TARGET_ERROR(target, "Memory sampling is only implemented for sbasize <= 64.");
+		return ERROR_NOT_IMPLEMENTED;
+	}
+
+	if (get_field(info->sbcs, DM_SBCS_SBVERSION) != 1) {
+		LOG_TARGET_ERROR(target, "Memory sampling is only implemented for SBA version 1.");
+		return ERROR_NOT_IMPLEMENTED;
+	}
+
+	if (info->sample.batch && info->sample.generation != config->generation)
+		sample_batch_free(target);
+	if (!info->sample.batch) {
+		int result = sample_batch_build(target, config);
+		if (result != ERROR_OK)
+			return result;
+	}
+	struct riscv_batch *batch = info->sample.batch;
+	const size_t sbcs_read_index = info->sample.sbcs_read_index;
+
+	while (timeval_ms() < until_ms) {
+		if (buf->used + info->sample.result_bytes >= buf->size)
+			break;
+
+		riscv_batch_rewind(batch);
+		int result = batch_run_scans(target, batch);
+		if (result != ERROR_OK)
 			return result;
-		}
 
 		/* Discard the batch when we encounter a busy state on the DMI level.
 		 * It's too much hassle to try to recover partial data. We'll try again
@@ -2753,10 +3757,8 @@ static int sample_memory_bus_v1(struct target *target,
 		unsigned int sbcs_read_op = riscv_batch_get_dmi_read_op(batch, sbcs_read_index);
 		if (sbcs_read_op == DTM_DMI_OP_BUSY) {
 			result = increase_dmi_busy_delay(target);
-			if (result != ERROR_OK) {
-				riscv_batch_free(batch);
+			if (result != ERROR_OK)
 				return result;
-			}
 			continue;
 		}
 
@@ -2767,7 +3769,6 @@ static int sample_memory_bus_v1(struct target *target,
 			dm_write(target, DM_SBCS, sbcs_read | DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR);
 			int res = riscv_scan_increase_delay(&info->learned_delays,
 					RISCV_DELAY_SYSBUS_READ);
-			riscv_batch_free(batch);
 			if (res != ERROR_OK)
 				return res;
 			continue;
@@ -2775,12 +3776,11 @@ static int sample_memory_bus_v1(struct target *target,
 		if (get_field(sbcs_read, DM_SBCS_SBERROR)) {
 			/* The memory we're sampling was unreadable, somehow. Give up. */
 			dm_write(target, DM_SBCS, DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR);
-			riscv_batch_free(batch);
 			return ERROR_FAIL;
 		}
 
 		unsigned int read_count = 0;
-		for (unsigned int n = 0; n < repeat; n++) {
+		for (unsigned int n = 0; n < info->sample.repeat; n++) {
 			for (unsigned int i = 0; i < ARRAY_SIZE(config->bucket); i++) {
 				if (config->bucket[i].enabled) {
 					assert(i < RISCV_SAMPLE_BUF_TIMESTAMP_BEFORE);
@@ -2795,8 +3795,6 @@ static int sample_memory_bus_v1(struct target *target,
 				}
 			}
 		}
-
-		riscv_batch_free(batch);
 	}
 
 	return ERROR_OK;
@@ -2860,8 +3858,237 @@ static int riscv013_get_hart_state(struct target *target, enum riscv_hart_state
 		*state = RISCV_STATE_RUNNING;
 		return ERROR_OK;
 	}
-	LOG_TARGET_ERROR(target, "Couldn't determine state. dmstatus=0x%x", dmstatus);
-	return ERROR_FAIL;
+	LOG_TARGET_ERROR(target, "Couldn't determine state. dmstatus=0x%x", dmstatus);
+	return ERROR_FAIL;
+}
+
+/**
+ * Get the state of all the harts of "dm" from "targets", without reading
+ * dmstatus of each of them: select them all with the hart array mask and
+ * read the summary in dmstatus. If some are halted, haltsum1 gives the
+ * groups of 32 harts that have halted ones and haltsum0 of those groups
+ * which ones. That's a few DMI accesses however many harts there are.
+ *
+ * Only used if every hart of "dm" is in "targets", as hart 0 is always in
+ * the hart array (see set_dmcontrol_hartsel()). If a hart was reset or is
+ * unavailable, nothing is set, the harts are then polled one by one.
+ */
+static int get_hart_state_summary(struct target **targets, unsigned int target_count,
+		dm013_info_t *dm, enum riscv_hart_state *states, bool *valid, bool *done)
+{
+	if (!dm->hasel_supported || dm->hart_count < 2 || dm->hart_count > 1024)
+		return ERROR_OK;
+
+	uint32_t hawindow[32] = { 0 };
+	const unsigned int hawindow_count = DIV_ROUND_UP(dm->hart_count, 32);
+	unsigned int group_count = 0;
+	bool have_hart0 = false;
+	target_list_t *entry;
+	list_for_each_entry(entry, &dm->target_list, list) {
+		unsigned int j = 0;
+		while (j < target_count && (targets[j] != entry->target || done[j]))
+			++j;
+		if (j == target_count)
+			return ERROR_OK;
+		const int index = get_info(entry->target)->index;
+		if (index < 0 || index >= dm->hart_count)
+			return ERROR_OK;
+		hawindow[index / 32] |= 1u << (index % 32);
+		have_hart0 |= index == 0;
+		++group_count;
+	}
+	if (!have_hart0 || group_count < 2)
+		return ERROR_OK;
+
+	struct target *target = targets[0];
+	struct riscv_batch *batch = riscv_batch_alloc(target, 2 * hawindow_count + 4);
+	if (!batch)
+		return ERROR_FAIL;
+	riscv_batch_add_dm_write(batch, DM_DMCONTROL,
+			set_dmcontrol_hartsel(DM_DMCONTROL_DMACTIVE, HART_INDEX_MULTIPLE),
+			/* read_back */ true, RISCV_DELAY_BASE);
+	for (unsigned int i = 0; i < hawindow_count; ++i) {
+		riscv_batch_add_dm_write(batch, DM_HAWINDOWSEL, i, /* read_back */ false,
+				RISCV_DELAY_BASE);
+		riscv_batch_add_dm_write(batch, DM_HAWINDOW, hawindow[i], /* read_back */ false,
+				RISCV_DELAY_BASE);
+	}
+	const size_t dmstatus_key = riscv_batch_add_dm_read(batch, DM_DMSTATUS, RISCV_DELAY_BASE);
+	const size_t haltsum1_key = hawindow_count > 1 ?
+		riscv_batch_add_dm_read(batch, DM_HALTSUM1, RISCV_DELAY_BASE) : 0;
+	riscv_batch_add_nop(batch);
+
+	int result = batch_run_timeout(target, batch);
+	dm->current_hartid = result == ERROR_OK ? HART_INDEX_MULTIPLE : HART_INDEX_UNKNOWN;
+	if (result != ERROR_OK) {
+		riscv_batch_free(batch);
+		return result;
+	}
+	const uint32_t dmstatus = riscv_batch_get_dmi_read_data(batch, dmstatus_key);
+	const uint32_t haltsum1 = hawindow_count > 1 ?
+		riscv_batch_get_dmi_read_data(batch, haltsum1_key) : 1;
+	riscv_batch_free(batch);
+
+	const unsigned int version = get_field32(dmstatus, DM_DMSTATUS_VERSION);
+	if ((version != 2 && version != 3) ||
+			!get_field32(dmstatus, DM_DMSTATUS_AUTHENTICATED) ||
+			get_field32(dmstatus, DM_DMSTATUS_ANYHAVERESET) ||
+			get_field32(dmstatus, DM_DMSTATUS_ANYUNAVAIL) ||
+			get_field32(dmstatus, DM_DMSTATUS_ANYNONEXISTENT))
+		return ERROR_OK;
+
+	/* Every hart is running or halted now, find the halted ones */
+	uint32_t haltsum0[32] = { 0 };
+	if (!get_field32(dmstatus, DM_DMSTATUS_ALLRUNNING)) {
+		unsigned int window_count = 0;
+		for (unsigned int i = 0; i < hawindow_count; ++i)
+			window_count += hawindow[i] && (haltsum1 & (1u << i));
+
+		batch = riscv_batch_alloc(target, 2 * window_count + 1);
+		if (!batch)
+			return ERROR_FAIL;
+		size_t keys[32];
+		int last = HART_INDEX_UNKNOWN;
+		for (unsigned int i = 0; i < hawindow_count; ++i) {
+			if (!hawindow[i] || !(haltsum1 & (1u << i)))
+				continue;
+			last = i * 32;
+			riscv_batch_add_dm_write(batch, DM_DMCONTROL,
+					set_dmcontrol_hartsel(DM_DMCONTROL_DMACTIVE, last),
+					/* read_back */ true, RISCV_DELAY_BASE);
+			keys[i] = riscv_batch_add_dm_read(batch, DM_HALTSUM0, RISCV_DELAY_BASE);
+		}
+		riscv_batch_add_nop(batch);
+
+		result = batch_run_timeout(target, batch);
+		dm->current_hartid = result == ERROR_OK ? last : HART_INDEX_UNKNOWN;
+		if (result != ERROR_OK) {
+			riscv_batch_free(batch);
+			return result;
+		}
+		for (unsigned int i = 0; i < hawindow_count; ++i) {
+			if (hawindow[i] && (haltsum1 & (1u << i)))
+				haltsum0[i] = riscv_batch_get_dmi_read_data(batch, keys[i]);
+		}
+		riscv_batch_free(batch);
+	}
+
+	for (unsigned int j = 0; j < target_count; ++j) {
+		if (done[j] || get_info(targets[j])->dm != dm)
+			continue;
+		const int index = get_info(targets[j])->index;
+		done[j] = true;
+		valid[j] = true;
+		states[j] = haltsum0[index / 32] & (1u << (index % 32)) ?
+			RISCV_STATE_HALTED : RISCV_STATE_RUNNING;
+	}
+	return ERROR_OK;
+}
+
+/**
+ * Read dmstatus of all the harts in "targets" with a single batch per Debug
+ * Module: for every hart, select it and read dmstatus. Harts that reported
+ * a reset or an inconclusive dmstatus are left invalid, their state is then
+ * obtained the usual way, which also acknowledges the reset.
+ */
+static int get_hart_state_group(struct target **targets, unsigned int target_count,
+		enum riscv_hart_state *states, bool *valid)
+{
+	bool *done = calloc(target_count, sizeof(*done));
+	size_t *keys = calloc(target_count, sizeof(*keys));
+	int result = ERROR_OK;
+	if (!done || !keys) {
+		LOG_ERROR("Out of memory");
+		result = ERROR_FAIL;
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < target_count; ++i)
+		valid[i] = false;
+
+	for (unsigned int i = 0; i < target_count; ++i) {
+		if (done[i])
+			continue;
+		dm013_info_t * const dm = get_dm(targets[i]);
+		if (!dm) {
+			result = ERROR_FAIL;
+			goto cleanup;
+		}
+
+		result = wait_for_idle_if_needed(targets[i]);
+		if (result != ERROR_OK)
+			goto cleanup;
+
+		result = get_hart_state_summary(targets, target_count, dm, states, valid, done);
+		if (result != ERROR_OK)
+			goto cleanup;
+		if (done[i])
+			continue;
+
+		unsigned int group_count = 0;
+		for (unsigned int j = i; j < target_count; ++j) {
+			if (!done[j] && get_info(targets[j])->dm == dm)
+				++group_count;
+		}
+		struct riscv_batch *batch = riscv_batch_alloc(targets[i], 2 * group_count + 1);
+		if (!batch) {
+			result = ERROR_FAIL;
+			goto cleanup;
+		}
+
+		unsigned int last = i;
+		for (unsigned int j = i; j < target_count; ++j) {
+			if (done[j] || get_info(targets[j])->dm != dm)
+				continue;
+			uint32_t dmcontrol = set_dmcontrol_hartsel(DM_DMCONTROL_DMACTIVE,
+					get_info(targets[j])->index);
+			riscv_batch_add_dm_write(batch, DM_DMCONTROL, dmcontrol,
+					/* read_back */ true, RISCV_DELAY_BASE);
+			keys[j] = riscv_batch_add_dm_read(batch, DM_DMSTATUS, RISCV_DELAY_BASE);
+			last = j;
+		}
+		riscv_batch_add_nop(batch);
+
+		result = batch_run_timeout(targets[i], batch);
+		/* The last hart in the batch is the one that remains selected. */
+		dm->current_hartid = result == ERROR_OK ?
+			(int)get_info(targets[last])->index : HART_INDEX_UNKNOWN;
+		if (result != ERROR_OK) {
+			riscv_batch_free(batch);
+			goto cleanup;
+		}
+
+		for (unsigned int j = i; j < target_count; ++j) {
+			if (done[j] || get_info(targets[j])->dm != dm)
+				continue;
+			done[j] = true;
+
+			const uint32_t dmstatus = riscv_batch_get_dmi_read_data(batch, keys[j]);
+			const unsigned int version = get_field32(dmstatus, DM_DMSTATUS_VERSION);
+			if ((version != 2 && version != 3) ||
+					!get_field32(dmstatus, DM_DMSTATUS_AUTHENTICATED) ||
+					get_field32(dmstatus, DM_DMSTATUS_ANYHAVERESET))
+				continue;
+
+			valid[j] = true;
+			if (get_field32(dmstatus, DM_DMSTATUS_ALLNONEXISTENT))
+				states[j] = RISCV_STATE_NON_EXISTENT;
+			else if (get_field32(dmstatus, DM_DMSTATUS_ALLUNAVAIL))
+				states[j] = RISCV_STATE_UNAVAILABLE;
+			else if (get_field32(dmstatus, DM_DMSTATUS_ALLHALTED))
+				states[j] = RISCV_STATE_HALTED;
+			else if (get_field32(dmstatus, DM_DMSTATUS_ALLRUNNING))
+				states[j] = RISCV_STATE_RUNNING;
+			else
+				valid[j] = false;
+		}
+		riscv_batch_free(batch);
+	}
+
+cleanup:
+	free(keys);
+	free(done);
+	return result;
 }
 
 static int handle_became_unavailable(struct target *target,
@@ -2869,6 +4096,7 @@ static int handle_became_unavailable(struct target *target,
 {
 	RISCV013_INFO(info);
 	info->dcsr_ebreak_is_set = false;
+	info->vector_context.active = false;
 	return ERROR_OK;
 }
 
@@ -2899,6 +4127,7 @@ static int init_target(struct command_context *cmd_ctx,
 	generic_info->halt_reason = &riscv013_halt_reason;
 	generic_info->read_progbuf = &riscv013_read_progbuf;
 	generic_info->write_progbuf = &riscv013_write_progbuf;
+	generic_info->write_program = &riscv013_write_program;
 	generic_info->execute_progbuf = &riscv013_execute_progbuf;
 	generic_info->invalidate_cached_progbuf = &riscv013_invalidate_cached_progbuf;
 	generic_info->fill_dmi_write = &riscv013_fill_dmi_write;
@@ -2911,7 +4140,15 @@ static int init_target(struct command_context *cmd_ctx,
 	generic_info->dmi_write = &dmi_write;
 	generic_info->get_dmi_address = &riscv013_get_dmi_address;
 	generic_info->read_memory = read_memory;
+	generic_info->read_memory_group = read_memory_group;
+	generic_info->read_register_group = register_read_group;
+	generic_info->get_hart_state_group = get_hart_state_group;
+	generic_info->read_registers = register_read_batch;
+	generic_info->read_triggers_tdata1 = riscv013_read_triggers_tdata1;
+	generic_info->read_vector_registers = riscv013_get_vector_registers;
+	generic_info->read_progbuf_stream = riscv013_read_progbuf_stream;
 	generic_info->data_bits = &riscv013_data_bits;
+	generic_info->bulk_access_size = &riscv013_bulk_access_size;
 	generic_info->print_info = &riscv013_print_info;
 
 	generic_info->handle_became_unavailable = &handle_became_unavailable;
@@ -2929,16 +4166,14 @@ static int init_target(struct command_context *cmd_ctx,
 	reset_learned_delays(target);
 
 	/* Assume all these abstract commands are supported until we learn
-	 * otherwise.
-	 * TODO: The spec allows eg. one CSR to be able to be accessed abstractly
-	 * while another one isn't. We don't track that this closely here, but in
-	 * the future we probably should. */
+	 * otherwise. */
 	info->abstract_read_csr_supported = true;
 	info->abstract_write_csr_supported = true;
 	info->abstract_read_fpr_supported = true;
 	info->abstract_write_fpr_supported = true;
 
 	info->has_aampostincrement = YNM_MAYBE;
+	info->has_aarpostincrement = YNM_MAYBE;
 
 	return ERROR_OK;
 }
@@ -2950,6 +4185,9 @@ static int assert_reset(struct target *target)
 
 	select_dmi(target);
 
+	/* Reset discards the vector set-up along with everything else. */
+	info->vector_context.active = false;
+
 	if (target_has_event_action(target, TARGET_EVENT_RESET_ASSERT)) {
 		/* Run the user-supplied script if there is one. */
 		target_handle_event(target, TARGET_EVENT_RESET_ASSERT);
@@ -3121,7 +4359,7 @@ static int execute_fence(struct target *target)
 static void log_memory_access128(target_addr_t address, uint64_t value_h,
 		uint64_t value_l, bool is_read)
 {
-	if (debug_level < LOG_LVL_DEBUG)
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
 		return;
 
 	char fmt[80];
@@ -3133,7 +4371,7 @@ static void log_memory_access128(target_addr_t address, uint64_t value_h,
 static void log_memory_access64(target_addr_t address, uint64_t value,
 		unsigned int size_bytes, bool is_read)
 {
-	if (debug_level < LOG_LVL_DEBUG)
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
 		return;
 
 	char fmt[80];
@@ -3169,6 +4407,18 @@ static void log_memory_access(target_addr_t address, uint32_t *sbvalue,
 	}
 }
 
+/* Log an element of "size_bytes" bytes stored little endian in "buf". */
+static void log_memory_access_buf(target_addr_t address, const uint8_t *buf,
+		unsigned int size_bytes, bool is_read)
+{
+	if (size_bytes == 16)
+		log_memory_access128(address, buf_get_u64(buf + 8, 0, 64),
+				buf_get_u64(buf, 0, 64), is_read);
+	else
+		log_memory_access64(address, buf_get_u64(buf, 0, 8 * size_bytes),
+				size_bytes, is_read);
+}
+
 /* Read the relevant sbdata regs depending on size, and put the results into
  * buffer. */
 static int read_memory_bus_word(struct target *target, target_addr_t address,
@@ -3357,9 +4607,26 @@ static int read_memory_bus_v1(struct target *target, target_addr_t address,
 	target_addr_t next_address = address;
 	target_addr_t end_address = address + (increment ? count : 1) * size;
 
-	/* TODO: Reading all the elements in a single batch will boost the
-	 * performance.
-	 */
+	/* Stream as much as possible at DMI speed, only what could not be
+	 * read that way goes through the loop below. */
+	if (count > 1 && sb_group_read_supported(target, size)) {
+		uint32_t done;
+		if (sb_stream_read(target, address, size, count, buffer,
+					increment == size, &done) != ERROR_OK)
+			return ERROR_FAIL;
+		if (done == count)
+			return ERROR_OK;
+		if (done > 0) {
+			LOG_TARGET_DEBUG(target, "Stream read stopped after %" PRIu32
+					" of %" PRIu32 " elements.", done, count);
+			address += done * increment;
+			buffer += done * size;
+			count -= done;
+			next_address = address;
+			end_address = address + (increment ? count : 1) * size;
+		}
+	}
+
 	while (next_address < end_address) {
 		uint32_t sbcs_write = set_field(0, DM_SBCS_SBREADONADDR, 1);
 		sbcs_write |= sb_sbaccess(size);
@@ -3478,6 +4745,327 @@ static int read_memory_bus_v1(struct target *target, target_addr_t address,
 	return ERROR_OK;
 }
 
+/* Number of scans needed by "sb_group_read_fill_batch()" besides the reads of
+ * the data itself. */
+static unsigned int sb_group_read_overhead(const struct target *target)
+{
+	/* sbcs write, sbaddress writes, sbcs write, sbcs read */
+	return 3 + get_sbaadress_reg_count(target);
+}
+
+static bool sb_group_read_supported(struct target *target, uint32_t size)
+{
+	RISCV013_INFO(info);
+	return target_was_examined(target)
+		&& get_field(info->sbcs, DM_SBCS_SBVERSION) == 1
+		&& get_field(info->sbcs, DM_SBCS_SBASIZE) <= 64
+		&& size <= 16
+		&& sba_supports_access(target, size);
+}
+
+/**
+ * Fill a batch with the reads of "count" elements of a sbreadondata stream.
+ * The "first" batch of the stream sets up sbcs and sbaddress, the "last"
+ * one disables sbreadondata before its last element. The batches in between
+ * only read sbdata, each read of sbdata0 starting the next bus read. All of
+ * them end with a read of sbcs, stored in "sbcs_read_key".
+ */
+static void sb_stream_read_fill_batch(struct target *target,
+		struct riscv_batch *batch, target_addr_t address, uint32_t size,
+		bool autoincrement, uint32_t count, bool first, bool last,
+		size_t *sbcs_read_key)
+{
+	assert(count > 0);
+	const uint32_t sbcs = sb_sbaccess(size) | DM_SBCS_SBREADONADDR
+		| (autoincrement ? DM_SBCS_SBAUTOINCREMENT : 0);
+	if (first) {
+		/* Writing ones to sbbusyerror and sberror clears them. */
+		riscv_batch_add_dm_write(batch, DM_SBCS, sbcs | DM_SBCS_SBREADONDATA
+				| DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR, /* read back */ true,
+				RISCV_DELAY_BASE);
+		batch_fill_sb_write_address(target, batch, address, RISCV_DELAY_SYSBUS_READ);
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		const bool is_last = last && i == count - 1;
+		/* Don't start another bus read after the last element. */
+		if (is_last)
+			riscv_batch_add_dm_write(batch, DM_SBCS, sbcs, /* read back */ true,
+					RISCV_DELAY_BASE);
+		/* sbdata0 last, its read starts the next bus read. */
+		static const uint32_t sbdata[] = { DM_SBDATA0, DM_SBDATA1,
+			DM_SBDATA2, DM_SBDATA3 };
+		for (unsigned int j = DIV_ROUND_UP(size, 4) - 1; j > 0; --j)
+			riscv_batch_add_dm_read(batch, sbdata[j], RISCV_DELAY_BASE);
+		riscv_batch_add_dm_read(batch, DM_SBDATA0,
+				is_last ? RISCV_DELAY_BASE : RISCV_DELAY_SYSBUS_READ);
+	}
+	*sbcs_read_key = riscv_batch_add_dm_read(batch, DM_SBCS, RISCV_DELAY_BASE);
+}
+
+/**
+ * Fill a batch that reads "count" elements using sbreadonaddr/sbreadondata.
+ * The batch is self-contained (it sets up sbcs and sbaddress at the start and
+ * disables sbreadondata before the last element), so batches of several
+ * targets can be run back to back in one JTAG queue.
+ */
+static void sb_group_read_fill_batch(struct target *target,
+		struct riscv_batch *batch, target_addr_t address, uint32_t size,
+		uint32_t count, size_t *sbcs_read_key)
+{
+	sb_stream_read_fill_batch(target, batch, address, size,
+			/* autoincrement */ true, count, /* first */ true, /* last */ true,
+			sbcs_read_key);
+}
+
+/**
+ * Process the results of "sb_group_read_fill_batch()". Returns true if all
+ * the data was read successfully. Otherwise the errors are cleared and the
+ * learned delays increased, so the caller can re-read the data by other means.
+ */
+static bool sb_group_read_process_batch(struct target *target,
+		const struct riscv_batch *batch, size_t sbcs_read_key,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	RISCV013_INFO(info);
+	if (riscv_batch_was_batch_busy(batch)) {
+		LOG_TARGET_DEBUG(target, "DMI busy encountered during group read.");
+		increase_dmi_busy_delay(target);
+		return false;
+	}
+	const uint32_t sbcs = riscv_batch_get_dmi_read_data(batch, sbcs_read_key);
+	if (get_field(sbcs, DM_SBCS_SBBUSYERROR) || get_field(sbcs, DM_SBCS_SBERROR)) {
+		LOG_TARGET_DEBUG(target, "System bus error during group read (sbcs=0x%"
+				PRIx32 ").", sbcs);
+		if (get_field(sbcs, DM_SBCS_SBBUSYERROR))
+			riscv_scan_increase_delay(&info->learned_delays,
+					RISCV_DELAY_SYSBUS_READ);
+		dm_write(target, DM_SBCS, DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR);
+		return false;
+	}
+	return riscv_batch_get_dmi_read_elements(batch, /* first_key */ 0, count,
+			size, buffer) == count;
+}
+
+/**
+ * Read "count" elements through the system bus as one sbreadondata stream.
+ * sbcs and sbaddress are only written at the start and the bus reads chain
+ * across batch boundaries, so the next batch can be filled while the
+ * previous one is shifted. On a busy response or a bus error nothing after
+ * the last good batch can be trusted: the errors are cleared, the learned
+ * delays increased and "*done" tells how many elements were read, so the
+ * caller can read the rest one element at a time.
+ */
+static int sb_stream_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer, bool autoincrement,
+		uint32_t *done)
+{
+	RISCV013_INFO(info);
+	const unsigned int words = DIV_ROUND_UP(size, 4);
+	const unsigned int scans = riscv_get_batch_size(target);
+	const unsigned int overhead = sb_group_read_overhead(target);
+	*done = 0;
+	if (scans < overhead + words)
+		return ERROR_OK;
+	const uint32_t per_batch = (scans - overhead) / words;
+
+	struct riscv_batch *in_flight = NULL;
+	uint32_t in_flight_start = 0, in_flight_count = 0;
+	size_t in_flight_sbcs_key = 0;
+	struct jtag_async *async = NULL;
+	bool failed = false;
+	int result = ERROR_OK;
+
+	for (uint32_t start = 0; ; start += in_flight_count) {
+		struct riscv_batch *next = NULL;
+		const uint32_t n = MIN(per_batch, count - start);
+		size_t next_sbcs_key = 0;
+		if (n > 0 && !failed && result == ERROR_OK) {
+			next = riscv_batch_alloc(target, n * words + overhead);
+			if (!next) {
+				result = ERROR_FAIL;
+			} else {
+				sb_stream_read_fill_batch(target, next, address, size,
+						autoincrement, n, start == 0, start + n == count,
+						&next_sbcs_key);
+				select_dmi(target);
+				riscv_batch_queue_from(next, 0, &info->learned_delays,
+						/* resets_delays */ false, 0);
+			}
+		}
+
+		/* The next batch is submitted as soon as the previous one is
+		 * done, its results are processed while the next one is shifted. */
+		int retval = jtag_async_wait(async);
+		async = NULL;
+		if (retval != ERROR_OK && result == ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Unable to execute JTAG queue");
+			result = retval;
+		}
+		keep_alive();
+		if (next && result == ERROR_OK) {
+			retval = jtag_execute_queue_async(&async);
+			if (retval != ERROR_OK) {
+				LOG_TARGET_ERROR(target, "Unable to execute JTAG queue");
+				result = retval;
+			}
+		}
+
+		if (in_flight && result == ERROR_OK && !failed) {
+			riscv_batch_finish_queued(in_flight, 0, &info->learned_delays);
+			uint8_t * const data = buffer + in_flight_start * size;
+			const uint32_t sbcs = riscv_batch_get_dmi_read_data(in_flight,
+					in_flight_sbcs_key);
+			if (riscv_batch_was_batch_busy(in_flight)) {
+				LOG_TARGET_DEBUG(target, "DMI busy encountered during stream read.");
+				increase_dmi_busy_delay(target);
+				failed = true;
+			} else if (get_field(sbcs, DM_SBCS_SBBUSYERROR) ||
+					get_field(sbcs, DM_SBCS_SBERROR)) {
+				/* The element whose bus read failed isn't known, the
+				 * data of the whole batch is read again. */
+				LOG_TARGET_DEBUG(target, "System bus error during stream read "
+						"(sbcs=0x%" PRIx32 ").", sbcs);
+				if (get_field(sbcs, DM_SBCS_SBBUSYERROR))
+					riscv_scan_increase_delay(&info->learned_delays,
+							RISCV_DELAY_SYSBUS_READ);
+				failed = true;
+			} else if (riscv_batch_get_dmi_read_elements(in_flight,
+						/* first_key */ 0, in_flight_count, size, data)
+					!= in_flight_count) {
+				failed = true;
+			} else {
+				for (uint32_t i = 0; i < in_flight_count; ++i) {
+					const uint32_t index = in_flight_start + i;
+					log_memory_access_buf(address + (autoincrement ? index * size : 0),
+							data + i * size, size, /* is_read */ true);
+				}
+				*done += in_flight_count;
+			}
+		}
+		if (in_flight)
+			riscv_batch_free(in_flight);
+
+		in_flight = next;
+		in_flight_start = start;
+		in_flight_count = n;
+		in_flight_sbcs_key = next_sbcs_key;
+		if (!in_flight)
+			break;
+	}
+
+	if (result != ERROR_OK)
+		return result;
+
+	if (*done < count) {
+		/* The stream may have been left running, wait for the bus before
+		 * clearing the errors. The caller sets up sbcs again. */
+		uint32_t sbcs;
+		if (read_sbcs_nonbusy(target, &sbcs) != ERROR_OK)
+			return ERROR_FAIL;
+		if (dm_write(target, DM_SBCS, DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static int read_memory_group(struct target **targets, unsigned int target_count,
+		target_addr_t address, uint32_t size, uint32_t count, uint8_t **buffers)
+{
+	struct riscv_batch **batches = calloc(target_count, sizeof(*batches));
+	size_t *sbcs_read_keys = calloc(target_count, sizeof(*sbcs_read_keys));
+	bool *merged = calloc(target_count, sizeof(*merged));
+	if (!batches || !sbcs_read_keys || !merged) {
+		LOG_ERROR("Out of memory");
+		free(batches);
+		free(sbcs_read_keys);
+		free(merged);
+		return ERROR_FAIL;
+	}
+
+	/* Targets that can't use the system bus are read one by one. */
+	uint32_t chunk = count;
+	for (unsigned int t = 0; t < target_count; ++t) {
+		merged[t] = sb_group_read_supported(targets[t], size);
+		if (!merged[t])
+			continue;
+		const unsigned int words = DIV_ROUND_UP(size, 4);
+		const unsigned int scans = riscv_get_batch_size(targets[t]);
+		const unsigned int overhead = sb_group_read_overhead(targets[t]);
+		chunk = MIN(chunk, (scans - overhead) / words);
+	}
+
+	int result = ERROR_OK;
+	for (uint32_t done = 0; done < count && result == ERROR_OK; ) {
+		const uint32_t n = MIN(chunk, count - done);
+		const target_addr_t chunk_address = address + done * size;
+
+		for (unsigned int t = 0; t < target_count; ++t) {
+			if (!merged[t])
+				continue;
+			const unsigned int words = DIV_ROUND_UP(size, 4);
+			batches[t] = riscv_batch_alloc(targets[t],
+					n * words + sb_group_read_overhead(targets[t]));
+			if (!batches[t]) {
+				result = ERROR_FAIL;
+				break;
+			}
+			sb_group_read_fill_batch(targets[t], batches[t], chunk_address,
+					size, n, &sbcs_read_keys[t]);
+			riscv_batch_add_nop(batches[t]);
+			select_dmi(targets[t]);
+			riscv_batch_queue_from(batches[t], 0,
+					&get_info(targets[t])->learned_delays,
+					/* resets_delays */ false, 0);
+		}
+
+		if (result == ERROR_OK) {
+			keep_alive();
+			result = jtag_execute_queue();
+			keep_alive();
+			if (result != ERROR_OK)
+				LOG_ERROR("Unable to execute JTAG queue");
+		}
+
+		for (unsigned int t = 0; t < target_count; ++t) {
+			struct target * const target = targets[t];
+			uint8_t * const buffer = buffers[t] + done * size;
+			if (!merged[t] || !batches[t] || result != ERROR_OK) {
+				if (batches[t])
+					riscv_batch_free(batches[t]);
+				batches[t] = NULL;
+				if (!merged[t] && result == ERROR_OK)
+					result = read_memory(target, chunk_address, size, n,
+							buffer, size);
+				continue;
+			}
+			riscv_batch_finish_queued(batches[t], 0,
+					&get_info(target)->learned_delays);
+			const bool success = sb_group_read_process_batch(target,
+					batches[t], sbcs_read_keys[t], size, n, buffer);
+			riscv_batch_free(batches[t]);
+			batches[t] = NULL;
+			if (!success) {
+				LOG_TARGET_DEBUG(target, "Re-reading 0x%" TARGET_PRIxADDR
+						"+%" PRIu32 " elements without merging.",
+						chunk_address, n);
+				result = read_memory(target, chunk_address, size, n,
+						buffer, size);
+			} else {
+				for (uint32_t i = 0; i < n; ++i)
+					log_memory_access_buf(chunk_address + i * size,
+							buffer + i * size, size, /* is_read */ true);
+			}
+		}
+		done += n;
+	}
+
+	free(batches);
+	free(sbcs_read_keys);
+	free(merged);
+	return result;
+}
+
 static void log_mem_access_result(struct target *target, bool success, int method, bool is_read)
 {
 	RISCV_INFO(r);
@@ -3610,6 +5198,170 @@ static bool mem_should_skip_abstract(struct target *target, target_addr_t addres
 	return false;
 }
 
+/* Number of memory elements moved by one abstract burst batch, given the
+ * number of data registers accessed per element. */
+static unsigned int abstract_burst_elements(struct target *target,
+		unsigned int words_per_element)
+{
+	/* arg1 (2 words at most), command, two abstractauto writes and the
+	 * final abstractcs read. */
+	const unsigned int overhead = 2 + 1 + 2 + 1;
+	const unsigned int batch_size = riscv_get_batch_size(target);
+	if (batch_size <= overhead + words_per_element)
+		return 1;
+	return (batch_size - overhead) / words_per_element;
+}
+
+/**
+ * Read "count" elements with a single memory access command using
+ * aampostincrement: with abstractauto.autoexecdata[0] set, every read of data0
+ * returns one element and executes the command again for the next one. This
+ * is done in batches, with only one cmderr check per batch.
+ *
+ * Must only be used once aampostincrement is known to work.
+ */
+static int read_memory_abstract_burst(struct target *target,
+		target_addr_t address, uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	const unsigned int width32 = MAX(size * 8, 32u);
+	const unsigned int words = width32 / 32;
+	const uint32_t command = access_memory_command(target, false, size * 8,
+			/* postincrement */ true, /* is_write */ false);
+
+	while (count > 0) {
+		const uint32_t n = MIN(count, abstract_burst_elements(target, words));
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				xlen / 32 + 3 + n * words + 1);
+		if (!batch)
+			return ERROR_FAIL;
+
+		abstract_data_write_fill_batch(batch, address, 1, xlen);
+		riscv_batch_add_dm_write(batch, DM_COMMAND, command,
+				/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+		if (n > 1)
+			riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+					set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1),
+					/* read_back */ true, RISCV_DELAY_BASE);
+		for (uint32_t i = 0; i < n; ++i) {
+			const bool is_last = i == n - 1;
+			if (is_last && n > 1)
+				riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+						/* read_back */ true, RISCV_DELAY_BASE);
+			/* Read the upper half first: accessing data0 starts the next
+			 * command. */
+			if (words > 1)
+				riscv_batch_add_dm_read(batch, DM_DATA1, RISCV_DELAY_BASE);
+			riscv_batch_add_dm_read(batch, DM_DATA0,
+					is_last ? RISCV_DELAY_BASE : RISCV_DELAY_ABSTRACT_COMMAND);
+		}
+		const size_t abstractcs_read_key = riscv_batch_add_dm_read(batch,
+				DM_ABSTRACTCS, RISCV_DELAY_BASE);
+		riscv_batch_add_nop(batch);
+
+		get_dm(target)->abstract_cmd_maybe_busy = true;
+		int result = batch_run_timeout(target, batch);
+		if (result != ERROR_OK) {
+			/* Don't leave the DM re-executing the command on data0 accesses. */
+			dm_write(target, DM_ABSTRACTAUTO, 0);
+			riscv_batch_free(batch);
+			return result;
+		}
+		uint32_t cmderr;
+		result = abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+				abstractcs_read_key, &cmderr);
+		if (result != ERROR_OK) {
+			riscv_batch_free(batch);
+			return result;
+		}
+
+		for (uint32_t i = 0; i < n; ++i) {
+			riscv_reg_t value = 0;
+			for (unsigned int w = 0; w < words; ++w)
+				value = (value << 32) | riscv_batch_get_dmi_read_data(batch,
+						i * words + w);
+			buf_set_u64(buffer + i * size, 0, 8 * size, value);
+		}
+		riscv_batch_free(batch);
+
+		address += n * size;
+		buffer += n * size;
+		count -= n;
+	}
+	return ERROR_OK;
+}
+
+/**
+ * Write "count" elements with a single memory access command using
+ * aampostincrement: with abstractauto.autoexecdata[0] set, every write of data0
+ * executes the command for the element just written. This is done in batches,
+ * with only one cmderr check per batch.
+ *
+ * Must only be used once aampostincrement is known to work.
+ */
+static int write_memory_abstract_burst(struct target *target,
+		target_addr_t address, uint32_t size, uint32_t count,
+		const uint8_t *buffer)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	const unsigned int words = xlen / 32;
+	const uint32_t command = access_memory_command(target, false, size * 8,
+			/* postincrement */ true, /* is_write */ true);
+
+	while (count > 0) {
+		const uint32_t n = MIN(count, abstract_burst_elements(target, words));
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				words + 3 + n * words + 1);
+		if (!batch)
+			return ERROR_FAIL;
+
+		abstract_data_write_fill_batch(batch, address, 1, xlen);
+		for (uint32_t i = 0; i < n; ++i) {
+			if (i == 1)
+				riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO,
+						set_field(0, DM_ABSTRACTAUTO_AUTOEXECDATA, 1),
+						/* read_back */ true, RISCV_DELAY_BASE);
+			riscv_reg_t value = buf_get_u64(buffer + i * size, 0, 8 * size);
+			/* Write the upper half first: writing data0 starts the
+			 * command. */
+			if (words > 1)
+				riscv_batch_add_dm_write(batch, DM_DATA1, (uint32_t)(value >> 32),
+						/* read_back */ true, RISCV_DELAY_BASE);
+			riscv_batch_add_dm_write(batch, DM_DATA0, (uint32_t)value,
+					/* read_back */ true,
+					i > 0 ? RISCV_DELAY_ABSTRACT_COMMAND : RISCV_DELAY_BASE);
+			if (i == 0)
+				riscv_batch_add_dm_write(batch, DM_COMMAND, command,
+						/* read_back */ true, RISCV_DELAY_ABSTRACT_COMMAND);
+		}
+		if (n > 1)
+			riscv_batch_add_dm_write(batch, DM_ABSTRACTAUTO, 0,
+					/* read_back */ true, RISCV_DELAY_BASE);
+		const size_t abstractcs_read_key = riscv_batch_add_dm_read(batch,
+				DM_ABSTRACTCS, RISCV_DELAY_BASE);
+		riscv_batch_add_nop(batch);
+
+		get_dm(target)->abstract_cmd_maybe_busy = true;
+		int result = batch_run_timeout(target, batch);
+		if (result != ERROR_OK) {
+			dm_write(target, DM_ABSTRACTAUTO, 0);
+			riscv_batch_free(batch);
+			return result;
+		}
+		uint32_t cmderr;
+		result = abstract_cmd_batch_check_and_clear_cmderr(target, batch,
+				abstractcs_read_key, &cmderr);
+		riscv_batch_free(batch);
+		if (result != ERROR_OK)
+			return result;
+
+		address += n * size;
+		buffer += n * size;
+		count -= n;
+	}
+	return ERROR_OK;
+}
+
 /*
  * Performs a memory read using memory access abstract commands. The read sizes
  * supported are 1, 2, and 4 bytes despite the spec's support of 8 and 16 byte
@@ -3691,8 +5443,14 @@ static int read_memory_abstract(struct target *target, target_addr_t address,
 			return result;
 		buf_set_u64(p, 0, 8 * size, value);
 
-		if (info->has_aampostincrement == YNM_YES)
+		if (info->has_aampostincrement == YNM_YES) {
+			/* The rest can be streamed. */
+			if (c + 1 < count)
+				return read_memory_abstract_burst(target,
+						address + (c + 1) * size, size, count - c - 1,
+						p + size);
 			updateaddr = false;
+		}
 		p += size;
 	}
 
@@ -3777,8 +5535,13 @@ static int write_memory_abstract(struct target *target, target_addr_t address,
 		if (result != ERROR_OK)
 			return result;
 
-		if (info->has_aampostincrement == YNM_YES)
+		if (info->has_aampostincrement == YNM_YES) {
+			if (c + 1 < count)
+				return write_memory_abstract_burst(target,
+						address + (c + 1) * size, size, count - c - 1,
+						p + size);
 			updateaddr = false;
+		}
 		p += size;
 	}
 
@@ -3956,7 +5719,15 @@ static int read_memory_progbuf_inner_extract_batch_data(struct target *target,
 	assert(!two_reads_per_element || riscv_xlen(target) == 64);
 	assert(elements_to_read <= UINT32_MAX / reads_per_element);
 	const uint32_t nreads = elements_to_read * reads_per_element;
-	for (uint32_t curr_idx = start_index, read = 0; read < nreads; ++read) {
+	/* Without debug logging there is nothing to do per element, so the
+	 * successfully read prefix of the batch is decoded in one go. */
+	uint32_t decoded = 0;
+	if (!LOG_LEVEL_IS(LOG_LVL_DEBUG))
+		decoded = riscv_batch_get_dmi_read_elements(batch, /*first_key*/ 0,
+				elements_to_read, access.element_size,
+				access.buffer_address + start_index * access.element_size);
+	for (uint32_t curr_idx = start_index + decoded,
+			read = decoded * reads_per_element; read < nreads; ++read) {
 		switch (riscv_batch_get_dmi_read_op(batch, read)) {
 		case DMI_STATUS_BUSY:
 			*elements_read = curr_idx - start_index;
@@ -3997,6 +5768,31 @@ static int read_memory_progbuf_inner_extract_batch_data(struct target *target,
 	return ERROR_OK;
 }
 
+/**
+ * Obtain abstractcs after a memory read batch was run.
+ * The batch ends with a read of abstractcs, so in the common case (no DMI busy
+ * and the last command has already finished) there is no need to spend another
+ * JTAG queue flush on "wait_for_idle()".
+ */
+static int read_memory_progbuf_inner_get_abstractcs(struct target *target,
+		const struct riscv_batch *batch, size_t abstractcs_read_key,
+		uint32_t *abstractcs)
+{
+	if (riscv_batch_get_dmi_read_op(batch, abstractcs_read_key) ==
+			DMI_STATUS_SUCCESS) {
+		*abstractcs = riscv_batch_get_dmi_read_data(batch,
+				abstractcs_read_key);
+		if (get_field32(*abstractcs, DM_ABSTRACTCS_BUSY) == 0) {
+			dm013_info_t *dm = get_dm(target);
+			if (!dm)
+				return ERROR_FAIL;
+			dm->abstract_cmd_maybe_busy = false;
+			return ERROR_OK;
+		}
+	}
+	return wait_for_idle(target, abstractcs);
+}
+
 /**
  * This function reads a batch of elements from memory.
  * Prior to calling this function the folowing conditions should be met:
@@ -4004,8 +5800,9 @@ static int read_memory_progbuf_inner_extract_batch_data(struct target *target,
  * - DM_ABSTRACTAUTO_AUTOEXECDATA is set.
  */
 static int read_memory_progbuf_inner_run_and_process_batch(struct target *target,
-		struct riscv_batch *batch, struct memory_access_info access,
-		uint32_t start_index, uint32_t elements_to_read, uint32_t *elements_read)
+		struct riscv_batch *batch, size_t abstractcs_read_key,
+		struct memory_access_info access, uint32_t start_index,
+		uint32_t elements_to_read, uint32_t *elements_read)
 {
 	dm013_info_t *dm = get_dm(target);
 	if (!dm)
@@ -4013,11 +5810,12 @@ static int read_memory_progbuf_inner_run_and_process_batch(struct target *target
 
 	/* Abstract commands are executed while running the batch. */
 	dm->abstract_cmd_maybe_busy = true;
-	if (batch_run(target, batch) != ERROR_OK)
+	if (block_access_batch_run(target, batch) != ERROR_OK)
 		return ERROR_FAIL;
 
 	uint32_t abstractcs;
-	if (wait_for_idle(target, &abstractcs) != ERROR_OK)
+	if (read_memory_progbuf_inner_get_abstractcs(target, batch,
+				abstractcs_read_key, &abstractcs) != ERROR_OK)
 		return ERROR_FAIL;
 
 	uint32_t elements_to_extract_from_batch;
@@ -4049,15 +5847,22 @@ static int read_memory_progbuf_inner_run_and_process_batch(struct target *target
 	return ERROR_OK;
 }
 
+/**
+ * Fill the batch with reads of up to "count" elements. The batch is terminated
+ * by a read of abstractcs, the key of which is stored in "abstractcs_read_key".
+ */
 static uint32_t read_memory_progbuf_inner_fill_batch(struct riscv_batch *batch,
-		uint32_t count, uint32_t size)
+		uint32_t count, uint32_t size, size_t *abstractcs_read_key)
 {
 	assert(size <= 8);
 	const uint32_t two_regs_used[] = {DM_DATA1, DM_DATA0};
 	const uint32_t one_reg_used[] = {DM_DATA0};
 	const uint32_t reads_per_element = size > 4 ? 2 : 1;
 	const uint32_t * const used_regs = size > 4 ? two_regs_used : one_reg_used;
-	const uint32_t batch_capacity = riscv_batch_available_scans(batch) / reads_per_element;
+	/* One scan is reserved for the read of abstractcs. */
+	assert(riscv_batch_available_scans(batch) > reads_per_element);
+	const uint32_t batch_capacity =
+		(riscv_batch_available_scans(batch) - 1) / reads_per_element;
 	const uint32_t end = MIN(batch_capacity, count);
 
 	for (uint32_t j = 0; j < end; ++j) {
@@ -4069,24 +5874,28 @@ static uint32_t read_memory_progbuf_inner_fill_batch(struct riscv_batch *batch,
 			riscv_batch_add_dm_read(batch, used_regs[i],
 					RISCV_DELAY_ABSTRACT_COMMAND);
 	}
+	*abstractcs_read_key = riscv_batch_add_dm_read(batch, DM_ABSTRACTCS,
+			RISCV_DELAY_BASE);
 	return end;
 }
 
+/**
+ * The batch is owned by the caller and is reused for all the iterations of the
+ * read loop, so no allocations are done per batch.
+ */
 static int read_memory_progbuf_inner_try_to_read(struct target *target,
-		struct memory_access_info access, uint32_t *elements_read,
-		uint32_t index, uint32_t loop_count)
+		struct riscv_batch *batch, struct memory_access_info access,
+		uint32_t *elements_read, uint32_t index, uint32_t loop_count)
 {
-	struct riscv_batch *batch = riscv_batch_alloc(target, RISCV_BATCH_ALLOC_SIZE);
-	if (!batch)
-		return ERROR_FAIL;
+	riscv_batch_reset(batch);
 
+	size_t abstractcs_read_key;
 	const uint32_t elements_to_read = read_memory_progbuf_inner_fill_batch(batch,
-			loop_count - index, access.element_size);
+			loop_count - index, access.element_size, &abstractcs_read_key);
 
-	int result = read_memory_progbuf_inner_run_and_process_batch(target, batch,
-			access, index, elements_to_read, elements_read);
-	riscv_batch_free(batch);
-	return result;
+	return read_memory_progbuf_inner_run_and_process_batch(target, batch,
+			abstractcs_read_key, access, index, elements_to_read,
+			elements_read);
 }
 
 /**
@@ -4094,7 +5903,8 @@ static int read_memory_progbuf_inner_try_to_read(struct target *target,
  * with the address argument equal to curr_target_address.
  */
 static int read_memory_progbuf_inner_ensure_forward_progress(struct target *target,
-		struct memory_access_info access, uint32_t start_index)
+		struct riscv_batch *batch, struct memory_access_info access,
+		uint32_t start_index)
 {
 	LOG_TARGET_DEBUG(target,
 			"Executing one loop iteration to ensure forward progress (index=%"
@@ -4110,8 +5920,8 @@ static int read_memory_progbuf_inner_ensure_forward_progress(struct target *targ
 		.increment = access.increment,
 	};
 	uint32_t elements_read;
-	if (read_memory_progbuf_inner_try_to_read(target, curr_access, &elements_read,
-			/*index*/ 0, /*loop_count*/ 1) != ERROR_OK)
+	if (read_memory_progbuf_inner_try_to_read(target, batch, curr_access,
+				&elements_read, /*index*/ 0, /*loop_count*/ 1) != ERROR_OK)
 		return ERROR_FAIL;
 
 	if (elements_read != 1) {
@@ -4245,16 +6055,23 @@ static int read_memory_progbuf_inner(struct target *target,
 	 */
 	const uint32_t loop_count = count - 2;
 
+	struct riscv_batch *batch = riscv_batch_alloc(target, riscv_get_batch_size(target));
+	if (!batch) {
+		dm_write(target, DM_ABSTRACTAUTO, 0);
+		return ERROR_FAIL;
+	}
 	for (uint32_t index = 0; index < loop_count;) {
 		uint32_t elements_read;
-		if (read_memory_progbuf_inner_try_to_read(target, access, &elements_read,
-					index, loop_count) != ERROR_OK) {
+		if (read_memory_progbuf_inner_try_to_read(target, batch, access,
+					&elements_read, index, loop_count) != ERROR_OK) {
+			riscv_batch_free(batch);
 			dm_write(target, DM_ABSTRACTAUTO, 0);
 			return ERROR_FAIL;
 		}
 		if (elements_read == 0) {
-			if (read_memory_progbuf_inner_ensure_forward_progress(target, access,
-						index) != ERROR_OK) {
+			if (read_memory_progbuf_inner_ensure_forward_progress(target, batch,
+						access, index) != ERROR_OK) {
+				riscv_batch_free(batch);
 				dm_write(target, DM_ABSTRACTAUTO, 0);
 				return ERROR_FAIL;
 			}
@@ -4263,6 +6080,7 @@ static int read_memory_progbuf_inner(struct target *target,
 		index += elements_read;
 		assert(index <= loop_count);
 	}
+	riscv_batch_free(batch);
 	if (dm_write(target, DM_ABSTRACTAUTO, 0) != ERROR_OK)
 		return ERROR_FAIL;
 
@@ -4369,27 +6187,38 @@ static int read_memory(struct target *target, target_addr_t address,
 	}
 
 	int ret = ERROR_FAIL;
-	RISCV_INFO(r);
 	RISCV013_INFO(info);
 
 	char *progbuf_result = "disabled";
 	char *sysbus_result = "disabled";
 	char *abstract_result = "disabled";
 
+	struct riscv_mem_access_region *region;
+	const int *methods = riscv_mem_access_methods(target, address,
+			(target_addr_t)size * count, &region);
+	const bool timed = region && region->auto_select && !region->auto_done;
+
 	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
-		int method = r->mem_access_methods[i];
+		int method = methods[i];
+		struct duration access_duration;
+		if (timed)
+			duration_start(&access_duration);
 
 		if (method == RISCV_MEM_ACCESS_PROGBUF) {
-			if (mem_should_skip_progbuf(target, address, size, true, &progbuf_result))
+			if (mem_should_skip_progbuf(target, address, size, true, &progbuf_result)) {
+				riscv_mem_access_account(target, region, method, false, 0, 0);
 				continue;
+			}
 
 			ret = read_memory_progbuf(target, address, size, count, buffer, increment);
 
 			if (ret != ERROR_OK)
 				progbuf_result = "failed";
 		} else if (method == RISCV_MEM_ACCESS_SYSBUS) {
-			if (mem_should_skip_sysbus(target, address, size, increment, true, &sysbus_result))
+			if (mem_should_skip_sysbus(target, address, size, increment, true, &sysbus_result)) {
+				riscv_mem_access_account(target, region, method, false, 0, 0);
 				continue;
+			}
 
 			if (get_field(info->sbcs, DM_SBCS_SBVERSION) == 0)
 				ret = read_memory_bus_v0(target, address, size, count, buffer, increment);
@@ -4399,8 +6228,10 @@ static int read_memory(struct target *target, target_addr_t address,
 			if (ret != ERROR_OK)
 				sysbus_result = "failed";
 		} else if (method == RISCV_MEM_ACCESS_ABSTRACT) {
-			if (mem_should_skip_abstract(target, address, size, increment, true, &abstract_result))
+			if (mem_should_skip_abstract(target, address, size, increment, true, &abstract_result)) {
+				riscv_mem_access_account(target, region, method, false, 0, 0);
 				continue;
+			}
 
 			ret = read_memory_abstract(target, address, size, count, buffer, increment);
 
@@ -4412,6 +6243,14 @@ static int read_memory(struct target *target, target_addr_t address,
 
 		log_mem_access_result(target, ret == ERROR_OK, method, true);
 
+		if (timed) {
+			duration_measure(&access_duration);
+			riscv_mem_access_account(target, region, method, ret == ERROR_OK,
+					(uint64_t)size * count,
+					(int64_t)access_duration.elapsed.tv_sec * 1000000
+					+ access_duration.elapsed.tv_usec);
+		}
+
 		if (ret == ERROR_OK)
 			return ret;
 	}
@@ -4493,7 +6332,7 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 		LOG_TARGET_DEBUG(target, "Transferring burst starting at address 0x%" TARGET_PRIxADDR,
 				next_address);
 
-		struct riscv_batch *batch = riscv_batch_alloc(target, RISCV_BATCH_ALLOC_SIZE);
+		struct riscv_batch *batch = riscv_batch_alloc(target, riscv_get_batch_size(target));
 		if (!batch)
 			return ERROR_FAIL;
 
@@ -4547,7 +6386,7 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 		}
 
 		/* Execute the batch of writes */
-		result = batch_run(target, batch);
+		result = block_access_batch_run(target, batch);
 		if (result != ERROR_OK) {
 			riscv_batch_free(batch);
 			return result;
@@ -4747,7 +6586,7 @@ static int write_memory_progbuf_run_batch(struct target *target, struct riscv_ba
 
 	/* Abstract commands are executed while running the batch. */
 	dm->abstract_cmd_maybe_busy = true;
-	if (batch_run(target, batch) != ERROR_OK)
+	if (block_access_batch_run(target, batch) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Note that if the scan resulted in a Busy DMI response, it
@@ -4787,7 +6626,7 @@ static int write_memory_progbuf_try_to_write(struct target *target,
 		target_addr_t *address_p, target_addr_t end_address, uint32_t size,
 		const uint8_t *buffer)
 {
-	struct riscv_batch * const batch = riscv_batch_alloc(target, RISCV_BATCH_ALLOC_SIZE);
+	struct riscv_batch * const batch = riscv_batch_alloc(target, riscv_get_batch_size(target));
 	if (!batch)
 		return ERROR_FAIL;
 
@@ -4901,7 +6740,8 @@ static int write_memory_progbuf(struct target *target, target_addr_t address,
 		if (register_write_direct(target, GDB_REGNO_MSTATUS, mstatus_old))
 			return ERROR_FAIL;
 
-	if (execute_fence(target) != ERROR_OK)
+	RISCV_INFO(r);
+	if (!r->skip_write_fence && execute_fence(target) != ERROR_OK)
 		return ERROR_FAIL;
 
 	return result;
@@ -4916,27 +6756,38 @@ static int write_memory(struct target *target, target_addr_t address,
 	}
 
 	int ret = ERROR_FAIL;
-	RISCV_INFO(r);
 	RISCV013_INFO(info);
 
 	char *progbuf_result = "disabled";
 	char *sysbus_result = "disabled";
 	char *abstract_result = "disabled";
 
+	struct riscv_mem_access_region *region;
+	const int *methods = riscv_mem_access_methods(target, address,
+			(target_addr_t)size * count, &region);
+	const bool timed = region && region->auto_select && !region->auto_done;
+
 	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
-		int method = r->mem_access_methods[i];
+		int method = methods[i];
+		struct duration access_duration;
+		if (timed)
+			duration_start(&access_duration);
 
 		if (method == RISCV_MEM_ACCESS_PROGBUF) {
-			if (mem_should_skip_progbuf(target, address, size, false, &progbuf_result))
+			if (mem_should_skip_progbuf(target, address, size, false, &progbuf_result)) {
+				riscv_mem_access_account(target, region, method, false, 0, 0);
 				continue;
+			}
 
 			ret = write_memory_progbuf(target, address, size, count, buffer);
 
 			if (ret != ERROR_OK)
 				progbuf_result = "failed";
 		} else if (method == RISCV_MEM_ACCESS_SYSBUS) {
-			if (mem_should_skip_sysbus(target, address, size, 0, false, &sysbus_result))
+			if (mem_should_skip_sysbus(target, address, size, 0, false, &sysbus_result)) {
+				riscv_mem_access_account(target, region, method, false, 0, 0);
 				continue;
+			}
 
 			if (get_field(info->sbcs, DM_SBCS_SBVERSION) == 0)
 				ret = write_memory_bus_v0(target, address, size, count, buffer);
@@ -4946,8 +6797,10 @@ static int write_memory(struct target *target, target_addr_t address,
 			if (ret != ERROR_OK)
 				sysbus_result = "failed";
 		} else if (method == RISCV_MEM_ACCESS_ABSTRACT) {
-			if (mem_should_skip_abstract(target, address, size, 0, false, &abstract_result))
+			if (mem_should_skip_abstract(target, address, size, 0, false, &abstract_result)) {
+				riscv_mem_access_account(target, region, method, false, 0, 0);
 				continue;
+			}
 
 			ret = write_memory_abstract(target, address, size, count, buffer);
 
@@ -4959,6 +6812,14 @@ static int write_memory(struct target *target, target_addr_t address,
 
 		log_mem_access_result(target, ret == ERROR_OK, method, false);
 
+		if (timed) {
+			duration_measure(&access_duration);
+			riscv_mem_access_account(target, region, method, ret == ERROR_OK,
+					(uint64_t)size * count,
+					(int64_t)access_duration.elapsed.tv_sec * 1000000
+					+ access_duration.elapsed.tv_usec);
+		}
+
 		if (ret == ERROR_OK)
 			return ret;
 	}
@@ -5014,6 +6875,9 @@ int riscv013_get_register(struct target *target,
 	if (dm013_select_target(target) != ERROR_OK)
 		return ERROR_FAIL;
 
+	if (is_vector_context_reg(rid) && vector_context_restore(target) != ERROR_OK)
+		return ERROR_FAIL;
+
 	if (register_read_direct(target, value, rid) != ERROR_OK) {
 		*value = -1;
 		return ERROR_FAIL;
@@ -5031,6 +6895,9 @@ int riscv013_set_register(struct target *target, enum gdb_regno rid,
 	if (dm013_select_target(target) != ERROR_OK)
 		return ERROR_FAIL;
 
+	if (is_vector_context_reg(rid) && vector_context_restore(target) != ERROR_OK)
+		return ERROR_FAIL;
+
 	return register_write_direct(target, rid, value);
 }
 
@@ -5244,7 +7111,9 @@ static int riscv013_on_step(struct target *target)
 static enum riscv_halt_reason riscv013_halt_reason(struct target *target)
 {
 	riscv_reg_t dcsr;
-	int result = register_read_direct(target, &dcsr, GDB_REGNO_DCSR);
+	/* dcsr may have been read together with the other harts' by
+	 * riscv_openocd_poll(). */
+	int result = riscv_reg_get(target, &dcsr, GDB_REGNO_DCSR);
 	if (result != ERROR_OK)
 		return RISCV_HALT_UNKNOWN;
 
@@ -5307,11 +7176,137 @@ static int riscv013_invalidate_cached_progbuf(struct target *target)
 	}
 
 	LOG_TARGET_DEBUG(target, "Invalidating progbuf cache");
-	for (unsigned int i = 0; i < 15; i++)
+	for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_cache); i++)
 		dm->progbuf_cache[i] = 0;
+	for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_residents); i++)
+		dm->progbuf_residents[i].start = 0;
 	return ERROR_OK;
 }
 
+/* A program can only run from another place than progbuf0 if it doesn't
+ * depend on its address and stops by itself instead of relying on the
+ * implicit ebreak at the end of the program buffer. */
+static bool progbuf_program_is_relocatable(const riscv_insn_t *insns,
+		unsigned int count)
+{
+	if (count == 0 || insns[count - 1] != ebreak())
+		return false;
+	for (unsigned int i = 0; i < count; i++) {
+		/* Compressed instructions aren't decoded, keep them in place. */
+		if ((insns[i] & 3) != 3)
+			return false;
+		switch (insns[i] & 0x7f) {
+		case MATCH_AUIPC:
+		case MATCH_JAL:
+		case MATCH_BEQ & 0x7f:
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool progbuf_resident_matches(const dm013_info_t *dm,
+		const struct progbuf_resident *resident, const riscv_insn_t *insns,
+		unsigned int count)
+{
+	if (!resident->start || resident->count != count)
+		return false;
+	for (unsigned int i = 0; i < count; i++)
+		if (dm->progbuf_cache[resident->start + i] != insns[i])
+			return false;
+	return true;
+}
+
+static bool progbuf_range_is_free(const dm013_info_t *dm, unsigned int start,
+		unsigned int count)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_residents); i++) {
+		const struct progbuf_resident *resident = &dm->progbuf_residents[i];
+		if (resident->start && start < resident->start + resident->count &&
+				resident->start < start + count)
+			return false;
+	}
+	return true;
+}
+
+static struct progbuf_resident *progbuf_least_recently_used(dm013_info_t *dm)
+{
+	struct progbuf_resident *lru = NULL;
+	for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_residents); i++) {
+		struct progbuf_resident *resident = &dm->progbuf_residents[i];
+		if (resident->start && (!lru || resident->last_use < lru->last_use))
+			lru = resident;
+	}
+	return lru;
+}
+
+/* Most operations alternate between a handful of short programs (e.g. a
+ * register read and a memory access), which makes the plain progbuf cache
+ * miss all the time. With "riscv set_progbuf_residents" enabled such
+ * programs are kept behind progbuf0 and progbuf0 is a jump to the one to
+ * run, so switching between resident programs costs at most one DMI write.
+ * Programs that don't fit or can't be moved are written to progbuf0 as
+ * usual, which overwrites the residents they overlap. */
+static int riscv013_write_program(struct target *target, const riscv_insn_t *insns,
+		unsigned int count)
+{
+	dm013_info_t *dm = get_dm(target);
+	if (!dm)
+		return ERROR_FAIL;
+	RISCV013_INFO(info);
+	RISCV_INFO(r);
+
+	if (!r->progbuf_residents || count + 1 > info->progbufsize ||
+			!progbuf_program_is_relocatable(insns, count)) {
+		for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_residents); i++)
+			if (dm->progbuf_residents[i].start < count)
+				dm->progbuf_residents[i].start = 0;
+		for (unsigned int i = 0; i < count; i++)
+			if (riscv013_write_progbuf(target, i, insns[i]) != ERROR_OK)
+				return ERROR_FAIL;
+		return ERROR_OK;
+	}
+
+	struct progbuf_resident *resident = NULL;
+	for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_residents) && !resident; i++)
+		if (progbuf_resident_matches(dm, &dm->progbuf_residents[i], insns, count))
+			resident = &dm->progbuf_residents[i];
+
+	if (!resident) {
+		for (unsigned int i = 0; i < ARRAY_SIZE(dm->progbuf_residents) && !resident; i++)
+			if (!dm->progbuf_residents[i].start)
+				resident = &dm->progbuf_residents[i];
+		if (!resident)
+			resident = progbuf_least_recently_used(dm);
+		resident->start = 0;
+
+		/* Evict the least recently used programs until there is room,
+		 * with no residents progbuf1 onwards is always free. */
+		unsigned int start = 0;
+		while (!start) {
+			for (unsigned int s = 1; s + count <= info->progbufsize; s++) {
+				if (progbuf_range_is_free(dm, s, count)) {
+					start = s;
+					break;
+				}
+			}
+			if (!start)
+				progbuf_least_recently_used(dm)->start = 0;
+		}
+
+		LOG_TARGET_DEBUG(target, "Loading a program of %u words at progbuf%u",
+				count, start);
+		for (unsigned int i = 0; i < count; i++)
+			if (riscv013_write_progbuf(target, start + i, insns[i]) != ERROR_OK)
+				return ERROR_FAIL;
+		resident->start = start;
+		resident->count = count;
+	}
+
+	resident->last_use = ++dm->progbuf_use;
+	return riscv013_write_progbuf(target, 0, jal(0, resident->start * 4));
+}
+
 static int riscv013_execute_progbuf(struct target *target, uint32_t *cmderr)
 {
 	uint32_t run_program = 0;
@@ -5363,6 +7358,15 @@ static int maybe_execute_fence_i(struct target *target)
 /* Helper Functions. */
 static int riscv013_on_step_or_resume(struct target *target, bool step)
 {
+	riscv013_info_t *info = get_info(target);
+	/* Leave or rejoin the halt group when gdb switched non-stop mode, before
+	 * the hart runs and may halt again */
+	if (info->haltgroup_supported && info->haltgroup != halt_group(target)) {
+		if (set_group(target, NULL, halt_group(target), HALT_GROUP) != ERROR_OK)
+			return ERROR_FAIL;
+		info->haltgroup = halt_group(target);
+	}
+
 	if (maybe_execute_fence_i(target) != ERROR_OK)
 		return ERROR_FAIL;
 
@@ -5371,6 +7375,9 @@ static int riscv013_on_step_or_resume(struct target *target, bool step)
 
 	if (riscv_reg_flush_all(target) != ERROR_OK)
 		return ERROR_FAIL;
+	/* Flushing vector registers may still need the vector set-up. */
+	if (vector_context_restore(target) != ERROR_OK)
+		return ERROR_FAIL;
 	return ERROR_OK;
 }
 
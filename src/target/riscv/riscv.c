@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <time.h>
 
@@ -18,13 +19,17 @@
 #include "target/register.h"
 #include "target/breakpoints.h"
 #include "helper/base64.h"
+#include "helper/fileio.h"
 #include "helper/time_support.h"
 #include "riscv.h"
 #include "riscv_reg.h"
 #include "program.h"
+#include "asm.h"
+#include "batch.h"
 #include "gdb_regs.h"
 #include "rtos/rtos.h"
 #include "debug_defines.h"
+#include <helper/align.h>
 #include <helper/bits.h>
 #include "field_helpers.h"
 
@@ -266,6 +271,8 @@ static const virt2phys_info_t sv57x4 = {
 static enum riscv_halt_reason riscv_halt_reason(struct target *target);
 static void riscv_info_init(struct target *target, struct riscv_info *r);
 static void riscv_invalidate_register_cache(struct target *target);
+static void riscv_tlb_invalidate(struct target *target);
+static void riscv_halt_prefetch(struct target *target);
 static int riscv_step_rtos_hart(struct target *target);
 
 static void riscv_sample_buf_maybe_add_timestamp(struct target *target, bool before)
@@ -284,6 +291,34 @@ static void riscv_sample_buf_maybe_add_timestamp(struct target *target, bool bef
 	}
 }
 
+static void riscv_sample_sink_close(struct riscv_info *r)
+{
+	if (r->sample_sink)
+		fclose(r->sample_sink);
+	r->sample_sink = NULL;
+	free(r->sample_sink_name);
+	r->sample_sink_name = NULL;
+}
+
+/* Append everything collected so far to the sample sink and empty the buffer,
+ * so that sampling can go on for as long as the sink accepts data. */
+static int riscv_sample_buf_drain(struct target *target)
+{
+	RISCV_INFO(r);
+	if (!r->sample_sink || r->sample_buf.used == 0)
+		return ERROR_OK;
+
+	if (fwrite(r->sample_buf.buf, 1, r->sample_buf.used, r->sample_sink) != r->sample_buf.used ||
+			fflush(r->sample_sink) != 0) {
+		LOG_TARGET_ERROR(target, "Failed to write samples to %s; closing the sample sink.",
+				r->sample_sink_name);
+		riscv_sample_sink_close(r);
+		return ERROR_FAIL;
+	}
+	r->sample_buf.used = 0;
+	return ERROR_OK;
+}
+
 static int riscv_resume_go_all_harts(struct target *target);
 
 void select_dmi_via_bscan(struct target *target)
@@ -506,6 +541,25 @@ static void free_wp_triggers_cache(struct target *target)
 	free(r->wp_triggers_negative_cache);
 }
 
+static void free_halt_prefetch_ranges(struct list_head *ranges)
+{
+	range_list_t *entry, *tmp;
+	list_for_each_entry_safe(entry, tmp, ranges, list) {
+		list_del(&entry->list);
+		free(entry->name);
+		free(entry);
+	}
+}
+
+static void free_mem_access_regions(struct list_head *regions)
+{
+	struct riscv_mem_access_region *region, *tmp;
+	list_for_each_entry_safe(region, tmp, regions, list) {
+		list_del(&region->list);
+		free(region);
+	}
+}
+
 static void riscv_deinit_target(struct target *target)
 {
 	LOG_TARGET_DEBUG(target, "riscv_deinit_target()");
@@ -523,6 +577,8 @@ static void riscv_deinit_target(struct target *target)
 
 	riscv_reg_free_all(target);
 	free_wp_triggers_cache(target);
+	/* Shared by all the targets, nothing worth tracing happens anymore. */
+	riscv_dmi_trace_stop();
 
 	if (!info)
 		return;
@@ -543,6 +599,27 @@ static void riscv_deinit_target(struct target *target)
 		free(entry);
 	}
 
+	riscv_sample_sink_close(info);
+	free(info->sample_buf.buf);
+	free(info->examine_snapshot);
+
+	free_halt_prefetch_ranges(&info->halt_prefetch_gpr);
+	free_halt_prefetch_ranges(&info->halt_prefetch_csr);
+
+	struct riscv_matrix_tile *tile, *tile_tmp;
+	list_for_each_entry_safe(tile, tile_tmp, &info->matrix_tiles, list) {
+		free(tile->name);
+		free(tile);
+	}
+
+	struct riscv_pending_sw_breakpoint *pending, *pending_tmp;
+	list_for_each_entry_safe(pending, pending_tmp, &info->pending_sw_breakpoints, list) {
+		list_del(&pending->list);
+		free(pending);
+	}
+
+	free_mem_access_regions(&info->mem_access_regions);
+
 	free(target->arch_info);
 
 	target->arch_info = NULL;
@@ -617,26 +694,109 @@ static int find_first_trigger_by_id(struct target *target, int unique_id)
 	return -1;
 }
 
+static bool trigger_dmode_is_set(struct target *target, riscv_reg_t tdata1)
+{
+	bool dmode_is_set = false;
+	switch (get_field(tdata1, CSR_TDATA1_TYPE(riscv_xlen(target)))) {
+		case CSR_TDATA1_TYPE_LEGACY:
+			/* On these older cores we don't support software using
+			 * triggers. */
+			dmode_is_set = true;
+			break;
+		case CSR_TDATA1_TYPE_MCONTROL:
+			dmode_is_set = tdata1 & CSR_MCONTROL_DMODE(riscv_xlen(target));
+			break;
+		case CSR_TDATA1_TYPE_MCONTROL6:
+			dmode_is_set = tdata1 & CSR_MCONTROL6_DMODE(riscv_xlen(target));
+			break;
+		case CSR_TDATA1_TYPE_ICOUNT:
+			dmode_is_set = tdata1 & CSR_ICOUNT_DMODE(riscv_xlen(target));
+			break;
+		case CSR_TDATA1_TYPE_ITRIGGER:
+			dmode_is_set = tdata1 & CSR_ITRIGGER_DMODE(riscv_xlen(target));
+			break;
+		case CSR_TDATA1_TYPE_ETRIGGER:
+			dmode_is_set = tdata1 & CSR_ETRIGGER_DMODE(riscv_xlen(target));
+			break;
+	}
+	return dmode_is_set;
+}
+
+/* Forget what is known about the contents of the triggers. When
+ * "keep_dmode" is set, tdata2 of triggers that the hart can't write is still
+ * trusted. */
+static void trigger_shadow_invalidate(struct target *target, bool keep_dmode)
+{
+	RISCV_INFO(r);
+	for (unsigned int i = 0; i < ARRAY_SIZE(r->trigger_shadow); i++) {
+		struct riscv_trigger_shadow *shadow = &r->trigger_shadow[i];
+		/* Hit bits and counters in tdata1 change while the hart runs. */
+		shadow->tdata1_valid = false;
+		if (!keep_dmode || !shadow->dmode)
+			shadow->tdata2_valid = false;
+	}
+}
+
+static struct riscv_trigger_shadow *trigger_shadow(struct target *target,
+		unsigned int idx)
+{
+	RISCV_INFO(r);
+	assert(idx < ARRAY_SIZE(r->trigger_shadow));
+	return &r->trigger_shadow[idx];
+}
+
+static void trigger_shadow_set_tdata1(struct target *target, unsigned int idx,
+		riscv_reg_t tdata1)
+{
+	struct riscv_trigger_shadow *shadow = trigger_shadow(target, idx);
+	shadow->tdata1_valid = true;
+	shadow->tdata1 = tdata1;
+	shadow->dmode = tdata1 && trigger_dmode_is_set(target, tdata1);
+}
+
 static int set_trigger(struct target *target, unsigned int idx, riscv_reg_t tdata1, riscv_reg_t tdata2,
 	riscv_reg_t tdata1_ignore_mask)
 {
+	RISCV_INFO(r);
+	struct riscv_trigger_shadow *shadow = trigger_shadow(target, idx);
+	/* Values written behind our back can't be tracked. */
+	const bool use_shadow = !r->manual_hwbp_set;
+	const bool tdata1_is_0 = use_shadow && shadow->tdata1_valid && shadow->tdata1 == 0;
+	const bool tdata2_matches = use_shadow && shadow->tdata2_valid && shadow->tdata2 == tdata2;
+	const bool accepted = use_shadow && shadow->accepted_valid &&
+		shadow->accepted_tdata1 == tdata1 &&
+		shadow->accepted_tdata2 == tdata2 &&
+		shadow->accepted_tdata1_ignore_mask == tdata1_ignore_mask;
+	shadow->tdata1_valid = false;
+	shadow->tdata2_valid = false;
+
 	riscv_reg_t tdata1_rb, tdata2_rb;
 	// Select which trigger to use
 	if (riscv_reg_set(target, GDB_REGNO_TSELECT, idx) != ERROR_OK)
 		return ERROR_FAIL;
 
 	// Disable the trigger by writing 0 to it
-	if (riscv_reg_set(target, GDB_REGNO_TDATA1, 0) != ERROR_OK)
+	if (!tdata1_is_0 && riscv_reg_set(target, GDB_REGNO_TDATA1, 0) != ERROR_OK)
 		return ERROR_FAIL;
 
 	// Set trigger data for tdata2 (and tdata3 if it was supported)
-	if (riscv_reg_set(target, GDB_REGNO_TDATA2, tdata2) != ERROR_OK)
+	if (!tdata2_matches && riscv_reg_set(target, GDB_REGNO_TDATA2, tdata2) != ERROR_OK)
 		return ERROR_FAIL;
 
 	// Set trigger data for tdata1
 	if (riscv_reg_set(target, GDB_REGNO_TDATA1, tdata1) != ERROR_OK)
 		return ERROR_FAIL;
 
+	if (accepted) {
+		/* This trigger took the same configuration before, so there is no
+		 * need to read it back. */
+		LOG_TARGET_DEBUG(target, "Trigger %u is known to support this configuration.", idx);
+		trigger_shadow_set_tdata1(target, idx, shadow->accepted_tdata1_rb);
+		shadow->tdata2_valid = true;
+		shadow->tdata2 = tdata2;
+		return ERROR_OK;
+	}
+
 	// Read back tdata1, tdata2, (tdata3), and check if the configuration is supported
 	if (riscv_reg_get(target, &tdata1_rb, GDB_REGNO_TDATA1) != ERROR_OK)
 		return ERROR_FAIL;
@@ -658,9 +818,20 @@ static int set_trigger(struct target *target, unsigned int idx, riscv_reg_t tdat
 				tdata2, tdata2_rb);
 		if (riscv_reg_set(target, GDB_REGNO_TDATA1, 0) != ERROR_OK)
 			return ERROR_FAIL;
+		trigger_shadow_set_tdata1(target, idx, 0);
+		shadow->tdata2_valid = true;
+		shadow->tdata2 = tdata2_rb;
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
+	trigger_shadow_set_tdata1(target, idx, tdata1_rb);
+	shadow->tdata2_valid = true;
+	shadow->tdata2 = tdata2_rb;
+	shadow->accepted_valid = true;
+	shadow->accepted_tdata1 = tdata1;
+	shadow->accepted_tdata2 = tdata2;
+	shadow->accepted_tdata1_ignore_mask = tdata1_ignore_mask;
+	shadow->accepted_tdata1_rb = tdata1_rb;
 	return ERROR_OK;
 }
 
@@ -1359,6 +1530,58 @@ int riscv_read_by_any_size(struct target *target, target_addr_t address, uint32_
 	return ERROR_FAIL;
 }
 
+static int write_sw_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	uint8_t buff[4] = { 0 };
+	buf_set_u32(buff, 0, breakpoint->length * CHAR_BIT, breakpoint->length == 4 ? ebreak() : ebreak_c());
+	/* Write the ebreak instruction. */
+	if (riscv_write_by_any_size(target, breakpoint->address, breakpoint->length, buff) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to write %d-byte breakpoint instruction at 0x%"
+				TARGET_PRIxADDR, breakpoint->length, breakpoint->address);
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+/* Write the ebreaks of all the software breakpoints set while the hart was
+ * halted. The fence that makes them visible to instruction fetch is done once
+ * for all of them when the hart resumes. */
+static int write_pending_sw_breakpoints(struct target *target)
+{
+	RISCV_INFO(r);
+	if (list_empty(&r->pending_sw_breakpoints))
+		return ERROR_OK;
+
+	int result = ERROR_OK;
+	r->skip_write_fence = true;
+	struct riscv_pending_sw_breakpoint *pending, *tmp;
+	list_for_each_entry_safe(pending, tmp, &r->pending_sw_breakpoints, list) {
+		if (result == ERROR_OK)
+			result = write_sw_breakpoint(target, pending->breakpoint);
+		list_del(&pending->list);
+		free(pending);
+	}
+	r->skip_write_fence = false;
+	return result;
+}
+
+/* Forget the ebreak of a software breakpoint that is still waiting to be
+ * written. Returns false if it has been written already. */
+static bool drop_pending_sw_breakpoint(struct target *target,
+		const struct breakpoint *breakpoint)
+{
+	RISCV_INFO(r);
+	struct riscv_pending_sw_breakpoint *pending;
+	list_for_each_entry(pending, &r->pending_sw_breakpoints, list) {
+		if (pending->breakpoint == breakpoint) {
+			list_del(&pending->list);
+			free(pending);
+			return true;
+		}
+	}
+	return false;
+}
+
 static int riscv_add_breakpoint(struct target *target, struct breakpoint *breakpoint)
 {
 	LOG_TARGET_DEBUG(target, "@0x%" TARGET_PRIxADDR, breakpoint->address);
@@ -1384,12 +1607,17 @@ static int riscv_add_breakpoint(struct target *target, struct breakpoint *breakp
 			return ERROR_FAIL;
 		}
 
-		uint8_t buff[4] = { 0 };
-		buf_set_u32(buff, 0, breakpoint->length * CHAR_BIT, breakpoint->length == 4 ? ebreak() : ebreak_c());
-		/* Write the ebreak instruction. */
-		if (riscv_write_by_any_size(target, breakpoint->address, breakpoint->length, buff) != ERROR_OK) {
-			LOG_TARGET_ERROR(target, "Failed to write %d-byte breakpoint instruction at 0x%"
-					TARGET_PRIxADDR, breakpoint->length, breakpoint->address);
+		if (target->state == TARGET_HALTED) {
+			/* Nothing will execute the ebreak before the hart resumes. */
+			RISCV_INFO(r);
+			struct riscv_pending_sw_breakpoint *pending = malloc(sizeof(*pending));
+			if (!pending) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+			pending->breakpoint = breakpoint;
+			list_add_tail(&pending->list, &r->pending_sw_breakpoints);
+		} else if (write_sw_breakpoint(target, breakpoint) != ERROR_OK) {
 			return ERROR_FAIL;
 		}
 		breakpoint->is_set = true;
@@ -1425,8 +1653,10 @@ static int remove_trigger(struct target *target, int unique_id)
 	bool done = false;
 	for (unsigned int i = 0; i < r->trigger_count; i++) {
 		if (r->trigger_unique_id[i] == unique_id) {
-			riscv_reg_set(target, GDB_REGNO_TSELECT, i);
-			riscv_reg_set(target, GDB_REGNO_TDATA1, 0);
+			r->trigger_shadow[i].tdata1_valid = false;
+			if (riscv_reg_set(target, GDB_REGNO_TSELECT, i) == ERROR_OK &&
+					riscv_reg_set(target, GDB_REGNO_TDATA1, 0) == ERROR_OK)
+				trigger_shadow_set_tdata1(target, i, 0);
 			r->trigger_unique_id[i] = -1;
 			LOG_TARGET_DEBUG(target, "Stop using resource %d for bp %d",
 				i, unique_id);
@@ -1448,12 +1678,18 @@ static int riscv_remove_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
 {
 	if (breakpoint->type == BKPT_SOFT) {
-		/* Write the original instruction. */
-		if (riscv_write_by_any_size(
-				target, breakpoint->address, breakpoint->length, breakpoint->orig_instr) != ERROR_OK) {
-			LOG_TARGET_ERROR(target, "Failed to restore instruction for %d-byte breakpoint at "
-					"0x%" TARGET_PRIxADDR, breakpoint->length, breakpoint->address);
-			return ERROR_FAIL;
+		if (!drop_pending_sw_breakpoint(target, breakpoint)) {
+			RISCV_INFO(r);
+			/* Write the original instruction. */
+			r->skip_write_fence = target->state == TARGET_HALTED;
+			int result = riscv_write_by_any_size(
+				target, breakpoint->address, breakpoint->length, breakpoint->orig_instr);
+			r->skip_write_fence = false;
+			if (result != ERROR_OK) {
+				LOG_TARGET_ERROR(target, "Failed to restore instruction for %d-byte breakpoint at "
+						"0x%" TARGET_PRIxADDR, breakpoint->length, breakpoint->address);
+				return ERROR_FAIL;
+			}
 		}
 
 	} else if (breakpoint->type == BKPT_HARD) {
@@ -1543,17 +1779,33 @@ static int riscv_trigger_detect_hit_bits(struct target *target, int64_t *unique_
 	if (riscv_reg_get(target, &tselect, GDB_REGNO_TSELECT) != ERROR_OK)
 		return ERROR_FAIL;
 
-	*unique_id = RISCV_TRIGGER_HIT_NOT_FOUND;
-	for (unsigned int i = 0; i < r->trigger_count; i++) {
-		if (r->trigger_unique_id[i] == -1)
-			continue;
-
-		if (riscv_reg_set(target, GDB_REGNO_TSELECT, i) != ERROR_OK)
-			return ERROR_FAIL;
+	/* Fetch tdata1 of all the triggers in use at once, if possible */
+	unsigned int in_use[RISCV_MAX_TRIGGERS];
+	riscv_reg_t prefetched[RISCV_MAX_TRIGGERS];
+	bool prefetched_valid[RISCV_MAX_TRIGGERS];
+	unsigned int in_use_count = 0;
+	for (unsigned int i = 0; i < r->trigger_count && i < RISCV_MAX_TRIGGERS; i++) {
+		if (r->trigger_unique_id[i] != -1)
+			in_use[in_use_count++] = i;
+	}
+	if (!r->read_triggers_tdata1 || r->read_triggers_tdata1(target, in_use,
+				in_use_count, prefetched, prefetched_valid) != ERROR_OK) {
+		for (unsigned int i = 0; i < in_use_count; i++)
+			prefetched_valid[i] = false;
+	}
 
+	*unique_id = RISCV_TRIGGER_HIT_NOT_FOUND;
+	for (unsigned int n = 0; n < in_use_count; n++) {
+		const unsigned int i = in_use[n];
 		uint64_t tdata1;
-		if (riscv_reg_get(target, &tdata1, GDB_REGNO_TDATA1) != ERROR_OK)
-			return ERROR_FAIL;
+		if (prefetched_valid[n]) {
+			tdata1 = prefetched[n];
+		} else {
+			if (riscv_reg_set(target, GDB_REGNO_TSELECT, i) != ERROR_OK)
+				return ERROR_FAIL;
+			if (riscv_reg_get(target, &tdata1, GDB_REGNO_TDATA1) != ERROR_OK)
+				return ERROR_FAIL;
+		}
 		int type = get_field(tdata1, CSR_TDATA1_TYPE(riscv_xlen(target)));
 
 		uint64_t hit_mask = 0;
@@ -1586,6 +1838,9 @@ static int riscv_trigger_detect_hit_bits(struct target *target, int64_t *unique_
 		if (tdata1 & hit_mask) {
 			LOG_TARGET_DEBUG(target, "Trigger %u (unique_id=%" PRIi64 ") has hit bit set.",
 				i, r->trigger_unique_id[i]);
+			r->trigger_shadow[i].tdata1_valid = false;
+			if (riscv_reg_set(target, GDB_REGNO_TSELECT, i) != ERROR_OK)
+				return ERROR_FAIL;
 			if (riscv_reg_set(target, GDB_REGNO_TDATA1, tdata1 & ~hit_mask) != ERROR_OK)
 				return ERROR_FAIL;
 
@@ -2167,6 +2422,7 @@ static int riscv_examine(struct target *target)
 	/* Don't need to select dbus, since the first thing we do is read dtmcontrol. */
 
 	RISCV_INFO(info);
+	trigger_shadow_invalidate(target, /* keep_dmode */ false);
 	uint32_t dtmcontrol;
 	if (dtmcontrol_scan(target, 0, &dtmcontrol) != ERROR_OK || dtmcontrol == 0) {
 		LOG_TARGET_ERROR(target, "Could not read dtmcontrol. Check JTAG connectivity/board power.");
@@ -2348,6 +2604,7 @@ static int riscv_halt_go_all_harts(struct target *target)
 		LOG_TARGET_DEBUG(target, "Hart is already halted.");
 		if (target->state != TARGET_HALTED) {
 			target->state = TARGET_HALTED;
+			riscv_halt_prefetch(target);
 			enum riscv_halt_reason halt_reason = riscv_halt_reason(target);
 			if (set_debug_reason(target, halt_reason) != ERROR_OK)
 				return ERROR_FAIL;
@@ -2380,6 +2637,125 @@ static int halt_go(struct target *target)
 	return result;
 }
 
+/**
+ * Read the registers every debugger asks for right after a halt (currently
+ * just the PC) for all the halted harts in "targets" at once, so e.g. a
+ * thread list refresh of a large SMP group doesn't need a round trip per
+ * hart. Failures are not fatal: the registers are then read on demand.
+ */
+static void riscv_prefetch_group_registers(struct list_head *targets)
+{
+	static const enum gdb_regno regnos[] = { GDB_REGNO_DPC };
+
+	unsigned int target_count = 0;
+	struct target_list *entry;
+	foreach_smp_target(entry, targets)
+		++target_count;
+	if (target_count < 2)
+		return;
+
+	struct target **group = calloc(target_count, sizeof(*group));
+	riscv_reg_t *values = calloc(target_count, sizeof(*values));
+	bool *valid = calloc(target_count, sizeof(*valid));
+	if (!group || !values || !valid)
+		goto cleanup;
+
+	for (unsigned int r = 0; r < ARRAY_SIZE(regnos); ++r) {
+		unsigned int group_count = 0;
+		int (*read_register_group)(struct target **targets,
+				unsigned int target_count, enum gdb_regno regno,
+				riscv_reg_t *values, bool *valid) = NULL;
+		foreach_smp_target(entry, targets) {
+			struct target *t = entry->target;
+			struct riscv_info *info = riscv_info(t);
+			if (!target_was_examined(t) || !info->read_register_group ||
+					!riscv_reg_cache_needs_read(t, regnos[r]))
+				continue;
+			if (!read_register_group)
+				read_register_group = info->read_register_group;
+			else if (read_register_group != info->read_register_group)
+				continue;
+			group[group_count++] = t;
+		}
+		if (group_count < 2)
+			continue;
+		if (read_register_group(group, group_count, regnos[r], values, valid)
+				!= ERROR_OK)
+			break;
+		for (unsigned int i = 0; i < group_count; ++i) {
+			if (valid[i])
+				riscv_reg_cache_fill(group[i], regnos[r], values[i]);
+		}
+	}
+
+cleanup:
+	free(group);
+	free(values);
+	free(valid);
+}
+
+/**
+ * Fill the register cache of a freshly halted hart with the registers the
+ * halt handling itself needs (dcsr for the halt reason, dpc) and the ones
+ * configured by "riscv halt_prefetch", reading all of them in one batch.
+ * Failures are not fatal: the registers are then read on demand.
+ */
+static void riscv_halt_prefetch(struct target *target)
+{
+	static const enum gdb_regno halt_entry_regnos[] = {
+		GDB_REGNO_DCSR, GDB_REGNO_DPC
+	};
+
+	RISCV_INFO(r);
+	if (!r->read_registers || target->state != TARGET_HALTED)
+		return;
+
+	unsigned int count = ARRAY_SIZE(halt_entry_regnos);
+	range_list_t *entry;
+	list_for_each_entry(entry, &r->halt_prefetch_gpr, list)
+		count += entry->high - entry->low + 1;
+	list_for_each_entry(entry, &r->halt_prefetch_csr, list)
+		count += entry->high - entry->low + 1;
+	if (count == 0)
+		return;
+
+	enum gdb_regno *regnos = calloc(count, sizeof(*regnos));
+	riscv_reg_t *values = calloc(count, sizeof(*values));
+	bool *valid = calloc(count, sizeof(*valid));
+	if (!regnos || !values || !valid)
+		goto cleanup;
+
+	count = 0;
+	for (unsigned int i = 0; i < ARRAY_SIZE(halt_entry_regnos); ++i) {
+		if (riscv_reg_cache_needs_read(target, halt_entry_regnos[i]))
+			regnos[count++] = halt_entry_regnos[i];
+	}
+	list_for_each_entry(entry, &r->halt_prefetch_gpr, list) {
+		for (unsigned int i = entry->low; i <= entry->high; ++i) {
+			if (riscv_reg_cache_needs_read(target, GDB_REGNO_ZERO + i))
+				regnos[count++] = GDB_REGNO_ZERO + i;
+		}
+	}
+	list_for_each_entry(entry, &r->halt_prefetch_csr, list) {
+		for (unsigned int i = entry->low; i <= entry->high; ++i) {
+			if (riscv_reg_cache_needs_read(target, GDB_REGNO_CSR0 + i))
+				regnos[count++] = GDB_REGNO_CSR0 + i;
+		}
+	}
+
+	if (count > 0 && r->read_registers(target, regnos, count, values, valid) == ERROR_OK) {
+		for (unsigned int i = 0; i < count; ++i) {
+			if (valid[i])
+				riscv_reg_cache_fill(target, regnos[i], values[i]);
+		}
+	}
+
+cleanup:
+	free(regnos);
+	free(values);
+	free(valid);
+}
+
 static int halt_finish(struct target *target)
 {
 	return target_call_event_callbacks(target, TARGET_EVENT_HALTED);
@@ -2396,10 +2772,11 @@ int riscv_halt(struct target *target)
 		return tt->halt(target);
 	}
 
-	LOG_TARGET_DEBUG(target, "halting all harts");
-
 	int result = ERROR_OK;
-	if (target->smp) {
+	/* In non-stop mode gdb stops the harts one by one */
+	if (target->smp && !target->smp_non_stop) {
+		LOG_TARGET_DEBUG(target, "halting all harts");
+
 		struct target_list *tlist;
 		foreach_smp_target(tlist, target->smp_targets) {
 			struct target *t = tlist->target;
@@ -2416,6 +2793,11 @@ int riscv_halt(struct target *target)
 			}
 		}
 
+		riscv_prefetch_group_registers(target->smp_targets);
+
+		foreach_smp_target(tlist, target->smp_targets)
+			riscv_halt_prefetch(tlist->target);
+
 		foreach_smp_target(tlist, target->smp_targets) {
 			struct target *t = tlist->target;
 			if (halt_finish(t) != ERROR_OK)
@@ -2427,6 +2809,7 @@ int riscv_halt(struct target *target)
 			result = ERROR_FAIL;
 		if (halt_go(target) != ERROR_OK)
 			result = ERROR_FAIL;
+		riscv_halt_prefetch(target);
 		if (halt_finish(target) != ERROR_OK)
 			return ERROR_FAIL;
 	}
@@ -2441,6 +2824,7 @@ static int riscv_assert_reset(struct target *target)
 	if (!tt)
 		return ERROR_FAIL;
 	riscv_invalidate_register_cache(target);
+	trigger_shadow_invalidate(target, /* keep_dmode */ false);
 	return tt->assert_reset(target);
 }
 
@@ -2558,6 +2942,9 @@ static int resume_prep(struct target *target, int current,
 		if (old_or_new_riscv_step_impl(target, current, address, handle_breakpoints,
 				false /* callbacks are not called */) != ERROR_OK)
 			return ERROR_FAIL;
+		/* The step puts back the breakpoint it stepped over. */
+		if (write_pending_sw_breakpoints(target) != ERROR_OK)
+			return ERROR_FAIL;
 	}
 
 	if (r->get_hart_state) {
@@ -2598,6 +2985,7 @@ static int resume_finish(struct target *target, int debug_execution)
 {
 	assert(target->state == TARGET_HALTED);
 	register_cache_invalidate(target->reg_cache);
+	riscv_tlb_invalidate(target);
 
 	target->state = debug_execution ? TARGET_DEBUG_RUNNING : TARGET_RUNNING;
 	target->debug_reason = DBG_REASON_NOTHALTED;
@@ -2627,7 +3015,7 @@ static int riscv_resume(
 		.target = target
 	};
 
-	if (target->smp && !single_hart) {
+	if (target->smp && !single_hart && !target->smp_non_stop) {
 		targets = target->smp_targets;
 	} else {
 		/* Make a list that just contains a single target, so we can
@@ -2644,6 +3032,14 @@ static int riscv_resume(
 				debug_execution ? "true" : "false");
 
 	struct target_list *tlist;
+	/* Software breakpoints are shared by all the harts, so they have to be in
+	 * memory before any of the harts executes its fence.i. */
+	foreach_smp_target(tlist, targets) {
+		struct target *t = tlist->target;
+		if (t->state == TARGET_HALTED && write_pending_sw_breakpoints(t) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
 	foreach_smp_target_direction(resume_order == RO_NORMAL, tlist, targets) {
 		struct target *t = tlist->target;
 		LOG_TARGET_DEBUG(t, "target->state=%s", target_state_name(t));
@@ -2893,6 +3289,48 @@ static int riscv_address_translate(struct target *target,
 	return ERROR_OK;
 }
 
+static void riscv_tlb_invalidate(struct target *target)
+{
+	RISCV_INFO(r);
+	for (unsigned int i = 0; i < RISCV_TLB_ENTRIES; i++)
+		r->tlb[i].valid = false;
+}
+
+static struct riscv_tlb_entry *riscv_tlb_entry(struct target *target,
+		target_addr_t virtual)
+{
+	RISCV_INFO(r);
+	return &r->tlb[(virtual >> RISCV_PGSHIFT) % RISCV_TLB_ENTRIES];
+}
+
+static bool riscv_tlb_lookup(struct target *target, bool v_mode, riscv_reg_t satp,
+		riscv_reg_t hgatp, target_addr_t virtual, target_addr_t *physical)
+{
+	const struct riscv_tlb_entry *entry = riscv_tlb_entry(target, virtual);
+	const target_addr_t page = virtual >> RISCV_PGSHIFT;
+
+	if (!entry->valid || entry->v_mode != v_mode || entry->satp != satp ||
+			entry->hgatp != hgatp || entry->virtual_page != page)
+		return false;
+
+	*physical = (entry->physical_page << RISCV_PGSHIFT) |
+		(virtual & (RISCV_PGSIZE - 1));
+	return true;
+}
+
+static void riscv_tlb_insert(struct target *target, bool v_mode, riscv_reg_t satp,
+		riscv_reg_t hgatp, target_addr_t virtual, target_addr_t physical)
+{
+	struct riscv_tlb_entry *entry = riscv_tlb_entry(target, virtual);
+
+	entry->valid = true;
+	entry->v_mode = v_mode;
+	entry->satp = satp;
+	entry->hgatp = hgatp;
+	entry->virtual_page = virtual >> RISCV_PGSHIFT;
+	entry->physical_page = physical >> RISCV_PGSHIFT;
+}
+
 /* Virtual to physical translation for hypervisor mode. */
 static int riscv_virt2phys_v(struct target *target, target_addr_t virtual, target_addr_t *physical)
 {
@@ -3021,14 +3459,28 @@ static int riscv_virt2phys(struct target *target, target_addr_t virtual, target_
 		return ERROR_FAIL;
 	}
 
-	if (priv & VIRT_PRIV_V)
-		return riscv_virt2phys_v(target, virtual, physical);
-
-	riscv_reg_t satp_value;
-	if (riscv_reg_get(target, &satp_value, GDB_REGNO_SATP) != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Failed to read SATP register.");
+	/* A backtrace or a memory view translates the same few pages over
+	 * and over, the page walk is only done once per halt */
+	const bool v_mode = priv & VIRT_PRIV_V;
+	riscv_reg_t satp_value, hgatp_value = 0;
+	if (riscv_reg_get(target, &satp_value,
+				v_mode ? GDB_REGNO_VSATP : GDB_REGNO_SATP) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to read %s register.", v_mode ? "vsatp" : "SATP");
 		return ERROR_FAIL;
 	}
+	if (v_mode && riscv_reg_get(target, &hgatp_value, GDB_REGNO_HGATP) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to read hgatp register.");
+		return ERROR_FAIL;
+	}
+	if (riscv_tlb_lookup(target, v_mode, satp_value, hgatp_value, virtual, physical))
+		return ERROR_OK;
+
+	if (v_mode) {
+		if (riscv_virt2phys_v(target, virtual, physical) != ERROR_OK)
+			return ERROR_FAIL;
+		riscv_tlb_insert(target, v_mode, satp_value, hgatp_value, virtual, *physical);
+		return ERROR_OK;
+	}
 
 	unsigned int xlen = riscv_xlen(target);
 	int satp_mode = get_field(satp_value, RISCV_SATP_MODE(xlen));
@@ -3056,10 +3508,51 @@ static int riscv_virt2phys(struct target *target, target_addr_t virtual, target_
 			return ERROR_FAIL;
 	}
 
-	return riscv_address_translate(target,
+	if (riscv_address_translate(target,
 			satp_info, get_field(satp_value, RISCV_SATP_PPN(xlen)),
 			NULL, 0,
-			virtual, physical);
+			virtual, physical) != ERROR_OK)
+		return ERROR_FAIL;
+	riscv_tlb_insert(target, v_mode, satp_value, hgatp_value, virtual, *physical);
+	return ERROR_OK;
+}
+
+/*
+ * Translate the start of an access of count units of size bytes at the
+ * virtual address. *run_count is set to the number of units that follow
+ * physically contiguous from *physical, at least one. A page that fails to
+ * translate ends the run, the error is then reported for that page.
+ */
+static int riscv_translate_range(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, target_addr_t *physical, uint32_t *run_count)
+{
+	int enabled;
+	if (riscv_mmu(target, &enabled) != ERROR_OK)
+		return ERROR_FAIL;
+	if (!enabled) {
+		*physical = address;
+		*run_count = count;
+		return ERROR_OK;
+	}
+
+	int result = target->type->virt2phys(target, address, physical);
+	if (result != ERROR_OK)
+		return result;
+
+	const uint64_t length = (uint64_t)size * count;
+	uint64_t contiguous = RISCV_PGSIZE - (address & (RISCV_PGSIZE - 1));
+	while (contiguous < length) {
+		target_addr_t next;
+		if (target->type->virt2phys(target, address + contiguous, &next) != ERROR_OK ||
+				next != *physical + contiguous)
+			break;
+		contiguous += RISCV_PGSIZE;
+	}
+
+	/* A unit that straddles two pages is accessed at the translation of
+	 * its first byte, as it always was */
+	*run_count = MAX(MIN(contiguous, length) / size, 1);
+	return ERROR_OK;
 }
 
 static int riscv_read_phys_memory(struct target *target, target_addr_t phys_address,
@@ -3077,15 +3570,27 @@ static int riscv_read_memory(struct target *target, target_addr_t address,
 		return ERROR_OK;
 	}
 
-	target_addr_t physical_addr;
-	int result = target->type->virt2phys(target, address, &physical_addr);
-	if (result != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Address translation failed.");
-		return result;
+	RISCV_INFO(r);
+	while (count > 0) {
+		target_addr_t physical_addr;
+		uint32_t run_count;
+		int result = riscv_translate_range(target, address, size, count,
+				&physical_addr, &run_count);
+		if (result != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Address translation failed.");
+			return result;
+		}
+
+		result = r->read_memory(target, physical_addr, size, run_count, buffer, size);
+		if (result != ERROR_OK)
+			return result;
+
+		address += (target_addr_t)size * run_count;
+		buffer += size * run_count;
+		count -= run_count;
 	}
 
-	RISCV_INFO(r);
-	return r->read_memory(target, physical_addr, size, count, buffer, size);
+	return ERROR_OK;
 }
 
 static int riscv_write_phys_memory(struct target *target, target_addr_t phys_address,
@@ -3094,6 +3599,8 @@ static int riscv_write_phys_memory(struct target *target, target_addr_t phys_add
 	struct target_type *tt = get_target_type(target);
 	if (!tt)
 		return ERROR_FAIL;
+	/* the write may change a page table */
+	riscv_tlb_invalidate(target);
 	return tt->write_memory(target, phys_address, size, count, buffer);
 }
 
@@ -3105,36 +3612,159 @@ static int riscv_write_memory(struct target *target, target_addr_t address,
 		return ERROR_OK;
 	}
 
-	target_addr_t physical_addr;
-	int result = target->type->virt2phys(target, address, &physical_addr);
-	if (result != ERROR_OK) {
-		LOG_TARGET_ERROR(target, "Address translation failed.");
-		return result;
-	}
-
 	struct target_type *tt = get_target_type(target);
 	if (!tt)
 		return ERROR_FAIL;
-	return tt->write_memory(target, physical_addr, size, count, buffer);
-}
 
-static const char *riscv_get_gdb_arch(const struct target *target)
-{
-	switch (riscv_xlen(target)) {
-		case 32:
-			return "riscv:rv32";
-		case 64:
-			return "riscv:rv64";
+	while (count > 0) {
+		target_addr_t physical_addr;
+		uint32_t run_count;
+		int result = riscv_translate_range(target, address, size, count,
+				&physical_addr, &run_count);
+		if (result != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Address translation failed.");
+			return result;
+		}
+
+		/* the write may change a page table, translate the rest again */
+		riscv_tlb_invalidate(target);
+		result = tt->write_memory(target, physical_addr, size, run_count, buffer);
+		if (result != ERROR_OK)
+			return result;
+
+		address += (target_addr_t)size * run_count;
+		buffer += size * run_count;
+		count -= run_count;
 	}
-	LOG_TARGET_ERROR(target, "Unsupported xlen: %d", riscv_xlen(target));
-	return NULL;
+
+	return ERROR_OK;
 }
 
-static int riscv_get_gdb_reg_list_internal(struct target *target,
-		struct reg **reg_list[], int *reg_list_size,
-		enum target_register_class reg_class, bool is_read)
+/* Access size for the next chunk of a buffer transfer: the widest one that
+ * is aligned and fits, so the whole buffer is moved with up to "max_size"
+ * accesses after an alignment prologue and before a shorter epilogue. */
+static unsigned int riscv_buffer_access_size(target_addr_t address,
+		uint32_t count, unsigned int max_size)
 {
-	LOG_TARGET_DEBUG(target, "reg_class=%d, read=%d", reg_class, is_read);
+	unsigned int size = 1;
+	while (size < max_size && !(address & size) && count >= 2 * size)
+		size *= 2;
+	return size;
+}
+
+static unsigned int riscv_buffer_max_access_size(struct target *target,
+		target_addr_t address, uint32_t count)
+{
+	RISCV_INFO(r);
+	unsigned int max_size = target_data_bits(target) / 8;
+	if (r->bulk_access_size)
+		max_size = MAX(max_size, r->bulk_access_size(target, address, count));
+	return max_size;
+}
+
+static int riscv_read_buffer(struct target *target, target_addr_t address,
+		uint32_t count, uint8_t *buffer)
+{
+	const unsigned int max_size = riscv_buffer_max_access_size(target, address, count);
+	while (count > 0) {
+		const unsigned int size = riscv_buffer_access_size(address, count, max_size);
+		/* Only the widest accesses are worth a multi-element transfer,
+		 * narrower ones just align the address or finish the buffer. */
+		const uint32_t n = size == max_size ? count / size : 1;
+		int retval = target_read_memory(target, address, size, n, buffer);
+		if (retval != ERROR_OK)
+			return retval;
+		address += size * n;
+		buffer += size * n;
+		count -= size * n;
+	}
+	return ERROR_OK;
+}
+
+static int riscv_write_buffer(struct target *target, target_addr_t address,
+		uint32_t count, const uint8_t *buffer)
+{
+	const unsigned int max_size = riscv_buffer_max_access_size(target, address, count);
+	while (count > 0) {
+		const unsigned int size = riscv_buffer_access_size(address, count, max_size);
+		const uint32_t n = size == max_size ? count / size : 1;
+		int retval = target_write_memory(target, address, size, n, buffer);
+		if (retval != ERROR_OK)
+			return retval;
+		address += size * n;
+		buffer += size * n;
+		count -= size * n;
+	}
+	return ERROR_OK;
+}
+
+static const char *riscv_get_gdb_arch(const struct target *target)
+{
+	switch (riscv_xlen(target)) {
+		case 32:
+			return "riscv:rv32";
+		case 64:
+			return "riscv:rv64";
+	}
+	LOG_TARGET_ERROR(target, "Unsupported xlen: %d", riscv_xlen(target));
+	return NULL;
+}
+
+/**
+ * Read the GPRs, FPRs and CSRs of "reg_list" that aren't cached yet in one
+ * go, so that e.g. gdb's "g" packet doesn't need a round trip per register.
+ * Failures are not fatal: the registers are then read one by one.
+ */
+static int riscv_fetch_registers(struct target *target, struct reg **reg_list,
+		int reg_list_size)
+{
+	RISCV_INFO(r);
+	if (!r->read_registers || target->state != TARGET_HALTED)
+		return ERROR_OK;
+
+	enum gdb_regno *regnos = calloc(reg_list_size, sizeof(*regnos));
+	riscv_reg_t *values = calloc(reg_list_size, sizeof(*values));
+	bool *valid = calloc(reg_list_size, sizeof(*valid));
+	int result = ERROR_OK;
+	if (!regnos || !values || !valid) {
+		result = ERROR_FAIL;
+		goto cleanup;
+	}
+
+	unsigned int count = 0;
+	for (int i = 0; i < reg_list_size; ++i) {
+		if (!reg_list[i])
+			continue;
+		const enum gdb_regno regno = reg_list[i]->number;
+		const bool batchable = (regno > GDB_REGNO_ZERO && regno <= GDB_REGNO_XPR31) ||
+			(regno >= GDB_REGNO_FPR0 && regno <= GDB_REGNO_FPR31) ||
+			(regno >= GDB_REGNO_CSR0 && regno <= GDB_REGNO_CSR4095);
+		if (batchable && riscv_reg_cache_needs_read(target, regno))
+			regnos[count++] = regno;
+	}
+	if (count < 2)
+		goto cleanup;
+
+	result = r->read_registers(target, regnos, count, values, valid);
+	if (result != ERROR_OK)
+		goto cleanup;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (valid[i])
+			riscv_reg_cache_fill(target, regnos[i], values[i]);
+	}
+
+cleanup:
+	free(regnos);
+	free(values);
+	free(valid);
+	return result;
+}
+
+static int riscv_get_gdb_reg_list_internal(struct target *target,
+		struct reg **reg_list[], int *reg_list_size,
+		enum target_register_class reg_class, bool is_read)
+{
+	LOG_TARGET_DEBUG(target, "reg_class=%d, read=%d", reg_class, is_read);
 
 	if (!target->reg_cache) {
 		LOG_TARGET_ERROR(target, "Target not initialized. Return ERROR_FAIL.");
@@ -3161,6 +3791,12 @@ static int riscv_get_gdb_reg_list_internal(struct target *target,
 		assert(!target->reg_cache->reg_list[i].valid ||
 				target->reg_cache->reg_list[i].size > 0);
 		(*reg_list)[i] = &target->reg_cache->reg_list[i];
+	}
+
+	if (is_read)
+		riscv_fetch_registers(target, *reg_list, *reg_list_size);
+
+	for (int i = 0; i < *reg_list_size; i++) {
 		if (is_read &&
 				target->reg_cache->reg_list[i].exist &&
 				!target->reg_cache->reg_list[i].valid) {
@@ -3206,10 +3842,10 @@ static int riscv_arch_state(struct target *target)
 }
 
 /* Algorithm must end with a software breakpoint instruction. */
-static int riscv_run_algorithm(struct target *target, int num_mem_params,
+static int riscv_start_algorithm(struct target *target, int num_mem_params,
 		struct mem_param *mem_params, int num_reg_params,
 		struct reg_param *reg_params, target_addr_t entry_point,
-		target_addr_t exit_point, unsigned int timeout_ms, void *arch_info)
+		target_addr_t exit_point, void *arch_info)
 {
 	RISCV_INFO(info);
 
@@ -3235,10 +3871,9 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	struct reg *reg_pc = register_get_by_name(target->reg_cache, "pc", true);
 	if (!reg_pc || reg_pc->type->get(reg_pc) != ERROR_OK)
 		return ERROR_FAIL;
-	uint64_t saved_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
-	LOG_TARGET_DEBUG(target, "saved_pc=0x%" PRIx64, saved_pc);
+	info->algorithm_saved_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
+	LOG_TARGET_DEBUG(target, "saved_pc=0x%" PRIx64, info->algorithm_saved_pc);
 
-	uint64_t saved_regs[32];
 	for (int i = 0; i < num_reg_params; i++) {
 		LOG_TARGET_DEBUG(target, "save %s", reg_params[i].reg_name);
 		struct reg *r = register_get_by_name(target->reg_cache, reg_params[i].reg_name, false);
@@ -3260,7 +3895,7 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 
 		if (r->type->get(r) != ERROR_OK)
 			return ERROR_FAIL;
-		saved_regs[r->number] = buf_get_u64(r->value, 0, r->size);
+		info->algorithm_saved_regs[r->number] = buf_get_u64(r->value, 0, r->size);
 
 		if (reg_params[i].direction == PARAM_OUT || reg_params[i].direction == PARAM_IN_OUT) {
 			if (r->type->set(r, reg_params[i].value) != ERROR_OK)
@@ -3269,9 +3904,9 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	}
 
 	/* Disable Interrupts before attempting to run the algorithm. */
-	uint64_t current_mstatus;
 	uint64_t irq_disabled_mask = MSTATUS_MIE | MSTATUS_HIE | MSTATUS_SIE | MSTATUS_UIE;
-	if (riscv_interrupts_disable(target, irq_disabled_mask, &current_mstatus) != ERROR_OK)
+	if (riscv_interrupts_disable(target, irq_disabled_mask,
+			&info->algorithm_saved_mstatus) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Run algorithm */
@@ -3279,10 +3914,28 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	if (riscv_resume(target, 0, entry_point, 0, 1, true) != ERROR_OK)
 		return ERROR_FAIL;
 
+	return ERROR_OK;
+}
+
+static int riscv_wait_algorithm(struct target *target, int num_mem_params,
+		struct mem_param *mem_params, int num_reg_params,
+		struct reg_param *reg_params, target_addr_t exit_point,
+		unsigned int timeout_ms, void *arch_info)
+{
+	RISCV_INFO(info);
+
+	struct reg *reg_pc = register_get_by_name(target->reg_cache, "pc", true);
+	if (!reg_pc)
+		return ERROR_FAIL;
+
+	/* The algorithm may have been started long ago and be streaming data
+	 * with the host, see target_run_flash_async_algorithm(). */
+	bool timed_out = false;
 	int64_t start = timeval_ms();
 	while (target->state != TARGET_HALTED) {
-		LOG_TARGET_DEBUG(target, "poll()");
 		int64_t now = timeval_ms();
+		if (now - start > 500)
+			keep_alive();
 		if (now - start > timeout_ms) {
 			LOG_TARGET_ERROR(target, "Algorithm timed out after %" PRId64 " ms.", now - start);
 			riscv_halt(target);
@@ -3307,7 +3960,11 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 
 				LOG_TARGET_ERROR(target, "%s = 0x%" PRIx64, riscv_reg_gdb_regno_name(target, regno), reg_value);
 			}
-			return ERROR_TARGET_TIMEOUT;
+			if (target->state != TARGET_HALTED)
+				return ERROR_TARGET_TIMEOUT;
+			/* restore the context saved at start anyway */
+			timed_out = true;
+			break;
 		}
 
 		int result = old_or_new_riscv_poll(target);
@@ -3322,25 +3979,25 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	if (reg_pc->type->get(reg_pc) != ERROR_OK)
 		return ERROR_FAIL;
 	uint64_t final_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
-	if (exit_point && final_pc != exit_point) {
+	if (!timed_out && exit_point && final_pc != exit_point) {
 		LOG_TARGET_ERROR(target, "PC ended up at 0x%" PRIx64 " instead of 0x%"
 				TARGET_PRIxADDR, final_pc, exit_point);
 		return ERROR_FAIL;
 	}
 
 	/* Restore Interrupts */
-	if (riscv_interrupts_restore(target, current_mstatus) != ERROR_OK)
+	if (riscv_interrupts_restore(target, info->algorithm_saved_mstatus) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* Restore registers */
 	uint8_t buf[8] = { 0 };
-	buf_set_u64(buf, 0, info->xlen, saved_pc);
+	buf_set_u64(buf, 0, info->xlen, info->algorithm_saved_pc);
 	if (reg_pc->type->set(reg_pc, buf) != ERROR_OK)
 		return ERROR_FAIL;
 
 	for (int i = 0; i < num_reg_params; i++) {
-		if (reg_params[i].direction == PARAM_IN ||
-				reg_params[i].direction == PARAM_IN_OUT) {
+		if (!timed_out && (reg_params[i].direction == PARAM_IN ||
+				reg_params[i].direction == PARAM_IN_OUT)) {
 			struct reg *r = register_get_by_name(target->reg_cache, reg_params[i].reg_name, false);
 			if (r->type->get(r) != ERROR_OK) {
 				LOG_TARGET_ERROR(target, "get(%s) failed", r->name);
@@ -3350,13 +4007,16 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 		}
 		LOG_TARGET_DEBUG(target, "restore %s", reg_params[i].reg_name);
 		struct reg *r = register_get_by_name(target->reg_cache, reg_params[i].reg_name, false);
-		buf_set_u64(buf, 0, info->xlen, saved_regs[r->number]);
+		buf_set_u64(buf, 0, info->xlen, info->algorithm_saved_regs[r->number]);
 		if (r->type->set(r, buf) != ERROR_OK) {
 			LOG_TARGET_ERROR(target, "set(%s) failed", r->name);
 			return ERROR_FAIL;
 		}
 	}
 
+	if (timed_out)
+		return ERROR_TARGET_TIMEOUT;
+
 	/* Read memory parameters from the target memory */
 	for (int i = 0; i < num_mem_params; i++) {
 		if (mem_params[i].direction == PARAM_IN ||
@@ -3375,6 +4035,27 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	return ERROR_OK;
 }
 
+static int riscv_run_algorithm(struct target *target, int num_mem_params,
+		struct mem_param *mem_params, int num_reg_params,
+		struct reg_param *reg_params, target_addr_t entry_point,
+		target_addr_t exit_point, unsigned int timeout_ms, void *arch_info)
+{
+	int retval = riscv_start_algorithm(target, num_mem_params, mem_params,
+			num_reg_params, reg_params, entry_point, exit_point, arch_info);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return riscv_wait_algorithm(target, num_mem_params, mem_params,
+			num_reg_params, reg_params, exit_point, timeout_ms, arch_info);
+}
+
+static const uint8_t riscv32_crc_code[] = {
+#include "../../../contrib/loaders/checksum/riscv32_crc.inc"
+};
+static const uint8_t riscv64_crc_code[] = {
+#include "../../../contrib/loaders/checksum/riscv64_crc.inc"
+};
+
 static int riscv_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t count,
 		uint32_t *checksum)
@@ -3385,13 +4066,6 @@ static int riscv_checksum_memory(struct target *target,
 
 	LOG_TARGET_DEBUG(target, "address=0x%" TARGET_PRIxADDR "; count=0x%" PRIx32, address, count);
 
-	static const uint8_t riscv32_crc_code[] = {
-#include "../../../contrib/loaders/checksum/riscv32_crc.inc"
-	};
-	static const uint8_t riscv64_crc_code[] = {
-#include "../../../contrib/loaders/checksum/riscv64_crc.inc"
-	};
-
 	static const uint8_t *crc_code;
 
 	unsigned xlen = riscv_xlen(target);
@@ -3424,8 +4098,8 @@ static int riscv_checksum_memory(struct target *target,
 		return ERROR_FAIL;
 	}
 
-	retval = target_write_buffer(target, crc_algorithm->address, crc_code_size,
-			crc_code);
+	retval = target_write_working_area_code(target, crc_algorithm, crc_code,
+			crc_code_size);
 	if (retval != ERROR_OK) {
 		LOG_TARGET_ERROR(target, "Failed to write code to " TARGET_ADDR_FMT ": %d",
 				crc_algorithm->address, retval);
@@ -3461,6 +4135,511 @@ static int riscv_checksum_memory(struct target *target,
 	return retval;
 }
 
+/* Words of the driver loop appended to the CRC code by
+ * riscv_checksum_memory_list(). */
+#define CRC_LIST_DRIVER_WORDS	8
+
+/* Registers used by the CRC code and its driver loop, restored afterwards.
+ * a6 and a7 are only used by the 64-bit code, s0 is called fp. */
+static char * const crc_list_reg_names[] = {
+	"fp", "s1", "ra", "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"
+};
+
+/**
+ * Checksum the blocks with one run of the CRC code. The code ends with an
+ * ebreak right before its "return crc", which is replaced by a nop so that
+ * a small driver loop can call it for every block of a table in the
+ * working area: {address, size, crc} words of xlen bits each.
+ */
+static int riscv_checksum_memory_list(struct target *target,
+		struct target_memory_checksum_block *blocks, unsigned int num_blocks)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	const unsigned int xlen_bytes = xlen / 8;
+	const uint8_t *crc_code = xlen == 32 ? riscv32_crc_code : riscv64_crc_code;
+	const uint32_t crc_code_size = xlen == 32 ? sizeof(riscv32_crc_code) :
+		sizeof(riscv64_crc_code);
+
+	/* Find "ebreak; mv a0, a5; ret" */
+	uint32_t ebreak_offset = 0;
+	for (uint32_t offset = 0; offset + 12 <= crc_code_size; offset += 4) {
+		if (le_to_h_u32(crc_code + offset) == ebreak() &&
+				le_to_h_u32(crc_code + offset + 4) == addi(A0, 15, 0) &&
+				le_to_h_u32(crc_code + offset + 8) == jalr(ZERO, RA, 0)) {
+			ebreak_offset = offset;
+			break;
+		}
+	}
+	if (!ebreak_offset) {
+		LOG_TARGET_DEBUG(target, "CRC code can't be called as a function");
+		return ERROR_FAIL;
+	}
+
+	const uint32_t driver_offset = ALIGN_UP(crc_code_size, 4);
+	const uint32_t code_size = driver_offset + 4 * CRC_LIST_DRIVER_WORDS;
+	uint8_t *code = calloc(1, code_size);
+	if (!code) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	memcpy(code, crc_code, crc_code_size);
+	/* nop */
+	h_u32_to_le(code + ebreak_offset, addi(ZERO, ZERO, 0));
+	const uint32_t driver[CRC_LIST_DRIVER_WORDS] = {
+		load(target, A0, S0, 0),
+		load(target, A1, S0, xlen_bytes),
+		jal(RA, -(driver_offset + 8)),
+		sw(A0, S0, 2 * xlen_bytes),
+		addi(S0, S0, 3 * xlen_bytes),
+		addi(S1, S1, -1),
+		bne(S1, ZERO, -24),
+		ebreak()
+	};
+	for (unsigned int i = 0; i < CRC_LIST_DRIVER_WORDS; i++)
+		h_u32_to_le(code + driver_offset + 4 * i, driver[i]);
+
+	struct working_area *crc_algorithm = NULL;
+	struct working_area *table = NULL;
+	uint8_t *table_buf = NULL;
+	struct reg_param reg_params[ARRAY_SIZE(crc_list_reg_names)];
+	const unsigned int num_reg_params = xlen == 32 ? ARRAY_SIZE(crc_list_reg_names) - 2 :
+		ARRAY_SIZE(crc_list_reg_names);
+	unsigned int count = num_blocks;
+	int retval = target_alloc_working_area(target, code_size, &crc_algorithm);
+	if (retval != ERROR_OK)
+		goto free_code;
+
+	/* A smaller table means more runs, but still a lot less than one per
+	 * block. */
+	const uint32_t entry_size = 3 * xlen_bytes;
+	while (target_alloc_working_area_try(target, count * entry_size, &table) != ERROR_OK) {
+		if (count == 1) {
+			retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+			goto free_areas;
+		}
+		count /= 2;
+	}
+
+	/* Stop at the first block the algorithm itself would be in. */
+	target_addr_t total = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		const target_addr_t start = blocks[i].address;
+		const target_addr_t end = start + blocks[i].size;
+		if ((start < crc_algorithm->address + crc_algorithm->size &&
+					crc_algorithm->address < end) ||
+				(start < table->address + table->size && table->address < end)) {
+			count = i;
+			break;
+		}
+		total += blocks[i].size;
+	}
+	if (count == 0) {
+		retval = ERROR_FAIL;
+		goto free_areas;
+	}
+
+	retval = target_write_working_area_code(target, crc_algorithm, code, code_size);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to write code to " TARGET_ADDR_FMT ": %d",
+				crc_algorithm->address, retval);
+		goto free_areas;
+	}
+
+	table_buf = calloc(count, entry_size);
+	if (!table_buf) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto free_areas;
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		uint8_t *entry = table_buf + i * entry_size;
+		if (xlen == 32) {
+			target_buffer_set_u32(target, entry, blocks[i].address);
+			target_buffer_set_u32(target, entry + xlen_bytes, blocks[i].size);
+		} else {
+			target_buffer_set_u64(target, entry, blocks[i].address);
+			target_buffer_set_u64(target, entry + xlen_bytes, blocks[i].size);
+		}
+	}
+	retval = target_write_buffer(target, table->address, count * entry_size, table_buf);
+	if (retval != ERROR_OK)
+		goto free_areas;
+
+	init_reg_param(&reg_params[0], crc_list_reg_names[0], xlen, PARAM_OUT);
+	init_reg_param(&reg_params[1], crc_list_reg_names[1], xlen, PARAM_OUT);
+	for (unsigned int i = 2; i < num_reg_params; i++)
+		init_reg_param(&reg_params[i], crc_list_reg_names[i], xlen, PARAM_IN);
+	buf_set_u64(reg_params[0].value, 0, xlen, table->address);
+	buf_set_u64(reg_params[1].value, 0, xlen, count);
+
+	/* 20 second timeout/megabyte, as for a single block */
+	unsigned int timeout = 20000 * (1 + (total / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, num_reg_params, reg_params,
+			crc_algorithm->address + driver_offset,
+			0,	/* Leave exit point unspecified because we don't know. */
+			timeout, NULL);
+	for (unsigned int i = 0; i < num_reg_params; i++)
+		destroy_reg_param(&reg_params[i]);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Error executing RISC-V CRC algorithm.");
+		goto free_areas;
+	}
+
+	retval = target_read_buffer(target, table->address, count * entry_size, table_buf);
+	if (retval != ERROR_OK)
+		goto free_areas;
+	for (unsigned int i = 0; i < count; i++)
+		blocks[i].checksum = target_buffer_get_u32(target,
+				table_buf + i * entry_size + 2 * xlen_bytes);
+
+	LOG_TARGET_DEBUG(target, "checksummed %u of %u blocks in one run", count, num_blocks);
+	retval = count;
+
+free_areas:
+	free(table_buf);
+	target_free_working_area(target, table);
+	target_free_working_area(target, crc_algorithm);
+free_code:
+	free(code);
+	return retval;
+}
+
+/**
+ * Fill memory with a loop that stores a register, so that only the value
+ * and the range are sent to the target:
+ *	store a2, 0(a0); addi a0, a0, size; bne a0, a1, loop; ebreak
+ */
+static int riscv_fill_memory(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint64_t value)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	uint32_t store_insn;
+
+	switch (size) {
+	case 1:
+		store_insn = sb(A2, A0, 0);
+		break;
+	case 2:
+		store_insn = sh(A2, A0, 0);
+		break;
+	case 4:
+		store_insn = sw(A2, A0, 0);
+		break;
+	case 8:
+		if (xlen < 64)
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		store_insn = sd(A2, A0, 0);
+		break;
+	default:
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	const uint32_t insns[] = {
+		store_insn,
+		addi(A0, A0, size),
+		bne(A0, A1, -8),
+		ebreak()
+	};
+	uint8_t code[sizeof(insns)];
+	for (unsigned int i = 0; i < ARRAY_SIZE(insns); i++)
+		h_u32_to_le(code + 4 * i, insns[i]);
+
+	struct working_area *fill_algorithm;
+	if (target_alloc_working_area(target, sizeof(code), &fill_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	struct reg_param reg_params[3];
+	const target_addr_t end = address + (target_addr_t)size * count;
+	int retval;
+
+	/* The loop can't overwrite itself */
+	if (address < fill_algorithm->address + fill_algorithm->size &&
+			fill_algorithm->address < end) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup;
+	}
+
+	retval = target_write_working_area_code(target, fill_algorithm, code, sizeof(code));
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	init_reg_param(&reg_params[0], "a0", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[1], "a1", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[2], "a2", xlen, PARAM_OUT);
+	buf_set_u64(reg_params[0].value, 0, xlen, address);
+	buf_set_u64(reg_params[1].value, 0, xlen, end);
+	buf_set_u64(reg_params[2].value, 0, xlen, value);
+
+	/* 2 second timeout/megabyte */
+	unsigned int timeout = 2000 * (1 + ((target_addr_t)size * count / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, ARRAY_SIZE(reg_params), reg_params,
+			fill_algorithm->address,
+			0,	/* Leave exit point unspecified because we don't know. */
+			timeout, NULL);
+	if (retval != ERROR_OK)
+		LOG_TARGET_ERROR(target, "Error executing RISC-V fill algorithm.");
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+cleanup:
+	target_free_working_area(target, fill_algorithm);
+	return retval;
+}
+
+static const uint8_t riscv32_memtest_code[] = {
+#include "../../../contrib/loaders/memtest/riscv32_memtest.inc"
+};
+static const uint8_t riscv64_memtest_code[] = {
+#include "../../../contrib/loaders/memtest/riscv64_memtest.inc"
+};
+
+static int riscv_memory_test(struct target *target, target_addr_t address,
+		uint32_t size, enum target_memory_test test, uint32_t state,
+		struct target_memory_test_failure *failures, unsigned int max_failures)
+{
+	const unsigned int xlen = riscv_xlen(target);
+	const uint8_t *code = xlen == 32 ? riscv32_memtest_code : riscv64_memtest_code;
+	const uint32_t code_size = xlen == 32 ? sizeof(riscv32_memtest_code) :
+		sizeof(riscv64_memtest_code);
+	/* struct { xlen_t address, uint32_t expected, uint32_t actual } */
+	const uint32_t entry_size = xlen / 8 + 8;
+	const uint32_t log_size = MAX(max_failures, 1) * entry_size;
+	const target_addr_t end = address + size;
+	struct working_area *memtest_algorithm;
+	struct working_area *memtest_log;
+	struct reg_param reg_params[6];
+	uint8_t *log_buf = NULL;
+	int retval;
+
+	if (target_alloc_working_area(target, code_size, &memtest_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	if (target_alloc_working_area(target, log_size, &memtest_log) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto free_algorithm;
+	}
+
+	/* The test can't overwrite its own code or log */
+	if ((address < memtest_algorithm->address + memtest_algorithm->size &&
+				memtest_algorithm->address < end) ||
+			(address < memtest_log->address + memtest_log->size &&
+				memtest_log->address < end)) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto free_log;
+	}
+
+	retval = target_write_working_area_code(target, memtest_algorithm, code, code_size);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Failed to write code to " TARGET_ADDR_FMT ": %d",
+				memtest_algorithm->address, retval);
+		goto free_log;
+	}
+
+	init_reg_param(&reg_params[0], "a0", xlen, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "a1", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[2], "a2", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[3], "a3", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[4], "a4", xlen, PARAM_OUT);
+	init_reg_param(&reg_params[5], "a5", xlen, PARAM_OUT);
+	buf_set_u64(reg_params[0].value, 0, xlen, address);
+	buf_set_u64(reg_params[1].value, 0, xlen, size / 4);
+	buf_set_u64(reg_params[2].value, 0, xlen, test);
+	buf_set_u64(reg_params[3].value, 0, xlen, state);
+	buf_set_u64(reg_params[4].value, 0, xlen, memtest_log->address);
+	buf_set_u64(reg_params[5].value, 0, xlen, max_failures);
+
+	/* 2 second timeout/megabyte */
+	unsigned int timeout = 2000 * (1 + (size / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, ARRAY_SIZE(reg_params), reg_params,
+			memtest_algorithm->address,
+			0,	/* Leave exit point unspecified because we don't know. */
+			timeout, NULL);
+	const uint64_t num_failures = buf_get_u64(reg_params[0].value, 0, xlen);
+	for (unsigned int i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Error executing RISC-V memory test algorithm.");
+		goto free_log;
+	}
+
+	const uint32_t logged = MIN(num_failures, max_failures);
+	if (logged) {
+		log_buf = malloc(logged * entry_size);
+		if (!log_buf) {
+			LOG_ERROR("Out of memory");
+			retval = ERROR_FAIL;
+			goto free_log;
+		}
+		retval = target_read_buffer(target, memtest_log->address,
+				logged * entry_size, log_buf);
+		if (retval != ERROR_OK)
+			goto free_log;
+		for (uint32_t i = 0; i < logged; i++) {
+			const uint8_t *entry = log_buf + i * entry_size;
+			failures[i].address = xlen == 32 ? target_buffer_get_u32(target, entry) :
+				target_buffer_get_u64(target, entry);
+			failures[i].expected = target_buffer_get_u32(target, entry + xlen / 8);
+			failures[i].actual = target_buffer_get_u32(target, entry + xlen / 8 + 4);
+		}
+	}
+
+	LOG_TARGET_DEBUG(target, "%" PRIu64 " failures in 0x%" PRIx32 " bytes at "
+			TARGET_ADDR_FMT, num_failures, size, address);
+	retval = MIN(num_failures, (uint64_t)INT_MAX);
+
+free_log:
+	free(log_buf);
+	target_free_working_area(target, memtest_log);
+free_algorithm:
+	target_free_working_area(target, memtest_algorithm);
+	return retval;
+}
+
+static int riscv_blank_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint8_t erased_value)
+{
+	struct working_area *erase_check_algorithm;
+	struct working_area *erase_check_params;
+	struct reg_param reg_params[2];
+	int retval;
+
+	static bool timed_out;
+
+	static const uint8_t riscv32_erase_check_code[] = {
+#include "../../../contrib/loaders/erase_check/riscv32_erase_check.inc"
+	};
+	static const uint8_t riscv64_erase_check_code[] = {
+#include "../../../contrib/loaders/erase_check/riscv64_erase_check.inc"
+	};
+
+	unsigned int xlen = riscv_xlen(target);
+	const uint8_t *code;
+	uint32_t code_size;
+	if (xlen == 32) {
+		code = riscv32_erase_check_code;
+		code_size = sizeof(riscv32_erase_check_code);
+	} else {
+		code = riscv64_erase_check_code;
+		code_size = sizeof(riscv64_erase_check_code);
+	}
+
+	/* make sure we have a working area */
+	if (target_alloc_working_area(target, code_size,
+			&erase_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = target_write_working_area_code(target, erase_check_algorithm,
+			code, code_size);
+	if (retval != ERROR_OK)
+		goto cleanup1;
+
+	/* blocks array for the algorithm: { size/result, address } of XLEN
+	 * bits each, terminated by a zero size */
+	const unsigned int reg_bytes = xlen / 8;
+	const unsigned int block_bytes = 2 * reg_bytes;
+
+	uint32_t avail = target_get_working_area_avail(target);
+	int blocks_to_check = avail / block_bytes - 1;
+	if (num_blocks < blocks_to_check)
+		blocks_to_check = num_blocks;
+
+	uint32_t param_size = (blocks_to_check + 1) * block_bytes;
+	uint8_t *params = calloc(1, param_size);
+	if (!params) {
+		retval = ERROR_FAIL;
+		goto cleanup1;
+	}
+
+	int i;
+	uint32_t total_size = 0;
+	for (i = 0; i < blocks_to_check; i++) {
+		uint8_t *block = params + i * block_bytes;
+		total_size += blocks[i].size;
+		if (xlen == 32) {
+			target_buffer_set_u32(target, block, blocks[i].size / sizeof(uint32_t));
+			target_buffer_set_u32(target, block + reg_bytes, blocks[i].address);
+		} else {
+			target_buffer_set_u64(target, block, blocks[i].size / sizeof(uint32_t));
+			target_buffer_set_u64(target, block + reg_bytes, blocks[i].address);
+		}
+	}
+
+	if (target_alloc_working_area(target, param_size,
+			&erase_check_params) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = target_write_buffer(target, erase_check_params->address,
+			param_size, params);
+	if (retval != ERROR_OK)
+		goto cleanup3;
+
+	uint32_t erased_word = erased_value | (erased_value << 8)
+			       | (erased_value << 16) | (erased_value << 24);
+
+	LOG_TARGET_DEBUG(target, "Starting erase check of %d blocks, parameters@"
+		TARGET_ADDR_FMT, blocks_to_check, erase_check_params->address);
+
+	init_reg_param(&reg_params[0], "a0", xlen, PARAM_OUT);
+	buf_set_u64(reg_params[0].value, 0, xlen, erase_check_params->address);
+
+	/* lw sign extends on RV64 */
+	init_reg_param(&reg_params[1], "a1", xlen, PARAM_OUT);
+	buf_set_u64(reg_params[1].value, 0, xlen, (int64_t)(int32_t)erased_word);
+
+	/* assume CPU clk at least 1 MHz */
+	unsigned int timeout = (timed_out ? 30000 : 2000) + total_size * 3 / 1000;
+
+	retval = target_run_algorithm(target, 0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			erase_check_algorithm->address,
+			erase_check_algorithm->address + code_size - 4,
+			timeout, NULL);
+
+	timed_out = retval == ERROR_TARGET_TIMEOUT;
+	if (retval != ERROR_OK && !timed_out)
+		goto cleanup4;
+
+	retval = target_read_buffer(target, erase_check_params->address,
+			param_size, params);
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	for (i = 0; i < blocks_to_check; i++) {
+		uint8_t *block = params + i * block_bytes;
+		uint64_t result = xlen == 32 ? target_buffer_get_u32(target, block) :
+			target_buffer_get_u64(target, block);
+		if (result != 0 && result != 1)
+			break;
+
+		blocks[i].result = result;
+	}
+	if (i && timed_out)
+		LOG_TARGET_INFO(target, "Slow CPU clock: %d blocks checked, %d remain. Continuing...",
+			i, num_blocks - i);
+
+	retval = i;		/* return number of blocks really checked */
+
+cleanup4:
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+cleanup3:
+	target_free_working_area(target, erase_check_params);
+cleanup2:
+	free(params);
+cleanup1:
+	target_free_working_area(target, erase_check_algorithm);
+
+	return retval;
+}
+
 /*** OpenOCD Helper Functions ***/
 
 enum riscv_next_action {
@@ -3468,7 +4647,80 @@ enum riscv_next_action {
 	RPH_RESUME,
 	RPH_REMAIN_HALTED
 };
-static int riscv_poll_hart(struct target *target, enum riscv_next_action *next_action)
+/**
+ * Get the state of all the harts in "targets" at once and read dcsr, which
+ * gives the halt reason, of the ones that just halted together too, so that
+ * polling a large SMP group doesn't need a few round trips per hart.
+ * "states[i]" and "dcsr[i]" are only set if "state_valid[i]" resp.
+ * "dcsr_valid[i]" is; failures are not fatal, the harts are then polled the
+ * usual way.
+ */
+static void riscv_poll_group_prefetch(struct target **targets, unsigned int count,
+		enum riscv_hart_state *states, bool *state_valid, riscv_reg_t *dcsr,
+		bool *dcsr_valid)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		state_valid[i] = false;
+		dcsr_valid[i] = false;
+	}
+	if (count < 2)
+		return;
+
+	struct riscv_info *first = riscv_info(targets[0]);
+	if (!first->get_hart_state_group)
+		return;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (!target_was_examined(targets[i]) ||
+				riscv_info(targets[i])->get_hart_state_group != first->get_hart_state_group)
+			return;
+	}
+
+	if (first->get_hart_state_group(targets, count, states, state_valid) != ERROR_OK)
+		return;
+
+	if (!first->read_register_group)
+		return;
+
+	struct target **halted = calloc(count, sizeof(*halted));
+	unsigned int *index = calloc(count, sizeof(*index));
+	riscv_reg_t *values = calloc(count, sizeof(*values));
+	bool *valid = calloc(count, sizeof(*valid));
+	if (!halted || !index || !values || !valid)
+		goto cleanup;
+
+	unsigned int halted_count = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (state_valid[i] && states[i] == RISCV_STATE_HALTED &&
+				targets[i]->state != TARGET_HALTED &&
+				riscv_info(targets[i])->read_register_group == first->read_register_group) {
+			halted[halted_count] = targets[i];
+			index[halted_count] = i;
+			++halted_count;
+		}
+	}
+	if (halted_count < 2)
+		goto cleanup;
+
+	if (first->read_register_group(halted, halted_count, GDB_REGNO_DCSR, values,
+				valid) != ERROR_OK)
+		goto cleanup;
+	for (unsigned int i = 0; i < halted_count; ++i) {
+		dcsr[index[i]] = values[i];
+		dcsr_valid[index[i]] = valid[i];
+	}
+
+cleanup:
+	free(halted);
+	free(index);
+	free(values);
+	free(valid);
+}
+
+/* "known_state" and "halt_dcsr" may be passed if they were read already with
+ * riscv_poll_group_prefetch(). */
+static int riscv_poll_hart(struct target *target,
+		const enum riscv_hart_state *known_state, const riscv_reg_t *halt_dcsr,
+		enum riscv_next_action *next_action)
 {
 	RISCV_INFO(r);
 
@@ -3503,7 +4755,9 @@ static int riscv_poll_hart(struct target *target, enum riscv_next_action *next_a
 	/* If OpenOCD thinks we're running but this hart is halted then it's time
 	 * to raise an event. */
 	enum riscv_hart_state state;
-	if (riscv_get_hart_state(target, &state) != ERROR_OK)
+	if (known_state)
+		state = *known_state;
+	else if (riscv_get_hart_state(target, &state) != ERROR_OK)
 		return ERROR_FAIL;
 
 	if (state == RISCV_STATE_NON_EXISTENT) {
@@ -3527,6 +4781,11 @@ static int riscv_poll_hart(struct target *target, enum riscv_next_action *next_a
 				LOG_TARGET_DEBUG(target, "  triggered a halt; previous_target_state=%d",
 					previous_target_state);
 				target->state = TARGET_HALTED;
+				if (halt_dcsr && riscv_reg_cache_needs_read(target, GDB_REGNO_DCSR))
+					riscv_reg_cache_fill(target, GDB_REGNO_DCSR, *halt_dcsr);
+				/* Everything the halt reason, the debug reason and the
+				 * stop reply need, in one go */
+				riscv_halt_prefetch(target);
 				enum riscv_halt_reason halt_reason = riscv_halt_reason(target);
 				if (set_debug_reason(target, halt_reason) != ERROR_OK)
 					return ERROR_FAIL;
@@ -3639,6 +4898,8 @@ static int sample_memory(struct target *target)
 
 exit:
 	riscv_sample_buf_maybe_add_timestamp(target, false);
+	if (riscv_sample_buf_drain(target) != ERROR_OK)
+		LOG_TARGET_INFO(target, "Samples will accumulate in the sample buffer again.");
 	if (result != ERROR_OK) {
 		LOG_TARGET_INFO(target, "Turning off memory sampling because it failed.");
 		r->sample_config.enabled = false;
@@ -3646,6 +4907,68 @@ exit:
 	return result;
 }
 
+/* Number of PC samples read from the target in one go while profiling. */
+#define RISCV_PROFILING_CHUNK 1024
+
+static int riscv_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	RISCV_INFO(r);
+
+	if (!r->pc_sample.enabled)
+		return target_profiling_default(target, samples, max_num_samples,
+				num_samples, seconds);
+
+	struct timeval timeout, now;
+	gettimeofday(&timeout, NULL);
+	timeval_add_time(&timeout, seconds, 0);
+
+	LOG_TARGET_INFO(target, "Starting profiling. Sampling the PC at 0x%" TARGET_PRIxADDR
+			" as fast as we can...", r->pc_sample.address);
+
+	/* Make sure the target is running. */
+	int retval = target_poll(target);
+	if (retval == ERROR_OK && target->state == TARGET_HALTED)
+		retval = target_resume(target, 1, 0, 0, 0);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Error while resuming target");
+		return retval;
+	}
+
+	const uint32_t size = r->pc_sample.size_bytes;
+	uint8_t *buffer = malloc(RISCV_PROFILING_CHUNK * size);
+	if (!buffer) {
+		LOG_ERROR("malloc failed");
+		return ERROR_FAIL;
+	}
+
+	uint32_t sample_count = 0;
+	while (sample_count < max_num_samples) {
+		const uint32_t read_count = MIN(max_num_samples - sample_count,
+				RISCV_PROFILING_CHUNK);
+		/* Increment 0 reads the same address over and over. */
+		retval = r->read_memory(target, r->pc_sample.address, size, read_count,
+				buffer, 0);
+		if (retval != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Error while reading the PC at 0x%" TARGET_PRIxADDR,
+					r->pc_sample.address);
+			break;
+		}
+		/* gmon output only holds 32-bit addresses. */
+		for (uint32_t i = 0; i < read_count; i++)
+			samples[sample_count++] = buf_get_u32(buffer + i * size, 0, 32);
+
+		gettimeofday(&now, NULL);
+		if (timeval_compare(&now, &timeout) > 0)
+			break;
+	}
+	free(buffer);
+
+	LOG_TARGET_INFO(target, "Profiling completed. %" PRIu32 " samples.", sample_count);
+	*num_samples = sample_count;
+	return retval;
+}
+
 /*** OpenOCD Interface ***/
 int riscv_openocd_poll(struct target *target)
 {
@@ -3673,9 +4996,33 @@ int riscv_openocd_poll(struct target *target)
 	unsigned int halted = 0;
 	unsigned int running = 0;
 	struct target_list *entry;
+
+	unsigned int target_count = 0;
+	foreach_smp_target(entry, targets)
+		++target_count;
+
+	struct target **group = calloc(target_count, sizeof(*group));
+	enum riscv_hart_state *states = calloc(target_count, sizeof(*states));
+	bool *state_valid = calloc(target_count, sizeof(*state_valid));
+	riscv_reg_t *dcsr = calloc(target_count, sizeof(*dcsr));
+	bool *dcsr_valid = calloc(target_count, sizeof(*dcsr_valid));
+	bool prefetched = group && states && state_valid && dcsr && dcsr_valid;
+	if (prefetched) {
+		unsigned int i = 0;
+		foreach_smp_target(entry, targets)
+			group[i++] = entry->target;
+		riscv_poll_group_prefetch(group, target_count, states, state_valid,
+				dcsr, dcsr_valid);
+	}
+
+	unsigned int i = 0;
+	int result = ERROR_OK;
 	foreach_smp_target(entry, targets) {
 		struct target *t = entry->target;
 		struct riscv_info *info = riscv_info(t);
+		const bool have_state = prefetched && state_valid[i];
+		const bool have_dcsr = prefetched && dcsr_valid[i];
+		const unsigned int index = i++;
 
 		/* Clear here just in case there were errors and we never got to
 		 * check this flag further down. */
@@ -3685,8 +5032,10 @@ int riscv_openocd_poll(struct target *target)
 			continue;
 
 		enum riscv_next_action next_action;
-		if (riscv_poll_hart(t, &next_action) != ERROR_OK)
-			return ERROR_FAIL;
+		result = riscv_poll_hart(t, have_state ? &states[index] : NULL,
+				have_dcsr ? &dcsr[index] : NULL, &next_action);
+		if (result != ERROR_OK)
+			break;
 
 		switch (next_action) {
 			case RPH_NONE:
@@ -3700,29 +5049,48 @@ int riscv_openocd_poll(struct target *target)
 				should_remain_halted++;
 				break;
 			case RPH_RESUME:
-				should_resume++;
+				/* Only this hart stopped, so only this one goes on */
+				if (t->smp_non_stop)
+					result = riscv_resume(t, true, 0, 0, 0, true);
+				else
+					should_resume++;
 				break;
 		}
+		if (result != ERROR_OK)
+			break;
 	}
 
+	free(group);
+	free(states);
+	free(state_valid);
+	free(dcsr);
+	free(dcsr_valid);
+	if (result != ERROR_OK)
+		return ERROR_FAIL;
+
 	LOG_TARGET_DEBUG(target, "should_remain_halted=%d, should_resume=%d",
 				should_remain_halted, should_resume);
 	if (should_remain_halted && should_resume) {
 		LOG_TARGET_WARNING(target, "%d harts should remain halted, and %d should resume.",
 					should_remain_halted, should_resume);
 	}
-	if (should_remain_halted) {
+	/* In non-stop mode the other harts keep running whatever one of them does */
+	const bool all_stop = !target->smp_non_stop;
+	if (should_remain_halted && all_stop) {
 		LOG_TARGET_DEBUG(target, "halt all; should_remain_halted=%d",
 			should_remain_halted);
 		riscv_halt(target);
 	} else if (should_resume) {
 		LOG_TARGET_DEBUG(target, "resume all");
 		riscv_resume(target, true, 0, 0, 0, false);
-	} else if (halted && running) {
+	} else if (halted && running && all_stop) {
 		LOG_TARGET_DEBUG(target, "halt all; halted=%d",
 			halted);
 		riscv_halt(target);
 	} else {
+		if (halted > 1)
+			riscv_prefetch_group_registers(targets);
+
 		/* For targets that were discovered to be halted, call the
 		 * appropriate callback. */
 		foreach_smp_target(entry, targets)
@@ -3730,6 +5098,7 @@ int riscv_openocd_poll(struct target *target)
 			struct target *t = entry->target;
 			struct riscv_info *info = riscv_info(t);
 			if (info->halted_needs_event_callback) {
+				riscv_halt_prefetch(t);
 				target_call_event_callbacks(t, info->halted_callback_event);
 				info->halted_needs_event_callback = false;
 			}
@@ -3756,6 +5125,17 @@ int riscv_openocd_poll(struct target *target)
 		}
 	}
 
+	/* The whole group was just polled, background polling doesn't need to
+	 * poll it again through each of the other harts. */
+	if (target->smp) {
+		const int64_t next_attempt = timeval_ms() +
+			MAX(target->backoff.interval, TARGET_DEFAULT_POLLING_INTERVAL);
+		foreach_smp_target(entry, targets) {
+			if (entry->target != target)
+				entry->target->backoff.next_attempt = next_attempt;
+		}
+	}
+
 	return ERROR_OK;
 }
 
@@ -3806,6 +5186,7 @@ static int riscv_openocd_step_impl(struct target *target, int current,
 	}
 
 	register_cache_invalidate(target->reg_cache);
+	riscv_tlb_invalidate(target);
 
 	if (info->isrmask_mode == RISCV_ISRMASK_STEPONLY)
 		if (riscv_interrupts_restore(target, current_mstatus) != ERROR_OK) {
@@ -3831,6 +5212,7 @@ _exit:
 
 		target->state = TARGET_HALTED;
 		target->debug_reason = DBG_REASON_SINGLESTEP;
+		riscv_halt_prefetch(target);
 		if (handle_callbacks)
 			target_call_event_callbacks(target, TARGET_EVENT_HALTED);
 	}
@@ -3845,7 +5227,153 @@ int riscv_openocd_step(struct target *target, int current,
 		true /* handle_callbacks */);
 }
 
-/* Command Handlers */
+/**
+ * Single step the hart up to "count" times, writing the address of every
+ * executed instruction to "trace" if not NULL. Unlike "count" calls of
+ * riscv_openocd_step(), triggers, interrupts and dcsr.step are only set up
+ * once and no event callbacks are run in between, so every step costs just
+ * the resume request and the read of dpc and dcsr. Stops early at a
+ * breakpoint or when the hart halts for another reason than the step.
+ */
+static int riscv_step_trace(struct target *target, unsigned int count,
+		FILE *trace, unsigned int *steps)
+{
+	RISCV_INFO(r);
+	*steps = 0;
+
+	riscv_reg_t pc;
+	if (riscv_reg_get(target, &pc, GDB_REGNO_PC) != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* The first step may start on a breakpoint, like "step" does */
+	struct breakpoint *breakpoint = breakpoint_find(target, pc);
+	if (breakpoint && riscv_remove_breakpoint(target, breakpoint) != ERROR_OK)
+		return ERROR_FAIL;
+
+	riscv_reg_t trigger_state[RISCV_MAX_HWBPS] = {0};
+	if (disable_triggers(target, trigger_state) != ERROR_OK)
+		return ERROR_FAIL;
+
+	int result = ERROR_OK;
+	uint64_t current_mstatus;
+	const bool mask_interrupts = r->isrmask_mode == RISCV_ISRMASK_STEPONLY;
+	if (mask_interrupts && riscv_interrupts_disable(target,
+				MSTATUS_MIE | MSTATUS_HIE | MSTATUS_SIE | MSTATUS_UIE,
+				&current_mstatus) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Unable to disable interrupts.");
+		result = ERROR_FAIL;
+		goto restore_triggers;
+	}
+
+	if (r->on_step(target) != ERROR_OK) {
+		result = ERROR_FAIL;
+		goto restore_interrupts;
+	}
+
+	while (*steps < count) {
+		if (r->step_current_hart(target) != ERROR_OK ||
+				target->state != TARGET_HALTED) {
+			LOG_TARGET_ERROR(target, "Hart was not halted after single step!");
+			result = ERROR_FAIL;
+			break;
+		}
+		++*steps;
+		if (trace)
+			fprintf(trace, "0x%" PRIx64 "\n", pc);
+
+		register_cache_invalidate(target->reg_cache);
+		riscv_tlb_invalidate(target);
+		/* dpc and dcsr in one batch */
+		riscv_halt_prefetch(target);
+		riscv_reg_t dcsr;
+		if (riscv_reg_get(target, &pc, GDB_REGNO_PC) != ERROR_OK ||
+				riscv_reg_get(target, &dcsr, GDB_REGNO_DCSR) != ERROR_OK) {
+			result = ERROR_FAIL;
+			break;
+		}
+		if (get_field(dcsr, CSR_DCSR_CAUSE) != CSR_DCSR_CAUSE_STEP) {
+			LOG_TARGET_DEBUG(target, "Halted for cause %d, stopping the trace.",
+					(int)get_field(dcsr, CSR_DCSR_CAUSE));
+			break;
+		}
+		if (breakpoint_find(target, pc))
+			break;
+	}
+
+restore_interrupts:
+	if (mask_interrupts && riscv_interrupts_restore(target, current_mstatus) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Unable to restore interrupts.");
+		result = ERROR_FAIL;
+	}
+
+restore_triggers:
+	if (enable_triggers(target, trigger_state) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Unable to enable triggers.");
+		result = ERROR_FAIL;
+	}
+
+	if (breakpoint && riscv_add_breakpoint(target, breakpoint) != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Unable to restore the disabled breakpoint.");
+		result = ERROR_FAIL;
+	}
+
+	if (*steps > 0) {
+		target->state = TARGET_RUNNING;
+		target_call_event_callbacks(target, TARGET_EVENT_RESUMED);
+		target->state = TARGET_HALTED;
+		target->debug_reason = DBG_REASON_SINGLESTEP;
+		riscv_halt_prefetch(target);
+		target_call_event_callbacks(target, TARGET_EVENT_HALTED);
+	}
+
+	return result;
+}
+
+/* Command Handlers */
+COMMAND_HANDLER(riscv_step_trace_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	if (!r->get_hart_state) {
+		command_print(CMD, "step_trace is not supported on this target");
+		return ERROR_FAIL;
+	}
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD, "target %s is not halted", target_name(target));
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	unsigned int count;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], count);
+
+	FILE *trace = NULL;
+	if (CMD_ARGC == 2) {
+		trace = fopen(CMD_ARGV[1], "w");
+		if (!trace) {
+			command_print(CMD, "can't open %s: %s", CMD_ARGV[1], strerror(errno));
+			return ERROR_FAIL;
+		}
+		/* Thousands of lines per second, don't write them one by one */
+		setvbuf(trace, NULL, _IOFBF, 64 * 1024);
+	}
+
+	unsigned int steps;
+	int result = riscv_step_trace(target, count, trace, &steps);
+
+	if (trace && fclose(trace) != 0) {
+		command_print(CMD, "error writing %s: %s", CMD_ARGV[1], strerror(errno));
+		result = ERROR_FAIL;
+	}
+
+	riscv_reg_t pc;
+	if (result == ERROR_OK && riscv_reg_get(target, &pc, GDB_REGNO_PC) == ERROR_OK)
+		command_print(CMD, "%u steps, pc 0x%" PRIx64, steps, pc);
+	return result;
+}
+
 COMMAND_HANDLER(riscv_set_command_timeout_sec)
 {
 	if (CMD_ARGC != 1) {
@@ -3880,30 +5408,45 @@ COMMAND_HANDLER(riscv_set_reset_timeout_sec)
 	return ERROR_OK;
 }
 
-COMMAND_HANDLER(riscv_set_mem_access)
+static const char *mem_access_method_name(int method)
+{
+	switch (method) {
+	case RISCV_MEM_ACCESS_PROGBUF:
+		return "progbuf";
+	case RISCV_MEM_ACCESS_SYSBUS:
+		return "sysbus";
+	case RISCV_MEM_ACCESS_ABSTRACT:
+		return "abstract";
+	default:
+		return "unspecified";
+	}
+}
+
+/* Parse a list of memory access methods, in order of priority, into
+ * "methods". */
+static int parse_mem_access_methods(unsigned int argc, const char **argv,
+		int methods[RISCV_NUM_MEM_ACCESS_METHODS])
 {
-	struct target *target = get_current_target(CMD_CTX);
-	RISCV_INFO(r);
 	int progbuf_cnt = 0;
 	int sysbus_cnt = 0;
 	int abstract_cnt = 0;
 
-	if (CMD_ARGC < 1 || CMD_ARGC > RISCV_NUM_MEM_ACCESS_METHODS) {
-		LOG_ERROR("Command takes 1 to %d parameters", RISCV_NUM_MEM_ACCESS_METHODS);
+	if (argc < 1 || argc > RISCV_NUM_MEM_ACCESS_METHODS) {
+		LOG_ERROR("Command takes 1 to %d memory access methods", RISCV_NUM_MEM_ACCESS_METHODS);
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
 
 	/* Check argument validity */
-	for (unsigned int i = 0; i < CMD_ARGC; i++) {
-		if (strcmp("progbuf", CMD_ARGV[i]) == 0) {
+	for (unsigned int i = 0; i < argc; i++) {
+		if (strcmp("progbuf", argv[i]) == 0) {
 			progbuf_cnt++;
-		} else if (strcmp("sysbus", CMD_ARGV[i]) == 0) {
+		} else if (strcmp("sysbus", argv[i]) == 0) {
 			sysbus_cnt++;
-		} else if (strcmp("abstract", CMD_ARGV[i]) == 0) {
+		} else if (strcmp("abstract", argv[i]) == 0) {
 			abstract_cnt++;
 		} else {
 			LOG_ERROR("Unknown argument '%s'. "
-				"Must be one of: 'progbuf', 'sysbus' or 'abstract'.", CMD_ARGV[i]);
+				"Must be one of: 'progbuf', 'sysbus' or 'abstract'.", argv[i]);
 			return ERROR_COMMAND_SYNTAX_ERROR;
 		}
 	}
@@ -3914,16 +5457,206 @@ COMMAND_HANDLER(riscv_set_mem_access)
 
 	/* Args are valid, store them */
 	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS; i++)
-		r->mem_access_methods[i] = RISCV_MEM_ACCESS_UNSPECIFIED;
-	for (unsigned int i = 0; i < CMD_ARGC; i++) {
-		if (strcmp("progbuf", CMD_ARGV[i]) == 0)
-			r->mem_access_methods[i] = RISCV_MEM_ACCESS_PROGBUF;
-		else if (strcmp("sysbus", CMD_ARGV[i]) == 0)
-			r->mem_access_methods[i] = RISCV_MEM_ACCESS_SYSBUS;
-		else if (strcmp("abstract", CMD_ARGV[i]) == 0)
-			r->mem_access_methods[i] = RISCV_MEM_ACCESS_ABSTRACT;
+		methods[i] = RISCV_MEM_ACCESS_UNSPECIFIED;
+	for (unsigned int i = 0; i < argc; i++) {
+		if (strcmp("progbuf", argv[i]) == 0)
+			methods[i] = RISCV_MEM_ACCESS_PROGBUF;
+		else if (strcmp("sysbus", argv[i]) == 0)
+			methods[i] = RISCV_MEM_ACCESS_SYSBUS;
+		else if (strcmp("abstract", argv[i]) == 0)
+			methods[i] = RISCV_MEM_ACCESS_ABSTRACT;
+	}
+	return ERROR_OK;
+}
+
+const int *riscv_mem_access_methods(struct target *target, target_addr_t address,
+		target_addr_t size, struct riscv_mem_access_region **region)
+{
+	RISCV_INFO(r);
+
+	const int *methods = r->mem_access_methods;
+	*region = NULL;
+
+	struct riscv_mem_access_region *entry;
+	list_for_each_entry(entry, &r->mem_access_regions, list) {
+		/* The access must lie entirely within the region; otherwise the
+		 * target-wide methods are used. */
+		if (address >= entry->address && size <= entry->size &&
+				address - entry->address <= entry->size - size) {
+			*region = entry;
+			methods = entry->methods;
+			break;
+		}
+	}
+
+	if (!target->background_access)
+		return methods;
+
+	/* Polling (e.g. RTT) must not halt or wait for the hart, so go through
+	 * the system bus whenever it can do the access. The timing of an "auto"
+	 * region would be skewed by the different order, leave it alone. */
+	*region = NULL;
+	unsigned int n = 0;
+	r->background_mem_access_methods[n++] = RISCV_MEM_ACCESS_SYSBUS;
+	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS &&
+			n < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
+		if (methods[i] == RISCV_MEM_ACCESS_UNSPECIFIED)
+			break;
+		if (methods[i] != RISCV_MEM_ACCESS_SYSBUS)
+			r->background_mem_access_methods[n++] = methods[i];
+	}
+	while (n < RISCV_NUM_MEM_ACCESS_METHODS)
+		r->background_mem_access_methods[n++] = RISCV_MEM_ACCESS_UNSPECIFIED;
+	return r->background_mem_access_methods;
+}
+
+static uint64_t mem_access_bytes_per_ms(const struct riscv_mem_access_region *region,
+		int method)
+{
+	return region->stats[method].bytes * 1000 / MAX(region->stats[method].us, 1);
+}
+
+/* Order the methods of an "auto" region: while learning, the method with the
+ * fewest samples goes first; afterwards the fastest one does. Methods that only
+ * ever failed go last either way. */
+static void mem_access_region_sort(struct target *target,
+		struct riscv_mem_access_region *region)
+{
+	bool learned = true;
+	for (unsigned int i = 0; i < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
+		const int method = region->methods[i];
+		if (method == RISCV_MEM_ACCESS_UNSPECIFIED)
+			break;
+		if (region->stats[method].successes < RISCV_MEM_ACCESS_AUTO_SAMPLES &&
+				(region->stats[method].successes || !region->stats[method].failures))
+			learned = false;
+	}
+
+	/* Insertion sort, stable so the configured order breaks ties. */
+	for (unsigned int i = 1; i < RISCV_NUM_MEM_ACCESS_METHODS; i++) {
+		const int method = region->methods[i];
+		if (method == RISCV_MEM_ACCESS_UNSPECIFIED)
+			break;
+		unsigned int j = i;
+		for (; j > 0; j--) {
+			const int other = region->methods[j - 1];
+			const bool failed = !region->stats[method].successes &&
+				region->stats[method].failures;
+			const bool other_failed = !region->stats[other].successes &&
+				region->stats[other].failures;
+			bool before;
+			if (failed != other_failed)
+				before = other_failed;
+			else if (learned)
+				before = mem_access_bytes_per_ms(region, method) >
+					mem_access_bytes_per_ms(region, other);
+			else
+				before = region->stats[method].successes <
+					region->stats[other].successes;
+			if (!before)
+				break;
+			region->methods[j] = other;
+		}
+		region->methods[j] = method;
+	}
+
+	if (!learned)
+		return;
+	region->auto_done = true;
+	const int best = region->methods[0];
+	LOG_TARGET_INFO(target, "Memory access to 0x%" TARGET_PRIxADDR "+0x%"
+			TARGET_PRIxADDR " will use %s first (%" PRIu64 " bytes/ms).",
+			region->address, region->size, mem_access_method_name(best),
+			mem_access_bytes_per_ms(region, best));
+}
+
+void riscv_mem_access_account(struct target *target,
+		struct riscv_mem_access_region *region, int method, bool success,
+		uint64_t bytes, int64_t elapsed_us)
+{
+	if (!region || !region->auto_select || region->auto_done ||
+			method <= RISCV_MEM_ACCESS_UNSPECIFIED ||
+			method > RISCV_NUM_MEM_ACCESS_METHODS)
+		return;
+
+	if (success) {
+		region->stats[method].successes++;
+		region->stats[method].bytes += bytes;
+		region->stats[method].us += MAX(elapsed_us, 0);
+	} else {
+		region->stats[method].failures++;
+	}
+	mem_access_region_sort(target, region);
+}
+
+static int set_mem_access_region(struct command_invocation *cmd,
+		struct riscv_info *r)
+{
+	if (CMD_ARGC < 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 2 && !strcmp(CMD_ARGV[1], "clear")) {
+		free_mem_access_regions(&r->mem_access_regions);
+		return ERROR_OK;
+	}
+	if (CMD_ARGC < 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t address, size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], address);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[2], size);
+	if (size == 0) {
+		LOG_ERROR("Memory access region size must not be zero.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct riscv_mem_access_region *region = calloc(1, sizeof(*region));
+	if (!region) {
+		LOG_ERROR("Failed to allocate memory access region.");
+		return ERROR_FAIL;
+	}
+	region->address = address;
+	region->size = size;
+
+	unsigned int argc = CMD_ARGC - 3;
+	const char **argv = CMD_ARGV + 3;
+	if (!strcmp(argv[0], "auto")) {
+		region->auto_select = true;
+		argc--;
+		argv++;
+	}
+	int result;
+	if (argc == 0) {
+		/* "auto" on its own chooses between all the methods. */
+		region->methods[0] = RISCV_MEM_ACCESS_PROGBUF;
+		region->methods[1] = RISCV_MEM_ACCESS_SYSBUS;
+		region->methods[2] = RISCV_MEM_ACCESS_ABSTRACT;
+		result = region->auto_select ? ERROR_OK : ERROR_COMMAND_SYNTAX_ERROR;
+	} else {
+		result = parse_mem_access_methods(argc, argv, region->methods);
+	}
+	if (result != ERROR_OK) {
+		free(region);
+		return result;
 	}
 
+	list_add(&region->list, &r->mem_access_regions);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_set_mem_access)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	int result;
+	if (CMD_ARGC > 0 && !strcmp(CMD_ARGV[0], "-region"))
+		result = set_mem_access_region(CMD, r);
+	else
+		result = parse_mem_access_methods(CMD_ARGC, CMD_ARGV, r->mem_access_methods);
+	if (result != ERROR_OK)
+		return result;
+
 	/* Reset warning flags */
 	r->mem_access_progbuf_warn = true;
 	r->mem_access_sysbus_warn = true;
@@ -4107,6 +5840,47 @@ COMMAND_HANDLER(riscv_set_expose_custom)
 	return ret;
 }
 
+COMMAND_HANDLER(riscv_set_halt_prefetch)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(info);
+
+	if (CMD_ARGC == 0) {
+		range_list_t *entry;
+		list_for_each_entry(entry, &info->halt_prefetch_gpr, list)
+			command_print(CMD, "gpr %u-%u", entry->low, entry->high);
+		list_for_each_entry(entry, &info->halt_prefetch_csr, list)
+			command_print(CMD, "csr %u-%u", entry->low, entry->high);
+		return ERROR_OK;
+	}
+
+	struct list_head *ranges;
+	const char *reg_type;
+	unsigned int max_val;
+	if (!strcmp(CMD_ARGV[0], "gprs")) {
+		ranges = &info->halt_prefetch_gpr;
+		reg_type = "gpr";
+		max_val = GDB_REGNO_XPR31 - GDB_REGNO_ZERO;
+	} else if (!strcmp(CMD_ARGV[0], "csrs")) {
+		ranges = &info->halt_prefetch_csr;
+		reg_type = "csr";
+		max_val = 0xfff;
+	} else {
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	/* The new list replaces the old one; no ranges disable prefetching. */
+	free_halt_prefetch_ranges(ranges);
+	for (unsigned int i = 1; i < CMD_ARGC; i++) {
+		int ret = parse_ranges(ranges, CMD_ARGV[i], reg_type, max_val);
+		if (ret != ERROR_OK) {
+			free_halt_prefetch_ranges(ranges);
+			return ret;
+		}
+	}
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(riscv_hide_csrs)
 {
 	if (CMD_ARGC == 0) {
@@ -4339,6 +6113,358 @@ COMMAND_HANDLER(riscv_reset_delays)
 	return ERROR_OK;
 }
 
+#define RISCV_BATCH_SIZER_RUNS 8
+
+static void riscv_batch_sizer_restart(struct riscv_batch_sizer *sizer)
+{
+	sizer->current = RISCV_BATCH_ALLOC_SIZE;
+	sizer->settled = false;
+	sizer->direction = 1;
+	sizer->runs = 0;
+	sizer->scans = 0;
+	sizer->flushes = 0;
+	sizer->elapsed_us = 0;
+	sizer->best_size = 0;
+	sizer->best_ns_per_scan = 0;
+}
+
+unsigned int riscv_get_batch_size(const struct target *target)
+{
+	const struct riscv_info *r = riscv_info(target);
+	if (r->batch_sizer.requested)
+		return r->batch_sizer.requested;
+	return r->batch_sizer.current;
+}
+
+void riscv_batch_size_account(struct target *target, size_t scans,
+		unsigned int flushes, int64_t elapsed_us)
+{
+	RISCV_INFO(r);
+	struct riscv_batch_sizer *sizer = &r->batch_sizer;
+
+	if (sizer->requested || sizer->settled)
+		return;
+	/* Only nearly full batches are representative: the last batch of a
+	 * transfer is usually a short one. */
+	if (scans < sizer->current / 2)
+		return;
+
+	sizer->runs++;
+	sizer->scans += scans;
+	sizer->flushes += flushes;
+	sizer->elapsed_us += MAX(elapsed_us, 0);
+	if (sizer->runs < RISCV_BATCH_SIZER_RUNS)
+		return;
+
+	const uint64_t ns_per_scan = sizer->elapsed_us * 1000 / sizer->scans;
+	LOG_TARGET_DEBUG(target, "Batch size %u: %" PRIu64 " ns per scan, %"
+			PRIu64 " scans per JTAG queue flush.", sizer->current, ns_per_scan,
+			sizer->scans / MAX(sizer->flushes, 1u));
+
+	/* Require at least 5% of improvement to keep moving in the same
+	 * direction, so the noise in the measurement does not drive the size. */
+	const bool improved = !sizer->best_size ||
+		ns_per_scan * 100 < sizer->best_ns_per_scan * 95;
+	if (improved) {
+		sizer->best_size = sizer->current;
+		sizer->best_ns_per_scan = ns_per_scan;
+	}
+	/* If the adapter needs more than one flush per batch, larger batches
+	 * can't reduce the number of round trips any more. */
+	const bool batches_are_split = sizer->flushes > sizer->runs;
+
+	unsigned int next_size = 0;
+	if (improved && !batches_are_split) {
+		next_size = sizer->direction > 0 ? sizer->current * 2 : sizer->current / 2;
+	} else if (!improved && sizer->direction > 0 &&
+			sizer->best_size == RISCV_BATCH_ALLOC_SIZE) {
+		/* Growing the batches did not help at all, try shrinking them. */
+		sizer->direction = -1;
+		next_size = sizer->best_size / 2;
+	}
+
+	sizer->runs = 0;
+	sizer->scans = 0;
+	sizer->flushes = 0;
+	sizer->elapsed_us = 0;
+
+	if (next_size < RISCV_BATCH_SIZE_MIN || next_size > RISCV_BATCH_SIZE_MAX) {
+		sizer->current = sizer->best_size;
+		sizer->settled = true;
+		LOG_TARGET_DEBUG(target, "Batch size settled at %u scans.", sizer->current);
+		return;
+	}
+	sizer->current = next_size;
+}
+
+COMMAND_HANDLER(riscv_set_batch_size)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	struct riscv_batch_sizer *sizer = &r->batch_sizer;
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%u%s", riscv_get_batch_size(target),
+				sizer->requested ? "" :
+				(sizer->settled ? " (auto)" : " (auto, tuning)"));
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "auto")) {
+		sizer->requested = 0;
+		riscv_batch_sizer_restart(sizer);
+		return ERROR_OK;
+	}
+
+	unsigned int size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+	if (size < RISCV_BATCH_SIZE_MIN || size > RISCV_BATCH_SIZE_MAX) {
+		LOG_ERROR("Batch size must be in range [%d, %d].",
+				RISCV_BATCH_SIZE_MIN, RISCV_BATCH_SIZE_MAX);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	sizer->requested = size;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_dmi_trace)
+{
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%s", riscv_dmi_trace_enabled() ? "on" : "off");
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "off")) {
+		riscv_dmi_trace_stop();
+		return ERROR_OK;
+	}
+	return riscv_dmi_trace_start(CMD_ARGV[0]);
+}
+
+const struct riscv_examine_snapshot *riscv_examine_snapshot_match(struct target *target)
+{
+	RISCV_INFO(r);
+
+	if (!r->examine_snapshot || !r->examine_identity_valid)
+		return NULL;
+
+	const struct riscv_examine_identity *id = &r->examine_snapshot->identity;
+	if (memcmp(id, &r->examine_identity, sizeof(*id))) {
+		LOG_TARGET_WARNING(target, "Examine snapshot doesn't match the target "
+				"(idcode 0x%08" PRIx32 " dtmcs 0x%08" PRIx32 " hartinfo 0x%08"
+				PRIx32 " abstractcs 0x%08" PRIx32 " sbcs 0x%08" PRIx32
+				"), examining it fully", r->examine_identity.idcode,
+				r->examine_identity.dtmcs, r->examine_identity.hartinfo,
+				r->examine_identity.abstractcs, r->examine_identity.sbcs);
+		return NULL;
+	}
+	return r->examine_snapshot;
+}
+
+static int riscv_examine_snapshot_save(struct command_invocation *cmd,
+		struct target *target, const char *filename)
+{
+	RISCV_INFO(r);
+
+	if (!target_was_examined(target) || !r->examine_identity_valid) {
+		command_print(CMD, "target %s hasn't been examined or doesn't support "
+				"examine snapshots", target_name(target));
+		return ERROR_FAIL;
+	}
+
+	/* Triggers are enumerated lazily, the snapshot can only have them
+	 * if the hart is halted now or they were enumerated before. */
+	if (!r->triggers_enumerated && target->state == TARGET_HALTED &&
+			riscv_enumerate_triggers(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		command_print(CMD, "can't open %s: %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	fprintf(f, "# RISC-V examine snapshot of %s\n", target_name(target));
+	fprintf(f, "version 1\n");
+	fprintf(f, "idcode 0x%08" PRIx32 "\n", r->examine_identity.idcode);
+	fprintf(f, "dtmcs 0x%08" PRIx32 "\n", r->examine_identity.dtmcs);
+	fprintf(f, "hartinfo 0x%08" PRIx32 "\n", r->examine_identity.hartinfo);
+	fprintf(f, "abstractcs 0x%08" PRIx32 "\n", r->examine_identity.abstractcs);
+	fprintf(f, "sbcs 0x%08" PRIx32 "\n", r->examine_identity.sbcs);
+	fprintf(f, "xlen %d\n", r->xlen);
+	fprintf(f, "misa 0x%" PRIx64 "\n", r->misa);
+	fprintf(f, "vlenb %u\n", r->vlenb);
+	fprintf(f, "mtopi %d\n", r->mtopi_readable);
+	fprintf(f, "mtopei %d\n", r->mtopei_readable);
+	if (r->triggers_enumerated) {
+		fprintf(f, "triggers %u", r->trigger_count);
+		for (unsigned int t = 0; t < r->trigger_count; t++)
+			fprintf(f, " 0x%x", r->trigger_tinfo[t]);
+		fprintf(f, "\n");
+	}
+
+	if (fclose(f)) {
+		command_print(CMD, "can't write %s: %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int riscv_examine_snapshot_load(struct command_invocation *cmd,
+		struct target *target, const char *filename)
+{
+	RISCV_INFO(r);
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		command_print(CMD, "can't open %s: %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	struct riscv_examine_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+	if (!snapshot) {
+		LOG_ERROR("Out of memory");
+		fclose(f);
+		return ERROR_FAIL;
+	}
+
+	/* Every key but "triggers" is required. */
+	enum {
+		KEY_IDCODE, KEY_DTMCS, KEY_HARTINFO, KEY_ABSTRACTCS, KEY_SBCS,
+		KEY_XLEN, KEY_MISA, KEY_VLENB, KEY_MTOPI, KEY_MTOPEI, KEY_COUNT
+	};
+	static const char * const keys[KEY_COUNT] = {
+		"idcode", "dtmcs", "hartinfo", "abstractcs", "sbcs",
+		"xlen", "misa", "vlenb", "mtopi", "mtopei"
+	};
+	unsigned int seen = 0;
+	bool version_ok = false;
+	char line[512];
+	unsigned int line_number = 0;
+	int retval = ERROR_OK;
+
+	while (fgets(line, sizeof(line), f)) {
+		line_number++;
+		char key[16];
+		int n;
+		if (line[0] == '#' || sscanf(line, "%15s%n", key, &n) != 1)
+			continue;
+
+		char *p = line + n;
+		char *end;
+		uint64_t value = strtoull(p, &end, 0);
+		if (end == p) {
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		if (!strcmp(key, "version")) {
+			version_ok = value == 1;
+			continue;
+		}
+		if (!strcmp(key, "triggers")) {
+			if (value > RISCV_MAX_TRIGGERS) {
+				retval = ERROR_FAIL;
+				break;
+			}
+			snapshot->trigger_count = value;
+			for (unsigned int t = 0; t < snapshot->trigger_count; t++) {
+				p = end;
+				snapshot->trigger_tinfo[t] = strtoul(p, &end, 0);
+				if (end == p)
+					retval = ERROR_FAIL;
+			}
+			snapshot->triggers_enumerated = true;
+			if (retval != ERROR_OK)
+				break;
+			continue;
+		}
+
+		unsigned int k;
+		for (k = 0; k < KEY_COUNT; k++)
+			if (!strcmp(key, keys[k]))
+				break;
+		switch (k) {
+		case KEY_IDCODE:
+			snapshot->identity.idcode = value;
+			break;
+		case KEY_DTMCS:
+			snapshot->identity.dtmcs = value;
+			break;
+		case KEY_HARTINFO:
+			snapshot->identity.hartinfo = value;
+			break;
+		case KEY_ABSTRACTCS:
+			snapshot->identity.abstractcs = value;
+			break;
+		case KEY_SBCS:
+			snapshot->identity.sbcs = value;
+			break;
+		case KEY_XLEN:
+			snapshot->xlen = value;
+			break;
+		case KEY_MISA:
+			snapshot->misa = value;
+			break;
+		case KEY_VLENB:
+			snapshot->vlenb = value;
+			break;
+		case KEY_MTOPI:
+			snapshot->mtopi_readable = value;
+			break;
+		case KEY_MTOPEI:
+			snapshot->mtopei_readable = value;
+			break;
+		default:
+			/* Unknown keys are left for newer versions. */
+			continue;
+		}
+		seen |= BIT(k);
+	}
+	fclose(f);
+
+	if (retval != ERROR_OK) {
+		command_print(CMD, "%s:%u: syntax error", filename, line_number);
+	} else if (!version_ok || seen != BIT(KEY_COUNT) - 1 ||
+			(snapshot->xlen != 32 && snapshot->xlen != 64)) {
+		command_print(CMD, "%s isn't a complete version 1 examine snapshot", filename);
+		retval = ERROR_FAIL;
+	}
+	if (retval != ERROR_OK) {
+		free(snapshot);
+		return retval;
+	}
+
+	free(r->examine_snapshot);
+	r->examine_snapshot = snapshot;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_examine_snapshot)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "clear")) {
+		free(r->examine_snapshot);
+		r->examine_snapshot = NULL;
+		r->examine_snapshot_used = false;
+		return ERROR_OK;
+	}
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "save"))
+		return riscv_examine_snapshot_save(CMD, target, CMD_ARGV[1]);
+	if (!strcmp(CMD_ARGV[0], "load"))
+		return riscv_examine_snapshot_load(CMD, target, CMD_ARGV[1]);
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
 COMMAND_HANDLER(riscv_set_ir)
 {
 	if (CMD_ARGC != 2) {
@@ -4458,16 +6584,34 @@ COMMAND_HANDLER(riscv_set_enable_virt2phys)
 	return ERROR_OK;
 }
 
-COMMAND_HANDLER(riscv_set_ebreakm)
+COMMAND_HANDLER(riscv_set_ebreakm)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "riscv_ebreakm enabled: %s", r->riscv_ebreakm ? "on" : "off");
+		return ERROR_OK;
+	} else if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], r->riscv_ebreakm);
+		return ERROR_OK;
+	}
+
+	LOG_ERROR("Command takes 0 or 1 parameters");
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
+COMMAND_HANDLER(riscv_set_progbuf_residents)
 {
 	struct target *target = get_current_target(CMD_CTX);
 	RISCV_INFO(r);
 
 	if (CMD_ARGC == 0) {
-		command_print(CMD, "riscv_ebreakm enabled: %s", r->riscv_ebreakm ? "on" : "off");
+		command_print(CMD, "progbuf residents enabled: %s",
+				r->progbuf_residents ? "on" : "off");
 		return ERROR_OK;
 	} else if (CMD_ARGC == 1) {
-		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], r->riscv_ebreakm);
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], r->progbuf_residents);
 		return ERROR_OK;
 	}
 
@@ -4721,6 +6865,45 @@ COMMAND_HANDLER(riscv_etrigger)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_profiling_pc_address)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC == 0) {
+		if (r->pc_sample.enabled)
+			command_print(CMD, "0x%" TARGET_PRIxADDR " size=%" PRIu32,
+					r->pc_sample.address, r->pc_sample.size_bytes);
+		else
+			command_print(CMD, "off");
+		return ERROR_OK;
+	}
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "off")) {
+		if (CMD_ARGC > 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		r->pc_sample.enabled = false;
+		return ERROR_OK;
+	}
+
+	target_addr_t address;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	uint32_t size = 4;
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+	if (size != 4 && size != 8) {
+		LOG_TARGET_ERROR(target, "Only 4-byte and 8-byte sizes are supported.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	r->pc_sample.address = address;
+	r->pc_sample.size_bytes = size;
+	r->pc_sample.enabled = true;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_repeat_read)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -4760,6 +6943,279 @@ COMMAND_HANDLER(handle_repeat_read)
 	return result;
 }
 
+/* Size of the chunks "dump_image_group" reads from all the targets at once. */
+#define RISCV_DUMP_IMAGE_GROUP_CHUNK 0x10000
+
+COMMAND_HANDLER(handle_dump_image_group)
+{
+	if (CMD_ARGC < 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t address, size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], address);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[2], size);
+
+	const unsigned int target_count = CMD_ARGC - 3;
+	struct target **targets = calloc(target_count, sizeof(*targets));
+	struct fileio **files = calloc(target_count, sizeof(*files));
+	uint8_t **buffers = calloc(target_count, sizeof(*buffers));
+	int result = ERROR_OK;
+	if (!targets || !files || !buffers) {
+		LOG_ERROR("Out of memory");
+		result = ERROR_FAIL;
+		goto cleanup;
+	}
+
+	for (unsigned int t = 0; t < target_count; ++t) {
+		struct target *target = get_target(CMD_ARGV[3 + t]);
+		if (!target) {
+			command_print(CMD, "Unknown target '%s'.", CMD_ARGV[3 + t]);
+			result = ERROR_COMMAND_ARGUMENT_INVALID;
+			goto cleanup;
+		}
+		struct riscv_info *r = target->arch_info;
+		if (!r || !is_riscv(r) || !r->read_memory_group ||
+				(t > 0 && r->read_memory_group !=
+				 riscv_info(targets[0])->read_memory_group)) {
+			command_print(CMD, "Target '%s' does not support group reads.",
+					target_name(target));
+			result = ERROR_COMMAND_ARGUMENT_INVALID;
+			goto cleanup;
+		}
+		targets[t] = target;
+	}
+
+	for (unsigned int t = 0; t < target_count; ++t) {
+		char *filename = alloc_printf("%s.%s", CMD_ARGV[0], target_name(targets[t]));
+		if (!filename) {
+			result = ERROR_FAIL;
+			goto cleanup;
+		}
+		result = fileio_open(&files[t], filename, FILEIO_WRITE, FILEIO_BINARY);
+		free(filename);
+		if (result != ERROR_OK)
+			goto cleanup;
+		buffers[t] = malloc(RISCV_DUMP_IMAGE_GROUP_CHUNK);
+		if (!buffers[t]) {
+			result = ERROR_FAIL;
+			goto cleanup;
+		}
+	}
+
+	/* Use the widest access the alignment allows. */
+	uint32_t width = 4;
+	while (width > 1 && (address % width || size % width))
+		width /= 2;
+
+	struct duration bench;
+	duration_start(&bench);
+	for (target_addr_t offset = 0; offset < size && result == ERROR_OK; ) {
+		const uint32_t chunk = MIN(size - offset, RISCV_DUMP_IMAGE_GROUP_CHUNK);
+		result = riscv_info(targets[0])->read_memory_group(targets, target_count,
+				address + offset, width, chunk / width, buffers);
+		for (unsigned int t = 0; t < target_count && result == ERROR_OK; ++t) {
+			size_t written;
+			result = fileio_write(files[t], chunk, buffers[t], &written);
+		}
+		offset += chunk;
+	}
+
+	if (result == ERROR_OK && duration_measure(&bench) == ERROR_OK)
+		command_print(CMD, "dumped %" TARGET_PRIuADDR " bytes from each of %u targets "
+				"in %fs (%0.3f KiB/s)", size, target_count, duration_elapsed(&bench),
+				duration_kbps(&bench, size * target_count));
+
+cleanup:
+	for (unsigned int t = 0; files && t < target_count; ++t) {
+		if (files[t])
+			fileio_close(files[t]);
+	}
+	for (unsigned int t = 0; buffers && t < target_count; ++t)
+		free(buffers[t]);
+	free(buffers);
+	free(files);
+	free(targets);
+	return result;
+}
+
+COMMAND_HANDLER(handle_dump_vregs)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+	if (!r->vlenb || !r->read_vector_registers) {
+		command_print(CMD, "Target has no vector registers.");
+		return ERROR_FAIL;
+	}
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "Not halted.");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	const unsigned int count = GDB_REGNO_V31 - GDB_REGNO_V0 + 1;
+	uint8_t *values = malloc(count * r->vlenb);
+	if (!values) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+	int result = r->read_vector_registers(target, GDB_REGNO_V0, count, values);
+	if (result != ERROR_OK)
+		goto cleanup;
+
+	if (CMD_ARGC == 1) {
+		struct fileio *fileio;
+		result = fileio_open(&fileio, CMD_ARGV[0], FILEIO_WRITE, FILEIO_BINARY);
+		if (result != ERROR_OK)
+			goto cleanup;
+		size_t written;
+		result = fileio_write(fileio, count * r->vlenb, values, &written);
+		fileio_close(fileio);
+		if (result == ERROR_OK && duration_measure(&bench) == ERROR_OK)
+			command_print(CMD, "dumped %u bytes in %fs (%0.3f KiB/s)",
+					count * r->vlenb, duration_elapsed(&bench),
+					duration_kbps(&bench, count * r->vlenb));
+	} else {
+		for (unsigned int i = 0; i < count; ++i) {
+			char *str = buf_to_hex_str(values + i * r->vlenb, r->vlenb * 8);
+			if (!str) {
+				result = ERROR_FAIL;
+				break;
+			}
+			command_print(CMD, "v%u = 0x%s", i, str);
+			free(str);
+		}
+	}
+
+cleanup:
+	free(values);
+	return result;
+}
+
+COMMAND_HANDLER(riscv_define_matrix_tile)
+{
+	if (CMD_ARGC < 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	unsigned int size_bits;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], size_bits);
+	if (size_bits == 0 || size_bits % 64) {
+		command_print(CMD, "Tile size must be a non-zero multiple of 64 bits.");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (CMD_ARGC - 2 > RISCV_MATRIX_TILE_MAX_INSNS) {
+		command_print(CMD, "At most %d instructions are supported.",
+				RISCV_MATRIX_TILE_MAX_INSNS);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct riscv_matrix_tile *tile;
+	list_for_each_entry(tile, &r->matrix_tiles, list) {
+		if (!strcmp(tile->name, CMD_ARGV[0])) {
+			command_print(CMD, "Matrix tile '%s' is already defined.", CMD_ARGV[0]);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	tile = calloc(1, sizeof(*tile));
+	if (!tile) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	tile->size_bits = size_bits;
+	tile->insn_count = CMD_ARGC - 2;
+	for (unsigned int i = 0; i < tile->insn_count; i++) {
+		int retval = parse_u32(CMD_ARGV[2 + i], &tile->insns[i]);
+		if (retval != ERROR_OK) {
+			free(tile);
+			return retval;
+		}
+	}
+	tile->name = strdup(CMD_ARGV[0]);
+	if (!tile->name) {
+		free(tile);
+		return ERROR_FAIL;
+	}
+	list_add_tail(&tile->list, &r->matrix_tiles);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_dump_matrix_tile)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	struct riscv_matrix_tile *tile = NULL, *entry;
+	list_for_each_entry(entry, &r->matrix_tiles, list) {
+		if (!strcmp(entry->name, CMD_ARGV[0])) {
+			tile = entry;
+			break;
+		}
+	}
+	if (!tile) {
+		command_print(CMD, "Unknown matrix tile '%s'.", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (!r->read_progbuf_stream) {
+		command_print(CMD, "Not supported on this target.");
+		return ERROR_FAIL;
+	}
+
+	const unsigned int xlen = riscv_xlen(target);
+	if (tile->size_bits % xlen) {
+		command_print(CMD, "Tile size is not a multiple of XLEN.");
+		return ERROR_FAIL;
+	}
+	const unsigned int size_bytes = tile->size_bits / 8;
+	uint8_t *buffer = malloc(size_bytes);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+	int result = r->read_progbuf_stream(target, tile->insns, tile->insn_count,
+			tile->size_bits / xlen, buffer);
+	if (result != ERROR_OK)
+		goto cleanup;
+
+	if (CMD_ARGC == 2) {
+		struct fileio *fileio;
+		result = fileio_open(&fileio, CMD_ARGV[1], FILEIO_WRITE, FILEIO_BINARY);
+		if (result != ERROR_OK)
+			goto cleanup;
+		size_t written;
+		result = fileio_write(fileio, size_bytes, buffer, &written);
+		fileio_close(fileio);
+		if (result == ERROR_OK && duration_measure(&bench) == ERROR_OK)
+			command_print(CMD, "dumped %u bytes in %fs (%0.3f KiB/s)",
+					size_bytes, duration_elapsed(&bench),
+					duration_kbps(&bench, size_bytes));
+	} else {
+		const unsigned int row_bytes = xlen / 8;
+		for (unsigned int offset = 0; offset < size_bytes; offset += row_bytes) {
+			command_print(CMD, "%s[%u] = 0x%0*" PRIx64, tile->name,
+					offset / row_bytes, (int)(xlen / 4),
+					buf_get_u64(buffer + offset, 0, xlen));
+		}
+	}
+
+cleanup:
+	free(buffer);
+	return result;
+}
+
 COMMAND_HANDLER(handle_memory_sample_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -4767,15 +7223,20 @@ COMMAND_HANDLER(handle_memory_sample_command)
 
 	if (CMD_ARGC == 0) {
 		command_print(CMD, "Memory sample configuration for %s:", target_name(target));
+		unsigned int disabled_count = 0;
 		for (unsigned int i = 0; i < ARRAY_SIZE(r->sample_config.bucket); i++) {
 			if (r->sample_config.bucket[i].enabled) {
 				command_print(CMD, "bucket %d; address=0x%" TARGET_PRIxADDR "; size=%d", i,
 							  r->sample_config.bucket[i].address,
 							  r->sample_config.bucket[i].size_bytes);
 			} else {
-				command_print(CMD, "bucket %d; disabled", i);
+				disabled_count++;
 			}
 		}
+		command_print(CMD, "%u of %zu buckets disabled", disabled_count,
+					  ARRAY_SIZE(r->sample_config.bucket));
+		if (r->sample_sink)
+			command_print(CMD, "samples are streamed to %s", r->sample_sink_name);
 		return ERROR_OK;
 	}
 
@@ -4786,8 +7247,8 @@ COMMAND_HANDLER(handle_memory_sample_command)
 
 	uint32_t bucket;
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], bucket);
-	if (bucket > ARRAY_SIZE(r->sample_config.bucket)) {
-		LOG_TARGET_ERROR(target, "Max bucket number is %zd.", ARRAY_SIZE(r->sample_config.bucket));
+	if (bucket >= ARRAY_SIZE(r->sample_config.bucket)) {
+		LOG_TARGET_ERROR(target, "Max bucket number is %zd.", ARRAY_SIZE(r->sample_config.bucket) - 1);
 		return ERROR_COMMAND_ARGUMENT_INVALID;
 	}
 
@@ -4817,12 +7278,54 @@ COMMAND_HANDLER(handle_memory_sample_command)
 
 	/* Clear the buffer when the configuration is changed. */
 	r->sample_buf.used = 0;
+	r->sample_config.generation++;
 
 	r->sample_config.enabled = true;
 
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_memory_sample_sink_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 0) {
+		if (r->sample_sink)
+			command_print(CMD, "%s", r->sample_sink_name);
+		else
+			command_print(CMD, "off");
+		return ERROR_OK;
+	}
+
+	/* Whatever was collected so far belongs to the old sink. */
+	int result = riscv_sample_buf_drain(target);
+	riscv_sample_sink_close(r);
+	if (result != ERROR_OK)
+		return result;
+
+	if (!strcmp(CMD_ARGV[0], "off"))
+		return ERROR_OK;
+
+	r->sample_sink = fopen(CMD_ARGV[0], "ab");
+	if (!r->sample_sink) {
+		LOG_TARGET_ERROR(target, "Failed to open %s for writing: %s", CMD_ARGV[0],
+				strerror(errno));
+		return ERROR_FAIL;
+	}
+	r->sample_sink_name = strdup(CMD_ARGV[0]);
+	if (!r->sample_sink_name) {
+		LOG_ERROR("Out of memory");
+		riscv_sample_sink_close(r);
+		return ERROR_FAIL;
+	}
+
+	return riscv_sample_buf_drain(target);
+}
+
 COMMAND_HANDLER(handle_dump_sample_buf_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -4929,6 +7432,8 @@ COMMAND_HANDLER(handle_info)
 		riscv_enumerate_triggers(target) == ERROR_OK;
 	riscv_print_info_line_if_available(CMD, "hart", "trigger_count",
 				r->trigger_count, trigger_count_available);
+	riscv_print_info_line(CMD, "target", "batch_size",
+			riscv_get_batch_size(target));
 	if (r->print_info)
 		return CALL_COMMAND_HANDLER(r->print_info, target);
 
@@ -4977,6 +7482,8 @@ COMMAND_HANDLER(riscv_exec_progbuf)
 		return ERROR_FAIL;
 	int error = riscv_program_exec(&prog, target);
 	riscv_invalidate_register_cache(target);
+	/* The program may have written any trigger. */
+	trigger_shadow_invalidate(target, /* keep_dmode */ false);
 
 	if (error != ERROR_OK) {
 		LOG_TARGET_ERROR(target, "exec_progbuf: Program buffer execution failed.");
@@ -5039,6 +7546,14 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.usage = "[base64]",
 		.help = "Print the contents of the sample buffer, and clear the buffer."
 	},
+	{
+		.name = "memory_sample_sink",
+		.handler = handle_memory_sample_sink_command,
+		.mode = COMMAND_ANY,
+		.usage = "[filename|off]",
+		.help = "Append the raw sample buffer to a file after every sampling "
+			"pass, so that samples don't have to be dumped manually."
+	},
 	{
 		.name = "info",
 		.handler = handle_info,
@@ -5053,6 +7568,40 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.usage = "bucket address|clear [size=4]",
 		.help = "Causes OpenOCD to frequently read size bytes at the given address."
 	},
+	{
+		.name = "dump_vregs",
+		.handler = handle_dump_vregs,
+		.mode = COMMAND_EXEC,
+		.usage = "[filename]",
+		.help = "Read all the vector registers in one go and display them, or "
+			"write them (v0 first, vlenb bytes each) to a binary file."
+	},
+	{
+		.name = "define_matrix_tile",
+		.handler = riscv_define_matrix_tile,
+		.mode = COMMAND_ANY,
+		.usage = "name size_bits insn0 [insn1 ...]",
+		.help = "Define a matrix tile register that is read by executing the "
+			"given instructions from the program buffer once per XLEN bits. "
+			"Each execution must leave the next XLEN bits of the tile in s0."
+	},
+	{
+		.name = "dump_matrix_tile",
+		.handler = handle_dump_matrix_tile,
+		.mode = COMMAND_EXEC,
+		.usage = "name [filename]",
+		.help = "Stream a matrix tile defined by define_matrix_tile out of the "
+			"hart and display it, or write it to a binary file."
+	},
+	{
+		.name = "dump_image_group",
+		.handler = handle_dump_image_group,
+		.mode = COMMAND_EXEC,
+		.usage = "filename address size target [target ...]",
+		.help = "Dump the same physical memory range of several targets to "
+			"filename.<target name>, merging the accesses into shared JTAG "
+			"queue flushes."
+	},
 	{
 		.name = "repeat_read",
 		.handler = handle_repeat_read,
@@ -5060,6 +7609,14 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.usage = "count address [size=4]",
 		.help = "Repeatedly read the value at address."
 	},
+	{
+		.name = "profiling_pc_address",
+		.handler = handle_profiling_pc_address,
+		.mode = COMMAND_ANY,
+		.usage = "[address [size=4]|off]",
+		.help = "Set the address of a memory-mapped register holding the "
+			"current PC, which profiling samples without halting the hart."
+	},
 	{
 		.name = "set_command_timeout_sec",
 		.handler = riscv_set_command_timeout_sec,
@@ -5078,9 +7635,13 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.name = "set_mem_access",
 		.handler = riscv_set_mem_access,
 		.mode = COMMAND_ANY,
-		.usage = "method1 [method2] [method3]",
+		.usage = "method1 [method2] [method3] | "
+			"-region address size ['auto'] [method1 [method2] [method3]] | "
+			"-region clear",
 		.help = "Set which memory access methods shall be used and in which order "
-			"of priority. Method can be one of: 'progbuf', 'sysbus' or 'abstract'."
+			"of priority, for all memory or for one address range. Method can "
+			"be one of: 'progbuf', 'sysbus' or 'abstract'. With 'auto' the "
+			"order of a range is learned from measured throughput."
 	},
 	{
 		.name = "set_enable_virtual",
@@ -5119,6 +7680,25 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 			"gdb target description and `reg` command output. "
 			"This must be executed before `init`."
 	},
+	{
+		.name = "step_trace",
+		.handler = riscv_step_trace_command,
+		.mode = COMMAND_EXEC,
+		.usage = "count [file]",
+		.help = "Single step the current hart up to count times without "
+			"returning to the debugger in between, optionally writing the "
+			"address of every executed instruction to file."
+	},
+	{
+		.name = "halt_prefetch",
+		.handler = riscv_set_halt_prefetch,
+		.mode = COMMAND_ANY,
+		.usage = "[gprs|csrs [{n0|n-m0}[,n1|n-m1]......]]",
+		.help = "Configure the GPRs or CSRs that are read into the register "
+			"cache in one batch whenever the hart halts. Without ranges the "
+			"given list is cleared; without arguments the current "
+			"configuration is shown."
+	},
 	{
 		.name = "authdata_read",
 		.handler = riscv_authdata_read,
@@ -5176,6 +7756,32 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 			"command resets those learned values after `wait` scans. It's only "
 			"useful for testing OpenOCD itself."
 	},
+	{
+		.name = "batch_size",
+		.handler = riscv_set_batch_size,
+		.mode = COMMAND_ANY,
+		.usage = "[auto|scans]",
+		.help = "Set the number of scans in the batches used for block memory "
+			"accesses, or let OpenOCD tune it based on the measured cost of "
+			"JTAG queue flushes (auto, default)."
+	},
+	{
+		.name = "dmi_trace",
+		.handler = riscv_dmi_trace,
+		.mode = COMMAND_ANY,
+		.usage = "[filename|off]",
+		.help = "Write all DMI scans to a binary trace file, see "
+			"contrib/riscv_dmi_trace.c, or stop the trace."
+	},
+	{
+		.name = "examine_snapshot",
+		.handler = riscv_examine_snapshot,
+		.mode = COMMAND_ANY,
+		.usage = "('save'|'load') filename | 'clear'",
+		.help = "Save the properties found by examining the hart to a file, "
+			"or load such a file to skip most of the next examine if the "
+			"hart still identifies the same way."
+	},
 	{
 		.name = "resume_order",
 		.handler = riscv_resume_order,
@@ -5251,6 +7857,14 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.help = "Control dcsr.ebreaku. When off, U-mode ebreak instructions "
 			"don't trap to OpenOCD. Defaults to on."
 	},
+	{
+		.name = "set_progbuf_residents",
+		.handler = riscv_set_progbuf_residents,
+		.mode = COMMAND_ANY,
+		.usage = "[on|off]",
+		.help = "Keep several programs in the program buffer and jump to "
+			"the one to run, instead of rewriting it. Defaults to off."
+	},
 	{
 		.name = "etrigger",
 		.handler = riscv_etrigger,
@@ -5358,10 +7972,18 @@ struct target_type riscv_target = {
 
 	.read_memory = riscv_read_memory,
 	.write_memory = riscv_write_memory,
+	.read_buffer = riscv_read_buffer,
+	.write_buffer = riscv_write_buffer,
 	.read_phys_memory = riscv_read_phys_memory,
 	.write_phys_memory = riscv_write_phys_memory,
 
 	.checksum_memory = riscv_checksum_memory,
+	.checksum_memory_list = riscv_checksum_memory_list,
+	.fill_memory = riscv_fill_memory,
+	.memory_test = riscv_memory_test,
+	.blank_check_memory = riscv_blank_check_memory,
+
+	.profiling = riscv_profiling,
 
 	.mmu = riscv_mmu,
 	.virt2phys = riscv_virt2phys,
@@ -5369,6 +7991,7 @@ struct target_type riscv_target = {
 	.get_gdb_arch = riscv_get_gdb_arch,
 	.get_gdb_reg_list = riscv_get_gdb_reg_list,
 	.get_gdb_reg_list_noread = riscv_get_gdb_reg_list_noread,
+	.fetch_registers = riscv_fetch_registers,
 
 	.add_breakpoint = riscv_add_breakpoint,
 	.remove_breakpoint = riscv_remove_breakpoint,
@@ -5380,6 +8003,8 @@ struct target_type riscv_target = {
 	.arch_state = riscv_arch_state,
 
 	.run_algorithm = riscv_run_algorithm,
+	.start_algorithm = riscv_start_algorithm,
+	.wait_algorithm = riscv_wait_algorithm,
 
 	.commands = riscv_command_handlers,
 
@@ -5416,9 +8041,16 @@ static void riscv_info_init(struct target *target, struct riscv_info *r)
 	INIT_LIST_HEAD(&r->expose_csr);
 	INIT_LIST_HEAD(&r->expose_custom);
 	INIT_LIST_HEAD(&r->hide_csr);
+	INIT_LIST_HEAD(&r->halt_prefetch_gpr);
+	INIT_LIST_HEAD(&r->halt_prefetch_csr);
+	INIT_LIST_HEAD(&r->matrix_tiles);
+	INIT_LIST_HEAD(&r->pending_sw_breakpoints);
+	INIT_LIST_HEAD(&r->mem_access_regions);
 
 	r->vsew64_supported = YNM_MAYBE;
 
+	riscv_batch_sizer_restart(&r->batch_sizer);
+
 	r->riscv_ebreakm = true;
 	r->riscv_ebreaks = true;
 	r->riscv_ebreaku = true;
@@ -5543,6 +8175,8 @@ static void riscv_invalidate_register_cache(struct target *target)
 
 	LOG_TARGET_DEBUG(target, "Invalidating register cache.");
 	register_cache_invalidate(target->reg_cache);
+	trigger_shadow_invalidate(target, /* keep_dmode */ true);
+	riscv_tlb_invalidate(target);
 }
 
 int riscv_get_hart_state(struct target *target, enum riscv_hart_state *state)
@@ -5575,6 +8209,18 @@ int riscv_write_progbuf(struct target *target, int index, riscv_insn_t insn)
 	return ERROR_OK;
 }
 
+int riscv_write_program(struct target *target, const riscv_insn_t *insns,
+		unsigned int count)
+{
+	RISCV_INFO(r);
+	if (r->write_program)
+		return r->write_program(target, insns, count);
+	for (unsigned int i = 0; i < count; i++)
+		if (riscv_write_progbuf(target, i, insns[i]) != ERROR_OK)
+			return ERROR_FAIL;
+	return ERROR_OK;
+}
+
 riscv_insn_t riscv_read_progbuf(struct target *target, int index)
 {
 	RISCV_INFO(r);
@@ -5654,30 +8300,7 @@ static int get_trigger_types(struct target *target, unsigned int *trigger_tinfo,
 
 static int disable_trigger_if_dmode(struct target *target, riscv_reg_t tdata1)
 {
-	bool dmode_is_set = false;
-	switch (get_field(tdata1, CSR_TDATA1_TYPE(riscv_xlen(target)))) {
-		case CSR_TDATA1_TYPE_LEGACY:
-			/* On these older cores we don't support software using
-			 * triggers. */
-			dmode_is_set = true;
-			break;
-		case CSR_TDATA1_TYPE_MCONTROL:
-			dmode_is_set = tdata1 & CSR_MCONTROL_DMODE(riscv_xlen(target));
-			break;
-		case CSR_TDATA1_TYPE_MCONTROL6:
-			dmode_is_set = tdata1 & CSR_MCONTROL6_DMODE(riscv_xlen(target));
-			break;
-		case CSR_TDATA1_TYPE_ICOUNT:
-			dmode_is_set = tdata1 & CSR_ICOUNT_DMODE(riscv_xlen(target));
-			break;
-		case CSR_TDATA1_TYPE_ITRIGGER:
-			dmode_is_set = tdata1 & CSR_ITRIGGER_DMODE(riscv_xlen(target));
-			break;
-		case CSR_TDATA1_TYPE_ETRIGGER:
-			dmode_is_set = tdata1 & CSR_ETRIGGER_DMODE(riscv_xlen(target));
-			break;
-	}
-	if (!dmode_is_set)
+	if (!trigger_dmode_is_set(target, tdata1))
 		/* Nothing to do */
 		return ERROR_OK;
 	return riscv_reg_set(target, GDB_REGNO_TDATA1, 0);
@@ -5714,23 +8337,39 @@ int riscv_enumerate_triggers(struct target *target)
 		return ERROR_OK;
 	}
 
+	/* With a snapshot only the triggers left over need to be looked at. */
+	const struct riscv_examine_snapshot *snapshot = NULL;
+	if (r->examine_snapshot_used && r->examine_snapshot->triggers_enumerated)
+		snapshot = r->examine_snapshot;
+
 	unsigned int t = 0;
 	for (; t < ARRAY_SIZE(r->trigger_tinfo); ++t) {
-		result = check_if_trigger_exists(target, t);
-		if (result == ERROR_FAIL)
-			return ERROR_FAIL;
-		if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
-			break;
+		if (snapshot) {
+			if (t == snapshot->trigger_count)
+				break;
+			if (riscv_reg_set(target, GDB_REGNO_TSELECT, t) != ERROR_OK)
+				return ERROR_FAIL;
+		} else {
+			result = check_if_trigger_exists(target, t);
+			if (result == ERROR_FAIL)
+				return ERROR_FAIL;
+			if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				break;
+		}
 
 		riscv_reg_t tdata1;
 		if (riscv_reg_get(target, &tdata1, GDB_REGNO_TDATA1) != ERROR_OK)
 			return ERROR_FAIL;
 
-		result = get_trigger_types(target, &r->trigger_tinfo[t], tdata1);
-		if (result == ERROR_FAIL)
-			return ERROR_FAIL;
-		if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
-			break;
+		if (snapshot) {
+			r->trigger_tinfo[t] = snapshot->trigger_tinfo[t];
+		} else {
+			result = get_trigger_types(target, &r->trigger_tinfo[t], tdata1);
+			if (result == ERROR_FAIL)
+				return ERROR_FAIL;
+			if (result == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				break;
+		}
 
 		LOG_TARGET_DEBUG(target, "Trigger %u: supported types (mask) = 0x%08x",
 				t, r->trigger_tinfo[t]);
@@ -5749,41 +8388,41 @@ int riscv_enumerate_triggers(struct target *target)
 	return ERROR_OK;
 }
 
+/* The fields of a tunneled DMI scan, in shift order, that are the same for
+ * every scan. Only the width and the data fields are filled in per scan. */
+static const struct scan_field bscan_tunneled_dr_template[][4] = {
+	[BSCAN_TUNNEL_NESTED_TAP] = {
+		{ .num_bits = 1, .out_value = bscan_one },
+		{ .num_bits = 7 },	/* width */
+		{ 0 },			/* data */
+		{ .num_bits = 3, .out_value = bscan_zero },
+	},
+	[BSCAN_TUNNEL_DATA_REGISTER] = {
+		{ .num_bits = 3, .out_value = bscan_zero },
+		{ 0 },			/* data */
+		{ .num_bits = 7 },	/* width */
+		{ .num_bits = 1, .out_value = bscan_one },
+	},
+};
+
 void riscv_add_bscan_tunneled_scan(struct target *target, const struct scan_field *field,
 					riscv_bscan_tunneled_scan_context_t *ctxt)
 {
-	jtag_add_ir_scan(target->tap, &select_user4, TAP_IDLE);
-
-	memset(ctxt->tunneled_dr, 0, sizeof(ctxt->tunneled_dr));
-	if (bscan_tunnel_type == BSCAN_TUNNEL_DATA_REGISTER) {
-		ctxt->tunneled_dr[3].num_bits = 1;
-		ctxt->tunneled_dr[3].out_value = bscan_one;
-		ctxt->tunneled_dr[2].num_bits = 7;
-		ctxt->tunneled_dr_width = field->num_bits;
-		ctxt->tunneled_dr[2].out_value = &ctxt->tunneled_dr_width;
-		/* for BSCAN tunnel, there is a one-TCK skew between shift in and shift out, so
-		   scanning num_bits + 1, and then will right shift the input field after executing the queues */
-
-		ctxt->tunneled_dr[1].num_bits = field->num_bits + 1;
-		ctxt->tunneled_dr[1].out_value = field->out_value;
-		ctxt->tunneled_dr[1].in_value = field->in_value;
-
-		ctxt->tunneled_dr[0].num_bits = 3;
-		ctxt->tunneled_dr[0].out_value = bscan_zero;
-	} else {
-		/* BSCAN_TUNNEL_NESTED_TAP */
-		ctxt->tunneled_dr[0].num_bits = 1;
-		ctxt->tunneled_dr[0].out_value = bscan_one;
-		ctxt->tunneled_dr[1].num_bits = 7;
-		ctxt->tunneled_dr_width = field->num_bits;
-		ctxt->tunneled_dr[1].out_value = &ctxt->tunneled_dr_width;
-		/* for BSCAN tunnel, there is a one-TCK skew between shift in and shift out, so
-		   scanning num_bits + 1, and then will right shift the input field after executing the queues */
-		ctxt->tunneled_dr[2].num_bits = field->num_bits + 1;
-		ctxt->tunneled_dr[2].out_value = field->out_value;
-		ctxt->tunneled_dr[2].in_value = field->in_value;
-		ctxt->tunneled_dr[3].num_bits = 3;
-		ctxt->tunneled_dr[3].out_value = bscan_zero;
-	}
-	jtag_add_dr_scan(target->tap, ARRAY_SIZE(ctxt->tunneled_dr), ctxt->tunneled_dr, TAP_IDLE);
+	const unsigned int width_index = bscan_tunnel_type == BSCAN_TUNNEL_DATA_REGISTER ? 2 : 1;
+	const unsigned int data_index = 3 - width_index;
+
+	memcpy(ctxt->tunneled_dr, bscan_tunneled_dr_template[bscan_tunnel_type],
+			sizeof(ctxt->tunneled_dr));
+	ctxt->tunneled_dr_width = field->num_bits;
+	ctxt->tunneled_dr[width_index].out_value = &ctxt->tunneled_dr_width;
+	/* for BSCAN tunnel, there is a one-TCK skew between shift in and shift out, so
+	   scanning num_bits + 1, and then will right shift the input field after executing the queues */
+	ctxt->tunneled_dr[data_index].num_bits = field->num_bits + 1;
+	ctxt->tunneled_dr[data_index].out_value = field->out_value;
+	ctxt->tunneled_dr[data_index].in_value = field->in_value;
+
+	/* The BSCAN TAP is left in USER4 by select_dmi_via_bscan(), and the
+	 * context stays allocated until the batch is run */
+	jtag_add_dr_scan_nocopy(target->tap, ARRAY_SIZE(ctxt->tunneled_dr),
+			ctxt->tunneled_dr, TAP_IDLE);
 }
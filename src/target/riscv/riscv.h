@@ -6,6 +6,7 @@
 struct riscv_program;
 
 #include <stdint.h>
+#include <stdio.h>
 #include "opcodes.h"
 #include "gdb_regs.h"
 #include "jtag/jtag.h"
@@ -29,12 +30,20 @@ struct riscv_program;
 #define RISCV_HGATP_MODE(xlen)  ((xlen) == 32 ? HGATP32_MODE : HGATP64_MODE)
 #define RISCV_HGATP_PPN(xlen)  ((xlen) == 32 ? HGATP32_PPN : HGATP64_PPN)
 #define RISCV_PGSHIFT 12
+#define RISCV_PGSIZE (1 << RISCV_PGSHIFT)
 
 #define PG_MAX_LEVEL 5
 
+/* Page translations cached while a hart is halted, see riscv_virt2phys() */
+#define RISCV_TLB_ENTRIES 64
+
 #define RISCV_NUM_MEM_ACCESS_METHODS  3
 
+/* Initial number of scans in batches used for block memory accesses. The value
+ * is then tuned at run time, see "struct riscv_batch_sizer". */
 #define RISCV_BATCH_ALLOC_SIZE 128
+#define RISCV_BATCH_SIZE_MIN 16
+#define RISCV_BATCH_SIZE_MAX 4096
 
 extern struct target_type riscv011_target;
 extern struct target_type riscv013_target;
@@ -52,6 +61,16 @@ typedef enum {
 	YNM_NO
 } yes_no_maybe_t;
 
+/* The translation of one page in the context of satp, or vsatp and hgatp. */
+struct riscv_tlb_entry {
+	bool valid;
+	bool v_mode;
+	riscv_reg_t satp;
+	riscv_reg_t hgatp;
+	target_addr_t virtual_page;
+	target_addr_t physical_page;
+};
+
 enum riscv_mem_access_method {
 	RISCV_MEM_ACCESS_UNSPECIFIED,
 	RISCV_MEM_ACCESS_PROGBUF,
@@ -92,6 +111,9 @@ typedef struct {
 
 #define RISCV_SAMPLE_BUF_TIMESTAMP_BEFORE	0x80
 #define RISCV_SAMPLE_BUF_TIMESTAMP_AFTER	0x81
+/* Bucket numbers are stored as a single byte in the sample buffer, so they
+ * must stay below the timestamp markers. */
+#define RISCV_SAMPLE_BUCKET_COUNT	RISCV_SAMPLE_BUF_TIMESTAMP_BEFORE
 struct riscv_sample_buf {
 	uint8_t *buf;
 	unsigned int used;
@@ -100,26 +122,148 @@ struct riscv_sample_buf {
 
 typedef struct {
 	bool enabled;
+	/* Incremented every time the buckets are changed, so that anything
+	 * derived from the configuration can tell when to rebuild itself. */
+	unsigned int generation;
 	struct {
 		bool enabled;
 		target_addr_t address;
 		uint32_t size_bytes;
-	} bucket[16];
+	} bucket[RISCV_SAMPLE_BUCKET_COUNT];
 } riscv_sample_config_t;
 
+/* What OpenOCD knows about the contents of one trigger, so a trigger that
+ * already holds the wanted values isn't written and read back again. It is
+ * only used as long as the user doesn't write the trigger CSRs directly (see
+ * manual_hwbp_set). */
+struct riscv_trigger_shadow {
+	bool tdata1_valid;
+	riscv_reg_t tdata1;
+	bool tdata2_valid;
+	riscv_reg_t tdata2;
+	/* tdata1 was last written with dmode set, so the hart can't change
+	 * tdata2 while it is running. */
+	bool dmode;
+	/* The last configuration the trigger accepted, and the value tdata1 read
+	 * back as afterwards. */
+	bool accepted_valid;
+	riscv_reg_t accepted_tdata1;
+	riscv_reg_t accepted_tdata2;
+	riscv_reg_t accepted_tdata1_ignore_mask;
+	riscv_reg_t accepted_tdata1_rb;
+};
+
 typedef struct {
 	struct list_head list;
 	uint16_t low, high;
 	char *name;
 } range_list_t;
 
+/* Program buffers have at most 16 words; leave room for the ebreak. */
+#define RISCV_MATRIX_TILE_MAX_INSNS 15
+
+/* A matrix tile/accumulator register of a (vendor-specific) matrix
+ * extension, read by running "insns" from the program buffer once per XLEN
+ * bits of the tile. */
+struct riscv_matrix_tile {
+	struct list_head list;
+	char *name;
+	unsigned int size_bits;
+	unsigned int insn_count;
+	uint32_t insns[RISCV_MATRIX_TILE_MAX_INSNS];
+};
+
+/* How often each method is timed before an "auto" region settles on the
+ * fastest one. */
+#define RISCV_MEM_ACCESS_AUTO_SAMPLES 8
+
+/* Memory access methods for an address range ("riscv set_mem_access
+ * -region"). */
+struct riscv_mem_access_region {
+	struct list_head list;
+	target_addr_t address;
+	target_addr_t size;
+	/* Ordered by priority, highest to lowest, like
+	 * riscv_info.mem_access_methods. */
+	int methods[RISCV_NUM_MEM_ACCESS_METHODS];
+	/* Order "methods" by measured throughput. */
+	bool auto_select;
+	bool auto_done;
+	/* Indexed by method. */
+	struct {
+		unsigned int successes;
+		unsigned int failures;
+		uint64_t bytes;
+		int64_t us;
+	} stats[RISCV_NUM_MEM_ACCESS_METHODS + 1];
+};
+
+/* A software breakpoint whose ebreak hasn't been written yet. */
+struct riscv_pending_sw_breakpoint {
+	struct list_head list;
+	struct breakpoint *breakpoint;
+};
+
 #define DTM_DTMCS_VERSION_UNKNOWN ((unsigned int)-1)
 
+/* The best size of the batches used for block memory accesses depends on the
+ * adapter: the fixed cost of a JTAG queue flush differs between USB probes and
+ * simulators by orders of magnitude. The sizer measures the cost per scan of
+ * full batches and hill-climbs (doubling or halving the size) until the cost
+ * stops improving. */
+struct riscv_batch_sizer {
+	/* Size requested by "riscv batch_size". 0 means "auto". */
+	unsigned int requested;
+	/* Size used for the next batch. */
+	unsigned int current;
+	/* Tuning is finished, "current" is the chosen size. */
+	bool settled;
+	/* +1 when the size is being increased, -1 when it is being decreased. */
+	int direction;
+	/* Statistics of the batch runs at "current" size. */
+	unsigned int runs;
+	uint64_t scans;
+	unsigned int flushes;
+	int64_t elapsed_us;
+	/* Best size measured so far and its cost. 0 if not measured yet. */
+	unsigned int best_size;
+	uint64_t best_ns_per_scan;
+};
+
+struct riscv_batch;
+
+/* Number of freed batches kept for reuse by each target. */
+#define RISCV_BATCH_POOL_SIZE 4
+
 struct reg_name_table {
 	unsigned int num_entries;
 	char **reg_names;
 };
 
+/* What identifies a hart, an examine snapshot is only used if all of it
+ * still matches. */
+struct riscv_examine_identity {
+	uint32_t idcode;
+	uint32_t dtmcs;
+	uint32_t hartinfo;
+	uint32_t abstractcs;
+	uint32_t sbcs;
+};
+
+/* Static properties found by examine, see "riscv examine_snapshot". */
+struct riscv_examine_snapshot {
+	struct riscv_examine_identity identity;
+	int xlen;
+	riscv_reg_t misa;
+	unsigned int vlenb;
+	bool mtopi_readable;
+	bool mtopei_readable;
+	/* trigger_count and trigger_tinfo are only valid if set */
+	bool triggers_enumerated;
+	unsigned int trigger_count;
+	unsigned int trigger_tinfo[RISCV_MAX_TRIGGERS];
+};
+
 struct riscv_info {
 	unsigned int common_magic;
 
@@ -154,6 +298,8 @@ struct riscv_info {
 	/* record the tinfo of each trigger */
 	unsigned int trigger_tinfo[RISCV_MAX_TRIGGERS];
 
+	struct riscv_trigger_shadow trigger_shadow[RISCV_MAX_TRIGGERS];
+
 	/* For each physical trigger contains:
 	 * -1: the hwbp is available
 	 * -4: The trigger is used by the itrigger command
@@ -179,6 +325,22 @@ struct riscv_info {
 	 * delays, causing them to be relearned. Used for testing. */
 	int reset_delays_wait;
 
+	struct riscv_batch_sizer batch_sizer;
+
+	/* Batches released by "riscv_batch_free()", kept to be handed out again
+	 * by "riscv_batch_alloc()" without any memory allocation. */
+	struct riscv_batch *batch_pool[RISCV_BATCH_POOL_SIZE];
+	unsigned int batch_pool_used;
+
+	/* Identity read by the last examine, only set by targets that
+	 * support examine snapshots. */
+	bool examine_identity_valid;
+	struct riscv_examine_identity examine_identity;
+	/* Loaded by "riscv examine_snapshot load", NULL if none. */
+	struct riscv_examine_snapshot *examine_snapshot;
+	/* The last examine took its results from examine_snapshot. */
+	bool examine_snapshot_used;
+
 	/* This target has been prepped and is ready to step/resume. */
 	bool prepped;
 	/* This target was selected using hasel. */
@@ -188,6 +350,12 @@ struct riscv_info {
 	bool halted_needs_event_callback;
 	enum target_event halted_callback_event;
 
+	/* Context saved by riscv_start_algorithm(), restored by
+	 * riscv_wait_algorithm(). */
+	uint64_t algorithm_saved_pc;
+	uint64_t algorithm_saved_regs[32];
+	uint64_t algorithm_saved_mstatus;
+
 	enum riscv_isrmasking_mode isrmask_mode;
 
 	/* Helper functions that target the various RISC-V debug spec
@@ -222,6 +390,10 @@ struct riscv_info {
 	int (*on_step)(struct target *target);
 	enum riscv_halt_reason (*halt_reason)(struct target *target);
 	int (*write_progbuf)(struct target *target, unsigned int index, riscv_insn_t d);
+	/* Write a whole program, to be executed from progbuf0. Optional, the
+	 * program is written word by word with write_progbuf() otherwise. */
+	int (*write_program)(struct target *target, const riscv_insn_t *insns,
+			unsigned int count);
 	riscv_insn_t (*read_progbuf)(struct target *target, unsigned int index);
 	int (*execute_progbuf)(struct target *target, uint32_t *cmderr);
 	int (*invalidate_cached_progbuf)(struct target *target);
@@ -250,7 +422,55 @@ struct riscv_info {
 	int (*read_memory)(struct target *target, target_addr_t address,
 			uint32_t size, uint32_t count, uint8_t *buffer, uint32_t increment);
 
+	/* Read the same (physical) memory range from several targets, merging
+	 * the accesses of all the targets into shared JTAG queue flushes.
+	 * "buffers[i]" receives the data of "targets[i]". */
+	int (*read_memory_group)(struct target **targets, unsigned int target_count,
+			target_addr_t address, uint32_t size, uint32_t count,
+			uint8_t **buffers);
+
+	/* Read the same register from several halted harts, sharing JTAG queue
+	 * flushes between the harts of one Debug Module. "valid[i]" tells
+	 * whether "values[i]" was read; the remaining ones have to be read the
+	 * usual way. */
+	int (*read_register_group)(struct target **targets, unsigned int target_count,
+			enum gdb_regno regno, riscv_reg_t *values, bool *valid);
+
+	/* Get the state of several harts at once, sharing JTAG queue flushes
+	 * between the harts of one Debug Module. "valid[i]" tells whether
+	 * "states[i]" was determined; the remaining ones have to be queried
+	 * with get_hart_state(). */
+	int (*get_hart_state_group)(struct target **targets, unsigned int target_count,
+			enum riscv_hart_state *states, bool *valid);
+
+	/* Read several registers of a halted hart, queueing the abstract
+	 * commands back to back. "valid[i]" tells whether "values[i]" was read;
+	 * the remaining ones have to be read the usual way. */
+	int (*read_registers)(struct target *target, const enum gdb_regno *regnos,
+			unsigned int count, riscv_reg_t *values, bool *valid);
+
+	/* Read tdata1 of the triggers "indexes[]" of a halted hart, selecting
+	 * each of them with tselect, in one batch. tselect is left changed.
+	 * "valid[i]" tells whether "values[i]" was read. */
+	int (*read_triggers_tdata1)(struct target *target,
+			const unsigned int *indexes, unsigned int count,
+			riscv_reg_t *values, bool *valid);
+
+	/* Read "count" vector registers starting at "first" into "values"
+	 * (vlenb bytes each). */
+	int (*read_vector_registers)(struct target *target, enum gdb_regno first,
+			unsigned int count, uint8_t *values);
+
+	/* Run "insns" from the program buffer "count" times, collecting the
+	 * XLEN-bit value each execution leaves in s0. */
+	int (*read_progbuf_stream)(struct target *target, const uint32_t *insns,
+			unsigned int insn_count, unsigned int count, uint8_t *buffer);
+
 	unsigned (*data_bits)(struct target *target);
+	/* Widest access size in bytes worth using for a bulk transfer of
+	 * [address, address + count), 0 if unknown. */
+	unsigned int (*bulk_access_size)(struct target *target,
+			target_addr_t address, uint32_t count);
 
 	COMMAND_HELPER((*print_info), struct target *target);
 
@@ -278,6 +498,9 @@ struct riscv_info {
 
 	/* Memory access methods to use, ordered by priority, highest to lowest. */
 	int mem_access_methods[RISCV_NUM_MEM_ACCESS_METHODS];
+	/* Methods used while target->background_access is set: the ones above
+	 * (or those of the matching region), system bus first. */
+	int background_mem_access_methods[RISCV_NUM_MEM_ACCESS_METHODS];
 
 	/* Different memory regions may need different methods but single configuration is applied
 	 * for all. Following flags are used to warn only once about failing memory access method. */
@@ -285,6 +508,10 @@ struct riscv_info {
 	bool mem_access_sysbus_warn;
 	bool mem_access_abstract_warn;
 
+	/* Address ranges that use their own memory access methods, most recently
+	 * configured first. */
+	struct list_head mem_access_regions;
+
 	/* In addition to the ones in the standard spec, we'll also expose additional
 	 * CSRs in this list. */
 	struct list_head expose_csr;
@@ -297,8 +524,43 @@ struct riscv_info {
 	 * but do not appear in gdb targets description or reg command output. */
 	struct list_head hide_csr;
 
+	/* GPRs and CSRs that are read into the register cache in one batch as
+	 * soon as the hart halts ("riscv halt_prefetch"). */
+	struct list_head halt_prefetch_gpr;
+	struct list_head halt_prefetch_csr;
+
+	/* Matrix tiles defined by "riscv define_matrix_tile". */
+	struct list_head matrix_tiles;
+
+	/* Direct mapped by virtual page number. Dropped whenever the hart
+	 * runs, the register cache is invalidated or memory is written, since
+	 * that may have changed the page tables. */
+	struct riscv_tlb_entry tlb[RISCV_TLB_ENTRIES];
+
+	/* Software breakpoints set while the hart is halted. Their ebreaks are
+	 * written all together right before the harts resume. */
+	struct list_head pending_sw_breakpoints;
+	/* The instructions written to memory only need to be fetched after the
+	 * hart resumes, and resuming executes fence.i anyway. So memory writes
+	 * can skip their own fence. */
+	bool skip_write_fence;
+
+	/* Memory-mapped register that holds a recent PC of the running hart
+	 * ("riscv profiling_pc_address"). When set, profiling reads it instead
+	 * of halting the hart for every sample. */
+	struct {
+		bool enabled;
+		target_addr_t address;
+		uint32_t size_bytes;
+	} pc_sample;
+
 	riscv_sample_config_t sample_config;
 	struct riscv_sample_buf sample_buf;
+	/* When set ("riscv memory_sample_sink"), the sample buffer is appended to
+	 * this file after every sampling pass instead of accumulating until
+	 * "riscv dump_sample_buf". */
+	FILE *sample_sink;
+	char *sample_sink_name;
 
 	/* Track when we were last asked to do something substantial. */
 	int64_t last_activity;
@@ -311,6 +573,10 @@ struct riscv_info {
 	bool riscv_ebreaks;
 	bool riscv_ebreaku;
 
+	/* Keep several programs in the program buffer, see
+	 * "riscv set_progbuf_residents". */
+	bool progbuf_residents;
+
 	bool wp_allow_equality_match_trigger;
 	bool wp_allow_napot_trigger;
 	bool wp_allow_ge_lt_trigger;
@@ -405,6 +671,8 @@ size_t riscv_progbuf_size(struct target *target);
 
 riscv_insn_t riscv_read_progbuf(struct target *target, int index);
 int riscv_write_progbuf(struct target *target, int index, riscv_insn_t insn);
+int riscv_write_program(struct target *target, const riscv_insn_t *insns,
+		unsigned int count);
 int riscv_execute_progbuf(struct target *target, uint32_t *cmderr);
 
 void riscv_fill_dm_nop(struct target *target, char *buf);
@@ -415,6 +683,28 @@ int riscv_get_dmi_scan_length(struct target *target);
 uint32_t riscv_get_dmi_address(const struct target *target, uint32_t dm_address);
 
 int riscv_enumerate_triggers(struct target *target);
+/* Return the loaded examine snapshot if it matches the identity examine just
+ * read into examine_identity, NULL otherwise. */
+const struct riscv_examine_snapshot *riscv_examine_snapshot_match(struct target *target);
+
+/* Number of scans to allocate for a batch used for block memory access. */
+unsigned int riscv_get_batch_size(const struct target *target);
+/* Account a run of a block memory access batch of "scans" scans, which took
+ * "elapsed_us" microseconds and "flushes" JTAG queue flushes. */
+void riscv_batch_size_account(struct target *target, size_t scans,
+		unsigned int flushes, int64_t elapsed_us);
+
+/* Return the memory access methods to try for [address, address + size), and
+ * the region they come from (NULL for the target-wide configuration). Background
+ * accesses try the system bus first and are not accounted to any region. */
+const int *riscv_mem_access_methods(struct target *target, target_addr_t address,
+		target_addr_t size, struct riscv_mem_access_region **region);
+/* Record the outcome of a memory access through one of the methods of an
+ * "auto" region. Methods that can't be used for the access count as failed,
+ * so the region still settles. */
+void riscv_mem_access_account(struct target *target,
+		struct riscv_mem_access_region *region, int method, bool success,
+		uint64_t bytes, int64_t elapsed_us);
 
 int riscv_add_watchpoint(struct target *target, struct watchpoint *watchpoint);
 int riscv_remove_watchpoint(struct target *target,
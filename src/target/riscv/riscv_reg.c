@@ -974,3 +974,35 @@ int riscv_reg_get(struct target *target, riscv_reg_t *value,
 	LOG_TARGET_DEBUG(target, "Read %s: 0x%" PRIx64, reg->name, *value);
 	return ERROR_OK;
 }
+
+bool riscv_reg_cache_needs_read(const struct target *target,
+		enum gdb_regno regid)
+{
+	if (!target->reg_cache || target->state != TARGET_HALTED)
+		return false;
+	if (!riscv_reg_impl_gdb_regno_cacheable(regid, /* is write? */ false))
+		return false;
+	const struct reg *reg = riscv_reg_impl_cache_entry(target, regid);
+	return reg->exist && !reg->valid;
+}
+
+void riscv_reg_cache_fill(struct target *target, enum gdb_regno regid,
+		riscv_reg_t value)
+{
+	assert(riscv_reg_cache_needs_read(target, regid));
+	struct reg *reg = riscv_reg_impl_cache_entry(target, regid);
+	buf_set_u64(reg->value, 0, reg->size, value);
+	reg->valid = true;
+	reg->dirty = false;
+	LOG_TARGET_DEBUG(target, "Read %s: 0x%" PRIx64 " (prefetched)", reg->name,
+			value);
+}
+
+void riscv_reg_cache_invalidate(struct target *target, enum gdb_regno regid)
+{
+	if (!target->reg_cache)
+		return;
+	struct reg *reg = riscv_reg_impl_cache_entry(target, regid);
+	assert(!reg->dirty);
+	reg->valid = false;
+}
@@ -34,5 +34,19 @@ int riscv_reg_write(struct target *target, enum gdb_regno i, riscv_reg_t v);
 /** Get register, from the cache if it's in there. */
 int riscv_reg_get(struct target *target, riscv_reg_t *value,
 		enum gdb_regno r);
+/**
+ * Return true if the register needs to be read from the target, i.e. it
+ * exists, is cacheable and there is no valid value in the cache.
+ */
+bool riscv_reg_cache_needs_read(const struct target *target, enum gdb_regno r);
+/**
+ * Store a value that was read from the target by other means (e.g. together
+ * with the same register of other harts) as if it was read by
+ * "riscv_reg_get()".
+ */
+void riscv_reg_cache_fill(struct target *target, enum gdb_regno r,
+		riscv_reg_t value);
+/** Drop the cached value of a (clean) register. */
+void riscv_reg_cache_invalidate(struct target *target, enum gdb_regno r);
 
 #endif /* OPENOCD_TARGET_RISCV_RISCV_REG_H */
@@ -82,14 +82,20 @@ enum semihosting_result riscv_semihosting(struct target *target, int *retval)
 		0x40705013	/* srai    zero,zero,0x7 */
 	};
 
-	/* Read three uncompressed instructions: The previous, the current one (pointed to by PC) and the next one */
+	/* Read three uncompressed instructions: The previous, the current one (pointed to by PC) and the next one.
+	 * Try all of them in a single access first, this is done on every halt. */
+	uint8_t insns[3 * 4];
+	bool read_all = pc % 4 == 0 &&
+		target_read_memory(target, pc - 4, 4, 3, insns) == ERROR_OK;
 	for (int i = 0; i < 3; i++) {
-		uint8_t buf[4];
-		/* Instruction memories may not support arbitrary read size. Use any size that will work. */
+		uint8_t *buf = insns + 4 * i;
 		target_addr_t address = (pc - 4) + 4 * i;
-		*retval = riscv_read_by_any_size(target, address, 4, buf);
-		if (*retval != ERROR_OK)
-			return SEMIHOSTING_ERROR;
+		if (!read_all) {
+			/* Instruction memories may not support arbitrary read size. Use any size that will work. */
+			*retval = riscv_read_by_any_size(target, address, 4, buf);
+			if (*retval != ERROR_OK)
+				return SEMIHOSTING_ERROR;
+		}
 		uint32_t value = target_buffer_get_u32(target, buf);
 		LOG_TARGET_DEBUG(target, "compare 0x%08x from 0x%" PRIx64 " against 0x%08x",
 			value, address, magic[i]);
@@ -10,6 +10,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <helper/log.h>
 #include <helper/binarybuffer.h>
 #include <helper/command.h>
@@ -18,6 +19,18 @@
 
 #include "target.h"
 
+static void decode_rtt_channel(target_addr_t address, const uint8_t *buf,
+		struct rtt_channel *channel)
+{
+	channel->address = address;
+	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
+	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
+	channel->size = buf_get_u32(buf + 8, 0, 32);
+	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
+	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
+	channel->flags = buf_get_u32(buf + 20, 0, 32);
+}
+
 static int read_rtt_channel(struct target *target,
 		const struct rtt_control *ctrl, unsigned int channel_index,
 		enum rtt_channel_type type, struct rtt_channel *channel)
@@ -36,13 +49,7 @@ static int read_rtt_channel(struct target *target,
 	if (ret != ERROR_OK)
 		return ret;
 
-	channel->address = address;
-	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
-	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
-	channel->size = buf_get_u32(buf + 8, 0, 32);
-	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
-	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
-	channel->flags = buf_get_u32(buf + 20, 0, 32);
+	decode_rtt_channel(address, buf, channel);
 
 	return ERROR_OK;
 }
@@ -179,9 +186,8 @@ static bool channel_is_active(const struct rtt_channel *channel)
 	return true;
 }
 
-int target_rtt_write_callback(struct target *target, struct rtt_control *ctrl,
-		unsigned int channel_index, const uint8_t *buffer, size_t *length,
-		void *user_data)
+static int write_down_channel(struct target *target, struct rtt_control *ctrl,
+		unsigned int channel_index, const uint8_t *buffer, size_t *length)
 {
 	int ret;
 	struct rtt_channel channel;
@@ -217,6 +223,17 @@ int target_rtt_write_callback(struct target *target, struct rtt_control *ctrl,
 	return ERROR_OK;
 }
 
+int target_rtt_write_callback(struct target *target, struct rtt_control *ctrl,
+		unsigned int channel_index, const uint8_t *buffer, size_t *length,
+		void *user_data)
+{
+	target->background_access = true;
+	int ret = write_down_channel(target, ctrl, channel_index, buffer, length);
+	target->background_access = false;
+
+	return ret;
+}
+
 int target_rtt_read_control_block(struct target *target,
 		target_addr_t address, struct rtt_control *ctrl, void *user_data)
 {
@@ -363,14 +380,44 @@ static int read_from_channel(struct target *target,
 	return ERROR_OK;
 }
 
-int target_rtt_read_callback(struct target *target,
+static int read_up_channels(struct target *target,
 		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
-		size_t num_channels, void *user_data)
+		struct rtt_channel_stats *stats, size_t num_channels)
 {
+	target_addr_t address = ctrl->address + RTT_CB_SIZE;
+	uint8_t *descs;
+	int ret;
+
 	num_channels = MIN(num_channels, ctrl->num_up_channels);
 
+	/* Only fetch the descriptions up to the last channel with a sink */
+	while (num_channels > 0 && !sinks[num_channels - 1])
+		num_channels--;
+
+	if (!num_channels)
+		return ERROR_OK;
+
+	descs = malloc(num_channels * RTT_CHANNEL_SIZE);
+
+	if (!descs) {
+		LOG_ERROR("rtt: Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/*
+	 * The up-channel descriptions follow each other right after the control
+	 * block, read them all at once instead of one round trip per channel.
+	 */
+	ret = target_read_buffer(target, address, num_channels * RTT_CHANNEL_SIZE,
+		descs);
+
+	if (ret != ERROR_OK) {
+		LOG_ERROR("rtt: Failed to read up-channel descriptions");
+		free(descs);
+		return ret;
+	}
+
 	for (size_t i = 0; i < num_channels; i++) {
-		int ret;
 		struct rtt_channel channel;
 		uint8_t buffer[1024];
 		size_t length;
@@ -378,13 +425,8 @@ int target_rtt_read_callback(struct target *target,
 		if (!sinks[i])
 			continue;
 
-		ret = read_rtt_channel(target, ctrl, i, RTT_CHANNEL_TYPE_UP,
-			&channel);
-
-		if (ret != ERROR_OK) {
-			LOG_ERROR("rtt: Failed to read up-channel %zu description", i);
-			return ret;
-		}
+		decode_rtt_channel(address + i * RTT_CHANNEL_SIZE,
+			descs + i * RTT_CHANNEL_SIZE, &channel);
 
 		if (!channel_is_active(&channel)) {
 			LOG_WARNING("rtt: Up-channel %zu is not active", i);
@@ -396,17 +438,44 @@ int target_rtt_read_callback(struct target *target,
 			continue;
 		}
 
+		uint32_t fill = (channel.write_pos + channel.size - channel.read_pos) %
+			channel.size;
+
+		stats[i].size = channel.size;
+		stats[i].fill = fill;
+
+		if (fill == channel.size - 1)
+			stats[i].overflows++;
+
 		length = sizeof(buffer);
 		ret = read_from_channel(target, &channel, buffer, &length);
 
 		if (ret != ERROR_OK) {
 			LOG_ERROR("rtt: Failed to read from up-channel %zu", i);
-			return ret;
+			break;
 		}
 
-		for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next)
-			sink->read(i, buffer, length, sink->user_data);
+		stats[i].bytes += length;
+
+		for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next) {
+			if (sink->read(i, buffer, length, sink->user_data) != ERROR_OK)
+				stats[i].drops += length;
+		}
 	}
 
-	return ERROR_OK;
+	free(descs);
+
+	return ret;
+}
+
+int target_rtt_read_callback(struct target *target,
+		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
+		struct rtt_channel_stats *stats, size_t num_channels, void *user_data)
+{
+	/* Polling runs while the target does, let it avoid halting the core */
+	target->background_access = true;
+	int ret = read_up_channels(target, ctrl, sinks, stats, num_channels);
+	target->background_access = false;
+
+	return ret;
 }
@@ -137,6 +137,10 @@ int semihosting_common_init(struct target *target, void *setup,
 	semihosting->sys_errno = -1;
 	semihosting->cmdline = NULL;
 	semihosting->basedir = NULL;
+	semihosting->write_buf = NULL;
+	semihosting->write_buf_size = 0;
+	semihosting->write_buf_len = 0;
+	semihosting->write_buf_fd = -1;
 
 	/* If possible, update it in setup(). */
 	semihosting->setup_time = clock();
@@ -217,11 +221,55 @@ static ssize_t semihosting_redirect_write(struct semihosting *semihosting, void
 	return retval;
 }
 
+/* Period of the write-behind buffer flush, in ms */
+#define SEMIHOSTING_WRITE_BUF_FLUSH_MS	100
+
+/* Write back the buffered data. The target was told it was written already,
+ * so an error can only be logged. */
+static void semihosting_write_buf_flush(struct semihosting *semihosting)
+{
+	const uint8_t *buf = semihosting->write_buf;
+	size_t len = semihosting->write_buf_len;
+
+	semihosting->write_buf_len = 0;
+
+	while (len) {
+		ssize_t result = write(semihosting->write_buf_fd, buf, len);
+		if (result <= 0) {
+			LOG_ERROR("semihosting: lost %zu bytes of buffered writes to fd %d: %s",
+				len, semihosting->write_buf_fd, strerror(errno));
+			return;
+		}
+		buf += result;
+		len -= result;
+	}
+}
+
+static int semihosting_write_buf_timer(void *priv)
+{
+	semihosting_write_buf_flush(priv);
+
+	return ERROR_OK;
+}
+
 static ssize_t semihosting_write(struct semihosting *semihosting, int fd, void *buf, int size)
 {
 	if (semihosting_is_redirected(semihosting, fd))
 		return semihosting_redirect_write(semihosting, buf, size);
 
+	if (semihosting->write_buf_size) {
+		if (fd != semihosting->write_buf_fd ||
+				(size_t)size > semihosting->write_buf_size - semihosting->write_buf_len)
+			semihosting_write_buf_flush(semihosting);
+		semihosting->write_buf_fd = fd;
+
+		if ((size_t)size < semihosting->write_buf_size) {
+			memcpy(semihosting->write_buf + semihosting->write_buf_len, buf, size);
+			semihosting->write_buf_len += size;
+			return size;
+		}
+	}
+
 	/* default write */
 	int result = write(fd, buf, size);
 	if (result == -1)
@@ -264,6 +312,39 @@ static inline int semihosting_putchar(struct semihosting *semihosting, int fd, i
 	return putchar(c);
 }
 
+/* Strings are read in blocks of this size, aligned to it */
+#define SEMIHOSTING_STRING_CHUNK	64
+
+/**
+ * Find the length of the NUL terminated string at @a addr and, if @a output,
+ * print it to the semihosting stdout. The string is read a block at a time
+ * rather than byte by byte; the blocks are aligned so that the read never
+ * goes beyond the block holding the terminator.
+ */
+static int semihosting_scan_string(struct target *target, uint64_t addr,
+	bool output, size_t *length)
+{
+	struct semihosting *semihosting = target->semihosting;
+	uint8_t buf[SEMIHOSTING_STRING_CHUNK];
+
+	*length = 0;
+	for (;;) {
+		uint32_t len = SEMIHOSTING_STRING_CHUNK - (addr % SEMIHOSTING_STRING_CHUNK);
+		int retval = target_read_buffer(target, addr, len, buf);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (uint32_t i = 0; i < len; i++) {
+			if (!buf[i])
+				return ERROR_OK;
+			if (output)
+				semihosting_putchar(semihosting, semihosting->stdout_fd, buf[i]);
+			(*length)++;
+		}
+		addr += len;
+	}
+}
+
 static inline ssize_t semihosting_read(struct semihosting *semihosting, int fd, void *buf, int size)
 {
 	if (semihosting_is_redirected(semihosting, fd))
@@ -391,6 +472,11 @@ int semihosting_common(struct target *target)
 			  semihosting_opcode_to_str(semihosting->op),
 			  semihosting->param);
 
+	/* Anything else may depend on the buffered writes, e.g. SYS_READ or
+	 * SYS_SEEK on the same file, or console output in the right order */
+	if (semihosting->write_buf_len && semihosting->op != SEMIHOSTING_SYS_WRITE)
+		semihosting_write_buf_flush(semihosting);
+
 	switch (semihosting->op) {
 
 		case SEMIHOSTING_SYS_CLOCK:	/* 0x10 */
@@ -1451,33 +1537,22 @@ int semihosting_common(struct target *target)
 			 * None. The RETURN REGISTER is corrupted.
 			 */
 			if (semihosting->is_fileio) {
-				size_t count = 0;
-				uint64_t addr = semihosting->param;
-				for (;; addr++) {
-					unsigned char c;
-					retval = target_read_memory(target, addr, 1, 1, &c);
-					if (retval != ERROR_OK)
-						return retval;
-					if (c == '\0')
-						break;
-					count++;
-				}
+				size_t count;
+				retval = semihosting_scan_string(target, semihosting->param,
+						false, &count);
+				if (retval != ERROR_OK)
+					return retval;
 				semihosting->hit_fileio = true;
 				fileio_info->identifier = "write";
 				fileio_info->param_1 = 1;
 				fileio_info->param_2 = semihosting->param;
 				fileio_info->param_3 = count;
 			} else {
-				uint64_t addr = semihosting->param;
-				do {
-					unsigned char c;
-					retval = target_read_memory(target, addr++, 1, 1, &c);
-					if (retval != ERROR_OK)
-						return retval;
-					if (!c)
-						break;
-					semihosting_putchar(semihosting, semihosting->stdout_fd, c);
-				} while (1);
+				size_t count;
+				retval = semihosting_scan_string(target, semihosting->param,
+						true, &count);
+				if (retval != ERROR_OK)
+					return retval;
 				semihosting->result = 0;
 			}
 			break;
@@ -1826,6 +1901,8 @@ static const struct service_driver semihosting_service_driver = {
 	.input_handler = semihosting_service_input_handler,
 	.connection_closed_handler = semihosting_service_connection_closed_handler,
 	.keep_client_alive_handler = NULL,
+	/* coalesce the small writes of a target printing a lot */
+	.buffered_output = true,
 };
 
 /* -------------------------------------------------------------------------
@@ -2112,6 +2189,56 @@ COMMAND_HANDLER(handle_common_semihosting_basedir_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_common_semihosting_write_buffer_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!target) {
+		LOG_ERROR("No target selected");
+		return ERROR_FAIL;
+	}
+
+	struct semihosting *semihosting = target->semihosting;
+	if (!semihosting) {
+		command_print(CMD, "semihosting not supported for current target");
+		return ERROR_FAIL;
+	}
+
+	if (CMD_ARGC > 0) {
+		unsigned int size;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+
+		semihosting_write_buf_flush(semihosting);
+
+		uint8_t *buf = NULL;
+		if (size) {
+			buf = malloc(size);
+			if (!buf) {
+				command_print(CMD, "semihosting failed to allocate the write buffer");
+				return ERROR_FAIL;
+			}
+		}
+
+		if (semihosting->write_buf_size)
+			target_unregister_timer_callback(semihosting_write_buf_timer, semihosting);
+
+		free(semihosting->write_buf);
+		semihosting->write_buf = buf;
+		semihosting->write_buf_size = size;
+
+		if (size)
+			target_register_timer_callback(semihosting_write_buf_timer,
+				SEMIHOSTING_WRITE_BUF_FLUSH_MS, TARGET_TIMER_TYPE_PERIODIC, semihosting);
+	}
+
+	command_print(CMD, "semihosting write buffer: %zu bytes", semihosting->write_buf_size);
+
+	return ERROR_OK;
+}
+
 const struct command_registration semihosting_common_handlers[] = {
 	{
 		.name = "semihosting",
@@ -2162,5 +2289,12 @@ const struct command_registration semihosting_common_handlers[] = {
 		.usage = "[dir]",
 		.help = "set the base directory for semihosting I/O operations",
 	},
+	{
+		.name = "semihosting_write_buffer",
+		.handler = handle_common_semihosting_write_buffer_command,
+		.mode = COMMAND_EXEC,
+		.usage = "[size]",
+		.help = "set the size of the host side buffer for semihosting file writes",
+	},
 	COMMAND_REGISTRATION_DONE
 };
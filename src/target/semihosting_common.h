@@ -177,6 +177,16 @@ struct semihosting {
 	/** Base directory for semihosting I/O operations. */
 	char *basedir;
 
+	/**
+	 * Write-behind buffer for SYS_WRITE to host files, holding data for
+	 * write_buf_fd only. It is flushed by any other semihosting call and
+	 * periodically. Disabled while write_buf_size is 0.
+	 */
+	uint8_t *write_buf;
+	size_t write_buf_size;
+	size_t write_buf_len;
+	int write_buf_fd;
+
 	/**
 	 * Target's extension of semihosting user commands.
 	 * @returns ERROR_NOT_IMPLEMENTED when user command is not handled, otherwise
@@ -18,6 +18,32 @@
 #include "smp.h"
 #include "helper/binarybuffer.h"
 
+/**
+ * Halt barrier of an SMP group. When the group halts each core reports its
+ * own halt; this returns true while another examined core of the group of
+ * @a target is still running, i.e. the halt reported for @a target is not
+ * the last one. Consumers of the halted events can wait for the remaining
+ * cores and refresh threads and registers once for the whole group.
+ */
+bool smp_halt_pending(struct target *target)
+{
+	struct target_list *head;
+
+	if (!target->smp || !target->smp_targets)
+		return false;
+
+	foreach_smp_target(head, target->smp_targets) {
+		struct target *curr = head->target;
+
+		if (curr == target || !target_was_examined(curr))
+			continue;
+		if (curr->state == TARGET_RUNNING)
+			return true;
+	}
+
+	return false;
+}
+
 /* DEPRECATED: gdb_read_smp_packet/gdb_write_smp_packet to be removed      */
 /*  implementation of new packet in gdb interface for smp feature          */
 /*                                                                         */
@@ -20,6 +20,10 @@
 
 extern const struct command_registration smp_command_handlers[];
 
+struct target;
+
+bool smp_halt_pending(struct target *target);
+
 /* DEPRECATED */
 int gdb_read_smp_packet(struct connection *connection,
 		char const *packet, int packet_size);
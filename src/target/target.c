@@ -31,7 +31,11 @@
 #endif
 
 #include <helper/align.h>
+#include <helper/bits.h>
+#include <helper/coop.h>
+#include <helper/crc32.h>
 #include <helper/nvp.h>
+#include <helper/perf.h>
 #include <helper/time_support.h>
 #include <jtag/jtag.h>
 #include <flash/nor/core.h>
@@ -47,11 +51,18 @@
 #include "transport/transport.h"
 #include "arm_cti.h"
 #include "smp.h"
+#include "core_dump.h"
+#include "mem_snapshot.h"
+#include "mem_track.h"
 #include "semihosting_common.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
+/* load_image streams sections through a buffer of this size */
+#define LOAD_IMAGE_CHUNK_SIZE (1024 * 1024)
 
+static int target_read_buffer_list_default(struct target *target,
+		struct target_memory_read_block *blocks, unsigned int num_blocks);
 static int target_read_buffer_default(struct target *target, target_addr_t address,
 		uint32_t count, uint8_t *buffer);
 static int target_write_buffer_default(struct target *target, target_addr_t address,
@@ -61,6 +72,9 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
+static void target_working_area_written(struct target *target,
+		target_addr_t address, uint32_t size);
+static int target_leave_working_area(struct target *target);
 
 static struct target_type *target_types[] = {
 	&arm7tdmi_target,
@@ -106,11 +120,20 @@ static struct target_type *target_types[] = {
 
 struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
-static struct target_timer_callback *target_timer_callbacks;
-static int64_t target_timer_next_event_value;
+/* binary min-heap of the timer callbacks, ordered by 'when' */
+static struct target_timer_callback **target_timer_heap;
+static unsigned int target_timer_count;
+static unsigned int target_timer_heap_size;
+/* callback being run; it cannot be freed by its own unregister */
+static struct target_timer_callback *target_timer_running;
+/* wake up deadline when no timer is registered */
+static int64_t target_timer_idle_event;
 static LIST_HEAD(target_reset_callback_list);
 static LIST_HEAD(target_trace_callback_list);
 static const unsigned int polling_interval = TARGET_DEFAULT_POLLING_INTERVAL;
+/* longest interval between polls of a target that keeps running, 0 to
+ * always poll every polling_interval */
+static unsigned int poll_idle_interval;
 static LIST_HEAD(empty_smp_targets);
 
 enum nvp_assert {
@@ -514,7 +537,9 @@ int target_halt(struct target *target)
 		return ERROR_FAIL;
 	}
 
+	int64_t start = perf_begin();
 	retval = target->type->halt(target);
+	perf_end(PERF_HALT, start, 0);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -567,6 +592,20 @@ int target_resume(struct target *target, int current, target_addr_t address,
 
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_START);
 
+	/* the CPU may change any memory */
+	mem_track_invalidate(target);
+
+	retval = breakpoint_remove_deferred(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* algorithms resume the target too, but run in the working area */
+	if (!debug_execution) {
+		retval = target_leave_working_area(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	/* note that resume *must* be asynchronous. The CPU can halt before
 	 * we poll. The CPU can even halt at the current PC as a result of
 	 * a software breakpoint being inserted by (a bug?) the application.
@@ -580,12 +619,20 @@ int target_resume(struct target *target, int current, target_addr_t address,
 	 * in the correct order.
 	 */
 	bool save_poll_mask = jtag_poll_mask();
+	int64_t start = perf_begin();
 	retval = target->type->resume(target, current, address, handle_breakpoints, debug_execution);
+	perf_end(PERF_RESUME, start, 0);
 	jtag_poll_unmask(save_poll_mask);
 
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* Poll fast again, the target is likely to halt soon after a resume */
+	if (!debug_execution) {
+		target->backoff.interval = polling_interval;
+		target->backoff.next_attempt = 0;
+	}
+
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_END);
 
 	return retval;
@@ -603,8 +650,11 @@ static int target_process_reset(struct command_invocation *cmd, enum target_rese
 	}
 
 	struct target *target;
-	for (target = all_targets; target; target = target->next)
+	for (target = all_targets; target; target = target->next) {
+		if (breakpoint_remove_deferred(target) != ERROR_OK)
+			LOG_TARGET_WARNING(target, "Failed to remove breakpoints before reset.");
 		target_call_reset_callbacks(target, reset_mode);
+	}
 
 	/* disable polling during reset to make reset event scripts
 	 * more predictable, i.e. dr/irscan & pathmove in events will
@@ -798,6 +848,11 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	retval = breakpoint_remove_deferred(target);
+	if (retval != ERROR_OK)
+		goto done;
+
+	mem_track_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -843,6 +898,11 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	retval = breakpoint_remove_deferred(target);
+	if (retval != ERROR_OK)
+		goto done;
+
+	mem_track_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -1251,7 +1311,10 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->read_memory(target, address, size, count, buffer);
+	int64_t start = perf_begin();
+	int retval = target->type->read_memory(target, address, size, count, buffer);
+	perf_end(PERF_READ_MEMORY, start, size * count);
+	return retval;
 }
 
 int target_read_phys_memory(struct target *target,
@@ -1279,7 +1342,13 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->write_memory(target, address, size, count, buffer);
+	target_working_area_written(target, address, size * count);
+	rtos_memory_cache_invalidate();
+	mem_track_written(target, address, (target_addr_t)size * count);
+	int64_t start = perf_begin();
+	int retval = target->type->write_memory(target, address, size, count, buffer);
+	perf_end(PERF_WRITE_MEMORY, start, size * count);
+	return retval;
 }
 
 int target_write_phys_memory(struct target *target,
@@ -1293,6 +1362,10 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_working_area_written(target, address, size * count);
+	rtos_memory_cache_invalidate();
+	/* not tracked by virtual address */
+	mem_track_invalidate(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1303,6 +1376,8 @@ int target_add_breakpoint(struct target *target,
 		LOG_TARGET_ERROR(target, "not halted (add breakpoint)");
 		return ERROR_TARGET_NOT_HALTED;
 	}
+	if (breakpoint->type != BKPT_HARD)
+		mem_track_written(target, breakpoint->address, breakpoint->length);
 	return target->type->add_breakpoint(target, breakpoint);
 }
 
@@ -1323,12 +1398,15 @@ int target_add_hybrid_breakpoint(struct target *target,
 		LOG_TARGET_ERROR(target, "not halted (add hybrid breakpoint)");
 		return ERROR_TARGET_NOT_HALTED;
 	}
+	mem_track_written(target, breakpoint->address, breakpoint->length);
 	return target->type->add_hybrid_breakpoint(target, breakpoint);
 }
 
 int target_remove_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
 {
+	if (breakpoint->type != BKPT_HARD)
+		mem_track_written(target, breakpoint->address, breakpoint->length);
 	return target->type->remove_breakpoint(target, breakpoint);
 }
 
@@ -1393,6 +1471,14 @@ done:
 	return result;
 }
 
+int target_fetch_registers(struct target *target, struct reg **reg_list,
+		int reg_list_size)
+{
+	if (!target->type->fetch_registers || !target_was_examined(target))
+		return ERROR_OK;
+	return target->type->fetch_registers(target, reg_list, reg_list_size);
+}
+
 int target_get_gdb_reg_list_noread(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class)
@@ -1420,7 +1506,19 @@ int target_step(struct target *target,
 
 	target_call_event_callbacks(target, TARGET_EVENT_STEP_START);
 
+	mem_track_invalidate(target);
+
+	retval = breakpoint_remove_deferred(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_leave_working_area(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	int64_t start = perf_begin();
 	retval = target->type->step(target, current, address, handle_breakpoints);
+	perf_end(PERF_STEP, start, 0);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1524,6 +1622,9 @@ static int target_init_one(struct command_context *cmd_ctx,
 	if (!target->type->read_buffer)
 		target->type->read_buffer = target_read_buffer_default;
 
+	if (!target->type->read_buffer_list)
+		target->type->read_buffer_list = target_read_buffer_list_default;
+
 	if (!target->type->write_buffer)
 		target->type->write_buffer = target_write_buffer_default;
 
@@ -1661,35 +1762,110 @@ int target_register_trace_callback(int (*callback)(struct target *target,
 	return ERROR_OK;
 }
 
-int target_register_timer_callback(int (*callback)(void *priv),
-		unsigned int time_ms, enum target_timer_type type, void *priv)
+static bool target_timer_before(const struct target_timer_callback *a,
+		const struct target_timer_callback *b)
+{
+	return a->when < b->when;
+}
+
+static void target_timer_heap_set(unsigned int index, struct target_timer_callback *cb)
+{
+	target_timer_heap[index] = cb;
+	cb->heap_index = index;
+}
+
+static void target_timer_sift_up(unsigned int index)
 {
-	struct target_timer_callback **callbacks_p = &target_timer_callbacks;
+	struct target_timer_callback *cb = target_timer_heap[index];
 
+	while (index > 0) {
+		unsigned int parent = (index - 1) / 2;
+		if (!target_timer_before(cb, target_timer_heap[parent]))
+			break;
+		target_timer_heap_set(index, target_timer_heap[parent]);
+		index = parent;
+	}
+	target_timer_heap_set(index, cb);
+}
+
+static void target_timer_sift_down(unsigned int index)
+{
+	struct target_timer_callback *cb = target_timer_heap[index];
+
+	for (;;) {
+		unsigned int child = 2 * index + 1;
+		if (child >= target_timer_count)
+			break;
+		if (child + 1 < target_timer_count &&
+				target_timer_before(target_timer_heap[child + 1], target_timer_heap[child]))
+			child++;
+		if (!target_timer_before(target_timer_heap[child], cb))
+			break;
+		target_timer_heap_set(index, target_timer_heap[child]);
+		index = child;
+	}
+	target_timer_heap_set(index, cb);
+}
+
+static void target_timer_heap_remove(struct target_timer_callback *cb)
+{
+	unsigned int index = cb->heap_index;
+	struct target_timer_callback *last = target_timer_heap[--target_timer_count];
+
+	if (last == cb)
+		return;
+
+	target_timer_heap_set(index, last);
+	if (index > 0 && target_timer_before(last, target_timer_heap[(index - 1) / 2]))
+		target_timer_sift_up(index);
+	else
+		target_timer_sift_down(index);
+}
+
+int target_register_timer_callback_us(int (*callback)(void *priv),
+		unsigned int time_us, enum target_timer_type type, void *priv)
+{
 	if (!callback)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	if (*callbacks_p) {
-		while ((*callbacks_p)->next)
-			callbacks_p = &((*callbacks_p)->next);
-		callbacks_p = &((*callbacks_p)->next);
+	if (target_timer_count == target_timer_heap_size) {
+		unsigned int size = target_timer_heap_size ? 2 * target_timer_heap_size : 16;
+		struct target_timer_callback **heap = realloc(target_timer_heap,
+				size * sizeof(*heap));
+		if (!heap) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		target_timer_heap = heap;
+		target_timer_heap_size = size;
 	}
 
-	(*callbacks_p) = malloc(sizeof(struct target_timer_callback));
-	(*callbacks_p)->callback = callback;
-	(*callbacks_p)->type = type;
-	(*callbacks_p)->time_ms = time_ms;
-	(*callbacks_p)->removed = false;
+	struct target_timer_callback *cb = malloc(sizeof(struct target_timer_callback));
+	if (!cb) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 
-	(*callbacks_p)->when = timeval_ms() + time_ms;
-	target_timer_next_event_value = MIN(target_timer_next_event_value, (*callbacks_p)->when);
+	cb->callback = callback;
+	cb->type = type;
+	cb->interval_us = time_us;
+	cb->removed = false;
+	cb->when = timeval_us() + time_us;
+	cb->priv = priv;
 
-	(*callbacks_p)->priv = priv;
-	(*callbacks_p)->next = NULL;
+	target_timer_heap_set(target_timer_count++, cb);
+	target_timer_sift_up(cb->heap_index);
 
 	return ERROR_OK;
 }
 
+int target_register_timer_callback(int (*callback)(void *priv),
+		unsigned int time_ms, enum target_timer_type type, void *priv)
+{
+	return target_register_timer_callback_us(callback,
+			MIN(time_ms, UINT_MAX / 1000) * 1000, type, priv);
+}
+
 int target_unregister_event_callback(int (*callback)(struct target *target,
 		enum target_event event, void *priv), void *priv)
 {
@@ -1756,10 +1932,19 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 	if (!callback)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	for (struct target_timer_callback *c = target_timer_callbacks;
-	     c; c = c->next) {
-		if ((c->callback == callback) && (c->priv == priv)) {
-			c->removed = true;
+	struct target_timer_callback *running = target_timer_running;
+	if (running && !running->removed && running->callback == callback &&
+			running->priv == priv) {
+		/* freed by target_call_timer_callbacks_check_time() on return */
+		running->removed = true;
+		return ERROR_OK;
+	}
+
+	for (unsigned int i = 0; i < target_timer_count; i++) {
+		struct target_timer_callback *c = target_timer_heap[i];
+		if (c != running && c->callback == callback && c->priv == priv) {
+			target_timer_heap_remove(c);
+			free(c);
 			return ERROR_OK;
 		}
 	}
@@ -1781,6 +1966,21 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 			target_event_name(event),
 			target_name(target));
 
+	switch (event) {
+	case TARGET_EVENT_HALTED:
+	case TARGET_EVENT_RESUMED:
+	case TARGET_EVENT_DEBUG_HALTED:
+	case TARGET_EVENT_DEBUG_RESUMED:
+	case TARGET_EVENT_RESET_ASSERT:
+	case TARGET_EVENT_RESET_END:
+	case TARGET_EVENT_EXAMINE_END:
+		/* also catches the target running without target_resume() */
+		mem_track_invalidate(target);
+		break;
+	default:
+		break;
+	}
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1815,24 +2015,6 @@ int target_call_trace_callbacks(struct target *target, size_t len, uint8_t *data
 	return ERROR_OK;
 }
 
-static int target_timer_callback_periodic_restart(
-		struct target_timer_callback *cb, int64_t *now)
-{
-	cb->when = *now + cb->time_ms;
-	return ERROR_OK;
-}
-
-static int target_call_timer_callback(struct target_timer_callback *cb,
-		int64_t *now)
-{
-	cb->callback(cb->priv);
-
-	if (cb->type == TARGET_TIMER_TYPE_PERIODIC)
-		return target_timer_callback_periodic_restart(cb, now);
-
-	return target_unregister_timer_callback(cb->callback, cb->priv);
-}
-
 static int target_call_timer_callbacks_check_time(int checktime)
 {
 	static bool callback_processing;
@@ -1845,36 +2027,42 @@ static int target_call_timer_callbacks_check_time(int checktime)
 
 	keep_alive();
 
-	int64_t now = timeval_ms();
-
-	/* Initialize to a default value that's a ways into the future.
-	 * The loop below will make it closer to now if there are
-	 * callbacks that want to be called sooner. */
-	target_timer_next_event_value = now + 1000;
-
-	/* Store an address of the place containing a pointer to the
-	 * next item; initially, that's a standalone "root of the
-	 * list" variable. */
-	struct target_timer_callback **callback = &target_timer_callbacks;
-	while (callback && *callback) {
-		if ((*callback)->removed) {
-			struct target_timer_callback *p = *callback;
-			*callback = (*callback)->next;
-			free(p);
-			continue;
-		}
+	int64_t now = timeval_us();
 
-		bool call_it = (*callback)->callback &&
-			((!checktime && (*callback)->type == TARGET_TIMER_TYPE_PERIODIC) ||
-			 now >= (*callback)->when);
+	/* Wake up a ways into the future when there is nothing to do */
+	target_timer_idle_event = now + 1000000;
 
-		if (call_it)
-			target_call_timer_callback(*callback, &now);
+	if (!checktime) {
+		/* make all periodic callbacks due, then restore the heap order */
+		for (unsigned int i = 0; i < target_timer_count; i++)
+			if (target_timer_heap[i]->type == TARGET_TIMER_TYPE_PERIODIC)
+				target_timer_heap[i]->when = now;
+		for (unsigned int i = target_timer_count / 2; i-- > 0; )
+			target_timer_sift_down(i);
+	}
 
-		if (!(*callback)->removed && (*callback)->when < target_timer_next_event_value)
-			target_timer_next_event_value = (*callback)->when;
+	/* Each periodic callback is rescheduled past 'now' before it runs,
+	 * so every due callback is called at most once per pass. */
+	while (target_timer_count && target_timer_heap[0]->when <= now) {
+		struct target_timer_callback *cb = target_timer_heap[0];
 
-		callback = &(*callback)->next;
+		if (cb->type == TARGET_TIMER_TYPE_PERIODIC) {
+			cb->when = now + MAX(cb->interval_us, 1);
+			target_timer_sift_down(0);
+		} else {
+			target_timer_heap_remove(cb);
+		}
+
+		target_timer_running = cb;
+		cb->callback(cb->priv);
+		target_timer_running = NULL;
+
+		if (cb->type == TARGET_TIMER_TYPE_PERIODIC) {
+			if (!cb->removed)
+				continue;
+			target_timer_heap_remove(cb);
+		}
+		free(cb);
 	}
 
 	callback_processing = false;
@@ -1892,24 +2080,236 @@ int target_call_timer_callbacks_now(void)
 	return target_call_timer_callbacks_check_time(0);
 }
 
+int64_t target_timer_next_event_us(void)
+{
+	if (!target_timer_count)
+		return target_timer_idle_event;
+
+	return target_timer_heap[0]->when;
+}
+
 int64_t target_timer_next_event(void)
 {
-	return target_timer_next_event_value;
+	/* round up, waking up early would only spin the server loop */
+	return (target_timer_next_event_us() + 999) / 1000;
 }
 
+/* A loader left in the working area by target_write_working_area_code() */
+struct working_area_code {
+	target_addr_t address;
+	uint32_t size;
+	uint32_t crc;
+	/* the allocated area starting at the code, if any */
+	struct working_area *area;
+	/* written or found intact since that area was allocated */
+	bool loaded;
+	struct working_area_code *next;
+};
+
 /* Prints the working area layout for debug purposes */
 static void print_wa_layout(struct target *target)
 {
 	struct working_area *c = target->working_areas;
 
 	while (c) {
-		LOG_DEBUG("%c%c " TARGET_ADDR_FMT "-" TARGET_ADDR_FMT " (%" PRIu32 " bytes)",
-			c->backup ? 'b' : ' ', c->free ? ' ' : '*',
+		LOG_DEBUG("%c " TARGET_ADDR_FMT "-" TARGET_ADDR_FMT " (%" PRIu32 " bytes)",
+			c->free ? ' ' : '*',
 			c->address, c->address + c->size - 1, c->size);
 		c = c->next;
 	}
 }
 
+/* Forget the loaders for which @a match returns true */
+static void target_drop_working_area_code(struct target *target,
+		bool (*match)(struct working_area_code *code, target_addr_t address, uint32_t size),
+		target_addr_t address, uint32_t size)
+{
+	struct working_area_code **p = &target->working_area_code;
+
+	while (*p) {
+		struct working_area_code *code = *p;
+
+		if (match(code, address, size)) {
+			*p = code->next;
+			free(code);
+		} else {
+			p = &code->next;
+		}
+	}
+}
+
+static bool working_area_code_any(struct working_area_code *code,
+		target_addr_t address, uint32_t size)
+{
+	return true;
+}
+
+static bool working_area_code_overlaps(struct working_area_code *code,
+		target_addr_t address, uint32_t size)
+{
+	return code->address < address + size && address < code->address + code->size;
+}
+
+/* A new area can only keep a loader it starts with and fully contains */
+static bool working_area_code_clobbered(struct working_area_code *code,
+		target_addr_t address, uint32_t size)
+{
+	if (!working_area_code_overlaps(code, address, size))
+		return false;
+
+	return code->address != address || code->size > size;
+}
+
+static bool working_area_code_address(struct working_area_code *code,
+		target_addr_t address, uint32_t size)
+{
+	return code->address == address;
+}
+
+/* Whether all of [address, address + size) lies in allocated working areas */
+static bool target_in_allocated_working_area(struct target *target,
+		target_addr_t address, uint32_t size)
+{
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (c->free || address < c->address || address >= c->address + c->size)
+			continue;
+		if (address + size <= c->address + c->size)
+			return true;
+		/* allocated areas can be adjacent */
+		size -= c->address + c->size - address;
+		address = c->address + c->size;
+	}
+
+	return false;
+}
+
+/* Called for every write to target memory, to keep the loaders and
+ * the backup of the working area in sync with what's there */
+static void target_working_area_written(struct target *target,
+		target_addr_t address, uint32_t size)
+{
+	if (!size)
+		return;
+
+	if (target->working_area_code)
+		target_drop_working_area_code(target, working_area_code_overlaps, address, size);
+
+	if (!target->working_area_saved)
+		return;
+
+	/* Writes outside of allocated areas are the user's, who wants them
+	 * to stick rather than being undone by the restore */
+	target_addr_t base = target->working_areas->address;
+	target_addr_t end = base + ALIGN_DOWN(target->working_area_size, 4);
+	target_addr_t first = MAX(address, base);
+	target_addr_t last = MIN(address + size, end);
+
+	for (target_addr_t a = ALIGN_DOWN(first, 4); a < last; a += 4) {
+		if (!target_in_allocated_working_area(target, a, 4))
+			clear_bit((a - base) / 4, target->working_area_saved);
+	}
+}
+
+/* Save the words of the area not saved yet since the target last ran */
+static int target_backup_working_area(struct target *target, struct working_area *area)
+{
+	target_addr_t base = target->working_areas->address;
+	uint32_t words = ALIGN_DOWN(target->working_area_size, 4) / 4;
+
+	if (!target->working_area_saved) {
+		target->working_area_backup = malloc(words * 4);
+		target->working_area_saved = calloc(BITS_TO_LONGS(words), sizeof(unsigned long));
+		if (!target->working_area_backup || !target->working_area_saved) {
+			free(target->working_area_backup);
+			free(target->working_area_saved);
+			target->working_area_backup = NULL;
+			target->working_area_saved = NULL;
+			return ERROR_FAIL;
+		}
+	}
+
+	uint32_t last = (area->address - base + area->size) / 4;
+	for (uint32_t i = (area->address - base) / 4; i < last; ) {
+		if (test_bit(i, target->working_area_saved)) {
+			i++;
+			continue;
+		}
+
+		uint32_t n = 1;
+		while (i + n < last && !test_bit(i + n, target->working_area_saved))
+			n++;
+
+		int retval = target_read_memory(target, base + i * 4, 4, n,
+				target->working_area_backup + i * 4);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (; n; n--)
+			set_bit(i++, target->working_area_saved);
+	}
+
+	return ERROR_OK;
+}
+
+/* Write back the saved words outside of allocated areas, or all of them
+ * if @a all is set, and forget about them */
+static int target_restore_working_area(struct target *target, bool all)
+{
+	unsigned long *saved = target->working_area_saved;
+	uint32_t words = ALIGN_DOWN(target->working_area_size, 4) / 4;
+	int retval = ERROR_OK;
+
+	if (!saved)
+		return ERROR_OK;
+
+	target_addr_t base = target->working_areas->address;
+
+	/* not a user write, don't let target_working_area_written() see it */
+	target->working_area_saved = NULL;
+
+	for (uint32_t i = 0; i < words; ) {
+		if (!test_bit(i, saved) ||
+				(!all && target_in_allocated_working_area(target, base + i * 4, 4))) {
+			i++;
+			continue;
+		}
+
+		uint32_t n = 1;
+		while (i + n < words && test_bit(i + n, saved) &&
+				(all || !target_in_allocated_working_area(target, base + (i + n) * 4, 4)))
+			n++;
+
+		int ret = target_write_memory(target, base + i * 4, 4, n,
+				target->working_area_backup + i * 4);
+		if (ret != ERROR_OK) {
+			LOG_ERROR("failed to restore %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
+					n * 4, base + i * 4);
+			retval = ret;
+		}
+
+		for (; n; n--)
+			clear_bit(i++, saved);
+	}
+
+	target->working_area_saved = saved;
+	if (all) {
+		free(target->working_area_saved);
+		free(target->working_area_backup);
+		target->working_area_saved = NULL;
+		target->working_area_backup = NULL;
+	}
+
+	return retval;
+}
+
+/* The target is about to run its own code, which may use any of the working
+ * area: put back what was saved and forget about the loaders there */
+static int target_leave_working_area(struct target *target)
+{
+	target_drop_working_area_code(target, working_area_code_any, 0, 0);
+	return target_restore_working_area(target, false);
+}
+
 /* Reduce area to size bytes, create a new free area from the remaining bytes, if any. */
 static void target_split_working_area(struct working_area *area, uint32_t size)
 {
@@ -1926,17 +2326,11 @@ static void target_split_working_area(struct working_area *area, uint32_t size)
 		new_wa->next = area->next;
 		new_wa->size = area->size - size;
 		new_wa->address = area->address + size;
-		new_wa->backup = NULL;
 		new_wa->user = NULL;
 		new_wa->free = true;
 
 		area->next = new_wa;
 		area->size = size;
-
-		/* If backup memory was allocated to this area, it has the wrong size
-		 * now so free it and it will be reallocated if/when needed */
-		free(area->backup);
-		area->backup = NULL;
 	}
 }
 
@@ -1956,13 +2350,7 @@ static void target_merge_working_areas(struct target *target)
 			/* Remove the last */
 			struct working_area *to_be_freed = c->next;
 			c->next = c->next->next;
-			free(to_be_freed->backup);
 			free(to_be_freed);
-
-			/* If backup memory was allocated to the remaining area, it's has
-			 * the wrong size now */
-			free(c->backup);
-			c->backup = NULL;
 		} else {
 			c = c->next;
 		}
@@ -2010,7 +2398,6 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 			new_wa->next = NULL;
 			new_wa->size = ALIGN_DOWN(target->working_area_size, 4); /* 4-byte align */
 			new_wa->address = target->working_area;
-			new_wa->backup = NULL;
 			new_wa->user = NULL;
 			new_wa->free = true;
 		}
@@ -2039,18 +2426,25 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	LOG_DEBUG("allocated new working area of %" PRIu32 " bytes at address " TARGET_ADDR_FMT,
 			  size, c->address);
 
+	/* The area is saved once until the target runs again, not for every
+	 * allocation: flash drivers allocate and free the same memory many
+	 * times while programming. */
 	if (target->backup_working_area) {
-		if (!c->backup) {
-			c->backup = malloc(c->size);
-			if (!c->backup)
-				return ERROR_FAIL;
-		}
-
-		int retval = target_read_memory(target, c->address, 4, c->size / 4, c->backup);
+		int retval = target_backup_working_area(target, c);
 		if (retval != ERROR_OK)
 			return retval;
 	}
 
+	/* Whoever gets the area may overwrite any loader in it, except one it
+	 * starts with: target_write_working_area_code() will tell */
+	target_drop_working_area_code(target, working_area_code_clobbered, c->address, c->size);
+	for (struct working_area_code *code = target->working_area_code; code; code = code->next) {
+		if (code->address == c->address) {
+			code->area = c;
+			code->loaded = false;
+		}
+	}
+
 	/* mark as used, and return the new (reused) area */
 	c->free = false;
 	*area = c;
@@ -2074,39 +2468,68 @@ int target_alloc_working_area(struct target *target, uint32_t size, struct worki
 
 }
 
-static int target_restore_working_area(struct target *target, struct working_area *area)
+int target_write_working_area_code(struct target *target,
+		struct working_area *area, const uint8_t *code, uint32_t size)
 {
-	int retval = ERROR_OK;
+	uint32_t crc = crc32_be(0, code, size);
+	struct working_area_code *c;
 
-	if (target->backup_working_area && area->backup) {
-		retval = target_write_memory(target, area->address, 4, area->size / 4, area->backup);
-		if (retval != ERROR_OK)
-			LOG_ERROR("failed to restore %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
-					area->size, area->address);
+	for (c = target->working_area_code; c; c = c->next) {
+		if (c->area == area)
+			break;
 	}
 
-	return retval;
+	if (c && c->size == size && c->crc == crc) {
+		LOG_DEBUG("loader of %" PRIu32 " bytes still at address " TARGET_ADDR_FMT,
+				size, area->address);
+		c->loaded = true;
+		return ERROR_OK;
+	}
+
+	int retval = target_write_buffer(target, area->address, size, code);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* the write dropped any other loader there */
+	c = malloc(sizeof(*c));
+	if (!c)
+		return ERROR_OK;
+
+	c->address = area->address;
+	c->size = size;
+	c->crc = crc;
+	c->area = area;
+	c->loaded = true;
+	c->next = target->working_area_code;
+	target->working_area_code = c;
+
+	return ERROR_OK;
 }
 
-/* Restore the area's backup memory, if any, and return the area to the allocation pool */
+/* Return the area to the allocation pool; the area's backup memory, if any,
+ * is restored once the target runs again */
 static int target_free_working_area_restore(struct target *target, struct working_area *area, int restore)
 {
 	if (!area || area->free)
 		return ERROR_OK;
 
-	int retval = ERROR_OK;
-	if (restore) {
-		retval = target_restore_working_area(target, area);
-		/* REVISIT: Perhaps the area should be freed even if restoring fails. */
-		if (retval != ERROR_OK)
-			return retval;
-	}
-
 	area->free = true;
 
 	LOG_DEBUG("freed %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
 			area->size, area->address);
 
+	/* A loader stays for the next user of that memory, unless the area
+	 * was used for something else */
+	for (struct working_area_code *code = target->working_area_code; code; code = code->next) {
+		if (code->area == area) {
+			code->area = NULL;
+			if (!code->loaded)
+				target_drop_working_area_code(target, working_area_code_address,
+						area->address, area->size);
+			break;
+		}
+	}
+
 	/* mark user pointer invalid */
 	/* TODO: Is this really safe? It points to some previous caller's memory.
 	 * How could we know that the area pointer is still in that place and not
@@ -2118,7 +2541,7 @@ static int target_free_working_area_restore(struct target *target, struct workin
 
 	print_wa_layout(target);
 
-	return retval;
+	return ERROR_OK;
 }
 
 int target_free_working_area(struct target *target, struct working_area *area)
@@ -2135,11 +2558,9 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 
 	LOG_DEBUG("freeing all working areas");
 
-	/* Loop through all areas, restoring the allocated ones and marking them as free */
+	/* Loop through all areas, marking the allocated ones as free */
 	while (c) {
 		if (!c->free) {
-			if (restore)
-				target_restore_working_area(target, c);
 			c->free = true;
 			*c->user = NULL; /* Same as above */
 			c->user = NULL;
@@ -2147,6 +2568,17 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 		c = c->next;
 	}
 
+	target_drop_working_area_code(target, working_area_code_any, 0, 0);
+
+	if (restore) {
+		target_restore_working_area(target, true);
+	} else {
+		free(target->working_area_saved);
+		free(target->working_area_backup);
+		target->working_area_saved = NULL;
+		target->working_area_backup = NULL;
+	}
+
 	/* Run a merge pass to combine all areas into one */
 	target_merge_working_areas(target);
 
@@ -2160,7 +2592,6 @@ void target_free_all_working_areas(struct target *target)
 	/* Now we have none or only one working area marked as free */
 	if (target->working_areas) {
 		/* Free the last one to allow on-the-fly moving and resizing */
-		free(target->working_areas->backup);
 		free(target->working_areas);
 		target->working_areas = NULL;
 	}
@@ -2208,6 +2639,7 @@ static void target_destroy(struct target *target)
 	}
 
 	target_free_all_working_areas(target);
+	mem_track_free(target);
 
 	/* release the targets SMP list */
 	if (target->smp) {
@@ -2243,13 +2675,14 @@ void target_quit(void)
 	}
 	target_event_callbacks = NULL;
 
-	struct target_timer_callback *pt = target_timer_callbacks;
-	while (pt) {
-		struct target_timer_callback *t = pt->next;
-		free(pt);
-		pt = t;
-	}
-	target_timer_callbacks = NULL;
+	for (unsigned int i = 0; i < target_timer_count; i++)
+		free(target_timer_heap[i]);
+	free(target_timer_heap);
+	target_timer_heap = NULL;
+	target_timer_count = 0;
+	target_timer_heap_size = 0;
+
+	mem_snapshot_free_all();
 
 	for (struct target *target = all_targets; target;) {
 		struct target *tmp;
@@ -2366,6 +2799,9 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	target_working_area_written(target, address, size);
+	rtos_memory_cache_invalidate();
+	mem_track_written(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2470,6 +2906,41 @@ static int target_read_buffer_default(struct target *target, target_addr_t addre
 	return ERROR_OK;
 }
 
+int target_read_buffer_list(struct target *target,
+		struct target_memory_read_block *blocks, unsigned int num_blocks)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; i < num_blocks; i++) {
+		if (blocks[i].size && blocks[i].address + blocks[i].size - 1 < blocks[i].address) {
+			LOG_ERROR("address + size wrapped (" TARGET_ADDR_FMT ", 0x%08" PRIx32 ")",
+					blocks[i].address, blocks[i].size);
+			return ERROR_FAIL;
+		}
+	}
+
+	if (num_blocks == 0)
+		return ERROR_OK;
+
+	return target->type->read_buffer_list(target, blocks, num_blocks);
+}
+
+static int target_read_buffer_list_default(struct target *target,
+		struct target_memory_read_block *blocks, unsigned int num_blocks)
+{
+	for (unsigned int i = 0; i < num_blocks; i++) {
+		int retval = target_read_buffer(target, blocks[i].address, blocks[i].size,
+				blocks[i].buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 int target_checksum_memory(struct target *target, target_addr_t address, uint32_t size, uint32_t *crc)
 {
 	uint8_t *buffer;
@@ -2485,7 +2956,13 @@ int target_checksum_memory(struct target *target, target_addr_t address, uint32_
 		return ERROR_FAIL;
 	}
 
+	if (mem_track_get_checksum(target, address, size, crc))
+		return ERROR_OK;
+
+	/* the algorithm only writes memory through the target API */
+	mem_track_read_only_begin(target);
 	retval = target->type->checksum_memory(target, address, size, &checksum);
+	mem_track_read_only_end(target);
 	if (retval != ERROR_OK) {
 		buffer = malloc(size);
 		if (!buffer) {
@@ -2510,10 +2987,91 @@ int target_checksum_memory(struct target *target, target_addr_t address, uint32_
 	}
 
 	*crc = checksum;
+	if (retval == ERROR_OK)
+		mem_track_set_checksum(target, address, size, checksum);
 
 	return retval;
 }
 
+static int target_checksum_memory_list_all(struct target *target,
+		struct target_memory_checksum_block *blocks, unsigned int num_blocks)
+{
+	bool use_list = target->type->checksum_memory_list;
+	unsigned int done = 0;
+	while (done < num_blocks) {
+		if (use_list) {
+			mem_track_read_only_begin(target);
+			int retval = target->type->checksum_memory_list(target, blocks + done,
+					num_blocks - done);
+			mem_track_read_only_end(target);
+			if (retval > 0) {
+				for (int i = 0; i < retval; i++)
+					mem_track_set_checksum(target, blocks[done + i].address,
+							blocks[done + i].size, blocks[done + i].checksum);
+				done += retval;
+				continue;
+			}
+			/* e.g. not enough working area, do the rest one by one */
+			LOG_DEBUG("checksumming the remaining %u blocks one by one",
+					num_blocks - done);
+			use_list = false;
+		}
+		int retval = target_checksum_memory(target, blocks[done].address,
+				blocks[done].size, &blocks[done].checksum);
+		if (retval != ERROR_OK)
+			return retval;
+		done++;
+	}
+
+	return ERROR_OK;
+}
+
+int target_checksum_memory_list(struct target *target,
+		struct target_memory_checksum_block *blocks, unsigned int num_blocks)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (!target->mem_track)
+		return target_checksum_memory_list_all(target, blocks, num_blocks);
+
+	/* Only checksum the blocks that may have changed since the last time */
+	struct target_memory_checksum_block *pending = malloc(num_blocks * sizeof(*pending));
+	unsigned int *index = malloc(num_blocks * sizeof(*index));
+	if (!pending || !index) {
+		free(pending);
+		free(index);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	unsigned int num_pending = 0;
+	for (unsigned int i = 0; i < num_blocks; i++) {
+		if (mem_track_get_checksum(target, blocks[i].address, blocks[i].size,
+					&blocks[i].checksum))
+			continue;
+		pending[num_pending] = blocks[i];
+		index[num_pending++] = i;
+	}
+
+	LOG_TARGET_DEBUG(target, "%u of %u checksums known", num_blocks - num_pending,
+			num_blocks);
+
+	int retval = ERROR_OK;
+	if (num_pending)
+		retval = target_checksum_memory_list_all(target, pending, num_pending);
+	if (retval == ERROR_OK) {
+		for (unsigned int i = 0; i < num_pending; i++)
+			blocks[index[i]].checksum = pending[i].checksum;
+	}
+
+	free(pending);
+	free(index);
+	return retval;
+}
+
 int target_blank_check_memory(struct target *target,
 	struct target_memory_check_block *blocks, int num_blocks,
 	uint8_t erased_value)
@@ -2529,6 +3087,64 @@ int target_blank_check_memory(struct target *target,
 	return target->type->blank_check_memory(target, blocks, num_blocks, erased_value);
 }
 
+/* Read the block from its start until the first word not holding "fill" */
+static int target_fill_check_block(struct target *target,
+		struct target_memory_check_block *block, uint32_t fill)
+{
+	uint8_t buffer[256];
+
+	block->result = 0;
+	while (block->result < block->size) {
+		uint32_t len = MIN(block->size - block->result, sizeof(buffer));
+		int retval = target_read_buffer(target, block->address + block->result,
+				len, buffer);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (uint32_t i = 0; i + 4 <= len; i += 4) {
+			if (target_buffer_get_u32(target, buffer + i) != fill)
+				return ERROR_OK;
+			block->result += 4;
+		}
+		if (len % 4)
+			return ERROR_OK;
+	}
+
+	return ERROR_OK;
+}
+
+int target_fill_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint32_t fill)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	int i = 0;
+	if (target->type->fill_check_memory) {
+		while (i < num_blocks) {
+			int retval = target->type->fill_check_memory(target, blocks + i,
+					num_blocks - i, fill);
+			if (retval < 1)
+				break;
+			i += retval;
+		}
+		if (i < num_blocks)
+			LOG_DEBUG("fill check algorithm failed, reading %d blocks",
+					num_blocks - i);
+	}
+
+	for (; i < num_blocks; i++) {
+		int retval = target_fill_check_block(target, &blocks[i], fill);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 int target_read_u64(struct target *target, target_addr_t address, uint64_t *value)
 {
 	uint8_t value_buf[8];
@@ -2982,8 +3598,14 @@ static int handle_target(void *priv)
 			continue;
 
 		/* polling may fail silently until the target has been examined */
+		const enum target_state previous_state = target->state;
 		retval = target_poll(target);
-		if (retval == ERROR_OK) {
+		if (retval == ERROR_OK && poll_idle_interval &&
+				previous_state == TARGET_RUNNING && target->state == TARGET_RUNNING) {
+			/* Nothing happened, poll a target that keeps running less often */
+			target->backoff.interval = MIN(poll_idle_interval,
+					MAX(polling_interval, target->backoff.interval * 3 / 2));
+		} else if (retval == ERROR_OK) {
 			/* Polling succeeded, reset the back-off interval */
 			target->backoff.interval = polling_interval;
 		} else {
@@ -3110,7 +3732,9 @@ COMMAND_HANDLER(handle_reg_command)
 			reg->valid = false;
 
 		if (!reg->valid) {
+			int64_t start = perf_begin();
 			int retval = reg->type->get(reg);
+			perf_end(PERF_GET_REGISTER, start, DIV_ROUND_UP(reg->size, 8));
 			if (retval != ERROR_OK) {
 				LOG_ERROR("Could not read register '%s'", reg->name);
 				return retval;
@@ -3129,7 +3753,9 @@ COMMAND_HANDLER(handle_reg_command)
 			return ERROR_FAIL;
 		str_to_buf(CMD_ARGV[1], strlen(CMD_ARGV[1]), buf, reg->size, 0);
 
+		int64_t start = perf_begin();
 		int retval = reg->type->set(reg, buf);
+		perf_end(PERF_SET_REGISTER, start, DIV_ROUND_UP(reg->size, 8));
 		if (retval != ERROR_OK) {
 			LOG_ERROR("Could not write to register '%s'", reg->name);
 		} else {
@@ -3179,6 +3805,18 @@ COMMAND_HANDLER(handle_poll_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_poll_idle_interval_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], poll_idle_interval);
+
+	command_print(CMD, "%u", poll_idle_interval);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_wait_halt_command)
 {
 	if (CMD_ARGC > 1)
@@ -3229,6 +3867,9 @@ int target_wait_state(struct target *target, enum target_state state, unsigned i
 				nvp_value2name(nvp_target_state, state)->name);
 			return ERROR_FAIL;
 		}
+
+		/* e.g. another target's flash can be programmed meanwhile */
+		coop_yield();
 	}
 
 	return ERROR_OK;
@@ -3456,6 +4097,35 @@ COMMAND_HANDLER(handle_md_command)
 typedef int (*target_write_fn)(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, const uint8_t *buffer);
 
+/* Smaller fills are written directly, running an algorithm isn't worth it */
+#define TARGET_FILL_MIN_SIZE	4096
+/* Fill this much at a time on the target, to keep gdb alive */
+#define TARGET_FILL_CHUNK_SIZE	(16 * 1024 * 1024)
+
+/* Let the target fill the memory itself, only the value and the range are
+ * sent. Returns ERROR_TARGET_RESOURCE_NOT_AVAILABLE if it can't. */
+static int target_fill_mem_on_target(struct target *target,
+		target_addr_t address, unsigned int data_size, uint64_t value,
+		unsigned int count)
+{
+	const unsigned int chunk = TARGET_FILL_CHUNK_SIZE / data_size;
+
+	for (unsigned int x = 0; x < count; x += chunk) {
+		const unsigned int current = MIN(count - x, chunk);
+		const target_addr_t chunk_address = address + (target_addr_t)x * data_size;
+
+		target_working_area_written(target, chunk_address, current * data_size);
+		rtos_memory_cache_invalidate();
+		mem_track_written(target, chunk_address, (target_addr_t)current * data_size);
+		int retval = target->type->fill_memory(target, chunk_address, data_size,
+				current, value);
+		if (retval != ERROR_OK)
+			return retval;
+		keep_alive();
+	}
+	return ERROR_OK;
+}
+
 static int target_fill_mem(struct target *target,
 		target_addr_t address,
 		target_write_fn fn,
@@ -3465,6 +4135,14 @@ static int target_fill_mem(struct target *target,
 		/* count */
 		unsigned c)
 {
+	if ((uint64_t)c * data_size >= TARGET_FILL_MIN_SIZE && fn == target_write_memory && target->type->fill_memory &&
+			target->state == TARGET_HALTED && address % data_size == 0) {
+		int retval = target_fill_mem_on_target(target, address, data_size, b, c);
+		if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			return retval;
+		LOG_TARGET_DEBUG(target, "can't fill on the target, writing the data");
+	}
+
 	/* We have to write in reasonably large chunks to be able
 	 * to fill large memory areas with any sane speed */
 	const unsigned chunk_size = 16384;
@@ -3613,56 +4291,75 @@ COMMAND_HANDLER(handle_load_image_command)
 	if (image_open(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL) != ERROR_OK)
 		return ERROR_FAIL;
 
+	/* Sections are streamed through one chunk sized buffer, so memory use
+	 * doesn't grow with the image and the target transfer starts early. */
+	buffer = malloc(LOAD_IMAGE_CHUNK_SIZE);
+	if (!buffer) {
+		command_print(CMD, "error allocating buffer (%d bytes)",
+				LOAD_IMAGE_CHUNK_SIZE);
+		image_close(&image);
+		return ERROR_FAIL;
+	}
+
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (unsigned int i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (!buffer) {
-			command_print(CMD,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
-
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
-		}
-
+		target_addr_t base_address = image.sections[i].base_address;
+		uint32_t size = image.sections[i].size;
 		uint32_t offset = 0;
-		uint32_t length = buf_cnt;
+		uint32_t length = size;
 
 		/* DANGER!!! beware of unsigned comparison here!!! */
 
-		if ((image.sections[i].base_address + buf_cnt >= min_address) &&
-				(image.sections[i].base_address < max_address)) {
+		if ((base_address + size < min_address) ||
+				(base_address >= max_address))
+			continue;
 
-			if (image.sections[i].base_address < min_address) {
-				/* clip addresses below */
-				offset += min_address-image.sections[i].base_address;
-				length -= offset;
-			}
+		if (base_address < min_address) {
+			/* clip addresses below */
+			offset += min_address - base_address;
+			length -= offset;
+		}
 
-			if (image.sections[i].base_address + buf_cnt > max_address)
-				length -= (image.sections[i].base_address + buf_cnt)-max_address;
+		if (base_address + size > max_address)
+			length -= (base_address + size) - max_address;
+
+		uint32_t written = 0;
+		while (written < length) {
+			uint32_t chunk = MIN(length - written, LOAD_IMAGE_CHUNK_SIZE);
+			const uint8_t *data;
+
+			/* write straight from the image when possible, copy otherwise */
+			if (image_map_section(&image, i, offset + written, chunk, &data) == ERROR_OK) {
+				buf_cnt = chunk;
+			} else {
+				retval = image_read_section(&image, i, offset + written, chunk,
+						buffer, &buf_cnt);
+				if (retval != ERROR_OK || buf_cnt == 0)
+					break;
+				data = buffer;
+			}
 
 			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
-			if (retval != ERROR_OK) {
-				free(buffer);
+					base_address + offset + written, buf_cnt, data);
+			if (retval != ERROR_OK)
+				break;
+			written += buf_cnt;
+
+			/* short read, end of the section data */
+			if (buf_cnt < chunk)
 				break;
-			}
-			image_size += length;
-			command_print(CMD, "%u bytes written at address " TARGET_ADDR_FMT "",
-					(unsigned int)length,
-					image.sections[i].base_address + offset);
 		}
+		if (retval != ERROR_OK)
+			break;
 
-		free(buffer);
+		image_size += written;
+		command_print(CMD, "%u bytes written at address " TARGET_ADDR_FMT "",
+				(unsigned int)written, base_address + offset);
 	}
 
+	free(buffer);
+
 	if ((retval == ERROR_OK) && (duration_measure(&bench) == ERROR_OK)) {
 		command_print(CMD, "downloaded %" PRIu32 " bytes "
 				"in %fs (%0.3f KiB/s)", image_size,
@@ -3783,10 +4480,61 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 	if (retval != ERROR_OK)
 		return retval;
 
-	image_size = 0x0;
-	int diffs = 0;
-	retval = ERROR_OK;
-	for (unsigned int i = 0; i < image.num_sections; i++) {
+	image_size = 0x0;
+	int diffs = 0;
+	retval = ERROR_OK;
+
+	/* Checksum all the sections of the image with a single call, so that a
+	 * target running an algorithm for it only needs to load it once. */
+	struct target_memory_checksum_block *blocks = NULL;
+	uint32_t *checksums = NULL;
+	if (verify >= IMAGE_VERIFY) {
+		blocks = calloc(image.num_sections, sizeof(*blocks));
+		checksums = calloc(image.num_sections, sizeof(*checksums));
+		if (!blocks || !checksums) {
+			command_print(CMD, "error allocating checksums for %u sections",
+					image.num_sections);
+			retval = ERROR_FAIL;
+			goto done;
+		}
+		for (unsigned int i = 0; i < image.num_sections; i++) {
+			buffer = malloc(image.sections[i].size);
+			if (!buffer) {
+				command_print(CMD,
+						"error allocating buffer for section (%" PRIu32 " bytes)",
+						image.sections[i].size);
+				retval = ERROR_FAIL;
+				goto done;
+			}
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval == ERROR_OK)
+				retval = image_calculate_checksum(buffer, buf_cnt, &checksums[i]);
+			free(buffer);
+			if (retval != ERROR_OK)
+				goto done;
+			blocks[i].address = image.sections[i].base_address;
+			blocks[i].size = buf_cnt;
+		}
+		retval = target_checksum_memory_list(target, blocks, image.num_sections);
+		if (retval != ERROR_OK)
+			goto done;
+	}
+
+	for (unsigned int i = 0; i < image.num_sections; i++) {
+		if (verify >= IMAGE_VERIFY) {
+			checksum = checksums[i];
+			mem_checksum = blocks[i].checksum;
+			buf_cnt = blocks[i].size;
+			image_size += buf_cnt;
+			if (checksum == mem_checksum)
+				continue;
+			if (verify == IMAGE_CHECKSUM_ONLY) {
+				LOG_ERROR("checksum mismatch");
+				retval = ERROR_FAIL;
+				goto done;
+			}
+		}
+
 		buffer = malloc(image.sections[i].size);
 		if (!buffer) {
 			command_print(CMD,
@@ -3801,68 +4549,50 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 		}
 
 		if (verify >= IMAGE_VERIFY) {
-			/* calculate checksum of image */
-			retval = image_calculate_checksum(buffer, buf_cnt, &checksum);
-			if (retval != ERROR_OK) {
-				free(buffer);
-				break;
-			}
-
-			retval = target_checksum_memory(target, image.sections[i].base_address, buf_cnt, &mem_checksum);
-			if (retval != ERROR_OK) {
-				free(buffer);
-				break;
-			}
-			if ((checksum != mem_checksum) && (verify == IMAGE_CHECKSUM_ONLY)) {
-				LOG_ERROR("checksum mismatch");
-				free(buffer);
-				retval = ERROR_FAIL;
-				goto done;
-			}
-			if (checksum != mem_checksum) {
-				/* failed crc checksum, fall back to a binary compare */
-				uint8_t *data;
-
-				if (diffs == 0)
-					LOG_ERROR("checksum mismatch - attempting binary compare");
-
-				data = malloc(buf_cnt);
-
-				retval = target_read_buffer(target, image.sections[i].base_address, buf_cnt, data);
-				if (retval == ERROR_OK) {
-					uint32_t t;
-					for (t = 0; t < buf_cnt; t++) {
-						if (data[t] != buffer[t]) {
-							command_print(CMD,
-										  "diff %d address 0x%08x. Was 0x%02x instead of 0x%02x",
-										  diffs,
-										  (unsigned)(t + image.sections[i].base_address),
-										  data[t],
-										  buffer[t]);
-							if (diffs++ >= 127) {
-								command_print(CMD, "More than 128 errors, the rest are not printed.");
-								free(data);
-								free(buffer);
-								goto done;
-							}
+			/* failed crc checksum, fall back to a binary compare */
+			uint8_t *data;
+
+			if (diffs == 0)
+				LOG_ERROR("checksum mismatch - attempting binary compare");
+
+			data = malloc(buf_cnt);
+
+			retval = target_read_buffer(target, image.sections[i].base_address, buf_cnt, data);
+			if (retval == ERROR_OK) {
+				uint32_t t;
+				for (t = 0; t < buf_cnt; t++) {
+					if (data[t] != buffer[t]) {
+						command_print(CMD,
+									  "diff %d address 0x%08x. Was 0x%02x instead of 0x%02x",
+									  diffs,
+									  (unsigned)(t + image.sections[i].base_address),
+									  data[t],
+									  buffer[t]);
+						if (diffs++ >= 127) {
+							command_print(CMD, "More than 128 errors, the rest are not printed.");
+							free(data);
+							free(buffer);
+							goto done;
 						}
-						keep_alive();
 					}
+					keep_alive();
 				}
-				free(data);
 			}
+			free(data);
 		} else {
 			command_print(CMD, "address " TARGET_ADDR_FMT " length 0x%08zx",
 						  image.sections[i].base_address,
 						  buf_cnt);
+			image_size += buf_cnt;
 		}
 
 		free(buffer);
-		image_size += buf_cnt;
 	}
 	if (diffs > 0)
 		command_print(CMD, "No more differences found.");
 done:
+	free(blocks);
+	free(checksums);
 	if (diffs > 0)
 		retval = ERROR_FAIL;
 	if ((retval == ERROR_OK) && (duration_measure(&bench) == ERROR_OK)) {
@@ -3891,6 +4621,115 @@ COMMAND_HANDLER(handle_test_image_command)
 	return CALL_COMMAND_HANDLER(handle_verify_image_command_internal, IMAGE_TEST);
 }
 
+/* Failures listed by mem_test, the others are only counted */
+#define TARGET_MEMORY_TEST_MAX_FAILURES	64
+/* Test this much per algorithm run, to keep gdb alive */
+#define TARGET_MEMORY_TEST_CHUNK_SIZE	(16 * 1024 * 1024)
+/* Galois LFSR, taps 32, 22, 2, 1, as in the memtest loaders */
+#define TARGET_MEMORY_TEST_LFSR_POLY	0x80200003
+
+static const struct nvp nvp_memory_tests[] = {
+	{ .name = "walking_ones", .value = TARGET_MEMORY_TEST_WALKING_ONES },
+	{ .name = "address", .value = TARGET_MEMORY_TEST_ADDRESS },
+	{ .name = "random", .value = TARGET_MEMORY_TEST_LFSR },
+	{ .name = NULL, .value = -1 },
+};
+
+/* Pattern state after "words" words, so the next run continues the
+ * sequence where the last one stopped. */
+static uint32_t target_memory_test_advance(enum target_memory_test test,
+		uint32_t state, uint32_t words)
+{
+	switch (test) {
+	case TARGET_MEMORY_TEST_WALKING_ONES:
+		words %= 32;
+		return words ? state << words | state >> (32 - words) : state;
+	case TARGET_MEMORY_TEST_LFSR:
+		for (uint32_t i = 0; i < words; i++)
+			state = (state >> 1) ^ (state & 1 ? TARGET_MEMORY_TEST_LFSR_POLY : 0);
+		return state;
+	default:
+		return state;
+	}
+}
+
+COMMAND_HANDLER(handle_mem_test_command)
+{
+	if (CMD_ARGC < 3 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t address;
+	uint32_t size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+	const struct nvp *n = nvp_name2value(nvp_memory_tests, CMD_ARGV[2]);
+	if (!n->name) {
+		command_print(CMD, "unknown test '%s'", CMD_ARGV[2]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	enum target_memory_test test = n->value;
+
+	uint32_t state = test == TARGET_MEMORY_TEST_LFSR ? 0x12345678 : 1;
+	if (CMD_ARGC == 4) {
+		if (test != TARGET_MEMORY_TEST_LFSR)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], state);
+		if (!state) {
+			command_print(CMD, "the seed can't be 0");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	if (address % 4 || size % 4 || !size) {
+		command_print(CMD, "address and size must be a multiple of 4");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct target *target = get_current_target(CMD_CTX);
+	if (!target->type->memory_test) {
+		command_print(CMD, "%s can't run memory tests", target_type_name(target));
+		return ERROR_NOT_IMPLEMENTED;
+	}
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD, "target must be halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	struct target_memory_test_failure failures[TARGET_MEMORY_TEST_MAX_FAILURES];
+	unsigned int num_failures = 0;
+	uint64_t total_failures = 0;
+
+	for (uint32_t offset = 0; offset < size; offset += TARGET_MEMORY_TEST_CHUNK_SIZE) {
+		const uint32_t chunk = MIN(size - offset, TARGET_MEMORY_TEST_CHUNK_SIZE);
+		const unsigned int max_failures = TARGET_MEMORY_TEST_MAX_FAILURES - num_failures;
+
+		target_working_area_written(target, address + offset, chunk);
+		rtos_memory_cache_invalidate();
+		mem_track_written(target, address + offset, chunk);
+		int retval = target->type->memory_test(target, address + offset, chunk, test,
+				state, failures + num_failures, max_failures);
+		if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
+			command_print(CMD, "no working area outside of the memory to test");
+			return retval;
+		}
+		if (retval < 0)
+			return retval;
+
+		num_failures += MIN((unsigned int)retval, max_failures);
+		total_failures += retval;
+		state = target_memory_test_advance(test, state, chunk / 4);
+		keep_alive();
+	}
+
+	for (unsigned int i = 0; i < num_failures; i++)
+		command_print(CMD, TARGET_ADDR_FMT ": wrote 0x%08" PRIx32 ", read 0x%08" PRIx32,
+				failures[i].address, failures[i].expected, failures[i].actual);
+	if (total_failures > num_failures)
+		command_print(CMD, "%" PRIu64 " more failures not listed", total_failures - num_failures);
+
+	return ERROR_OK;
+}
+
 static int handle_bp_command_list(struct command_invocation *cmd)
 {
 	struct target *target = get_current_target(cmd->ctx);
@@ -4034,6 +4873,21 @@ COMMAND_HANDLER(handle_rbp_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_bp_defer_removal_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+		breakpoint_set_defer_removal(enable);
+	}
+
+	command_print(CMD, "%s", breakpoint_get_defer_removal() ? "on" : "off");
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_wp_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -4383,10 +5237,10 @@ COMMAND_HANDLER(handle_target_read_memory)
 	 * CMD_ARGV[0] = memory address
 	 * CMD_ARGV[1] = desired element width in bits
 	 * CMD_ARGV[2] = number of elements to read
-	 * CMD_ARGV[3] = optional "phys"
+	 * CMD_ARGV[3..4] = optional "phys" and "binary"
 	 */
 
-	if (CMD_ARGC < 3 || CMD_ARGC > 4)
+	if (CMD_ARGC < 3 || CMD_ARGC > 5)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	/* Arg 1: Memory address. */
@@ -4401,15 +5255,18 @@ COMMAND_HANDLER(handle_target_read_memory)
 	unsigned int count;
 	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], count);
 
-	/* Arg 4: Optional 'phys'. */
+	/* Arg 4 and 5: Optional 'phys' and 'binary'. */
 	bool is_phys = false;
-	if (CMD_ARGC == 4) {
-		if (strcmp(CMD_ARGV[3], "phys")) {
-			command_print(CMD, "invalid argument '%s', must be 'phys'", CMD_ARGV[3]);
+	bool is_binary = false;
+	for (unsigned int i = 3; i < CMD_ARGC; i++) {
+		if (!strcmp(CMD_ARGV[i], "phys")) {
+			is_phys = true;
+		} else if (!strcmp(CMD_ARGV[i], "binary")) {
+			is_binary = true;
+		} else {
+			command_print(CMD, "invalid argument '%s', must be 'phys' or 'binary'", CMD_ARGV[i]);
 			return ERROR_COMMAND_ARGUMENT_INVALID;
 		}
-
-		is_phys = true;
 	}
 
 	switch (width_bits) {
@@ -4439,13 +5296,17 @@ COMMAND_HANDLER(handle_target_read_memory)
 
 	const size_t buffersize = 4096;
 	uint8_t *buffer = malloc(buffersize);
+	/* Text of a chunk, at most "0x" and 16 digits plus a separator per element */
+	char *text = malloc(buffersize / width * 19 + 1);
 
-	if (!buffer) {
+	if (!buffer || !text) {
 		LOG_ERROR("Failed to allocate memory");
+		free(text);
+		free(buffer);
 		return ERROR_FAIL;
 	}
 
-	char *separator = "";
+	const char *separator = "";
 	while (count > 0) {
 		const unsigned int max_chunk_len = buffersize / width;
 		const size_t chunk_len = MIN(count, max_chunk_len);
@@ -4465,10 +5326,23 @@ COMMAND_HANDLER(handle_target_read_memory)
 			 * Add a way to flush and replace old output, but LOG_DEBUG() it
 			 */
 			command_print(CMD, "read_memory: failed to read memory");
+			free(text);
 			free(buffer);
 			return retval;
 		}
 
+		if (is_binary) {
+			/* raw target memory, in target byte order */
+			Jim_AppendString(CMD_CTX->interp, CMD->output, (const char *)buffer,
+					chunk_len * width);
+			count -= chunk_len;
+			addr += chunk_len * width;
+			continue;
+		}
+
+		/* Collect the text of the whole chunk, appending each number to
+		 * the output on its own is much slower for large reads */
+		size_t text_len = 0;
 		for (size_t i = 0; i < chunk_len ; i++) {
 			uint64_t v = 0;
 
@@ -4487,19 +5361,191 @@ COMMAND_HANDLER(handle_target_read_memory)
 				break;
 			}
 
-			command_print_sameline(CMD, "%s0x%" PRIx64, separator, v);
+			text_len += sprintf(text + text_len, "%s0x%" PRIx64, separator, v);
 			separator = " ";
 		}
+		Jim_AppendString(CMD_CTX->interp, CMD->output, text, text_len);
 
 		count -= chunk_len;
 		addr += chunk_len * width;
 	}
 
+	/* exec_command() drops one final newline, don't lose the data's one */
+	if (is_binary)
+		Jim_AppendString(CMD_CTX->interp, CMD->output, "\n", 1);
+
+	free(text);
 	free(buffer);
 
 	return ERROR_OK;
 }
 
+static int target_sequence_read(struct target *target, target_addr_t addr,
+		unsigned int size, bool is_phys, uint64_t *value)
+{
+	uint8_t buf[8];
+	int retval;
+
+	if (is_phys)
+		retval = target_read_phys_memory(target, addr, size, 1, buf);
+	else
+		retval = target_read_memory(target, addr, size, 1, buf);
+	if (retval != ERROR_OK)
+		return retval;
+
+	switch (size) {
+	case 8:
+		*value = target_buffer_get_u64(target, buf);
+		break;
+	case 4:
+		*value = target_buffer_get_u32(target, buf);
+		break;
+	case 2:
+		*value = target_buffer_get_u16(target, buf);
+		break;
+	default:
+		*value = buf[0];
+		break;
+	}
+	return ERROR_OK;
+}
+
+static int target_sequence_write(struct target *target, target_addr_t addr,
+		unsigned int size, bool is_phys, uint64_t value)
+{
+	uint8_t buf[8];
+
+	switch (size) {
+	case 8:
+		target_buffer_set_u64(target, buf, value);
+		break;
+	case 4:
+		target_buffer_set_u32(target, buf, value);
+		break;
+	case 2:
+		target_buffer_set_u16(target, buf, value);
+		break;
+	default:
+		buf[0] = value;
+		break;
+	}
+
+	if (is_phys)
+		return target_write_phys_memory(target, addr, size, 1, buf);
+	return target_write_memory(target, addr, size, 1, buf);
+}
+
+COMMAND_HANDLER(handle_target_memory_sequence)
+{
+	/*
+	 * CMD_ARGV[0] = list of operations
+	 * CMD_ARGV[1] = optional "phys"
+	 */
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	bool is_phys = false;
+	if (CMD_ARGC == 2) {
+		if (strcmp(CMD_ARGV[1], "phys")) {
+			command_print(CMD, "invalid argument '%s', must be 'phys'", CMD_ARGV[1]);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		is_phys = true;
+	}
+
+	static const struct {
+		const char *name;
+		int num_args;
+	} ops[] = {
+		{ "read", 2 },		/* width address */
+		{ "write", 3 },		/* width address value */
+		{ "poll", 5 },		/* width address mask value timeout_ms */
+		{ "delay", 1 },		/* ms */
+	};
+
+	/* The operations are taken straight from the Tcl list, whose parsed
+	 * form Jim keeps with the object, so running the same program again
+	 * parses nothing */
+	Jim_Interp *interp = CMD_CTX->interp;
+	Jim_Obj *program = CMD->jimtcl_argv[0];
+	struct target *target = get_current_target(CMD_CTX);
+	const char *separator = "";
+	const int num_ops = Jim_ListLength(interp, program);
+
+	for (int i = 0; i < num_ops; i++) {
+		Jim_Obj *op = Jim_ListGetIndex(interp, program, i);
+		const int argc = Jim_ListLength(interp, op);
+		const char *name = argc ? Jim_String(Jim_ListGetIndex(interp, op, 0)) : "";
+		jim_wide args[5];
+
+		unsigned int kind;
+		for (kind = 0; kind < ARRAY_SIZE(ops); kind++) {
+			if (!strcmp(name, ops[kind].name))
+				break;
+		}
+		if (kind == ARRAY_SIZE(ops) || argc != ops[kind].num_args + 1) {
+			command_print(CMD, "memory_sequence: invalid operation #%d '%s'", i,
+					Jim_String(op));
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		for (int j = 0; j < ops[kind].num_args; j++) {
+			if (Jim_GetWide(interp, Jim_ListGetIndex(interp, op, j + 1), &args[j]) != JIM_OK) {
+				command_print(CMD, "memory_sequence: invalid number in operation #%d '%s'",
+						i, Jim_String(op));
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+
+		if (!strcmp(name, "delay")) {
+			alive_sleep(args[0]);
+			continue;
+		}
+
+		const unsigned int width_bits = args[0];
+		if (width_bits != 8 && width_bits != 16 && width_bits != 32 && width_bits != 64) {
+			command_print(CMD, "memory_sequence: invalid width in operation #%d, "
+					"must be 8, 16, 32 or 64", i);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		const unsigned int size = width_bits / 8;
+		const target_addr_t addr = args[1];
+		uint64_t value;
+		int retval;
+
+		if (!strcmp(name, "write")) {
+			retval = target_sequence_write(target, addr, size, is_phys, args[2]);
+		} else if (!strcmp(name, "read")) {
+			retval = target_sequence_read(target, addr, size, is_phys, &value);
+		} else {
+			const int64_t then = timeval_ms();
+			for (;;) {
+				retval = target_sequence_read(target, addr, size, is_phys, &value);
+				if (retval != ERROR_OK || (value & args[2]) == (uint64_t)args[3])
+					break;
+				if (timeval_ms() - then > args[4]) {
+					command_print(CMD, "memory_sequence: timeout polling "
+							TARGET_ADDR_FMT " (last value 0x%" PRIx64 ")", addr, value);
+					return ERROR_TIMEOUT_REACHED;
+				}
+				keep_alive();
+			}
+		}
+
+		if (retval != ERROR_OK) {
+			command_print(CMD, "memory_sequence: failed to access "
+					TARGET_ADDR_FMT " in operation #%d", addr, i);
+			return retval;
+		}
+
+		if (strcmp(name, "write")) {
+			command_print_sameline(CMD, "%s0x%" PRIx64, separator, value);
+			separator = " ";
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int target_jim_write_memory(Jim_Interp *interp, int argc,
 		Jim_Obj * const *argv)
 {
@@ -4736,7 +5782,9 @@ static int target_jim_get_reg(Jim_Interp *interp, int argc,
 		}
 
 		if (force || !reg->valid) {
+			int64_t start = perf_begin();
 			int retval = reg->type->get(reg);
+			perf_end(PERF_GET_REGISTER, start, DIV_ROUND_UP(reg->size, 8));
 
 			if (retval != ERROR_OK) {
 				Jim_SetResultFormatted(interp, "failed to read register '%s'",
@@ -4818,7 +5866,9 @@ static int target_jim_set_reg(Jim_Interp *interp, int argc,
 		}
 
 		str_to_buf(reg_value, strlen(reg_value), buf, reg->size, 0);
+		int64_t start = perf_begin();
 		int retval = reg->type->set(reg, buf);
+		perf_end(PERF_SET_REGISTER, start, DIV_ROUND_UP(reg->size, 8));
 		free(buf);
 
 		if (retval != ERROR_OK) {
@@ -4857,6 +5907,7 @@ enum target_cfg_param {
 	TCFG_CHAIN_POSITION,
 	TCFG_DBGBASE,
 	TCFG_RTOS,
+	TCFG_RTOS_SYMBOL_TAG,
 	TCFG_DEFER_EXAMINE,
 	TCFG_GDB_PORT,
 	TCFG_GDB_MAX_CONNECTIONS,
@@ -4874,6 +5925,7 @@ static struct jim_nvp nvp_config_opts[] = {
 	{ .name = "-chain-position",   .value = TCFG_CHAIN_POSITION },
 	{ .name = "-dbgbase",          .value = TCFG_DBGBASE },
 	{ .name = "-rtos",             .value = TCFG_RTOS },
+	{ .name = "-rtos-symbol-tag",  .value = TCFG_RTOS_SYMBOL_TAG },
 	{ .name = "-defer-examine",    .value = TCFG_DEFER_EXAMINE },
 	{ .name = "-gdb-port",         .value = TCFG_GDB_PORT },
 	{ .name = "-gdb-max-connections",   .value = TCFG_GDB_MAX_CONNECTIONS },
@@ -5163,6 +6215,24 @@ no_params:
 			/* loop for more */
 			break;
 
+		case TCFG_RTOS_SYMBOL_TAG:
+			if (goi->isconfigure) {
+				const char *s;
+				e = jim_getopt_string(goi, &s, NULL);
+				if (e != JIM_OK)
+					return e;
+				if (rtos_set_symbol_tag(target, s) != ERROR_OK) {
+					Jim_SetResultString(goi->interp, "out of memory", -1);
+					return JIM_ERR;
+				}
+			} else {
+				if (goi->argc != 0)
+					goto no_params;
+			}
+			Jim_SetResultString(goi->interp, rtos_get_symbol_tag(target), -1);
+			/* loop for more */
+			break;
+
 		case TCFG_DEFER_EXAMINE:
 			/* DEFER_EXAMINE */
 			target->defer_examine = true;
@@ -5576,8 +6646,18 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.name = "read_memory",
 		.mode = COMMAND_EXEC,
 		.handler = handle_target_read_memory,
-		.help = "Read Tcl list of 8/16/32/64 bit numbers from target memory",
-		.usage = "address width count ['phys']",
+		.help = "Read Tcl list of 8/16/32/64 bit numbers, or with 'binary' "
+			"the raw bytes, from target memory",
+		.usage = "address width count ['phys'] ['binary']",
+	},
+	{
+		.name = "memory_sequence",
+		.mode = COMMAND_EXEC,
+		.handler = handle_target_memory_sequence,
+		.help = "Run a list of memory reads, writes, polls and delays, "
+			"returning the values read",
+		.usage = "{{read width address} {write width address value} "
+			"{poll width address mask value timeout_ms} {delay ms} ...} ['phys']",
 	},
 	{
 		.name = "write_memory",
@@ -5670,6 +6750,9 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "invoke handler for specified event",
 		.usage = "event_name",
 	},
+	{
+		.chain = mem_track_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -5795,6 +6878,7 @@ static int target_create(struct jim_getopt_info *goi)
 
 	target->rtos = NULL;
 	target->rtos_auto_detect = false;
+	target->rtos_symbol_cache = NULL;
 
 	target->gdb_port_override = NULL;
 	target->gdb_max_connections = 1;
@@ -6089,11 +7173,16 @@ struct fast_load {
 	target_addr_t address;
 	uint8_t *data;
 	int length;
-
+	/* image_calculate_checksum() of data, for 'fast_load diff' */
+	uint32_t crc;
 };
 
 static int fastload_num;
 static struct fast_load *fastload;
+/* identifies the file content and arguments fastload was built from */
+static bool fastload_key_valid;
+static uint32_t fastload_key;
+static size_t fastload_key_size;
 
 static void free_fastload(void)
 {
@@ -6105,6 +7194,56 @@ static void free_fastload(void)
 	}
 }
 
+/* CRC over the content of the image file and the command arguments */
+static int fast_load_image_key(struct command_invocation *cmd, uint32_t *key, size_t *size)
+{
+	struct fileio *fileio;
+	int retval = fileio_open(&fileio, CMD_ARGV[0], FILEIO_READ, FILEIO_BINARY);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = fileio_size(fileio, size);
+	if (retval != ERROR_OK) {
+		fileio_close(fileio);
+		return retval;
+	}
+
+	uint8_t *buffer = malloc(LOAD_IMAGE_CHUNK_SIZE);
+	if (!buffer) {
+		fileio_close(fileio);
+		return ERROR_FAIL;
+	}
+
+	uint32_t crc = 0xffffffff;
+	for (size_t pos = 0; pos < *size; ) {
+		size_t chunk = MIN(*size - pos, LOAD_IMAGE_CHUNK_SIZE);
+		const uint8_t *data;
+		size_t size_read = chunk;
+
+		if (fileio_map(fileio, pos, chunk, &data) != ERROR_OK) {
+			retval = fileio_read(fileio, chunk, buffer, &size_read);
+			if (retval != ERROR_OK || !size_read)
+				break;
+			data = buffer;
+		}
+
+		crc = crc32_be(crc, data, size_read);
+		pos += size_read;
+		keep_alive();
+	}
+
+	free(buffer);
+	fileio_close(fileio);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 1; i < CMD_ARGC; i++)
+		crc = crc32_be(crc, CMD_ARGV[i], strlen(CMD_ARGV[i]) + 1);
+
+	*key = crc;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_fast_load_image_command)
 {
 	uint8_t *buffer;
@@ -6123,6 +7262,21 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 	struct duration bench;
 	duration_start(&bench);
 
+	/* Parsing e.g. a large ihex file costs far more than hashing it, keep
+	 * the sections already in memory if neither file nor arguments changed.
+	 * A 'mem' image isn't a file. */
+	uint32_t key = 0;
+	size_t key_size = 0;
+	bool have_key = (CMD_ARGC < 3 || strcmp(CMD_ARGV[2], "mem")) &&
+		fast_load_image_key(CMD, &key, &key_size) == ERROR_OK;
+	if (have_key && fastload && fastload_key_valid &&
+			key == fastload_key && key_size == fastload_key_size) {
+		command_print(CMD, "image unchanged, keeping the one in memory");
+		return ERROR_OK;
+	}
+
+	free_fastload();
+
 	retval = image_open(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL);
 	if (retval != ERROR_OK)
 		return retval;
@@ -6179,6 +7333,7 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 			}
 			memcpy(fastload[i].data, buffer + offset, length);
 			fastload[i].length = length;
+			image_calculate_checksum(fastload[i].data, length, &fastload[i].crc);
 
 			image_size += length;
 			command_print(CMD, "%u bytes written at address 0x%8.8x",
@@ -6201,16 +7356,28 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 
 	image_close(&image);
 
-	if (retval != ERROR_OK)
+	if (retval != ERROR_OK) {
 		free_fastload();
+	} else {
+		fastload_key_valid = have_key;
+		fastload_key = key;
+		fastload_key_size = key_size;
+	}
 
 	return retval;
 }
 
 COMMAND_HANDLER(handle_fast_load_command)
 {
-	if (CMD_ARGC > 0)
+	bool diff = false;
+
+	if (CMD_ARGC > 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "diff"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		diff = true;
+	}
 	if (!fastload) {
 		LOG_ERROR("No image in memory");
 		return ERROR_FAIL;
@@ -6221,6 +7388,18 @@ COMMAND_HANDLER(handle_fast_load_command)
 	int retval = ERROR_OK;
 	for (i = 0; i < fastload_num; i++) {
 		struct target *target = get_current_target(CMD_CTX);
+
+		if (diff && fastload[i].length) {
+			uint32_t crc;
+			if (target_checksum_memory(target, fastload[i].address,
+					fastload[i].length, &crc) == ERROR_OK && crc == fastload[i].crc) {
+				command_print(CMD, "Unchanged 0x%08x, length 0x%08x",
+							  (unsigned int)(fastload[i].address),
+							  (unsigned int)(fastload[i].length));
+				continue;
+			}
+		}
+
 		command_print(CMD, "Write to 0x%08x, length 0x%08x",
 					  (unsigned int)(fastload[i].address),
 					  (unsigned int)(fastload[i].length));
@@ -6501,7 +7680,7 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.mode = COMMAND_EXEC,
 		.help = "loads active fast load image to current target "
 			"- mainly for profiling purposes",
-		.usage = "",
+		.usage = "['diff']",
 	},
 	{
 		.name = "profile",
@@ -6533,6 +7712,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "poll target state; or reconfigure background polling",
 		.usage = "['on'|'off']",
 	},
+	{
+		.name = "poll_idle_interval",
+		.handler = handle_poll_idle_interval_command,
+		.mode = COMMAND_ANY,
+		.help = "display/set the longest interval in ms between background "
+			"polls of a running target, 0 to poll at a fixed rate",
+		.usage = "[milliseconds]",
+	},
 	{
 		.name = "wait_halt",
 		.handler = handle_wait_halt_command,
@@ -6648,6 +7835,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "remove breakpoint",
 		.usage = "'all' | address",
 	},
+	{
+		.name = "bp_defer_removal",
+		.handler = handle_bp_defer_removal_command,
+		.mode = COMMAND_ANY,
+		.help = "keep removed hardware breakpoints set until the "
+			"target resumes",
+		.usage = "['on'|'off']",
+	},
 	{
 		.name = "wp",
 		.handler = handle_wp_command,
@@ -6693,6 +7888,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.mode = COMMAND_EXEC,
 		.usage = "filename [offset [type]]",
 	},
+	{
+		.name = "mem_test",
+		.handler = handle_mem_test_command,
+		.mode = COMMAND_EXEC,
+		.help = "Test memory with an algorithm on the target, "
+			"lists the words that failed",
+		.usage = "address size ('walking_ones'|'address'|'random' [seed])",
+	},
 	{
 		.name = "get_reg",
 		.mode = COMMAND_EXEC,
@@ -6711,8 +7914,18 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "read_memory",
 		.mode = COMMAND_EXEC,
 		.handler = handle_target_read_memory,
-		.help = "Read Tcl list of 8/16/32/64 bit numbers from target memory",
-		.usage = "address width count ['phys']",
+		.help = "Read Tcl list of 8/16/32/64 bit numbers, or with 'binary' "
+			"the raw bytes, from target memory",
+		.usage = "address width count ['phys'] ['binary']",
+	},
+	{
+		.name = "memory_sequence",
+		.mode = COMMAND_EXEC,
+		.handler = handle_target_memory_sequence,
+		.help = "Run a list of memory reads, writes, polls and delays, "
+			"returning the values read",
+		.usage = "{{read width address} {write width address value} "
+			"{poll width address mask value timeout_ms} {delay ms} ...} ['phys']",
 	},
 	{
 		.name = "write_memory",
@@ -6750,6 +7963,12 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "Test the target's memory access functions",
 		.usage = "size",
 	},
+	{
+		.chain = core_dump_command_handlers,
+	},
+	{
+		.chain = mem_snapshot_command_handlers,
+	},
 
 	COMMAND_REGISTRATION_DONE
 };
@@ -85,11 +85,13 @@ enum target_endianness {
 	TARGET_BIG_ENDIAN = 1, TARGET_LITTLE_ENDIAN = 2
 };
 
+struct working_area_code;
+struct mem_track;
+
 struct working_area {
 	target_addr_t address;
 	uint32_t size;
 	bool free;
-	uint8_t *backup;
 	struct working_area **user;
 	struct working_area *next;
 };
@@ -142,6 +144,13 @@ struct target {
 	 */
 	bool running_alg;
 
+	/*
+	 * true while OpenOCD accesses memory on its own behalf behind the back
+	 * of the debugger, e.g. when polling RTT. Targets may then prefer an
+	 * access path that does not need the core halted.
+	 */
+	bool background_access;
+
 	struct target_event_action *event_action;
 
 	bool reset_halt;						/* attempt resetting the CPU into the halted mode? */
@@ -154,12 +163,17 @@ struct target {
 	uint32_t working_area_size;			/* size in bytes */
 	bool backup_working_area;			/* whether the content of the working area has to be preserved */
 	struct working_area *working_areas;/* list of allocated working areas */
+	uint8_t *working_area_backup;		/* working area content saved until the target resumes */
+	unsigned long *working_area_saved;	/* words of the working area saved in working_area_backup */
+	struct working_area_code *working_area_code;	/* loaders still in the working area */
+	struct mem_track *mem_track;		/* memory written while halted, NULL unless tracked */
 	enum target_debug_reason debug_reason;/* reason why the target entered debug state */
 	enum target_endianness endianness;	/* target endianness */
 	/* also see: target_state_name() */
 	enum target_state state;			/* the current backend-state (running, halted, ...) */
 	struct reg_cache *reg_cache;		/* the first register cache of the target (core regs) */
 	struct breakpoint *breakpoints;		/* list of breakpoints */
+	struct breakpoint *breakpoints_removed;	/* hardware breakpoints still set, removal deferred until resume */
 	struct watchpoint *watchpoints;		/* list of watchpoints */
 	struct trace *trace_info;			/* generic trace information */
 	struct debug_msg_receiver *dbgmsg;	/* list of debug message receivers */
@@ -186,6 +200,8 @@ struct target {
 	struct rtos *rtos;					/* Instance of Real Time Operating System support */
 	bool rtos_auto_detect;				/* A flag that indicates that the RTOS has been specified as "auto"
 										 * and must be detected when symbols are offered */
+	struct rtos_symbol_cache *rtos_symbol_cache;	/* RTOS detected last and, with
+										 * -rtos-symbol-tag, its symbol addresses */
 	/* Track when next to poll(). If polling is failing, we don't want to
 	 * poll too quickly because we'll just overwhelm the user with error
 	 * messages. */
@@ -197,6 +213,8 @@ struct target {
 	bool smp_halt_event_postponed;		/* Some SMP implementations (currently Cortex-M) stores
 										 * 'halted' events and emits them after all targets of
 										 * the SMP group has been polled */
+	bool smp_non_stop;					/* gdb runs the SMP group in non-stop mode, the
+										 * targets halt and resume one by one */
 
 	/* the gdb service is there in case of smp, we have only one gdb server
 	 * for all smp target
@@ -335,12 +353,13 @@ enum target_timer_type {
 
 struct target_timer_callback {
 	int (*callback)(void *priv);
-	unsigned int time_ms;
+	int64_t interval_us;
 	enum target_timer_type type;
 	bool removed;
-	int64_t when;	/* output of timeval_ms() */
+	int64_t when;	/* output of timeval_us() */
 	void *priv;
-	struct target_timer_callback *next;
+	/* position in the timer heap */
+	unsigned int heap_index;
 };
 
 struct target_memory_check_block {
@@ -349,6 +368,35 @@ struct target_memory_check_block {
 	uint32_t result;
 };
 
+/** One block of a scattered read, see target_read_buffer_list(). */
+struct target_memory_read_block {
+	target_addr_t address;
+	uint32_t size;
+	uint8_t *buffer;
+};
+
+/** One block of target_checksum_memory_list(). */
+struct target_memory_checksum_block {
+	target_addr_t address;
+	uint32_t size;
+	/* set by target_checksum_memory_list() */
+	uint32_t checksum;
+};
+
+/** Patterns of the "mem_test" command, numbered as the loaders expect. */
+enum target_memory_test {
+	TARGET_MEMORY_TEST_WALKING_ONES = 0,
+	TARGET_MEMORY_TEST_ADDRESS = 1,
+	TARGET_MEMORY_TEST_LFSR = 2,
+};
+
+/** A word that didn't read back as written during a memory test. */
+struct target_memory_test_failure {
+	target_addr_t address;
+	uint32_t expected;
+	uint32_t actual;
+};
+
 int target_register_commands(struct command_context *cmd_ctx);
 int target_examine(void);
 
@@ -405,6 +453,13 @@ int target_call_trace_callbacks(struct target *target, size_t len, uint8_t *data
  */
 int target_register_timer_callback(int (*callback)(void *priv),
 		unsigned int time_ms, enum target_timer_type type, void *priv);
+/**
+ * Same as target_register_timer_callback() with the period in microseconds.
+ * The callback is still only run from the server loop, so the achievable
+ * rate depends on how busy the loop is.
+ */
+int target_register_timer_callback_us(int (*callback)(void *priv),
+		unsigned int time_us, enum target_timer_type type, void *priv);
 int target_unregister_timer_callback(int (*callback)(void *priv), void *priv);
 int target_call_timer_callbacks(void);
 /**
@@ -417,6 +472,8 @@ int target_call_timer_callbacks_now(void);
  * to go to sleep until that time occurs.
  */
 int64_t target_timer_next_event(void);
+/** Same as target_timer_next_event(), in the timeval_us() time base. */
+int64_t target_timer_next_event_us(void);
 
 struct target *get_current_target(struct command_context *cmd_ctx);
 struct target *get_current_target_or_null(struct command_context *cmd_ctx);
@@ -519,6 +576,16 @@ int target_get_gdb_reg_list(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class);
 
+/**
+ * Read the registers of @a reg_list that aren't cached yet in as few
+ * transactions as possible, if the target supports that. Registers that are
+ * still invalid afterwards must be read one by one.
+ *
+ * This routine is a wrapper for target->type->fetch_registers.
+ */
+int target_fetch_registers(struct target *target, struct reg **reg_list,
+		int reg_list_size);
+
 /**
  * Obtain the registers for GDB, but don't read register values from the
  * target.
@@ -660,11 +727,34 @@ int target_write_buffer(struct target *target,
 		target_addr_t address, uint32_t size, const uint8_t *buffer);
 int target_read_buffer(struct target *target,
 		target_addr_t address, uint32_t size, uint8_t *buffer);
+/**
+ * Read several unrelated blocks of memory, as target_read_buffer() does for
+ * each of them. Targets that can queue memory accesses do it in a single
+ * transaction, saving a round trip to the adapter per block.
+ */
+int target_read_buffer_list(struct target *target,
+		struct target_memory_read_block *blocks, unsigned int num_blocks);
 int target_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t *crc);
+/**
+ * Checksum several blocks of memory, setting the checksum of each the way
+ * target_checksum_memory() computes it. Targets that support it do all the
+ * blocks with a single algorithm run instead of one run per block.
+ */
+int target_checksum_memory_list(struct target *target,
+		struct target_memory_checksum_block *blocks, unsigned int num_blocks);
 int target_blank_check_memory(struct target *target,
 		struct target_memory_check_block *blocks, int num_blocks,
 		uint8_t erased_value);
+/**
+ * Count the bytes at the start of each block that hold the 32 bit @a fill
+ * word, leaving the count in the result of the block. The blocks must be
+ * word aligned. Uses an algorithm on the target where there's one and
+ * reads the memory otherwise.
+ */
+int target_fill_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint32_t fill);
 int target_wait_state(struct target *target, enum target_state state, unsigned int ms);
 
 /**
@@ -730,9 +820,17 @@ int target_alloc_working_area(struct target *target,
  */
 int target_alloc_working_area_try(struct target *target,
 		uint32_t size, struct working_area **area);
+/**
+ * Write loader @a code of @a size bytes to the start of @a area, unless it
+ * is still there from an earlier allocation at the same address which
+ * nothing overwrote since.  Loaders are told apart by a CRC of their code.
+ */
+int target_write_working_area_code(struct target *target,
+		struct working_area *area, const uint8_t *code, uint32_t size);
 /**
  * Free a working area.
- * Restore target data if area backup is configured.
+ * If area backup is configured, the target data is restored when the
+ * target resumes or steps, or all working areas are freed.
  * @param target
  * @param area Pointer to the area to be freed or NULL
  * @returns ERROR_OK if successful; error code if restore failed
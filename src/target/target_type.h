@@ -106,6 +106,16 @@ struct target_type {
 			struct reg **reg_list[], int *reg_list_size,
 			enum target_register_class reg_class);
 
+	/**
+	 * Optional. Read the registers of @a reg_list that aren't valid yet into
+	 * the register cache, in as few transactions as the target allows.
+	 * Registers that can't be read this way are left invalid and are read
+	 * one by one through reg->type->get() later on. Do @b not call this
+	 * function directly, use target_fetch_registers() instead.
+	 */
+	int (*fetch_registers)(struct target *target, struct reg **reg_list,
+			int reg_list_size);
+
 	/* target memory access
 	* size: 1 = byte (8bit), 2 = half-word (16bit), 4 = word (32bit)
 	* count: number of items of <size>
@@ -128,15 +138,45 @@ struct target_type {
 	int (*read_buffer)(struct target *target, target_addr_t address,
 			uint32_t size, uint8_t *buffer);
 
+	/* Default implementation reads the blocks one by one with read_buffer,
+	 * target can override to queue them in a single transaction */
+	int (*read_buffer_list)(struct target *target,
+			struct target_memory_read_block *blocks, unsigned int num_blocks);
+
 	/* Default implementation will do some fancy alignment to improve performance, target can override */
 	int (*write_buffer)(struct target *target, target_addr_t address,
 			uint32_t size, const uint8_t *buffer);
 
 	int (*checksum_memory)(struct target *target, target_addr_t address,
 			uint32_t count, uint32_t *checksum);
+	/* Optional, checksum the blocks with as few algorithm runs as possible.
+	 * Returns the number of blocks done from the start of "blocks", or an
+	 * error if not even the first one could be done this way. */
+	int (*checksum_memory_list)(struct target *target,
+			struct target_memory_checksum_block *blocks, unsigned int num_blocks);
 	int (*blank_check_memory)(struct target *target,
 			struct target_memory_check_block *blocks, int num_blocks,
 			uint8_t erased_value);
+	/* Count the bytes at the start of each block that hold the 32 bit
+	 * "fill" word, e.g. the part of a stack that was never used. Sets the
+	 * result of the blocks and returns how many were checked. */
+	int (*fill_check_memory)(struct target *target,
+			struct target_memory_check_block *blocks, int num_blocks,
+			uint32_t fill);
+	/* Optional, fill count elements of size bytes at address with value
+	 * on the target, so that the data doesn't have to be sent. Returns
+	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE if the caller should write the
+	 * memory itself instead. */
+	int (*fill_memory)(struct target *target, target_addr_t address,
+			uint32_t size, uint32_t count, uint64_t value);
+	/* Optional, write a pattern of 32 bit words to size bytes at address
+	 * and verify it with an algorithm on the target. "state" is the first
+	 * walking ones pattern or the LFSR state. Logs up to max_failures,
+	 * which may be 0, and returns how many words failed, or an error. */
+	int (*memory_test)(struct target *target, target_addr_t address,
+			uint32_t size, enum target_memory_test test, uint32_t state,
+			struct target_memory_test_failure *failures,
+			unsigned int max_failures);
 
 	/*
 	 * target break-/watchpoint control
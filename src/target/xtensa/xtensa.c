@@ -17,6 +17,7 @@
 #include <helper/align.h>
 #include <target/register.h>
 #include <target/algorithm.h>
+#include <target/smp.h>
 
 #include "xtensa_chip.h"
 #include "xtensa.h"
@@ -593,32 +594,49 @@ static int xtensa_queue_pwr_reg_write(struct xtensa *xtensa, unsigned int reg, u
 }
 
 /* NOTE: Assumes A3 has already been saved */
-static int xtensa_window_state_save(struct target *target, uint32_t *woe)
+static void xtensa_window_state_queue_read(struct target *target, uint8_t *woe_buf)
+{
+	struct xtensa *xtensa = target_to_xtensa(target);
+	unsigned int woe_sr = (xtensa->core_config->core_type == XT_LX) ? XT_SR_PS : XT_SR_WB;
+
+	/* Save PS (LX) or WB (NX) prior to AR save */
+	xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, woe_sr, XT_REG_A3));
+	xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A3));
+	xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, woe_buf);
+}
+
+/* NOTE: Assumes A3 has already been saved */
+static void xtensa_window_state_queue_disable(struct target *target, uint32_t woe)
 {
 	struct xtensa *xtensa = target_to_xtensa(target);
 	unsigned int woe_sr = (xtensa->core_config->core_type == XT_LX) ? XT_SR_PS : XT_SR_WB;
-	uint32_t woe_dis;
+	uint32_t woe_dis = woe & ~((woe_sr == XT_SR_PS) ? XT_PS_WOE_MSK : XT_WB_S_MSK);
+
+	/* Disable window overflow exceptions prior to AR save */
+	LOG_TARGET_DEBUG(target, "Clearing %s (0x%08" PRIx32 " -> 0x%08" PRIx32 ")",
+		(woe_sr == XT_SR_PS) ? "PS.WOE" : "WB.S", woe, woe_dis);
+	xtensa_queue_dbg_reg_write(xtensa, XDMREG_DDR, woe_dis);
+	xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, XT_SR_DDR, XT_REG_A3));
+	xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, woe_sr, XT_REG_A3));
+}
+
+/* NOTE: Assumes A3 has already been saved */
+static int xtensa_window_state_save(struct target *target, uint32_t *woe)
+{
+	struct xtensa *xtensa = target_to_xtensa(target);
 	uint8_t woe_buf[4];
 
 	if (xtensa->core_config->windowed) {
-		/* Save PS (LX) or WB (NX) and disable window overflow exceptions prior to AR save */
-		xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, woe_sr, XT_REG_A3));
-		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A3));
-		xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, woe_buf);
+		xtensa_window_state_queue_read(target, woe_buf);
 		int res = xtensa_dm_queue_execute(&xtensa->dbg_mod);
 		if (res != ERROR_OK) {
 			LOG_TARGET_ERROR(target, "Failed to read %s (%d)!",
-				(woe_sr == XT_SR_PS) ? "PS" : "WB", res);
+				(xtensa->core_config->core_type == XT_LX) ? "PS" : "WB", res);
 			return res;
 		}
 		xtensa_core_status_check(target);
 		*woe = buf_get_u32(woe_buf, 0, 32);
-		woe_dis = *woe & ~((woe_sr == XT_SR_PS) ? XT_PS_WOE_MSK : XT_WB_S_MSK);
-		LOG_TARGET_DEBUG(target, "Clearing %s (0x%08" PRIx32 " -> 0x%08" PRIx32 ")",
-			(woe_sr == XT_SR_PS) ? "PS.WOE" : "WB.S", *woe, woe_dis);
-		xtensa_queue_dbg_reg_write(xtensa, XDMREG_DDR, woe_dis);
-		xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, XT_SR_DDR, XT_REG_A3));
-		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, woe_sr, XT_REG_A3));
+		xtensa_window_state_queue_disable(target, *woe);
 	}
 	return ERROR_OK;
 }
@@ -670,7 +688,7 @@ static int xtensa_write_dirty_registers(struct target *target)
 	unsigned int reg_list_size = xtensa->core_cache->num_regs;
 	bool preserve_a3 = false;
 	uint8_t a3_buf[4];
-	xtensa_reg_val_t a3 = 0, woe;
+	xtensa_reg_val_t a3 = 0, woe = 0;
 	unsigned int ms_idx = (xtensa->core_config->core_type == XT_NX) ?
 		xtensa->nx_reg_idx[XT_NX_REG_IDX_MS] : reg_list_size;
 	xtensa_reg_val_t ms = 0;
@@ -1163,6 +1181,7 @@ int xtensa_assert_reset(struct target *target)
 	struct xtensa *xtensa = target_to_xtensa(target);
 
 	LOG_TARGET_DEBUG(target, " begin");
+	xtensa->regs_prefetched = false;
 	xtensa_queue_pwr_reg_write(xtensa,
 		XDMREG_PWRCTL,
 		PWRCTL_JTAGDEBUGUSE(xtensa) | PWRCTL_DEBUGWAKEUP(xtensa) | PWRCTL_MEMWAKEUP(xtensa) |
@@ -1207,57 +1226,96 @@ int xtensa_soft_reset_halt(struct target *target)
 	return xtensa_assert_reset(target);
 }
 
-int xtensa_fetch_all_regs(struct target *target)
+/* State of a register fetch across its queueing phases */
+struct xtensa_reg_fetch {
+	struct target *target;
+	union xtensa_reg_val_u *regvals;
+	union xtensa_reg_val_u *dsrs;
+	bool debug_dsrs;
+	unsigned int ms_idx;
+	uint8_t a0_buf[4], a3_buf[4], ms_buf[4], woe_buf[4];
+};
+
+static int xtensa_reg_fetch_init(struct target *target, struct xtensa_reg_fetch *f)
 {
 	struct xtensa *xtensa = target_to_xtensa(target);
-	struct reg *reg_list = xtensa->core_cache->reg_list;
 	unsigned int reg_list_size = xtensa->core_cache->num_regs;
-	xtensa_reg_val_t cpenable = 0, windowbase = 0, a0 = 0, a3;
-	unsigned int ms_idx = reg_list_size;
-	uint32_t ms = 0;
-	uint32_t woe;
-	uint8_t a0_buf[4], a3_buf[4], ms_buf[4];
-	bool debug_dsrs = !xtensa->regs_fetched || LOG_LEVEL_IS(LOG_LVL_DEBUG);
 
-	union xtensa_reg_val_u *regvals = calloc(reg_list_size, sizeof(*regvals));
-	if (!regvals) {
+	memset(f, 0, sizeof(*f));
+	f->target = target;
+	f->debug_dsrs = !xtensa->regs_fetched || LOG_LEVEL_IS(LOG_LVL_DEBUG);
+	f->ms_idx = reg_list_size;
+
+	f->regvals = calloc(reg_list_size, sizeof(*f->regvals));
+	if (!f->regvals) {
 		LOG_TARGET_ERROR(target, "unable to allocate memory for regvals!");
 		return ERROR_FAIL;
 	}
-	union xtensa_reg_val_u *dsrs = calloc(reg_list_size, sizeof(*dsrs));
-	if (!dsrs) {
+	f->dsrs = calloc(reg_list_size, sizeof(*f->dsrs));
+	if (!f->dsrs) {
 		LOG_TARGET_ERROR(target, "unable to allocate memory for dsrs!");
-		free(regvals);
+		free(f->regvals);
+		f->regvals = NULL;
 		return ERROR_FAIL;
 	}
+	return ERROR_OK;
+}
+
+static void xtensa_reg_fetch_free(struct xtensa_reg_fetch *f)
+{
+	free(f->regvals);
+	free(f->dsrs);
+}
+
+/* First phase: save the scratch registers and read the window state,
+ * needed to queue the second phase */
+static void xtensa_reg_fetch_queue_save(struct xtensa_reg_fetch *f)
+{
+	struct target *target = f->target;
+	struct xtensa *xtensa = target_to_xtensa(target);
 
 	LOG_TARGET_DEBUG(target, "start");
 
 	/* Save (windowed) A3 so cache matches physical AR3; A3 usable as scratch */
 	xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A3));
-	xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, a3_buf);
+	xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, f->a3_buf);
 	if (xtensa->core_config->core_type == XT_NX) {
 		/* Save (windowed) A0 as well--it will be required for reading PC */
 		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A0));
-		xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, a0_buf);
+		xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, f->a0_buf);
 
 		/* Set MS.DispSt, clear MS.DE prior to accessing ARs.  This ensures ARs remain
 		 * in correct order even for reversed register groups (overflow/underflow).
 		 */
-		ms_idx = xtensa->nx_reg_idx[XT_NX_REG_IDX_MS];
-		uint32_t ms_regno = xtensa->optregs[ms_idx - XT_NUM_REGS].reg_num;
+		f->ms_idx = xtensa->nx_reg_idx[XT_NX_REG_IDX_MS];
+		uint32_t ms_regno = xtensa->optregs[f->ms_idx - XT_NUM_REGS].reg_num;
 		xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, ms_regno, XT_REG_A3));
 		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A3));
-		xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, ms_buf);
+		xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, f->ms_buf);
 		LOG_TARGET_DEBUG(target, "Overriding MS (0x%x): 0x%x", ms_regno, XT_MS_DISPST_DBG);
 		xtensa_queue_dbg_reg_write(xtensa, XDMREG_DDR, XT_MS_DISPST_DBG);
 		xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, XT_SR_DDR, XT_REG_A3));
 		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, ms_regno, XT_REG_A3));
 	}
 
-	int res = xtensa_window_state_save(target, &woe);
-	if (res != ERROR_OK)
-		goto xtensa_fetch_all_regs_done;
+	if (xtensa->core_config->windowed)
+		xtensa_window_state_queue_read(target, f->woe_buf);
+}
+
+/* Second phase: queue the reads of all the registers */
+static void xtensa_reg_fetch_queue_read(struct xtensa_reg_fetch *f)
+{
+	struct target *target = f->target;
+	struct xtensa *xtensa = target_to_xtensa(target);
+	unsigned int reg_list_size = xtensa->core_cache->num_regs;
+	union xtensa_reg_val_u *regvals = f->regvals;
+	union xtensa_reg_val_u *dsrs = f->dsrs;
+	uint32_t woe = 0;
+
+	if (xtensa->core_config->windowed) {
+		woe = buf_get_u32(f->woe_buf, 0, 32);
+		xtensa_window_state_queue_disable(target, woe);
+	}
 
 	/* Assume the CPU has just halted. We now want to fill the register cache with all the
 	 * register contents GDB needs. For speed, we pipeline all the read operations, execute them
@@ -1272,7 +1330,7 @@ int xtensa_fetch_all_regs(struct target *target)
 					XT_INS_WSR(xtensa, XT_SR_DDR, xtensa_regs[XT_REG_IDX_AR0 + i].reg_num));
 				xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR,
 					regvals[XT_REG_IDX_AR0 + i + j].buf);
-				if (debug_dsrs)
+				if (f->debug_dsrs)
 					xtensa_queue_dbg_reg_read(xtensa, XDMREG_DSR,
 						dsrs[XT_REG_IDX_AR0 + i + j].buf);
 			}
@@ -1287,37 +1345,22 @@ int xtensa_fetch_all_regs(struct target *target)
 	}
 	xtensa_window_state_restore(target, woe);
 
+	/* The original CPENABLE is only known after the queue ran, so the
+	 * coprocessor registers are queued regardless and discarded when decoding */
+	xtensa_reg_val_t cpenable = 0;
 	if (xtensa->core_config->coproc) {
 		/* As the very first thing after AREGS, go grab CPENABLE */
 		xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, xtensa_regs[XT_REG_IDX_CPENABLE].reg_num, XT_REG_A3));
 		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A3));
 		xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, regvals[XT_REG_IDX_CPENABLE].buf);
-	}
-	res = xtensa_dm_queue_execute(&xtensa->dbg_mod);
-	if (res != ERROR_OK) {
-		LOG_ERROR("Failed to read ARs (%d)!", res);
-		goto xtensa_fetch_all_regs_done;
-	}
-	xtensa_core_status_check(target);
-
-	a3 = buf_get_u32(a3_buf, 0, 32);
-	if (xtensa->core_config->core_type == XT_NX) {
-		a0 = buf_get_u32(a0_buf, 0, 32);
-		ms = buf_get_u32(ms_buf, 0, 32);
-	}
-
-	if (xtensa->core_config->coproc) {
-		cpenable = buf_get_u32(regvals[XT_REG_IDX_CPENABLE].buf, 0, 32);
 
 		/* Enable all coprocessors (by setting all bits in CPENABLE) so we can read FP and user registers. */
 		xtensa_queue_dbg_reg_write(xtensa, XDMREG_DDR, 0xffffffff);
 		xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, XT_SR_DDR, XT_REG_A3));
 		xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, xtensa_regs[XT_REG_IDX_CPENABLE].reg_num, XT_REG_A3));
-
-		/* Save CPENABLE; flag dirty later (when regcache updated) so original value is always restored */
-		LOG_TARGET_DEBUG(target, "CPENABLE: was 0x%" PRIx32 ", all enabled", cpenable);
-		xtensa_reg_set(target, XT_REG_IDX_CPENABLE, cpenable);
+		cpenable = 0xffffffff;
 	}
+
 	/* We're now free to use any of A0-A15 as scratch registers
 	 * Grab the SFRs and user registers first. We use A3 as a scratch register. */
 	for (unsigned int i = 0; i < reg_list_size; i++) {
@@ -1366,20 +1409,42 @@ int xtensa_fetch_all_regs(struct target *target)
 			if (reg_fetched) {
 				xtensa_queue_exec_ins(xtensa, XT_INS_WSR(xtensa, XT_SR_DDR, XT_REG_A3));
 				xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, regvals[i].buf);
-				if (debug_dsrs)
+				if (f->debug_dsrs)
 					xtensa_queue_dbg_reg_read(xtensa, XDMREG_DSR, dsrs[i].buf);
 			}
 		}
 	}
-	/* Ok, send the whole mess to the CPU. */
-	res = xtensa_dm_queue_execute(&xtensa->dbg_mod);
-	if (res != ERROR_OK) {
-		LOG_ERROR("Failed to fetch AR regs!");
-		goto xtensa_fetch_all_regs_done;
-	}
+}
+
+/* Last phase, once the queue ran: decode the results into the register cache */
+static int xtensa_reg_fetch_decode(struct xtensa_reg_fetch *f)
+{
+	struct target *target = f->target;
+	struct xtensa *xtensa = target_to_xtensa(target);
+	struct reg *reg_list = xtensa->core_cache->reg_list;
+	unsigned int reg_list_size = xtensa->core_cache->num_regs;
+	union xtensa_reg_val_u *regvals = f->regvals;
+	union xtensa_reg_val_u *dsrs = f->dsrs;
+	xtensa_reg_val_t cpenable = 0, windowbase = 0, a0 = 0, a3;
+	uint32_t ms = 0;
+
 	xtensa_core_status_check(target);
 
-	if (debug_dsrs) {
+	a3 = buf_get_u32(f->a3_buf, 0, 32);
+	if (xtensa->core_config->core_type == XT_NX) {
+		a0 = buf_get_u32(f->a0_buf, 0, 32);
+		ms = buf_get_u32(f->ms_buf, 0, 32);
+	}
+
+	if (xtensa->core_config->coproc) {
+		cpenable = buf_get_u32(regvals[XT_REG_IDX_CPENABLE].buf, 0, 32);
+
+		/* Save CPENABLE; flag dirty later (when regcache updated) so original value is always restored */
+		LOG_TARGET_DEBUG(target, "CPENABLE: was 0x%" PRIx32 ", all enabled", cpenable);
+		xtensa_reg_set(target, XT_REG_IDX_CPENABLE, cpenable);
+	}
+
+	if (f->debug_dsrs) {
 		/* DSR checking: follows order in which registers are requested. */
 		for (unsigned int i = 0; i < reg_list_size; i++) {
 			struct xtensa_reg_desc *rlist = (i < XT_NUM_REGS) ? xtensa_regs : xtensa->optregs;
@@ -1391,8 +1456,7 @@ int xtensa_fetch_all_regs(struct target *target)
 				(rlist[ridx].type != XT_REG_OTHER)) {
 				if (buf_get_u32(dsrs[i].buf, 0, 32) & OCDDSR_EXECEXCEPTION) {
 					LOG_ERROR("Exception reading %s!", reg_list[i].name);
-					res = ERROR_FAIL;
-					goto xtensa_fetch_all_regs_done;
+					return ERROR_FAIL;
 				}
 			}
 		}
@@ -1435,7 +1499,7 @@ int xtensa_fetch_all_regs(struct target *target)
 					/* A0 from prior CALL0 points to next instruction; decrement it */
 					regval -= 3;
 					is_dirty = 1;
-				} else if (i == ms_idx) {
+				} else if (i == f->ms_idx) {
 					LOG_TARGET_DEBUG(target, "Caching MS: 0x%x", ms);
 					regval = ms;
 					is_dirty = 1;
@@ -1480,12 +1544,72 @@ int xtensa_fetch_all_regs(struct target *target)
 	}
 
 	xtensa->regs_fetched = true;
+	return ERROR_OK;
+}
+
+/* Fetch the registers of several cores, sharing each queue execution
+ * between them. All the cores must be on the same JTAG chain or DAP. */
+int xtensa_fetch_all_regs_group(struct target **targets, unsigned int num)
+{
+	struct xtensa_debug_module *dm = &target_to_xtensa(targets[0])->dbg_mod;
+	bool windowed = false;
+	int res = ERROR_OK;
+
+	struct xtensa_reg_fetch *fetch = calloc(num, sizeof(*fetch));
+	if (!fetch) {
+		LOG_ERROR("unable to allocate memory for register fetch!");
+		return ERROR_FAIL;
+	}
+
+	unsigned int n;
+	for (n = 0; n < num; n++) {
+		struct xtensa *xtensa = target_to_xtensa(targets[n]);
+		assert(xtensa->dbg_mod.dap == dm->dap);
+
+		res = xtensa_reg_fetch_init(targets[n], &fetch[n]);
+		if (res != ERROR_OK)
+			goto xtensa_fetch_all_regs_done;
+		windowed |= xtensa->core_config->windowed;
+		xtensa_reg_fetch_queue_save(&fetch[n]);
+	}
+
+	/* The window state is needed to queue the register reads */
+	if (windowed) {
+		res = xtensa_dm_queue_execute(dm);
+		if (res != ERROR_OK) {
+			LOG_ERROR("Failed to read window state (%d)!", res);
+			goto xtensa_fetch_all_regs_done;
+		}
+	}
+
+	for (unsigned int i = 0; i < num; i++)
+		xtensa_reg_fetch_queue_read(&fetch[i]);
+
+	/* Ok, send the whole mess to the CPU. */
+	res = xtensa_dm_queue_execute(dm);
+	if (res != ERROR_OK) {
+		LOG_ERROR("Failed to fetch regs (%d)!", res);
+		goto xtensa_fetch_all_regs_done;
+	}
+
+	for (unsigned int i = 0; i < num; i++) {
+		int r = xtensa_reg_fetch_decode(&fetch[i]);
+		if (res == ERROR_OK)
+			res = r;
+	}
+
 xtensa_fetch_all_regs_done:
-	free(regvals);
-	free(dsrs);
+	while (n--)
+		xtensa_reg_fetch_free(&fetch[n]);
+	free(fetch);
 	return res;
 }
 
+int xtensa_fetch_all_regs(struct target *target)
+{
+	return xtensa_fetch_all_regs_group(&target, 1);
+}
+
 int xtensa_get_gdb_reg_list(struct target *target,
 	struct reg **reg_list[],
 	int *reg_list_size,
@@ -1611,6 +1735,7 @@ int xtensa_prepare_resume(struct target *target,
 		return ERROR_TARGET_NOT_HALTED;
 	}
 	xtensa->halt_request = false;
+	xtensa->regs_prefetched = false;
 
 	if (address && !current) {
 		xtensa_reg_set(target, XT_REG_IDX_PC, address);
@@ -2034,11 +2159,14 @@ int xtensa_read_memory(struct target *target, target_addr_t address, uint32_t si
 	xtensa_queue_exec_ins(xtensa, XT_INS_RSR(xtensa, XT_SR_DDR, XT_REG_A3));
 	/* Now we can safely read data from addrstart_al up to addrend_al into albuff */
 	if (xtensa->probe_lsddr32p != 0) {
+		unsigned int words = (addrend_al - addrstart_al) / sizeof(uint32_t);
 		xtensa_queue_exec_ins(xtensa, XT_INS_LDDR32P(xtensa, XT_REG_A3));
-		for (unsigned int i = 0; adr != addrend_al; i += sizeof(uint32_t), adr += sizeof(uint32_t))
-			xtensa_queue_dbg_reg_read(xtensa,
-				(adr + sizeof(uint32_t) == addrend_al) ? XDMREG_DDR : XDMREG_DDREXEC,
-				&albuff[i]);
+		/* Stream all but the last word through DDREXEC, each read issuing the next
+		 * LDDR32.P; errors are sticky in DSR and checked once at the end */
+		if (words > 1)
+			xtensa_queue_dbg_reg_read_n(xtensa, XDMREG_DDREXEC, albuff, words - 1);
+		if (words)
+			xtensa_queue_dbg_reg_read(xtensa, XDMREG_DDR, &albuff[(words - 1) * sizeof(uint32_t)]);
 	} else {
 		xtensa_mark_register_dirty(xtensa, XT_REG_IDX_A4);
 		for (unsigned int i = 0; adr != addrend_al; i += sizeof(uint32_t), adr += sizeof(uint32_t)) {
@@ -2301,6 +2429,51 @@ int xtensa_checksum_memory(struct target *target, target_addr_t address, uint32_
 	return ERROR_FAIL;
 }
 
+/* The other SMP cores usually halt along with this one: fetch their registers in
+ * the same queue executions, their own poll then finds them already fetched. */
+static void xtensa_poll_fetch_regs(struct target *target)
+{
+	struct xtensa *xtensa = target_to_xtensa(target);
+	struct target_list *head;
+	unsigned int num = 1;
+
+	if (xtensa->regs_prefetched) {
+		xtensa->regs_prefetched = false;
+		return;
+	}
+
+	if (target->smp)
+		foreach_smp_target(head, target->smp_targets)
+			num++;
+
+	struct target **targets = (num > 1) ? calloc(num, sizeof(*targets)) : NULL;
+	if (!targets) {
+		xtensa_fetch_all_regs(target);
+		return;
+	}
+
+	num = 0;
+	targets[num++] = target;
+	foreach_smp_target(head, target->smp_targets) {
+		struct target *curr = head->target;
+		struct xtensa *curr_xtensa = target_to_xtensa(curr);
+
+		if (curr == target || !target_was_examined(curr) ||
+			curr->state == TARGET_HALTED || curr_xtensa->dbg_mod.dap != xtensa->dbg_mod.dap)
+			continue;
+		if (xtensa_dm_core_status_read(&curr_xtensa->dbg_mod) != ERROR_OK ||
+			!xtensa_is_stopped(curr))
+			continue;
+		targets[num++] = curr;
+	}
+
+	if (xtensa_fetch_all_regs_group(targets, num) == ERROR_OK) {
+		for (unsigned int i = 1; i < num; i++)
+			target_to_xtensa(targets[i])->regs_prefetched = true;
+	}
+	free(targets);
+}
+
 int xtensa_poll(struct target *target)
 {
 	struct xtensa *xtensa = target_to_xtensa(target);
@@ -2360,7 +2533,7 @@ int xtensa_poll(struct target *target)
 			target->state = TARGET_HALTED;
 			/* Examine why the target has been halted */
 			target->debug_reason = DBG_REASON_DBGRQ;
-			xtensa_fetch_all_regs(target);
+			xtensa_poll_fetch_regs(target);
 			/* When setting debug reason DEBUGCAUSE events have the following
 			 * priorities: watchpoint == breakpoint > single step > debug interrupt. */
 			/* Watchpoint and breakpoint events at the same time results in special
@@ -285,6 +285,7 @@ struct xtensa {
 	uint32_t nx_reg_idx[XT_NX_REG_IDX_NUM];
 	struct xtensa_keyval_info scratch_ars[XT_AR_SCRATCH_NUM];
 	bool regs_fetched;	/* true after first register fetch completed successfully */
+	bool regs_prefetched;	/* registers fetched by another SMP core's poll, before our own */
 };
 
 static inline struct xtensa *target_to_xtensa(struct target *target)
@@ -336,6 +337,21 @@ static inline int xtensa_queue_dbg_reg_read(struct xtensa *xtensa, enum xtensa_d
 	return dm->dbg_ops->queue_reg_read(dm, reg, data);
 }
 
+static inline int xtensa_queue_dbg_reg_read_n(struct xtensa *xtensa, enum xtensa_dm_reg reg, uint8_t *data,
+	unsigned int count)
+{
+	struct xtensa_debug_module *dm = &xtensa->dbg_mod;
+
+	if (dm->dbg_ops->queue_reg_read_n)
+		return dm->dbg_ops->queue_reg_read_n(dm, reg, data, count);
+	for (unsigned int i = 0; i < count; i++) {
+		int res = xtensa_queue_dbg_reg_read(xtensa, reg, data + i * 4);
+		if (res != ERROR_OK)
+			return res;
+	}
+	return ERROR_OK;
+}
+
 static inline int xtensa_queue_dbg_reg_write(struct xtensa *xtensa, enum xtensa_dm_reg reg, uint32_t data)
 {
 	struct xtensa_debug_module *dm = &xtensa->dbg_mod;
@@ -366,6 +382,7 @@ xtensa_reg_val_t xtensa_reg_get(struct target *target, enum xtensa_reg_id reg_id
 void xtensa_reg_set(struct target *target, enum xtensa_reg_id reg_id, xtensa_reg_val_t value);
 void xtensa_reg_set_deep_relgen(struct target *target, enum xtensa_reg_id a_idx, xtensa_reg_val_t value);
 int xtensa_fetch_all_regs(struct target *target);
+int xtensa_fetch_all_regs_group(struct target **targets, unsigned int num);
 int xtensa_get_gdb_reg_list(struct target *target,
 	struct reg **reg_list[],
 	int *reg_list_size,
@@ -73,7 +73,8 @@ static int xtensa_chip_virt2phys(struct target *target,
 static const struct xtensa_debug_ops xtensa_chip_dm_dbg_ops = {
 	.queue_enable = xtensa_dm_queue_enable,
 	.queue_reg_read = xtensa_dm_queue_reg_read,
-	.queue_reg_write = xtensa_dm_queue_reg_write
+	.queue_reg_write = xtensa_dm_queue_reg_write,
+	.queue_reg_read_n = xtensa_dm_queue_reg_read_n
 };
 
 static const struct xtensa_power_ops xtensa_chip_dm_pwr_ops = {
@@ -49,6 +49,10 @@ static void xtensa_dm_add_set_ir(struct xtensa_debug_module *dm, uint8_t value)
 	struct scan_field field;
 	uint8_t t[4] = { 0, 0, 0, 0 };
 
+	/* back to back register accesses all go through NARSEL */
+	if (buf_get_u32(dm->tap->cur_instr, 0, dm->tap->ir_length) == value)
+		return;
+
 	memset(&field, 0, sizeof(field));
 	field.num_bits = dm->tap->ir_length;
 	field.out_value = t;
@@ -178,6 +182,25 @@ int xtensa_dm_queue_reg_read(struct xtensa_debug_module *dm, enum xtensa_dm_reg
 	return ERROR_OK;
 }
 
+int xtensa_dm_queue_reg_read_n(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint8_t *value,
+	unsigned int count)
+{
+	if (reg >= XDMREG_NUM) {
+		LOG_ERROR("Invalid DBG reg ID %d!", reg);
+		return ERROR_FAIL;
+	}
+	if (dm->dap)
+		/* one block of queued reads; like single reads on DAP, it runs the queue */
+		return mem_ap_read_buf_noincr(dm->debug_ap, value, 4, count,
+			xdm_regs[reg].apb + dm->ap_offset);
+	for (unsigned int i = 0; i < count; i++) {
+		int res = xtensa_dm_queue_reg_read(dm, reg, value + i * 4);
+		if (res != ERROR_OK)
+			return res;
+	}
+	return ERROR_OK;
+}
+
 int xtensa_dm_queue_reg_write(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint32_t value)
 {
 	if (reg >= XDMREG_NUM) {
@@ -396,6 +396,9 @@ struct xtensa_debug_ops {
 	int (*queue_reg_read)(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint8_t *data);
 	/** register write. */
 	int (*queue_reg_write)(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint32_t data);
+	/** optional, @a count reads of the same register into consecutive words of @a data. */
+	int (*queue_reg_read_n)(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint8_t *data,
+		unsigned int count);
 };
 
 /* Xtensa power registers are 8 bits wide on JTAG interfaces but 32 bits wide
@@ -508,6 +511,8 @@ int xtensa_dm_examine(struct xtensa_debug_module *dm);
 int xtensa_dm_queue_enable(struct xtensa_debug_module *dm);
 int xtensa_dm_queue_reg_read(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint8_t *value);
 int xtensa_dm_queue_reg_write(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint32_t value);
+int xtensa_dm_queue_reg_read_n(struct xtensa_debug_module *dm, enum xtensa_dm_reg reg, uint8_t *value,
+	unsigned int count);
 int xtensa_dm_queue_pwr_reg_read(struct xtensa_debug_module *dm,
 	enum xtensa_dm_pwr_reg reg,
 	uint8_t *data,
@@ -29,6 +29,7 @@
 
 #include "xsvf.h"
 #include "helper/system.h"
+#include <helper/binarybuffer.h>
 #include <jtag/jtag.h>
 #include <svf/svf.h>
 
@@ -109,7 +110,37 @@ TDO  (1);
 
 #define XSTATE_MAX_PATH 12
 
-static int xsvf_fd;
+/* Scans queued before the queue is executed, see xsvf_deferred_check */
+#define XSVF_MAX_DEFERRED 256
+#define XSVF_MAX_DEFERRED_BYTES (1024 * 1024)
+
+/* Buffer of the stdio stream XSVF files are read through */
+#define XSVF_FILE_BUFFER_SIZE (64 * 1024)
+
+static FILE *xsvf_file;
+
+/*
+ * XSDR and XSDRTDO without retries fail the whole file on a mismatch, so
+ * their TDO doesn't need to be checked right away. Such scans are queued
+ * along with a copy of the expected value and mask, and checked by a
+ * callback when the queue is executed, which is only done when needed.
+ */
+struct xsvf_deferred_check {
+	long file_offset;
+	const char *op_name;
+	int num_bits;
+	uint8_t *in;
+	uint8_t *expected;
+	uint8_t *mask;
+};
+
+static struct xsvf_deferred_check *xsvf_deferred[XSVF_MAX_DEFERRED];
+static unsigned int xsvf_deferred_count;
+/* All the scans queued since the last execution, checked or not */
+static unsigned int xsvf_queued_scans;
+static size_t xsvf_queued_bytes;
+/* Offset of the first scan that failed its deferred check, or -1 */
+static long xsvf_mismatch_offset;
 
 /* map xsvf tap state to an openocd "tap_state_t" */
 static tap_state_t xsvf_to_tap(int xsvf_state)
@@ -173,19 +204,111 @@ static tap_state_t xsvf_to_tap(int xsvf_state)
 	return ret;
 }
 
-static int xsvf_read_buffer(int num_bits, int fd, uint8_t *buf)
+static int xsvf_read(void *buf, size_t len)
 {
-	int num_bytes;
+	if (fread(buf, 1, len, xsvf_file) != len)
+		return ERROR_XSVF_EOF;
+	return ERROR_OK;
+}
+
+static int xsvf_read_buffer(int num_bits, uint8_t *buf)
+{
+	const size_t num_bytes = DIV_ROUND_UP(num_bits, 8);
+
+	if (xsvf_read(buf, num_bytes) != ERROR_OK)
+		return ERROR_XSVF_EOF;
 
-	for (num_bytes = (num_bits + 7) / 8; num_bytes > 0; num_bytes--) {
-		/* reverse the order of bytes as they are read sequentially from file */
-		if (read(fd, buf + num_bytes - 1, 1) < 0)
-			return ERROR_XSVF_EOF;
+	/* reverse the order of bytes as they are read sequentially from file */
+	for (size_t i = 0; i < num_bytes / 2; i++) {
+		uint8_t tmp = buf[i];
+		buf[i] = buf[num_bytes - 1 - i];
+		buf[num_bytes - 1 - i] = tmp;
 	}
 
 	return ERROR_OK;
 }
 
+static int xsvf_deferred_check_callback(jtag_callback_data_t data0,
+		jtag_callback_data_t data1, jtag_callback_data_t data2,
+		jtag_callback_data_t data3)
+{
+	const struct xsvf_deferred_check *check = (struct xsvf_deferred_check *)data0;
+
+	if (!buf_cmp_mask(check->in, check->expected, check->mask, check->num_bits))
+		return ERROR_OK;
+
+	char *in = buf_to_hex_str(check->in, check->num_bits);
+	char *expected = buf_to_hex_str(check->expected, check->num_bits);
+	char *mask = buf_to_hex_str(check->mask, check->num_bits);
+	LOG_USER("%s mismatch at offset %ld, captured 0x%s, expected 0x%s, mask 0x%s",
+			check->op_name, check->file_offset, in, expected, mask);
+	free(mask);
+	free(expected);
+	free(in);
+
+	xsvf_mismatch_offset = check->file_offset;
+	return ERROR_JTAG_QUEUE_FAILED;
+}
+
+/* Queue the TDO check of a scan, which has to capture into the returned buffer */
+static uint8_t *xsvf_defer_check(long file_offset, const char *op_name,
+		int num_bits, const uint8_t *expected, const uint8_t *mask)
+{
+	const size_t num_bytes = DIV_ROUND_UP(num_bits, 8);
+	struct xsvf_deferred_check *check = malloc(sizeof(*check) + 3 * num_bytes);
+	if (!check) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+
+	check->file_offset = file_offset;
+	check->op_name = op_name;
+	check->num_bits = num_bits;
+	check->in = (uint8_t *)(check + 1);
+	check->expected = check->in + num_bytes;
+	check->mask = check->expected + num_bytes;
+	memset(check->in, 0, num_bytes);
+	memcpy(check->expected, expected, num_bytes);
+	if (mask)
+		memcpy(check->mask, mask, num_bytes);
+	else
+		memset(check->mask, 0xff, num_bytes);
+
+	xsvf_deferred[xsvf_deferred_count++] = check;
+	jtag_add_callback4(xsvf_deferred_check_callback, (jtag_callback_data_t)check,
+			0, 0, 0);
+
+	return check->in;
+}
+
+/* Account a scan left in the queue */
+static void xsvf_queued_scan(int num_bits)
+{
+	xsvf_queued_scans++;
+	xsvf_queued_bytes += DIV_ROUND_UP(num_bits, 8);
+}
+
+/*
+ * Execute the queue, including the deferred TDO checks. If one of them
+ * fails, *file_offset is set to the offset of that scan.
+ */
+static int xsvf_execute_queue(long *file_offset)
+{
+	xsvf_mismatch_offset = -1;
+
+	int result = jtag_execute_queue();
+	if (result != ERROR_OK && xsvf_mismatch_offset >= 0)
+		*file_offset = xsvf_mismatch_offset;
+
+	for (unsigned int i = 0; i < xsvf_deferred_count; i++)
+		free(xsvf_deferred[i]);
+	xsvf_deferred_count = 0;
+	xsvf_queued_scans = 0;
+	xsvf_queued_bytes = 0;
+
+	return result;
+}
+
 COMMAND_HANDLER(handle_xsvf_command)
 {
 	uint8_t *dr_out_buf = NULL;				/* from host to device (TDI) */
@@ -244,11 +367,12 @@ COMMAND_HANDLER(handle_xsvf_command)
 		}
 	}
 
-	xsvf_fd = open(filename, O_RDONLY);
-	if (xsvf_fd < 0) {
+	xsvf_file = fopen(filename, "rb");
+	if (!xsvf_file) {
 		command_print(CMD, "file \"%s\" not found", filename);
 		return ERROR_FAIL;
 	}
+	setvbuf(xsvf_file, NULL, _IOFBF, XSVF_FILE_BUFFER_SIZE);
 
 	/* if this argument is present, then interpret xruntest counts as TCK cycles rather than as
 	 *usecs */
@@ -264,9 +388,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 	LOG_WARNING("XSVF support in OpenOCD is limited. Consider using SVF instead");
 	LOG_USER("xsvf processing file: \"%s\"", filename);
 
-	while (read(xsvf_fd, &opcode, 1) > 0) {
+	while (xsvf_read(&opcode, 1) == ERROR_OK) {
 		/* record the position of this opcode within the file */
-		file_offset = lseek(xsvf_fd, 0, SEEK_CUR) - 1;
+		file_offset = ftell(xsvf_file) - 1;
 
 		/* maybe collect another state for a pathmove();
 		 * or terminate a path.
@@ -286,7 +410,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 						break;
 					}
 
-					if (read(xsvf_fd, &uc, 1) < 0) {
+					if (xsvf_read(&uc, 1) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -334,7 +458,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 					else
 						jtag_add_pathmove(pathlen, path);
 
-					result = jtag_execute_queue();
+					result = xsvf_execute_queue(&file_offset);
 					if (result != ERROR_OK) {
 						LOG_ERROR("XSVF: pathmove error %d", result);
 						do_abort = 1;
@@ -348,7 +472,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			case XCOMPLETE:
 				LOG_DEBUG("XCOMPLETE");
 
-				result = jtag_execute_queue();
+				result = xsvf_execute_queue(&file_offset);
 				if (result != ERROR_OK) {
 					tdo_mismatch = 1;
 					break;
@@ -358,7 +482,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			case XTDOMASK:
 				LOG_DEBUG("XTDOMASK");
 				if (dr_in_mask &&
-						(xsvf_read_buffer(xsdrsize, xsvf_fd, dr_in_mask) != ERROR_OK))
+						(xsvf_read_buffer(xsdrsize, dr_in_mask) != ERROR_OK))
 					do_abort = 1;
 				break;
 
@@ -366,7 +490,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t xruntest_buf[4];
 
-				if (read(xsvf_fd, xruntest_buf, 4) < 0) {
+				if (xsvf_read(xruntest_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -380,7 +504,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t myrepeat;
 
-				if (read(xsvf_fd, &myrepeat, 1) < 0)
+				if (xsvf_read(&myrepeat, 1) != ERROR_OK)
 					do_abort = 1;
 				else {
 					xrepeat = myrepeat;
@@ -393,7 +517,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t xsdrsize_buf[4];
 
-				if (read(xsvf_fd, xsdrsize_buf, 4) < 0) {
+				if (xsvf_read(xsdrsize_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -420,14 +544,13 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				const char *op_name = (opcode == XSDR ? "XSDR" : "XSDRTDO");
 
-				if (xsvf_read_buffer(xsdrsize, xsvf_fd, dr_out_buf) != ERROR_OK) {
+				if (xsvf_read_buffer(xsdrsize, dr_out_buf) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
 
 				if (opcode == XSDRTDO) {
-					if (xsvf_read_buffer(xsdrsize, xsvf_fd,
-						dr_in_buf)  != ERROR_OK) {
+					if (xsvf_read_buffer(xsdrsize, dr_in_buf) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -438,7 +561,40 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				LOG_DEBUG("%s %d", op_name, xsdrsize);
 
-				for (attempt = 0; attempt < limit; ++attempt) {
+				if (limit == 1) {
+					/* No retry, a mismatch fails the file, check it later */
+					struct scan_field field = {
+						.num_bits = xsdrsize,
+						.out_value = dr_out_buf,
+					};
+					if (dr_in_buf) {
+						field.in_value = xsvf_defer_check(file_offset, op_name,
+								xsdrsize, dr_in_buf, dr_in_mask);
+						if (!field.in_value) {
+							do_abort = 1;
+							break;
+						}
+					}
+
+					if (!tap)
+						jtag_add_plain_dr_scan(field.num_bits,
+								field.out_value,
+								field.in_value,
+								TAP_DRPAUSE);
+					else
+						jtag_add_dr_scan(tap, 1, &field, TAP_DRPAUSE);
+					xsvf_queued_scan(field.num_bits);
+
+					matched = 1;
+				} else if (xsvf_deferred_count &&
+						xsvf_execute_queue(&file_offset) != ERROR_OK) {
+					/* The earlier scans have to match before this
+					 * one is retried */
+					tdo_mismatch = 1;
+					break;
+				}
+
+				for (attempt = 0; attempt < limit && !matched; ++attempt) {
 					struct scan_field field;
 
 					if (attempt > 0) {
@@ -489,7 +645,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 					free(field.in_value);
 
 					/* LOG_DEBUG("FLUSHING QUEUE"); */
-					result = jtag_execute_queue();
+					result = xsvf_execute_queue(&file_offset);
 					if (result == ERROR_OK) {
 						matched = 1;
 						break;
@@ -565,7 +721,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				tap_state_t mystate;
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(&uc, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -608,7 +764,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 			case XENDIR:
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(&uc, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -629,7 +785,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 			case XENDDR:
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(&uc, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -658,14 +814,14 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				if (opcode == XSIR) {
 					/* one byte bitcount */
-					if (read(xsvf_fd, short_buf, 1) < 0) {
+					if (xsvf_read(short_buf, 1) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
 					bitcount = short_buf[0];
 					LOG_DEBUG("XSIR %d", bitcount);
 				} else {
-					if (read(xsvf_fd, short_buf, 2) < 0) {
+					if (xsvf_read(short_buf, 2) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -675,7 +831,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				ir_buf = malloc((bitcount + 7) / 8);
 
-				if (xsvf_read_buffer(bitcount, xsvf_fd, ir_buf) != ERROR_OK)
+				if (xsvf_read_buffer(bitcount, ir_buf) != ERROR_OK)
 					do_abort = 1;
 				else {
 					struct scan_field field;
@@ -703,10 +859,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 					 * around the problem.
 					 */
 
-					/* LOG_DEBUG("FLUSHING QUEUE"); */
-					result = jtag_execute_queue();
-					if (result != ERROR_OK)
-						tdo_mismatch = 1;
+					/* The queue is executed once enough scans are
+					 * pending, see below */
+					xsvf_queued_scan(field.num_bits);
 				}
 				free(ir_buf);
 			}
@@ -718,7 +873,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				char comment[128];
 
 				do {
-					if (read(xsvf_fd, &uc, 1) < 0) {
+					if (xsvf_read(&uc, 1) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -748,9 +903,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 				tap_state_t end_state;
 				int delay;
 
-				if (read(xsvf_fd, &wait_local, 1) < 0
-					|| read(xsvf_fd, &end, 1) < 0
-					|| read(xsvf_fd, delay_buf, 4) < 0) {
+				if (xsvf_read(&wait_local, 1) != ERROR_OK
+					|| xsvf_read(&end, 1) != ERROR_OK
+					|| xsvf_read(delay_buf, 4) != ERROR_OK) {
 						do_abort = 1;
 						break;
 				}
@@ -793,10 +948,10 @@ COMMAND_HANDLER(handle_xsvf_command)
 				int clock_count;
 				int usecs;
 
-				if (read(xsvf_fd, &wait_local, 1) < 0
-						||  read(xsvf_fd, &end, 1) < 0
-						||  read(xsvf_fd, clock_buf, 4) < 0
-						||  read(xsvf_fd, usecs_buf, 4) < 0) {
+				if (xsvf_read(&wait_local, 1) != ERROR_OK
+						||  xsvf_read(&end, 1) != ERROR_OK
+						||  xsvf_read(clock_buf, 4) != ERROR_OK
+						||  xsvf_read(usecs_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -845,7 +1000,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				*/
 				uint8_t count_buf[4];
 
-				if (read(xsvf_fd, count_buf, 4) < 0) {
+				if (xsvf_read(count_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -864,9 +1019,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 				uint8_t clock_buf[4];
 				uint8_t usecs_buf[4];
 
-				if (read(xsvf_fd, &state, 1) < 0
-						|| read(xsvf_fd, clock_buf, 4) < 0
-						|| read(xsvf_fd, usecs_buf, 4) < 0) {
+				if (xsvf_read(&state, 1) != ERROR_OK
+						|| xsvf_read(clock_buf, 4) != ERROR_OK
+						|| xsvf_read(usecs_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -892,8 +1047,8 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				LOG_DEBUG("LSDR");
 
-				if (xsvf_read_buffer(xsdrsize, xsvf_fd, dr_out_buf) != ERROR_OK
-						|| xsvf_read_buffer(xsdrsize, xsvf_fd, dr_in_buf) != ERROR_OK) {
+				if (xsvf_read_buffer(xsdrsize, dr_out_buf) != ERROR_OK
+						|| xsvf_read_buffer(xsdrsize, dr_in_buf) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -901,6 +1056,11 @@ COMMAND_HANDLER(handle_xsvf_command)
 				if (limit < 1)
 					limit = 1;
 
+				if (xsvf_deferred_count && xsvf_execute_queue(&file_offset) != ERROR_OK) {
+					tdo_mismatch = 1;
+					break;
+				}
+
 				for (attempt = 0; attempt < limit; ++attempt) {
 					struct scan_field field;
 
@@ -933,7 +1093,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 
 					/* LOG_DEBUG("FLUSHING QUEUE"); */
-					result = jtag_execute_queue();
+					result = xsvf_execute_queue(&file_offset);
 					if (result == ERROR_OK) {
 						matched = 1;
 						break;
@@ -952,7 +1112,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t trst_mode;
 
-				if (read(xsvf_fd, &trst_mode, 1) < 0) {
+				if (xsvf_read(&trst_mode, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -979,6 +1139,15 @@ COMMAND_HANDLER(handle_xsvf_command)
 				unsupported = 1;
 		}
 
+		/* Execute the queued scans once there are enough of them, which
+		 * also checks the TDO of the deferred ones */
+		if (!do_abort && !unsupported && !tdo_mismatch &&
+				(xsvf_queued_scans >= XSVF_MAX_DEFERRED ||
+				xsvf_queued_bytes >= XSVF_MAX_DEFERRED_BYTES)) {
+			if (xsvf_execute_queue(&file_offset) != ERROR_OK)
+				tdo_mismatch = 1;
+		}
+
 		if (do_abort || unsupported || tdo_mismatch) {
 			LOG_DEBUG("xsvf failed, setting taps to reasonable state");
 
@@ -986,31 +1155,45 @@ COMMAND_HANDLER(handle_xsvf_command)
 			result = svf_add_statemove(TAP_IDLE);
 			if (result != ERROR_OK)
 				return result;
-			result = jtag_execute_queue();
-			if (result != ERROR_OK)
-				return result;
+			result = xsvf_execute_queue(&file_offset);
+			if (result != ERROR_OK) {
+				/* a pending scan may have failed its check */
+				if (xsvf_mismatch_offset < 0) {
+					fclose(xsvf_file);
+					return result;
+				}
+				tdo_mismatch = 1;
+			}
 			break;
 		}
 	}
 
+	/* The file may end without XCOMPLETE, check what is still queued */
+	if (!do_abort && !unsupported && !tdo_mismatch &&
+			xsvf_execute_queue(&file_offset) != ERROR_OK)
+		tdo_mismatch = 1;
+
 	if (tdo_mismatch) {
 		command_print(CMD,
 			"TDO mismatch, somewhere near offset %lu in xsvf file, aborting",
 			file_offset);
 
+		fclose(xsvf_file);
 		return ERROR_FAIL;
 	}
 
 	if (unsupported) {
-		off_t offset = lseek(xsvf_fd, 0, SEEK_CUR) - 1;
+		long offset = ftell(xsvf_file) - 1;
 		command_print(CMD,
-			"unsupported xsvf command (0x%02X) at offset %jd, aborting",
-			uc, (intmax_t)offset);
+			"unsupported xsvf command (0x%02X) at offset %ld, aborting",
+			uc, offset);
+		fclose(xsvf_file);
 		return ERROR_FAIL;
 	}
 
 	if (do_abort) {
 		command_print(CMD, "premature end of xsvf file detected, aborting");
+		fclose(xsvf_file);
 		return ERROR_FAIL;
 	}
 
@@ -1018,7 +1201,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 	free(dr_in_buf);
 	free(dr_in_mask);
 
-	close(xsvf_fd);
+	fclose(xsvf_file);
 
 	command_print(CMD, "XSVF file programmed successfully");
 
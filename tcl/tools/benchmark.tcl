@@ -0,0 +1,252 @@
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+# Description:
+#  Measure the performance of the debug transport on the current target:
+#  memory throughput per access method, register read latency, run control
+#  latency, flash program and verify rates and RTT throughput. Every result
+#  is JSON, so that reports from different OpenOCD versions, adapters and
+#  firmware can be compared with scripts.
+#
+#  Each measurement is repeated and all the times are reported together
+#  with the best and the median one, in milliseconds. The data written to
+#  memory is a fixed pattern, so runs are reproducible.
+#
+# Example:
+#  benchmark report bench.json {memory 0x20000000 0x10000} registers run_control
+
+proc benchmark_json_string {s} {
+	return "\"[string map {"\\" "\\\\" "\"" "\\\"" "\n" "\\n" "\r" "\\r" "\t" "\\t"} $s]\""
+}
+
+# Build an object from a list of keys and already encoded values.
+proc benchmark_json_object {pairs} {
+	set members {}
+	foreach {key value} $pairs {
+		lappend members "[benchmark_json_string $key]: $value"
+	}
+	return "\{[join $members {, }]\}"
+}
+
+proc benchmark_json_array {values} {
+	return "\[[join $values {, }]\]"
+}
+
+# Run "script" in the caller's scope "iterations" times, return the sorted
+# durations in ms.
+proc benchmark_time {iterations script} {
+	set times {}
+	for {set i 0} {$i < $iterations} {incr i} {
+		set start [ms]
+		uplevel 1 $script
+		lappend times [expr {[ms] - $start}]
+	}
+	return [lsort -integer $times]
+}
+
+# JSON members describing sorted "times", and the rate for "bytes" if given.
+proc benchmark_timing {times {bytes 0}} {
+	set best [lindex $times 0]
+	set median [lindex $times [expr {[llength $times] / 2}]]
+	set pairs [list times_ms [benchmark_json_array $times] best_ms $best median_ms $median]
+	if {$bytes} {
+		if {$best > 0} {
+			set rate [format %.1f [expr {$bytes / 1024.0 / ($best / 1000.0)}]]
+		} else {
+			set rate null
+		}
+		lappend pairs bytes $bytes kib_per_s $rate
+	}
+	return $pairs
+}
+
+proc benchmark_target_type {t} {
+	return [$t cget -type]
+}
+
+proc benchmark_memory_methods {t} {
+	set type [benchmark_target_type $t]
+	if {$type eq "riscv"} {
+		return {progbuf sysbus abstract}
+	}
+	if {[string match cortex_* $type] || [string match arm* $type] ||
+			[string match aarch64 $type]} {
+		return {mem_ap}
+	}
+	return {default}
+}
+
+proc benchmark_register_names {t} {
+	if {[benchmark_target_type $t] eq "riscv"} {
+		return {ra sp gp tp t0 t1 t2 fp s1 a0 a1 a2 a3 a4 a5 a6 a7
+			s2 s3 s4 s5 s6 s7 s8 s9 s10 s11 t3 t4 t5 t6 pc}
+	}
+	return {r0 r1 r2 r3 r4 r5 r6 r7 r8 r9 r10 r11 r12 sp lr pc}
+}
+
+# Write and read "size" bytes at "address" with 32-bit accesses, once per
+# memory access method of the target. The memory is overwritten.
+proc benchmark_memory {address size {iterations 5}} {
+	set t [target current]
+	set count [expr {$size / 4}]
+	set size [expr {$count * 4}]
+	set data {}
+	for {set i 0} {$i < $count} {incr i} {
+		lappend data [expr {($i * 0x9e3779b1 + 0x12345678) & 0xffffffff}]
+	}
+
+	set type [benchmark_target_type $t]
+	set results {}
+	foreach method [benchmark_memory_methods $t] {
+		set pairs [list method [benchmark_json_string $method]]
+		if {$type eq "riscv" && [catch {$t riscv set_mem_access $method} err]} {
+			lappend pairs error [benchmark_json_string $err]
+			lappend results [benchmark_json_object $pairs]
+			continue
+		}
+		foreach op {write read} {
+			if {$op eq "write"} {
+				set script {$t write_memory $address 32 $data}
+			} else {
+				set script {set read [$t read_memory $address 32 $count]}
+			}
+			if {[catch {benchmark_time $iterations $script} times]} {
+				lappend pairs $op [benchmark_json_object [list error [benchmark_json_string $times]]]
+				continue
+			}
+			lappend pairs $op [benchmark_json_object [benchmark_timing $times $size]]
+		}
+		if {[info exists read]} {
+			lappend pairs verified [expr {$read eq $data ? "true" : "false"}]
+			unset read
+		}
+		lappend results [benchmark_json_object $pairs]
+	}
+
+	# There's no way to query the previous order, go back to the default.
+	if {$type eq "riscv"} {
+		$t riscv set_mem_access progbuf sysbus abstract
+	}
+
+	return [benchmark_json_array $results]
+}
+
+# Latency of reading one register and the whole general register file,
+# bypassing the register cache.
+proc benchmark_registers {{iterations 20}} {
+	set t [target current]
+	set regs [benchmark_register_names $t]
+	set single [benchmark_time $iterations {$t get_reg -force pc}]
+	set all [benchmark_time $iterations {$t get_reg -force $regs}]
+	return [benchmark_json_object [list \
+		single [benchmark_json_object [concat [list register [benchmark_json_string pc]] \
+			[benchmark_timing $single]]] \
+		file [benchmark_json_object [concat [list registers [llength $regs]] \
+			[benchmark_timing $all]]]]]
+}
+
+# Latency of halt, resume and single step. The target runs its own code.
+proc benchmark_run_control {{iterations 10}} {
+	halt
+	set steps [benchmark_time $iterations {step}]
+	set resumes {}
+	set halts {}
+	for {set i 0} {$i < $iterations} {incr i} {
+		set start [ms]
+		resume
+		lappend resumes [expr {[ms] - $start}]
+		set start [ms]
+		halt
+		lappend halts [expr {[ms] - $start}]
+	}
+	return [benchmark_json_object [list \
+		step [benchmark_json_object [benchmark_timing $steps]] \
+		resume [benchmark_json_object [benchmark_timing [lsort -integer $resumes]]] \
+		halt [benchmark_json_object [benchmark_timing [lsort -integer $halts]]]]]
+}
+
+# Read "size" bytes of flash bank "bank" at "offset" to "tmpfile", then
+# erase and program the same data back and verify it. The contents of the
+# flash are preserved.
+proc benchmark_flash {bank offset size tmpfile} {
+	set base [dict get [lindex [flash list] $bank] base]
+	set address [expr {$base + $offset}]
+
+	set read [benchmark_time 1 {flash read_bank $bank $tmpfile $offset $size}]
+	set program [benchmark_time 1 {flash write_image erase $tmpfile $address bin}]
+	set verify [benchmark_time 1 {flash verify_bank $bank $tmpfile $offset}]
+	return [benchmark_json_object [list \
+		bank $bank \
+		read [benchmark_json_object [benchmark_timing $read $size]] \
+		erase_program [benchmark_json_object [benchmark_timing $program $size]] \
+		verify [benchmark_json_object [benchmark_timing $verify $size]]]]
+}
+
+proc benchmark_rtt_bytes {channel} {
+	foreach line [split [rtt statistics] "\n"] {
+		if {[regexp {^([0-9]+): bytes ([0-9]+)} $line -> ch bytes] && $ch == $channel} {
+			return $bytes
+		}
+	}
+	error "rtt: no statistics for up-channel $channel"
+}
+
+# Bytes received on RTT up-channel "channel" while the target runs for
+# "duration" ms. RTT has to be set up and started already.
+proc benchmark_rtt {channel duration} {
+	set before [benchmark_rtt_bytes $channel]
+	set start [ms]
+	sleep $duration
+	set elapsed [expr {[ms] - $start}]
+	set bytes [expr {[benchmark_rtt_bytes $channel] - $before}]
+	return [benchmark_json_object [list \
+		channel $channel \
+		duration_ms $elapsed \
+		bytes $bytes \
+		kib_per_s [format %.1f [expr {$bytes / 1024.0 / ($elapsed / 1000.0)}]]]]
+}
+
+# Run the given suites, each a list of a benchmark name and its arguments,
+# and write one JSON report describing the setup and the results to "file".
+proc benchmark_report {file args} {
+	set t [target current]
+	set speed null
+	regexp {([0-9]+)} [adapter speed] -> speed
+
+	set results {}
+	foreach suite $args {
+		set name [lindex $suite 0]
+		if {[catch {benchmark {*}$suite} result]} {
+			set result [benchmark_json_object [list error [benchmark_json_string $result]]]
+		}
+		lappend results $name $result
+	}
+
+	set report [benchmark_json_object [list \
+		openocd [benchmark_json_string [version]] \
+		timestamp [clock seconds] \
+		adapter [benchmark_json_string [adapter name]] \
+		adapter_khz $speed \
+		transport [benchmark_json_string [transport select]] \
+		target [benchmark_json_string $t] \
+		target_type [benchmark_json_string [benchmark_target_type $t]] \
+		results [benchmark_json_object $results]]]
+
+	set f [open $file w]
+	puts $f $report
+	close $f
+	return $report
+}
+
+add_help_text benchmark "Measure the debug transport performance, results are JSON"
+add_usage_text benchmark {memory address size [iterations] | registers [iterations] | run_control [iterations] | flash bank offset size tmpfile | rtt channel ms | report file suite ...}
+proc benchmark {what args} {
+	switch -- $what {
+		memory { return [benchmark_memory {*}$args] }
+		registers { return [benchmark_registers {*}$args] }
+		run_control { return [benchmark_run_control {*}$args] }
+		flash { return [benchmark_flash {*}$args] }
+		rtt { return [benchmark_rtt {*}$args] }
+		report { return [benchmark_report {*}$args] }
+	}
+	error "benchmark: unknown benchmark '$what'"
+}